@@ -0,0 +1,210 @@
+// Copyright CERN and copyright holders of ALICE O2. This software is
+// distributed under the terms of the GNU General Public License v3 (GPL
+// Version 3), copied verbatim in the file "COPYING".
+//
+// See http://alice-o2.web.cern.ch/license for full licensing information.
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#include "CruDataGenerator.h"
+
+#include <DataDistLogger.h>
+
+#include <Headers/RAWDataHeader.h>
+
+#include <random>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+namespace o2::DataDistribution
+{
+
+// upper limit of memory used for patterns of one link
+static constexpr std::size_t cMaxPatternMemory = std::size_t(64) << 20;
+// HB and ORBIT trigger bits
+static constexpr std::uint32_t cHbTriggerType = 0x3;
+
+bool CruDataGeneratorConfig::parseOccupancy(const std::string &pStr, Occupancy &pOcc)
+{
+  if (pStr == "fixed") {
+    pOcc = eOccupancyFixed;
+  } else if (pStr == "uniform") {
+    pOcc = eOccupancyUniform;
+  } else if (pStr == "normal") {
+    pOcc = eOccupancyNormal;
+  } else if (pStr == "exponential") {
+    pOcc = eOccupancyExponential;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+CruLinkDataGenerator::CruLinkDataGenerator(const CruDataGeneratorConfig &pConfig, const std::uint64_t pLinkId,
+  const std::uint8_t pSystemId, const std::size_t pNominalHbfSize, const std::size_t pMaxHbfSize)
+  : mConfig(pConfig),
+    mLinkId(pLinkId),
+    mSystemId(pSystemId)
+{
+  switch (mConfig.mRdhVersion) {
+    case 3:
+    case 4:
+      generate<o2::header::RAWDataHeaderV4>(pNominalHbfSize, pMaxHbfSize);
+      break;
+    case 5:
+      generate<o2::header::RAWDataHeaderV5>(pNominalHbfSize, pMaxHbfSize);
+      break;
+    case 6:
+      generate<o2::header::RAWDataHeaderV6>(pNominalHbfSize, pMaxHbfSize);
+      break;
+    default:
+      EDDLOG("CruLinkDataGenerator: unsupported RDH version. version={}", mConfig.mRdhVersion);
+      throw std::invalid_argument("Unsupported RDH version");
+  }
+}
+
+template <typename RDH>
+void CruLinkDataGenerator::generate(const std::size_t pNominalHbfSize, const std::size_t pMaxHbfSize)
+{
+  constexpr std::size_t cRdhSize = sizeof(RDH);
+  const std::size_t lPageSize = mConfig.mPageSize;
+  const std::size_t lPagePayload = (lPageSize - cRdhSize) & ~std::size_t(15); // GBT words
+  // data pages and the stop page must fit
+  const std::size_t lMaxDataPages = std::max(std::size_t(1), (pMaxHbfSize - cRdhSize) / lPageSize);
+  const std::size_t lMaxPayload = lMaxDataPages * lPagePayload;
+
+  std::mt19937_64 lGen(0x0DDA7A00 + mLinkId);
+  std::uniform_real_distribution<double> lUniform01(0.0, 1.0);
+  std::uniform_real_distribution<double> lUniformOcc(mConfig.mOccupancyMean - mConfig.mOccupancySigma,
+    mConfig.mOccupancyMean + mConfig.mOccupancySigma);
+  std::normal_distribution<double> lNormalOcc(mConfig.mOccupancyMean, std::max(mConfig.mOccupancySigma, 1e-9));
+  std::exponential_distribution<double> lExpOcc(1.0 / std::max(mConfig.mOccupancyMean, 1e-9));
+
+  auto lSampleOccupancy = [&]() -> double {
+    switch (mConfig.mOccupancy) {
+      case CruDataGeneratorConfig::eOccupancyUniform: return lUniformOcc(lGen);
+      case CruDataGeneratorConfig::eOccupancyNormal: return lNormalOcc(lGen);
+      case CruDataGeneratorConfig::eOccupancyExponential: return lExpOcc(lGen);
+      default: return mConfig.mOccupancyMean;
+    }
+  };
+
+  auto lWriteRdh = [&](char *pDst, const std::size_t pMemSize, const std::size_t pOffsetToNext,
+    const std::size_t pPageCnt, const bool pStop) {
+    RDH lRdh;
+    lRdh.feeId = std::uint16_t(mConfig.mFeeIdBase + mLinkId);
+    lRdh.linkID = std::uint8_t(mLinkId & 0xFF);
+    lRdh.cruID = 0xEEE;
+    lRdh.endPointID = 0;
+    lRdh.memorySize = std::uint16_t(pMemSize);
+    lRdh.offsetToNext = std::uint16_t(pOffsetToNext);
+    lRdh.pageCnt = std::uint16_t(pPageCnt);
+    lRdh.stop = pStop ? 1 : 0;
+    lRdh.triggerType = cHbTriggerType;
+    if constexpr (std::is_same_v<RDH, o2::header::RAWDataHeaderV6>) {
+      lRdh.sourceID = mSystemId;
+    }
+    std::memcpy(pDst, &lRdh, cRdhSize);
+  };
+
+  std::size_t lTotalSize = 0;
+
+  while (mPatterns.size() < std::max(std::size_t(1), mConfig.mNumPatterns)) {
+    const bool lEmpty = lUniform01(lGen) < mConfig.mEmptyHbfFraction;
+
+    std::size_t lPayload = 0;
+    if (!lEmpty) {
+      const double lOcc = std::max(0.0, lSampleOccupancy());
+      lPayload = std::min(lMaxPayload, std::size_t(lOcc * double(pNominalHbfSize))) & ~std::size_t(15);
+    }
+
+    const std::size_t lNumDataPages = lEmpty ? 1 : std::max(std::size_t(1), (lPayload + lPagePayload - 1) / lPagePayload);
+    const std::size_t lSize = lEmpty ? (2 * cRdhSize) : (lNumDataPages * lPageSize + cRdhSize);
+
+    if (!mPatterns.empty() && (lTotalSize + lSize) > cMaxPatternMemory) {
+      break;
+    }
+
+    Pattern lPattern{ mData.size(), lSize, mPageOffsets.size(), lNumDataPages + 1 };
+    mData.resize(mData.size() + lSize, 0);
+    char *lHbf = mData.data() + lPattern.mDataOffset;
+
+    if (lEmpty) {
+      // trigger mode: HBF without payload is two header-only RDHs
+      lWriteRdh(lHbf, cRdhSize, cRdhSize, 0, false);
+      lWriteRdh(lHbf + cRdhSize, cRdhSize, cRdhSize, 1, true);
+      mPageOffsets.push_back(0);
+      mPageOffsets.push_back(cRdhSize);
+    } else {
+      std::size_t lRemaining = lPayload;
+      for (std::size_t p = 0; p < lNumDataPages; p++) {
+        const std::size_t lPageData = std::min(lRemaining, lPagePayload);
+        char *lPage = lHbf + p * lPageSize;
+
+        lWriteRdh(lPage, cRdhSize + lPageData, lPageSize, p, false);
+        // ADC-like payload: 10 bit samples
+        for (std::size_t w = 0; w < lPageData; w += sizeof(std::uint64_t)) {
+          const std::uint64_t lWord = lGen() & 0x03FF03FF03FF03FFULL;
+          std::memcpy(lPage + cRdhSize + w, &lWord, sizeof(std::uint64_t));
+        }
+        lRemaining -= lPageData;
+        mPageOffsets.push_back(std::uint32_t(p * lPageSize));
+      }
+      // stop page
+      lWriteRdh(lHbf + lNumDataPages * lPageSize, cRdhSize, cRdhSize, lNumDataPages, true);
+      mPageOffsets.push_back(std::uint32_t(lNumDataPages * lPageSize));
+    }
+
+    lTotalSize += lSize;
+    mPatterns.push_back(lPattern);
+  }
+
+  mMeanHbfSize = double(lTotalSize) / double(mPatterns.size());
+
+  DDDLOG("CruLinkDataGenerator: link_id={} rdh_version={} patterns={} mean_hbf_size={:.1f} memory={}",
+    mLinkId, mConfig.mRdhVersion, mPatterns.size(), mMeanHbfSize, lTotalSize);
+}
+
+template <typename RDH>
+void CruLinkDataGenerator::patch(char *pDst, const Pattern &pPattern, const std::uint32_t pOrbit)
+{
+  for (std::size_t p = 0; p < pPattern.mNumPages; p++) {
+    RDH *lRdh = reinterpret_cast<RDH*>(pDst + mPageOffsets[pPattern.mPageOffset + p]);
+    if constexpr (std::is_same_v<RDH, o2::header::RAWDataHeaderV4>) {
+      lRdh->heartbeatOrbit = pOrbit;
+      lRdh->triggerOrbit = pOrbit;
+    } else {
+      lRdh->orbit = pOrbit;
+    }
+    lRdh->packetCounter = mPacketCounter++;
+  }
+}
+
+std::size_t CruLinkDataGenerator::writeNext(char *pDst, const std::uint32_t pOrbit)
+{
+  const Pattern &lPattern = mPatterns[mNextPattern];
+  mNextPattern = (mNextPattern + 1) % mPatterns.size();
+
+  std::memcpy(pDst, mData.data() + lPattern.mDataOffset, lPattern.mSize);
+
+  switch (mConfig.mRdhVersion) {
+    case 5:
+      patch<o2::header::RAWDataHeaderV5>(pDst, lPattern, pOrbit);
+      break;
+    case 6:
+      patch<o2::header::RAWDataHeaderV6>(pDst, lPattern, pOrbit);
+      break;
+    default:
+      patch<o2::header::RAWDataHeaderV4>(pDst, lPattern, pOrbit);
+      break;
+  }
+
+  return lPattern.mSize;
+}
+
+}  /* namespace o2::DataDistribution */
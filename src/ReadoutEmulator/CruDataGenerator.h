@@ -0,0 +1,89 @@
+// Copyright CERN and copyright holders of ALICE O2. This software is
+// distributed under the terms of the GNU General Public License v3 (GPL
+// Version 3), copied verbatim in the file "COPYING".
+//
+// See http://alice-o2.web.cern.ch/license for full licensing information.
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#ifndef ALICEO2_CRU_DATA_GENERATOR_H_
+#define ALICEO2_CRU_DATA_GENERATOR_H_
+
+#include <cstdint>
+#include <vector>
+#include <string>
+
+namespace o2::DataDistribution
+{
+
+struct CruDataGeneratorConfig {
+  enum Occupancy {
+    eOccupancyFixed,
+    eOccupancyUniform,      // [mean - sigma, mean + sigma]
+    eOccupancyNormal,
+    eOccupancyExponential   // mean only
+  };
+
+  unsigned mRdhVersion = 6;
+  std::size_t mPageSize = 8192;
+  Occupancy mOccupancy = eOccupancyFixed;
+  double mOccupancyMean = 1.0;    // relative to the nominal HBF size
+  double mOccupancySigma = 0.0;   // relative to the nominal HBF size
+  double mEmptyHbfFraction = 0.0; // trigger mode: HBFs without payload
+  std::uint16_t mFeeIdBase = 0;
+  std::size_t mNumPatterns = 256;
+
+  static bool parseOccupancy(const std::string &pStr, Occupancy &pOcc);
+};
+
+/// Pre-generated RDH page chains (HBFs) of one CRU link
+///
+/// Each pattern is a complete HBF: data pages of mPageSize with memorySize, offsetToNext and pageCnt
+/// set, closed by a header-only stop page. Empty trigger-mode HBFs are two header-only RDHs.
+/// Only the orbit and the packet counter are patched when a pattern is copied into a superpage.
+class CruLinkDataGenerator
+{
+ public:
+  CruLinkDataGenerator() = delete;
+  CruLinkDataGenerator(const CruDataGeneratorConfig &pConfig, const std::uint64_t pLinkId,
+    const std::uint8_t pSystemId, const std::size_t pNominalHbfSize, const std::size_t pMaxHbfSize);
+
+  /// size of the next HBF
+  std::size_t nextSize() const { return mPatterns[mNextPattern].mSize; }
+
+  /// copy the next HBF to pDst and advance. Returns the HBF size
+  std::size_t writeNext(char *pDst, const std::uint32_t pOrbit);
+
+  double meanHbfSize() const { return mMeanHbfSize; }
+
+ private:
+  struct Pattern {
+    std::size_t mDataOffset;
+    std::size_t mSize;
+    std::size_t mPageOffset; // into mPageOffsets
+    std::size_t mNumPages;
+  };
+
+  template <typename RDH>
+  void generate(const std::size_t pNominalHbfSize, const std::size_t pMaxHbfSize);
+
+  template <typename RDH>
+  void patch(char *pDst, const Pattern &pPattern, const std::uint32_t pOrbit);
+
+  const CruDataGeneratorConfig mConfig;
+  const std::uint64_t mLinkId;
+  const std::uint8_t mSystemId;
+
+  std::vector<char> mData;
+  std::vector<std::uint32_t> mPageOffsets;
+  std::vector<Pattern> mPatterns;
+  std::size_t mNextPattern = 0;
+  std::uint8_t mPacketCounter = 0;
+  double mMeanHbfSize = 0;
+};
+
+}  /* namespace o2::DataDistribution */
+
+#endif /* ALICEO2_CRU_DATA_GENERATOR_H_ */
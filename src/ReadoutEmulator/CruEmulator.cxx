@@ -28,125 +28,110 @@ namespace DataDistribution
 {
 
 void CruLinkEmulator::linkReadoutThread()
+{
+  while (mRunning) {
+    if (!generateData()) {
+      usleep(500);
+    }
+  }
+
+  DDDLOG("Exiting ReadoutEmulator thread.");
+}
+
+bool CruLinkEmulator::generateData()
 {
   static const std::uint64_t cHBFrameFreq = 11223;
 
   const auto cSuperpageSize = mMemHandler->getSuperpageSize();
-  const auto cHBFrameSize = (mLinkBitsPerS / cHBFrameFreq) >> 3;
-  const auto cStfLinkSize = cHBFrameSize * cHBFrameFreq * 256 / cHBFrameFreq;
-  const auto cNumDmaChunkPerSuperpage = std::min(size_t(256), size_t(cSuperpageSize / mDmaChunkSize));
+  const auto cStfLinkSize = std::uint64_t(mDataGenerator.meanHbfSize() * 256);
   constexpr int64_t cStfTimeUs = std::chrono::microseconds(std::uint64_t(1000000) * 256 / cHBFrameFreq).count();
 
-  DDDLOG("Superpage size: {}", cSuperpageSize);
-  DDDLOG("mDmaChunkSize size: {}", mDmaChunkSize);
-  DDDLOG("HBFrameSize size: {}", cHBFrameSize);
-  DDDLOG("StfLinkSize size: {}", cStfLinkSize);
-  DDDLOG("cNumDmaChunkPerSuperpage: {}", cNumDmaChunkPerSuperpage);
-  DDDLOG("Sleep time us: {}", cStfTimeUs);
-
   // os might sleep much longer than requested
   // keep count of transmitted pages and adjust when needed
-  int64_t lSentStf = 0;
-  using hres_clock = std::chrono::high_resolution_clock;
-  const auto lOpStart = hres_clock::now();
+  const int64_t lUsSinceStart = std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - mOpStart).count();
+  const int64_t lStfToSend = lUsSinceStart / cStfTimeUs - mSentStf;
 
-  std::vector<CRUSuperpage> lSuperpages;
+  if (lStfToSend <= 0) {
+    return false;
+  }
 
-  while (mRunning) {
+  if (lStfToSend > 1) {
+    WDDLOG_RL(1000, "Data producer is running slow. link_id={} StfBacklog: {}", mLinkID, lStfToSend);
+  }
 
-    const int64_t lUsSinceStart = std::chrono::duration_cast<std::chrono::microseconds>(hres_clock::now() - lOpStart).count();
-    const int64_t lStfToSend = lUsSinceStart / cStfTimeUs - lSentStf;
+  const std::int64_t lPagesToSend = std::max(lStfToSend, int64_t(lStfToSend * (cStfLinkSize + cSuperpageSize - 1) / cSuperpageSize));
 
-    if (lStfToSend <= 0) {
-      usleep(500);
-      continue;
-    }
+  // request enough superpages (can be less!)
+  if (std::int64_t(mSuperpages.size()) < lPagesToSend) {
+    mMemHandler->getSuperpages(std::max(lPagesToSend, std::int64_t(32)), std::back_inserter(mSuperpages));
+  }
 
-    if (lStfToSend > 1 || lStfToSend < 0) {
-      WDDLOG("Data producer is running slow. StfBacklog: {}", lStfToSend);
-    }
+  for (int64_t stf = 0; stf < lStfToSend; stf++, mSentStf++) {
+    auto lHbfToSend = 256;
+
+    while (lHbfToSend > 0) {
+      if (!mSuperpages.empty()) {
+        CRUSuperpage sp = mSuperpages.back();
+        mSuperpages.pop_back();
+
+        // Enumerate valid data and create work-item for STFBuilder
+        // Each channel is reported separately to the O2
+        ReadoutLinkO2Data linkO2Data;
+
+        linkO2Data.mLinkHeader.mSystemId = mSystemId;
+        linkO2Data.mLinkHeader.mFeeId = 0xFEE0;
+        linkO2Data.mLinkHeader.mEquipmentId = 0xE1D0; // ?
+        linkO2Data.mLinkHeader.mLinkId = mLinkID;
+        linkO2Data.mLinkHeader.mFlags.mIsRdhFormat = 1;
+
+        // HBFrames are placed back to back, as the CRU does
+        std::size_t lSpOffset = 0;
+        while (lHbfToSend > 0 && (lSpOffset + mDataGenerator.nextSize()) <= cSuperpageSize) {
+          char *lHbf = sp.mDataVirtualAddress + lSpOffset;
+          const auto lHbfSize = mDataGenerator.writeNext(lHbf, mOrbit++);
+
+          linkO2Data.mLinkRawData.push_back(CruDmaPacket{
+            mMemHandler->getDataRegion(),
+            lHbf,     // Valid data DMA Chunk <superpage offset + length>
+            lHbfSize
+          });
+
+          lSpOffset += lHbfSize;
+          lHbfToSend--;
+        }
 
-    const std::int64_t lPagesToSend = std::max(lStfToSend, int64_t(lStfToSend * (cStfLinkSize + cSuperpageSize - 1) / cSuperpageSize));
+        // Put the link info data into the send queue
+        mMemHandler->putLinkData(std::move(linkO2Data));
 
-    // request enough superpages (can be less!)
-    std::int64_t lPagesAvail = lSuperpages.size();
-    if (lPagesAvail < lPagesToSend) {
-      lPagesAvail += mMemHandler->getSuperpages(std::max(lPagesToSend, std::int64_t(32)), std::back_inserter(lSuperpages));
-      assert(std::size_t(lPagesAvail) == lSuperpages.size());
-    }
-    lPagesAvail = lSuperpages.size();
-
-    for (int64_t stf = 0; stf < lStfToSend; stf++, lSentStf++) {
-      auto lHbfToSend = 256;
-
-      while (lHbfToSend > 0) {
-        if (!lSuperpages.empty()) {
-          CRUSuperpage sp = lSuperpages.back();
-          lSuperpages.pop_back();
-
-          // Enumerate valid data and create work-item for STFBuilder
-          // Each channel is reported separately to the O2
-          ReadoutLinkO2Data linkO2Data;
-
-          linkO2Data.mLinkHeader.mSystemId = (rand() % 100 < 70) ? o2::header::DAQID::TPC : o2::header::DAQID::ITS;
-          linkO2Data.mLinkHeader.mFeeId = 0xFEE0;
-          linkO2Data.mLinkHeader.mEquipmentId = 0xE1D0; // ?
-          linkO2Data.mLinkHeader.mLinkId = mLinkID;
-          linkO2Data.mLinkHeader.mFlags.mIsRdhFormat = 1;
-
-          for (unsigned d = 0; d < cNumDmaChunkPerSuperpage; d++, lHbfToSend--) {
-
-            if (lHbfToSend == 0)
-              break; // start a new superpage
-
-            // make set few bits for the RDHv4 packet to keep SubTimeFrame builder happy
-            {
-              char *lRdh = reinterpret_cast<char*>(sp.mDataVirtualAddress + (d * mDmaChunkSize));
-              // version
-              std::uint32_t lVer = 0x00000004;
-              std::memcpy(lRdh, &lVer, sizeof(std::uint32_t));
-
-              // cru, linkid, ep
-              std::uint32_t lEquipment = 0;
-              lEquipment = (
-                (std::uint32_t(0xEEE) << 16) |  /* CRU, 12bit */
-                (std::uint32_t(0x0) << 28) |    /* endpoint id */
-                (std::uint32_t(mLinkID) & 0xFF) /* linkID, 8 bit */
-              );
-
-              std::memcpy(lRdh+12, &lEquipment, sizeof(std::uint32_t));
-            }
-
-            linkO2Data.mLinkRawData.push_back(CruDmaPacket{
-              mMemHandler->getDataRegion(),
-              sp.mDataVirtualAddress + (d * mDmaChunkSize),        // Valid data DMA Chunk <superpage offset + length>
-              mDmaChunkSize /* - (rand() % (mDmaChunkSize / 10))*/ // This should be taken from desc->mRawDataSize (filled by the CRU)
-            });
-          }
-
-          // Put the link info data into the send queue
-          mMemHandler->putLinkData(std::move(linkO2Data));
-
-        } else {
-          // signal lost data (no free superpages)
-          ReadoutLinkO2Data linkO2Data;
-          linkO2Data.mLinkHeader.mFlags.mIsRdhFormat = 0;
-
-          mMemHandler->putLinkData(std::move(linkO2Data));
-          break;
-        }
+      } else {
+        // signal lost data (no free superpages)
+        mOrbit += lHbfToSend;
+        ReadoutLinkO2Data linkO2Data;
+        linkO2Data.mLinkHeader.mFlags.mIsRdhFormat = 0;
+
+        mMemHandler->putLinkData(std::move(linkO2Data));
+        break;
       }
     }
   }
 
-  DDDLOG("Exiting ReadoutEmulator thread.");
+  return true;
 }
 
 /// Start "data taking" thread
-void CruLinkEmulator::start()
+void CruLinkEmulator::start(const bool pOwnThread)
 {
+  DDDLOG("Starting link emulation. link_id={} superpage_size={} nominal_hbf_size={} mean_hbf_size={:.1f}",
+    mLinkID, mMemHandler->getSuperpageSize(), mDmaChunkSize, mDataGenerator.meanHbfSize());
+
+  mSentStf = 0;
+  mOpStart = std::chrono::steady_clock::now();
   mRunning = true;
-  mCRULinkThread = create_thread_member("cru_link", &CruLinkEmulator::linkReadoutThread, this);
+
+  if (pOwnThread) {
+    mCRULinkThread = create_thread_member("cru_link", &CruLinkEmulator::linkReadoutThread, this);
+  }
 }
 
 /// Stop "data taking" thread
@@ -158,5 +143,51 @@ void CruLinkEmulator::stop()
   }
 }
 
+void CruEmulatorWorkers::start()
+{
+  mRunning = true;
+  for (auto &lLink : mLinks) {
+    lLink->start(false);
+  }
+
+  const auto lNumThreads = std::min(std::size_t(mNumThreads), std::max(mLinks.size(), std::size_t(1)));
+  mNumActiveThreads = lNumThreads;
+  for (unsigned i = 0; i < lNumThreads; i++) {
+    mThreads.push_back(create_thread_member("cru_worker", &CruEmulatorWorkers::workerThread, this, i));
+  }
+  IDDLOG("CRU emulation started. links={} threads={}", mLinks.size(), lNumThreads);
+}
+
+void CruEmulatorWorkers::stop()
+{
+  mRunning = false;
+  for (auto &lThread : mThreads) {
+    if (lThread.joinable()) {
+      lThread.join();
+    }
+  }
+  mThreads.clear();
+
+  for (auto &lLink : mLinks) {
+    lLink->stop();
+  }
+}
+
+void CruEmulatorWorkers::workerThread(const unsigned pThreadIdx)
+{
+  while (mRunning) {
+    bool lWorkDone = false;
+    for (std::size_t i = pThreadIdx; i < mLinks.size(); i += mNumActiveThreads) {
+      lWorkDone |= mLinks[i]->generateData();
+    }
+
+    if (!lWorkDone) {
+      usleep(200);
+    }
+  }
+
+  DDDLOG("Exiting CRU emulator worker thread. thread_idx={}", pThreadIdx);
+}
+
 }
 } /* namespace o2::DataDistribution */
@@ -12,11 +12,13 @@
 #define ALICEO2_CRU_EMULATOR_H_
 
 #include "CruMemoryHandler.h"
+#include "CruDataGenerator.h"
 
 #include <ConcurrentQueue.h>
 #include <ReadoutDataModel.h>
 
 #include <Headers/DataHeader.h>
+#include <Headers/DAQID.h>
 
 #include <stack>
 #include <map>
@@ -25,6 +27,10 @@
 #include <mutex>
 #include <condition_variable>
 #include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <algorithm>
 
 namespace o2
 {
@@ -40,11 +46,14 @@ struct RawDmaChunkDesc {
 class CruLinkEmulator
 {
  public:
-  CruLinkEmulator(std::shared_ptr<CruMemoryHandler> pMemHandler, uint64_t pLinkId, uint64_t pLinkBitsPerS, uint64_t pDmaChunkSize)
+  CruLinkEmulator(std::shared_ptr<CruMemoryHandler> pMemHandler, uint64_t pLinkId, uint64_t pLinkBitsPerS,
+    uint64_t pDmaChunkSize, const CruDataGeneratorConfig &pGenConfig)
     : mMemHandler{ pMemHandler },
       mLinkID{ pLinkId },
       mLinkBitsPerS{ pLinkBitsPerS },
       mDmaChunkSize{ pDmaChunkSize },
+      mSystemId{ (pLinkId % 10 < 7) ? o2::header::DAQID::TPC : o2::header::DAQID::ITS },
+      mDataGenerator{ pGenConfig, pLinkId, mSystemId, pDmaChunkSize, pMemHandler->getSuperpageSize() },
       mRunning{ false }
   {
   }
@@ -56,8 +65,11 @@ class CruLinkEmulator
 
   void linkReadoutThread();
 
-  /// Start "data taking" thread
-  void start();
+  /// Emit the HBFrames due since the start of data taking. Returns false if there was nothing to do
+  bool generateData();
+
+  /// Start "data taking" thread. Without own thread, generateData() is called by CruEmulatorWorkers
+  void start(const bool pOwnThread = true);
   /// Stop "data taking" thread
   void stop();
 
@@ -66,10 +78,51 @@ class CruLinkEmulator
 
   std::uint64_t mLinkID;
   std::uint64_t mLinkBitsPerS;
-  std::uint64_t mDmaChunkSize;
+  std::uint64_t mDmaChunkSize; // nominal HBF size
+  std::uint8_t mSystemId;
+
+  CruLinkDataGenerator mDataGenerator;
+
+  // data taking state
+  std::int64_t mSentStf = 0;
+  std::chrono::steady_clock::time_point mOpStart;
+  std::vector<CRUSuperpage> mSuperpages;
+  std::uint32_t mOrbit = 0;
 
   std::thread mCRULinkThread;
-  bool mRunning;
+  std::atomic_bool mRunning;
+};
+
+/// Shared generator threads driving many emulated links
+///
+/// Links are assigned to the threads round-robin. Each thread services its links in turn and only
+/// sleeps when none of them had data due.
+class CruEmulatorWorkers
+{
+ public:
+  CruEmulatorWorkers(std::vector<std::unique_ptr<CruLinkEmulator>> &pLinks, const unsigned pNumThreads)
+    : mLinks(pLinks),
+      mNumThreads(std::max(1u, pNumThreads))
+  {
+  }
+
+  ~CruEmulatorWorkers()
+  {
+    stop();
+  }
+
+  void start();
+  void stop();
+
+ private:
+  void workerThread(const unsigned pThreadIdx);
+
+  std::vector<std::unique_ptr<CruLinkEmulator>> &mLinks;
+  const unsigned mNumThreads;
+
+  std::size_t mNumActiveThreads = 1;
+  std::vector<std::thread> mThreads;
+  std::atomic_bool mRunning = false;
 };
 }
 } /* namespace o2::DataDistribution */
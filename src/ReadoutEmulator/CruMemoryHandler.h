@@ -29,6 +29,9 @@
 #include <thread>
 
 #include <functional>
+#include <atomic>
+#include <memory>
+#include <algorithm>
 
 class FairMQUnmanagedRegion;
 
@@ -77,7 +80,7 @@ class CruMemoryHandler
   template <class OutputIt>
   std::size_t getSuperpages(unsigned long n, OutputIt spDst)
   {
-    return mSuperpages.try_pop_n(n, spDst);
+    return mSuperpages ? mSuperpages->try_pop_n(n, spDst) : 0;
   }
 
   // not useful
@@ -121,25 +124,21 @@ class CruMemoryHandler
 
   std::size_t mSuperpageSize;
 
-  /// stack of free superpages
-  ConcurrentLifo<CRUSuperpage> mSuperpages;
+  /// free superpages. Sized to hold all superpages, a push never waits
+  std::unique_ptr<ConcurrentMpmcRing<CRUSuperpage>> mSuperpages;
 
-  /// used buffers
-  /// split tracking for scalability into several buckets based on sp address
-  static constexpr unsigned long cBufferBucketSize = 127;
+  /// number of data buffers in use, per superpage. The superpage is freed when the last one returns
+  std::size_t mNumSuperpages = 0;
+  std::unique_ptr<std::atomic_uint32_t[]> mSpBuffersUsed;
 
-  struct BufferBucket {
-    std::mutex mLock;
-    std::unordered_map<const char*, CRUSuperpage> mVirtToSuperpage;
-    // map<sp_address, map<buff_addr, buf_len>>
-    std::unordered_map<const char*, std::unordered_map<const char*, std::size_t>> mUsedSuperPages;
-  };
-
-  BufferBucket mBufferMap[cBufferBucketSize];
-
-  BufferBucket& getBufferBucket(const char* pAddr)
+  // index of the superpage holding the buffer, or mNumSuperpages if outside of the data region
+  std::size_t getSuperpageIndex(const char* pAddr) const
   {
-    return mBufferMap[std::hash<const char*>{}(pAddr) % cBufferBucketSize];
+    const char* lRegionStart = getDataRegionPtr();
+    if (pAddr < lRegionStart) {
+      return mNumSuperpages;
+    }
+    return std::min(mNumSuperpages, std::size_t(pAddr - lRegionStart) / mSuperpageSize);
   }
 
   /// output data queue
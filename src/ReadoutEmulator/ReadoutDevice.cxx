@@ -15,6 +15,7 @@
 
 #include <options/FairMQProgOptions.h>
 
+#include <algorithm>
 #include <chrono>
 #include <thread>
 
@@ -46,6 +47,7 @@ void ReadoutDevice::InitTask()
 
   mCruLinkCount = GetConfig()->GetValue<std::size_t>(OptionKeyCruLinkCount);
   mCruLinkBitsPerS = GetConfig()->GetValue<double>(OptionKeyCruLinkBitsPerS);
+  mCruWorkerThreads = GetConfig()->GetValue<unsigned>(OptionKeyCruWorkerThreads);
 
   if (mSuperpageSize < (1ULL << 20)) {
     WDDLOG("Superpage size too low ({}). Setting to 1 MiB...", mSuperpageSize);
@@ -55,6 +57,36 @@ void ReadoutDevice::InitTask()
   mDmaChunkSize = (mCruLinkBitsPerS / 11223ULL) >> 3;
   IDDLOG("Using HBFrame size of {} B.", mDmaChunkSize);
 
+  mGenConfig.mRdhVersion = GetConfig()->GetValue<unsigned>(OptionKeyRdhVersion);
+  mGenConfig.mPageSize = GetConfig()->GetValue<std::size_t>(OptionKeyRdhPageSize);
+  mGenConfig.mFeeIdBase = GetConfig()->GetValue<std::uint16_t>(OptionKeyRdhFeeIdBase);
+  mGenConfig.mOccupancyMean = GetConfig()->GetValue<double>(OptionKeyOccupancyMean);
+  mGenConfig.mOccupancySigma = GetConfig()->GetValue<double>(OptionKeyOccupancySigma);
+  mGenConfig.mEmptyHbfFraction = GetConfig()->GetValue<double>(OptionKeyEmptyHbfFraction);
+  mGenConfig.mNumPatterns = GetConfig()->GetValue<std::size_t>(OptionKeyNumHbfPatterns);
+
+  if (mGenConfig.mRdhVersion < 3 || mGenConfig.mRdhVersion > 6) {
+    WDDLOG("Unsupported RDH version {}. Using RDHv6...", mGenConfig.mRdhVersion);
+    mGenConfig.mRdhVersion = 6;
+  }
+
+  const auto lOccupancy = GetConfig()->GetValue<std::string>(OptionKeyOccupancy);
+  if (!CruDataGeneratorConfig::parseOccupancy(lOccupancy, mGenConfig.mOccupancy)) {
+    WDDLOG("Unknown occupancy distribution '{}'. Using 'fixed'...", lOccupancy);
+    mGenConfig.mOccupancy = CruDataGeneratorConfig::eOccupancyFixed;
+  }
+
+  // CRU pages are multiples of 64 B, and a superpage must hold at least a few of them
+  const std::size_t lPageSize = std::clamp(mGenConfig.mPageSize, std::size_t(256), mSuperpageSize / 4) & ~std::size_t(63);
+  if (lPageSize != mGenConfig.mPageSize) {
+    WDDLOG("Adjusting RDH page size from {} to {} B.", mGenConfig.mPageSize, lPageSize);
+    mGenConfig.mPageSize = lPageSize;
+  }
+
+  IDDLOG("Generating RDHv{} data. page_size={} occupancy={} mean={} sigma={} empty_hbf_fraction={}",
+    mGenConfig.mRdhVersion, mGenConfig.mPageSize, lOccupancy, mGenConfig.mOccupancyMean,
+    mGenConfig.mOccupancySigma, mGenConfig.mEmptyHbfFraction);
+
   mDataRegion.reset();
 
   // Open SHM regions (segments). Increase size to make sure we can start on the mSuperpageSize boundary
@@ -71,18 +103,27 @@ void ReadoutDevice::InitTask()
 
   mCruMemoryHandler->init(mDataRegion.get(), mSuperpageSize);
 
+  mCruWorkers.reset();
   mCruLinks.clear();
   for (unsigned e = 0; e < mCruLinkCount; e++) {
     mCruLinks.push_back(std::make_unique<CruLinkEmulator>(mCruMemoryHandler, mLinkIdOffset + e,
-      mCruLinkBitsPerS, mDmaChunkSize));
+      mCruLinkBitsPerS, mDmaChunkSize, mGenConfig));
+  }
+
+  if (mCruWorkerThreads > 0) {
+    mCruWorkers = std::make_unique<CruEmulatorWorkers>(mCruLinks, mCruWorkerThreads);
   }
 }
 
 void ReadoutDevice::PreRun()
 {
   // start all cru link emulators
-  for (auto& e : mCruLinks)
-    e->start();
+  if (mCruWorkers) {
+    mCruWorkers->start();
+  } else {
+    for (auto& e : mCruLinks)
+      e->start();
+  }
 
   // info thread
   mInfoThread = create_thread_member("readout_info", &ReadoutDevice::InfoThread, this);
@@ -94,6 +135,9 @@ void ReadoutDevice::PreRun()
 void ReadoutDevice::ResetTask()
 {
   // stop all cru link emulators
+  if (mCruWorkers) {
+    mCruWorkers->stop();
+  }
   for (auto& e : mCruLinks)
     e->stop();
   // unblock waiters
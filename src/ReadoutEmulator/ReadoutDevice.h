@@ -37,6 +37,16 @@ class ReadoutDevice : public DataDistDevice
 
   static constexpr const char* OptionKeyCruLinkCount = "cru-link-count";
   static constexpr const char* OptionKeyCruLinkBitsPerS = "cru-link-bits-per-s";
+  static constexpr const char* OptionKeyCruWorkerThreads = "cru-worker-threads";
+
+  static constexpr const char* OptionKeyRdhVersion = "rdh-version";
+  static constexpr const char* OptionKeyRdhPageSize = "rdh-page-size";
+  static constexpr const char* OptionKeyRdhFeeIdBase = "rdh-fee-id-base";
+  static constexpr const char* OptionKeyOccupancy = "occupancy";
+  static constexpr const char* OptionKeyOccupancyMean = "occupancy-mean";
+  static constexpr const char* OptionKeyOccupancySigma = "occupancy-sigma";
+  static constexpr const char* OptionKeyEmptyHbfFraction = "empty-hbf-fraction";
+  static constexpr const char* OptionKeyNumHbfPatterns = "hbf-patterns";
 
   /// Default constructor
   ReadoutDevice();
@@ -69,10 +79,13 @@ class ReadoutDevice : public DataDistDevice
   std::size_t mDmaChunkSize;
   unsigned mCruLinkCount;
   std::uint64_t mCruLinkBitsPerS;
+  CruDataGeneratorConfig mGenConfig;
 
   std::shared_ptr<CruMemoryHandler> mCruMemoryHandler;
 
   std::vector<std::unique_ptr<CruLinkEmulator>> mCruLinks;
+  unsigned mCruWorkerThreads;
+  std::unique_ptr<CruEmulatorWorkers> mCruWorkers;
 
   // messages to send
   std::vector<FairMQMessagePtr> mDataBlockMsgs;
@@ -37,7 +37,34 @@ void addCustomOptions(bpo::options_description& options)
     "Number of CRU equipments to emulate (links, user logics, ...).")(
     o2::DataDistribution::ReadoutDevice::OptionKeyCruLinkBitsPerS,
     bpo::value<double>()->default_value(1000000000),
-    "Input throughput per link (bits per second).");
+    "Input throughput per link (bits per second).")(
+    o2::DataDistribution::ReadoutDevice::OptionKeyCruWorkerThreads,
+    bpo::value<unsigned>()->default_value(0),
+    "Number of threads generating data of all links. Default (0): a thread per link.")(
+    o2::DataDistribution::ReadoutDevice::OptionKeyRdhVersion,
+    bpo::value<unsigned>()->default_value(6),
+    "RDH version of generated data (4, 5, 6). Must match the StfBuilder configuration.")(
+    o2::DataDistribution::ReadoutDevice::OptionKeyRdhPageSize,
+    bpo::value<size_t>()->default_value(8192),
+    "CRU page size (RDH + payload).")(
+    o2::DataDistribution::ReadoutDevice::OptionKeyRdhFeeIdBase,
+    bpo::value<std::uint16_t>()->default_value(0),
+    "FEE ID of the first link. FEE ID of a link is (base + link id).")(
+    o2::DataDistribution::ReadoutDevice::OptionKeyOccupancy,
+    bpo::value<std::string>()->default_value("fixed"),
+    "HBFrame size distribution: fixed, uniform, normal, exponential.")(
+    o2::DataDistribution::ReadoutDevice::OptionKeyOccupancyMean,
+    bpo::value<double>()->default_value(1.0),
+    "Mean HBFrame payload, relative to the nominal HBFrame size of the link.")(
+    o2::DataDistribution::ReadoutDevice::OptionKeyOccupancySigma,
+    bpo::value<double>()->default_value(0.0),
+    "Spread of HBFrame payload (sigma or half-width), relative to the nominal HBFrame size.")(
+    o2::DataDistribution::ReadoutDevice::OptionKeyEmptyHbfFraction,
+    bpo::value<double>()->default_value(0.0),
+    "Fraction of empty HBFrames (trigger mode).")(
+    o2::DataDistribution::ReadoutDevice::OptionKeyNumHbfPatterns,
+    bpo::value<size_t>()->default_value(256),
+    "Number of pre-generated HBFrames per link.");
 }
 
 FairMQDevicePtr getDevice(const FairMQProgOptions& /*config*/)
@@ -24,6 +24,7 @@
 #include <options/FairMQProgOptions.h>
 #include <Framework/SourceInfoHeader.h>
 
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include <exception>
@@ -66,6 +67,12 @@ void StfBuilderDevice::Init()
   DDDLOG("StfBuilderDevice::Init()");
   mI = std::make_unique<StfBuilderInstance>();
   mMemI = std::make_unique<MemoryResources>(this->AddTransport(fair::mq::Transport::SHM));
+  mMemI->mAllocStrategy = GetConfig()->GetValue<RegionAllocStrategy>(MemoryResources::OptionKeyShmAllocator);
+  mMemI->mHeaderSlotPool = GetConfig()->GetValue<bool>(MemoryResources::OptionKeyShmHeaderSlotPool);
+  mMemI->mHeaderSlotPoolPercent = GetConfig()->GetValue<unsigned>(MemoryResources::OptionKeyShmHeaderSlotPoolPercent);
+  mMemI->mNumaNode = GetConfig()->GetValue<int>(MemoryResources::OptionKeyShmNumaNode);
+  mMemI->mNumaRegions = GetConfig()->GetValue<bool>(MemoryResources::OptionKeyShmNumaRegions);
+  mMemI->mPrefaultThreads = GetConfig()->GetValue<unsigned>(MemoryResources::OptionKeyShmPrefaultThreads);
 
   I().mFileSource = std::make_unique<SubTimeFrameFileSource>(*mI, eStfFileSourceOut);
   I().mReadoutInterface = std::make_unique<StfInputInterface>(*this);
@@ -95,6 +102,7 @@ void StfBuilderDevice::InitTask()
   I().mStandalone = GetConfig()->GetValue<bool>(OptionKeyStandalone);
   I().mMaxStfsInPipeline = GetConfig()->GetValue<std::int64_t>(OptionKeyMaxBufferedStfs);
   I().mMaxBuiltStfs = GetConfig()->GetValue<std::uint64_t>(OptionKeyMaxBuiltStfs);
+  I().mTraceSampling = GetConfig()->GetValue<std::uint64_t>(OptionKeyTraceSampling);
 
   // input data handling
   ReadoutDataUtils::sSpecifiedDataOrigin = getDataOriginFromOption(
@@ -106,12 +114,26 @@ void StfBuilderDevice::InitTask()
   ReadoutDataUtils::sRawDataSubspectype =
     GetConfig()->GetValue<ReadoutDataUtils::SubSpecMode>(OptionKeySubSpec);
 
-  ReadoutDataUtils::sRdhSanityCheckMode =
+  I().mReadoutDataConfig.mRdhSanityCheckMode =
     GetConfig()->GetValue<ReadoutDataUtils::SanityCheckMode>(OptionKeyRdhSanityCheck);
 
-  ReadoutDataUtils::sEmptyTriggerHBFrameFilterring =
+  I().mReadoutDataConfig.mRdhSanityCheckImpl =
+    GetConfig()->GetValue<ReadoutDataUtils::SanityCheckImpl>(OptionKeyRdhSanityCheckImpl);
+
+  I().mReadoutDataConfig.mEmptyTriggerHBFrameFilterring =
     GetConfig()->GetValue<bool>(OptionKeyFilterEmptyTriggerData);
 
+  I().mReadoutDataConfig.mHbfCoalesceMaxSize =
+    GetConfig()->GetValue<std::uint64_t>(OptionKeyCoalesceHbfSize) << 10; /* in kiB */
+
+  I().mReadoutDataConfig.mHbfCoalesceRegionSize =
+    GetConfig()->GetValue<std::uint64_t>(OptionKeyCoalesceRegionSize) << 20; /* in MiB */
+
+  I().mNumBuilderThreads = GetConfig()->GetValue<std::size_t>(OptionKeyStfBuilderThreads);
+  I().mReorderWindowTfs = GetConfig()->GetValue<std::uint64_t>(OptionKeyStfReorderWindowTfs);
+  I().mReorderWindowMs = GetConfig()->GetValue<std::uint64_t>(OptionKeyStfReorderWindowMs);
+  I().mInputBusyPollUs = GetConfig()->GetValue<std::uint64_t>(OptionKeyInputBusyPollUs);
+
   // Buffering limitation
   if (I().mMaxStfsInPipeline > 0) {
     if (I().mMaxStfsInPipeline < 4) {
@@ -163,14 +185,24 @@ void StfBuilderDevice::InitTask()
 
     IDDLOG("READOUT INTERFACE: Configured O2 SubSpec mode: {}", to_string(ReadoutDataUtils::sRawDataSubspectype));
 
-    if (ReadoutDataUtils::sRdhSanityCheckMode != ReadoutDataUtils::SanityCheckMode::eNoSanityCheck) {
+    if (I().mReadoutDataConfig.mRdhSanityCheckMode != ReadoutDataUtils::SanityCheckMode::eNoSanityCheck) {
       IDDLOG("Extensive RDH checks enabled. Data that does not meet the criteria will be {}.",
-        (ReadoutDataUtils::sRdhSanityCheckMode == ReadoutDataUtils::eSanityCheckDrop ? "dropped" : "kept"));
+        (I().mReadoutDataConfig.mRdhSanityCheckMode == ReadoutDataUtils::eSanityCheckDrop ? "dropped" : "kept"));
+      IDDLOG("RDH check implementation: {}", to_string(I().mReadoutDataConfig.mRdhSanityCheckImpl));
     }
 
-    if (ReadoutDataUtils::sEmptyTriggerHBFrameFilterring) {
+    if (I().mReadoutDataConfig.mEmptyTriggerHBFrameFilterring) {
       IDDLOG("Filtering of empty HBFrames in triggered mode enabled.");
     }
+
+    if (I().mReadoutDataConfig.mHbfCoalesceMaxSize > 0) {
+      if (I().mReadoutDataConfig.mHbfCoalesceRegionSize == 0) {
+        EDDLOG("HBFrame coalescing requires a region. Set the {} parameter.", OptionKeyCoalesceRegionSize);
+        std::this_thread::sleep_for(1s); exit(-1);
+      }
+      IDDLOG("Coalescing contiguous HBFrames into payloads of up to {} kiB. region_size={} MiB",
+        I().mReadoutDataConfig.mHbfCoalesceMaxSize >> 10, I().mReadoutDataConfig.mHbfCoalesceRegionSize >> 20);
+    }
   }
 
   // Using DPL?
@@ -183,6 +215,75 @@ void StfBuilderDevice::InitTask()
     IDDLOG("Not sending data to DPL.");
   }
 
+  // routing table: "<destination>:<selection>;..."
+  I().mRoutes.assign(eNumStfRoutes, {});
+  {
+    const auto lRoutingOpt = GetConfig()->GetValue<std::string>(OptionKeyStfRouting);
+    std::vector<std::string> lRouteStrs;
+    boost::split(lRouteStrs, lRoutingOpt, boost::is_any_of(";"), boost::token_compress_on);
+
+    for (auto &lRouteStr : lRouteStrs) {
+      boost::algorithm::trim(lRouteStr);
+      if (lRouteStr.empty()) {
+        continue;
+      }
+
+      const auto lSep = lRouteStr.find(':');
+      const auto lDest = boost::algorithm::trim_copy(lRouteStr.substr(0, lSep));
+      int lRoute = -1;
+      if (lDest == "stfsender") {
+        lRoute = eStfRouteStfSender;
+      } else if (lDest == "dpl") {
+        lRoute = eStfRouteDpl;
+      } else if (lDest == "sink") {
+        lRoute = eStfRouteSink;
+      }
+
+      if (lSep == std::string::npos || lRoute < 0 ||
+        !DataIdentifierSplitter::parseSelection(lRouteStr.substr(lSep + 1), I().mRoutes[lRoute])) {
+        EDDLOG("Configuration: invalid SubTimeFrame route. {}={}", OptionKeyStfRouting, lRouteStr);
+        std::this_thread::sleep_for(1s); exit(-1);
+      }
+      I().mRoutingEnabled = true;
+    }
+
+    if (I().mRoutingEnabled) {
+      if (isStandalone() && (!I().mRoutes[eStfRouteStfSender].empty() || !I().mRoutes[eStfRouteDpl].empty())) {
+        EDDLOG("Configuration: only the file sink can be routed to in standalone mode. {}={}",
+          OptionKeyStfRouting, lRoutingOpt);
+        std::this_thread::sleep_for(1s); exit(-1);
+      }
+      if (!I().mRoutes[eStfRouteDpl].empty() && !I().mDplEnabled) {
+        EDDLOG("Configuration: routing to DPL requires the DPL channel. {}={}", OptionKeyStfRouting, lRoutingOpt);
+        std::this_thread::sleep_for(1s); exit(-1);
+      }
+      if (!I().mRoutes[eStfRouteSink].empty() && !I().mFileSink->enabled()) {
+        EDDLOG("Configuration: routing to the file sink requires the sink to be enabled. {}={}",
+          OptionKeyStfRouting, lRoutingOpt);
+        std::this_thread::sleep_for(1s); exit(-1);
+      }
+      IDDLOG("Configuration: SubTimeFrame routing enabled. {}={}", OptionKeyStfRouting, lRoutingOpt);
+    }
+  }
+
+  // load shedding
+  {
+    const auto lSheddingOpt = GetConfig()->GetValue<std::string>(OptionKeyStfShedding);
+    if (!I().mLoadShedder.configure(lSheddingOpt,
+      GetConfig()->GetValue<double>(OptionKeyStfSheddingLowWatermark),
+      GetConfig()->GetValue<double>(OptionKeyStfSheddingHighWatermark))) {
+      EDDLOG("Configuration: invalid SubTimeFrame load shedding policy. {}={}", OptionKeyStfShedding, lSheddingOpt);
+      std::this_thread::sleep_for(1s); exit(-1);
+    }
+    if (I().mLoadShedder.enabled()) {
+      IDDLOG("Configuration: SubTimeFrame load shedding enabled. {}={}", OptionKeyStfShedding, lSheddingOpt);
+      if (!I().mPipelineLimit) {
+        WDDLOG("Configuration: load shedding only reacts to shm region usage, {} is not set.",
+          OptionKeyMaxBufferedStfs);
+      }
+    }
+  }
+
   // check if output enabled
   if (isStandalone() && !I().mFileSink->enabled()) {
     WDDLOG("Running in standalone mode and with STF file sink disabled. Data will be lost.");
@@ -200,8 +301,15 @@ void StfBuilderDevice::InitTask()
     }
 
     try {
-      if (!isStandalone()) {
+      if (!isStandalone() && !I().mRoutingEnabled) {
         GetChannel(I().mDplEnabled ? I().mDplChannelName : I().mOutputChannelName);
+      } else if (!isStandalone()) {
+        if (!I().mRoutes[eStfRouteStfSender].empty()) {
+          GetChannel(I().mOutputChannelName);
+        }
+        if (!I().mRoutes[eStfRouteDpl].empty()) {
+          GetChannel(I().mDplChannelName);
+        }
       }
     } catch(std::exception &) {
       EDDLOG("Output channel (to DPL or StfSender) must be configured if not running in stand-alone mode.");
@@ -219,7 +327,8 @@ void StfBuilderDevice::InitTask()
 
   // start a thread for readout process
   if (!I().mFileSource->enabled()) {
-    I().mReadoutInterface->start();
+    I().mReadoutInterface->start(I().mNumBuilderThreads, I().mReorderWindowTfs,
+      std::chrono::milliseconds(I().mReorderWindowMs), std::chrono::microseconds(I().mInputBusyPollUs));
   }
 
   // info thread
@@ -273,15 +382,24 @@ void StfBuilderDevice::StfOutputThread()
   std::unique_ptr<InterleavedHdrDataSerializer> lStfSerializer;
   std::unique_ptr<StfToDplAdapter> lStfDplAdapter;
 
+  // routing table: the STF is split once, and data needed by several destinations is shared
+  DataIdentifierSplitter lSplitter;
+  std::vector<std::unique_ptr<SubTimeFrame>> lRoutedStfs;
+
   if (!isStandalone()) {
     // cannot get the channels in standalone mode
-    auto& lOutputChan = getOutputChannel();
-    IDDLOG("StfOutputThread: sending data to channel: {}", lOutputChan.GetName());
+    const bool lToStfSender = I().mRoutingEnabled ? !I().mRoutes[eStfRouteStfSender].empty() : !dplEnabled();
+    const bool lToDpl = I().mRoutingEnabled ? !I().mRoutes[eStfRouteDpl].empty() : dplEnabled();
 
-    if (!dplEnabled()) {
+    if (lToStfSender) {
+      auto& lOutputChan = GetChannel(I().mOutputChannelName);
+      IDDLOG("StfOutputThread: sending data to channel: {}", lOutputChan.GetName());
       lStfSerializer = std::make_unique<InterleavedHdrDataSerializer>(lOutputChan);
-    } else {
-      lStfDplAdapter = std::make_unique<StfToDplAdapter>(lOutputChan);
+    }
+    if (lToDpl) {
+      auto& lDplChan = GetChannel(I().mDplChannelName);
+      IDDLOG("StfOutputThread: sending data to channel: {}", lDplChan.GetName());
+      lStfDplAdapter = std::make_unique<StfToDplAdapter>(lDplChan, &MemI());
     }
   }
 
@@ -303,17 +421,48 @@ void StfBuilderDevice::StfOutputThread()
     // get data size sample
     I().mStfSizeMean += (lStf->getDataSize()/64 - I().mStfSizeMean/64);
 
+    // readout STFs are sampled when built, other sources (file, missing STFs) here
+    if (!lStf->traced()) {
+      lStf->setTraceSampling(I().mTraceSampling);
+      lStf->trace(SubTimeFrame::Header::Trace::eStfBuilt);
+    }
+
+    // degrade by detector priority before the regions are exhausted
+    if (I().mLoadShedder.enabled()) {
+      I().mLoadShedder.shed(*lStf, outputPressure());
+    }
+
+    if (I().mRoutingEnabled) {
+      lRoutedStfs = lSplitter.split(*lStf, I().mRoutes);
+      lStf.reset();
+
+      if (!I().mRoutes[eStfRouteSink].empty()) {
+        I().queue(eStfRouterOut, std::move(lRoutedStfs[eStfRouteSink]));
+      }
+    }
+
     if (!isStandalone()) {
       const auto lSendStartTime = hres_clock::now();
 
       try {
 
-        if (!dplEnabled()) {
+        if (I().mRoutingEnabled) {
+          if (lStfSerializer) {
+            lRoutedStfs[eStfRouteStfSender]->trace(SubTimeFrame::Header::Trace::eStfBuilderSent);
+            lStfSerializer->serialize(std::move(lRoutedStfs[eStfRouteStfSender]));
+          }
+          if (lStfDplAdapter) {
+            lRoutedStfs[eStfRouteDpl]->trace(SubTimeFrame::Header::Trace::eStfBuilderSent);
+            lStfDplAdapter->sendToDpl(std::move(lRoutedStfs[eStfRouteDpl]));
+          }
+        } else if (!dplEnabled()) {
           assert (lStfSerializer);
+          lStf->trace(SubTimeFrame::Header::Trace::eStfBuilderSent);
           lStfSerializer->serialize(std::move(lStf));
         } else {
           // Send to DPL bridge
           assert (lStfDplAdapter);
+          lStf->trace(SubTimeFrame::Header::Trace::eStfBuilderSent);
           lStfDplAdapter->sendToDpl(std::move(lStf));
         }
       } catch (std::exception& e) {
@@ -340,6 +489,7 @@ void StfBuilderDevice::StfOutputThread()
       const double lTimeMs = std::max(1e-6, std::chrono::duration<double, std::milli>(lNow - lSendStartTime).count());
       I().mSentOutRate = double(I().mSentOutStfs) / std::chrono::duration<double>(lNow - sStartOfStfSending).count();
       I().mStfDataTimeSamples += (lTimeMs / 100.0 - I().mStfDataTimeSamples / 100.0);
+      I().mStfSendTimeUs.record(std::uint64_t(lTimeMs * 1000.0));
     }
 
     // check if we should exit:
@@ -352,7 +502,7 @@ void StfBuilderDevice::StfOutputThread()
   }
 
   // leaving the output thread, send end of the stream info
-  if (dplEnabled()) {
+  if (lStfDplAdapter) {
     o2::framework::SourceInfoHeader lDplExitHdr;
     lDplExitHdr.state = o2::framework::InputChannelState::Completed;
     auto lDoneStack = Stack(
@@ -362,7 +512,7 @@ void StfBuilderDevice::StfOutputThread()
     );
 
     // Send a multipart
-    auto& lOutputChan = getOutputChannel();
+    auto& lOutputChan = GetChannel(I().mDplChannelName);
     FairMQParts lCompletedMsg;
     auto lNoFree = [](void*, void*) { /* stack */ };
     lCompletedMsg.AddPart(lOutputChan.NewMessage(lDoneStack.data(), lDoneStack.size(), lNoFree));
@@ -380,6 +530,27 @@ void StfBuilderDevice::StfOutputThread()
   DDDLOG("Exiting StfOutputThread...");
 }
 
+double StfBuilderDevice::outputPressure() const
+{
+  double lPressure = 0.0;
+
+  if (I().mPipelineLimit) {
+    lPressure = double(I().mCounters.mNumStfs) / double(I().mMaxStfsInPipeline);
+  }
+
+  if (mMemI && mMemI->running()) {
+    if (mMemI->mHeaderMemRes && mMemI->mHeaderMemRes->size() > 0) {
+      lPressure = std::max(lPressure,
+        1.0 - double(mMemI->mHeaderMemRes->free()) / double(mMemI->mHeaderMemRes->size()));
+    }
+    if (mMemI->sizeData() > 0) {
+      lPressure = std::max(lPressure, 1.0 - double(mMemI->freeData()) / double(mMemI->sizeData()));
+    }
+  }
+
+  return std::clamp(lPressure, 0.0, 1.0);
+}
+
 void StfBuilderDevice::InfoThread()
 {
   while (I().mState.mRunning) {
@@ -394,6 +565,47 @@ void StfBuilderDevice::InfoThread()
       I().mStfSizeMean, (1.0 / I().mReadoutInterface->StfTimeMean()),
       I().mStfDataTimeSamples, I().mCounters.mNumStfs);
     IDDLOG("SubTimeFrame sent_total={} rate={:.4}", I().mSentOutStfsTotal, I().mSentOutRate);
+    IDDLOG("SubTimeFrame late data reordered_bytes={} late_dropped_bytes={}",
+      I().mReadoutInterface->ReorderedBytes(), I().mReadoutInterface->LateDroppedBytes());
+
+    // latency percentiles of the last interval
+    const auto lLogHist = [](const char *pName, LogLinearHistogram &pHist) {
+      const auto lSnap = pHist.snapshot_reset();
+      if (lSnap.mCount > 0) {
+        IDDLOG("SubTimeFrame {} p50={} p90={} p99={} p999={} max={} count={}", pName,
+          LogLinearHistogram::percentile(lSnap, 50.0), LogLinearHistogram::percentile(lSnap, 90.0),
+          LogLinearHistogram::percentile(lSnap, 99.0), LogLinearHistogram::percentile(lSnap, 99.9),
+          lSnap.mMax, lSnap.mCount);
+      }
+    };
+    lLogHist("interval_us", I().mReadoutInterface->StfIntervalHist());
+    lLogHist("sending_time_us", I().mStfSendTimeUs);
+
+    if (I().mLoadShedder.enabled()) {
+      for (const auto &lPolicy : I().mLoadShedder.policies()) {
+        IDDLOG("SubTimeFrame load shedding origin={} priority={} shed_stfs={} shed_bytes={} level={}",
+          lPolicy.mOrigin.str, lPolicy.mPriority, lPolicy.mShedStfs.load(), lPolicy.mShedBytes.load(),
+          I().mLoadShedder.level());
+      }
+    }
+
+    for (unsigned lStage = 0; lStage < I().getPipelineNumStages(); lStage++) {
+      const auto lStats = I().getStageStats(lStage);
+      DDDLOG("Pipeline stage {}: depth={} high_watermark={} dequeued={} dwell_us_p50={} dwell_us_p99={}",
+        lStage, lStats.mDepth, lStats.mHighWatermark, lStats.mNumDequeued, lStats.mDwellP50Us, lStats.mDwellP99Us);
+    }
+
+    if (mMemI && mMemI->running()) {
+      const auto lLogStats = [](const char *pRegion, const RegionAllocatorStats &pStats) {
+        DDDLOG("Memory region {}: free={} largest_free_block={} free_ranges={} try_alloc_failed={} "
+          "size_class_bytes={} magazine_refills={} alloc_wait_us_p50={} alloc_wait_us_p99={} reclaim_batch_p50={}",
+          pRegion, pStats.mFree, pStats.mLargestFreeBlock, pStats.mNumFreeRanges, pStats.mTryAllocFailed,
+          pStats.mSizeClassBytes, pStats.mMagazineRefills, pStats.mAllocWaitP50Us, pStats.mAllocWaitP99Us,
+          Log2Histogram::percentile(pStats.mReclaimBatchHist, 50.0));
+      };
+      lLogStats("header", mMemI->headerStats());
+      lLogStats("data", mMemI->dataStats());
+    }
   }
 
   DDDLOG("Exiting Info thread...");
@@ -440,9 +652,36 @@ bpo::options_description StfBuilderDevice::getStfBuildingProgramOptions() {
     OptionKeyRdhSanityCheck,
     bpo::value<ReadoutDataUtils::SanityCheckMode>()->default_value(ReadoutDataUtils::SanityCheckMode::eNoSanityCheck, "off"),
     "Enable extensive RDH verification. Permitted values: off, print, drop (caution, any data not meeting criteria will be dropped)")(
+    OptionKeyRdhSanityCheckImpl,
+    bpo::value<ReadoutDataUtils::SanityCheckImpl>()->default_value(ReadoutDataUtils::SanityCheckImpl::eSanityCheckSimd, "simd"),
+    "Implementation of the RDH verification. Permitted values: scalar, simd (uses AVX2 if supported by the cpu)")(
     OptionKeyFilterEmptyTriggerData,
     bpo::bool_switch()->default_value(false),
-    "Filter out empty HBFrames with RDHv4 sent in triggered mode.");
+    "Filter out empty HBFrames with RDHv4 sent in triggered mode.")(
+    OptionKeyCoalesceHbfSize,
+    bpo::value<std::uint64_t>()->default_value(0),
+    "Merge HBFrames of an equipment that are contiguous in the readout superpage into one O2 message of up to "
+    "the given size (kiB). The HBFrames are copied into the coalescing region and the readout pages are released. "
+    "Consumers iterate the HBFrames of a message using the RDHs. Default: 0 (one message per HBFrame).")(
+    OptionKeyCoalesceRegionSize,
+    bpo::value<std::uint64_t>()->default_value(1024),
+    "Size of the memory region for coalesced HBFrames in MiB. HBFrames are not coalesced when the region is full.")(
+    OptionKeyStfBuilderThreads,
+    bpo::value<std::size_t>()->default_value(1),
+    "Number of threads building SubTimeFrames. Data of different equipment links is built in parallel and "
+    "merged into one SubTimeFrame. Default: 1 (no sharding).")(
+    OptionKeyStfReorderWindowTfs,
+    bpo::value<std::uint64_t>()->default_value(0),
+    "Number of recent SubTimeFrames for which late readout data is merged instead of dropped. "
+    "Default: 0 (no reordering).")(
+    OptionKeyStfReorderWindowMs,
+    bpo::value<std::uint64_t>()->default_value(50),
+    "Time (ms) a SubTimeFrame is held in the reorder window waiting for late readout data.")(
+    OptionKeyInputBusyPollUs,
+    bpo::value<std::uint64_t>()->default_value(0),
+    "Busy-poll the readout channels for up to the given time (us) before blocking in receive. Lowers the "
+    "latency at the cost of a fully used core per input; pin the input threads with DATADIST_THREAD_PLACEMENT. "
+    "Default: 0 (blocking receive).");
 
   return lStfBuildingOptions;
 }
@@ -15,9 +15,11 @@
 #define ALICEO2_STFBUILDER_DEVICE_H_
 
 #include "StfBuilderInput.h"
+#include "StfLoadShedder.h"
 
 #include <ReadoutDataModel.h>
 #include <SubTimeFrameDataModel.h>
+#include <SubTimeFrameUtils.h>
 #include <SubTimeFrameFileSink.h>
 #include <SubTimeFrameFileSource.h>
 #include <ConcurrentQueue.h>
@@ -49,12 +51,21 @@ enum StfBuilderPipeline {
 
   // output only stages
   eStfSendIn = 1,
+  eStfRouterOut = 2, // routing table: file sink part of the STF (see StfOutputThread)
 
-  eStfNullIn = 2, // delete/drop
-  eStfPipelineSize = 2,
+  eStfNullIn = 3, // delete/drop
+  eStfPipelineSize = 3,
   eStfInvalidStage = -1,
 };
 
+// destinations of the routing table
+enum StfRoute {
+  eStfRouteStfSender = 0,
+  eStfRouteDpl,
+  eStfRouteSink,
+  eNumStfRoutes
+};
+
 class StfBuilderDevice : public DataDistDevice
 {
  public:
@@ -63,16 +74,28 @@ class StfBuilderDevice : public DataDistDevice
   static constexpr const char* OptionKeyInputChannelName = "input-channel-name";
   static constexpr const char* OptionKeyOutputChannelName = "output-channel-name";
   static constexpr const char* OptionKeyDplChannelName = "dpl-channel-name";
+  static constexpr const char* OptionKeyStfRouting = "stf-routing";
+  static constexpr const char* OptionKeyStfShedding = "stf-shedding";
+  static constexpr const char* OptionKeyStfSheddingLowWatermark = "stf-shedding-low-watermark";
+  static constexpr const char* OptionKeyStfSheddingHighWatermark = "stf-shedding-high-watermark";
   static constexpr const char* OptionKeyStandalone = "stand-alone";
   static constexpr const char* OptionKeyMaxBufferedStfs = "max-buffered-stfs";
   static constexpr const char* OptionKeyMaxBuiltStfs = "max-built-stfs";
+  static constexpr const char* OptionKeyTraceSampling = "trace-sampling";
 
   static constexpr const char* OptionKeyStfDetector = "detector";
   static constexpr const char* OptionKeyRhdVer = "detector-rdh";
   static constexpr const char* OptionKeySubSpec = "detector-subspec";
 
   static constexpr const char* OptionKeyRdhSanityCheck = "rdh-data-check";
+  static constexpr const char* OptionKeyRdhSanityCheckImpl = "rdh-data-check-impl";
   static constexpr const char* OptionKeyFilterEmptyTriggerData = "rdh-filter-empty-trigger";
+  static constexpr const char* OptionKeyCoalesceHbfSize = "rdh-coalesce-hbf-size";
+  static constexpr const char* OptionKeyCoalesceRegionSize = "rdh-coalesce-region-size";
+  static constexpr const char* OptionKeyStfBuilderThreads = "stf-builder-threads";
+  static constexpr const char* OptionKeyStfReorderWindowTfs = "stf-reorder-window-tfs";
+  static constexpr const char* OptionKeyStfReorderWindowMs = "stf-reorder-window-ms";
+  static constexpr const char* OptionKeyInputBusyPollUs = "input-busy-poll-us";
 
   static bpo::options_description getDetectorProgramOptions();
   static bpo::options_description getStfBuildingProgramOptions();
@@ -85,9 +108,15 @@ class StfBuilderDevice : public DataDistDevice
   ~StfBuilderDevice() override;
 
   bool dplEnabled() const noexcept { return I().mDplEnabled; }
+  const ReadoutDataContext& readoutDataConfig() const noexcept { return I().mReadoutDataConfig; }
   bool isStandalone() const noexcept { return I().mStandalone; }
 
   const std::string& getInputChannelName() const { return I().mInputChannelName; }
+  // number of sub-channels of the input channel (readout producers)
+  std::size_t getNumInputChannels() const {
+    const auto lChanIt = fChannels.find(I().mInputChannelName);
+    return (lChanIt != fChannels.end()) ? lChanIt->second.size() : 0;
+  }
   const std::string& getDplChannelName() const { return I().mDplChannelName; }
 
   auto& getOutputChannel() {
@@ -144,6 +173,9 @@ class StfBuilderDevice : public DataDistDevice
   void StfOutputThread();
   void InfoThread();
 
+  // fill level of the pipeline or of the shm regions, whichever is higher [0, 1]
+  double outputPressure() const;
+
   struct StfBuilderInstance : public IFifoPipeline<std::unique_ptr<SubTimeFrame>> {
 
     StfBuilderInstance()
@@ -155,9 +187,18 @@ class StfBuilderDevice : public DataDistDevice
     std::string mDplChannelName;
     bool mStandalone;
     bool mDplEnabled;
+    bool mRoutingEnabled = false;
+    DataIdentifierSplitter::RoutingTable mRoutes; // indexed by StfRoute, empty: not routed
+    StfLoadShedder mLoadShedder;
     std::int64_t mMaxStfsInPipeline;
     std::uint64_t mMaxBuiltStfs;
+    std::uint64_t mTraceSampling = 0;
     bool mPipelineLimit;
+    std::size_t mNumBuilderThreads;
+    std::uint64_t mReorderWindowTfs;
+    std::uint64_t mReorderWindowMs;
+    std::uint64_t mInputBusyPollUs = 0;
+    ReadoutDataContext mReadoutDataConfig; // copied to each StfBuilder
 
     /// Input Interface handler
     std::unique_ptr<StfInputInterface> mReadoutInterface;
@@ -182,6 +223,7 @@ class StfBuilderDevice : public DataDistDevice
     std::thread mInfoThread;
     uint64_t mStfSizeMean;
     double mStfDataTimeSamples;
+    LogLinearHistogram mStfSendTimeUs;
     std::uint64_t mSentOutStfsTotal = 0;
     std::uint64_t mSentOutStfs = 0; // used to calculate the rate (pause/resume)
     double mSentOutRate = 0.0;
@@ -195,7 +237,8 @@ class StfBuilderDevice : public DataDistDevice
         return true;
       }
 
-      if (this->try_pop(eStfFileSinkIn)) {
+      // with routing, the file sink only receives copies
+      if (!mRoutingEnabled && this->try_pop(eStfFileSinkIn)) {
         return true;
       }
 
@@ -226,7 +269,7 @@ class StfBuilderDevice : public DataDistDevice
           }
         }
 
-        if (mFileSink->enabled()) {
+        if (mFileSink->enabled() && !mRoutingEnabled) {
           mCounters.mNumStfs--;
           lNextStage = eStfFileSinkIn;
         } else {
@@ -236,10 +279,19 @@ class StfBuilderDevice : public DataDistDevice
       }
       case eStfFileSinkOut:
       {
+        if (mRoutingEnabled) {
+          lNextStage = eStfNullIn; // the output has its own part of the STF
+          break;
+        }
         mCounters.mNumStfs++;
         lNextStage = eStfSendIn;
         break;
       }
+      case eStfRouterOut:
+      {
+        lNextStage = eStfFileSinkIn;
+        break;
+      }
       default:
         throw std::runtime_error("pipeline error");
     }
@@ -23,40 +23,106 @@
 
 #include <vector>
 #include <queue>
+#include <map>
 #include <chrono>
+#include <algorithm>
 #include <sstream>
 
 namespace o2::DataDistribution
 {
 
-void StfInputInterface::start()
+void StfInputInterface::start(const std::size_t pNumBuilders, const std::uint64_t pReorderWindowTfs,
+  const std::chrono::milliseconds pReorderWindowMs, const std::chrono::microseconds pBusyPoll)
 {
   mRunning = true;
+  mBusyPoll = pBusyPoll;
+  mReorderWindowTfs = pReorderWindowTfs;
+  mReorderWindowMs = pReorderWindowMs;
+  if (mReorderWindowTfs > 0) {
+    IDDLOG("READOUT INTERFACE: Reordering late STF data. window_tfs={} window_ms={}",
+      mReorderWindowTfs, mReorderWindowMs.count());
+  }
+
+  // every input needs at least one builder
+  const std::size_t lNumInputs = std::clamp(mDevice.getNumInputChannels(), std::size_t(1), cMaxBuilderThreads);
+  mNumInputs = lNumInputs;
+  const std::size_t lNumBuilders = std::clamp(std::max(pNumBuilders, lNumInputs), std::size_t(1), cMaxBuilderThreads);
+  if (lNumBuilders != pNumBuilders) {
+    WDDLOG("READOUT INTERFACE: Number of StfBuilder threads adjusted. requested={} used={} num_inputs={}",
+      pNumBuilders, lNumBuilders, lNumInputs);
+  }
+  const bool lSharded = (lNumBuilders > 1);
 
   mSeqStfQueue.start();
-  mBuilderInputQueue = std::make_unique<ConcurrentFifo<std::vector<FairMQMessagePtr>>>();
-  mStfBuilder = std::make_unique<SubTimeFrameReadoutBuilder>(mDevice.MemI(), mDevice.dplEnabled());
+  mLastStfTime = std::chrono::steady_clock::now();
+
+  if (lSharded) {
+    mPartialStfQueue = std::make_unique<ConcurrentMpmcRing<PartialStfT>>(cBuilderInputQueueCapacity);
+  }
+
+  for (std::size_t lIdx = 0; lIdx < lNumBuilders; lIdx++) {
+    mBuilderInputQueues.push_back(
+      std::make_unique<ConcurrentSpscRing<std::vector<FairMQMessagePtr>>>(cBuilderInputQueueCapacity));
+    // the first builder creates the header region, all builders allocate concurrently when sharded
+    mStfBuilders.push_back(std::make_unique<SubTimeFrameReadoutBuilder>(mDevice.MemI(), mDevice.dplEnabled(),
+      mDevice.readoutDataConfig(), (lIdx == 0) /* create region */, lSharded /* concurrent allocation */));
+  }
 
   mStfSeqThread = create_thread_member("stfb_seq", &StfInputInterface::StfSequencerThread, this);
-  mBuilderThread = create_thread_member("stfb_builder", &StfInputInterface::StfBuilderThread, this);
-  mInputThread = create_thread_member("stfb_input", &StfInputInterface::DataHandlerThread, this);
+  if (lSharded) {
+    mStfMergeThread = create_thread_member("stfb_merge", &StfInputInterface::StfMergeThread, this);
+    IDDLOG("READOUT INTERFACE: Building STFs with {} threads. Readout data is sharded by equipment and link.",
+      lNumBuilders);
+  }
+  for (std::size_t lIdx = 0; lIdx < lNumBuilders; lIdx++) {
+    char lThreadName[128];
+    std::snprintf(lThreadName, 127, "stfb_builder_%zu", lIdx);
+    lThreadName[127] = '\0'; // safety
+    mBuilderThreads.push_back(create_thread_member(lThreadName, &StfInputInterface::StfBuilderThread, this, lIdx));
+  }
+  for (std::size_t lIdx = 0; lIdx < lNumInputs; lIdx++) {
+    char lThreadName[128];
+    std::snprintf(lThreadName, 127, "stfb_input_%zu", lIdx);
+    lThreadName[127] = '\0'; // safety
+    mInputThreads.push_back(create_thread_member(lThreadName, &StfInputInterface::DataHandlerThread, this, lIdx));
+  }
+  if (lNumInputs > 1) {
+    IDDLOG("READOUT INTERFACE: Receiving on {} input channels.", lNumInputs);
+  }
+  if (mBusyPoll.count() > 0) {
+    IDDLOG("READOUT INTERFACE: Busy-polling the input channels. spin_budget_us={}", mBusyPoll.count());
+  }
 }
 
 void StfInputInterface::stop()
 {
-mRunning = false;
+  mRunning = false;
 
-  mStfBuilder->stop();
+  for (auto &lStfBuilder : mStfBuilders) {
+    lStfBuilder->stop();
+  }
 
+  for (auto &lThread : mInputThreads) {
+    if (lThread.joinable()) {
+      lThread.join();
+    }
+  }
 
-  if (mInputThread.joinable()) {
-    mInputThread.join();
+  for (auto &lQueue : mBuilderInputQueues) {
+    lQueue->stop();
   }
 
-  mBuilderInputQueue->stop();
+  for (auto &lThread : mBuilderThreads) {
+    if (lThread.joinable()) {
+      lThread.join();
+    }
+  }
 
-  if (mBuilderThread.joinable()) {
-      mBuilderThread.join();
+  if (mPartialStfQueue) {
+    mPartialStfQueue->stop();
+  }
+  if (mStfMergeThread.joinable()) {
+    mStfMergeThread.join();
   }
 
   mSeqStfQueue.stop();
@@ -65,14 +131,27 @@ mRunning = false;
   }
 
   // mStfBuilders.clear(); // TODO: deal with shm region cleanup
-  mBuilderInputQueue.reset();
-  mStfBuilder.reset();
+  mInputThreads.clear();
+  mBuilderThreads.clear();
+  mBuilderInputQueues.clear();
+  mPartialStfQueue.reset();
+  mStfBuilders.clear();
 
   DDDLOG("INPUT INTERFACE: Stopped.");
 }
 
+void StfInputInterface::updateStfTimeMean()
+{
+  // MON: data of a new STF received, get the freq and new start time
+  const auto lNow = std::chrono::steady_clock::now();
+  const std::chrono::duration<double> lTimeDiff = lNow - mLastStfTime;
+  mLastStfTime = lNow;
+  mStfTimeMean += (lTimeDiff.count()/100.0 - mStfTimeMean/100.0);
+  mStfIntervalUs.record(std::uint64_t(lTimeDiff.count() * 1e6));
+}
+
 /// Receiving thread
-void StfInputInterface::DataHandlerThread()
+void StfInputInterface::DataHandlerThread(const std::size_t pInputIdx)
 {
   using namespace std::chrono_literals;
   constexpr std::uint32_t cInvalidStfId = ~0;
@@ -82,7 +161,37 @@ void StfInputInterface::DataHandlerThread()
   std::uint32_t lCurrentStfId = cInvalidStfId;
 
   // Reference to the input channel
-  auto& lInputChan = mDevice.GetChannel(mDevice.getInputChannelName());
+  auto& lInputChan = mDevice.GetChannel(mDevice.getInputChannelName(), pInputIdx);
+  PollingReceiver lReceiver(lInputChan, mBusyPoll, -1 /* block until interrupted */);
+
+  // Builders fed by this input: every n-th builder, for n inputs
+  std::vector<std::size_t> lShardBuilders;
+  for (std::size_t lIdx = pInputIdx; lIdx < mBuilderInputQueues.size(); lIdx += mNumInputs) {
+    lShardBuilders.push_back(lIdx);
+  }
+
+  // Sharded building: every builder must finish its partial STF when the TF is complete
+  const std::size_t lNumShards = lShardBuilders.size();
+  const bool lMerging = (mBuilderInputQueues.size() > 1);
+  bool lStfOpen = false;
+
+  auto lFinishShards = [&](const ReadoutSubTimeframeHeader &pHdr, const std::uint32_t pStfId,
+    const std::size_t pSkipShard) {
+    // header only message with the stop bit is interpreted as the end of STF
+    ReadoutSubTimeframeHeader lStopHdr = pHdr;
+    lStopHdr.mTimeFrameId = pStfId;
+    lStopHdr.mFlags.mLastTFMessage = 1;
+
+    for (std::size_t lShard = 0; lShard < lNumShards; lShard++) {
+      if (lShard == pSkipShard) {
+        continue;
+      }
+      std::vector<FairMQMessagePtr> lStopMsg;
+      lStopMsg.push_back(lInputChan.NewMessage(sizeof(ReadoutSubTimeframeHeader)));
+      std::memcpy(lStopMsg[0]->GetData(), &lStopHdr, sizeof(ReadoutSubTimeframeHeader));
+      mBuilderInputQueues[lShardBuilders[lShard]]->push(std::move(lStopMsg));
+    }
+  };
 
   try {
     while (mRunning) {
@@ -92,7 +201,18 @@ void StfInputInterface::DataHandlerThread()
       lReadoutMsgs.clear();
 
       // receive readout messages
-      const std::int64_t lRet = lInputChan.Receive(lReadoutMsgs);
+      const std::int64_t lRet = lReceiver.receive(lReadoutMsgs);
+
+      // CPU cost per message: the busy-poll trade-off
+      if (const auto lStats = lReceiver.intervalStats(10s); lStats && lStats->mMessages > 0) {
+        if (lReceiver.busyPoll()) {
+          IDDLOG("READOUT INTERFACE: Input statistics. input={} messages={} spin_received={} cpu_us_per_msg={:.2f}",
+            pInputIdx, lStats->mMessages, lStats->mSpinReceived, lStats->mCpuUsPerMessage);
+        } else {
+          DDDLOG("READOUT INTERFACE: Input statistics. input={} messages={} cpu_us_per_msg={:.2f}",
+            pInputIdx, lStats->mMessages, lStats->mCpuUsPerMessage);
+        }
+      }
 
       // timeout ok
       if (lRet == static_cast<int64_t>(fair::mq::TransferCode::timeout)) {
@@ -160,10 +280,32 @@ void StfInputInterface::DataHandlerThread()
               "o2-readout-exe sent messages with non-monotonic TF id! SubTimeFrames will be incomplete! "
               "Total occurrences: " << sNumNonContIncStfs;
 
+          // late data of a recent STF: build it separately, the sequencer merges it into the held STF
+          if ((lCurrentStfId - lReadoutHdr.mTimeFrameId) <= mReorderWindowTfs) {
+            DDDLOG_RL(1000, lErrMsg.str());
+
+            const std::size_t lShard = lMerging ?
+              ((std::size_t(lReadoutHdr.mEquipmentId) << 8) | std::size_t(lReadoutHdr.mLinkId)) % lNumShards : 0;
+            const bool lLastTfMessage = lReadoutHdr.mFlags.mLastTFMessage;
+
+            // close the current STF first. It continues in a new fragment after the late data
+            if (lStfOpen) {
+              lFinishShards(lReadoutHdr, lCurrentStfId, lNumShards /* all */);
+            }
+            mBuilderInputQueues[lShardBuilders[lShard]]->push(std::move(lReadoutMsgs));
+            lFinishShards(lReadoutHdr, lReadoutHdr.mTimeFrameId, lLastTfMessage ? lShard : lNumShards);
+            lStfOpen = false;
+            continue;
+          }
+
           EDDLOG_RL(200, lErrMsg.str());
           DDDLOG(lErrMsg.str());
 
-          // TODO: accout for lost data
+          std::uint64_t lLateSize = 0;
+          for (const auto &lMsg : lReadoutMsgs) {
+            lLateSize += lMsg->GetSize();
+          }
+          mLateDroppedBytes += lLateSize;
           continue;
         }
 
@@ -176,10 +318,32 @@ void StfInputInterface::DataHandlerThread()
         // we keep the data since this might be a legitimate jump
       }
 
+      if (!lMerging) {
+        lCurrentStfId = lReadoutHdr.mTimeFrameId;
+        lStfOpen = !lReadoutHdr.mFlags.mLastTFMessage;
+        mBuilderInputQueues[0]->push(std::move(lReadoutMsgs));
+        continue;
+      }
+
+      // new TF without the stop bit on the previous one
+      if (lStfOpen && (lReadoutHdr.mTimeFrameId != lCurrentStfId)) {
+        lFinishShards(lReadoutHdr, lCurrentStfId, lNumShards /* all */);
+      }
+
       // get the current TF id
       lCurrentStfId = lReadoutHdr.mTimeFrameId;
 
-      mBuilderInputQueue->push(std::move(lReadoutMsgs));
+      // all data of one equipment link is built by the same thread
+      const std::size_t lShard =
+        ((std::size_t(lReadoutHdr.mEquipmentId) << 8) | std::size_t(lReadoutHdr.mLinkId)) % lNumShards;
+      const bool lLastTfMessage = lReadoutHdr.mFlags.mLastTFMessage;
+
+      mBuilderInputQueues[lShardBuilders[lShard]]->push(std::move(lReadoutMsgs));
+
+      lStfOpen = !lLastTfMessage;
+      if (lLastTfMessage) {
+        lFinishShards(lReadoutHdr, lCurrentStfId, lShard);
+      }
     }
   } catch (std::runtime_error& e) {
     if (mRunning) {
@@ -191,7 +355,7 @@ void StfInputInterface::DataHandlerThread()
 }
 
 /// StfBuilding thread
-void StfInputInterface::StfBuilderThread()
+void StfInputInterface::StfBuilderThread(const std::size_t pIdx)
 {
   using namespace std::chrono_literals;
 
@@ -213,15 +377,18 @@ void StfInputInterface::StfBuilderThread()
       EDDLOG("Cannot convert {} for the FeeID mask.", lFeeMask);
     }
   }
-  IDDLOG("StfBuilder: Using {:#06x} as the FeeID mask.", lFeeIdMask);
+  if (pIdx == 0) {
+    IDDLOG("StfBuilder: Using {:#06x} as the FeeID mask.", lFeeIdMask);
+  }
 
-  // Reference to the input channel
-  assert (mBuilderInputQueue);
-  assert (mStfBuilder);
+  assert (pIdx < mBuilderInputQueues.size());
+  assert (pIdx < mStfBuilders.size());
   // Input queue
-  auto &lInputQueue = *mBuilderInputQueue;
+  auto &lInputQueue = *mBuilderInputQueues[pIdx];
   // Stf builder
-  SubTimeFrameReadoutBuilder &lStfBuilder = *mStfBuilder;
+  SubTimeFrameReadoutBuilder &lStfBuilder = *mStfBuilders[pIdx];
+  // partial STFs are merged when building in multiple threads
+  const bool lSharded = (mPartialStfQueue != nullptr);
 
   // insert and mask the feeid
   auto lInsertWitFeeIdMasking = [&lStfBuilder, lFeeIdMask] (const header::DataOrigin &pDataOrigin,
@@ -241,33 +408,32 @@ void StfInputInterface::StfBuilderThread()
 
   const auto cStfDataWaitFor = 2s;
 
-  using hres_clock = std::chrono::high_resolution_clock;
-
-  std::chrono::time_point<hres_clock, std::chrono::duration<double>> lStartSec = hres_clock::now();
-
   while (mRunning) {
 
     // Lambda for completing the Stf
-    auto finishBuildingCurrentStf = [&](bool pTimeout = false) {
+    // pStfId: id of the finished STF, reported to the merger even if this builder has no data for it
+    auto finishBuildingCurrentStf = [&](bool pTimeout = false, std::optional<std::uint32_t> pStfId = std::nullopt) {
       // Finished: queue the current STF and start a new one
-      ReadoutDataUtils::sFirstSeenHBOrbitCnt = 0;
+      auto lStf = lStfBuilder.getStf();
+      if (lStf.has_value() && pTimeout) {
+        WDDLOG("READOUT INTERFACE: finishing STF on a timeout. stf_id={} size={}",
+          (*lStf)->header().mId, (*lStf)->getDataSize());
+      }
 
-      if (auto lStf = lStfBuilder.getStf(); lStf.has_value()) {
-        // start the new STF
-        if (pTimeout) {
-          WDDLOG("READOUT INTERFACE: finishing STF on a timeout. stf_id={} size={}",
-            (*lStf)->header().mId, (*lStf)->getDataSize());
+      if (lSharded) {
+        if (lStf.has_value()) {
+          const std::uint32_t lStfId = (*lStf)->header().mId;
+          mPartialStfQueue->push(pIdx, lStfId, std::move(*lStf));
+        } else if (pStfId) {
+          mPartialStfQueue->push(pIdx, *pStfId, nullptr);
         }
+        return;
+      }
 
+      // an empty flush is not a new STF
+      if (lStf.has_value()) {
         mSeqStfQueue.push(std::move(*lStf));
-        { // MON: data of a new STF received, get the freq and new start time
-          auto lNow = hres_clock::now();
-          std::chrono::duration<double> lTimeDiff = lNow - lStartSec;
-          lStartSec = lNow;
-          mStfTimeMean += (lTimeDiff.count()/100.0 - mStfTimeMean/100.0);
-        }
-      } else {
-        mStfTimeMean *= 2.0;
+        updateStfTimeMean();
       }
     };
 
@@ -346,129 +512,269 @@ void StfInputInterface::StfBuilderThread()
 
     const bool lFinishStf = lReadoutHdr.mFlags.mLastTFMessage;
     if (lReadoutMsgs.size() > 1) {
-      // check subspecifications of all messages
-      header::DataHeader::SubSpecificationType lSubSpecification = ~header::DataHeader::SubSpecificationType(0);
-      header::DataOrigin lDataOrigin;
-      try {
-        const auto R1 = RDHReader(lReadoutMsgs[1]);
-        lDataOrigin = ReadoutDataUtils::getDataOrigin(R1);
-        lSubSpecification = ReadoutDataUtils::getSubSpecification(R1);
-      } catch (RDHReaderException &e) {
-        EDDLOG_RL(1000, "READOUT_INTERFACE: Cannot parse RDH of received HBFs. what={}", e.what());
-        // TODO: the whole ReadoutMsg is discarded. Account and report the data size.
-        continue;
-      }
-
-      assert (lReadoutMsgs.size() > 1);
-      auto lStartHbf = lReadoutMsgs.begin() + 1; // skip the meta message
-      auto lEndHbf = lStartHbf + 1;
-
-      std::size_t lAdded = 0;
-      bool lErrorWhileAdding = false;
+      // RDH version is fixed for the run: use the reader of the configured version for all HBFrames
+      const bool lAddedHbfs = ReadoutDataUtils::withRdhReader([&](auto pReaderTag) {
+        using ReaderT = typename decltype(pReaderTag)::Reader;
 
-      while (true) {
-        if (lEndHbf == lReadoutMsgs.end()) {
-          //insert the remaining span
-          std::size_t lInsertCnt = (lEndHbf - lStartHbf);
-          lAdded += lInsertWitFeeIdMasking(lDataOrigin, lSubSpecification, lReadoutHdr, lStartHbf, lInsertCnt);
-          break;
-        }
-
-        header::DataHeader::SubSpecificationType lNewSubSpec = ~header::DataHeader::SubSpecificationType(0);
+        // check subspecifications of all messages
+        header::DataHeader::SubSpecificationType lSubSpecification = ~header::DataHeader::SubSpecificationType(0);
+        header::DataOrigin lDataOrigin;
         try {
-          const auto Rend = RDHReader(*lEndHbf);
-          lNewSubSpec = ReadoutDataUtils::getSubSpecification(Rend);
+          const auto R1 = ReaderT(lReadoutMsgs[1]);
+          lDataOrigin = ReadoutDataUtils::getDataOrigin(R1);
+          lSubSpecification = ReadoutDataUtils::getSubSpecification(R1);
         } catch (RDHReaderException &e) {
-          EDDLOG_RL(1000, e.what());
-          // TODO: portion of the ReadoutMsg is discarded. Account and report the data size.
-          lErrorWhileAdding = true;
-          break;
+          EDDLOG_RL(1000, "READOUT_INTERFACE: Cannot parse RDH of received HBFs. what={}", e.what());
+          // TODO: the whole ReadoutMsg is discarded. Account and report the data size.
+          return false;
         }
 
-        if (lNewSubSpec != lSubSpecification) {
-          WDDLOG_RL(10000, "READOUT INTERFACE: Update with mismatched subspecifications."
-            " block[0]_subspec={:#06x}, block[{}]_subspec={:#06x}",
-            lSubSpecification, (lEndHbf - (lReadoutMsgs.begin() + 1)), lNewSubSpec);
-          // insert
-          lAdded += lInsertWitFeeIdMasking(lDataOrigin, lSubSpecification, lReadoutHdr, lStartHbf, lEndHbf - lStartHbf);
-          lStartHbf = lEndHbf;
+        assert (lReadoutMsgs.size() > 1);
+        auto lStartHbf = lReadoutMsgs.begin() + 1; // skip the meta message
+        auto lEndHbf = lStartHbf + 1;
+
+        std::size_t lAdded = 0;
+        bool lErrorWhileAdding = false;
+
+        while (true) {
+          if (lEndHbf == lReadoutMsgs.end()) {
+            //insert the remaining span
+            std::size_t lInsertCnt = (lEndHbf - lStartHbf);
+            lAdded += lInsertWitFeeIdMasking(lDataOrigin, lSubSpecification, lReadoutHdr, lStartHbf, lInsertCnt);
+            break;
+          }
+
+          header::DataHeader::SubSpecificationType lNewSubSpec = ~header::DataHeader::SubSpecificationType(0);
+          try {
+            const auto Rend = ReaderT(*lEndHbf);
+            lNewSubSpec = ReadoutDataUtils::getSubSpecification(Rend);
+          } catch (RDHReaderException &e) {
+            EDDLOG_RL(1000, e.what());
+            // TODO: portion of the ReadoutMsg is discarded. Account and report the data size.
+            lErrorWhileAdding = true;
+            break;
+          }
+
+          if (lNewSubSpec != lSubSpecification) {
+            WDDLOG_RL(10000, "READOUT INTERFACE: Update with mismatched subspecifications."
+              " block[0]_subspec={:#06x}, block[{}]_subspec={:#06x}",
+              lSubSpecification, (lEndHbf - (lReadoutMsgs.begin() + 1)), lNewSubSpec);
+            // insert
+            lAdded += lInsertWitFeeIdMasking(lDataOrigin, lSubSpecification, lReadoutHdr, lStartHbf, lEndHbf - lStartHbf);
+            lStartHbf = lEndHbf;
+
+            lSubSpecification = lNewSubSpec;
+          }
+          lEndHbf = lEndHbf + 1;
+        }
 
-          lSubSpecification = lNewSubSpec;
+        if (!lErrorWhileAdding && (lAdded != lReadoutMsgs.size() - 1) ) {
+          EDDLOG_RL(500, "BUG: Not all received HBFrames added to the STF.");
         }
-        lEndHbf = lEndHbf + 1;
-      }
+        return true;
+      });
 
-      if (!lErrorWhileAdding && (lAdded != lReadoutMsgs.size() - 1) ) {
-        EDDLOG_RL(500, "BUG: Not all received HBFrames added to the STF.");
+      if (!lAddedHbfs) {
+        continue;
       }
     }
 
     // check if this was the last message of an STF
     if (lFinishStf) {
-      finishBuildingCurrentStf();
+      finishBuildingCurrentStf(false, lReadoutHdr.mTimeFrameId);
     }
   }
 
   DDDLOG("Exiting StfBuilder thread.");
 }
 
-void StfInputInterface::StfSequencerThread()
+/// StfMerge thread: collect partial STFs of all builders
+void StfInputInterface::StfMergeThread()
 {
   using namespace std::chrono_literals;
 
-  static constexpr std::uint64_t sMaxMissingStfsForSeq = 2ull * 11234 / 256; // 2 seconds of STFs
+  assert (mPartialStfQueue);
+  const std::size_t lNumBuilders = mBuilderInputQueues.size();
+  const std::uint64_t lAllBuilders = (lNumBuilders >= 64) ? ~std::uint64_t(0) : ((std::uint64_t(1) << lNumBuilders) - 1);
 
-  while (mRunning) {
-    auto lStf = mSeqStfQueue.pop_wait_for(500ms);
+  struct PendingStf {
+    std::uint64_t mBuilders = 0; // builders that finished the STF
+    std::unique_ptr<SubTimeFrame> mStf;
+  };
+  std::map<std::uint32_t, PendingStf> lPendingStfs;
+
+  auto lQueueStf = [&](PendingStf &pPending) {
+    // no shard built the STF: not counted in the STF time mean
+    if (pPending.mStf) {
+      mSeqStfQueue.push(std::move(pPending.mStf));
+      updateStfTimeMean();
+    }
+  };
 
-    if (lStf == std::nullopt || !mAcceptingData) {
+  while (mRunning) {
+    auto lPartial = mPartialStfQueue->pop_wait_for(2s);
+
+    if (!lPartial) {
+      // all builders are idle: queue what we have
+      while (!lPendingStfs.empty()) {
+        const auto lIt = lPendingStfs.begin();
+        WDDLOG_RL(1000, "READOUT INTERFACE: Queuing incomplete STF on a timeout. stf_id={} finished_builders={}/{}",
+          lIt->first, __builtin_popcountll(lIt->second.mBuilders), lNumBuilders);
+        lQueueStf(lIt->second);
+        lPendingStfs.erase(lIt);
+      }
       continue;
     }
 
-    // have data, check the sequence
+    auto &[lBuilderIdx, lStfId, lStf] = *lPartial;
+    auto &lPending = lPendingStfs[lStfId];
+
+    lPending.mBuilders |= (std::uint64_t(1) << lBuilderIdx);
     if (lStf) {
-      const auto lCurrId = (*lStf)->id();
-      (*lStf)->setOrigin(SubTimeFrame::Header::Origin::eReadout);
+      if (!lPending.mStf) {
+        lPending.mStf = std::move(lStf);
+      } else {
+        lPending.mStf->updateFirstOrbit(lStf->header().mFirstOrbit);
+        lPending.mStf->updateRunNumber(std::max(lPending.mStf->header().mRunNumber, lStf->header().mRunNumber));
+        lPending.mStf->mergeStf(std::move(lStf));
+      }
+    }
 
-      if (lCurrId <= mLastSeqStfId) {
-        EDDLOG_RL(500, "READOUT_INTERFACE: Repeated STF will be rejected. previous_stf_id={} current_stf_id={}",
-          mLastSeqStfId, lCurrId);
-        // reject this STF.
-        continue;
+    if (lPending.mBuilders != lAllBuilders) {
+      continue;
+    }
+
+    // STF is complete. Older STFs cannot be completed any more
+    while (!lPendingStfs.empty() && lPendingStfs.begin()->first <= lStfId) {
+      const auto lIt = lPendingStfs.begin();
+      if (lIt->first != lStfId) {
+        WDDLOG_RL(1000, "READOUT INTERFACE: Queuing incomplete STF. stf_id={} finished_builders={}/{}",
+          lIt->first, __builtin_popcountll(lIt->second.mBuilders), lNumBuilders);
       }
+      lQueueStf(lIt->second);
+      lPendingStfs.erase(lIt);
+    }
+  }
 
-      // expected next stf
-      if ((mLastSeqStfId + 1) == lCurrId) {
-        mLastSeqStfId = lCurrId;
-        mDevice.I().queue(eStfBuilderOut, std::move(*lStf));
-        continue;
+  DDDLOG("Exiting StfMerge thread.");
+}
+
+void StfInputInterface::StfSequencerThread()
+{
+  using namespace std::chrono_literals;
+
+  static constexpr std::uint64_t sMaxMissingStfsForSeq = 2ull * 11234 / 256; // 2 seconds of STFs
+
+  auto lSequenceStf = [&](std::unique_ptr<SubTimeFrame> &&pStf) {
+    const auto lCurrId = pStf->id();
+
+    if (lCurrId <= mLastSeqStfId) {
+      EDDLOG_RL(500, "READOUT_INTERFACE: Repeated STF will be rejected. previous_stf_id={} current_stf_id={}",
+        mLastSeqStfId, lCurrId);
+      // reject this STF.
+      mLateDroppedBytes += pStf->getDataSize();
+      return;
+    }
+
+    // expected next stf
+    if ((mLastSeqStfId + 1) == lCurrId) {
+      mLastSeqStfId = lCurrId;
+      mDevice.I().queue(eStfBuilderOut, std::move(pStf));
+      return;
+    }
+
+    // there are missing STFs
+    const auto lMissingIdStart = mLastSeqStfId + 1;
+    const auto lMissingCnt = lCurrId - lMissingIdStart;
+
+    if (lMissingCnt < sMaxMissingStfsForSeq) {
+      WDDLOG_RL(1000, "READOUT_INTERFACE: Creating empty (missing) STFs. previous_stf_id={} num_missing={}",
+        mLastSeqStfId, lMissingCnt);
+      // create the missing ones and continue
+      for (std::uint64_t lStfIdIdx = lMissingIdStart; lStfIdIdx < lCurrId; lStfIdIdx++) {
+        auto lEmptyStf = SubTimeFramePool::get(lStfIdIdx);
+        lEmptyStf->setOrigin(SubTimeFrame::Header::Origin::eNull);
+        mDevice.I().queue(eStfBuilderOut, std::move(lEmptyStf));
       }
+    } else {
+      WDDLOG_RL(1000, "READOUT_INTERFACE: Large STF gap. previous_stf_id={} current_stf_id={} num_missing={}",
+        mLastSeqStfId, lCurrId, lMissingCnt);
+    }
 
-      // there are missing STFs
-      const auto lMissingIdStart = mLastSeqStfId + 1;
-      const auto lMissingCnt = lCurrId - lMissingIdStart;
-
-      if (lMissingCnt < sMaxMissingStfsForSeq) {
-        WDDLOG_RL(1000, "READOUT_INTERFACE: Creating empty (missing) STFs. previous_stf_id={} num_missing={}",
-          mLastSeqStfId, lMissingCnt);
-        // create the missing ones and continue
-        for (std::uint64_t lStfIdIdx = lMissingIdStart; lStfIdIdx < lCurrId; lStfIdIdx++) {
-          auto lEmptyStf = std::make_unique<SubTimeFrame>(lStfIdIdx);
-          (*lStf)->setOrigin(SubTimeFrame::Header::Origin::eNull);
-          mDevice.I().queue(eStfBuilderOut, std::move(lEmptyStf));
-        }
-      } else {
-        WDDLOG_RL(1000, "READOUT_INTERFACE: Large STF gap. previous_stf_id={} current_stf_id={} num_missing={}",
-          mLastSeqStfId, lCurrId, lMissingCnt);
+    // insert the actual stf
+    mLastSeqStfId = lCurrId;
+    mDevice.I().queue(eStfBuilderOut, std::move(pStf));
+  };
+
+  // Reorder window: STFs are held until they are older than the window, or newer STFs fill the window
+  struct HeldStf {
+    std::unique_ptr<SubTimeFrame> mStf;
+    std::chrono::steady_clock::time_point mArrival;
+  };
+  std::map<std::uint64_t, HeldStf> lHeldStfs;
+  const bool lReordering = (mReorderWindowTfs > 0);
+
+  auto lReleaseStfs = [&](const bool pAll) {
+    const auto lNow = std::chrono::steady_clock::now();
+    while (!lHeldStfs.empty()) {
+      const auto lIt = lHeldStfs.begin();
+      if (!pAll && ((lNow - lIt->second.mArrival) < mReorderWindowMs) &&
+        ((lHeldStfs.rbegin()->first - lIt->first) < mReorderWindowTfs)) {
+        break;
       }
+      lSequenceStf(std::move(lIt->second.mStf));
+      lHeldStfs.erase(lIt);
+    }
+  };
 
-      // insert the actual stf
-      mLastSeqStfId = lCurrId;
-      mDevice.I().queue(eStfBuilderOut, std::move(*lStf));
+  while (mRunning) {
+    const auto lWaitFor = lHeldStfs.empty() ? 500ms : std::min<std::chrono::milliseconds>(500ms, mReorderWindowMs);
+    auto lStf = mSeqStfQueue.pop_wait_for(lWaitFor);
+
+    if (!mAcceptingData) {
+      lHeldStfs.clear();
+      continue;
+    }
+
+    if (lStf == std::nullopt) {
+      // no new data: release held STFs
+      lReleaseStfs(true);
       continue;
     }
 
-    // TODO: handle timeouts
+    // have data, check the sequence
+    (*lStf)->setOrigin(SubTimeFrame::Header::Origin::eReadout);
+    (*lStf)->setTraceSampling(mDevice.I().mTraceSampling);
+    (*lStf)->trace(SubTimeFrame::Header::Trace::eStfBuilt);
+
+    if (!lReordering) {
+      lSequenceStf(std::move(*lStf));
+      continue;
+    }
+
+    const auto lCurrId = (*lStf)->id();
+    if (lCurrId <= mLastSeqStfId) {
+      EDDLOG_RL(500, "READOUT_INTERFACE: Late STF data outside of the reorder window will be rejected. "
+        "previous_stf_id={} current_stf_id={}", mLastSeqStfId, lCurrId);
+      mLateDroppedBytes += (*lStf)->getDataSize();
+      continue;
+    }
+
+    auto lHeldIt = lHeldStfs.find(lCurrId);
+    if (lHeldIt == lHeldStfs.end()) {
+      lHeldStfs.emplace(lCurrId, HeldStf{ std::move(*lStf), std::chrono::steady_clock::now() });
+    } else {
+      // late data of a held STF
+      auto &lHeldStf = lHeldIt->second.mStf;
+      mReorderedBytes += (*lStf)->getDataSize();
+      DDDLOG_RL(1000, "READOUT_INTERFACE: Merging late STF data. stf_id={} size={}", lCurrId, (*lStf)->getDataSize());
+
+      lHeldStf->updateFirstOrbit((*lStf)->header().mFirstOrbit);
+      lHeldStf->updateRunNumber(std::max(lHeldStf->header().mRunNumber, (*lStf)->header().mRunNumber));
+      lHeldStf->mergeStf(std::move(*lStf));
+    }
+
+    lReleaseStfs(false);
   }
 
   DDDLOG("Exiting StfSequencerThread thread.");
@@ -21,7 +21,10 @@
 #include <Headers/DataHeader.h>
 
 #include <thread>
+#include <atomic>
 #include <vector>
+#include <chrono>
+#include <tuple>
 
 namespace o2::DataDistribution
 {
@@ -39,7 +42,9 @@ public:
     : mDevice(pStfBuilderDev)
   { }
 
-  void start();
+  void start(const std::size_t pNumBuilders = 1, const std::uint64_t pReorderWindowTfs = 0,
+    const std::chrono::milliseconds pReorderWindowMs = std::chrono::milliseconds(50),
+    const std::chrono::microseconds pBusyPoll = std::chrono::microseconds(0));
   void stop();
 
   void setRunningState(bool pRunning) {
@@ -47,31 +52,56 @@ public:
     mAcceptingData = pRunning;
   }
 
-  void DataHandlerThread();
-  void StfBuilderThread();
+  void DataHandlerThread(const std::size_t pInputIdx);
+  void StfBuilderThread(const std::size_t pIdx);
+  void StfMergeThread();
   void StfSequencerThread();
 
   double StfTimeMean() const { return mStfTimeMean; }
+  LogLinearHistogram& StfIntervalHist() { return mStfIntervalUs; }
+  std::uint64_t ReorderedBytes() const { return mReorderedBytes; }
+  std::uint64_t LateDroppedBytes() const { return mLateDroppedBytes; }
  private:
   /// Main SubTimeBuilder O2 device
   StfBuilderDevice &mDevice;
 
-  /// Thread for the input channel
+  /// Threads for the input channel (one per sub-channel)
+  /// With more than one input, each input thread feeds its own subset of the builders
   bool mRunning = false;
   bool mAcceptingData = false;
-  std::thread mInputThread;
+  std::size_t mNumInputs = 1;
+  std::vector<std::thread> mInputThreads;
+  std::chrono::microseconds mBusyPoll{ 0 }; // spin budget of the input threads (0: blocking receive)
 
   double mStfTimeMean = 1.0;
-
-  /// StfBuilding thread and queues
-  std::unique_ptr<ConcurrentFifo<std::vector<FairMQMessagePtr>>> mBuilderInputQueue = nullptr;
-  std::unique_ptr<SubTimeFrameReadoutBuilder> mStfBuilder = nullptr;
-  std::thread mBuilderThread;
+  std::chrono::steady_clock::time_point mLastStfTime;
+  LogLinearHistogram mStfIntervalUs;
+  void updateStfTimeMean();
+
+  /// StfBuilding threads and queues (single producer and consumer)
+  /// With more than one builder, readout messages are sharded by equipment and link. Every builder
+  /// produces a partial STF, partial STFs are merged by the StfMergeThread.
+  static constexpr std::size_t cBuilderInputQueueCapacity = 4096;
+  static constexpr std::size_t cMaxBuilderThreads = 64;
+  std::vector<std::unique_ptr<ConcurrentSpscRing<std::vector<FairMQMessagePtr>>>> mBuilderInputQueues;
+  std::vector<std::unique_ptr<SubTimeFrameReadoutBuilder>> mStfBuilders;
+  std::vector<std::thread> mBuilderThreads;
+
+  /// StfMerge thread (sharded building only): <builder index, stf id, partial stf (can be nullptr)>
+  using PartialStfT = std::tuple<std::size_t, std::uint32_t, std::unique_ptr<SubTimeFrame>>;
+  std::unique_ptr<ConcurrentMpmcRing<PartialStfT>> mPartialStfQueue = nullptr;
+  std::thread mStfMergeThread;
 
   /// StfSequencer thread
-  ConcurrentFifo<std::unique_ptr<SubTimeFrame>> mSeqStfQueue;
+  ConcurrentSpscRing<std::unique_ptr<SubTimeFrame>> mSeqStfQueue;
   std::uint64_t mLastSeqStfId = 0;
   std::thread mStfSeqThread;
+
+  /// Reorder window: late data of recent STFs is held and merged instead of dropped (0 TFs: disabled)
+  std::uint64_t mReorderWindowTfs = 0;
+  std::chrono::milliseconds mReorderWindowMs{ 50 };
+  std::atomic_uint64_t mReorderedBytes = 0;
+  std::atomic_uint64_t mLateDroppedBytes = 0;
 };
 
 } /* namespace o2::DataDistribution */
@@ -0,0 +1,128 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "StfLoadShedder.h"
+
+#include <DataDistLogger.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace o2::DataDistribution
+{
+
+using namespace o2::header;
+
+bool StfLoadShedder::configure(const std::string &pPolicy, const double pLowWatermark, const double pHighWatermark)
+{
+  mPolicies.clear();
+  mPriorities.clear();
+
+  std::vector<std::string> lOriginStrs;
+  boost::split(lOriginStrs, pPolicy, boost::is_any_of(","), boost::token_compress_on);
+
+  for (auto &lOriginStr : lOriginStrs) {
+    boost::algorithm::trim(lOriginStr);
+    if (lOriginStr.empty()) {
+      continue;
+    }
+
+    std::vector<std::string> lFields;
+    boost::split(lFields, lOriginStr, boost::is_any_of(":"));
+    if (lFields.size() < 2 || lFields.size() > 3 || lFields[0].empty() || lFields[0].size() > DataOrigin::size) {
+      EDDLOG("STF load shedding: invalid origin policy. policy={}", lOriginStr);
+      return false;
+    }
+
+    DataOrigin lOrigin;
+    lOrigin.runtimeInit(boost::to_upper_copy(lFields[0]).c_str());
+
+    unsigned lPriority = 0;
+    std::uint64_t lKeepOneOf = 0;
+    try {
+      lPriority = std::stoul(lFields[1]);
+      lKeepOneOf = (lFields.size() == 3) ? std::stoull(lFields[2]) : 0;
+    } catch (std::logic_error &) {
+      EDDLOG("STF load shedding: invalid priority or sampling. policy={}", lOriginStr);
+      return false;
+    }
+
+    mPolicies.emplace_back(lOrigin, lPriority, lKeepOneOf);
+    mPriorities.push_back(lPriority);
+  }
+
+  std::sort(mPriorities.begin(), mPriorities.end());
+  mPriorities.erase(std::unique(mPriorities.begin(), mPriorities.end()), mPriorities.end());
+
+  if (!(pLowWatermark >= 0.0 && pLowWatermark < pHighWatermark && pHighWatermark <= 1.0)) {
+    EDDLOG("STF load shedding: invalid watermarks. low={} high={}", pLowWatermark, pHighWatermark);
+    return false;
+  }
+  mLowWatermark = pLowWatermark;
+  mHighWatermark = pHighWatermark;
+
+  return true;
+}
+
+void StfLoadShedder::shed(SubTimeFrame &pStf, const double pPressure)
+{
+  // the number of shed priorities grows linearly between the watermarks
+  unsigned lLevel = 0;
+  if (pPressure >= mLowWatermark) {
+    const double lFrac = std::min(1.0, (pPressure - mLowWatermark) / (mHighWatermark - mLowWatermark));
+    lLevel = std::min(unsigned(mPriorities.size()), 1 + unsigned(std::floor(lFrac * mPriorities.size())));
+  }
+
+  const auto lPrevLevel = mLevel.exchange(lLevel);
+  if (lPrevLevel != lLevel) {
+    if (lLevel > 0) {
+      WDDLOG_RL(1000, "STF load shedding: output is falling behind, shedding origins with priority <= {}. "
+        "pressure={:.3}", mPriorities[lLevel - 1], pPressure);
+    } else {
+      IDDLOG_RL(1000, "STF load shedding: output recovered. pressure={:.3}", pPressure);
+    }
+  }
+
+  if (lLevel == 0) {
+    return;
+  }
+
+  const auto lMaxPriority = mPriorities[lLevel - 1];
+  const auto lStfId = pStf.header().mId;
+
+  for (auto &lPolicy : mPolicies) {
+    if (lPolicy.mPriority > lMaxPriority) {
+      continue;
+    }
+
+    // sampled STFs are kept on all StfBuilders
+    if (lPolicy.mKeepOneOf > 0 && (lStfId % lPolicy.mKeepOneOf) == 0) {
+      continue;
+    }
+
+    DataIdentifier lIden;
+    lIden.dataOrigin = lPolicy.mOrigin;
+    lIden.dataDescription = gDataDescriptionAny;
+
+    auto lShedStf = mSplitter.split(pStf, lIden);
+    const auto lShedSize = lShedStf ? lShedStf->getDataSize() : 0;
+    if (lShedStf && !lShedStf->getEquipmentIdentifiers().empty()) {
+      lPolicy.mShedStfs.fetch_add(1, std::memory_order_relaxed);
+      lPolicy.mShedBytes.fetch_add(lShedSize, std::memory_order_relaxed);
+    }
+  }
+}
+
+} /* namespace o2::DataDistribution */
@@ -0,0 +1,73 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef ALICEO2_STFBUILDER_LOAD_SHEDDER_H_
+#define ALICEO2_STFBUILDER_LOAD_SHEDDER_H_
+
+#include <SubTimeFrameDataModel.h>
+#include <SubTimeFrameUtils.h>
+
+#include <Headers/DataHeader.h>
+
+#include <atomic>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace o2::DataDistribution
+{
+
+/// Drops the data of low priority detectors when the output of the StfBuilder falls behind
+///
+/// The pressure is the fill level of the pipeline or of the shm regions, in [0, 1]. Between the low and the
+/// high watermark, the configured origins are shed in the order of their priority (lowest first). Origins
+/// not in the policy are never shed. A shed origin can keep 1 of N STFs, selected by the STF id so that
+/// all StfBuilders keep the data of the same TimeFrames.
+class StfLoadShedder
+{
+public:
+  struct OriginPolicy {
+    OriginPolicy(const o2::header::DataOrigin pOrigin, const unsigned pPriority, const std::uint64_t pKeepOneOf)
+    : mOrigin(pOrigin), mPriority(pPriority), mKeepOneOf(pKeepOneOf) { }
+
+    o2::header::DataOrigin mOrigin;
+    unsigned mPriority;
+    std::uint64_t mKeepOneOf; // 0: all data is dropped while shed
+
+    std::atomic_uint64_t mShedStfs = 0;
+    std::atomic_uint64_t mShedBytes = 0;
+  };
+
+  /// "ORIG:priority[:N],..."
+  bool configure(const std::string &pPolicy, const double pLowWatermark, const double pHighWatermark);
+  bool enabled() const { return !mPolicies.empty(); }
+
+  /// remove the data of origins shed at pPressure
+  void shed(SubTimeFrame &pStf, const double pPressure);
+
+  const std::deque<OriginPolicy>& policies() const { return mPolicies; }
+  unsigned level() const { return mLevel; }
+
+private:
+  std::deque<OriginPolicy> mPolicies;
+  std::vector<unsigned> mPriorities; // distinct, ascending
+  double mLowWatermark = 1.0;
+  double mHighWatermark = 1.0;
+
+  std::atomic_uint mLevel = 0; // number of shed priorities
+  DataIdentifierSplitter mSplitter;
+};
+
+} /* namespace o2::DataDistribution */
+
+#endif /* ALICEO2_STFBUILDER_LOAD_SHEDDER_H_ */
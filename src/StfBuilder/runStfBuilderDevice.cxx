@@ -17,6 +17,7 @@
 #include <SubTimeFrameFileSink.h>
 #include <SubTimeFrameFileSource.h>
 #include <FmqUtilities.h>
+#include <MemoryUtils.h>
 
 #include <fairmq/DeviceRunner.h>
 
@@ -64,10 +65,39 @@ int main(int argc, char* argv[])
           bpo::value<std::uint64_t>()->default_value(0),
           "Maximum number of built and forwarded (Sub)TimeFrames before closing (unlimited: 0, default)."
         )
+        (
+          o2::DataDistribution::StfBuilderDevice::OptionKeyTraceSampling,
+          bpo::value<std::uint64_t>()->default_value(0),
+          "Trace hand-off times of 1 in N TimeFrames, by the TF id (disabled: 0, default)."
+        )
         (
           o2::DataDistribution::StfBuilderDevice::OptionKeyOutputChannelName,
           bpo::value<std::string>()->default_value("builder-stf-channel"),
           "Name of the output channel."
+        )
+        (
+          o2::DataDistribution::StfBuilderDevice::OptionKeyStfRouting,
+          bpo::value<std::string>()->default_value(""),
+          "Route parts of each SubTimeFrame to the outputs: '<output>:<ORIG[/DESC]>,...;...'. Outputs are "
+          "'stfsender', 'dpl', and 'sink' (file sink), '*' selects all data. Outputs not listed receive no data. "
+          "Data routed to several outputs is shared, not copied. Default: all data to the StfSender or DPL output."
+        )
+        (
+          o2::DataDistribution::StfBuilderDevice::OptionKeyStfShedding,
+          bpo::value<std::string>()->default_value(""),
+          "Drop data of lower priority origins first when the output falls behind: '<ORIG>:<priority>[:<N>],...'. "
+          "Origins with the lowest priority are shed first, a shed origin keeps 1 of N SubTimeFrames (by the STF id). "
+          "Origins not listed are never shed. Default: disabled."
+        )
+        (
+          o2::DataDistribution::StfBuilderDevice::OptionKeyStfSheddingLowWatermark,
+          bpo::value<double>()->default_value(0.7),
+          "Fill level of the pipeline (max-buffered-stfs) or of the shm regions where shedding starts."
+        )
+        (
+          o2::DataDistribution::StfBuilderDevice::OptionKeyStfSheddingHighWatermark,
+          bpo::value<double>()->default_value(0.95),
+          "Fill level of the pipeline or of the shm regions where all origins in the shedding policy are shed."
         );
 
       bpo::options_description lStfBuilderDplOptions("StfBuilder DPL options", 120);
@@ -88,6 +118,8 @@ int main(int argc, char* argv[])
       r.fConfig.AddToCmdLineOptions(o2::DataDistribution::SubTimeFrameFileSink::getProgramOptions());
       // Add options for STF file source
       r.fConfig.AddToCmdLineOptions(o2::DataDistribution::SubTimeFrameFileSource::getProgramOptions());
+      // Add options for shared memory regions
+      r.fConfig.AddToCmdLineOptions(o2::DataDistribution::MemoryResources::getProgramOptions());
 
     });
 
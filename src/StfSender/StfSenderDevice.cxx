@@ -79,6 +79,9 @@ void StfSenderDevice::InitTask()
     lStatus.mutable_info()->set_process_state(BasicInfo::NOT_RUNNING);
     lStatus.mutable_info()->set_process_id(Config::getIdOption(StfSender, *GetConfig()));
     lStatus.mutable_info()->set_ip_address(Config::getNetworkIfAddressOption(*GetConfig()));
+    for (const auto &[lLabel, lValue] : Config::getTopologyOption(*GetConfig())) {
+      (*lStatus.mutable_info()->mutable_topology())[lLabel] = lValue;
+    }
 
     // wait for "partition-id"
     while (!Config::getPartitionOption(*GetConfig())) {
@@ -127,9 +130,11 @@ void StfSenderDevice::InitTask()
       lStatus.set_rpc_endpoint(lStatus.info().ip_address() + ":" + std::to_string(lRpcRealPort));
       I().mDiscoveryConfig->write();
 
-      // contact the scheduler on gRPC
+      // contact the scheduler on gRPC, as soon as the instance is registered
+      I().mDiscoveryConfig->startWatch("TfSchedulerInstance");
+      std::uint64_t lDiscoveryIndex = 0;
       while (!I().mTfSchedulerRpcClient.start(I().mDiscoveryConfig)) {
-        std::this_thread::sleep_for(250ms);
+        I().mDiscoveryConfig->waitForUpdate(lDiscoveryIndex, 250ms);
       }
     }
 
@@ -265,20 +270,22 @@ void StfSenderDevice::StfReceiverThread()
       if (lStf) {
         WDDLOG_RL(1000, "StfSender: received STF but not in the running state.");
       }
-      DDMON("stfsender", "stf_input.rate", 0.0);
-      DDMON("stfsender", "stf_input.size", 0.0);
+      DDMON_STATIC("stfsender", "stf_input.rate", 0.0);
+      DDMON_STATIC("stfsender", "stf_input.size", 0.0);
       std::this_thread::sleep_for(20ms);
       continue;
     }
 
+    lStf->trace(SubTimeFrame::Header::Trace::eStfSenderReceived);
+
     { // Input STF frequency
       const auto lNow = hres_clock::now();
       const auto lStfDur = std::chrono::duration<double>(lNow - lStfStartTime);
       lStfStartTime = lNow;
 
-      DDMON("stfsender", "stf_input.rate", (1.0 / lStfDur.count()));
-      DDMON("stfsender", "stf_input.size", lStf->getDataSize());
-      DDMON("stfsender", "stf_input.id", (uint64_t)lStf->header().mId);
+      DDMON_STATIC("stfsender", "stf_input.rate", (1.0 / lStfDur.count()));
+      DDMON_STATIC("stfsender", "stf_input.size", lStf->getDataSize());
+      DDMON_STATIC("stfsender", "stf_input.id", (uint64_t)lStf->header().mId);
     }
 
     ++lReceivedStfs;
@@ -323,6 +330,12 @@ bool StfSenderDevice::ConditionalRun()
 
   // nothing to do here sleep for awhile
   std::this_thread::sleep_for(500ms);
+
+  // publish pipeline stage statistics every 1s
+  static unsigned sPipelineStatsCnt = 0;
+  if (++sPipelineStatsCnt % 2 == 0) {
+    DataDistMonitor::publish_pipeline("stfsender", I());
+  }
   return true;
 }
 
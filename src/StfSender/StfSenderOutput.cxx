@@ -16,9 +16,14 @@
 
 #include <SubTimeFrameDataModel.h>
 #include <SubTimeFrameVisitors.h>
+#include <SubTimeFrameCompression.h>
+#include <Crc32c.h>
 
 #include <fairmq/tools/Unique.h>
 
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+
 #include <algorithm>
 #include <condition_variable>
 #include <stdexcept>
@@ -49,14 +54,115 @@ void StfSenderOutput::start(std::shared_ptr<ConsulStfSender> pDiscoveryConfig)
     }
   }
 
+  // admission control watermarks (percent of the buffer)
+  const auto lHighWatermarkVar = getenv("DATADIST_STFS_HIGH_WATERMARK");
+  if (lHighWatermarkVar) {
+    try {
+      mHighWatermark = std::clamp(std::stod(lHighWatermarkVar), 1.0, 100.0) / 100.0;
+      mLowWatermark = mHighWatermark * 0.8;
+
+      const auto lLowWatermarkVar = getenv("DATADIST_STFS_LOW_WATERMARK");
+      if (lLowWatermarkVar) {
+        mLowWatermark = std::clamp(std::stod(lLowWatermarkVar) / 100.0, 0.0, mHighWatermark);
+      }
+
+      const auto lSubsampleVar = getenv("DATADIST_STFS_SUBSAMPLE");
+      if (lSubsampleVar) {
+        mSubsampleFactor = std::clamp(std::stoull(lSubsampleVar), 1ull, 1000ull);
+      }
+
+      IDDLOG("StfSender admission control. low_watermark={:.2f} high_watermark={:.2f} subsample={}",
+        mLowWatermark, mHighWatermark, mSubsampleFactor);
+    } catch (std::logic_error &) {
+      EDDLOG("StfSender admission control watermarks not valid. DATADIST_STFS_HIGH_WATERMARK={}", lHighWatermarkVar);
+      mHighWatermark = mLowWatermark = 0.0;
+    }
+  }
+
   // create a socket and connect
   mDevice.GetConfig()->SetProperty<int>("io-threads", (int) std::min(std::thread::hardware_concurrency(), 20u));
   mZMQTransportFactory = FairMQTransportFactory::CreateTransportFactory("zeromq", "", mDevice.GetConfig());
 
+  // pooled buffers for coalesced headers, shared by all output channels
+  const auto lHdrPoolSizeVar = getenv("DATADIST_STFS_HDR_POOL_SIZE");
+  const auto lHdrBufferSizeVar = getenv("DATADIST_STFS_HDR_BUFFER_SIZE");
+  if (lHdrPoolSizeVar) {
+    try {
+      const auto lHdrPoolSize = std::stoull(lHdrPoolSizeVar) << 20;
+      const auto lHdrBufferSize = lHdrBufferSizeVar ? (std::stoull(lHdrBufferSizeVar) << 10) :
+        CoalescedHdrBufferPool::cDefaultBufferSize;
+      if (lHdrPoolSize > 0) {
+        mHdrBufferPool = std::make_shared<CoalescedHdrBufferPool>(*mZMQTransportFactory, lHdrPoolSize, lHdrBufferSize);
+      }
+    } catch (std::logic_error &) {
+      EDDLOG("StfSender header pool size is not valid. DATADIST_STFS_HDR_POOL_SIZE={} DATADIST_STFS_HDR_BUFFER_SIZE={}",
+        lHdrPoolSizeVar, (lHdrBufferSizeVar ? lHdrBufferSizeVar : ""));
+    }
+  }
+
+  // send large STFs in several chunks, split on equipment boundaries
+  const auto lChunkSizeVar = getenv("DATADIST_STFS_CHUNK_SIZE");
+  if (lChunkSizeVar) {
+    try {
+      mChunkSize = std::stoull(lChunkSizeVar) << 20;
+      IDDLOG("StfSender: sending STFs in chunks. chunk_size={}", mChunkSize);
+    } catch (std::logic_error &) {
+      EDDLOG("StfSender chunk size is not valid. DATADIST_STFS_CHUNK_SIZE={}", lChunkSizeVar);
+    }
+  }
+
+  // compress payloads of selected data origins (comma separated)
+  const auto lCompressVar = getenv("DATADIST_STFS_COMPRESS");
+  if (lCompressVar) {
+    std::vector<std::string> lOriginStrs;
+    boost::split(lOriginStrs, lCompressVar, boost::is_any_of(","), boost::token_compress_on);
+
+    std::vector<o2::header::DataOrigin> lOrigins;
+    for (const auto &lOriginStr : lOriginStrs) {
+      if (lOriginStr.empty() || lOriginStr.size() > o2::header::DataOrigin::size) {
+        EDDLOG("StfSender compression: invalid data origin. origin={}", lOriginStr);
+        continue;
+      }
+      o2::header::DataOrigin lOrigin;
+      lOrigin.runtimeInit(lOriginStr.c_str());
+      lOrigins.push_back(lOrigin);
+    }
+
+    unsigned lNumThreads = 4;
+    const auto lCompressThreadsVar = getenv("DATADIST_STFS_COMPRESS_THREADS");
+    if (lCompressThreadsVar) {
+      try {
+        lNumThreads = std::clamp(std::stoul(lCompressThreadsVar), 1ul, 64ul);
+      } catch (std::logic_error &) {
+        EDDLOG("StfSender compression threads not valid. DATADIST_STFS_COMPRESS_THREADS={}", lCompressThreadsVar);
+      }
+    }
+
+    if (!StfPayloadCompressor::available()) {
+      WDDLOG("StfSender compression requested, but LZ4 support is not built. Sending uncompressed.");
+    } else if (!lOrigins.empty()) {
+      IDDLOG("StfSender: compressing payloads. origins={} threads={}", lCompressVar, lNumThreads);
+      mCompressor = std::make_shared<StfPayloadCompressor>(lOrigins, lNumThreads);
+    }
+  }
+
+  // send headers in the blocks they were allocated in (no copy)
+  mHeaderBlocks = (getenv("DATADIST_STFS_HDR_BLOCKS") != nullptr);
+  if (mHeaderBlocks) {
+    IDDLOG("StfSender: sending STF headers as header blocks.");
+  }
+
+  // CRC32C of the sent payloads, verified by TfBuilders with stf-verify-checksums
+  mChecksums = (getenv("DATADIST_STFS_CHECKSUM") != nullptr);
+  if (mChecksums) {
+    IDDLOG("StfSender: sending CRC32C checksums of STF payloads. hardware={}", Crc32c::hardware());
+  }
+
   // create stf drop thread
   mStfDropThread = create_thread_member("stfs_drop", &StfSenderOutput::StfDropThread, this);
 
-  // create scheduler thread
+  // create scheduler threads
+  mAnnounceThread = create_thread_member("stfs_announce", &StfSenderOutput::StfAnnounceThread, this);
   mSchedulerThread = create_thread_member("stfs_sched", &StfSenderOutput::StfSchedulerThread, this);
 }
 
@@ -67,6 +173,12 @@ void StfSenderOutput::stop()
     mSchedulerThread.join();
   }
 
+  // stop announcing
+  mAnnounceQueue.stop();
+  if (mAnnounceThread.joinable()) {
+    mAnnounceThread.join();
+  }
+
   // stop the drop queue
   mDropQueue.stop();
   if (mStfDropThread.joinable()) {
@@ -84,15 +196,40 @@ void StfSenderOutput::stop()
 
   // wait for threads to exit
   for (auto& lIdOutputIt : mOutputMap) {
-    if (lIdOutputIt.second.mThread.joinable()) {
-      lIdOutputIt.second.mThread.join();
+    for (auto &lThread : lIdOutputIt.second.mThreads) {
+      if (lThread.joinable()) {
+        lThread.join();
+      }
     }
   }
 
+  // the header region is released before the channels (and their transport) are destroyed
+  mHdrBufferPool.reset();
+
   {
     std::scoped_lock lLock(mOutputMapLock);
     mOutputMap.clear();
   }
+
+  mCompressor.reset();
+}
+
+std::shared_ptr<FairMQTransportFactory> StfSenderOutput::transportForEndpoint(const std::string &pEndpoint)
+{
+  if (pEndpoint.rfind("verbs://", 0) != 0) {
+    return mZMQTransportFactory;
+  }
+
+  std::call_once(mOfiTransportOnce, [&]() {
+    try {
+      mOfiTransportFactory = FairMQTransportFactory::CreateTransportFactory("ofi", "", mDevice.GetConfig());
+      IDDLOG("StfSender: created the ofi transport for RDMA capable TfBuilder endpoints.");
+    } catch (std::exception &e) {
+      EDDLOG("StfSender: cannot create the ofi transport. what={}", e.what());
+    }
+  });
+
+  return mOfiTransportFactory;
 }
 
 bool StfSenderOutput::running() const
@@ -116,45 +253,68 @@ StfSenderOutput::ConnectStatus StfSenderOutput::connectTfBuilder(const std::stri
   auto lChanName = "tf_builder_" + pTfBuilderId;
   std::replace(lChanName.begin(), lChanName.end(),'.', '_');
 
-  auto lNewChannel = std::make_unique<FairMQChannel>(
-    lChanName ,              // name
-    "push",                  // type
-    "connect",               // method
-    pEndpoint,               // address (TODO: this should only ever be the IB interface)
-    mZMQTransportFactory
-  );
+  // one channel for each advertised endpoint (comma separated)
+  std::vector<std::string> lEndpoints;
+  boost::split(lEndpoints, pEndpoint, boost::is_any_of(","), boost::token_compress_on);
+
+  std::vector<std::unique_ptr<FairMQChannel>> lNewChannels;
+  for (const auto &lEndpoint : lEndpoints) {
+    // the TfBuilder selects the transport with the endpoint scheme
+    auto lTransport = transportForEndpoint(lEndpoint);
+    if (!lTransport) {
+      EDDLOG("Transport for the TfBuilder endpoint is not available. tfb_id={} ep={}", pTfBuilderId, lEndpoint);
+      return eCONNERR;
+    }
 
-  lNewChannel->UpdateSndBufSize(2);
-  lNewChannel->Init();
+    auto lNewChannel = std::make_unique<FairMQChannel>(
+      lChanName + (lEndpoints.size() > 1 ? "_" + std::to_string(lNewChannels.size()) : ""), // name
+      "push",                  // type
+      "connect",               // method
+      lEndpoint,               // address (TODO: this should only ever be the IB interface)
+      lTransport
+    );
 
-  if (!lNewChannel->Validate()) {
-    EDDLOG("Channel validation failed when connecting. tfb_id={} ep={}", pTfBuilderId, pEndpoint);
-    return eCONNERR;
-  }
+    lNewChannel->UpdateSndBufSize(2);
+    lNewChannel->Init();
+
+    if (!lNewChannel->Validate()) {
+      EDDLOG("Channel validation failed when connecting. tfb_id={} ep={}", pTfBuilderId, lEndpoint);
+      return eCONNERR;
+    }
+
+    if (!lNewChannel->ConnectEndpoint(lEndpoint)) {
+      EDDLOG("Cannot connect a new cannel. ep={}", lEndpoint);
+      return eCONNERR;
+    }
 
-  if (!lNewChannel->ConnectEndpoint(pEndpoint)) {
-    EDDLOG("Cannot connect a new cannel. ep={}", pEndpoint);
-    return eCONNERR;
+    lNewChannels.push_back(std::move(lNewChannel));
   }
 
   // create all resources for the connection
   {
     std::scoped_lock lLock(mOutputMapLock);
 
-    char lThreadName[128];
-    std::snprintf(lThreadName, 127, "to_%s", pTfBuilderId.c_str());
-    lThreadName[15] = '\0'; // kernel limitation
-
-    mOutputMap.try_emplace(
+    auto [lIt, lInserted] = mOutputMap.try_emplace(
       pTfBuilderId,
       OutputChannelObjects {
         pEndpoint,
-        std::move(lNewChannel),
+        std::move(lNewChannels),
         std::make_unique<ConcurrentFifo<std::unique_ptr<SubTimeFrame>>>(),
-        // Note: this thread will try to access this same map. The MapLock will prevent races
-        create_thread_member(lThreadName, &StfSenderOutput::DataHandlerThread, this, pTfBuilderId)
+        std::vector<std::thread>()
       }
     );
+    assert (lInserted);
+
+    // Note: these threads will try to access this same map. The MapLock will prevent races
+    for (std::size_t lChanIdx = 0; lChanIdx < lIt->second.mChannels.size(); lChanIdx++) {
+      char lThreadName[128];
+      std::snprintf(lThreadName, 127, "to_%s", pTfBuilderId.c_str());
+      lThreadName[15] = '\0'; // kernel limitation
+
+      lIt->second.mThreads.push_back(
+        create_thread_member(lThreadName, &StfSenderOutput::DataHandlerThread, this, pTfBuilderId, lChanIdx)
+      );
+    }
   }
 
   // update our connection status
@@ -196,12 +356,16 @@ bool StfSenderOutput::disconnectTfBuilder(const std::string &pTfBuilderId, const
   // stop and teardown everything
   IDDLOG("StfSenderOutput::disconnectTfBuilder: Stopping sending thread. tfb_id={}", pTfBuilderId);
   lOutputObj.mStfQueue->stop();
-  if (lOutputObj.mThread.joinable()) {
-    lOutputObj.mThread.join();
+  for (auto &lThread : lOutputObj.mThreads) {
+    if (lThread.joinable()) {
+      lThread.join();
+    }
   }
-  DDDLOG("StfSenderOutput::disconnectTfBuilder: Stopping sending channel. tfb_id={}", pTfBuilderId);
-  if (lOutputObj.mChannel->IsValid() ) {
-    lOutputObj.mChannel->GetSocket().Close();
+  DDDLOG("StfSenderOutput::disconnectTfBuilder: Stopping sending channels. tfb_id={}", pTfBuilderId);
+  for (auto &lChannel : lOutputObj.mChannels) {
+    if (lChannel->IsValid() ) {
+      lChannel->GetSocket().Close();
+    }
   }
 
   // update our connection status
@@ -213,8 +377,37 @@ bool StfSenderOutput::disconnectTfBuilder(const std::string &pTfBuilderId, const
   return true;
 }
 
+StfSenderOutput::AdmissionState StfSenderOutput::admissionState(const std::uint64_t pBufferedSize)
+{
+  if (mHighWatermark <= 0.0) {
+    return eAdmitAll;
+  }
+
+  const double lUsed = double(pBufferedSize) / double(mBufferSize);
+
+  AdmissionState lNewState = eAdmitAll;
+  if (lUsed >= mHighWatermark || (mAdmissionState == eAdmitNone && lUsed >= mLowWatermark)) {
+    lNewState = eAdmitNone;
+  } else if (lUsed >= mLowWatermark || mSchedulerRejected) {
+    lNewState = eAdmitSubsample;
+  }
+
+  if (lNewState != mAdmissionState) {
+    WDDLOG_RL(1000, "StfSender admission control: state changed. state={} buffer_used={:.2f}",
+      (lNewState == eAdmitAll) ? "admit_all" : (lNewState == eAdmitSubsample) ? "subsample" : "drop", lUsed);
+    DDMON_STATIC("stfsender", "admission.watermark_crossing", 1);
+    mAdmissionState = lNewState;
+  }
+  DDMON_STATIC("stfsender", "admission.state", int(mAdmissionState));
+
+  return mAdmissionState;
+}
+
 void StfSenderOutput::StfSchedulerThread()
 {
+  std::uint64_t lAdmissionDroppedCnt = 0;
+  std::uint64_t lAdmissionDroppedSize = 0;
+
   DDDLOG("StfSchedulerThread: Starting.");
   // Notifies the scheduler about stfs
   std::unique_ptr<SubTimeFrame> lStf;
@@ -232,71 +425,205 @@ void StfSenderOutput::StfSchedulerThread()
       continue;
     }
 
-    DDDLOG_RL(5000, "StfSchedulerThread: scheduling stf_id={}", lStfId);
-
-    StfSenderStfInfo lStfInfo;
-    SchedulerStfInfoResponse lSchedResponse;
+    // drop locally, without a round-trip to the scheduler. Sub-sampling by id keeps the same STFs on all FLPs
+    const auto lAdmission = admissionState(mBuffered.mSize + lStfSize);
+    if ((lAdmission == eAdmitNone) || (lAdmission == eAdmitSubsample && (lStfId % mSubsampleFactor) != 0)) {
+      // accounted as buffered until the drop thread releases it
+      mBuffered.mSize += lStfSize;
+      mBuffered.mCnt += 1;
+      mDropQueue.push(std::move(lStf));
+
+      lAdmissionDroppedCnt += 1;
+      lAdmissionDroppedSize += lStfSize;
+      DDMON_STATIC("stfsender", "admission.dropped_stf_cnt", lAdmissionDroppedCnt);
+      DDMON_STATIC("stfsender", "admission.dropped_stf_size", lAdmissionDroppedSize);
+      DDDLOG_RL(1000, "StfSchedulerThread: STF not admitted. stf_id={} total_not_admitted={}", lStfId,
+        lAdmissionDroppedCnt);
+      continue;
+    }
 
-    const auto &lStatus = mDiscoveryConfig->status();
-    lStfInfo.mutable_info()->CopyFrom(lStatus.info());
-    lStfInfo.mutable_partition()->CopyFrom(lStatus.partition());
-    lStfInfo.set_stf_id(lStfId);
-    lStfInfo.set_stf_size(lStfSize);
+    DDDLOG_RL(5000, "StfSchedulerThread: scheduling stf_id={}", lStfId);
 
     // move the stf into triage map (before notifying the scheduler to avoid races)
     {
-      std::scoped_lock lLock(mScheduledStfMapLock);
+      auto &lShard = scheduledStfShard(lStfId);
+      std::scoped_lock lLock(lShard.mLock);
 
-      auto [it, ins] = mScheduledStfMap.try_emplace(lStfId, std::move(lStf));
+      auto [it, ins] = lShard.mStfs.try_emplace(lStfId, std::move(lStf));
       if (!ins) {
         (void)it;
         EDDLOG_RL(500, "StfSchedulerThread: Stf is already scheduled! Skipping the duplicate. stf_id={}", lStfId);
         continue;
       }
+    }
+
+    // update buffer size
+    mBuffered.mSize += lStfSize;
+    mBuffered.mCnt += 1;
+
+    // announce without waiting for the scheduler
+    mAnnounceQueue.push(lStfId, lStfSize);
+  }
+
+  DDDLOG("StfSchedulerThread: Exiting.");
+}
+
+void StfSenderOutput::StfAnnounceThread()
+{
+  DDDLOG("StfAnnounceThread: Starting.");
+
+  std::vector<std::tuple<std::uint64_t, std::uint64_t>> lAnnounces;
+  StfSenderStfInfoBatch lBatch;
+  SchedulerStfInfoBatchResponse lSchedResponse;
+  StfSenderStfInfo lStfInfo;
+  SchedulerStfInfoResponse lStfResponse;
+  std::vector<SchedulerStfInfoResponse::StfInfoStatus> lStatuses;
+
+  // TfSchedulers without the batch call get one StfSenderStfUpdate per STF
+  bool lBatchSupported = true;
+
+  // transient gRPC errors are retried before the STFs are dropped
+  static constexpr unsigned cMaxRetries = 5;
+  auto lSendWithRetry = [&](const auto &pSendFn) {
+    auto lBackoff = 10ms;
+    for (unsigned lRetry = 0; ; lRetry++) {
+      grpc::StatusCode lCode = grpc::StatusCode::OK;
+      if (pSendFn(lCode)) {
+        return true;
+      }
 
-      // update buffer size
-      mCounters.mBuffered.mSize += lStfSize;
-      mCounters.mBuffered.mCnt += 1;
+      if (lCode == grpc::StatusCode::UNIMPLEMENTED && lBatchSupported) {
+        WDDLOG("TfScheduler does not support batched STF announces. Using single STF announces.");
+        lBatchSupported = false;
+        return false;
+      }
+
+      const bool lTransient = (lCode == grpc::StatusCode::UNAVAILABLE) ||
+        (lCode == grpc::StatusCode::DEADLINE_EXCEEDED) || (lCode == grpc::StatusCode::RESOURCE_EXHAUSTED) ||
+        (lCode == grpc::StatusCode::ABORTED);
+      if (!lTransient || lRetry == cMaxRetries || !mAnnounceQueue.is_running()) {
+        return false;
+      }
+
+      WDDLOG_RL(5000, "Sending STF announces failed, retrying. code={} retry={}", int(lCode), lRetry + 1);
+      std::this_thread::sleep_for(lBackoff);
+      lBackoff *= 2;
+    }
+  };
+
+  while (true) {
+    lAnnounces.clear();
+    if (mAnnounceQueue.pop_all(std::back_inserter(lAnnounces)) == 0) {
+      break;
+    }
+
+    const auto &lStatus = mDiscoveryConfig->status();
+    lStatuses.assign(lAnnounces.size(), SchedulerStfInfoResponse::IGNORE__);
+
+    // Send STF infos to scheduler
+    const auto lRpcStart = std::chrono::steady_clock::now();
+    bool lBatchSent = false;
+    if (lBatchSupported) {
+      lBatch.mutable_info()->CopyFrom(lStatus.info());
+      lBatch.mutable_partition()->CopyFrom(lStatus.partition());
+      lBatch.clear_stfs();
+      for (const auto &[lStfId, lStfSize] : lAnnounces) {
+        auto *lStfAnnounce = lBatch.add_stfs();
+        lStfAnnounce->set_stf_id(lStfId);
+        lStfAnnounce->set_stf_size(lStfSize);
+      }
 
       // send current state of the buffers
-      lStfInfo.mutable_stfs_info()->set_buffer_size(mBufferSize);
-      lStfInfo.mutable_stfs_info()->set_buffer_used(mCounters.mBuffered.mSize);
-      lStfInfo.mutable_stfs_info()->set_num_buffered_stfs(mCounters.mBuffered.mCnt);
+      lBatch.mutable_stfs_info()->set_buffer_size(mBufferSize);
+      lBatch.mutable_stfs_info()->set_buffer_used(mBuffered.mSize);
+      lBatch.mutable_stfs_info()->set_num_buffered_stfs(mBuffered.mCnt);
+
+      lBatchSent = lSendWithRetry([&](grpc::StatusCode &pCode) {
+        lSchedResponse.Clear();
+        return mDevice.TfSchedRpcCli().StfSenderStfUpdateBatch(lBatch, lSchedResponse, &pCode);
+      });
+
+      for (std::size_t i = 0; lBatchSent && i < lAnnounces.size() && int(i) < lSchedResponse.status_size(); i++) {
+        lStatuses[i] = lSchedResponse.status(i);
+      }
     }
 
-    // Send STF info to scheduler
-    {
-      const auto lSentOK = mDevice.TfSchedRpcCli().StfSenderStfUpdate(lStfInfo, lSchedResponse);
-      // check if the scheduler rejected the data
-      if (!lSentOK || (lSchedResponse.status() != SchedulerStfInfoResponse::OK)) {
-        { // drop the stf
-          std::scoped_lock lLock(mScheduledStfMapLock);
-          // find the stf in the map and erase it
-          const auto lStfIter = mScheduledStfMap.find(lStfId);
-          if (lStfIter != mScheduledStfMap.end()) {
-            mDropQueue.push(std::move(lStfIter->second));
-            mScheduledStfMap.erase(lStfIter);
-          }
+    if (!lBatchSupported && !lBatchSent) {
+      lStfInfo.mutable_info()->CopyFrom(lStatus.info());
+      lStfInfo.mutable_partition()->CopyFrom(lStatus.partition());
+
+      for (std::size_t i = 0; i < lAnnounces.size(); i++) {
+        lStfInfo.set_stf_id(std::get<0>(lAnnounces[i]));
+        lStfInfo.set_stf_size(std::get<1>(lAnnounces[i]));
+        lStfInfo.mutable_stfs_info()->set_buffer_size(mBufferSize);
+        lStfInfo.mutable_stfs_info()->set_buffer_used(mBuffered.mSize);
+        lStfInfo.mutable_stfs_info()->set_num_buffered_stfs(mBuffered.mCnt);
+
+        const bool lSent = lSendWithRetry([&](grpc::StatusCode &pCode) {
+          lStfResponse.Clear();
+          return mDevice.TfSchedRpcCli().StfSenderStfUpdate(lStfInfo, lStfResponse, &pCode);
+        });
+        if (lSent) {
+          lStatuses[i] = lStfResponse.status();
         }
+      }
+    }
+    DDMON_HIST("stfsender", "stf_announce.rpc_us", std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - lRpcStart).count());
 
-      WDDLOG_RL(5000, "TfScheduler rejected the Stf announce. stf_id={} reason={}",
-        lStfId, SchedulerStfInfoResponse_StfInfoStatus_Name(lSchedResponse.status()));
+    // check if the scheduler rejected the data
+    bool lRejected = false;
+    for (std::size_t i = 0; i < lAnnounces.size(); i++) {
+      const auto lStfId = std::get<0>(lAnnounces[i]);
+      const auto lStfStatus = lStatuses[i];
+
+      if (lStfStatus == SchedulerStfInfoResponse::OK) {
+        continue;
+      }
+      lRejected = true;
+
+      { // drop the stf
+        auto &lShard = scheduledStfShard(lStfId);
+        std::scoped_lock lLock(lShard.mLock);
+        // find the stf in the map and erase it
+        const auto lStfIter = lShard.mStfs.find(lStfId);
+        if (lStfIter != lShard.mStfs.end()) {
+          mDropQueue.push(std::move(lStfIter->second));
+          lShard.mStfs.erase(lStfIter);
+        }
       }
-      DDDLOG_RL(5000, "Sent STF announce, stf_id={} stf_size={}", lStfId, lStfInfo.stf_size());
+
+      WDDLOG_RL(5000, "TfScheduler rejected the Stf announce. stf_id={} reason={}",
+        lStfId, SchedulerStfInfoResponse_StfInfoStatus_Name(lStfStatus));
     }
+    mSchedulerRejected = lRejected;
+
+    DDMON_STATIC("stfsender", "stf_announce.batch_size", lAnnounces.size());
+    DDDLOG_RL(5000, "Sent STF announces. num_stfs={} first_stf_id={}", lAnnounces.size(),
+      std::get<0>(lAnnounces.front()));
   }
 
-  DDDLOG("StfSchedulerThread: Exiting.");
+  DDDLOG("StfAnnounceThread: Exiting.");
 }
 
 void StfSenderOutput::sendStfToTfBuilder(const std::uint64_t pStfId, const std::string &pTfBuilderId, StfDataResponse &pRes)
 {
   assert(!pTfBuilderId.empty());
-  std::scoped_lock lLock(mOutputMapLock, mScheduledStfMapLock);
 
-  const auto lStfIter = mScheduledStfMap.find(pStfId);
+  // take the STF out of the scheduled map
+  std::unique_ptr<SubTimeFrame> lStf;
+  {
+    auto &lShard = scheduledStfShard(pStfId);
+    std::scoped_lock lLock(lShard.mLock);
+
+    auto lStfNode = lShard.mStfs.extract(pStfId);
+    if (lStfNode) {
+      lStf = std::move(lStfNode.mapped());
+    }
+  }
+
   // verify we have the STF: we can have
-  if (lStfIter == mScheduledStfMap.end()) {
+  if (!lStf) {
     if (pTfBuilderId != "-1") {
       pRes.set_status(StfDataResponse::DATA_DROPPED_UNKNOWN);
       EDDLOG_GRL(1000, "sendStfToTfBuilder: TfBuilder requested non-existing STF. stf_id={}", pStfId);
@@ -305,14 +632,14 @@ void StfSenderOutput::sendStfToTfBuilder(const std::uint64_t pStfId, const std::
     }
   } else if (pTfBuilderId == "-1") { // check if it is drop request from the scheduler
     pRes.set_status(StfDataResponse::DATA_DROPPED_SCHEDULER);
-    mDropQueue.push(std::move(lStfIter->second));
-    mScheduledStfMap.erase(lStfIter);
+    mDropQueue.push(std::move(lStf));
   } else {
+    std::shared_lock lLock(mOutputMapLock);
+
     auto lTfBuilderIter = mOutputMap.find(pTfBuilderId);
     if (lTfBuilderIter == mOutputMap.end()) {
       pRes.set_status(StfDataResponse::TF_BUILDER_UNKNOWN);
-      mDropQueue.push(std::move(lStfIter->second));
-      mScheduledStfMap.erase(lStfIter);
+      mDropQueue.push(std::move(lStf));
       EDDLOG_GRL(1000, "sendStfToTfBuilder: TfBuilder not known to StfSender. tfb_id={}", pTfBuilderId);
       return;
     }
@@ -321,23 +648,23 @@ void StfSenderOutput::sendStfToTfBuilder(const std::uint64_t pStfId, const std::
     // we clean the buffer when data is sent
     pRes.set_status(StfDataResponse::OK);
 
-    const auto lStfSize = lStfIter->second->getDataSize();
-    const auto lStfId = lStfIter->second->id();
-    mCounters.mInSending.mSize += lStfSize;
-    mCounters.mInSending.mCnt += 1;
+    const auto lStfSize = lStf->getDataSize();
+    const auto lStfId = lStf->id();
+    mInSending.mSize += lStfSize;
+    mInSending.mCnt += 1;
 
-    auto lStfNode = mScheduledStfMap.extract(lStfIter);
-    lTfBuilderIter->second.mStfQueue->push(std::move(lStfNode.mapped()));
+    lStf->trace(SubTimeFrame::Header::Trace::eStfSenderRequested);
+    lTfBuilderIter->second.mStfQueue->push(std::move(lStf));
 
     // monitoring
     {
       using hres_clock = std::chrono::high_resolution_clock;
-      static decltype(hres_clock::now()) sStfStartTime = hres_clock::now();
-      const auto lDuration = std::chrono::duration<double>(hres_clock::now() - sStfStartTime);
-      DDMON("stfsender", "stf_output.stf_id", lStfId);
-      DDMON("stfsender", "stf_output.stf_rate", (1.0 / lDuration.count()));
-      DDMON("stfsender", "stf_output.stf_size", lStfSize);
-      sStfStartTime = hres_clock::now();
+      static std::atomic<hres_clock::rep> sStfStartTime = hres_clock::now().time_since_epoch().count();
+      const auto lNow = hres_clock::now().time_since_epoch().count();
+      const auto lDuration = std::chrono::duration<double>(hres_clock::duration(lNow - sStfStartTime.exchange(lNow)));
+      DDMON_STATIC("stfsender", "stf_output.stf_id", lStfId);
+      DDMON_STATIC("stfsender", "stf_output.stf_rate", (1.0 / lDuration.count()));
+      DDMON_STATIC("stfsender", "stf_output.stf_size", lStfSize);
     }
 
     if (lTfBuilderIter->second.mStfQueue->size() > 50) {
@@ -347,9 +674,9 @@ void StfSenderOutput::sendStfToTfBuilder(const std::uint64_t pStfId, const std::
 }
 
 /// Sending thread
-void StfSenderOutput::DataHandlerThread(const std::string pTfBuilderId)
+void StfSenderOutput::DataHandlerThread(const std::string pTfBuilderId, const std::size_t pChanIdx)
 {
-  IDDLOG("StfSenderOutput[{}]: Starting the thread", pTfBuilderId);
+  IDDLOG("StfSenderOutput[{}]: Starting the thread. channel={}", pTfBuilderId, pChanIdx);
 
   FairMQChannel *lOutputChan = nullptr;
   ConcurrentFifo<std::unique_ptr<SubTimeFrame>> *lInputStfQueue = nullptr;
@@ -358,7 +685,7 @@ void StfSenderOutput::DataHandlerThread(const std::string pTfBuilderId)
     std::scoped_lock lLock(mOutputMapLock);
     auto &lOutData = mOutputMap.at(pTfBuilderId);
 
-    lOutputChan = lOutData.mChannel.get();
+    lOutputChan = lOutData.mChannels.at(pChanIdx).get();
     lInputStfQueue = lOutData.mStfQueue.get();
   }
   assert(lOutputChan != nullptr && lOutputChan->IsValid());
@@ -366,7 +693,10 @@ void StfSenderOutput::DataHandlerThread(const std::string pTfBuilderId)
 
   std::uint64_t lNumSentStfs = 0;
 
-  CoalescedHdrDataSerializer lStfSerializer(*lOutputChan);
+  CoalescedHdrDataSerializer lStfSerializer(*lOutputChan, mHdrBufferPool, mHeaderBlocks);
+  lStfSerializer.setChunkSize(mChunkSize);
+  lStfSerializer.setCompressor(mCompressor);
+  lStfSerializer.setChecksums(mChecksums);
   std::optional<std::unique_ptr<SubTimeFrame>> lStfOpt;
 
   while ((lStfOpt = lInputStfQueue->pop()) != std::nullopt) {
@@ -378,6 +708,8 @@ void StfSenderOutput::DataHandlerThread(const std::string pTfBuilderId)
     DDDLOG_GRL(5000, "Sending an STF to TfBuilder. stf_id={} tfb_id={} stf_size={} total_sent_stf={}",
       lStf->header().mId, pTfBuilderId, lStfSize, lNumSentStfs);
 
+    const auto lSendStart = std::chrono::steady_clock::now();
+    lStf->trace(SubTimeFrame::Header::Trace::eStfSenderSent);
     try {
       lStfSerializer.serialize(std::move(lStf));
     } catch (std::exception &e) {
@@ -389,27 +721,29 @@ void StfSenderOutput::DataHandlerThread(const std::string pTfBuilderId)
       break;
     }
 
+    DDMON_HIST("stfsender", "stf_output.send_us", std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - lSendStart).count());
+
     // update buffer status
     lNumSentStfs += 1;
 
     {
-      std::scoped_lock lLock(mScheduledStfMapLock);
-      mCounters.mBuffered.mSize -= lStfSize;
-      mCounters.mBuffered.mCnt -= 1;
-      mCounters.mInSending.mSize -= lStfSize;
-      mCounters.mInSending.mCnt -= 1;
-      mCounters.mTotalSent.mSize += lStfSize;
-      mCounters.mTotalSent.mCnt += 1;
-
-      if (mCounters.mInSending.mCnt > 100) {
+      const auto lBufferedSize = mBuffered.mSize.fetch_sub(lStfSize) - lStfSize;
+      const auto lBufferedCnt = mBuffered.mCnt.fetch_sub(1) - 1;
+      const auto lInSendingSize = mInSending.mSize.fetch_sub(lStfSize) - lStfSize;
+      const auto lInSendingCnt = mInSending.mCnt.fetch_sub(1) - 1;
+      const auto lTotalSentSize = mTotalSent.mSize.fetch_add(lStfSize) + lStfSize;
+      const auto lTotalSentCnt = mTotalSent.mCnt.fetch_add(1) + 1;
+
+      if (lInSendingCnt > 100) {
         DDDLOG_RL(2000, "DataHandlerThread: Number of buffered STFs. tfb_id={} num_stfs={} num_stf_total={} size_stf_total={}",
-          pTfBuilderId, lInputStfQueue->size(), mCounters.mInSending.mCnt, mCounters.mInSending.mSize);
+          pTfBuilderId, lInputStfQueue->size(), lInSendingCnt, lInSendingSize);
       }
 
-      DDMON("stfsender", "stf_output.sent_count", mCounters.mTotalSent.mCnt);
-      DDMON("stfsender", "stf_output.sent_size", mCounters.mTotalSent.mSize);
-      DDMON("stfsender", "buffered.stf_cnt", mCounters.mBuffered.mCnt);
-      DDMON("stfsender", "buffered.stf_size", mCounters.mBuffered.mSize);
+      DDMON_STATIC("stfsender", "stf_output.sent_count", lTotalSentCnt);
+      DDMON_STATIC("stfsender", "stf_output.sent_size", lTotalSentSize);
+      DDMON_STATIC("stfsender", "buffered.stf_cnt", lBufferedCnt);
+      DDMON_STATIC("stfsender", "buffered.stf_size", lBufferedSize);
     }
   }
 
@@ -422,29 +756,53 @@ void StfSenderOutput::StfDropThread()
   DDDLOG("Starting DataDropThread thread.");
   std::uint64_t lNumDroppedStfs = 0;
 
+  std::vector<std::unique_ptr<SubTimeFrame>> lStfs;
+  std::vector<FairMQMessagePtr> lMsgs;
+
   while (true) {
-    std::unique_ptr<SubTimeFrame> lStf;
-    if (!mDropQueue.pop(lStf)) {
+    lStfs.clear();
+    if (mDropQueue.pop_all(std::back_inserter(lStfs)) == 0) {
       break;
     }
 
-    const auto lStfSize = lStf->getDataSize();
+    const auto lStart = std::chrono::steady_clock::now();
+
+    // gather messages of all dropped STFs
+    std::uint64_t lDroppedSize = 0;
+    for (auto &lStf : lStfs) {
+      const auto lStfSize = lStf->getDataSize();
 
-    DDDLOG_GRL(5000, "Dropping an STF. stf_id={} stf_size={} total_dropped_stf={}", lStf->header().mId,
-      lStfSize, lNumDroppedStfs);
+      DDDLOG_GRL(5000, "Dropping an STF. stf_id={} stf_size={} total_dropped_stf={}", lStf->header().mId,
+        lStfSize, lNumDroppedStfs);
+
+      lStf->extractMessages(lMsgs);
+      lStf.reset();
+      lDroppedSize += lStfSize;
+      lNumDroppedStfs += 1;
+    }
+
+    // release in address order: the region owner receives adjacent blocks in the same release batch,
+    // and can merge them before reclaiming
+    std::sort(lMsgs.begin(), lMsgs.end(), [](const FairMQMessagePtr &a, const FairMQMessagePtr &b) {
+      return std::less<void*>()(a ? a->GetData() : nullptr, b ? b->GetData() : nullptr);
+    });
+    const auto lNumMsgs = lMsgs.size();
+    lMsgs.clear();
 
-    // delete the data
-    lStf.reset();
     // update buffer status
-    lNumDroppedStfs += 1;
     {
-      std::scoped_lock lLock(mScheduledStfMapLock);
-      mCounters.mBuffered.mSize -= lStfSize;
-      mCounters.mBuffered.mCnt -= 1;
+      const auto lBufferedSize = mBuffered.mSize.fetch_sub(lDroppedSize) - lDroppedSize;
+      const auto lBufferedCnt = mBuffered.mCnt.fetch_sub(lStfs.size()) - lStfs.size();
 
-      DDMON("stfsender", "buffered.stf_size", mCounters.mBuffered.mSize);
-      DDMON("stfsender", "buffered.stf_cnt", mCounters.mBuffered.mCnt);
+      DDMON_STATIC("stfsender", "buffered.stf_size", lBufferedSize);
+      DDMON_STATIC("stfsender", "buffered.stf_cnt", lBufferedCnt);
     }
+
+    DDMON_HIST("stfsender", "stf_drop.release_us", std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - lStart).count());
+    DDDLOG_RL(1000, "StfDropThread: released dropped STFs. num_stfs={} num_msgs={} size={} duration_ms={:.3}",
+      lStfs.size(), lNumMsgs, lDroppedSize,
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lStart).count());
   }
 
   DDDLOG("Exiting DataDropThread thread");
@@ -21,12 +21,19 @@
 
 #include <vector>
 #include <map>
+#include <tuple>
+#include <array>
+#include <atomic>
 #include <thread>
+#include <mutex>
+#include <shared_mutex>
 
 namespace o2::DataDistribution
 {
 
 class StfSenderDevice;
+class CoalescedHdrBufferPool;
+class StfPayloadCompressor;
 
 class StfSenderOutput
 {
@@ -65,8 +72,9 @@ public:
   bool running() const;
 
   void StfSchedulerThread();
+  void StfAnnounceThread();
   void StfDropThread();
-  void DataHandlerThread(const std::string pTfBuilderId);
+  void DataHandlerThread(const std::string pTfBuilderId, const std::size_t pChanIdx);
 
   /// RPC requests
   enum ConnectStatus { eOK, eEXISTS, eCONNERR };
@@ -75,15 +83,25 @@ public:
 
   void sendStfToTfBuilder(const std::uint64_t pStfId, const std::string &pTfBuilderId, StfDataResponse &pRes);
 
-  StdSenderOutputCounters getCounters() {
-    std::scoped_lock lLock(mScheduledStfMapLock);
-    return mCounters;
+  StdSenderOutputCounters getCounters() const {
+    StdSenderOutputCounters lRet;
+    lRet.mBuffered.mSize = mBuffered.mSize;
+    lRet.mBuffered.mCnt = std::uint32_t(mBuffered.mCnt);
+    lRet.mInSending.mSize = mInSending.mSize;
+    lRet.mInSending.mCnt = std::uint32_t(mInSending.mCnt);
+    lRet.mTotalSent.mSize = mTotalSent.mSize;
+    lRet.mTotalSent.mCnt = mTotalSent.mCnt;
+    return lRet;
   }
 
   StdSenderOutputCounters resetCounters() {
-    std::scoped_lock lLock(mScheduledStfMapLock);
-    StdSenderOutputCounters lRet = mCounters;
-    mCounters = StdSenderOutputCounters();
+    StdSenderOutputCounters lRet;
+    lRet.mBuffered.mSize = mBuffered.mSize.exchange(0);
+    lRet.mBuffered.mCnt = std::uint32_t(mBuffered.mCnt.exchange(0));
+    lRet.mInSending.mSize = mInSending.mSize.exchange(0);
+    lRet.mInSending.mCnt = std::uint32_t(mInSending.mCnt.exchange(0));
+    lRet.mTotalSent.mSize = mTotalSent.mSize.exchange(0);
+    lRet.mTotalSent.mCnt = mTotalSent.mCnt.exchange(0);
     return lRet;
   }
 
@@ -95,22 +113,63 @@ public:
   /// Discovery configuration
   std::shared_ptr<ConsulStfSender> mDiscoveryConfig;
   std::shared_ptr<FairMQTransportFactory>  mZMQTransportFactory;
+  /// RDMA capable transport (libfabric), created on the first 'verbs://' TfBuilder endpoint
+  std::once_flag mOfiTransportOnce;
+  std::shared_ptr<FairMQTransportFactory>  mOfiTransportFactory;
+  std::shared_ptr<FairMQTransportFactory> transportForEndpoint(const std::string &pEndpoint);
+  std::shared_ptr<CoalescedHdrBufferPool> mHdrBufferPool;
+  bool mHeaderBlocks = false;
+  bool mChecksums = false;
+  std::uint64_t mChunkSize = 0;
+  std::shared_ptr<StfPayloadCompressor> mCompressor;
 
   /// Scheduler threads
   std::thread mSchedulerThread;
-  std::mutex mScheduledStfMapLock;
-    std::map<std::uint64_t, std::unique_ptr<SubTimeFrame>> mScheduledStfMap;
-    StdSenderOutputCounters mCounters;
+
+  /// STF announces <stf id, size>. Announces accumulated while waiting for the scheduler are sent in one batch
+  ConcurrentFifo<std::tuple<std::uint64_t, std::uint64_t>> mAnnounceQueue;
+  std::thread mAnnounceThread;
+
+  /// Admission control: STFs are dropped, or sub-sampled by STF id, before announcing them to the scheduler
+  enum AdmissionState { eAdmitAll = 0, eAdmitSubsample = 1, eAdmitNone = 2 };
+  double mLowWatermark = 0.0;  // sub-sample above (fraction of the buffer), 0: disabled
+  double mHighWatermark = 0.0; // drop above, until the buffer is below the low watermark
+  std::uint64_t mSubsampleFactor = 2;
+  AdmissionState mAdmissionState = eAdmitAll;
+  std::atomic_bool mSchedulerRejected = false; // the last announce was rejected: sub-sample
+  AdmissionState admissionState(const std::uint64_t pBufferedSize);
+
+  /// Scheduled STFs, sharded by STF id. Scheduling, sending and dropping of different STFs do not contend.
+  static constexpr std::size_t cNumStfMapShards = 16;
+  struct alignas(128) ScheduledStfShard {
+    std::mutex mLock;
+      std::map<std::uint64_t, std::unique_ptr<SubTimeFrame>> mStfs;
+  };
+  std::array<ScheduledStfShard, cNumStfMapShards> mScheduledStfMap;
+  ScheduledStfShard& scheduledStfShard(const std::uint64_t pStfId) {
+    return mScheduledStfMap[pStfId % cNumStfMapShards];
+  }
+
+  /// Buffer counters
+  struct alignas(128) OutputCounter {
+    std::atomic_uint64_t mSize = 0;
+    std::atomic_uint64_t mCnt = 0;
+  };
+  OutputCounter mBuffered;
+  OutputCounter mInSending;
+  OutputCounter mTotalSent;
 
   /// Threads for output channels (to EPNs)
+  /// TfBuilders can advertise several endpoints: STFs are striped across the channels, one thread each
   struct OutputChannelObjects {
     std::string mTfBuilderEndpoint;
-    std::unique_ptr<FairMQChannel> mChannel;
+    std::vector<std::unique_ptr<FairMQChannel>> mChannels;
     std::unique_ptr<ConcurrentFifo<std::unique_ptr<SubTimeFrame>>> mStfQueue;
-    std::thread mThread;
+    std::vector<std::thread> mThreads;
   };
 
-  mutable std::mutex mOutputMapLock;
+  /// shared: STF requests, exclusive: connecting and disconnecting TfBuilders
+  mutable std::shared_mutex mOutputMapLock;
     std::map<std::string, OutputChannelObjects> mOutputMap;
 
   // Buffer maintenance
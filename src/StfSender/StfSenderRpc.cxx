@@ -107,6 +107,14 @@ void StfSenderRpcImpl::stop()
   return Status::OK;
 }
 
+// rpc HealthProbe(google.protobuf.Empty) returns (StatusResponse) { }
+::grpc::Status StfSenderRpcImpl::HealthProbe(::grpc::ServerContext* /*context*/,
+  const ::google::protobuf::Empty* /*request*/, StatusResponse* response)
+{
+  response->set_status(0);
+  return Status::OK;
+}
+
 // rpc TerminatePartition(PartitionInfo) returns (PartitionResponse) { }
 ::grpc::Status StfSenderRpcImpl::TerminatePartition(::grpc::ServerContext* /*context*/,
   const PartitionInfo* /*request*/, PartitionResponse* response)
@@ -62,6 +62,11 @@ class StfSenderRpcImpl final : public StfSenderRpc::Service
                                 const StfDataRequestMessage* request,
                                 StfDataResponse* response) override;
 
+  // rpc HealthProbe(google.protobuf.Empty) returns (StatusResponse) { }
+  ::grpc::Status HealthProbe(::grpc::ServerContext* context,
+                                const ::google::protobuf::Empty* request,
+                                StatusResponse* response) override;
+
   // rpc TerminatePartition(PartitionInfo) returns (PartitionResponse) { }
   ::grpc::Status TerminatePartition(::grpc::ServerContext* context,
                                 const PartitionInfo* request,
@@ -20,9 +20,13 @@
 #include <SubTimeFrameDPL.h>
 #include <Framework/SourceInfoHeader.h>
 
+#include <boost/algorithm/string.hpp>
+#include <boost/algorithm/string/join.hpp>
+
 #include <chrono>
 #include <thread>
 #include <future>
+#include <algorithm>
 
 namespace o2::DataDistribution
 {
@@ -44,6 +48,12 @@ TfBuilderDevice::~TfBuilderDevice()
 void TfBuilderDevice::Init()
 {
   mMemI = std::make_unique<SyncMemoryResources>(this->AddTransport(fair::mq::Transport::SHM));
+  mMemI->mAllocStrategy = GetConfig()->GetValue<RegionAllocStrategy>(MemoryResources::OptionKeyShmAllocator);
+  mMemI->mHeaderSlotPool = GetConfig()->GetValue<bool>(MemoryResources::OptionKeyShmHeaderSlotPool);
+  mMemI->mHeaderSlotPoolPercent = GetConfig()->GetValue<unsigned>(MemoryResources::OptionKeyShmHeaderSlotPoolPercent);
+  mMemI->mNumaNode = GetConfig()->GetValue<int>(MemoryResources::OptionKeyShmNumaNode);
+  mMemI->mNumaRegions = GetConfig()->GetValue<bool>(MemoryResources::OptionKeyShmNumaRegions);
+  mMemI->mPrefaultThreads = GetConfig()->GetValue<unsigned>(MemoryResources::OptionKeyShmPrefaultThreads);
 }
 
 void TfBuilderDevice::Reset()
@@ -60,6 +70,8 @@ void TfBuilderDevice::InitTask()
   mStandalone = GetConfig()->GetValue<bool>(OptionKeyStandalone);
   mTfBufferSize = GetConfig()->GetValue<std::uint64_t>(OptionKeyTfMemorySize);
   mTfBufferSize <<= 20; /* input parameter is in MiB */
+  mStfRequestWindow = GetConfig()->GetValue<std::uint64_t>(OptionKeyStfRequestWindow);
+  mStfRequestWindow <<= 20; /* input parameter is in MiB */
 
   // start monitoring
   DataDistMonitor::start_datadist(ProcessType::TfBuilder, GetConfig()->GetValue<std::string>("monitoring-backend"));
@@ -67,10 +79,21 @@ void TfBuilderDevice::InitTask()
   DataDistMonitor::set_log(GetConfig()->GetValue<bool>("monitoring-log"));
 
   // Using DPL?
-  if (mDplChannelName != "") {
+  mDplChannelNames.clear();
+  boost::split(mDplChannelNames, mDplChannelName, boost::is_any_of(","), boost::token_compress_on);
+  mDplChannelNames.erase(std::remove(mDplChannelNames.begin(), mDplChannelNames.end(), ""), mDplChannelNames.end());
+
+  const auto lDplPolicy = GetConfig()->GetValue<std::string>(OptionKeyDplChannelPolicy);
+  if (lDplPolicy != "round-robin" && lDplPolicy != "least-outstanding") {
+    EDDLOG("Unknown DPL channel policy. Using round-robin. {}={}", OptionKeyDplChannelPolicy, lDplPolicy);
+  }
+  mDplLeastOutstanding = (lDplPolicy == "least-outstanding");
+
+  if (!mDplChannelNames.empty()) {
     mDplEnabled = true;
     mStandalone = false;
-    IDDLOG("Using DPL channel. channel_name={}", mDplChannelName);
+    IDDLOG("Using DPL channels. channel_names={} policy={}", boost::algorithm::join(mDplChannelNames, ","),
+      mDplLeastOutstanding ? "least-outstanding" : "round-robin");
   } else {
     mDplEnabled = false;
     mStandalone = true;
@@ -109,6 +132,9 @@ void TfBuilderDevice::InitTask()
   lStatus.mutable_info()->set_process_state(BasicInfo::NOT_RUNNING);
   lStatus.mutable_info()->set_process_id(Config::getIdOption(TfBuilder, *GetConfig()));
   lStatus.mutable_info()->set_ip_address(Config::getNetworkIfAddressOption(*GetConfig()));
+  for (const auto &[lLabel, lValue] : Config::getTopologyOption(*GetConfig())) {
+    (*lStatus.mutable_info()->mutable_topology())[lLabel] = lValue;
+  }
 
   // wait for "partition-id"
   while (!Config::getPartitionOption(*GetConfig())) {
@@ -176,23 +202,38 @@ void TfBuilderDevice::PreRun()
 
 bool TfBuilderDevice::start()
 {
+  // react to the scheduler instance registration instead of polling Consul
+  mDiscoveryConfig->startWatch("TfSchedulerInstance");
+
   // start all gRPC clients
-  while (!mRpc->start(mTfBufferSize)) {
+  std::uint64_t lDiscoveryIndex = 0;
+  while (!mRpc->start(mStfRequestWindow)) {
     // try to reach the scheduler unless we should exit
     if (IsRunningState() && NewStatePending()) {
       mShouldExit = true;
       return false;
     }
 
-    std::this_thread::sleep_for(1s);
+    mDiscoveryConfig->waitForUpdate(lDiscoveryIndex, 1s);
   }
 
   // we reached the scheduler instance, initialize everything else
   mRunning = true;
 
   if (!mStandalone && dplEnabled()) {
-    auto& lOutputChan = GetChannel(getDplChannelName(), 0);
-    mTfDplAdapter = std::make_unique<StfToDplAdapter>(lOutputChan);
+    mDplOutputs.clear();
+    mDplNextOutput = 0;
+    for (std::size_t lIdx = 0; lIdx < mDplChannelNames.size(); lIdx++) {
+      auto &lOutput = *mDplOutputs.emplace_back(std::make_unique<DplOutput>());
+      lOutput.mChannelName = mDplChannelNames[lIdx];
+      lOutput.mTfDplAdapter = std::make_unique<StfToDplAdapter>(GetChannel(lOutput.mChannelName, 0));
+      lOutput.mTfQueue.start();
+
+      char lThreadName[128];
+      std::snprintf(lThreadName, 127, "tfb_dpl_%u", (unsigned)lIdx);
+      lThreadName[15] = '\0';
+      lOutput.mThread = create_thread_member(lThreadName, &TfBuilderDevice::DplOutputThread, this, lIdx);
+    }
   }
 
   // start TF forwarding thread
@@ -216,8 +257,8 @@ void TfBuilderDevice::stop()
     mRpc->stopAcceptingTfs();
   }
 
-  if (mTfDplAdapter) {
-    mTfDplAdapter->stop();
+  for (auto &lOutput : mDplOutputs) {
+    lOutput->mTfDplAdapter->stop();
   }
 
   mRunning = false;
@@ -237,6 +278,14 @@ void TfBuilderDevice::stop()
   if (mTfFwdThread.joinable()) {
     mTfFwdThread.join();
   }
+  // the forward thread closes the DPL output queues
+  for (auto &lOutput : mDplOutputs) {
+    lOutput->mTfQueue.stop();
+    if (lOutput->mThread.joinable()) {
+      lOutput->mThread.join();
+    }
+  }
+  mDplOutputs.clear();
   DDDLOG("TfBuilderDevice::stop(): Forward thread stopped.");
 
   // stop the RPCs
@@ -286,6 +335,12 @@ bool TfBuilderDevice::ConditionalRun()
   }
   // nothing to do here sleep for awhile
   std::this_thread::sleep_for(250ms);
+
+  // publish pipeline stage statistics every 1s
+  static unsigned sPipelineStatsCnt = 0;
+  if (++sPipelineStatsCnt % 4 == 0) {
+    DataDistMonitor::publish_pipeline("tfbuilder", *this);
+  }
   return true;
 }
 
@@ -306,66 +361,113 @@ void TfBuilderDevice::TfForwardThread()
     {
       const auto lStfDur = std::chrono::duration<double>(hres_clock::now() - lRateStartTime);
       lRateStartTime = hres_clock::now();
-      DDMON("tfbuilder", "tf_output.id", lTfId);
-      DDMON("tfbuilder", "tf_output.size", lTf->getDataSize());
-      DDMON("tfbuilder", "tf_output.rate", 1.0 / lStfDur.count());
+      DDMON_STATIC("tfbuilder", "tf_output.id", lTfId);
+      DDMON_STATIC("tfbuilder", "tf_output.size", lTf->getDataSize());
+      DDMON_STATIC("tfbuilder", "tf_output.unused_capacity", lTf->getUnusedCapacity());
+      DDMON_STATIC("tfbuilder", "tf_output.rate", 1.0 / lStfDur.count());
     }
 
-    if (!mStandalone) {
-      try {
-        lTfOutCnt++;
-        IDDLOG_RL(5000, "Forwarding a new TF to DPL. tf_id={} stf_size={:d} unique_equipments={:d} total={:d}",
-          lTfId, lTf->getDataSize(), lTf->getEquipmentIdentifiers().size(), lTfOutCnt);
-
-        if (dplEnabled()) {
-          // adapt headers to include DPL processing header on the stack
-          assert(mTfBuilder);
-          TfBuilderI().adaptHeaders(lTf.get());
-
-          // Send to DPL
-          assert (mTfDplAdapter);
-          mTfDplAdapter->sendToDpl(std::move(lTf));
+    if (!mStandalone && !mDplOutputs.empty()) {
+      lTfOutCnt++;
+      IDDLOG_RL(5000, "Forwarding a new TF to DPL. tf_id={} stf_size={:d} unique_equipments={:d} total={:d}",
+        lTfId, lTf->getDataSize(), lTf->getEquipmentIdentifiers().size(), lTfOutCnt);
+
+      // select the output channel
+      std::size_t lOutIdx = mDplNextOutput;
+      if (mDplLeastOutstanding) {
+        for (std::size_t lIdx = 0; lIdx < mDplOutputs.size(); lIdx++) {
+          if (mDplOutputs[lIdx]->mTfsOutstanding < mDplOutputs[lOutIdx]->mTfsOutstanding) {
+            lOutIdx = lIdx;
+          }
         }
-      } catch (std::exception& e) {
-        if (IsRunningState()) {
-          EDDLOG("StfOutputThread: exception on send. exception_what={:s}", e.what());
-        } else {
-          IDDLOG("StfOutputThread: shutting down. exception_what={:s}", e.what());
-        }
-        break;
       }
+      mDplNextOutput = (lOutIdx + 1) % mDplOutputs.size();
+
+      // the TF is recorded as forwarded by the output thread, when sent
+      auto &lOutput = *mDplOutputs[lOutIdx];
+      lOutput.mTfsOutstanding++;
+      lOutput.mTfQueue.push(std::move(lTf));
+      continue;
     }
 
     // decrement the size used by the TF
-    // TODO: move this close to the output channel send to have more precise accounting of free memory
-    //       or, get the memory status directly from shm region
     mRpc->recordTfForwarded(lTfId);
   }
 
-  // leaving the output thread, send end of the stream info
-  if (!mStandalone && dplEnabled()) {
-    o2::framework::SourceInfoHeader lDplExitHdr;
-    lDplExitHdr.state = o2::framework::InputChannelState::Completed;
-    auto lDoneStack = o2::header::Stack(
-      o2::header::DataHeader(o2::header::gDataDescriptionInfo, o2::header::gDataOriginAny, 0, 0),
-      o2::framework::DataProcessingHeader(),
-      lDplExitHdr
-    );
-
-    // Send a multipart
-    auto& lOutputChan = GetChannel(getDplChannelName(), 0);
-    FairMQParts lCompletedMsg;
-    auto lNoFree = [](void*, void*) { /* stack */ };
-    lCompletedMsg.AddPart(lOutputChan.NewMessage(lDoneStack.data(), lDoneStack.size(), lNoFree));
-    lCompletedMsg.AddPart(lOutputChan.NewMessage());
-    lOutputChan.Send(lCompletedMsg);
-
-    IDDLOG("Source Completed message sent to DPL.");
-    // NOTE: no guarantees this will be sent out
-    std::this_thread::sleep_for(2s);
+  // leaving the forwarding thread: the output threads send end of the stream info
+  for (auto &lOutput : mDplOutputs) {
+    lOutput->mTfQueue.stop();
   }
 
   DDDLOG("Exiting TF forwarding thread.");
 }
 
+void TfBuilderDevice::DplOutputThread(const std::size_t pIdx)
+{
+  auto &lOutput = *mDplOutputs[pIdx];
+  DDDLOG("Starting DPL output thread. channel={}", lOutput.mChannelName);
+
+  std::unique_ptr<SubTimeFrame> lTf;
+
+  while (lOutput.mTfQueue.pop(lTf)) {
+    const auto lTfId = lTf->id();
+
+    try {
+      // adapt headers to include DPL processing header on the stack
+      assert(mTfBuilder);
+      if (!TfBuilderI().adaptHeaders(lTf.get())) {
+        EDDLOG_RL(1000, "DplOutputThread: dropping TF, header or data allocation failed. channel={} tf_id={}",
+          lOutput.mChannelName, lTfId);
+        lTf.reset();
+        mRpc->recordTfForwarded(lTfId);
+        lOutput.mTfsOutstanding--;
+        continue;
+      }
+
+      // Send to DPL
+      lOutput.mTfDplAdapter->sendToDpl(std::move(lTf));
+    } catch (std::exception& e) {
+      if (IsRunningState()) {
+        EDDLOG("StfOutputThread: exception on send. channel={} exception_what={:s}", lOutput.mChannelName, e.what());
+      } else {
+        IDDLOG("StfOutputThread: shutting down. channel={} exception_what={:s}", lOutput.mChannelName, e.what());
+      }
+      lOutput.mTfsOutstanding--;
+      break;
+    }
+
+    // decrement the size used by the TF
+    mRpc->recordTfForwarded(lTfId);
+    lOutput.mTfsOutstanding--;
+    DDMON("tfbuilder", "tf_output.outstanding." + lOutput.mChannelName, lOutput.mTfsOutstanding);
+  }
+
+  // leaving the output thread, send end of the stream info
+  sendDplCompleted(GetChannel(lOutput.mChannelName, 0));
+
+  DDDLOG("Exiting DPL output thread. channel={}", lOutput.mChannelName);
+}
+
+void TfBuilderDevice::sendDplCompleted(FairMQChannel &pOutputChan)
+{
+  o2::framework::SourceInfoHeader lDplExitHdr;
+  lDplExitHdr.state = o2::framework::InputChannelState::Completed;
+  auto lDoneStack = o2::header::Stack(
+    o2::header::DataHeader(o2::header::gDataDescriptionInfo, o2::header::gDataOriginAny, 0, 0),
+    o2::framework::DataProcessingHeader(),
+    lDplExitHdr
+  );
+
+  // Send a multipart
+  FairMQParts lCompletedMsg;
+  auto lNoFree = [](void*, void*) { /* stack */ };
+  lCompletedMsg.AddPart(pOutputChan.NewMessage(lDoneStack.data(), lDoneStack.size(), lNoFree));
+  lCompletedMsg.AddPart(pOutputChan.NewMessage());
+  pOutputChan.Send(lCompletedMsg);
+
+  IDDLOG("Source Completed message sent to DPL.");
+  // NOTE: no guarantees this will be sent out
+  std::this_thread::sleep_for(2s);
+}
+
 } /* namespace o2::DataDistribution */
@@ -57,8 +57,18 @@ class TfBuilderDevice : public DataDistDevice,
  public:
   static constexpr const char* OptionKeyStandalone = "stand-alone";
   static constexpr const char* OptionKeyTfMemorySize = "tf-memory-size";
+  static constexpr const char* OptionKeyStfSenderChannels = "stf-sender-channels";
+  static constexpr const char* OptionKeyStfFullValidation = "stf-full-validation";
+  static constexpr const char* OptionKeyStfVerifyChecksums = "stf-verify-checksums";
+  static constexpr const char* OptionKeyStfTransport = "stf-transport";
+  static constexpr const char* OptionKeyStfDeserializerThreads = "stf-deserializer-threads";
+  static constexpr const char* OptionKeyTfAssemblyTimeout = "tf-assembly-timeout";
+  static constexpr const char* OptionKeyForwardPartialTfs = "forward-partial-tfs";
+  static constexpr const char* OptionKeyStfRequestWindow = "stf-request-window";
+  static constexpr const char* OptionKeyInputBusyPollUs = "input-busy-poll-us";
 
   static constexpr const char* OptionKeyDplChannelName = "dpl-channel-name";
+  static constexpr const char* OptionKeyDplChannelPolicy = "dpl-channel-policy";
 
   /// Default constructor
   TfBuilderDevice();
@@ -114,7 +124,8 @@ class TfBuilderDevice : public DataDistDevice,
   }
 
   void TfForwardThread();
-
+  void DplOutputThread(const std::size_t pIdx);
+  void sendDplCompleted(FairMQChannel &pOutputChan);
 
   const std::string& getDplChannelName() const { return mDplChannelName; }
 
@@ -127,6 +138,7 @@ class TfBuilderDevice : public DataDistDevice,
   std::string mDplChannelName;
   bool mStandalone;
   std::uint64_t mTfBufferSize;
+  std::uint64_t mStfRequestWindow;
   std::string mPartitionId;
   bool mDplEnabled = false;
 
@@ -140,8 +152,18 @@ class TfBuilderDevice : public DataDistDevice,
   std::unique_ptr<TfBuilderInput> mFlpInputHandler;
   /// prepare TF for output (standard or DPL)
   std::unique_ptr<TimeFrameBuilder> mTfBuilder;
-  /// Serializer for DPL channel
-  std::unique_ptr<StfToDplAdapter> mTfDplAdapter;
+  /// DPL output channels (comma separated in OptionKeyDplChannelName), each with a forwarding thread
+  struct DplOutput {
+    std::string mChannelName;
+    std::unique_ptr<StfToDplAdapter> mTfDplAdapter;
+    ConcurrentFifo<std::unique_ptr<SubTimeFrame>> mTfQueue;
+    std::atomic_uint64_t mTfsOutstanding = 0;
+    std::thread mThread;
+  };
+  std::vector<std::string> mDplChannelNames;
+  std::vector<std::unique_ptr<DplOutput>> mDplOutputs;
+  bool mDplLeastOutstanding = false; // default: round-robin
+  std::size_t mDplNextOutput = 0;
 
   /// File sink
   SubTimeFrameFileSink mFileSink;
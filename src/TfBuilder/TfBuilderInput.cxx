@@ -20,10 +20,13 @@
 #include <SubTimeFrameDataModel.h>
 #include <SubTimeFrameVisitors.h>
 
+#include <atomic>
 #include <condition_variable>
 #include <mutex>
 #include <thread>
 #include <chrono>
+#include <algorithm>
+#include <limits>
 
 namespace o2
 {
@@ -36,7 +39,22 @@ bool TfBuilderInput::start(std::shared_ptr<ConsulTfBuilder> pConfig)
 {
   // make max number of listening channels for the partition
   mDevice.GetConfig()->SetProperty<int>("io-threads", (int) std::min(std::thread::hardware_concurrency(), 32u));
-  auto lTransportFactory = FairMQTransportFactory::CreateTransportFactory("zeromq", "", mDevice.GetConfig());
+
+  // STF data transport. The ofi transport (libfabric) uses RDMA on capable fabrics (verbs endpoints)
+  const auto lTransport = mDevice.GetConfig()->GetValue<std::string>(TfBuilderDevice::OptionKeyStfTransport);
+  if (lTransport != "zeromq" && lTransport != "ofi") {
+    EDDLOG("Unknown STF transport. {}={}", TfBuilderDevice::OptionKeyStfTransport, lTransport);
+    return false;
+  }
+  const std::string lScheme = (lTransport == "ofi") ? "verbs://" : "tcp://";
+
+  std::shared_ptr<FairMQTransportFactory> lTransportFactory;
+  try {
+    lTransportFactory = FairMQTransportFactory::CreateTransportFactory(lTransport, "", mDevice.GetConfig());
+  } catch (std::exception &e) {
+    EDDLOG("Cannot create the STF transport. transport={} what={}", lTransport, e.what());
+    return false;
+  }
 
   auto &lStatus = pConfig->status();
 
@@ -53,60 +71,112 @@ bool TfBuilderInput::start(std::shared_ptr<ConsulTfBuilder> pConfig)
 
   mNumStfSenders = lNumStfSenders;
 
-  IDDLOG("Creating input channels. num_channels={} partition={}",
-    mNumStfSenders, lStatus.partition().partition_id());
+  // STFs of each StfSender are striped across multiple channels
+  const std::uint32_t lNumChansPerSender = std::clamp(
+    mDevice.GetConfig()->GetValue<std::uint32_t>(TfBuilderDevice::OptionKeyStfSenderChannels), 1u, 16u);
+
+  IDDLOG("Creating input channels. num_channels={} channels_per_stf_sender={} transport={} partition={}",
+    mNumStfSenders, lNumChansPerSender, lTransport, lStatus.partition().partition_id());
 
   const auto &lAaddress = lStatus.info().ip_address();
 
   auto &lSocketMap = *(lStatus.mutable_sockets()->mutable_map());
 
-  for (std::uint32_t lSocketIdx = 0; lSocketIdx < mNumStfSenders; lSocketIdx++) {
+  mStfSenderChannels.resize(mNumStfSenders);
+  std::vector<std::string> lSocketEndpoints(mNumStfSenders);
 
-    std::string lAddress = "tcp://" + lAaddress + ":" + std::to_string(10000 + lSocketIdx);
+  // bind the channels of one StfSender. All endpoints are advertised as a comma separated list
+  auto lBindChannels = [&](const std::uint32_t lSocketIdx) -> bool {
+    std::string lEndpoints;
 
-    auto lNewChannel = std::make_unique<FairMQChannel>(
-      "stf_sender_chan_" + std::to_string(lSocketIdx) ,  // name
-      "pull",               // type
-      "bind",               // method
-      lAddress,             // address (TODO: this should only ever be ib interface)
-      lTransportFactory
-    );
+    for (std::uint32_t lChanIdx = 0; lChanIdx < lNumChansPerSender; lChanIdx++) {
+      const auto lPort = 10000 + lSocketIdx * lNumChansPerSender + lChanIdx;
+      std::string lAddress = lScheme + lAaddress + ":" + std::to_string(lPort);
+
+      std::string lChanName = "stf_sender_chan_" + std::to_string(lSocketIdx);
+      if (lNumChansPerSender > 1) {
+        lChanName += "_" + std::to_string(lChanIdx);
+      }
 
-    lNewChannel->Init();
+      auto lNewChannel = std::make_unique<FairMQChannel>(
+        lChanName,            // name
+        "pull",               // type
+        "bind",               // method
+        lAddress,             // address (TODO: this should only ever be ib interface)
+        lTransportFactory
+      );
 
-    lNewChannel->UpdateRateLogging(1); // log each second
+      lNewChannel->Init();
 
-    lNewChannel->UpdateAutoBind(true); // make sure bind succeeds
+      lNewChannel->UpdateRateLogging(1); // log each second
 
-    if (!lNewChannel->BindEndpoint(lAddress)) {
-      EDDLOG("Cannot bind channel to a free port! Check permissions. bind_address={}", lAddress);
-      return false;
+      lNewChannel->UpdateAutoBind(true); // make sure bind succeeds
+
+      if (!lNewChannel->BindEndpoint(lAddress)) {
+        EDDLOG("Cannot bind channel to a free port! Check permissions. bind_address={}", lAddress);
+        return false;
+      }
+
+      if (!lNewChannel->Validate()) {
+        EDDLOG("Channel validation failed! Exiting!");
+        return false;
+      }
+
+      lEndpoints += (lEndpoints.empty() ? "" : ",") + lAddress;
+      mStfSenderChannels[lSocketIdx].push_back(std::move(lNewChannel));
     }
 
-    if (!lNewChannel->Validate()) {
-      EDDLOG("Channel validation failed! Exiting!");
-      return false;
+    lSocketEndpoints[lSocketIdx] = std::move(lEndpoints);
+    return true;
+  };
+
+  // bind in parallel: each thread binds every n-th StfSender
+  {
+    const auto lBindStart = std::chrono::steady_clock::now();
+    const std::uint32_t lNumBindThreads = std::clamp(std::thread::hardware_concurrency(), 1u, 16u);
+    std::atomic_bool lBindOk = true;
+    std::vector<std::thread> lBindThreads;
+
+    for (std::uint32_t lThreadIdx = 0; lThreadIdx < std::min(lNumBindThreads, mNumStfSenders); lThreadIdx++) {
+      lBindThreads.emplace_back([&, lThreadIdx]() {
+        for (std::uint32_t lSocketIdx = lThreadIdx; lBindOk && lSocketIdx < mNumStfSenders; lSocketIdx += lNumBindThreads) {
+          if (!lBindChannels(lSocketIdx)) {
+            lBindOk = false;
+          }
+        }
+      });
+    }
+    for (auto &lThread : lBindThreads) {
+      lThread.join();
     }
 
-    // save channel addresses to configuration
-    auto &lSocket = lSocketMap[lSocketIdx];
-    lSocket.set_idx(lSocketIdx);
-    lSocket.set_endpoint(lAddress);
+    if (!lBindOk) {
+      return false;
+    }
 
-    mStfSenderChannels.push_back(std::move(lNewChannel));
+    IDDLOG("New channels created. num_channels={} time_ms={}", mNumStfSenders * lNumChansPerSender,
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lBindStart).count());
   }
 
-  if (pConfig->write()) {
-    IDDLOG("New channels created. Discovery configuration written.");
-  } else {
-    IDDLOG("New channels created. Discovery configuration writing failed!");
-    return false;
+  // save channel addresses to configuration (written to the discovery once connected)
+  for (std::uint32_t lSocketIdx = 0; lSocketIdx < mNumStfSenders; lSocketIdx++) {
+    auto &lSocket = lSocketMap[lSocketIdx];
+    lSocket.set_idx(lSocketIdx);
+    lSocket.set_endpoint(lSocketEndpoints[lSocketIdx]);
   }
 
-
   // Connect all StfSenders
   TfBuilderConnectionResponse lConnResult;
   do {
+    // wait for the partition to become ready. Polling is used if the scheduler does not provide notifications
+    TfBuilderConnectionStatus lReadyStatus = ERROR_STF_SENDERS_NOT_READY;
+    const bool lNotified = mRpc->TfSchedRpcCli().PartitionReadyWait(60s, lReadyStatus);
+
+    if (lNotified && lReadyStatus == ERROR_PARTITION_TERMINATING) {
+      WDDLOG("Partition is terminating. Stopping.");
+      return false;
+    }
+
     IDDLOG("Requesting StfSender connections from the TfSchedulerInstance.");
 
     lConnResult.Clear();
@@ -117,7 +187,9 @@ bool TfBuilderInput::start(std::shared_ptr<ConsulTfBuilder> pConfig)
 
     if (lConnResult.status() == ERROR_STF_SENDERS_NOT_READY) {
       WDDLOG("StfSenders are not ready. Retrying...");
-      std::this_thread::sleep_for(1s);
+      if (!lNotified) {
+        std::this_thread::sleep_for(1s);
+      }
       continue;
     }
 
@@ -144,20 +216,44 @@ bool TfBuilderInput::start(std::shared_ptr<ConsulTfBuilder> pConfig)
     // save socket peers to configuration
     lSocketMap[lSocketIdx].set_peer_id(lStfSenderId);
   }
-  pConfig->write();
+
+  if (pConfig->write()) {
+    IDDLOG("StfSenders connected. Discovery configuration written.");
+  } else {
+    WDDLOG("StfSenders connected. Discovery configuration writing failed!");
+  }
 
 
   // Start all the threads
   mState = RUNNING;
 
   // Start the deserialize thread
-  mReceivedData.start();
-  mStfDeserThread = create_thread_member("tfb_deser", &TfBuilderInput::StfDeserializingThread, this);
+  const std::size_t lNumDeserThreads = std::clamp(
+    mDevice.GetConfig()->GetValue<std::uint32_t>(TfBuilderDevice::OptionKeyStfDeserializerThreads),
+    1u, std::max(mNumStfSenders, 1u));
+  IDDLOG("Starting STF deserializing threads. num_threads={}", lNumDeserThreads);
+
+  mReceivedData.clear();
+  for (std::size_t lIdx = 0; lIdx < lNumDeserThreads; lIdx++) {
+    mReceivedData.push_back(std::make_unique<ConcurrentQueue<ReceivedStfMeta>>());
+    mReceivedData.back()->start();
+  }
+  for (std::size_t lIdx = 0; lIdx < lNumDeserThreads; lIdx++) {
+    char lThreadName[128];
+    std::snprintf(lThreadName, 127, "tfb_deser_%u", (unsigned)lIdx);
+    lThreadName[15] = '\0';
+
+    mStfDeserThreads.push_back(
+      create_thread_member(lThreadName, &TfBuilderInput::StfDeserializingThread, this, lIdx)
+    );
+  }
 
   // Start the merger
   {
     std::unique_lock<std::mutex> lQueueLock(mStfMergerQueueLock);
     mStfMergeMap.clear();
+    mReadyTfs.clear();
+    mTimedOutTfs.clear();
     mStfCount = 0;
 
     // start the merger thread
@@ -168,14 +264,17 @@ bool TfBuilderInput::start(std::shared_ptr<ConsulTfBuilder> pConfig)
   assert(mInputThreads.size() == 0);
 
   for (auto &[lSocketIdx, lStfSenderId] : lConnResult.connection_map()) {
-    char lThreadName[128];
-    std::snprintf(lThreadName, 127, "tfb_in_%03u", (unsigned)lSocketIdx);
-    lThreadName[15] = '\0';
+    auto &lThreads = mInputThreads[lStfSenderId];
 
-    mInputThreads.try_emplace(
-      lStfSenderId,
-      create_thread_member(lThreadName, &TfBuilderInput::DataHandlerThread, this, lSocketIdx)
-    );
+    for (std::uint32_t lChanIdx = 0; lChanIdx < mStfSenderChannels[lSocketIdx].size(); lChanIdx++) {
+      char lThreadName[128];
+      std::snprintf(lThreadName, 127, "tfb_in_%03u_%u", (unsigned)lSocketIdx, (unsigned)lChanIdx);
+      lThreadName[15] = '\0';
+
+      lThreads.push_back(
+        create_thread_member(lThreadName, &TfBuilderInput::DataHandlerThread, this, lSocketIdx, lChanIdx)
+      );
+    }
   }
 
   // finally start accepting TimeFrames
@@ -206,31 +305,40 @@ void TfBuilderInput::stop(std::shared_ptr<ConsulTfBuilder> pConfig)
 
   // Wait for input threads to stop
   DDDLOG("TfBuilderInput::stop: Waiting for input threads to terminate.");
-  for (auto& lIdThread : mInputThreads) {
-    if (lIdThread.second.joinable())
-      lIdThread.second.join();
+  for (auto& lIdThreads : mInputThreads) {
+    for (auto &lThread : lIdThreads.second) {
+      if (lThread.joinable())
+        lThread.join();
+    }
   }
   mInputThreads.clear();
   DDDLOG("TfBuilderInput::stop: All input threads terminated.");
 
   // disconnect and close the sockets
-  for (auto &lFmqChannelPtr : mStfSenderChannels) {
-    if (!lFmqChannelPtr->IsValid()) {
-      WDDLOG("TfBuilderInput::stop: Socket not found for channel. socket_ep={}",
-        lFmqChannelPtr->GetAddress());
-      continue;
+  for (auto &lStfSenderChannels : mStfSenderChannels) {
+    for (auto &lFmqChannelPtr : lStfSenderChannels) {
+      if (!lFmqChannelPtr->IsValid()) {
+        WDDLOG("TfBuilderInput::stop: Socket not found for channel. socket_ep={}",
+          lFmqChannelPtr->GetAddress());
+        continue;
+      }
+      lFmqChannelPtr->GetSocket().SetLinger(0);
+      lFmqChannelPtr->GetSocket().Close();
     }
-    lFmqChannelPtr->GetSocket().SetLinger(0);
-    lFmqChannelPtr->GetSocket().Close();
   }
   mStfSenderChannels.clear();
   IDDLOG("TfBuilderInput::stop: All input channels are closed.");
 
   //Wait for deserializer thread
-  mReceivedData.stop();
-  if (mStfDeserThread.joinable()) {
-    mStfDeserThread.join();
+  for (auto &lQueue : mReceivedData) {
+    lQueue->stop();
+  }
+  for (auto &lThread : mStfDeserThreads) {
+    if (lThread.joinable()) {
+      lThread.join();
+    }
   }
+  mStfDeserThreads.clear();
 
   // Make sure the merger stopped
   {
@@ -238,6 +346,7 @@ void TfBuilderInput::stop(std::shared_ptr<ConsulTfBuilder> pConfig)
     {
       std::unique_lock<std::mutex> lQueueLock(mStfMergerQueueLock);
       mStfMergeMap.clear();
+      mReadyTfs.clear();
       IDDLOG("TfBuilderInput::stop: Merger queue emptied.");
       mStfMergerCondition.notify_all();
     }
@@ -252,20 +361,29 @@ void TfBuilderInput::stop(std::shared_ptr<ConsulTfBuilder> pConfig)
 }
 
 /// Receiving thread
-void TfBuilderInput::DataHandlerThread(const std::uint32_t pFlpIndex)
+void TfBuilderInput::DataHandlerThread(const std::uint32_t pFlpIndex, const std::uint32_t pChanIdx)
 {
   std::uint64_t lNumStfs = 0;
 
-  DataDistLogger::SetThreadName(fmt::format("Receiver[{}]", pFlpIndex));
-  DDDLOG("Starting receiver thread for StfSender[{}]", pFlpIndex);
+  DataDistLogger::SetThreadName(fmt::format("Receiver[{}:{}]", pFlpIndex, pChanIdx));
+  DDDLOG("Starting receiver thread for StfSender[{}] channel={}", pFlpIndex, pChanIdx);
 
   // Reference to the input channel
-  auto& lInputChan = *mStfSenderChannels[pFlpIndex];
+  auto& lInputChan = *mStfSenderChannels[pFlpIndex][pChanIdx];
+  PollingReceiver lReceiver(lInputChan, std::chrono::microseconds(
+    mDevice.GetConfig()->GetValue<std::uint64_t>(TfBuilderDevice::OptionKeyInputBusyPollUs)), 1000 /* ms */);
 
   while (mState == RUNNING) {
     std::unique_ptr<std::vector<FairMQMessagePtr>> lStfData = std::make_unique<std::vector<FairMQMessagePtr>>();
 
-    const std::int64_t ret = lInputChan.Receive(*lStfData, 1000 /* ms */);
+    const std::int64_t ret = lReceiver.receive(*lStfData);
+
+    // CPU cost per STF: the busy-poll trade-off
+    if (const auto lStats = lReceiver.intervalStats(std::chrono::seconds(10)); lStats && lStats->mMessages > 0) {
+      DDMON_STATIC("tfbuilder", "tf_input.cpu_us_per_stf", lStats->mCpuUsPerMessage);
+      DDDLOG("Input statistics. stf_sender={} channel={} stfs={} spin_received={} cpu_us_per_stf={:.2f}",
+        pFlpIndex, pChanIdx, lStats->mMessages, lStats->mSpinReceived, lStats->mCpuUsPerMessage);
+    }
     // timeout ?
     if (ret == -2) {
       continue;
@@ -277,56 +395,199 @@ void TfBuilderInput::DataHandlerThread(const std::uint32_t pFlpIndex)
     }
 
     // send to deserializer thread so that we can keep receiving
-    mReceivedData.push(std::move(lStfData));
+    mReceivedData[pFlpIndex % mReceivedData.size()]->push(pFlpIndex, std::move(lStfData));
     lNumStfs++;
   }
 
-  IDDLOG("Exiting input thread [{}]", pFlpIndex);
+  IDDLOG("Exiting input thread [{}:{}]", pFlpIndex, pChanIdx);
 }
 
 /// FMQ->STF thread
-void TfBuilderInput::StfDeserializingThread()
+void TfBuilderInput::StfDeserializingThread(const std::size_t pIdx)
 {
+  auto &lReceivedData = *mReceivedData[pIdx];
+
   std::uint64_t lNumStfs = 0;
   // Deserialization object
   CoalescedHdrDataDeserializer lStfReceiver(mDevice.TfBuilderI());
+  lStfReceiver.setFullValidation(mDevice.GetConfig()->GetValue<bool>(TfBuilderDevice::OptionKeyStfFullValidation));
+  lStfReceiver.setVerifyChecksums(mDevice.GetConfig()->GetValue<bool>(TfBuilderDevice::OptionKeyStfVerifyChecksums));
+
+  std::vector<ReceivedStfMeta> lReceived;
+  std::map<std::pair<TimeFrameIdType, std::uint32_t>, ChunkedStf> lChunkedStfs;
+
+  // partial chunked STFs are evicted with the TF assembly timeout
+  const std::chrono::milliseconds lAssemblyTimeout(
+    mDevice.GetConfig()->GetValue<std::uint64_t>(TfBuilderDevice::OptionKeyTfAssemblyTimeout));
+  const auto lPollInterval = (lAssemblyTimeout.count() > 0) ?
+    std::clamp(std::chrono::duration_cast<std::chrono::milliseconds>(lAssemblyTimeout / 4), 10ms, 500ms) : 500ms;
+  auto lLastEvictionCheck = std::chrono::system_clock::now();
+  std::uint64_t lNumEvictedStfs = 0;
+
+  // Assemble chunks of an STF as they arrive. Returns true when the STF is complete
+  auto lAddChunk = [&](ReceivedStfMeta &pStfInfo, const CoalescedHdrDataSerializer::chunk_info &pChunk) {
+    static constexpr std::uint32_t cMaxChunks = 1U << 16;
+
+    const auto lStfId = pStfInfo.mStf->header().mId;
+    auto &lChunked = lChunkedStfs[{ lStfId, pStfInfo.mFlpIndex }];
+
+    // duplicate chunks or indices past the last chunk would complete the STF with missing data
+    const bool lValidIdx = (pChunk.mChunkIdx < cMaxChunks) &&
+      (lChunked.mTotalChunks == 0 || pChunk.mChunkIdx < lChunked.mTotalChunks) &&
+      (!pChunk.mLastChunk || lChunked.mChunkReceived.size() <= pChunk.mChunkIdx + 1);
+    const bool lDuplicate = lValidIdx && (pChunk.mChunkIdx < lChunked.mChunkReceived.size()) &&
+      lChunked.mChunkReceived[pChunk.mChunkIdx];
+    if (!lValidIdx || lDuplicate) {
+      EDDLOG_RL(1000, "Discarding an invalid STF chunk. stf_id={} flp_idx={} chunk_idx={} last_chunk={} duplicate={}",
+        lStfId, pStfInfo.mFlpIndex, pChunk.mChunkIdx, pChunk.mLastChunk, lDuplicate);
+      if (!lChunked.mStf) {
+        lChunkedStfs.erase({ lStfId, pStfInfo.mFlpIndex });
+      }
+      pStfInfo.mStf.reset();
+      return false;
+    }
 
-  while (mState == RUNNING) {
+    if (lChunked.mChunkReceived.size() <= pChunk.mChunkIdx) {
+      lChunked.mChunkReceived.resize(pChunk.mChunkIdx + 1, false);
+    }
+    lChunked.mChunkReceived[pChunk.mChunkIdx] = true;
 
-    auto lData = mReceivedData.pop();
-    if (lData == std::nullopt) {
-      continue;
+    if (!lChunked.mStf) {
+      lChunked.mTimeReceived = pStfInfo.mTimeReceived;
+      lChunked.mStf = std::move(pStfInfo.mStf);
+    } else {
+      lChunked.mStf->mergeStf(std::move(pStfInfo.mStf));
+    }
+
+    lChunked.mNumChunks++;
+    if (pChunk.mLastChunk) {
+      lChunked.mTotalChunks = pChunk.mChunkIdx + 1;
+    }
+
+    if (lChunked.mNumChunks != lChunked.mTotalChunks) {
+      return false;
     }
-    auto &lStfInfo = lData.value();
 
-    assert (lStfInfo.mRecvStfdata);
+    pStfInfo.mTimeReceived = lChunked.mTimeReceived;
+    pStfInfo.mStf = std::move(lChunked.mStf);
+    lChunkedStfs.erase({ lStfId, pStfInfo.mFlpIndex });
+    return true;
+  };
+
+  // Evict partial chunked STFs of timed out TFs, or older than the assembly timeout. The TF cannot be
+  // completed: drop it here, unless its other STFs are already waiting for the merger deadline.
+  auto lEvictChunkedStfs = [&]() {
+    const auto lNow = std::chrono::system_clock::now();
+    if (lChunkedStfs.empty() || (lNow - lLastEvictionCheck) < lPollInterval) {
+      return;
+    }
+    lLastEvictionCheck = lNow;
+
+    std::unique_lock<std::mutex> lQueueLock(mStfMergerQueueLock);
+    for (auto lIt = lChunkedStfs.begin(); lIt != lChunkedStfs.end(); ) {
+      const auto lTfId = lIt->first.first;
+      const bool lTimedOut = (lAssemblyTimeout.count() > 0) && ((lNow - lIt->second.mTimeReceived) >= lAssemblyTimeout);
 
-    // try to deserialize
-    lStfInfo.mStf = lStfReceiver.deserialize(*lStfInfo.mRecvStfdata);
-    if (!lStfInfo.mStf) {
+      if (!lTimedOut && mTimedOutTfs.count(lTfId) == 0) {
+        ++lIt;
+        continue;
+      }
+
+      lNumEvictedStfs++;
+      WDDLOG_RL(1000, "Evicting a partial chunked STF. tf_id={} flp_idx={} num_chunks={} total_chunks={} total={}",
+        lTfId, lIt->first.second, lIt->second.mNumChunks, lIt->second.mTotalChunks, lNumEvictedStfs);
+      DDMON_STATIC("tfbuilder", "tf_input.evicted_chunked_stfs", lNumEvictedStfs);
+
+      mTimedOutTfs.insert(lTfId);
+      if (mTimedOutTfs.size() > 16384) {
+        mTimedOutTfs.erase(mTimedOutTfs.begin());
+      }
+
+      if (mStfMergeMap.count(lTfId) == 0) {
+        mRpc->removeIncompleteTf(lTfId);
+        mRpc->releaseTfCredits(lTfId);
+        mRpc->releaseTfReservation(lTfId);
+      }
+      lIt = lChunkedStfs.erase(lIt);
+    }
+  };
+
+  while (mState == RUNNING) {
+
+    lEvictChunkedStfs();
+
+    lReceived.clear();
+    if (lReceivedData.pop_n(std::numeric_limits<unsigned long>::max(), lPollInterval, std::back_inserter(lReceived)) == 0) {
       continue;
     }
 
-    const TimeFrameIdType lTfId = lStfInfo.mStf->header().mId;
-    lNumStfs++;
+    // deserialize all received STFs before taking the merger lock
+    for (auto &lStfInfo : lReceived) {
+      assert (lStfInfo.mRecvStfdata);
+
+      lStfInfo.mStf = lStfReceiver.deserialize(*lStfInfo.mRecvStfdata);
+
+      const auto &lChunk = lStfReceiver.chunkInfo();
+      if (lStfInfo.mStf && !(lChunk.mChunkIdx == 0 && lChunk.mLastChunk)) {
+        if (!lAddChunk(lStfInfo, lChunk)) {
+          continue; // wait for the remaining chunks
+        }
+      }
 
-    DDDLOG_RL(5000, "Deserialized STF. stf_id={} total={}", lTfId, lNumStfs);
+      if (lStfInfo.mStf) {
+        lNumStfs++;
+        DDDLOG_RL(5000, "Deserialized STF. stf_id={} total={}", lStfInfo.mStf->header().mId, lNumStfs);
+
+        // allow requesting of more STFs
+        mRpc->releaseStfCredit(lStfInfo.mStf->header().mId, lStfInfo.mStf->getDataSize());
+        mRpc->recordStfReceived(lStfInfo.mStf->header().mId, lStfInfo.mStf->getDataSize());
+      }
+    }
 
     {
-      // Push the STF into the merger queue
+      // Push the STFs into the merger queue
       std::unique_lock<std::mutex> lQueueLock(mStfMergerQueueLock);
+      bool lTfComplete = false;
+
+      for (auto &lStfInfo : lReceived) {
+        if (!lStfInfo.mStf) {
+          continue;
+        }
+
+        const TimeFrameIdType lTfId = lStfInfo.mStf->header().mId;
+
+        // late STF of a TF which timed out
+        if (mTimedOutTfs.count(lTfId) > 0) {
+          WDDLOG_RL(1000, "Discarding a late STF of a timed out TF. tf_id={} flp_idx={}", lTfId, lStfInfo.mFlpIndex);
+          lStfInfo.mStf.reset();
+          continue;
+        }
+
+        auto &lTfStfs = mStfMergeMap.try_emplace(lTfId).first->second;
+        lTfStfs.push_back(std::move(lStfInfo));
+        mStfCount++;
+
+        // hand over to the merger when the last STF arrives
+        if (lTfStfs.size() == expectedStfCount(lTfId)) {
+          mReadyTfs.push_back(lTfId);
+          lTfComplete = true;
+        }
+      }
 
-      mStfMergeMap[lTfId].push_back(std::move(lStfInfo));
-      mStfCount++;
-
-      if (mStfMergeMap[lTfId].size() == mNumStfSenders) {
+      if (lTfComplete) {
         lQueueLock.unlock();
         mStfMergerCondition.notify_one();
       }
     }
   }
 
-  IDDLOG("Exiting stf deserializer thread.");
+  IDDLOG("Exiting stf deserializer thread. idx={}", pIdx);
+}
+
+std::uint32_t TfBuilderInput::expectedStfCount(const TimeFrameIdType pTfId) const
+{
+  const auto lIncompleteCnt = mRpc->incompleteTfStfCount(pTfId);
+  return (lIncompleteCnt > 0) ? lIncompleteCnt : mNumStfSenders;
 }
 
 /// STF->TF Merger thread
@@ -335,62 +596,148 @@ void TfBuilderInput::StfMergerThread()
   using namespace std::chrono_literals;
 
   std::uint64_t lNumBuiltTfs = 0;
+  std::uint64_t lNumPartialTfs = 0;
 
-  while (mState == RUNNING) {
+  // TFs not complete within the assembly timeout (from the first received STF) are forwarded or dropped
+  const std::chrono::milliseconds lAssemblyTimeout(
+    mDevice.GetConfig()->GetValue<std::uint64_t>(TfBuilderDevice::OptionKeyTfAssemblyTimeout));
+  const bool lForwardPartial = mDevice.GetConfig()->GetValue<bool>(TfBuilderDevice::OptionKeyForwardPartialTfs);
+  const auto lPollInterval = (lAssemblyTimeout.count() > 0) ?
+    std::clamp(std::chrono::duration_cast<std::chrono::milliseconds>(lAssemblyTimeout / 4), 10ms, 500ms) : 500ms;
+  auto lLastDeadlineCheck = std::chrono::system_clock::now();
 
-    std::unique_lock<std::mutex> lQueueLock(mStfMergerQueueLock);
+  std::vector<std::tuple<TimeFrameIdType, std::vector<ReceivedStfMeta>>> lTimedOutTfs;
 
-    if (mStfCount < mNumStfSenders) {
-      if (std::cv_status::timeout == mStfMergerCondition.wait_for(lQueueLock, 500ms)) {
-        continue;
+  auto lBuildTf = [&](const TimeFrameIdType lStfId, std::vector<ReceivedStfMeta> &lStfMetaVec) {
+    const auto lNumStfs = lStfMetaVec.size();
+
+    if (lNumStfs > mNumStfSenders) {
+      EDDLOG("StfMerger: number of STFs is larger than expected. stf_id={:d} num_stfs={:d} num_stf_senders={:d}",
+        lStfId, lNumStfs, mNumStfSenders);
+    }
+
+    // merge the current TF!
+    const auto lBuildDurationMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+      lStfMetaVec.rbegin()->mTimeReceived - lStfMetaVec.begin()->mTimeReceived);
+    DDMON_HIST("tfbuilder", "tf_build_us", std::chrono::duration_cast<std::chrono::microseconds>(
+      lStfMetaVec.rbegin()->mTimeReceived - lStfMetaVec.begin()->mTimeReceived).count());
+
+    // emit traces of sampled TFs, one record per STF
+    if (lStfMetaVec.begin()->mStf->traced()) {
+      const auto lNow = std::chrono::system_clock::now();
+      for (auto &lStfMeta : lStfMetaVec) {
+        lStfMeta.mStf->trace(SubTimeFrame::Header::Trace::eTfBuilderReceived, lStfMeta.mTimeReceived);
+        lStfMeta.mStf->trace(SubTimeFrame::Header::Trace::eTfBuilt, lNow);
+        IDDLOG("TfTrace: flp_idx={} num_stfs={} {}", lStfMeta.mFlpIndex, lNumStfs, lStfMeta.mStf->traceRecord());
       }
     }
 
-    if (mStfCount < mNumStfSenders) {
-      continue;
+    // start from the first element (using it as the seed for the TF)
+    std::unique_ptr<SubTimeFrame> lTf = std::move(lStfMetaVec.begin()->mStf);
+
+    for (auto lStfIter = std::next(lStfMetaVec.begin()); lStfIter != lStfMetaVec.end(); ++lStfIter) {
+        // Add them all up
+        lTf->mergeStf(std::move(lStfIter->mStf));
     }
 
-    for (auto &lStfInfoIt : mStfMergeMap) {
-      auto &lStfMetaVec = lStfInfoIt.second;
-      const auto lStfId = lStfInfoIt.first;
+    lNumBuiltTfs++;
+    DDDLOG_RL(1000, "Building of TF completed. tf_id={:d} duration_ms={} total_tf={:d}",
+      lStfId, lBuildDurationMs.count(), lNumBuiltTfs);
 
-      if (lStfMetaVec.size() < mNumStfSenders) {
-        continue;
-      }
+    if (lNumStfs < mNumStfSenders) {
+      mRpc->removeIncompleteTf(lStfId);
+    }
+    // credits of STFs which were never received
+    mRpc->releaseTfCredits(lStfId);
 
-      if (lStfMetaVec.size() > mNumStfSenders) {
-        EDDLOG("StfMerger: number of STFs is larger than expected. stf_id={:d} num_stfs={:d} num_stf_senders={:d}",
-          lStfId, lStfMetaVec.size(), mNumStfSenders);
-      }
+    // account the size of received TF
+    mRpc->recordTfBuilt(*lTf);
 
-      // merge the current TF!
-      const auto lBuildDurationMs = std::chrono::duration_cast<std::chrono::milliseconds>(
-        lStfMetaVec.rbegin()->mTimeReceived - lStfMetaVec.begin()->mTimeReceived);
+    return lTf;
+  };
 
-      // start from the first element (using it as the seed for the TF)
-      std::unique_ptr<SubTimeFrame> lTf = std::move(lStfMetaVec.begin()->mStf);
+  while (mState == RUNNING) {
+
+    std::vector<ReceivedStfMeta> lStfMetaVec;
+    TimeFrameIdType lStfId = 0;
+    lTimedOutTfs.clear();
+    {
+      std::unique_lock<std::mutex> lQueueLock(mStfMergerQueueLock);
 
-      for (auto lStfIter = std::next(lStfMetaVec.begin()); lStfIter != lStfMetaVec.end(); ++lStfIter) {
-          // Add them all up
-          lTf->mergeStf(std::move(lStfIter->mStf));
+      if (mReadyTfs.empty()) {
+        if (!mStfMergerCondition.wait_for(lQueueLock, lPollInterval, [this]() { return !mReadyTfs.empty(); })) {
+          // safety net: TFs completed by a late change of the expected STF count
+          for (const auto &lTfStfs : mStfMergeMap) {
+            if (lTfStfs.second.size() >= expectedStfCount(lTfStfs.first) &&
+              std::find(mReadyTfs.cbegin(), mReadyTfs.cend(), lTfStfs.first) == mReadyTfs.cend()) {
+              mReadyTfs.push_back(lTfStfs.first);
+            }
+          }
+        }
       }
 
-      lNumBuiltTfs++;
-      DDDLOG_RL(1000, "Building of TF completed. tf_id={:d} duration_ms={} total_tf={:d}",
-        lStfId, lBuildDurationMs.count(), lNumBuiltTfs);
+      // check the TF assembly deadlines
+      const auto lNow = std::chrono::system_clock::now();
+      if (lAssemblyTimeout.count() > 0 && (lNow - lLastDeadlineCheck) >= lPollInterval) {
+        lLastDeadlineCheck = lNow;
+
+        for (auto lIt = mStfMergeMap.begin(); lIt != mStfMergeMap.end(); ) {
+          if ((lNow - lIt->second.front().mTimeReceived) < lAssemblyTimeout ||
+            lIt->second.size() >= expectedStfCount(lIt->first)) {
+            ++lIt;
+            continue;
+          }
+
+          // late STFs of this TF are discarded
+          mTimedOutTfs.insert(lIt->first);
+          if (mTimedOutTfs.size() > 16384) {
+            mTimedOutTfs.erase(mTimedOutTfs.begin());
+          }
+
+          mStfCount -= lIt->second.size();
+          lTimedOutTfs.emplace_back(lIt->first, std::move(lIt->second));
+          lIt = mStfMergeMap.erase(lIt);
+        }
+      }
 
-      // remove consumed STFs from the merge queue
-      mStfMergeMap.erase(lStfId);
-      mStfCount -= mNumStfSenders;
+      if (!mReadyTfs.empty()) {
+        lStfId = mReadyTfs.front();
+        mReadyTfs.pop_front();
 
-      // account the size of received TF
-      mRpc->recordTfBuilt(*lTf);
+        auto lTfNode = mStfMergeMap.extract(lStfId);
+        if (!lTfNode.empty()) {
+          lStfMetaVec = std::move(lTfNode.mapped());
+          mStfCount -= lStfMetaVec.size();
+        }
+      }
+    }
 
-      // Queue out the TF for consumption
-      mDevice.queue(mOutStage, std::move(lTf));
+    // partial TFs: forward with the missing STF count, or drop to release the memory
+    for (auto &[lTfId, lPartialStfs] : lTimedOutTfs) {
+      lNumPartialTfs++;
+      const std::uint32_t lNumMissing = mNumStfSenders - std::min(std::uint32_t(lPartialStfs.size()), mNumStfSenders);
+
+      WDDLOG_RL(1000, "StfMerger: TF assembly timeout. tf_id={} num_stfs={} num_missing={} action={} total={}",
+        lTfId, lPartialStfs.size(), lNumMissing, (lForwardPartial ? "forward" : "drop"), lNumPartialTfs);
+      DDMON_STATIC("tfbuilder", "tf_input.partial_tfs", lNumPartialTfs);
+
+      if (lForwardPartial) {
+        auto lTf = lBuildTf(lTfId, lPartialStfs);
+        lTf->setNumMissingStfs(lNumMissing);
+        mDevice.queue(mOutStage, std::move(lTf));
+      } else {
+        // not accounted with recordTfBuilt(): the region memory is released with the STFs
+        mRpc->removeIncompleteTf(lTfId);
+        mRpc->releaseTfCredits(lTfId);
+        mRpc->releaseTfReservation(lTfId);
+        lPartialStfs.clear();
+      }
+    }
 
-      // break from the for loop and try again
-      break;
+    // merge outside of the lock
+    if (!lStfMetaVec.empty()) {
+      // Queue out the TF for consumption
+      mDevice.queue(mOutStage, lBuildTf(lStfId, lStfMetaVec));
     }
   }
 
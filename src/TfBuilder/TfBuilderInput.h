@@ -22,6 +22,8 @@
 
 #include <vector>
 #include <map>
+#include <deque>
+#include <set>
 
 #include <condition_variable>
 #include <mutex>
@@ -49,8 +51,8 @@ class TfBuilderInput
   bool start(std::shared_ptr<ConsulTfBuilder> pConfig);
   void stop(std::shared_ptr<ConsulTfBuilder> pConfig);
 
-  void DataHandlerThread(const std::uint32_t pFlpIndex);
-  void StfDeserializingThread();
+  void DataHandlerThread(const std::uint32_t pFlpIndex, const std::uint32_t pChanIdx);
+  void StfDeserializingThread(const std::size_t pIdx);
   void StfMergerThread();
 
  private:
@@ -66,35 +68,52 @@ class TfBuilderInput
   // Partition info
   std::uint32_t mNumStfSenders = 0;
 
-  /// StfBuilder channels
-  std::vector<std::unique_ptr<FairMQChannel>> mStfSenderChannels;
+  /// StfBuilder channels (one or more per FLP)
+  std::vector<std::vector<std::unique_ptr<FairMQChannel>>> mStfSenderChannels;
 
-  /// Threads for input channels (per FLP)
-  std::map<std::string, std::thread> mInputThreads;
+  /// Threads for input channels (per FLP, one for each channel)
+  std::map<std::string, std::vector<std::thread>> mInputThreads;
 
   /// Deserializing thread
   struct ReceivedStfMeta {
     std::chrono::time_point<std::chrono::system_clock> mTimeReceived;
+    std::uint32_t mFlpIndex;
     std::unique_ptr<std::vector<FairMQMessagePtr>> mRecvStfdata;
     std::unique_ptr<SubTimeFrame> mStf;
 
-    ReceivedStfMeta(std::unique_ptr<std::vector<FairMQMessagePtr>> &&pRecvStfdata)
+    ReceivedStfMeta(const std::uint32_t pFlpIndex, std::unique_ptr<std::vector<FairMQMessagePtr>> &&pRecvStfdata)
     : mTimeReceived(std::chrono::system_clock::now()),
+      mFlpIndex(pFlpIndex),
       mRecvStfdata(std::move(pRecvStfdata)),
       mStf(nullptr)
     {}
   };
 
-  ConcurrentQueue<ReceivedStfMeta> mReceivedData;
-  std::thread mStfDeserThread;
+  /// Chunked STFs being assembled: <stf id, flp index>
+  struct ChunkedStf {
+    std::chrono::time_point<std::chrono::system_clock> mTimeReceived; // first chunk
+    std::unique_ptr<SubTimeFrame> mStf;
+    std::uint32_t mNumChunks = 0;
+    std::uint32_t mTotalChunks = 0; // known when the last chunk is received
+    std::vector<bool> mChunkReceived; // by chunk index
+  };
+
+  /// Deserializing workers: STFs of one StfSender are always deserialized by the same worker (chunk assembly)
+  std::vector<std::unique_ptr<ConcurrentQueue<ReceivedStfMeta>>> mReceivedData;
+  std::vector<std::thread> mStfDeserThreads;
 
   /// STF Merger
   std::thread mStfMergerThread;
   std::mutex mStfMergerQueueLock;
     std::condition_variable mStfMergerCondition;
     std::map<TimeFrameIdType, std::vector<ReceivedStfMeta>> mStfMergeMap;
+    std::deque<TimeFrameIdType> mReadyTfs; // TFs of mStfMergeMap which received all STFs
+    std::set<TimeFrameIdType> mTimedOutTfs; // recent TFs removed by the assembly timeout
     std::uint64_t mStfCount = 0;
 
+    // number of STFs to wait for: less than mNumStfSenders for TFs scheduled as incomplete
+    std::uint32_t expectedStfCount(const TimeFrameIdType pTfId) const;
+
   /// Output pipeline stage
   unsigned mOutStage;
 };
@@ -39,10 +39,15 @@ void TfBuilderRpcImpl::initDiscovery(const std::string pRpcSrvBindIp, int &lReal
   IDDLOG("gRPC server is started. server_ep={}:{}", pRpcSrvBindIp, lRealPort);
 }
 
-bool TfBuilderRpcImpl::start(const std::uint64_t pBufferSize)
+bool TfBuilderRpcImpl::start(const std::uint64_t pStfRequestWindow)
 {
-  mBufferSize = pBufferSize;
-  mCurrentTfBufferSize = pBufferSize;
+  {
+    std::scoped_lock lLock(mStfCreditLock);
+    mStfRequestWindow = pStfRequestWindow;
+    mStfCreditsOutstanding = 0;
+    mStfsOutstanding = 0;
+    mTfCredits.clear();
+  }
   mTerminateRequested = false;
 
   // Interact with the scheduler
@@ -70,6 +75,7 @@ bool TfBuilderRpcImpl::start(const std::uint64_t pBufferSize)
 void TfBuilderRpcImpl::stop()
 {
   mRunning = false;
+  mStfCreditCond.notify_all();
 
   stopAcceptingTfs();
 
@@ -94,9 +100,19 @@ void TfBuilderRpcImpl::stop()
   mStfSenderRpcClients.stop();
   mTfSchedulerRpcClient.stop();
 
-  mCurrentTfBufferSize = 0;
-  mNumBufferedTfs = 0;
-  mLastBuiltTfId = 0;
+  {
+    std::scoped_lock lLock(mTfIdSizesLock);
+    mTfIdSizes.clear();
+    mTfReservations.clear();
+    mReservedMemory = 0;
+    mReceivedMemory = 0;
+    mBufferedMemory = 0;
+    mNumBufferedTfs = 0;
+    mLastAcceptedTfId = 0;
+    mLastBuiltTfId = 0;
+    mBuiltTfsSinceUpdate.clear();
+    mAcceptedTfsSinceUpdate.clear();
+  }
 }
 
 // make sure these are sent immediately
@@ -117,7 +133,14 @@ void TfBuilderRpcImpl::UpdateSendingThread()
   using namespace std::chrono_literals;
   DDDLOG("Starting TfBuilder Update sending thread.");
 
+  auto lLastMemStats = std::chrono::steady_clock::now();
+
   while (mRunning) {
+    if (std::chrono::steady_clock::now() - lLastMemStats >= 1s) {
+      publishMemoryStats();
+      lLastMemStats = std::chrono::steady_clock::now();
+    }
+
     if (!mTerminateRequested) {
       std::unique_lock lLock(mUpdateLock);
       sendTfBuilderUpdate();
@@ -137,6 +160,35 @@ void TfBuilderRpcImpl::UpdateSendingThread()
   DDDLOG("Exiting TfBuilder Update sending thread.");
 }
 
+void TfBuilderRpcImpl::publishMemoryStats()
+{
+  const auto lPublish = [](const std::string &pRegion, const RegionAllocatorStats &pStats) {
+    DDMON("tfbuilder", pRegion + ".free", pStats.mFree);
+    DDMON("tfbuilder", pRegion + ".largest_free_block", pStats.mLargestFreeBlock);
+    DDMON("tfbuilder", pRegion + ".free_ranges", pStats.mNumFreeRanges);
+    DDMON("tfbuilder", pRegion + ".try_alloc_failed", pStats.mTryAllocFailed);
+    DDMON("tfbuilder", pRegion + ".size_class_bytes", pStats.mSizeClassBytes);
+    DDMON("tfbuilder", pRegion + ".magazine_refills", pStats.mMagazineRefills);
+    DDMON("tfbuilder", pRegion + ".alloc_wait_us.p50", pStats.mAllocWaitP50Us);
+    DDMON("tfbuilder", pRegion + ".alloc_wait_us.p90", pStats.mAllocWaitP90Us);
+    DDMON("tfbuilder", pRegion + ".alloc_wait_us.p99", pStats.mAllocWaitP99Us);
+    DDMON("tfbuilder", pRegion + ".alloc_wait_us.max", pStats.mAllocWaitMaxUs);
+    DDMON("tfbuilder", pRegion + ".reclaim_batch.p50", Log2Histogram::percentile(pStats.mReclaimBatchHist, 50.0));
+    DDMON("tfbuilder", pRegion + ".reclaim_batch.p90", Log2Histogram::percentile(pStats.mReclaimBatchHist, 90.0));
+    DDMON("tfbuilder", pRegion + ".reclaim_batch.p99", Log2Histogram::percentile(pStats.mReclaimBatchHist, 99.0));
+  };
+
+  if (!mMemI.running()) {
+    return;
+  }
+
+  lPublish("shm_header", mMemI.headerStats());
+
+  const auto lDataStats = mMemI.dataStats();
+  mFreeContiguousMemory = lDataStats.mLargestFreeBlock;
+  lPublish("shm_data", lDataStats);
+}
+
 void TfBuilderRpcImpl::StfRequestThread()
 {
   using namespace std::chrono_literals;
@@ -159,24 +211,40 @@ void TfBuilderRpcImpl::StfRequestThread()
     DDDLOG_RL(1000, "Requesting SubTimeFrame. stf_id={} tf_size={} total_requests={}",
       mTfInfo.tf_id(), mTfInfo.tf_size(), lNumTfRequests);
 
+    bool lStfsRequested = false;
+
     for (auto &lStfDataIter : mTfInfo.stf_size_map()) {
       const auto &lStfSenderId = lStfDataIter.first;
       // const auto &lStfSize = lStfDataIter.second;
+      const auto &lStfSize = lStfDataIter.second;
       lStfRequest.set_stf_id(mTfInfo.tf_id());
 
+      // pace the requests: StfSenders only send requested STFs
+      if (!acquireStfCredit(mTfInfo.tf_id(), lStfSize)) {
+        break; // not running
+      }
+
       grpc::Status lStatus = StfSenderRpcClients()[lStfSenderId]->StfDataRequest(lStfRequest, lStfResponse);
       if (!lStatus.ok()) {
         // gRPC problem... continue asking for other STFs
         EDDLOG("StfSender gRPC connection problem. stfs_id={} code={} error={}",
           lStfSenderId, lStatus.error_code(), lStatus.error_message());
+        releaseStfCredit(mTfInfo.tf_id(), lStfSize);
         continue;
       }
 
       if (lStfResponse.status() != StfDataResponse::OK) {
         EDDLOG("StfSender did not sent data. stfs_id={} reason={}",
           lStfSenderId, StfDataResponse_StfDataStatus_Name(lStfResponse.status()));
+        releaseStfCredit(mTfInfo.tf_id(), lStfSize);
         continue;
       }
+      lStfsRequested = true;
+    }
+
+    // no STF will be received: the TF is never built
+    if (!lStfsRequested) {
+      releaseTfReservation(mTfInfo.tf_id());
     }
   }
 
@@ -185,6 +253,79 @@ void TfBuilderRpcImpl::StfRequestThread()
   DDDLOG("Exiting Stf requesting thread.");
 }
 
+bool TfBuilderRpcImpl::acquireStfCredit(const std::uint64_t pTfId, const std::uint64_t pStfSize)
+{
+  using namespace std::chrono_literals;
+
+  std::unique_lock lLock(mStfCreditLock);
+
+  // always allow one STF in flight, regardless of the size
+  // the free memory changes without notification: re-check periodically
+  while (mRunning && mStfsOutstanding > 0) {
+    const auto lRequested = mStfCreditsOutstanding + pStfSize;
+    if ((mStfRequestWindow == 0 || lRequested <= mStfRequestWindow) && lRequested <= mMemI.freeData()) {
+      break;
+    }
+    mStfCreditCond.wait_for(lLock, 10ms);
+  }
+
+  if (!mRunning) {
+    return false;
+  }
+
+  auto &[lTfBytes, lTfStfs] = mTfCredits[pTfId];
+  lTfBytes += pStfSize;
+  lTfStfs += 1;
+  mStfCreditsOutstanding += pStfSize;
+  mStfsOutstanding += 1;
+
+  DDMON_STATIC("tfbuilder", "stf_request.credits_outstanding", mStfCreditsOutstanding);
+  DDMON_STATIC("tfbuilder", "stf_request.incast_depth", mStfsOutstanding);
+  return true;
+}
+
+void TfBuilderRpcImpl::releaseStfCredit(const std::uint64_t pTfId, const std::uint64_t pStfSize)
+{
+  {
+    std::scoped_lock lLock(mStfCreditLock);
+
+    const auto lIt = mTfCredits.find(pTfId);
+    if (lIt == mTfCredits.end()) {
+      return;
+    }
+    auto &[lTfBytes, lTfStfs] = lIt->second;
+
+    // the received size can be different from the announced one
+    const auto lBytes = (lTfStfs <= 1) ? lTfBytes : std::min(lTfBytes, pStfSize);
+    lTfBytes -= lBytes;
+    lTfStfs -= std::min(lTfStfs, 1u);
+    mStfCreditsOutstanding -= lBytes;
+    mStfsOutstanding -= 1;
+
+    if (lTfStfs == 0) {
+      mTfCredits.erase(lIt);
+    }
+  }
+  mStfCreditCond.notify_one();
+}
+
+void TfBuilderRpcImpl::releaseTfCredits(const std::uint64_t pTfId)
+{
+  {
+    std::scoped_lock lLock(mStfCreditLock);
+
+    const auto lIt = mTfCredits.find(pTfId);
+    if (lIt == mTfCredits.end()) {
+      return;
+    }
+    const auto &[lTfBytes, lTfStfs] = lIt->second;
+    mStfCreditsOutstanding -= lTfBytes;
+    mStfsOutstanding -= lTfStfs;
+    mTfCredits.erase(lIt);
+  }
+  mStfCreditCond.notify_one();
+}
+
 bool TfBuilderRpcImpl::sendTfBuilderUpdate()
 {
   TfBuilderUpdateMessage lUpdate;
@@ -199,11 +340,33 @@ bool TfBuilderRpcImpl::sendTfBuilderUpdate()
   {
     std::scoped_lock lLock(mTfIdSizesLock);
 
-    const std::uint64_t lFreeMem = std::min(std::size_t(mCurrentTfBufferSize), mMemI.freeData());
-
-    lUpdate.set_free_memory(lFreeMem);
+    // everything allocated in the data region, and not built or being received, is held by DPL
+    const std::uint64_t lFree = mMemI.freeData();
+    const std::uint64_t lUsed = mMemI.sizeData() - std::min(std::uint64_t(mMemI.sizeData()), lFree);
+    const std::uint64_t lHeld = mBufferedMemory + mReceivedMemory;
+
+    lUpdate.set_free_memory(lFree - std::min(lFree, mReservedMemory));
+    lUpdate.set_reserved_memory(mReservedMemory);
+    lUpdate.set_free_contiguous_memory(std::min(std::uint64_t(mFreeContiguousMemory), lFree));
+    lUpdate.set_buffered_memory(mBufferedMemory);
+    lUpdate.set_dpl_inflight_memory(lUsed - std::min(lUsed, lHeld));
+    lUpdate.set_last_accepted_tf_id(mLastAcceptedTfId);
     lUpdate.set_num_buffered_tfs(mNumBufferedTfs);
     lUpdate.set_last_built_tf_id(mLastBuiltTfId);
+
+    // actual TF sizes for the scheduler size estimate
+    for (const auto &[lTfId, lTfSize] : mBuiltTfsSinceUpdate) {
+      auto lBuiltTf = lUpdate.add_built_tfs();
+      lBuiltTf->set_tf_id(lTfId);
+      lBuiltTf->set_tf_size(lTfSize);
+    }
+    mBuiltTfsSinceUpdate.clear();
+
+    // the free memory above includes the reservations of these TFs
+    for (const auto lTfId : mAcceptedTfsSinceUpdate) {
+      lUpdate.add_accepted_tf_ids(lTfId);
+    }
+    mAcceptedTfsSinceUpdate.clear();
   }
 
   sUpdateCnt++;
@@ -227,22 +390,22 @@ bool TfBuilderRpcImpl::recordTfBuilt(const SubTimeFrame &pTf)
   {
     std::scoped_lock lLock(mTfIdSizesLock);
 
-    if (mCurrentTfBufferSize >= lTfSize) {
-      mCurrentTfBufferSize -= lTfSize;
-    } else {
-      EDDLOG("TimeFrame memory buffer overrun! size=0 missing={}", (lTfSize - mCurrentTfBufferSize));
-      mCurrentTfBufferSize = 0;
-    }
+    // the TF memory is accounted as buffered instead of reserved and received
+    releaseTfReservation(lTfId);
 
     assert (mTfIdSizes.count(lTfId) == 0);
 
     // save the size and id to increment the state later
     mTfIdSizes[lTfId] = lTfSize;
+    mBufferedMemory += lTfSize;
     mNumBufferedTfs++;
     mLastBuiltTfId = std::max(mLastBuiltTfId, lTfId);
+    if (mBuiltTfsSinceUpdate.size() < 4096) {
+      mBuiltTfsSinceUpdate.emplace_back(lTfId, lTfSize);
+    }
 
-    DDMON("tfbuilder", "buffered.tf_cnt", mNumBufferedTfs);
-    DDMON("tfbuilder", "buffered.tf_size", mBufferSize - mCurrentTfBufferSize);
+    DDMON_STATIC("tfbuilder", "buffered.tf_cnt", mNumBufferedTfs);
+    DDMON_STATIC("tfbuilder", "buffered.tf_size", mBufferedMemory);
   }
   mUpdateCondition.notify_one();
 
@@ -264,14 +427,14 @@ bool TfBuilderRpcImpl::recordTfForwarded(const std::uint64_t &pTfId)
     }
 
     const auto lTfSize = mTfIdSizes[pTfId];
-    mCurrentTfBufferSize += lTfSize;
+    mBufferedMemory -= std::min(mBufferedMemory, lTfSize);
 
     // remove the tf id from the map
     mTfIdSizes.erase(pTfId);
     mNumBufferedTfs--;
 
-    DDMON("tfbuilder", "buffered.tf_cnt", mNumBufferedTfs);
-    DDMON("tfbuilder", "buffered.tf_size", mBufferSize - mCurrentTfBufferSize);
+    DDMON_STATIC("tfbuilder", "buffered.tf_cnt", mNumBufferedTfs);
+    DDMON_STATIC("tfbuilder", "buffered.tf_size", mBufferedMemory);
   }
 
   mUpdateCondition.notify_one();
@@ -279,6 +442,44 @@ bool TfBuilderRpcImpl::recordTfForwarded(const std::uint64_t &pTfId)
   return true;
 }
 
+void TfBuilderRpcImpl::recordStfReceived(const std::uint64_t pTfId, const std::uint64_t pStfSize)
+{
+  std::scoped_lock lLock(mTfIdSizesLock);
+
+  const auto lIt = mTfReservations.find(pTfId);
+  if (lIt == mTfReservations.end()) {
+    return; // late STF of a built or dropped TF
+  }
+
+  // the received size can be different from the announced one
+  auto &lReservation = lIt->second;
+  const auto lFilled = std::min(lReservation.mReserved, pStfSize);
+  lReservation.mReserved -= lFilled;
+  lReservation.mReceived += pStfSize;
+  mReservedMemory -= lFilled;
+  mReceivedMemory += pStfSize;
+}
+
+void TfBuilderRpcImpl::releaseTfReservation(const std::uint64_t pTfId)
+{
+  std::scoped_lock lLock(mTfIdSizesLock);
+
+  const auto lIt = mTfReservations.find(pTfId);
+  if (lIt == mTfReservations.end()) {
+    return;
+  }
+
+  mReservedMemory -= lIt->second.mReserved;
+  mReceivedMemory -= lIt->second.mReceived;
+  mTfReservations.erase(lIt);
+}
+
+std::uint64_t TfBuilderRpcImpl::availableMemory() const
+{
+  const std::uint64_t lFree = mMemI.freeData();
+  return lFree - std::min(lFree, mReservedMemory);
+}
+
 ::grpc::Status TfBuilderRpcImpl::BuildTfRequest(::grpc::ServerContext* /*context*/,
                                                 const TfBuildingInformation* request, BuildTfResponse* response)
 {
@@ -290,17 +491,34 @@ bool TfBuilderRpcImpl::recordTfForwarded(const std::uint64_t &pTfId)
   const auto &lTfId = request->tf_id();
   const auto &lTfSize = request->tf_size();
 
-  // sanity checks for accepting new TFs
+  // sanity checks for accepting new TFs, and reserve the memory
   {
     std::scoped_lock lLock(mTfIdSizesLock);
 
-    if (lTfSize > mCurrentTfBufferSize) {
-      EDDLOG("Request to build a TimeFrame: Not enough free memory! tf_id={} tf_size={} buffer_size={}",
-        lTfId,lTfSize, mCurrentTfBufferSize);
+    const auto lAvailable = availableMemory();
+    if (lTfSize > lAvailable) {
+      EDDLOG("Request to build a TimeFrame: Not enough free memory! tf_id={} tf_size={} available={} reserved={}",
+        lTfId, lTfSize, lAvailable, mReservedMemory);
 
       response->set_status(BuildTfResponse::ERROR_NOMEM);
       return ::grpc::Status::OK;
     }
+
+    mTfReservations[lTfId].mReserved += lTfSize;
+    mReservedMemory += lTfSize;
+    mLastAcceptedTfId = std::max(mLastAcceptedTfId, lTfId);
+    if (mAcceptedTfsSinceUpdate.size() < 4096) {
+      mAcceptedTfsSinceUpdate.push_back(lTfId);
+    }
+  }
+
+  // the TF is built without STFs of the missing StfSenders
+  if (request->missing_stf_senders_size() > 0) {
+    DDDLOG_RL(1000, "Request to build an incomplete TimeFrame. tf_id={} num_stfs={} num_missing={}",
+      lTfId, request->stf_size_map_size(), request->missing_stf_senders_size());
+
+    std::scoped_lock lLock(mIncompleteTfsLock);
+    mIncompleteTfs[lTfId] = request->stf_size_map_size();
   }
 
   // add request to the queue
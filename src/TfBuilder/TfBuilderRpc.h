@@ -28,10 +28,14 @@
 
 #include <ConcurrentQueue.h>
 
+#include <atomic>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <tuple>
 
 namespace o2::DataDistribution
 {
@@ -57,7 +61,7 @@ public:
   TfSchedulerRpcClient& TfSchedRpcCli() { return mTfSchedulerRpcClient; }
 
   void initDiscovery(const std::string pRpcSrvBindIp, int &lRealPort /*[out]*/);
-  bool start(const std::uint64_t pBufferSize);
+  bool start(const std::uint64_t pStfRequestWindow = 0);
   void stop();
 
   void startAcceptingTfs();
@@ -68,7 +72,11 @@ public:
 
   bool recordTfBuilt(const SubTimeFrame &pTf);
   bool recordTfForwarded(const std::uint64_t &pTfId);
+  /// memory reserved for accepted TFs: filled by received STFs, released when the TF is built or dropped
+  void recordStfReceived(const std::uint64_t pTfId, const std::uint64_t pStfSize);
+  void releaseTfReservation(const std::uint64_t pTfId);
   bool sendTfBuilderUpdate();
+  void publishMemoryStats();
 
   bool getNewTfBuildingRequest(TfBuildingInformation &pNewTfRequest)
   { if (!mTfBuildRequests) {
@@ -79,6 +87,24 @@ public:
 
   StfSenderRpcClientCollection<ConsulTfBuilder>& StfSenderRpcClients() { return mStfSenderRpcClients; }
 
+  /// Number of STFs of a TF scheduled as incomplete (0 for complete TFs)
+  std::uint32_t incompleteTfStfCount(const std::uint64_t pTfId)
+  {
+    std::scoped_lock lLock(mIncompleteTfsLock);
+    const auto lIt = mIncompleteTfs.find(pTfId);
+    return (lIt != mIncompleteTfs.end()) ? lIt->second : 0;
+  }
+
+  void removeIncompleteTf(const std::uint64_t pTfId)
+  {
+    std::scoped_lock lLock(mIncompleteTfsLock);
+    mIncompleteTfs.erase(pTfId);
+  }
+
+  /// STF request credits: returned when the STF is received, or when the TF is done
+  void releaseStfCredit(const std::uint64_t pTfId, const std::uint64_t pStfSize);
+  void releaseTfCredits(const std::uint64_t pTfId);
+
   bool isTerminateRequested() const { return mTerminateRequested; }
 
   // rpc BuildTfRequest(TfBuildingInformation) returns (BuildTfResponse) { }
@@ -116,17 +142,42 @@ private:
   /// StfSender RPC clients
   TfSchedulerRpcClient mTfSchedulerRpcClient;
 
-  /// TF buffer size accounting
+  /// TF buffer accounting, based on the data region allocators
   std::recursive_mutex mTfIdSizesLock;
-  std::unordered_map <uint64_t, uint64_t> mTfIdSizes;
+  std::unordered_map <uint64_t, uint64_t> mTfIdSizes; // built, not yet forwarded
+  struct TfReservation {
+    std::uint64_t mReserved = 0; // not yet received
+    std::uint64_t mReceived = 0;
+  };
+  std::unordered_map<std::uint64_t, TfReservation> mTfReservations; // accepted, not yet built
+  std::uint64_t mReservedMemory = 0;
+  std::uint64_t mReceivedMemory = 0; // STFs of TFs not yet built
+  std::uint64_t mBufferedMemory = 0;
+  std::atomic_uint64_t mFreeContiguousMemory = 0; // updated with the memory stats
+  // free region memory not reserved by accepted TFs
+  std::uint64_t availableMemory() const;
   // Update information for the TfScheduler
-  std::uint64_t mBufferSize = 0;
-  std::uint64_t mCurrentTfBufferSize = 0;
+  std::uint64_t mLastAcceptedTfId = 0;
   std::uint64_t mLastBuiltTfId = 0;
   std::uint32_t mNumBufferedTfs = 0;
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> mBuiltTfsSinceUpdate; // <tf id, size>
+  std::vector<std::uint64_t> mAcceptedTfsSinceUpdate;
 
   /// Queue of TF building requests
   std::unique_ptr<ConcurrentFifo<TfBuildingInformation>> mTfBuildRequests;
+
+  /// STF request credits: bytes and STFs requested from StfSenders, but not yet received
+  bool acquireStfCredit(const std::uint64_t pTfId, const std::uint64_t pStfSize);
+  std::mutex mStfCreditLock;
+    std::condition_variable mStfCreditCond;
+    std::uint64_t mStfRequestWindow = 0; // 0: limited only by the free memory
+    std::uint64_t mStfCreditsOutstanding = 0;
+    std::uint64_t mStfsOutstanding = 0;
+    std::unordered_map<std::uint64_t, std::tuple<std::uint64_t, std::uint32_t>> mTfCredits; // <bytes, stfs>
+
+  /// Incomplete TFs: <tf id, number of STFs>
+  std::mutex mIncompleteTfsLock;
+  std::unordered_map<std::uint64_t, std::uint32_t> mIncompleteTfs;
 };
 
 } /* namespace o2::DataDistribution */
@@ -16,6 +16,7 @@
 #include <SubTimeFrameFileSink.h>
 #include <Config.h>
 #include <FmqUtilities.h>
+#include <MemoryUtils.h>
 
 #include <options/FairMQProgOptions.h>
 #include <fairmq/DeviceRunner.h>
@@ -49,19 +50,57 @@ int main(int argc, char* argv[])
         "Standalone operation. TimeFrames will not be forwarded to other processes.")(
         o2::DataDistribution::TfBuilderDevice::OptionKeyTfMemorySize,
         bpo::value<std::uint64_t>()->default_value(1024),
-        "Memory buffer reserved for building and buffering TimeFrames (in MiB).");
+        "Memory buffer reserved for building and buffering TimeFrames (in MiB).")(
+        o2::DataDistribution::TfBuilderDevice::OptionKeyStfSenderChannels,
+        bpo::value<std::uint32_t>()->default_value(1),
+        "Number of input channels per StfSender. STFs are striped across the channels by the StfSender.")(
+        o2::DataDistribution::TfBuilderDevice::OptionKeyStfFullValidation,
+        bpo::bool_switch()->default_value(false),
+        "Fully validate every received STF header (debugging). By default, STFs of the same protocol version "
+        "are deserialized on the fast path.")(
+        o2::DataDistribution::TfBuilderDevice::OptionKeyStfVerifyChecksums,
+        bpo::bool_switch()->default_value(false),
+        "Verify the CRC32C checksums of received STF payloads (sent by StfSenders with DATADIST_STFS_CHECKSUM). "
+        "STFs with checksum errors are rejected.")(
+        o2::DataDistribution::TfBuilderDevice::OptionKeyStfTransport,
+        bpo::value<std::string>()->default_value("zeromq"),
+        "Transport of STF data from StfSenders: 'zeromq' (tcp) or 'ofi' (libfabric, for RDMA capable fabrics). "
+        "StfSenders select the transport from the advertised endpoints.")(
+        o2::DataDistribution::TfBuilderDevice::OptionKeyStfDeserializerThreads,
+        bpo::value<std::uint32_t>()->default_value(1),
+        "Number of STF deserializing threads. StfSenders are distributed over the threads.")(
+        o2::DataDistribution::TfBuilderDevice::OptionKeyTfAssemblyTimeout,
+        bpo::value<std::uint64_t>()->default_value(5000),
+        "Timeout for receiving all STFs of a TimeFrame, from the first received STF (in ms). 0 to disable.")(
+        o2::DataDistribution::TfBuilderDevice::OptionKeyForwardPartialTfs,
+        bpo::bool_switch()->default_value(false),
+        "Forward TimeFrames which timed out with the received STFs. By default they are dropped.")(
+        o2::DataDistribution::TfBuilderDevice::OptionKeyStfRequestWindow,
+        bpo::value<std::uint64_t>()->default_value(0),
+        "Maximum size of requested STFs not yet received (in MiB). STF requests are always limited by the free "
+        "TimeFrame memory. 0 for no additional limit.")(
+        o2::DataDistribution::TfBuilderDevice::OptionKeyInputBusyPollUs,
+        bpo::value<std::uint64_t>()->default_value(0),
+        "Busy-poll the StfSender channels for up to the given time (us) before blocking in receive. Lowers the "
+        "latency at the cost of a fully used core per channel; pin the input threads with DATADIST_THREAD_PLACEMENT. "
+        "0 for blocking receive.");
 
       bpo::options_description lTfBuilderDplOptions("TfBuilder DPL options", 120);
       lTfBuilderDplOptions.add_options()(
         o2::DataDistribution::TfBuilderDevice::OptionKeyDplChannelName,
         bpo::value<std::string>()->default_value(""),
-        "Name of the DPL output channel.");
+        "Name of the DPL output channel. Multiple comma separated channels can be used for independent workflows.")(
+        o2::DataDistribution::TfBuilderDevice::OptionKeyDplChannelPolicy,
+        bpo::value<std::string>()->default_value("round-robin"),
+        "Selection of the DPL output channel for TimeFrames: 'round-robin' or 'least-outstanding'.");
 
       r.fConfig.AddToCmdLineOptions(lTfBuilderOptions);
       r.fConfig.AddToCmdLineOptions(lTfBuilderDplOptions);
 
       // Add options for TF file sink
       r.fConfig.AddToCmdLineOptions(o2::DataDistribution::SubTimeFrameFileSink::getProgramOptions());
+      // Add options for shared memory regions
+      r.fConfig.AddToCmdLineOptions(o2::DataDistribution::MemoryResources::getProgramOptions());
       // Add options for Data Distribution discovery
       r.fConfig.AddToCmdLineOptions(o2::DataDistribution::Config::getProgramOptions(o2::DataDistribution::ProcessType::TfBuilder));
 
@@ -28,17 +28,22 @@ namespace DataDistribution
 
 using namespace std::chrono_literals;
 
-std::size_t TfSchedulerConnManager::checkStfSenders()
+namespace {
+
+// wait for all started calls of the completion queue. Calls complete on their deadline at the latest
+void awaitAsyncCalls(grpc::CompletionQueue &pCq, const std::size_t pNumCalls)
 {
-  std::size_t lReadyCnt = 0;
-  for (const auto &lId : mPartitionInfo.mStfSenderIdList) {
-    // this will attempt reconnection on existing connections
-    if (checkStfSenderRpcConn(lId)) {
-      lReadyCnt++;
+  void *lTag = nullptr;
+  bool lOk = false;
+  for (std::size_t i = 0; i < pNumCalls; i++) {
+    if (!pCq.Next(&lTag, &lOk)) {
+      break;
     }
   }
+  pCq.Shutdown();
+  while (pCq.Next(&lTag, &lOk)) { }
+}
 
-  return lReadyCnt;
 }
 
 void TfSchedulerConnManager::connectTfBuilder(const TfBuilderConfigStatus &pTfBuilderStatus, TfBuilderConnectionResponse &pResponse /*out*/)
@@ -54,110 +59,163 @@ void TfSchedulerConnManager::connectTfBuilder(const TfBuilderConfigStatus &pTfBu
     return;
   }
 
-  std::scoped_lock lLock(mStfSenderClientsLock);
+  // bookkeeping only under the lock, the StfSenders are contacted without it
+  std::vector<std::pair<std::string, std::shared_ptr<StfSenderRpcClient>>> lStfSenders;
+  {
+    std::scoped_lock lLock(mStfSenderClientsLock);
 
-  if (!stfSendersReady()) {
-    IDDLOG("TfBuilder Connection error: StfSenders not ready.");
-    pResponse.set_status(ERROR_STF_SENDERS_NOT_READY);
-    return;
-  }
+    if (!stfSendersReady()) {
+      IDDLOG("TfBuilder Connection error: StfSenders not ready.");
+      pResponse.set_status(ERROR_STF_SENDERS_NOT_READY);
+      return;
+    }
 
-  // Open the gRPC connection to the new TfBuilder
-  if (!newTfBuilderRpcClient(lTfBuilderId)) {
-    WDDLOG("TfBuilder gRPC connection error: Cannot open the gRPC connection. tfb_id={}", lTfBuilderId);
-    pResponse.set_status(ERROR_GRPC_TF_BUILDER);
-    return;
+    // Open the gRPC connection to the new TfBuilder
+    if (!newTfBuilderRpcClient(lTfBuilderId)) {
+      WDDLOG("TfBuilder gRPC connection error: Cannot open the gRPC connection. tfb_id={}", lTfBuilderId);
+      pResponse.set_status(ERROR_GRPC_TF_BUILDER);
+      return;
+    }
+
+    lStfSenders = mStfSenderRpcClients.snapshot();
   }
 
-  // send message to all StfSenders to connect
-  bool lConnectionsOk = true;
-  pResponse.set_status(OK);
+  // send message to all StfSenders to connect, concurrently. Endpoints are assigned in StfSender id order
+  const auto lStart = std::chrono::steady_clock::now();
+  grpc::CompletionQueue lCq;
+  std::vector<std::unique_ptr<ConnectTfBuilderAsyncCall>> lCalls;
+  lCalls.reserve(lStfSenders.size());
 
-  TfBuilderEndpoint lParam;
-  lParam.set_tf_builder_id(lTfBuilderId);
-  std::uint32_t lEndpointIdx = 0;
-  for (auto &[lStfSenderId, lRpcClient] : mStfSenderRpcClients) {
+  for (std::uint32_t lEndpointIdx = 0; lEndpointIdx < lStfSenders.size(); lEndpointIdx++) {
+    auto &[lStfSenderId, lRpcClient] = lStfSenders[lEndpointIdx];
 
+    TfBuilderEndpoint lParam;
+    lParam.set_tf_builder_id(lTfBuilderId);
     lParam.set_endpoint(pTfBuilderStatus.sockets().map().at(lEndpointIdx).endpoint());
 
-    ConnectTfBuilderResponse lResponse;
-    if(!lRpcClient->ConnectTfBuilderRequest(lParam, lResponse).ok()) {
-      EDDLOG("TfBuilder Connection error: gRPC error when connecting StfSender. stfs_id={} tfb_id={}",
-        lStfSenderId, lTfBuilderId);
-      pResponse.set_status(ERROR_GRPC_STF_SENDER);
+    auto lCall = std::make_unique<ConnectTfBuilderAsyncCall>();
+    lCall->mStfSenderId = lStfSenderId;
+    lCall->mEndpointIdx = lEndpointIdx;
+    lRpcClient->ConnectTfBuilderRequestAsync(lParam, lCall.get(), &lCq, cStfSenderRpcDeadline);
+    lCalls.push_back(std::move(lCall));
+  }
+  awaitAsyncCalls(lCq, lCalls.size());
+
+  // aggregate: the first failure (in endpoint order) is returned
+  bool lConnectionsOk = true;
+  pResponse.set_status(OK);
+  std::vector<StfSenderDisconnect> lConnected;
+
+  for (const auto &lCall : lCalls) {
+    if (!lCall->mStatus.ok()) {
+      EDDLOG("TfBuilder Connection error: gRPC error when connecting StfSender. stfs_id={} tfb_id={} code={} error={}",
+        lCall->mStfSenderId, lTfBuilderId, lCall->mStatus.error_code(), lCall->mStatus.error_message());
+      if (lConnectionsOk) {
+        pResponse.set_status(ERROR_GRPC_STF_SENDER);
+      }
       lConnectionsOk = false;
-      break;
+      continue;
     }
 
     // check StfSender status
-    if (lResponse.status() != OK) {
-      EDDLOG("TfBuilder Connection error: cannot connect. stfs_id={} tfb_id={}", lStfSenderId, lTfBuilderId);
-      pResponse.set_status(lResponse.status());
+    if (lCall->mResponse.status() != OK) {
+      EDDLOG("TfBuilder Connection error: cannot connect. stfs_id={} tfb_id={}", lCall->mStfSenderId, lTfBuilderId);
+      if (lConnectionsOk) {
+        pResponse.set_status(lCall->mResponse.status());
+      }
       lConnectionsOk = false;
-      break;
+      continue;
     }
 
+    lConnected.push_back({ lCall->mStfSenderId, lStfSenders[lCall->mEndpointIdx].second,
+      pTfBuilderStatus.sockets().map().at(lCall->mEndpointIdx).endpoint() });
+
     // save connection for response
     auto &lConnMap = *(pResponse.mutable_connection_map());
-    lConnMap[lEndpointIdx] = lStfSenderId;
-
-    lEndpointIdx++;
+    lConnMap[lCall->mEndpointIdx] = lCall->mStfSenderId;
   }
 
+  DDDLOG("connectTfBuilder: StfSenders contacted. tfb_id={} num_stfs={} ok={} time_ms={}", lTfBuilderId,
+    lStfSenders.size(), lConnectionsOk, std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - lStart).count());
+
   if (! lConnectionsOk) {
-    StatusResponse lResponse;
-    // remove all existing connection
-    disconnectTfBuilder(pTfBuilderStatus, lResponse);
+    // remove all connections that were made
+    pResponse.clear_connection_map();
+    deleteTfBuilderRpcClient(lTfBuilderId);
+    disconnectStfSenders(lTfBuilderId, lConnected);
   }
 }
 
+std::uint32_t TfSchedulerConnManager::disconnectStfSenders(const std::string &pTfBuilderId,
+  const std::vector<StfSenderDisconnect> &pStfSenders)
+{
+  std::uint32_t lStatus = 0;
+
+  grpc::CompletionQueue lCq;
+  std::vector<std::unique_ptr<DisconnectTfBuilderAsyncCall>> lCalls;
+  lCalls.reserve(pStfSenders.size());
+
+  for (const auto &lStfSender : pStfSenders) {
+    TfBuilderEndpoint lParam;
+    lParam.set_tf_builder_id(pTfBuilderId);
+    lParam.set_endpoint(lStfSender.mEndpoint);
+
+    auto lCall = std::make_unique<DisconnectTfBuilderAsyncCall>();
+    lCall->mStfSenderId = lStfSender.mStfSenderId;
+    lStfSender.mClient->DisconnectTfBuilderRequestAsync(lParam, lCall.get(), &lCq, cStfSenderRpcDeadline);
+    lCalls.push_back(std::move(lCall));
+  }
+  awaitAsyncCalls(lCq, lCalls.size());
+
+  for (const auto &lCall : lCalls) {
+    if (!lCall->mStatus.ok()) {
+      EDDLOG("StfSender Connection error: gRPC error. stfs_id={} tfb_id={} code={} error={}",
+        lCall->mStfSenderId, pTfBuilderId, lCall->mStatus.error_code(), lCall->mStatus.error_message());
+      lStatus = lStatus ? lStatus : ERROR_GRPC_STF_SENDER;
+      continue;
+    }
+    // check StfSender status
+    if (lCall->mResponse.status() != 0) {
+      EDDLOG("TfBuilder Connection error. stfs_id={} tfb_id={} response={}",
+        lCall->mStfSenderId, pTfBuilderId, lCall->mResponse.status());
+      lStatus = lStatus ? lStatus : ERROR_STF_SENDER_CONNECTING;
+    }
+  }
+
+  return lStatus;
+}
+
 void TfSchedulerConnManager::disconnectTfBuilder(const TfBuilderConfigStatus &pTfBuilderStatus, StatusResponse &pResponse /*out*/)
 {
   pResponse.set_status(0);
   const std::string &lTfBuilderId = pTfBuilderStatus.info().process_id();
 
+  std::vector<StfSenderDisconnect> lStfSenders;
   {
     std::scoped_lock lLock(mStfSenderClientsLock);
     deleteTfBuilderRpcClient(lTfBuilderId);
-  }
-
-  TfBuilderEndpoint lParam;
 
-  for (const auto &[lTfBuilderSocketIdx, lSocketInfo] : pTfBuilderStatus.sockets().map()) {
-    (void) lTfBuilderSocketIdx;
+    for (const auto &[lTfBuilderSocketIdx, lSocketInfo] : pTfBuilderStatus.sockets().map()) {
+      (void) lTfBuilderSocketIdx;
 
-    const auto &lStfSenderId = lSocketInfo.peer_id();
+      const auto &lStfSenderId = lSocketInfo.peer_id();
 
-    if (lStfSenderId.empty()) {
-      continue; // not connected
-    }
-
-    { // lock clients
-      std::scoped_lock lLock(mStfSenderClientsLock);
+      if (lStfSenderId.empty()) {
+        continue; // not connected
+      }
 
-      if (mStfSenderRpcClients.count(lStfSenderId) == 0) {
+      auto lRpcClient = mStfSenderRpcClients.get(lStfSenderId);
+      if (!lRpcClient) {
         WDDLOG("disconnectTfBuilder: Unknown StfSender. stfs_id={}", lStfSenderId);
         continue;
       }
 
-      lParam.set_tf_builder_id(lTfBuilderId);
-      lParam.set_endpoint(lSocketInfo.endpoint());
-      StatusResponse lResponse;
-
-      auto &lRpcClient = mStfSenderRpcClients[lSocketInfo.peer_id()];
-      if(!lRpcClient->DisconnectTfBuilderRequest(lParam, lResponse).ok()) {
-        EDDLOG("StfSender Connection error: gRPC error. stfs_id={} tfb_id={}", lStfSenderId, lTfBuilderId);
-        pResponse.set_status(ERROR_GRPC_STF_SENDER);
-        continue;
-      }
-      // check StfSender status
-      if (lResponse.status() != 0) {
-        EDDLOG("TfBuilder Connection error. stfs_id={} tfb_id={} response={}", lStfSenderId, lTfBuilderId, lResponse.status());
-        pResponse.set_status(ERROR_STF_SENDER_CONNECTING);
-        continue;
-      }
+      lStfSenders.push_back({ lStfSenderId, std::move(lRpcClient), lSocketInfo.endpoint() });
     }
   }
+
+  pResponse.set_status(disconnectStfSenders(lTfBuilderId, lStfSenders));
 }
 
 // Partition RPC: keep sending until all TfBuilders are gone
@@ -166,9 +224,9 @@ bool TfSchedulerConnManager::requestTfBuildersTerminate() {
 
   std::scoped_lock lLock(mStfSenderClientsLock);
 
-  for (auto &lTfBuilder : mTfBuilderRpcClients) {
-    if (!lTfBuilder.second.mClient->TerminatePartition()) {
-      lFailedRpcsForDeletion.push_back(lTfBuilder.first);
+  for (const auto &[lId, lClient] : *mTfBuilderRpcClients.snapshot()) {
+    if (!lClient->TerminatePartition()) {
+      lFailedRpcsForDeletion.push_back(lId);
     }
   }
 
@@ -201,33 +259,22 @@ bool TfSchedulerConnManager::requestStfSendersTerminate() {
 
 void TfSchedulerConnManager::removeTfBuilder(const std::string &pTfBuilderId)
 {
-  std::scoped_lock lLock(mStfSenderClientsLock);
-
-  // Stop talking to TfBuilder
-  deleteTfBuilderRpcClient(pTfBuilderId);
-
-  DDDLOG("TfBuilder RpcClient deleted. tfb_id={}", pTfBuilderId);
-
-  // Tell all StfSenders to disconnect
-  TfBuilderEndpoint lParam;
-  lParam.set_tf_builder_id(pTfBuilderId);
+  std::vector<StfSenderDisconnect> lStfSenders;
+  {
+    std::scoped_lock lLock(mStfSenderClientsLock);
 
-  for (auto &lStfSenderIdCli : mStfSenderRpcClients) {
-    const auto &lStfSenderId = lStfSenderIdCli.first;
-    auto &lStfSenderRpcCli = lStfSenderIdCli.second;
+    // Stop talking to TfBuilder
+    deleteTfBuilderRpcClient(pTfBuilderId);
 
-    StatusResponse lResponse;
-    if(!lStfSenderRpcCli->DisconnectTfBuilderRequest(lParam, lResponse).ok()) {
-      EDDLOG("TfBuilder Connection error: gRPC error when connecting StfSender. stfs_id={} tfb_id={}",
-        lStfSenderId, pTfBuilderId);
-    }
+    DDDLOG("TfBuilder RpcClient deleted. tfb_id={}", pTfBuilderId);
 
-    // check StfSender status
-    if (lResponse.status() != 0) {
-      EDDLOG("DisconnectTfBuilderRequest failed. stfs_id={} tfb_id={} response={}",
-        lStfSenderId, pTfBuilderId, lResponse.status());
+    for (auto &[lStfSenderId, lRpcClient] : mStfSenderRpcClients.snapshot()) {
+      lStfSenders.push_back({ lStfSenderId, lRpcClient, "" /* all endpoints */ });
     }
   }
+
+  // Tell all StfSenders to disconnect
+  disconnectStfSenders(pTfBuilderId, lStfSenders);
 }
 
 void TfSchedulerConnManager::dropAllStfsAsync(const std::uint64_t pStfId)
@@ -309,26 +356,101 @@ void TfSchedulerConnManager::DropWaitThread()
   DDDLOG("Exiting DropWaitThread thread.");
 }
 
+std::size_t TfSchedulerConnManager::probeStfSenders(std::map<std::string, StfSenderProbeState> &pStates)
+{
+  const auto lNow = std::chrono::steady_clock::now();
+
+  grpc::CompletionQueue lCq;
+  // clients must outlive the calls in flight
+  std::vector<std::shared_ptr<StfSenderRpcClient>> lClients;
+  std::vector<std::unique_ptr<HealthProbeAsyncCall>> lCalls;
+  // <stfs_id, ok, error>
+  std::vector<std::tuple<std::string, bool, std::string>> lResults;
+
+  for (const auto &[lId, lState] : pStates) {
+    if (lState.mNextProbe > lNow) {
+      continue;
+    }
+
+    auto lClient = mStfSenderRpcClients.get(lId);
+    if (!lClient) {
+      lResults.emplace_back(lId, false, "no gRPC client");
+      continue;
+    }
+
+    auto &lCall = lCalls.emplace_back(std::make_unique<HealthProbeAsyncCall>());
+    lCall->mStfSenderId = lId;
+    lClient->HealthProbeAsync(lCall.get(), &lCq, cStfSenderProbeDeadline);
+    lClients.push_back(std::move(lClient));
+  }
+
+  awaitAsyncCalls(lCq, lCalls.size());
+
+  for (const auto &lCall : lCalls) {
+    const bool lOk = lCall->mStatus.ok() && lCall->mResponse.status() == 0;
+    lResults.emplace_back(lCall->mStfSenderId, lOk, lCall->mStatus.ok() ?
+      fmt::format("status={}", lCall->mResponse.status()) : lCall->mStatus.error_message());
+  }
+
+  for (const auto &[lId, lOk, lError] : lResults) {
+    auto &lState = pStates[lId];
+
+    if (lOk) {
+      if (!lState.mAlive) {
+        IDDLOG("StfSender is reachable again. stfs_id={} failed_probes={}", lId, lState.mFailures);
+      }
+      lState.mFailures = 0;
+      lState.mNextProbe = lNow + cStfSenderProbeInterval;
+    } else {
+      if (lState.mAlive) {
+        WDDLOG("StfSender health probe failed. Excluding the StfSender from scheduling. stfs_id={} error={}", lId, lError);
+      }
+      // back off exponentially while the StfSender stays unreachable
+      lState.mFailures++;
+      lState.mNextProbe = lNow + std::min(std::chrono::milliseconds(cStfSenderProbeInterval *
+        (1u << std::min(lState.mFailures, 5u))), cStfSenderProbeMaxBackoff);
+    }
+
+    if (lState.mAlive != lOk) {
+      lState.mAlive = lOk;
+
+      std::scoped_lock lLock(mStfSenderStateCbLock);
+      if (mStfSenderStateCb) {
+        mStfSenderStateCb(lId, lOk);
+      }
+    }
+  }
+
+  return std::count_if(pStates.cbegin(), pStates.cend(), [](const auto &pState) { return pState.second.mAlive; });
+}
+
 void TfSchedulerConnManager::StfSenderMonitoringThread()
 {
   DDDLOG("Starting StfSender gRPC Monitoring thread.");
 
+  std::map<std::string, StfSenderProbeState> lProbeStates;
+  for (const auto &lId : mPartitionInfo.mStfSenderIdList) {
+    lProbeStates[lId] = StfSenderProbeState();
+  }
+
   while (mRunning) {
-    std::chrono::milliseconds lSleep = 1000ms;
+    const auto lRoundStart = std::chrono::steady_clock::now();
 
-    // make sure all StfSenders are alive
-    const std::uint32_t lNumStfSenders = checkStfSenders();
+    // make sure all StfSenders are alive. Probes are concurrent, a round takes at most the probe deadline
+    const std::size_t lNumStfSenders = probeStfSenders(lProbeStates);
     if (lNumStfSenders < mPartitionInfo.mStfSenderIdList.size()) {
 
       mStfSenderState = STF_SENDER_STATE_INCOMPLETE;
 
       WDDLOG_RL(1000, "Waiting for StfSenders. ready={} total={}", lNumStfSenders, mPartitionInfo.mStfSenderIdList.size());
-      lSleep = 250ms;
     } else {
+      if (mStfSenderState != STF_SENDER_STATE_OK) {
+        notifyStfSendersReady();
+      }
       mStfSenderState = STF_SENDER_STATE_OK;
     }
 
-    std::this_thread::sleep_for(lSleep);
+    std::this_thread::sleep_until(lRoundStart + cStfSenderProbeInterval);
   }
 
   DDDLOG("Exiting StfSender RPC Monitoring thread.");
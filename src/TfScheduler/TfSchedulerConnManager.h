@@ -32,6 +32,9 @@
 #include <thread>
 #include <list>
 #include <future>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
 
 namespace o2::DataDistribution
 {
@@ -64,6 +67,7 @@ class TfSchedulerConnManager
     }
 
     mRunning = true;
+    notifyStfSendersReady();
 
     // start gRPC client monitoring thread
     mStfSenderMonitoringThread = create_thread_member("sched_stfs_mon",
@@ -92,10 +96,15 @@ class TfSchedulerConnManager
     mStfSenderRpcClients.stop();
   }
 
-  std::size_t checkStfSenders();
-
   bool stfSendersReady() { return mStfSenderRpcClients.size() == mPartitionInfo.mStfSenderIdList.size(); }
 
+  /// wait until all StfSender clients are ready, or timeout (TfBuilder startup notifications)
+  bool waitStfSendersReady(const std::chrono::milliseconds pTimeout)
+  {
+    std::unique_lock lLock(mStfSendersReadyLock);
+    return mStfSendersReadyCV.wait_for(lLock, pTimeout, [this]() { return mRunning && stfSendersReady(); });
+  }
+
   std::set<std::string> getStfSenderSet() const
   {
     std::set<std::string> lSet;
@@ -117,6 +126,22 @@ class TfSchedulerConnManager
   /// Internal request, disconnect on error
   void removeTfBuilder(const std::string &pTfBuilderId);
 
+  /// Deadline of each StfSender (dis)connect request. The requests are issued concurrently
+  static constexpr std::chrono::milliseconds cStfSenderRpcDeadline = std::chrono::seconds(5);
+
+  /// StfSender health probes: interval, deadline of each probe, and the longest backoff of failing StfSenders
+  static constexpr std::chrono::milliseconds cStfSenderProbeInterval = std::chrono::milliseconds(500);
+  static constexpr std::chrono::milliseconds cStfSenderProbeDeadline = std::chrono::milliseconds(400);
+  static constexpr std::chrono::milliseconds cStfSenderProbeMaxBackoff = std::chrono::seconds(8);
+
+  /// Called by the monitoring thread when a StfSender becomes unreachable, or reachable again
+  using StfSenderStateCallback = std::function<void(const std::string &pStfSenderId, const bool pAlive)>;
+  void setStfSenderStateCallback(StfSenderStateCallback pCallback)
+  {
+    std::scoped_lock lLock(mStfSenderStateCbLock);
+    mStfSenderStateCb = std::move(pCallback);
+  }
+
   /// Drop all SubTimeFrames (in case they can't be scheduled)
   void dropAllStfsAsync(const std::uint64_t pStfId);
 
@@ -149,6 +174,25 @@ class TfSchedulerConnManager
   std::size_t getStfSenderCount() const { return mStfSenderRpcClients.size(); }
 
 private:
+  struct StfSenderDisconnect {
+    std::string mStfSenderId;
+    std::shared_ptr<StfSenderRpcClient> mClient;
+    std::string mEndpoint;
+  };
+  /// Disconnect the TfBuilder from all given StfSenders concurrently. Returns the status of the first error
+  std::uint32_t disconnectStfSenders(const std::string &pTfBuilderId, const std::vector<StfSenderDisconnect> &pStfSenders);
+
+  struct StfSenderProbeState {
+    bool mAlive = true; // all StfSenders are connected when monitoring starts
+    std::uint32_t mFailures = 0;
+    std::chrono::steady_clock::time_point mNextProbe;
+  };
+  /// Probe all due StfSenders concurrently. Returns the number of reachable StfSenders
+  std::size_t probeStfSenders(std::map<std::string, StfSenderProbeState> &pStates);
+
+  std::mutex mStfSenderStateCbLock;
+    StfSenderStateCallback mStfSenderStateCb;
+
   /// Partition information
   PartitionRequest mPartitionInfo;
 
@@ -159,13 +203,20 @@ private:
   std::shared_ptr<ConsulTfSchedulerInstance> mDiscoveryConfig;
 
   /// Scheduler threads
-  bool mRunning = false;
+  std::atomic_bool mRunning = false;
   std::thread mStfSenderMonitoringThread;
   std::thread mDropFutureWaitThread;
 
   /// StfSender RPC-client channels
   std::recursive_mutex mStfSenderClientsLock;
     StfSenderRpcClientCollection<ConsulTfSchedulerInstance> mStfSenderRpcClients;
+  /// StfSender readiness notification
+  std::mutex mStfSendersReadyLock;
+  std::condition_variable mStfSendersReadyCV;
+  void notifyStfSendersReady() {
+    std::scoped_lock lLock(mStfSendersReadyLock);
+    mStfSendersReadyCV.notify_all();
+  }
   /// TfBuilder RPC-client channels
   TfBuilderRpcClientCollection<ConsulTfSchedulerInstance> mTfBuilderRpcClients;
 
@@ -55,6 +55,9 @@ TfSchedulerInstanceHandler::TfSchedulerInstanceHandler(DataDistDevice& pDev,
 
   mDiscoveryConfig->write();
 
+  // StfSender and TfBuilder discovery data is read from the cache
+  mDiscoveryConfig->startWatch();
+
   DDDLOG("Initialized new TfSchedulerInstance. partition={}", mPartitionInfo.mPartitionId);
 }
 
@@ -49,11 +49,23 @@ void TfSchedulerInstanceRpcImpl::start()
   // start StfInfo database
   mStfInfo.start();
 
+  if (auto lWatch = mDiscoveryConfig->watch()) {
+    lWatch->addCallback([](const std::string &pKey, const std::string *pValue) {
+      static const std::string sStfSenderKey = "/StfSender/";
+      const auto lPos = pKey.find(sStfSenderKey);
+      if (!pValue && lPos != std::string::npos) {
+        WDDLOG("StfSender removed its discovery entry. stfs_id={}", pKey.substr(lPos + sStfSenderKey.size()));
+      }
+    });
+  }
+
   // start all client gRPC channels
   // This can block, waiting to connect to all StfSenders.
-  // We have to loop and check if we should bail on Terminate request
+  // We have to loop and check if we should bail on Terminate request.
+  // Retry as soon as StfSenders register in the discovery.
+  std::uint64_t lDiscoveryIndex = 0;
   while (accepting_updates() && !mConnManager.start()) {
-    std::this_thread::sleep_for(500ms);
+    mDiscoveryConfig->waitForUpdate(lDiscoveryIndex, 500ms);
   }
 }
 
@@ -257,6 +269,45 @@ void TfSchedulerInstanceRpcImpl::PartitionMonitorThread()
   return Status::OK;
 }
 
+::grpc::Status TfSchedulerInstanceRpcImpl::PartitionReadyStream(::grpc::ServerContext* context,
+  const ::o2::DataDistribution::PartitionInfo* /*request*/,
+  ::grpc::ServerWriter<::o2::DataDistribution::PartitionReadyNotification>* writer)
+{
+  DDDLOG("gRPC server: PartitionReadyStream");
+
+  PartitionReadyNotification lNotification;
+  lNotification.set_num_stf_senders(mPartitionInfo.mStfSenderIdList.size());
+
+  // progress is sent every second, the final status as soon as it is known
+  auto lLastProgress = std::chrono::steady_clock::now() - 1s;
+
+  while (!context->IsCancelled()) {
+    if (!accepting_updates()) {
+      lNotification.set_status(TfBuilderConnectionStatus::ERROR_PARTITION_TERMINATING);
+      writer->Write(lNotification);
+      return Status::OK;
+    }
+
+    if (mConnManager.waitStfSendersReady(100ms)) {
+      lNotification.set_status(TfBuilderConnectionStatus::OK);
+      lNotification.set_num_stf_senders_ready(mConnManager.getStfSenderCount());
+      writer->Write(lNotification);
+      return Status::OK;
+    }
+
+    if (std::chrono::steady_clock::now() - lLastProgress >= 1s) {
+      lLastProgress = std::chrono::steady_clock::now();
+      lNotification.set_status(TfBuilderConnectionStatus::ERROR_STF_SENDERS_NOT_READY);
+      lNotification.set_num_stf_senders_ready(mConnManager.getStfSenderCount());
+      if (!writer->Write(lNotification)) {
+        break; // client is gone
+      }
+    }
+  }
+
+  return Status::CANCELLED;
+}
+
 ::grpc::Status TfSchedulerInstanceRpcImpl::TfBuilderUpdate(::grpc::ServerContext* /*context*/,
   const ::o2::DataDistribution::TfBuilderUpdateMessage* request, ::google::protobuf::Empty* /*response*/)
 {
@@ -295,5 +346,43 @@ void TfSchedulerInstanceRpcImpl::PartitionMonitorThread()
   return Status::OK;
 }
 
+::grpc::Status TfSchedulerInstanceRpcImpl::StfSenderStfUpdateBatch(::grpc::ServerContext* /*context*/,
+  const ::o2::DataDistribution::StfSenderStfInfoBatch* request,
+  ::o2::DataDistribution::SchedulerStfInfoBatchResponse* response)
+{
+  static std::atomic_uint64_t sStfUpdates = 0;
+
+  response->Clear();
+
+  if (!accepting_updates()) {
+    for (int i = 0; i < request->stfs_size(); i++) {
+      response->add_status(SchedulerStfInfoResponse::DROP_NOT_RUNNING);
+    }
+    return Status::OK;
+  }
+
+  sStfUpdates += request->stfs_size();
+  DDLOGF_GRL(3000, DataDistSeverity::debug, "gRPC server: StfSenderStfUpdateBatch. stfs_id={} batch_size={} total={}",
+    request->info().process_id(), request->stfs_size(), sStfUpdates);
+
+  // the shared part of the info is copied once for the batch
+  StfSenderStfInfo lStfInfo;
+  lStfInfo.mutable_info()->CopyFrom(request->info());
+  lStfInfo.mutable_partition()->CopyFrom(request->partition());
+  lStfInfo.mutable_stfs_info()->CopyFrom(request->stfs_info());
+
+  SchedulerStfInfoResponse lResponse;
+  for (const auto &lStf : request->stfs()) {
+    lStfInfo.set_stf_id(lStf.stf_id());
+    lStfInfo.set_stf_size(lStf.stf_size());
+
+    lResponse.Clear();
+    mStfInfo.addStfInfo(lStfInfo, lResponse /*out*/);
+    response->add_status(lResponse.status());
+  }
+
+  return Status::OK;
+}
+
 
 } /* o2::DataDistribution */
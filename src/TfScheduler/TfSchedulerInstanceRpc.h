@@ -60,9 +60,11 @@ class TfSchedulerInstanceRpcImpl final : public TfSchedulerInstanceRpc::Service
   ::grpc::Status NumStfSendersInPartitionRequest(::grpc::ServerContext* context, const ::google::protobuf::Empty* request, ::o2::DataDistribution::NumStfSendersInPartitionResponse* response) override;
   ::grpc::Status TfBuilderConnectionRequest(::grpc::ServerContext* context, const ::o2::DataDistribution::TfBuilderConfigStatus* request, ::o2::DataDistribution::TfBuilderConnectionResponse* response) override;
   ::grpc::Status TfBuilderDisconnectionRequest(::grpc::ServerContext* context, const ::o2::DataDistribution::TfBuilderConfigStatus* request, ::o2::DataDistribution::StatusResponse* response) override;
+  ::grpc::Status PartitionReadyStream(::grpc::ServerContext* context, const ::o2::DataDistribution::PartitionInfo* request, ::grpc::ServerWriter<::o2::DataDistribution::PartitionReadyNotification>* writer) override;
 
   ::grpc::Status TfBuilderUpdate(::grpc::ServerContext* context, const ::o2::DataDistribution::TfBuilderUpdateMessage* request, ::google::protobuf::Empty* response) override;
   ::grpc::Status StfSenderStfUpdate(::grpc::ServerContext* context, const ::o2::DataDistribution::StfSenderStfInfo* request, ::o2::DataDistribution::SchedulerStfInfoResponse* response) override;
+  ::grpc::Status StfSenderStfUpdateBatch(::grpc::ServerContext* context, const ::o2::DataDistribution::StfSenderStfInfoBatch* request, ::o2::DataDistribution::SchedulerStfInfoBatchResponse* response) override;
 
 
   void initDiscovery(const std::string pRpcSrvBindIp, int &lRealPort /*[out]*/);
@@ -0,0 +1,328 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/// Offline replay of TF announces against the TfBuilder selection policies
+///
+/// TF announces (synthetic, or recorded as "stf_id,stfs_id,stf_size" lines) are fed to
+/// TfSchedulerTfBuilderInfo in simulated time. TfBuilders are simulated: a scheduled TF occupies
+/// memory until it is processed (FIFO, at a fixed rate per TfBuilder), and TfBuilders send
+/// periodic updates like the real ones. No RPC is involved.
+
+#include "TfSchedulerTfBuilderInfo.h"
+
+#include <DataDistLogger.h>
+
+#include <boost/program_options.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <tuple>
+#include <random>
+#include <queue>
+#include <map>
+#include <vector>
+#include <string>
+#include <cstdlib>
+
+using namespace o2::DataDistribution;
+namespace bpo = boost::program_options;
+
+namespace {
+
+struct ReplayConfig {
+  std::uint64_t mNumTfBuilders = 100;
+  std::uint64_t mTfBuilderMemory = 32ULL << 30;
+  double mProcessingRate = 2.0e9;   // bytes / s per TfBuilder
+  double mTfRate = 88.0;            // TFs / s
+  double mTfSizeMean = 64.0 * (1 << 20);
+  double mTfSizeSigma = 0.2;        // relative
+  double mActualSizeRatio = 1.02;   // built / announced size
+  double mUpdateInterval = 0.05;    // s
+  double mDuration = 60.0;          // s
+  std::uint64_t mNumSegments = 4;
+  std::vector<std::uint64_t> mRecordedTfSizes;
+};
+
+struct SimTfBuilder {
+  std::string mId;
+  std::string mSegment;
+  std::uint64_t mUsedMemory = 0;
+  std::uint64_t mLastBuiltTfId = 0;
+  double mBusyUntil = 0.0;
+  std::deque<std::pair<std::uint64_t, std::uint64_t>> mBuffered; // <tf id, actual size>
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> mBuiltSinceUpdate;
+};
+
+struct ReplayResult {
+  std::uint64_t mTfs = 0;
+  std::uint64_t mScheduled = 0;
+  std::uint64_t mDroppedSched = 0; // no TfBuilder found
+  std::uint64_t mDroppedNoMem = 0; // TfBuilder out of memory (ERROR_NOMEM)
+  std::vector<double> mDecisionNs;
+  double mMemUtilSum = 0.0;
+  std::uint64_t mMemUtilSamples = 0;
+  double mWallSeconds = 0.0;
+};
+
+// sim events: <time, type, tfbuilder index>
+enum EventType { eTfArrival, eTfProcessed, eTfBuilderUpdate };
+using Event = std::tuple<double, EventType, std::size_t>;
+
+TfBuilderUpdateMessage makeUpdate(const ReplayConfig &pConfig, SimTfBuilder &pTfb)
+{
+  TfBuilderUpdateMessage lUpdate;
+  lUpdate.mutable_info()->set_process_id(pTfb.mId);
+  lUpdate.mutable_info()->set_process_state(BasicInfo::RUNNING);
+  lUpdate.mutable_info()->set_last_update_t(std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count());
+  (*lUpdate.mutable_info()->mutable_topology())["switch"] = pTfb.mSegment;
+
+  lUpdate.set_free_memory(pConfig.mTfBuilderMemory - pTfb.mUsedMemory);
+  lUpdate.set_num_buffered_tfs(pTfb.mBuffered.size());
+  lUpdate.set_last_built_tf_id(pTfb.mLastBuiltTfId);
+
+  for (const auto &[lTfId, lTfSize] : pTfb.mBuiltSinceUpdate) {
+    auto lBuiltTf = lUpdate.add_built_tfs();
+    lBuiltTf->set_tf_id(lTfId);
+    lBuiltTf->set_tf_size(lTfSize);
+  }
+  pTfb.mBuiltSinceUpdate.clear();
+  return lUpdate;
+}
+
+ReplayResult runReplay(const ReplayConfig &pConfig, const std::string &pPolicy)
+{
+  ReplayResult lResult;
+
+  setenv("DATADIST_TFSCHED_TFB_POLICY", pPolicy.c_str(), 1);
+  TfSchedulerTfBuilderInfo lTfBuilderInfo(nullptr);
+  lTfBuilderInfo.start();
+
+  std::vector<SimTfBuilder> lTfBuilders(pConfig.mNumTfBuilders);
+  std::unordered_map<std::string, std::size_t> lTfBuilderIdx;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> lEvents;
+
+  for (std::size_t i = 0; i < lTfBuilders.size(); i++) {
+    lTfBuilders[i].mId = fmt::format("tfb-{:04}", i);
+    lTfBuilders[i].mSegment = fmt::format("segment-{}", i % std::max(pConfig.mNumSegments, std::uint64_t(1)));
+    lTfBuilderIdx[lTfBuilders[i].mId] = i;
+
+    lTfBuilderInfo.updateTfBuilderInfo(makeUpdate(pConfig, lTfBuilders[i]));
+    lEvents.emplace(pConfig.mUpdateInterval * double(i) / double(lTfBuilders.size()), eTfBuilderUpdate, i);
+  }
+
+  std::mt19937_64 lGen(42);
+  std::lognormal_distribution<double> lSizeDist(std::log(pConfig.mTfSizeMean), pConfig.mTfSizeSigma);
+  std::exponential_distribution<double> lArrivalDist(pConfig.mTfRate);
+
+  const std::uint64_t lNumTfs = pConfig.mRecordedTfSizes.empty() ?
+    std::uint64_t(pConfig.mDuration * pConfig.mTfRate) : pConfig.mRecordedTfSizes.size();
+  lResult.mDecisionNs.reserve(lNumTfs);
+
+  std::uint64_t lNextTfId = 1;
+  lEvents.emplace(0.0, eTfArrival, 0);
+
+  const auto lWallStart = std::chrono::steady_clock::now();
+
+  while (!lEvents.empty()) {
+    const auto [lTime, lType, lIdx] = lEvents.top();
+    lEvents.pop();
+
+    switch (lType) {
+      case eTfArrival: {
+        const std::uint64_t lTfId = lNextTfId++;
+        const std::uint64_t lTfSize = pConfig.mRecordedTfSizes.empty() ?
+          std::uint64_t(lSizeDist(lGen)) : pConfig.mRecordedTfSizes[lTfId - 1];
+        lResult.mTfs++;
+
+        std::string lTfBuilderId;
+        const auto lDecisionStart = std::chrono::steady_clock::now();
+        const bool lFound = lTfBuilderInfo.findTfBuilderForTf(lTfSize, lTfBuilderId);
+        lResult.mDecisionNs.push_back(std::chrono::duration<double, std::nano>(
+          std::chrono::steady_clock::now() - lDecisionStart).count());
+
+        if (!lFound) {
+          lResult.mDroppedSched++;
+        } else {
+          auto &lTfb = lTfBuilders[lTfBuilderIdx.at(lTfBuilderId)];
+          const std::uint64_t lActualSize = std::uint64_t(double(lTfSize) * pConfig.mActualSizeRatio);
+
+          lTfBuilderInfo.markTfBuilderWithTfId(lTfBuilderId, lTfId, lTfSize);
+
+          if (lTfb.mUsedMemory + lActualSize > pConfig.mTfBuilderMemory) {
+            // ERROR_NOMEM: do not stall the scheduler's estimate updates on the dropped TF
+            lResult.mDroppedNoMem++;
+            lTfb.mLastBuiltTfId = std::max(lTfb.mLastBuiltTfId, lTfId);
+          } else {
+            // TF is built on arrival, processed in order
+            lResult.mScheduled++;
+            lTfb.mUsedMemory += lActualSize;
+            lTfb.mLastBuiltTfId = std::max(lTfb.mLastBuiltTfId, lTfId);
+            lTfb.mBuffered.emplace_back(lTfId, lActualSize);
+            lTfb.mBuiltSinceUpdate.emplace_back(lTfId, lActualSize);
+
+            lTfb.mBusyUntil = std::max(lTfb.mBusyUntil, lTime) + double(lActualSize) / pConfig.mProcessingRate;
+            lEvents.emplace(lTfb.mBusyUntil, eTfProcessed, lTfBuilderIdx.at(lTfBuilderId));
+          }
+        }
+
+        if (lNextTfId <= lNumTfs) {
+          lEvents.emplace(lTime + (pConfig.mRecordedTfSizes.empty() ? lArrivalDist(lGen) : (1.0 / pConfig.mTfRate)),
+            eTfArrival, 0);
+        }
+        break;
+      }
+      case eTfProcessed: {
+        auto &lTfb = lTfBuilders[lIdx];
+        lTfb.mUsedMemory -= lTfb.mBuffered.front().second;
+        lTfb.mBuffered.pop_front();
+        break;
+      }
+      case eTfBuilderUpdate: {
+        auto &lTfb = lTfBuilders[lIdx];
+        lResult.mMemUtilSum += double(lTfb.mUsedMemory) / double(pConfig.mTfBuilderMemory);
+        lResult.mMemUtilSamples++;
+
+        lTfBuilderInfo.updateTfBuilderInfo(makeUpdate(pConfig, lTfb));
+
+        if (lNextTfId <= lNumTfs || !lTfb.mBuffered.empty()) {
+          lEvents.emplace(lTime + pConfig.mUpdateInterval, eTfBuilderUpdate, lIdx);
+        }
+        break;
+      }
+    }
+  }
+
+  lResult.mWallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lWallStart).count();
+  lTfBuilderInfo.stop();
+  return lResult;
+}
+
+void reportResult(const std::string &pPolicy, ReplayResult &pResult)
+{
+  std::sort(pResult.mDecisionNs.begin(), pResult.mDecisionNs.end());
+  const auto lPercentile = [&](const double pPerc) {
+    return pResult.mDecisionNs.empty() ? 0.0 :
+      pResult.mDecisionNs[std::size_t(pPerc / 100.0 * double(pResult.mDecisionNs.size() - 1))];
+  };
+
+  const double lDropped = double(pResult.mDroppedSched + pResult.mDroppedNoMem);
+
+  IDDLOG("Replay result. policy={} tfs={} scheduled={} drop_rate={:.4} drop_no_tfb={} drop_nomem={} "
+    "sched_rate_hz={:.0f} decision_ns.p50={:.0f} decision_ns.p99={:.0f} decision_ns.max={:.0f} mem_util_mean={:.4}",
+    pPolicy, pResult.mTfs, pResult.mScheduled, (pResult.mTfs ? lDropped / double(pResult.mTfs) : 0.0),
+    pResult.mDroppedSched, pResult.mDroppedNoMem, double(pResult.mTfs) / std::max(pResult.mWallSeconds, 1e-9),
+    lPercentile(50.0), lPercentile(99.0), lPercentile(100.0),
+    (pResult.mMemUtilSamples ? pResult.mMemUtilSum / double(pResult.mMemUtilSamples) : 0.0));
+}
+
+bool readRecordedAnnounces(const std::string &pFileName, std::vector<std::uint64_t> &pTfSizes)
+{
+  std::ifstream lFile(pFileName);
+  if (!lFile) {
+    EDDLOG("Cannot open the announce file. file={}", pFileName);
+    return false;
+  }
+
+  // "stf_id,stfs_id,stf_size": the TF size is the sum of its STFs
+  std::map<std::uint64_t, std::uint64_t> lTfSizes;
+  std::string lLine;
+  std::vector<std::string> lFields;
+
+  while (std::getline(lFile, lLine)) {
+    boost::split(lFields, lLine, boost::is_any_of(","));
+    if (lFields.size() != 3) {
+      continue;
+    }
+    try {
+      lTfSizes[std::stoull(lFields[0])] += std::stoull(lFields[2]);
+    } catch (...) {
+      continue; // header line
+    }
+  }
+
+  for (const auto &lTfSize : lTfSizes) {
+    pTfSizes.push_back(lTfSize.second);
+  }
+  IDDLOG("Recorded announces loaded. file={} num_tfs={}", pFileName, pTfSizes.size());
+  return !pTfSizes.empty();
+}
+
+} /* namespace */
+
+int main(int argc, char* argv[])
+{
+  ReplayConfig lConfig;
+  std::string lPolicies;
+  std::string lInputFile;
+  double lTfbMemoryGiB = 0.0;
+  double lTfSizeMiB = 0.0;
+
+  bpo::options_description lOptions("TfScheduler replay options", 120);
+  lOptions.add_options()
+    ("help,h", "Print help")
+    ("policy", bpo::value<std::string>(&lPolicies)->default_value("round-robin,best-fit,least-loaded,weighted,topology"),
+      "Comma separated TfBuilder selection policies to replay.")
+    ("input", bpo::value<std::string>(&lInputFile)->default_value(""),
+      "Recorded StfSender announces (stf_id,stfs_id,stf_size). Synthetic TFs are used if not set.")
+    ("tfbuilders", bpo::value<std::uint64_t>(&lConfig.mNumTfBuilders)->default_value(lConfig.mNumTfBuilders),
+      "Number of TfBuilders.")
+    ("tfbuilder-memory", bpo::value<double>(&lTfbMemoryGiB)->default_value(32.0), "TfBuilder memory (GiB).")
+    ("processing-rate", bpo::value<double>(&lConfig.mProcessingRate)->default_value(lConfig.mProcessingRate),
+      "TF processing rate of a TfBuilder (B/s).")
+    ("tf-rate", bpo::value<double>(&lConfig.mTfRate)->default_value(lConfig.mTfRate), "TF rate (Hz).")
+    ("tf-size", bpo::value<double>(&lTfSizeMiB)->default_value(64.0), "Mean TF size (MiB).")
+    ("tf-size-sigma", bpo::value<double>(&lConfig.mTfSizeSigma)->default_value(lConfig.mTfSizeSigma),
+      "Log-normal sigma of the TF size.")
+    ("actual-size-ratio", bpo::value<double>(&lConfig.mActualSizeRatio)->default_value(lConfig.mActualSizeRatio),
+      "Built TF size over announced TF size.")
+    ("update-interval", bpo::value<double>(&lConfig.mUpdateInterval)->default_value(lConfig.mUpdateInterval),
+      "TfBuilder update interval (s).")
+    ("duration", bpo::value<double>(&lConfig.mDuration)->default_value(lConfig.mDuration),
+      "Simulated duration for synthetic TFs (s).")
+    ("segments", bpo::value<std::uint64_t>(&lConfig.mNumSegments)->default_value(lConfig.mNumSegments),
+      "Number of network segments (topology policy).");
+
+  bpo::variables_map lVm;
+  try {
+    bpo::store(bpo::parse_command_line(argc, argv, lOptions), lVm);
+    bpo::notify(lVm);
+  } catch (const std::exception &e) {
+    EDDLOG("Invalid options. what={}", e.what());
+    return -1;
+  }
+
+  if (lVm.count("help")) {
+    std::cout << lOptions << std::endl;
+    return 0;
+  }
+
+  lConfig.mTfBuilderMemory = std::uint64_t(lTfbMemoryGiB * double(1ULL << 30));
+  lConfig.mTfSizeMean = lTfSizeMiB * double(1ULL << 20);
+
+  if (!lInputFile.empty() && !readRecordedAnnounces(lInputFile, lConfig.mRecordedTfSizes)) {
+    return -1;
+  }
+
+  std::vector<std::string> lPolicyList;
+  boost::split(lPolicyList, lPolicies, boost::is_any_of(","), boost::token_compress_on);
+
+  for (const auto &lPolicy : lPolicyList) {
+    auto lResult = runReplay(lConfig, lPolicy);
+    reportResult(lPolicy, lResult);
+  }
+
+  return 0;
+}
@@ -17,6 +17,7 @@
 #include <StfSenderRpcClient.h>
 
 #include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string.hpp>
 
 #include <set>
 #include <tuple>
@@ -27,10 +28,148 @@ namespace o2::DataDistribution
 
 using namespace std::chrono_literals;
 
-void TfSchedulerStfInfo::SchedulingThread()
+void TfSchedulerStfInfo::configureIncompletePolicy()
 {
-  DataDistLogger::SetThreadName("SchedulingThread");
-  DDDLOG("Starting StfInfo Scheduling thread.");
+  mIncompletePolicy = IncompleteTfPolicy();
+
+  const auto lMinStfsVar = getenv("DATADIST_TFSCHED_INCOMPLETE_MIN_STFS");
+  if (!lMinStfsVar) {
+    return;
+  }
+
+  const auto lNumStfSenders = mDiscoveryConfig->status().stf_sender_count();
+  try {
+    const auto lMinStfs = std::stoul(lMinStfsVar);
+    if (lMinStfs == 0 || lMinStfs > lNumStfSenders) {
+      throw std::invalid_argument("out of range");
+    }
+    mIncompletePolicy.mMinStfs = lMinStfs;
+
+    const auto lTimeoutVar = getenv("DATADIST_TFSCHED_INCOMPLETE_TIMEOUT_MS");
+    if (lTimeoutVar) {
+      mIncompletePolicy.mTimeout = std::chrono::milliseconds(std::max(std::stoul(lTimeoutVar), 10ul));
+    }
+  } catch (...) {
+    EDDLOG("Incomplete TF policy is not valid. DATADIST_TFSCHED_INCOMPLETE_MIN_STFS={} num_stf_senders={}",
+      lMinStfsVar, lNumStfSenders);
+    mIncompletePolicy = IncompleteTfPolicy();
+    return;
+  }
+
+  const auto lRequiredVar = getenv("DATADIST_TFSCHED_INCOMPLETE_REQUIRED");
+  if (lRequiredVar) {
+    const std::string lRequiredStr = lRequiredVar;
+    std::vector<std::string> lRequired;
+    boost::split(lRequired, lRequiredStr, boost::is_any_of(","), boost::token_compress_on);
+    for (auto &lId : lRequired) {
+      boost::trim(lId);
+      if (!lId.empty()) {
+        mIncompletePolicy.mRequiredStfSenders.insert(lId);
+      }
+    }
+  }
+
+  IDDLOG("Incomplete TF policy enabled. min_stfs={} num_stf_senders={} timeout_ms={} required_stfs_ids={}",
+    mIncompletePolicy.mMinStfs, lNumStfSenders, mIncompletePolicy.mTimeout.count(),
+    boost::algorithm::join(mIncompletePolicy.mRequiredStfSenders, ","));
+}
+
+bool TfSchedulerStfInfo::acceptIncompleteTf(const std::vector<StfInfo> &pStfInfos) const
+{
+  if (mIncompletePolicy.mMinStfs == 0 || pStfInfos.size() < mIncompletePolicy.mMinStfs) {
+    return false;
+  }
+
+  std::size_t lNumRequired = 0;
+  for (const auto &lStfInfo : pStfInfos) {
+    lNumRequired += mIncompletePolicy.mRequiredStfSenders.count(lStfInfo.process_id());
+  }
+  return lNumRequired == mIncompletePolicy.mRequiredStfSenders.size();
+}
+
+void TfSchedulerStfInfo::stfSenderStateChanged(const std::string &pStfSenderId, const bool pAlive)
+{
+  const auto lNumStfSenders = mDiscoveryConfig->status().stf_sender_count();
+  {
+    std::scoped_lock lLock(mDeadStfSendersLock);
+    if (pAlive) {
+      mDeadStfSenders.erase(pStfSenderId);
+    } else {
+      mDeadStfSenders.insert(pStfSenderId);
+    }
+
+    bool lWithoutDead = !mDeadStfSenders.empty() && mIncompletePolicy.mMinStfs > 0 &&
+      (lNumStfSenders - mDeadStfSenders.size()) >= mIncompletePolicy.mMinStfs;
+    for (const auto &lRequired : mIncompletePolicy.mRequiredStfSenders) {
+      lWithoutDead = lWithoutDead && (mDeadStfSenders.count(lRequired) == 0);
+    }
+
+    mNumDeadStfSenders = mDeadStfSenders.size();
+    mScheduleWithoutDead = lWithoutDead;
+  }
+
+  IDDLOG("StfSender state changed. stfs_id={} reachable={} num_unreachable={} schedule_without_unreachable={}",
+    pStfSenderId, pAlive, mNumDeadStfSenders.load(), mScheduleWithoutDead.load());
+
+  if (pAlive) {
+    return;
+  }
+
+  // TFs waiting for the StfSender: schedule them now, or drop them to release the buffers of other StfSenders
+  std::uint64_t lNumScheduled = 0;
+  std::uint64_t lNumDropped = 0;
+  std::vector<std::uint64_t> lStfIds;
+
+  for (auto &lShard : mStfInfoShards) {
+    std::scoped_lock lLock(lShard.mLock);
+
+    lStfIds.clear();
+    for (const auto &[lStfId, lStfInfoVec] : lShard.mStfInfoMap) {
+      const bool lWaiting = std::none_of(lStfInfoVec.cbegin(), lStfInfoVec.cend(),
+        [&](const StfInfo &pI) { return pI.process_id() == pStfSenderId; });
+      if (lWaiting) {
+        lStfIds.push_back(lStfId);
+      }
+    }
+
+    for (const auto lStfId : lStfIds) {
+      if (mScheduleWithoutDead) {
+        if (reachableStfSendersComplete(lShard.mStfInfoMap[lStfId]) && acceptIncompleteTf(lShard.mStfInfoMap[lStfId])) {
+          scheduleIncompleteLocked(lShard, lStfId);
+          lNumScheduled++;
+        }
+      } else {
+        requestDropAllLocked(lShard, lStfId);
+        lNumDropped++;
+      }
+    }
+  }
+
+  if (lNumScheduled > 0 || lNumDropped > 0) {
+    WDDLOG("TFs waiting for the unreachable StfSender. stfs_id={} scheduled={} dropped={}",
+      pStfSenderId, lNumScheduled, lNumDropped);
+  }
+}
+
+bool TfSchedulerStfInfo::reachableStfSendersComplete(const std::vector<StfInfo> &pStfInfos)
+{
+  const auto lNumReachable = mDiscoveryConfig->status().stf_sender_count() - mNumDeadStfSenders;
+  if (pStfInfos.size() < lNumReachable) {
+    return false;
+  }
+
+  std::scoped_lock lLock(mDeadStfSendersLock);
+  const auto lNumFromReachable = std::count_if(pStfInfos.cbegin(), pStfInfos.cend(),
+    [this](const StfInfo &pI) { return mDeadStfSenders.count(pI.process_id()) == 0; });
+  return std::size_t(lNumFromReachable) >= lNumReachable;
+}
+
+void TfSchedulerStfInfo::SchedulingThread(const std::size_t pWorkerIdx)
+{
+  DataDistLogger::SetThreadName(fmt::format("SchedulingThread[{}]", pWorkerIdx));
+  DDDLOG("Starting StfInfo Scheduling thread. worker_idx={} num_workers={}", pWorkerIdx, mNumSchedulingWorkers);
+
+  auto &lWorker = mSchedulingWorkers[pWorkerIdx];
 
   const auto lNumStfSenders = mDiscoveryConfig->status().stf_sender_count();
   const std::set<std::string> lStfSenderIdSet = mConnManager.getStfSenderSet();
@@ -43,7 +182,19 @@ void TfSchedulerStfInfo::SchedulingThread()
   std::map<std::string, std::uint64_t> lStfSenderMissingCnt;
   std::optional<std::vector<StfInfo>> lStfInfosOpt;
 
-  while ((lStfInfosOpt = mCompleteStfsInfoQueue.pop()) != std::nullopt) {
+  // per-worker decision count and busy time, accounted on every exit from the loop body
+  struct DecisionAccounting {
+    SchedulingWorker &mWorker;
+    const std::chrono::steady_clock::time_point mStart = std::chrono::steady_clock::now();
+    ~DecisionAccounting() {
+      mWorker.mDecisions.fetch_add(1, std::memory_order_relaxed);
+      mWorker.mBusyNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - mStart).count(), std::memory_order_relaxed);
+    }
+  };
+
+  while ((lStfInfosOpt = lWorker.mQueue.pop()) != std::nullopt) {
+    const DecisionAccounting lAccounting{lWorker};
     const std::vector<StfInfo> &lStfInfos = lStfInfosOpt.value();
     TfBuildingInformation lRequest;
 
@@ -52,10 +203,20 @@ void TfSchedulerStfInfo::SchedulingThread()
 
     const auto lTfId = lStfInfos[0].stf_id();
 
-    // TODO: alow incomplete TFs
     if (lStfInfos.size() != lNumStfSenders) {
-      requestDropAllFromSchedule(lTfId);
-      continue;
+      if (!acceptIncompleteTf(lStfInfos)) {
+        requestDropAllFromSchedule(lTfId);
+        continue;
+      }
+
+      // tell the TfBuilder which StfSenders will not send an STF
+      std::set<std::string> lMissingStfSenders = lStfSenderIdSet;
+      for (const auto &lStfI : lStfInfos) {
+        lMissingStfSenders.erase(lStfI.process_id());
+      }
+      for (const auto &lMissing : lMissingStfSenders) {
+        lRequest.add_missing_stf_senders(lMissing);
+      }
     }
 
     // calculate combined STF size
@@ -77,35 +238,44 @@ void TfSchedulerStfInfo::SchedulingThread()
       // Notify TfBuilder to build the TF
       TfBuilderRpcClient lRpcCli = mConnManager.getTfBuilderRpcClient(lTfBuilderId);
 
-      // finding and getting the client is racy
+      // the TfBuilder can be removed after it was selected; a client which was found stays valid
       if (lRpcCli) {
-        BuildTfResponse lResponse;
-
-        if (lRpcCli.get().BuildTfRequest(lRequest, lResponse)) {
-          switch (lResponse.status()) {
-            case BuildTfResponse::OK:
-              // marked TfBuilder as scheduled
-              mTfBuilderInfo.markTfBuilderWithTfId(lTfBuilderId, lRequest.tf_id());
-              break;
-            case BuildTfResponse::ERROR_NOMEM:
-              EDDLOG("Scheduling error: selected TfBuilder returned ERROR_NOMEM. tf_id={:s}", lTfBuilderId);
-              requestDropAllFromSchedule(lTfId);
-              break;
-            case BuildTfResponse::ERROR_NOT_RUNNING:
-              EDDLOG("Scheduling error: selected TfBuilder returned ERROR_NOT_RUNNING. tf_id={:s}", lTfBuilderId);
-              requestDropAllFromSchedule(lTfId);
-              break;
-            default:
-              break;
+        // limit the number of requests in flight
+        {
+          std::unique_lock lLock(mBuildTfInFlightLock);
+          mBuildTfInFlightCond.wait(lLock, [&]() { return mBuildTfInFlight < sMaxBuildTfInFlight; });
+          mBuildTfInFlight++;
+        }
+
+        // mark the TfBuilder as scheduled before the request, errors are handled on completion
+        mTfBuilderInfo.markTfBuilderWithTfId(lTfBuilderId, lRequest.tf_id(), lTfSize);
+
+        auto lCall = std::make_unique<BuildTfAsyncCall>();
+        lCall->mTfBuilderId = lTfBuilderId;
+        lCall->mTfId = lTfId;
+        lCall->mTfSize = lTfSize;
+
+        if (lRpcCli.get().BuildTfRequestAsync(lRequest, lCall.get(), mBuildTfCq.get())) {
+          lCall.release(); // owned by the completion queue
+
+          const auto lLastUpdate = std::max_element(lStfInfos.cbegin(), lStfInfos.cend(),
+            [](const StfInfo &a, const StfInfo &b) { return a.mUpdateLocalTime < b.mUpdateLocalTime; });
+          mTfScheduleUs.record(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - lLastUpdate->mUpdateLocalTime).count());
+
+          if (mTraceSampling > 0 && (lTfId % mTraceSampling) == 0) {
+            traceScheduledTf(lStfInfos, lTfBuilderId);
           }
         } else {
-          EDDLOG("Scheduling of TF failed. to_tfb_id={:s} reason=grpc_error", lTfBuilderId);
-          WDDLOG("Removing TfBuilder from scheduling. tfb_id={:s}", lTfBuilderId);
-
+          {
+            std::scoped_lock lLock(mBuildTfInFlightLock);
+            mBuildTfInFlight--;
+          }
           lRpcCli.put();
 
+          WDDLOG("Selected TfBuilder is not connected. TF will be dropped. tfb_id={} tf_id={}", lTfBuilderId, lTfId);
+          mTfBuilderInfo.unmarkTfBuilderWithTfId(lTfBuilderId, lTfId, lTfSize);
           requestDropAllFromSchedule(lTfId);
-          mConnManager.removeTfBuilder(lTfBuilderId);
           mTfBuilderInfo.removeReadyTfBuilder(lTfBuilderId);
         }
       } else {
@@ -127,34 +297,128 @@ void TfSchedulerStfInfo::SchedulingThread()
   DDDLOG("Exiting StfInfo Scheduling thread.");
 }
 
+void TfSchedulerStfInfo::BuildTfCompletionThread()
+{
+  DataDistLogger::SetThreadName("BuildTfCompletionThread");
+  DDDLOG("Starting BuildTf completion thread.");
+
+  void *lTag = nullptr;
+  bool lOk = false;
+
+  while (mBuildTfCq->Next(&lTag, &lOk)) {
+    std::unique_ptr<BuildTfAsyncCall> lCall(static_cast<BuildTfAsyncCall*>(lTag));
+    const auto &lTfBuilderId = lCall->mTfBuilderId;
+    const auto lTfId = lCall->mTfId;
+
+    if (lOk && lCall->mStatus.ok()) {
+      switch (lCall->mResponse.status()) {
+        case BuildTfResponse::OK:
+          break;
+        case BuildTfResponse::ERROR_NOMEM:
+          EDDLOG("Scheduling error: selected TfBuilder returned ERROR_NOMEM. tfb_id={:s} tf_id={}",
+            lTfBuilderId, lTfId);
+          mTfBuilderInfo.unmarkTfBuilderWithTfId(lTfBuilderId, lTfId, lCall->mTfSize);
+          requestDropAllFromSchedule(lTfId);
+          break;
+        case BuildTfResponse::ERROR_NOT_RUNNING:
+          EDDLOG("Scheduling error: selected TfBuilder returned ERROR_NOT_RUNNING. tfb_id={:s} tf_id={}",
+            lTfBuilderId, lTfId);
+          mTfBuilderInfo.unmarkTfBuilderWithTfId(lTfBuilderId, lTfId, lCall->mTfSize);
+          requestDropAllFromSchedule(lTfId);
+          break;
+        default:
+          break;
+      }
+    } else {
+      EDDLOG("Scheduling of TF failed. to_tfb_id={:s} tf_id={} reason=grpc_error code={:d} message={:s}",
+        lTfBuilderId, lTfId, lCall->mStatus.error_code(), lCall->mStatus.error_message());
+      WDDLOG("Removing TfBuilder from scheduling. tfb_id={:s}", lTfBuilderId);
+
+      mTfBuilderInfo.unmarkTfBuilderWithTfId(lTfBuilderId, lTfId, lCall->mTfSize);
+      requestDropAllFromSchedule(lTfId);
+      mConnManager.removeTfBuilder(lTfBuilderId);
+      mTfBuilderInfo.removeReadyTfBuilder(lTfBuilderId);
+    }
+
+    {
+      std::scoped_lock lLock(mBuildTfInFlightLock);
+      mBuildTfInFlight--;
+    }
+    mBuildTfInFlightCond.notify_one();
+  }
+
+  DDDLOG("Exiting BuildTf completion thread.");
+}
+
+void TfSchedulerStfInfo::scheduleIncompleteLocked(StfInfoShard &pShard, const std::uint64_t pStfId)
+{
+  auto lInfoNode = pShard.mStfInfoMap.extract(pStfId);
+  WDDLOG_RL(1000, "Scheduling incomplete TimeFrame. stf_id={} received={} expected={}",
+    pStfId, lInfoNode.mapped().size(), mDiscoveryConfig->status().stf_sender_count());
+
+  atomicMax(mMaxCompletedTfId, pStfId);
+  pShard.mBuiltTfs.SetEvent(shardEvent(pStfId));
+  queueCompleteTf(std::move(lInfoNode.mapped()));
+}
+
 // Mostly usefull for troubleshooting now when the high watermark thread is implemented
 void TfSchedulerStfInfo::StaleCleanupThread()
 {
   DataDistLogger::SetThreadName("StaleCleanupThread");
   DDDLOG("Starting StfInfo StaleCleanupThread thread.");
 
+  // limit the lock hold time
+  static constexpr std::size_t sMaxExpiredPerLock = 256;
+
   const auto lNumStfSenders = mDiscoveryConfig->status().stf_sender_count();
   const std::set<std::string> lStfSenderIdSet = mConnManager.getStfSenderSet();
   std::vector<std::uint64_t> lStfsToErase;
-  auto lLastDiscardTime = std::chrono::steady_clock::now();
+  std::set<std::string> lPresentStfSenders;
 
   // count how many time an FLP was missing STFs
   std::map<std::string, std::uint64_t> lStfSenderMissingCnt;
 
-  std::vector<StfInfo> lStfInfos;
+  using steady_rep = std::chrono::steady_clock::rep;
+  std::size_t lNumErased = 0;
 
   while (mRunning) {
-    std::this_thread::sleep_for(std::chrono::seconds(sStfDiscardTimeout));
-    lLastDiscardTime = std::chrono::steady_clock::now();
-
-    lStfsToErase.clear();
+    // wait for the earliest deadline of all shards
     {
-      std::unique_lock lLock(mGlobalStfInfoLock);
+      std::unique_lock lLock(mStfDeadlineLock);
+      const auto lWaitUntil = std::min(std::chrono::steady_clock::now() + 1s, std::chrono::steady_clock::time_point(
+        std::chrono::steady_clock::duration(mNextStfDeadline.load())));
+      mStfDeadlineCondition.wait_until(lLock, lWaitUntil, [&]() {
+        return !mRunning || mNextStfDeadline.load() < lWaitUntil.time_since_epoch().count();
+      });
+    }
+    if (!mRunning) {
+      break;
+    }
+
+    // deadlines armed during the scan lower it again
+    mNextStfDeadline = std::numeric_limits<steady_rep>::max();
+    steady_rep lNextDeadline = std::numeric_limits<steady_rep>::max();
+    lNumErased = 0;
+
+    for (auto &lShard : mStfInfoShards) {
+      lStfsToErase.clear();
 
-      // check all available stf information
-      for (const auto &lStfIdInfo : mStfInfoMap) {
-        auto lStfId = lStfIdInfo.first;
-        auto &lStfInfoVec = lStfIdInfo.second;
+      std::scoped_lock lLock(lShard.mLock);
+
+      const auto lNow = std::chrono::steady_clock::now();
+
+      for (std::size_t lNumExpired = 0; lNumExpired < sMaxExpiredPerLock && !lShard.mStfDeadlines.empty() &&
+        std::get<0>(lShard.mStfDeadlines.top()) <= lNow; lNumExpired++) {
+
+        const auto [lDeadline, lStfId, lType] = lShard.mStfDeadlines.top();
+        lShard.mStfDeadlines.pop();
+
+        // already scheduled or dropped
+        const auto lStfIt = lShard.mStfInfoMap.find(lStfId);
+        if (lStfIt == lShard.mStfInfoMap.end()) {
+          continue;
+        }
+        const auto &lStfInfoVec = lStfIt->second;
 
         if (lStfInfoVec.empty()) { // this should not happen
           EDDLOG_RL(1000, "Discarding TimeFrame with no STF updates. stf_id={} received={} expected={}",
@@ -164,44 +428,63 @@ void TfSchedulerStfInfo::StaleCleanupThread()
           continue;
         }
 
-        // check reap
-        const auto &lLastStfInfo = lStfInfoVec.back();
-        const auto lTimeDiff = std::chrono::abs(lLastStfInfo.mUpdateLocalTime - lLastDiscardTime);
-        if (lTimeDiff > sStfDiscardTimeout) {
-          WDDLOG_RL(1000, "Discarding incomplete SubTimeFrame. stf_id={} received={} expected={}",
-            lStfId, lStfInfoVec.size(), lNumStfSenders);
+        if (lType == eDeadlineIncomplete) {
+          // incomplete TF allowed by the policy? Otherwise addStfInfo() checks again on every new STF
+          if (acceptIncompleteTf(lStfInfoVec)) {
+            scheduleIncompleteLocked(lShard, lStfId);
+          }
+          continue;
+        }
 
-          // find missing StfSenders
-          std::set<std::string> lMissingStfSenders = lStfSenderIdSet;
+        // re-arm if updated since the deadline was set
+        const auto lStaleDeadline = lStfInfoVec.back().mUpdateLocalTime + sStfDiscardTimeout;
+        if (lStaleDeadline > lNow) {
+          lShard.mStfDeadlines.emplace(lStaleDeadline, lStfId, eDeadlineStale);
+          continue;
+        }
 
-          for (const auto &lUpdate : lStfInfoVec) {
-            lMissingStfSenders.erase(lUpdate.process_id());
-          }
+        WDDLOG_RL(1000, "Discarding incomplete SubTimeFrame. stf_id={} received={} expected={}",
+          lStfId, lStfInfoVec.size(), lNumStfSenders);
 
-          std::string lMissingIds = boost::algorithm::join(lMissingStfSenders, ", ");
-          DDDLOG("Missing STFs from StfSender IDs: {}", lMissingIds);
+        // find missing StfSenders
+        lPresentStfSenders.clear();
+        for (const auto &lUpdate : lStfInfoVec) {
+          lPresentStfSenders.insert(lUpdate.process_id());
+        }
 
-          for (const auto &lStf : lMissingStfSenders) {
-            lStfSenderMissingCnt[lStf]++;
+        std::string lMissingIds;
+        for (const auto &lStfSenderId : lStfSenderIdSet) {
+          if (lPresentStfSenders.count(lStfSenderId) == 0) {
+            lStfSenderMissingCnt[lStfSenderId]++;
+            lMissingIds += (lMissingIds.empty() ? "" : ", ") + lStfSenderId;
           }
-
-          lStfsToErase.push_back(lStfId);
         }
+        DDDLOG("Missing STFs from StfSender IDs: {}", lMissingIds);
+
+        lStfsToErase.push_back(lStfId);
       }
 
       // drop outside of the main iteration loop
       for(const auto &lStfIdToDrop : lStfsToErase) {
-        requestDropAllLocked(lStfIdToDrop);
+        requestDropAllLocked(lShard, lStfIdToDrop);
+      }
+      lNumErased += lStfsToErase.size();
+
+      if (!lShard.mStfDeadlines.empty()) {
+        lNextDeadline = std::min(lNextDeadline, std::get<0>(lShard.mStfDeadlines.top()).time_since_epoch().count());
       }
     }
 
-    if (lStfsToErase.size() > 0) {
-      WDDLOG("SchedulingThread: TFs have been discarded due to incomplete number of STFs. discarded_tf_count={}",
-        lStfsToErase.size());
+    auto lOld = mNextStfDeadline.load();
+    while (lOld > lNextDeadline && !mNextStfDeadline.compare_exchange_weak(lOld, lNextDeadline)) { }
+
+    if (lNumErased > 0) {
+      WDDLOG_RL(1000, "SchedulingThread: TFs have been discarded due to incomplete number of STFs. discarded_tf_count={}",
+        lNumErased);
 
       for (const auto &lStfSenderCnt : lStfSenderMissingCnt) {
         if (lStfSenderCnt.second > 0) {
-          DDDLOG("StfSender with missing ids: stfsender_id={} missing_cnt={}",
+          DDDLOG_RL(1000, "StfSender with missing ids: stfsender_id={} missing_cnt={}",
             lStfSenderCnt.first, lStfSenderCnt.second);
         }
       }
@@ -211,118 +494,271 @@ void TfSchedulerStfInfo::StaleCleanupThread()
   DDDLOG("Exiting StfInfo StaleCleanupThread thread.");
 }
 
-void TfSchedulerStfInfo::HighWatermarkThread()
+void TfSchedulerStfInfo::updateStfSenderSlot(const StfSenderStfInfo &pStfInfo)
 {
-  DataDistLogger::SetThreadName("HighWatermarkThread");
-  DDDLOG("Starting HighWatermarkThread thread.");
+  const auto lSlotIt = mStfSenderSlots.find(pStfInfo.info().process_id());
+  if (lSlotIt == mStfSenderSlots.end()) {
+    return;
+  }
+  auto &lSlot = *lSlotIt->second;
 
-  // const auto lNumStfSenders = mDiscoveryConfig->status().stf_sender_count();
-  const std::set<std::string> lStfSenderIdSet = mConnManager.getStfSenderSet();
-  std::vector<std::uint64_t> lStfsToErase;
-  lStfsToErase.reserve(1000);
+  const auto lUsedBuffer = pStfInfo.stfs_info().buffer_used();
+  const auto lTotalBuffer = pStfInfo.stfs_info().buffer_size();
 
-  while (mRunning) {
-    std::vector<std::uint64_t> lStfsToDrop;
-    std::uint64_t lStfsToDropSize = 0;
-    double lBuffUtilMean = 0.0;
-    double lBuffUtilMax = 0.0;
-    std::string lStfsToFree;
+  lSlot.mBufferSize.store(lTotalBuffer, std::memory_order_relaxed);
+  lSlot.mBufferUsed.store(lUsedBuffer, std::memory_order_relaxed);
+  lSlot.mValid = true;
 
-    {
-      std::unique_lock lLock(mGlobalStfInfoLock);
-      if (std::cv_status::timeout == mMemWatermarkCondition.wait_for(lLock, 1s)) {
-        DDDLOG_RL(10000, "HighWatermarkThread: Running the StfSender buffer utilization perodic scan.");
-      }
+  const bool lAbove = lUsedBuffer > (lTotalBuffer * sHighWatermarkPercent / 100);
+  if (!lAbove) {
+    lSlot.mAboveWatermark.store(false, std::memory_order_relaxed);
+    return;
+  }
+
+  // signal only when crossing the watermark
+  if (lSlot.mAboveWatermark.exchange(true) || lSlot.mPending) {
+    return;
+  }
+  lSlot.mCrossedTime = std::chrono::steady_clock::now().time_since_epoch().count();
+  mMemWatermarkPending++;
+  lSlot.mPending = true;
+  { // the watermark thread checks mMemWatermarkPending under the lock
+    std::scoped_lock lLock(mMemWatermarkLock);
+  }
+  mMemWatermarkCondition.notify_one();
+}
 
-      // check for problematic stf senders
-      for (const auto &lUtil : mStfSenderInfoMap) {
-        const auto &lStfs = lUtil.first;
-        const auto &lStfsUtil = lUtil.second;
+void TfSchedulerStfInfo::traceScheduledTf(const std::vector<StfInfo> &pStfInfos, const std::string &pTfBuilderId) const
+{
+  // updates are timed with the steady clock: convert to the system clock for comparison with other nodes
+  const auto lSteadyNow = std::chrono::steady_clock::now();
+  const auto lFirst = std::min_element(pStfInfos.cbegin(), pStfInfos.cend(),
+    [](const StfInfo &a, const StfInfo &b) { return a.mUpdateLocalTime < b.mUpdateLocalTime; })->mUpdateLocalTime;
+  const auto lStartNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    (std::chrono::system_clock::now() - (lSteadyNow - lFirst)).time_since_epoch()).count();
+
+  const auto lUs = [&](const std::chrono::steady_clock::time_point pT) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(pT - lFirst).count();
+  };
+
+  std::string lRec = fmt::format("tf_id={} start_ns={} sched={} tfb_id={}", pStfInfos[0].stf_id(), lStartNs,
+    lUs(lSteadyNow), pTfBuilderId);
+  for (const auto &lStfI : pStfInfos) {
+    lRec += fmt::format(" {}={}", lStfI.process_id(), lUs(lStfI.mUpdateLocalTime));
+  }
+  IDDLOG("TfTrace: scheduler {}", lRec);
+}
 
-        const double lBufUtil = double(lStfsUtil.buffer_used()) / double(lStfsUtil.buffer_size());
-        lBuffUtilMean += lBufUtil / mStfSenderInfoMap.size();
+void TfSchedulerStfInfo::logLatencyStats()
+{
+  const auto lLogHist = [](const char *pName, LogLinearHistogram &pHist) {
+    const auto lSnap = pHist.snapshot_reset();
+    if (lSnap.mCount > 0) {
+      IDDLOG("Scheduling latency. stage={} p50_us={} p90_us={} p99_us={} p999_us={} max_us={} count={}", pName,
+        LogLinearHistogram::percentile(lSnap, 50.0), LogLinearHistogram::percentile(lSnap, 90.0),
+        LogLinearHistogram::percentile(lSnap, 99.0), LogLinearHistogram::percentile(lSnap, 99.9),
+        lSnap.mMax, lSnap.mCount);
+    }
+  };
 
-        // max util sender
-        if (lBufUtil > lBuffUtilMax) {
-          lBuffUtilMax = lBufUtil;
-          lStfsToFree = lStfs;
-        }
+  lLogHist("tf_complete", mTfCompleteUs);
+  lLogHist("tf_schedule", mTfScheduleUs);
+  lLogHist("watermark_reaction", mWatermarkReactionUs);
 
-        // log problematic ones
-        if (lBufUtil > 0.95) {
-          WDDLOG_RL(1000, "HighWatermark: buffer utilization too high. stfs_id={} buffer_util={:.4} buffer_size={}",
-            lStfs, lBufUtil, lStfsUtil.buffer_size());
-        }
-      }
+  const auto lNow = std::chrono::steady_clock::now();
+  const double lIntervalS = std::max(1e-3, std::chrono::duration<double>(lNow - mSchedulingStatsTime).count());
+  mSchedulingStatsTime = lNow;
 
-      IDDLOG_RL(5000, "HighWatermark: StfSender buffer utilization max_util={:.4} stfs_id={} mean_util={:.4}",
-        lBuffUtilMax, lStfsToFree, lBuffUtilMean);
+  for (std::size_t lIdx = 0; lIdx < mNumSchedulingWorkers; lIdx++) {
+    auto &lWorker = mSchedulingWorkers[lIdx];
+    const auto lDecisions = lWorker.mDecisions.exchange(0);
+    const auto lBusyNs = lWorker.mBusyNs.exchange(0);
 
-      if (lBuffUtilMax <= 0.95) {
-        continue;
+    IDDLOG("Scheduling worker. idx={} decisions={} rate_hz={:.1f} busy_pct={:.1f} queued={}", lIdx, lDecisions,
+      double(lDecisions) / lIntervalS, 100.0 * double(lBusyNs) / (lIntervalS * 1e9), lWorker.mQueue.size());
+  }
+}
+
+std::tuple<std::uint64_t, std::uint64_t> TfSchedulerStfInfo::freeStfSenderBuffer(const std::string &pStfsToFree)
+{
+  // check if we have incomplete TFs smaller than the currently build one
+  // since all StfSenders are required to send updates in order, all incomplete TFs before
+  // the current can be discarded
+  assert (!pStfsToFree.empty());
+
+  // <stf id, size of the stf of the problematic StfSender>
+  std::vector<std::tuple<std::uint64_t, std::uint64_t>> lStfsCandidates;
+  std::uint64_t lNumStfsDropped = 0;
+  std::uint64_t lStfsToDropSize = 0;
+
+  const auto lTimeNow = std::chrono::steady_clock::now();
+  const std::uint64_t lMaxCompletedTfId = mMaxCompletedTfId;
+
+  for (auto &lShard : mStfInfoShards) {
+    std::scoped_lock lLock(lShard.mLock);
+
+    for (const auto &it : lShard.mStfInfoMap) {
+      const auto &lStfId = it.first;
+      const auto &lStfVec = it.second;
+
+      assert (!lStfVec.empty());
+
+      // check the TFID
+      if (lStfId > lMaxCompletedTfId) {
+        break;
+      }
+
+      // check if the TF is too recent
+      if (!lStfVec.empty() && (lTimeNow - lStfVec[0].mUpdateLocalTime < 1s)) {
+        break;
       }
 
-      if (lStfsToFree.empty()) {
+      // check if this will help the problematic stf sender
+      const auto &lFoundStfs = std::find_if(lStfVec.begin(), lStfVec.end(),
+        [&pStfsToFree](const StfInfo &pI) {
+          return (pI.process_id() == pStfsToFree);
+        }
+      );
+      if (lFoundStfs == lStfVec.end()) {
         continue;
       }
 
-      // check if we have incomplete TFs smaller than the currently build one
-      // since all StfSenders are required to send updates in order, all incomplete TFs before
-      // the current can be discarded
-      assert (!lStfsToFree.empty());
+      lStfsCandidates.emplace_back(lStfId, lFoundStfs->stf_size());
+    }
+  }
+
+  // drop the oldest first, and limit how much we drop
+  std::sort(lStfsCandidates.begin(), lStfsCandidates.end());
 
-      auto lTimeNow = std::chrono::steady_clock::now();
+  for (const auto &[lStfId, lStfSize] : lStfsCandidates) {
+    if (lStfsToDropSize > (std::uint64_t(1) << 30)) {
+      break;
+    }
 
-      for (const auto &it : mStfInfoMap) {
-        const auto &lStfId = it.first;
-        const auto &lStfVec = it.second;
+    auto &lShard = stfInfoShard(lStfId);
+    std::scoped_lock lLock(lShard.mLock);
+    // completed or dropped in the meantime
+    if (lShard.mStfInfoMap.count(lStfId) == 0) {
+      continue;
+    }
 
-        // limit how much we drop
-        if (lStfsToDropSize > (std::uint64_t(1) << 30)) {
-          break;
-        }
+    WDDLOG_GRL(1000, "STFUpdateComplete: dropping incomplete TF with lower id than the currently completed one. "
+      "drop_tf_id={} complete_tf_id={}", lStfId, lMaxCompletedTfId);
 
-        assert (!lStfVec.empty());
+    lStfsToDropSize += lStfSize;
+    lNumStfsDropped++;
+    requestDropAllLocked(lShard, lStfId); // this will remove the element from the shard map
+  }
 
-        // check the TFID
-        if (lStfId > mMaxCompletedTfId) {
-          break;
-        }
+  if (lStfsToDropSize > 0) {
+    IDDLOG("HighWatermark: cleared dropped STFs from StfSender. stfs_id={} num_stfs_dropped={} dropped_size={}",
+      pStfsToFree, lNumStfsDropped, lStfsToDropSize);
+  }
 
-        // check if the TF is too recent
-        if (!lStfVec.empty() && (lTimeNow - lStfVec[0].mUpdateLocalTime < 1s)) {
-          break;
-        }
+  return { lNumStfsDropped, lStfsToDropSize };
+}
 
-        // check if this will help the problematic stf sender
-        const auto &lFoundStfs = std::find_if(lStfVec.begin(), lStfVec.end(),
-          [&cMatch = std::as_const(lStfsToFree)](const StfInfo &pI) {
-            return (pI.process_id() == cMatch);
-          }
-        );
-        if (lFoundStfs == lStfVec.end()) {
+void TfSchedulerStfInfo::HighWatermarkThread()
+{
+  DataDistLogger::SetThreadName("HighWatermarkThread");
+  DDDLOG("Starting HighWatermarkThread thread.");
+
+  // reaction latency: from the watermark crossing in addStfInfo() to the drop decision
+  double lReactionMeanMs = 0.0;
+  double lReactionMaxMs = 0.0;
+  auto lLastLatencyLog = std::chrono::steady_clock::now();
+
+  while (mRunning) {
+    if (std::chrono::steady_clock::now() - lLastLatencyLog >= sLatencyLogInterval) {
+      lLastLatencyLog = std::chrono::steady_clock::now();
+      logLatencyStats();
+    }
+
+    double lBuffUtilMean = 0.0;
+    double lBuffUtilMax = 0.0;
+    std::string lStfsToFree;
+
+    bool lEvent = false;
+    {
+      std::unique_lock lLock(mMemWatermarkLock);
+      lEvent = mMemWatermarkCondition.wait_for(lLock, 1s, [this]() { return !mRunning || mMemWatermarkPending > 0; });
+    }
+    if (!mRunning) {
+      break;
+    }
+
+    // handle StfSenders which crossed the watermark
+    if (lEvent) {
+      for (const auto &lSlotIt : mStfSenderSlots) {
+        auto &lSlot = *lSlotIt.second;
+        if (!lSlot.mPending.exchange(false)) {
           continue;
         }
+        mMemWatermarkPending--;
+
+        const std::chrono::duration<double, std::milli> lReaction = std::chrono::steady_clock::now() -
+          std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(lSlot.mCrossedTime.load()));
+        lReactionMeanMs += (lReaction.count() - lReactionMeanMs) / 16;
+        lReactionMaxMs = std::max(lReactionMaxMs, lReaction.count());
+        mWatermarkReactionUs.record(std::uint64_t(lReaction.count() * 1000.0));
+
+        WDDLOG_RL(1000, "HighWatermark: buffer utilization crossed the watermark. stfs_id={} buffer_used={} buffer_size={}",
+          lSlotIt.first, lSlot.mBufferUsed.load(), lSlot.mBufferSize.load());
+        freeStfSenderBuffer(lSlotIt.first);
+      }
+
+      IDDLOG_RL(5000, "HighWatermark: watermark reaction latency. mean_ms={:.3} max_ms={:.3}",
+        lReactionMeanMs, lReactionMaxMs);
+      continue;
+    }
+
+    // periodic safety net scan
+    DDDLOG_RL(10000, "HighWatermarkThread: Running the StfSender buffer utilization perodic scan.");
+
+    // check for problematic stf senders
+    std::size_t lNumValid = 0;
+    for (const auto &lSlot : mStfSenderSlots) {
+      lNumValid += lSlot.second->mValid ? 1 : 0;
+    }
+
+    for (const auto &lSlotIt : mStfSenderSlots) {
+      const auto &lStfs = lSlotIt.first;
+      const auto &lSlot = *lSlotIt.second;
+
+      const auto lBufferSize = lSlot.mBufferSize.load(std::memory_order_relaxed);
+      if (!lSlot.mValid || lBufferSize == 0) {
+        continue;
+      }
 
-        WDDLOG_GRL(1000, "STFUpdateComplete: dropping incomplete TF with lower id than the currently completed one. "
-          "drop_tf_id={} complete_tf_id={}", lStfId, mMaxCompletedTfId);
+      const double lBufUtil = double(lSlot.mBufferUsed.load(std::memory_order_relaxed)) / double(lBufferSize);
+      lBuffUtilMean += lBufUtil / lNumValid;
 
-        lStfsToDropSize += lFoundStfs->stf_size();
-        lStfsToDrop.push_back(lStfId);
+      // max util sender
+      if (lBufUtil > lBuffUtilMax) {
+        lBuffUtilMax = lBufUtil;
+        lStfsToFree = lStfs;
       }
-      // make sure the info is regenerated fresh after clearing
-      mStfSenderInfoMap.clear();
 
-      // note: must drop while the map is locked
-      for (const auto lStfId :lStfsToDrop) {
-        requestDropAllLocked(lStfId); // this will remove the element from mStfInfoMap
+      // log problematic ones
+      if (lBufUtil > 0.95) {
+        WDDLOG_RL(1000, "HighWatermark: buffer utilization too high. stfs_id={} buffer_util={:.4} buffer_size={}",
+          lStfs, lBufUtil, lBufferSize);
       }
-    }// unlock mGlobalStfInfoLock
+    }
+
+    IDDLOG_RL(5000, "HighWatermark: StfSender buffer utilization max_util={:.4} stfs_id={} mean_util={:.4}",
+      lBuffUtilMax, lStfsToFree, lBuffUtilMean);
 
-    if (lStfsToDropSize > 0) {
-      IDDLOG("HighWatermark: cleared dropped STFs from StfSender. stfs_id={} num_stfs_dropped={} dropped_size={}",
-        lStfsToFree, lStfsToDrop.size(), lStfsToDropSize);
+    // make sure the info is regenerated fresh after the scan
+    for (auto &lSlot : mStfSenderSlots) {
+      lSlot.second->mValid = false;
+    }
+
+    if (lBuffUtilMax <= 0.95 || lStfsToFree.empty()) {
+      continue;
     }
+
+    freeStfSenderBuffer(lStfsToFree);
   }
 
   DDDLOG("Exiting HighWatermarkThread thread.");
@@ -341,8 +777,9 @@ void TfSchedulerStfInfo::DropThread()
 
 #if !defined(NDEBUG)
       { // Should remove earlier?
-        std::unique_lock lLock(mGlobalStfInfoLock);
-        assert (mStfInfoMap.count(lStfId) == 0);
+        auto &lShard = stfInfoShard(lStfId);
+        std::scoped_lock lLock(lShard.mLock);
+        assert (lShard.mStfInfoMap.count(lStfId) == 0);
       }
 #endif
       mConnManager.dropAllStfsAsync(lStfId);
@@ -354,31 +791,37 @@ void TfSchedulerStfInfo::DropThread()
 
 void TfSchedulerStfInfo::addStfInfo(const StfSenderStfInfo &pStfInfo, SchedulerStfInfoResponse &pResponse)
 {
+  static std::mutex sCompleteTfDurLock;
   static std::chrono::duration<double, std::milli> sCompleteTfDurAvg = std::chrono::duration<double, std::milli>(0);
   static std::chrono::duration<double, std::milli> sCompleteTfDurMax = std::chrono::duration<double, std::milli>(0);
 
   const auto lNumStfSenders = mDiscoveryConfig->status().stf_sender_count();
   const auto lStfId = pStfInfo.stf_id();
+  const auto lStfEvent = shardEvent(lStfId);
+  auto &lShard = stfInfoShard(lStfId);
 
   {
-    std::unique_lock lLock(mGlobalStfInfoLock);
+    std::unique_lock lLock(lShard.mLock);
 
-    // always record latest stfsender status for high watermark thread
-    mStfSenderInfoMap[pStfInfo.info().process_id()] = pStfInfo.stfs_info();
+    // always record latest stfsender status for high watermark thread (start() rebuilds the slots under the
+    // shard locks)
+    if (mRunning) {
+      updateStfSenderSlot(pStfInfo);
+    }
 
     // check if already dropped?
-    if (mDroppedStfs.GetEvent(lStfId)) {
+    if (lShard.mDroppedStfs.GetEvent(lStfEvent)) {
       pResponse.set_status((!mRunning) ? SchedulerStfInfoResponse::DROP_NOT_RUNNING :
         SchedulerStfInfoResponse::DROP_SCHED_DISCARDED);
-      assert (mStfInfoMap.count(lStfId) == 0);
+      assert (lShard.mStfInfoMap.count(lStfId) == 0);
       return;
     }
 
     // check if already built?
-    if (mBuiltTfs.GetEvent(lStfId)) {
+    if (lShard.mBuiltTfs.GetEvent(lStfEvent)) {
       pResponse.set_status((!mRunning) ? SchedulerStfInfoResponse::DROP_NOT_RUNNING :
         SchedulerStfInfoResponse::DROP_SCHED_DISCARDED);
-      assert (mStfInfoMap.count(lStfId) == 0);
+      assert (lShard.mStfInfoMap.count(lStfId) == 0);
       EDDLOG_GRL(500, "addStfInfo: Stf update with ID that is already built. stfs_id={} stf_id={}",
         pStfInfo.info().process_id(), lStfId);
       return;
@@ -387,13 +830,13 @@ void TfSchedulerStfInfo::addStfInfo(const StfSenderStfInfo &pStfInfo, SchedulerS
     // Drop not running
     if (!mRunning) {
       pResponse.set_status(SchedulerStfInfoResponse::DROP_NOT_RUNNING);
-      requestDropAllLocked(lStfId);
+      requestDropAllLocked(lShard, lStfId);
       return;
     }
-    // DROP When stfsenders are not complete
-    if (mConnManager.getStfSenderState() != StfSenderState::STF_SENDER_STATE_OK) {
+    // DROP When stfsenders are not complete, unless TFs can be built without the unreachable ones
+    if (mConnManager.getStfSenderState() != StfSenderState::STF_SENDER_STATE_OK && !mScheduleWithoutDead) {
       pResponse.set_status(SchedulerStfInfoResponse::DROP_STFS_INCOMPLETE);
-      requestDropAllLocked(lStfId);
+      requestDropAllLocked(lShard, lStfId);
       return;
     }
 
@@ -401,75 +844,92 @@ void TfSchedulerStfInfo::addStfInfo(const StfSenderStfInfo &pStfInfo, SchedulerS
     // TODO: fix watermarks
     const auto lUsedBuffer = pStfInfo.stfs_info().buffer_used();
     const auto lTotalBuffer = pStfInfo.stfs_info().buffer_size();
-    if (lUsedBuffer > (lTotalBuffer * 95 / 100) ) {
-      mMemWatermarkCondition.notify_one();
-    }
     // check for buffer overrun, and instruct to drop
     if (lUsedBuffer > (lTotalBuffer * 99 / 100)) {
       WDDLOG_GRL(1000, "addStfInfo: stfs buffer full, dropping stf. stfs_id={} buffer_used={} buffer_size={}",
         pStfInfo.info().process_id(), lUsedBuffer, lTotalBuffer);
       pResponse.set_status(SchedulerStfInfoResponse::DROP_STFS_BUFFER_FULL);
-      requestDropAllLocked(lStfId);
+      requestDropAllLocked(lShard, lStfId);
       return;
     }
 
-    if (lStfId > mLastStfId + 220) { // warn about the future
+    const std::uint64_t lLastStfId = mLastStfId;
+    if (lStfId > lLastStfId + 220) { // warn about the future
       WDDLOG_GRL(500, "TfScheduler: Received STFid is much larger than the currently processed TF id."
-        " new_stf_id={} current_stf_id={} from_stf_sender={}", lStfId, mLastStfId, pStfInfo.info().process_id());
+        " new_stf_id={} current_stf_id={} from_stf_sender={}", lStfId, lLastStfId, pStfInfo.info().process_id());
     }
 
     // Sanity check for delayed Stf info
     // TODO: define tolerable delay here
     // seq consistency: FLPs are driving streams independently
     const std::uint64_t lMaxDelayTf = sStfDiscardTimeout.count() * 44;
-    const std::uint64_t lMinAccept = mLastStfId < lMaxDelayTf ? 0 : (mLastStfId - lMaxDelayTf);
+    const std::uint64_t lMinAccept = lLastStfId < lMaxDelayTf ? 0 : (lLastStfId - lMaxDelayTf);
 
     DDDLOG_GRL(5000, "TfScheduler: Currently accepting STF id range: start_id={} current_id={}",
-      lMinAccept, mLastStfId);
+      lMinAccept, lLastStfId);
 
-    if ((lStfId < lMinAccept) && (mStfInfoMap.count(lStfId) == 0)) {
+    if ((lStfId < lMinAccept) && (lShard.mStfInfoMap.count(lStfId) == 0)) {
       WDDLOG_GRL(1000, "TfScheduler: Delayed or duplicate STF info. stf_id={} current_stf_id={} from_stf_sender={}",
-        lStfId, mLastStfId, pStfInfo.info().process_id());
+        lStfId, lLastStfId, pStfInfo.info().process_id());
 
       pResponse.set_status(SchedulerStfInfoResponse::DROP_SCHED_DISCARDED);
-      requestDropAllLocked(lStfId);
+      requestDropAllLocked(lShard, lStfId);
       return;
     }
 
-    mLastStfId = std::max(mLastStfId, lStfId);
-    assert (mDroppedStfs.GetEvent(lStfId) == false);
+    atomicMax(mLastStfId, lStfId);
+    assert (lShard.mDroppedStfs.GetEvent(lStfEvent) == false);
 
     // get or create a new vector of Stf updates
-    auto &lStfIdVector = mStfInfoMap[lStfId];
+    auto &lStfIdVector = lShard.mStfInfoMap[lStfId];
+
+    const auto lNow = std::chrono::steady_clock::now();
 
     if (lStfIdVector.size() == 0) {
       lStfIdVector.reserve(lNumStfSenders);
+
+      // arm the deadlines of the new TF
+      lShard.mStfDeadlines.emplace(lNow + sStfDiscardTimeout, lStfId, eDeadlineStale);
+      armStfDeadline(lNow + sStfDiscardTimeout);
+      if (mIncompletePolicy.mMinStfs > 0) {
+        lShard.mStfDeadlines.emplace(lNow + mIncompletePolicy.mTimeout, lStfId, eDeadlineIncomplete);
+        armStfDeadline(lNow + mIncompletePolicy.mTimeout);
+      }
     }
 
     // add the current STF to the list
     pResponse.set_status(SchedulerStfInfoResponse::OK);
-    lStfIdVector.emplace_back(std::chrono::steady_clock::now(), pStfInfo);
+    lStfIdVector.emplace_back(lNow, pStfInfo);
 
     // check if complete
     if (lStfIdVector.size() == lNumStfSenders) {
       { // check duration
+        std::scoped_lock lDurLock(sCompleteTfDurLock);
         const std::chrono::duration<double, std::milli> lTfSchedDur = lStfIdVector.rbegin()->mUpdateLocalTime -
           lStfIdVector.begin()->mUpdateLocalTime;
 
         sCompleteTfDurAvg += (lTfSchedDur / 16 - sCompleteTfDurAvg / 16);
         sCompleteTfDurMax = std::max(lTfSchedDur, sCompleteTfDurMax);
+        mTfCompleteUs.record(std::uint64_t(lTfSchedDur.count() * 1000.0));
 
         DDDLOG_GRL(1000, "STFUpdateComplete: collected {} STFs. current_dur_ms={:.3} mean_dur_ms={:.3} max_dur_ms={:.3}",
           lNumStfSenders, lTfSchedDur.count(), sCompleteTfDurAvg.count(), sCompleteTfDurMax.count());
       }
 
-      auto lInfoNode = mStfInfoMap.extract(lStfId);
-      mMaxCompletedTfId = std::max(mMaxCompletedTfId, lStfId);
+      auto lInfoNode = lShard.mStfInfoMap.extract(lStfId);
+      atomicMax(mMaxCompletedTfId, lStfId);
 
       // queue completed TFs
-      mBuiltTfs.SetEvent(lStfId);
-      mCompleteStfsInfoQueue.push(std::move(lInfoNode.mapped()));
-
+      lShard.mBuiltTfs.SetEvent(lStfEvent);
+      queueCompleteTf(std::move(lInfoNode.mapped()));
+
+    } else if (mIncompletePolicy.mMinStfs > 0 && (lNow - lStfIdVector.front().mUpdateLocalTime) >
+      mIncompletePolicy.mTimeout && acceptIncompleteTf(lStfIdVector)) {
+      // late STF made the timed-out TF acceptable
+      scheduleIncompleteLocked(lShard, lStfId);
+    } else if (mScheduleWithoutDead && reachableStfSendersComplete(lStfIdVector) && acceptIncompleteTf(lStfIdVector)) {
+      // no need to wait for the unreachable StfSenders
+      scheduleIncompleteLocked(lShard, lStfId);
     }
   }
 }
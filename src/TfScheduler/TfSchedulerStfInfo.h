@@ -30,8 +30,19 @@
 
 #include <vector>
 #include <map>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <set>
 #include <thread>
 #include <chrono>
+#include <queue>
+#include <tuple>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <limits>
 
 namespace o2::DataDistribution
 {
@@ -64,19 +75,71 @@ public:
                      TfSchedulerTfBuilderInfo &pTfBuilderInfo)
   : mDiscoveryConfig(pDiscoveryConfig),
     mConnManager(pConnManager),
-    mTfBuilderInfo(pTfBuilderInfo),
-    mDroppedStfs(24ULL * 3600 * 88), // 1h of running ~ 1MiB size
-    mBuiltTfs(24ULL * 3600 * 88)
+    mTfBuilderInfo(pTfBuilderInfo)
   { }
 
   ~TfSchedulerStfInfo() { }
 
   void start() {
-    mStfInfoMap.clear();
+    for (auto &lShard : mStfInfoShards) {
+      std::scoped_lock lLock(lShard.mLock);
+      lShard.mStfInfoMap.clear();
+    }
+    configureIncompletePolicy();
+
+    const auto lTraceVar = getenv("DATADIST_TRACE_SAMPLING");
+    mTraceSampling = lTraceVar ? std::strtoull(lTraceVar, nullptr, 10) : 0;
+
+    // StfSender slots are fixed for the partition. addStfInfo() reads them under the shard lock
+    {
+      std::vector<std::unique_lock<std::mutex>> lShardLocks;
+      lShardLocks.reserve(cNumStfInfoShards);
+      for (auto &lShard : mStfInfoShards) {
+        lShardLocks.emplace_back(lShard.mLock);
+      }
+      mStfSenderSlots.clear();
+      for (const auto &lStfSenderId : mConnManager.getStfSenderSet()) {
+        mStfSenderSlots[lStfSenderId] = std::make_unique<StfSenderSlot>();
+      }
+    }
+    mMemWatermarkPending = 0;
+    mNextStfDeadline = std::numeric_limits<std::chrono::steady_clock::rep>::max();
+
+    {
+      std::scoped_lock lLock(mDeadStfSendersLock);
+      mDeadStfSenders.clear();
+      mNumDeadStfSenders = 0;
+      mScheduleWithoutDead = false;
+    }
+    mConnManager.setStfSenderStateCallback([this](const std::string &pStfSenderId, const bool pAlive) {
+      stfSenderStateChanged(pStfSenderId, pAlive);
+    });
+
+    // scheduling workers: each one schedules the TFs of one TF-ID residue class
+    const auto lSchedThreadsVar = getenv("DATADIST_TFSCHED_SCHED_THREADS");
+    mNumSchedulingWorkers = std::clamp(std::size_t(lSchedThreadsVar ? std::strtoull(lSchedThreadsVar, nullptr, 10) : 1),
+      std::size_t(1), cMaxSchedulingWorkers);
+    for (auto &lWorker : mSchedulingWorkers) {
+      lWorker.mQueue.start();
+      lWorker.mDecisions = 0;
+      lWorker.mBusyNs = 0;
+    }
+    mSchedulingStatsTime = std::chrono::steady_clock::now();
+
+    // BuildTf requests are sent by the scheduling threads
+    mBuildTfCq = std::make_unique<grpc::CompletionQueue>();
+    mBuildTfThread = create_thread_member("sched_buildtf", &TfSchedulerStfInfo::BuildTfCompletionThread, this);
 
     mRunning = true;
     // Start the scheduling threads
-    mSchedulingThread = create_thread_member("sched_sched", &TfSchedulerStfInfo::SchedulingThread, this);
+    for (std::size_t lIdx = 0; lIdx < mNumSchedulingWorkers; lIdx++) {
+      char lThreadName[128];
+      std::snprintf(lThreadName, 127, "sched_sched_%u", (unsigned)lIdx);
+      lThreadName[15] = '\0';
+
+      mSchedulingWorkers[lIdx].mThread = create_thread_member(lThreadName, &TfSchedulerStfInfo::SchedulingThread,
+        this, lIdx);
+    }
     mStaleStfThread = create_thread_member("stale_drop", &TfSchedulerStfInfo::StaleCleanupThread, this);
     mWatermarkThread = create_thread_member("wmark", &TfSchedulerStfInfo::HighWatermarkThread, this);
     mDropThread = create_thread_member("sched_drop", &TfSchedulerStfInfo::DropThread, this);
@@ -84,13 +147,35 @@ public:
 
   void stop() {
     DDDLOG("TfSchedulerStfInfo::stop()");
+    mConnManager.setStfSenderStateCallback(nullptr);
     mRunning = false;
+    {
+      std::scoped_lock lLock(mMemWatermarkLock);
+    }
+    mMemWatermarkCondition.notify_all();
+    {
+      std::scoped_lock lLock(mStfDeadlineLock);
+    }
+    mStfDeadlineCondition.notify_all();
     mDropQueue.stop();
-    mCompleteStfsInfoQueue.stop();
+    for (auto &lWorker : mSchedulingWorkers) {
+      lWorker.mQueue.stop();
+    }
+
+    for (auto &lWorker : mSchedulingWorkers) {
+      if (lWorker.mThread.joinable()) {
+        lWorker.mThread.join();
+      }
+    }
 
-    if (mSchedulingThread.joinable()) {
-      mSchedulingThread.join();
+    // drain BuildTf requests in flight
+    if (mBuildTfCq) {
+      mBuildTfCq->Shutdown();
+    }
+    if (mBuildTfThread.joinable()) {
+      mBuildTfThread.join();
     }
+    mBuildTfCq.reset();
 
     if (mStaleStfThread.joinable()) {
       mStaleStfThread.join();
@@ -105,22 +190,52 @@ public:
     }
 
     // delete all stf information
-    std::unique_lock lLock(mGlobalStfInfoLock);
-    mStfInfoMap.clear();
+    for (auto &lShard : mStfInfoShards) {
+      std::scoped_lock lLock(lShard.mLock);
+      lShard.mStfInfoMap.clear();
+      lShard.mStfDeadlines = decltype(lShard.mStfDeadlines)();
+    }
   }
 
   void addStfInfo(const StfSenderStfInfo &pStfInfo, SchedulerStfInfoResponse &pResponse);
 
-  void SchedulingThread();
+  void SchedulingThread(const std::size_t pWorkerIdx);
   void StaleCleanupThread();
   void HighWatermarkThread();
   void DropThread();
+  void BuildTfCompletionThread();
 
 
 private:
   /// Discard timeout for incomplete TFs
   static constexpr auto sStfDiscardTimeout = 5s;
 
+  /// Incomplete TF policy (DATADIST_TFSCHED_INCOMPLETE_*): TFs missing some STFs after the timeout are
+  /// built if they have at least mMinStfs STFs, including all required StfSenders
+  struct IncompleteTfPolicy {
+    std::size_t mMinStfs = 0; // 0: disabled
+    std::set<std::string> mRequiredStfSenders;
+    std::chrono::milliseconds mTimeout = 1000ms;
+  } mIncompletePolicy;
+
+  void configureIncompletePolicy();
+  bool acceptIncompleteTf(const std::vector<StfInfo> &pStfInfos) const;
+
+  /// StfSenders failing the health probes of the ConnManager. If the incomplete TF policy accepts TFs
+  /// without them, TFs are scheduled as soon as all reachable StfSenders sent their STF. Otherwise
+  /// the TFs waiting for them are dropped at once.
+  std::mutex mDeadStfSendersLock;
+    std::set<std::string> mDeadStfSenders;
+  std::atomic_size_t mNumDeadStfSenders = 0;
+  std::atomic_bool mScheduleWithoutDead = false;
+
+  void stfSenderStateChanged(const std::string &pStfSenderId, const bool pAlive);
+  bool reachableStfSendersComplete(const std::vector<StfInfo> &pStfInfos);
+
+  /// TF tracing (DATADIST_TRACE_SAMPLING): 1 in N TFs by the TF id, as in the StfBuilder
+  std::uint64_t mTraceSampling = 0;
+  void traceScheduledTf(const std::vector<StfInfo> &pStfInfos, const std::string &pTfBuilderId) const;
+
   std::atomic_bool mRunning = false;
 
   /// Discovery configuration
@@ -136,40 +251,134 @@ private:
   ConcurrentFifo<std::tuple<std::uint64_t>> mDropQueue;
   std::thread mDropThread;
 
-  /// Stfs global info
-  mutable std::mutex mGlobalStfInfoLock;
+  /// Stfs info, sharded by stf id
+  static constexpr std::size_t cNumStfInfoShards = 16;
+
+  /// Deadlines of TFs in the shard (min-heap): <deadline, stf id, type>
+  /// Stale deadlines are re-armed from the last STF update when they expire.
+  enum StfDeadlineType { eDeadlineStale, eDeadlineIncomplete };
+  using StfDeadline = std::tuple<std::chrono::steady_clock::time_point, std::uint64_t, StfDeadlineType>;
+
+  struct alignas(128) StfInfoShard {
+    std::mutex mLock;
+      std::map<std::uint64_t, std::vector<StfInfo>> mStfInfoMap;
+      // events are recorded with shardEvent(stf_id); 1h of running ~ 1MiB size in total
+      EventRecorder mDroppedStfs{24ULL * 3600 * 88 / cNumStfInfoShards};
+      EventRecorder mBuiltTfs{24ULL * 3600 * 88 / cNumStfInfoShards};
+      std::priority_queue<StfDeadline, std::vector<StfDeadline>, std::greater<StfDeadline>> mStfDeadlines;
+  };
+  std::array<StfInfoShard, cNumStfInfoShards> mStfInfoShards;
+
+  StfInfoShard& stfInfoShard(const std::uint64_t pStfId) { return mStfInfoShards[pStfId % cNumStfInfoShards]; }
+
+  /// Earliest deadline of all shards, the cleanup thread waits for it. Lowered by addStfInfo() when it
+  /// arms an earlier deadline (the cleanup thread is woken up), recomputed by the cleanup thread.
+  std::mutex mStfDeadlineLock;
+    std::condition_variable mStfDeadlineCondition;
+    std::atomic<std::chrono::steady_clock::rep> mNextStfDeadline =
+      std::numeric_limits<std::chrono::steady_clock::rep>::max();
+
+  void armStfDeadline(const std::chrono::steady_clock::time_point pDeadline) {
+    const auto lDeadline = pDeadline.time_since_epoch().count();
+    auto lOld = mNextStfDeadline.load();
+    if (lOld <= lDeadline) {
+      return;
+    }
+    while (lOld > lDeadline && !mNextStfDeadline.compare_exchange_weak(lOld, lDeadline)) { }
+    { // the cleanup thread checks mNextStfDeadline under the lock
+      std::scoped_lock lLock(mStfDeadlineLock);
+    }
+    mStfDeadlineCondition.notify_one();
+  }
+  static std::uint64_t shardEvent(const std::uint64_t pStfId) { return pStfId / cNumStfInfoShards; }
+
+  std::atomic_uint64_t mLastStfId = 0;
+  std::atomic_uint64_t mMaxCompletedTfId = 0;
+
+  static void atomicMax(std::atomic_uint64_t &pVal, const std::uint64_t pNewVal) {
+    auto lOld = pVal.load();
+    while (lOld < pNewVal && !pVal.compare_exchange_weak(lOld, pNewVal)) { }
+  }
+
+  /// Latest buffer status of each StfSender, written by addStfInfo, read by the watermark thread
+  /// Crossing of the high watermark is signaled to the watermark thread (mPending) once per crossing.
+  struct alignas(64) StfSenderSlot {
+    std::atomic_uint64_t mBufferSize = 0;
+    std::atomic_uint64_t mBufferUsed = 0;
+    std::atomic_bool mValid = false;
+    std::atomic_bool mAboveWatermark = false;
+    std::atomic_bool mPending = false;
+    std::atomic<std::chrono::steady_clock::rep> mCrossedTime = 0;
+  };
+  std::map<std::string, std::unique_ptr<StfSenderSlot>> mStfSenderSlots; // fixed by start()
+
+  static constexpr std::uint64_t sHighWatermarkPercent = 95;
+
+  void updateStfSenderSlot(const StfSenderStfInfo &pStfInfo);
+  /// drop old incomplete TFs holding buffers of the StfSender: <num dropped, dropped size>
+  std::tuple<std::uint64_t, std::uint64_t> freeStfSenderBuffer(const std::string &pStfsId);
+
+  std::mutex mMemWatermarkLock;
     std::condition_variable mMemWatermarkCondition;
-    std::map<std::uint64_t, std::vector<StfInfo>> mStfInfoMap;
-    std::map<std::string, StfSenderInfo> mStfSenderInfoMap;
-    std::uint64_t mLastStfId = 0;
-    std::uint64_t mMaxCompletedTfId = 0;
-    EventRecorder mDroppedStfs;
-    EventRecorder mBuiltTfs;
-
-    inline void requestDropAllLocked(const std::uint64_t lStfId) {
-      assert (mDroppedStfs.GetEvent(lStfId) == false);
-      mDroppedStfs.SetEvent(lStfId);
-      mStfInfoMap.erase(lStfId);
-      mDropQueue.push(std::make_tuple(lStfId));
-    }
-
-    inline void requestDropAllFromSchedule(const std::uint64_t lStfId) {
-      std::scoped_lock lLock(mGlobalStfInfoLock);
-      if (mDroppedStfs.GetEvent(lStfId) != false) {
-        EDDLOG_RL(1000, "Request for dripping of already discarded TF. tf_id={}", lStfId);
-      }
-      mDroppedStfs.SetEvent(lStfId);
-      mStfInfoMap.erase(lStfId);
-      mDropQueue.push(std::make_tuple(lStfId)); // TODO: add REASON
+    std::atomic_uint64_t mMemWatermarkPending = 0;
+
+  void scheduleIncompleteLocked(StfInfoShard &pShard, const std::uint64_t pStfId);
+
+  inline void requestDropAllLocked(StfInfoShard &pShard, const std::uint64_t lStfId) {
+    assert (pShard.mDroppedStfs.GetEvent(shardEvent(lStfId)) == false);
+    pShard.mDroppedStfs.SetEvent(shardEvent(lStfId));
+    pShard.mStfInfoMap.erase(lStfId);
+    mDropQueue.push(std::make_tuple(lStfId));
+  }
+
+  inline void requestDropAllFromSchedule(const std::uint64_t lStfId) {
+    auto &lShard = stfInfoShard(lStfId);
+    std::scoped_lock lLock(lShard.mLock);
+    if (lShard.mDroppedStfs.GetEvent(shardEvent(lStfId)) != false) {
+      EDDLOG_RL(1000, "Request for dripping of already discarded TF. tf_id={}", lStfId);
     }
+    lShard.mDroppedStfs.SetEvent(shardEvent(lStfId));
+    lShard.mStfInfoMap.erase(lStfId);
+    mDropQueue.push(std::make_tuple(lStfId)); // TODO: add REASON
+  }
 
-  /// scheduling thread & queue
-  ConcurrentFifo<std::vector<StfInfo>> mCompleteStfsInfoQueue;
-  std::thread mSchedulingThread;
+  /// scheduling threads & queues (DATADIST_TFSCHED_SCHED_THREADS): complete TFs are queued to the worker
+  /// of their TF-ID residue class. Workers share the TfBuilder selection, which reserves the TfBuilder memory.
+  static constexpr std::size_t cMaxSchedulingWorkers = 16;
+
+  struct alignas(128) SchedulingWorker {
+    ConcurrentFifo<std::vector<StfInfo>> mQueue;
+    std::thread mThread;
+    std::atomic_uint64_t mDecisions = 0;
+    std::atomic_uint64_t mBusyNs = 0;
+  };
+  std::array<SchedulingWorker, cMaxSchedulingWorkers> mSchedulingWorkers;
+  std::size_t mNumSchedulingWorkers = 1; // fixed by start()
+  std::chrono::steady_clock::time_point mSchedulingStatsTime;
+
+  void queueCompleteTf(std::vector<StfInfo> &&pStfInfos) {
+    const auto lTfId = pStfInfos.front().stf_id();
+    mSchedulingWorkers[lTfId % mNumSchedulingWorkers].mQueue.push(std::move(pStfInfos));
+  }
+
+  /// BuildTf requests in flight, completed by the BuildTfCompletionThread
+  static constexpr std::uint64_t sMaxBuildTfInFlight = 256;
+  std::unique_ptr<grpc::CompletionQueue> mBuildTfCq;
+  std::thread mBuildTfThread;
+  std::mutex mBuildTfInFlightLock;
+    std::condition_variable mBuildTfInFlightCond;
+    std::uint64_t mBuildTfInFlight = 0;
 
   /// memory watermark thread
   std::thread mWatermarkThread;
 
+  /// latency histograms, logged by the watermark thread
+  static constexpr auto sLatencyLogInterval = std::chrono::seconds(10);
+  LogLinearHistogram mTfCompleteUs;      // first to last STF update of a TF
+  LogLinearHistogram mTfScheduleUs;      // last STF update to the BuildTf request
+  LogLinearHistogram mWatermarkReactionUs;
+  void logLatencyStats();
+
   /// stale cleanup thread
   std::thread mStaleStfThread;
 };
@@ -19,6 +19,7 @@
 #include <set>
 #include <tuple>
 #include <algorithm>
+#include <limits>
 
 namespace o2
 {
@@ -27,6 +28,141 @@ namespace DataDistribution
 
 using namespace std::chrono_literals;
 
+TfBuilderSelectionPolicy TfSchedulerTfBuilderInfo::selectionPolicyFromEnv()
+{
+  const auto lPolicyVar = getenv("DATADIST_TFSCHED_TFB_POLICY");
+  const std::string lPolicy = lPolicyVar ? lPolicyVar : "round-robin";
+
+  TfBuilderSelectionPolicy lRet = TfBuilderSelectionPolicy::eRoundRobin;
+  if (lPolicy == "best-fit") {
+    lRet = TfBuilderSelectionPolicy::eBestFit;
+  } else if (lPolicy == "least-loaded") {
+    lRet = TfBuilderSelectionPolicy::eLeastLoaded;
+  } else if (lPolicy == "weighted") {
+    lRet = TfBuilderSelectionPolicy::eWeightedThroughput;
+  } else if (lPolicy == "topology") {
+    lRet = TfBuilderSelectionPolicy::eTopologyAware;
+  } else if (lPolicy != "round-robin") {
+    EDDLOG("TfBuilder selection policy is not valid. DATADIST_TFSCHED_TFB_POLICY={} using=round-robin", lPolicy);
+    return lRet;
+  }
+
+  IDDLOG("TfBuilder selection policy. policy={}", lPolicy);
+  return lRet;
+}
+
+void TfSchedulerTfBuilderInfo::addReadyTfBuilder(std::shared_ptr<TfBuilderInfo> pInfo)
+{
+  std::scoped_lock lLock(mReadyInfoLock);
+
+  if (pInfo->mReady) {
+    return;
+  }
+
+  // new TfBuilders join at the end of the round-robin, or at the current virtual time
+  if (mSelectionPolicy == TfBuilderSelectionPolicy::eWeightedThroughput) {
+    pInfo->mOrderKey = mReadyByOrder.empty() ? 0.0 : mReadyByOrder.begin()->first;
+  } else {
+    pInfo->mOrderKey = double(++mOrderSeq);
+  }
+  pInfo->mThroughputTime = std::chrono::system_clock::now();
+
+  pInfo->mMemoryKey = pInfo->availableTfSize();
+  mReadyByMemory.emplace(pInfo->mMemoryKey, pInfo.get());
+  mReadyByOrder.emplace(pInfo->mOrderKey, pInfo.get());
+  pInfo->mReady = true;
+  mReadyTfBuilders[pInfo->id()] = std::move(pInfo);
+}
+
+void TfSchedulerTfBuilderInfo::removeReadyTfBuilder(const std::string &pId)
+{
+  std::scoped_lock lLock(mReadyInfoLock);
+
+  const auto lIt = mReadyTfBuilders.find(pId);
+  if (lIt == mReadyTfBuilders.end()) {
+    return;
+  }
+
+  auto &lInfo = *lIt->second;
+  mReadyByMemory.erase({ lInfo.mMemoryKey, &lInfo });
+  mReadyByOrder.erase({ lInfo.mOrderKey, &lInfo });
+  lInfo.mReady = false;
+  mReadyTfBuilders.erase(lIt);
+
+  DDDLOG("Removed TfBuilder from the ready list. tfb_id={}", pId);
+}
+
+void TfSchedulerTfBuilderInfo::setEstimatedFreeMemory(TfBuilderInfo &pInfo, const std::uint64_t pFreeMemory)
+{
+  pInfo.mEstimatedFreeMemory = pFreeMemory;
+
+  const auto lMemoryKey = pInfo.availableTfSize();
+  if (pInfo.mReady && pInfo.mMemoryKey != lMemoryKey) {
+    mReadyByMemory.erase({ pInfo.mMemoryKey, &pInfo });
+    mReadyByMemory.emplace(lMemoryKey, &pInfo);
+  }
+  pInfo.mMemoryKey = lMemoryKey;
+}
+
+void TfSchedulerTfBuilderInfo::updateSizeEstimate(TfBuilderInfo &pInfo, const TfBuilderUpdateMessage &pTfBuilderUpdate)
+{
+  if (pTfBuilderUpdate.built_tfs_size() == 0) {
+    return;
+  }
+
+  for (const auto &lBuiltTf : pTfBuilderUpdate.built_tfs()) {
+    const auto lIt = std::find_if(pInfo.mScheduledTfs.cbegin(), pInfo.mScheduledTfs.cend(),
+      [&](const auto &pScheduled) { return pScheduled.first == lBuiltTf.tf_id(); });
+
+    if (lIt == pInfo.mScheduledTfs.cend() || lIt->second == 0) {
+      continue;
+    }
+
+    const double lRatio = double(lBuiltTf.tf_size()) / double(lIt->second);
+    pInfo.mSizeRatioDev = 0.75 * pInfo.mSizeRatioDev + 0.25 * std::abs(lRatio - pInfo.mSizeRatio);
+    pInfo.mSizeRatio = 0.875 * pInfo.mSizeRatio + 0.125 * lRatio;
+  }
+
+  // the index key depends on the estimate
+  setEstimatedFreeMemory(pInfo, pInfo.mEstimatedFreeMemory);
+}
+
+void TfSchedulerTfBuilderInfo::updateThroughput(TfBuilderInfo &pInfo, const std::uint64_t pLastBuiltTfId,
+  const std::chrono::system_clock::time_point pNow)
+{
+  std::uint64_t lBuiltSize = 0;
+  while (!pInfo.mScheduledTfs.empty() && pInfo.mScheduledTfs.front().first <= pLastBuiltTfId) {
+    lBuiltSize += pInfo.mScheduledTfs.front().second;
+    pInfo.mAcceptedTfs.erase(pInfo.mScheduledTfs.front().first);
+    pInfo.mScheduledTfs.pop_front();
+  }
+
+  if (lBuiltSize == 0) {
+    return;
+  }
+
+  const double lDuration = std::chrono::duration<double>(pNow - pInfo.mThroughputTime).count();
+  pInfo.mThroughputTime = pNow;
+  if (lDuration <= 0.0) {
+    return;
+  }
+
+  const double lThroughput = double(lBuiltSize) / lDuration;
+  pInfo.mThroughput = (pInfo.mThroughput == 0.0) ? lThroughput : (0.8 * pInfo.mThroughput + 0.2 * lThroughput);
+}
+
+std::uint64_t TfSchedulerTfBuilderInfo::segmentIngress(const std::string &pSegment,
+  const std::chrono::steady_clock::time_point pNow)
+{
+  auto &lIngress = mSegmentIngress[pSegment];
+
+  while (!lIngress.mTfs.empty() && (pNow - lIngress.mTfs.front().first) > sSegmentIngressWindow) {
+    lIngress.mBytes -= lIngress.mTfs.front().second;
+    lIngress.mTfs.pop_front();
+  }
+  return lIngress.mBytes;
+}
+
 void TfSchedulerTfBuilderInfo::updateTfBuilderInfo(const TfBuilderUpdateMessage &pTfBuilderUpdate)
 {
   using namespace std::chrono_literals;
@@ -78,39 +214,71 @@ void TfSchedulerTfBuilderInfo::updateTfBuilderInfo(const TfBuilderUpdateMessage
       std::scoped_lock lLockReady(mReadyInfoLock);
       lInfo->mUpdateLocalTime = lLocalTime;
 
+      updateSizeEstimate(*lInfo, pTfBuilderUpdate);
+      updateThroughput(*lInfo, pTfBuilderUpdate.last_built_tf_id(), lLocalTime);
+
       // update only when the last scheduled tf is built!
       if (pTfBuilderUpdate.last_built_tf_id() == lInfo->last_scheduled_tf_id()) {
         // store the new information
         lInfo->mTfBuilderUpdate = pTfBuilderUpdate;
+      }
 
-        // verify the memory estimation is correct
-        if (lInfo->mEstimatedFreeMemory > pTfBuilderUpdate.free_memory() ) {
-          DDDLOG("TfBuilder memory estimate is too high. tfb_id={:s} mem_estimate={}", lTfBuilderId,
-            (double(lInfo->mEstimatedFreeMemory) / double(pTfBuilderUpdate.free_memory())));
+      // The reported free memory comes from the region allocators, with the memory of all accepted TFs
+      // reserved. Only scheduled TFs not yet reported as accepted are not accounted for.
+      // NOTE: TFs are accepted out of order with several scheduling threads, they are tracked by id.
+      //       The TfBuilder rejects TFs it cannot fit, with ERROR_NOMEM.
+      for (const auto lTfId : pTfBuilderUpdate.accepted_tf_ids()) {
+        const auto lIt = std::lower_bound(lInfo->mScheduledTfs.cbegin(), lInfo->mScheduledTfs.cend(),
+          std::make_pair(lTfId, std::uint64_t(0)));
+        if (lIt != lInfo->mScheduledTfs.cend() && lIt->first == lTfId) {
+          lInfo->mAcceptedTfs.insert(lTfId);
         }
+      }
+      std::uint64_t lNotAccepted = 0;
+      for (const auto &[lTfId, lTfSize] : lInfo->mScheduledTfs) {
+        if (lInfo->mAcceptedTfs.count(lTfId) == 0) {
+          lNotAccepted += std::uint64_t(double(lTfSize) * lInfo->sizeFactor());
+        }
+      }
 
-        lInfo->mEstimatedFreeMemory = pTfBuilderUpdate.free_memory();
+      const auto lFreeMemory = pTfBuilderUpdate.free_memory();
+      if (lInfo->mEstimatedFreeMemory + lNotAccepted > lFreeMemory) {
+        DDDLOG_RL(5000, "TfBuilder memory estimate is too high. tfb_id={:s} mem_estimate={} free={} not_accepted={}",
+          lTfBuilderId, lInfo->mEstimatedFreeMemory, lFreeMemory, lNotAccepted);
+      }
+      setEstimatedFreeMemory(*lInfo, lFreeMemory - std::min(lFreeMemory, lNotAccepted));
+    }
+  } // mGlobalInfoLock unlock
+}
 
-      } else if (pTfBuilderUpdate.last_built_tf_id() < lInfo->last_scheduled_tf_id()) {
+void TfSchedulerTfBuilderInfo::unmarkTfBuilderWithTfId(const std::string& pTfBuilderId, const std::uint64_t pTfIf,
+  const std::uint64_t pSize)
+{
+  std::scoped_lock lLock(mGlobalInfoLock, mReadyInfoLock);
 
-        // update scheduler's estimate to be on the safe side
-        if (lInfo->mEstimatedFreeMemory > pTfBuilderUpdate.free_memory() ) {
+  const auto lIt = mGlobalInfo.find(pTfBuilderId);
+  if (lIt == mGlobalInfo.end()) {
+    return;
+  }
+  auto &lInfo = *lIt->second;
 
-          DDDLOG("Ignoring TfBuilder info (last_build < last_scheduled). Fixing the estimate ratio. "
-            "tfb_id={:s} new_mem_estimate={}", lTfBuilderId, pTfBuilderUpdate.free_memory());
+  const auto lTfIt = std::find_if(lInfo.mScheduledTfs.begin(), lInfo.mScheduledTfs.end(),
+    [&](const auto &pScheduled) { return pScheduled.first == pTfIf; });
+  if (lTfIt == lInfo.mScheduledTfs.end()) {
+    return;
+  }
+  lInfo.mScheduledTfs.erase(lTfIt);
+  lInfo.mAcceptedTfs.erase(pTfIf);
 
-          lInfo->mEstimatedFreeMemory = pTfBuilderUpdate.free_memory();
+  // the TfBuilder info is only refreshed when the last scheduled TF is built
+  if (lInfo.mLastScheduledTf == pTfIf) {
+    lInfo.mLastScheduledTf = lInfo.mScheduledTfs.empty() ? lInfo.last_built_tf_id() :
+      std::max(lInfo.mScheduledTfs.back().first, lInfo.last_built_tf_id());
+  }
 
-        } else {
-          // if (last_build > last_scheduled)
-          // NOTE: there is a "race" between notifying the EPN to build and updating last_scheduled_tf_id
-          // in our record. Thus, this codepath is possible, and we should update the est memory since we
-          // hold the lock
-          lInfo->mEstimatedFreeMemory = std::min(lInfo->mEstimatedFreeMemory, pTfBuilderUpdate.free_memory());
-        }
-      }
-    }
-  } // mGlobalInfoLock unlock
+  // return the estimate reservation, up to the last reported free memory
+  const std::uint64_t lTfEstSize = std::uint64_t(double(pSize) * lInfo.sizeFactor());
+  setEstimatedFreeMemory(lInfo, std::min(lInfo.mEstimatedFreeMemory + lTfEstSize, lInfo.mTfBuilderUpdate.free_memory()));
 }
 
 bool TfSchedulerTfBuilderInfo::findTfBuilderForTf(const std::uint64_t pSize, std::string& pTfBuilderId /*out*/)
@@ -118,49 +286,89 @@ bool TfSchedulerTfBuilderInfo::findTfBuilderForTf(const std::uint64_t pSize, std
   static std::atomic_uint64_t sNoTfBuilderAvailable = 0;
   static std::atomic_uint64_t sNoMemoryAvailable = 0;
 
-  // NOTE: we will overestimate memory requirement by a factor, until TfBuilder updates
-  //       us with the actual size.
-  const std::uint64_t lTfEstSize = pSize * (sTfSizeOverestimatePercent + 100) / 100;
-
+  // NOTE: the memory index is keyed by the largest announced TF size each TfBuilder can take, i.e.
+  //       the estimated free memory divided by the TfBuilder's size overestimate factor
   std::scoped_lock lLock(mReadyInfoLock);
 
-  uint64_t lMaxMem = 0;
-  auto lIt = mReadyTfBuilders.begin();
-  for (; lIt != mReadyTfBuilders.end(); ++lIt) {
-    lMaxMem = std::max(lMaxMem, (*lIt)->mEstimatedFreeMemory);
-    if ((*lIt)->mEstimatedFreeMemory >= lTfEstSize) {
-      break;
-    }
-  }
-
   // TfBuilder not found?
-  if ( lIt == mReadyTfBuilders.end() ) {
-    if (mReadyTfBuilders.empty()) {
+  if (mReadyByMemory.empty() || mReadyByMemory.rbegin()->first < pSize) {
+    if (mReadyByMemory.empty()) {
       ++sNoTfBuilderAvailable;
       WDDLOG_RL(1000, "FindTfBuilder: TF cannot be scheduled. reason=NO_TFBUILDERS total={}",
         sNoTfBuilderAvailable);
     } else {
       ++sNoMemoryAvailable;
       WDDLOG_RL(1000, "FindTfBuilder: TF cannot be scheduled. reason=NO_MEMORY total={} tf_size={} ready_tfb={}",
-        sNoMemoryAvailable, lTfEstSize, mReadyTfBuilders.size());
+        sNoMemoryAvailable, pSize, mReadyTfBuilders.size());
     }
     return false;
   }
 
-  // reposition the selected StfBuilder to the end of the list
-  auto lTfBuilder = std::move(*lIt);
+  TfBuilderInfo *lTfBuilder = nullptr;
+
+  switch (mSelectionPolicy) {
+    case TfBuilderSelectionPolicy::eBestFit:
+      lTfBuilder = mReadyByMemory.lower_bound({ pSize, nullptr })->second;
+      break;
+    case TfBuilderSelectionPolicy::eLeastLoaded:
+      lTfBuilder = mReadyByMemory.rbegin()->second;
+      break;
+    case TfBuilderSelectionPolicy::eTopologyAware:
+    {
+      // least loaded segment; round-robin within the segment
+      const auto lNow = std::chrono::steady_clock::now();
+      std::uint64_t lMinIngress = std::numeric_limits<std::uint64_t>::max();
 
-  assert (lTfBuilder->mEstimatedFreeMemory >= lTfEstSize);
+      for (const auto &lOrderInfo : mReadyByOrder) {
+        if (lOrderInfo.second->availableTfSize() < pSize) {
+          continue;
+        }
+        const auto lIngress = segmentIngress(lOrderInfo.second->mNetworkSegment, lNow);
+        if (lIngress < lMinIngress) {
+          lMinIngress = lIngress;
+          lTfBuilder = lOrderInfo.second;
+        }
+      }
+
+      auto &lSegment = mSegmentIngress[lTfBuilder->mNetworkSegment];
+      lSegment.mTfs.emplace_back(lNow, pSize);
+      lSegment.mBytes += pSize;
+      break;
+    }
+    case TfBuilderSelectionPolicy::eRoundRobin:
+    case TfBuilderSelectionPolicy::eWeightedThroughput:
+      // at least one TfBuilder fits. The scan stops at the first TfBuilder in the policy order which fits: TfBuilders
+      // without memory for the TF get no new TFs, and are not the first in the order for long.
+      for (const auto &lOrderInfo : mReadyByOrder) {
+        if (lOrderInfo.second->availableTfSize() >= pSize) {
+          lTfBuilder = lOrderInfo.second;
+          break;
+        }
+      }
+      break;
+  }
+
+  assert (lTfBuilder && lTfBuilder->availableTfSize() >= pSize);
+
+  const std::uint64_t lTfEstSize = std::min(lTfBuilder->mEstimatedFreeMemory,
+    std::uint64_t(double(pSize) * lTfBuilder->sizeFactor()));
 
   // copy the string out
   assert (!lTfBuilder->id().empty());
   pTfBuilderId = lTfBuilder->id();
 
-  // deque erase reverse_iterator
-  mReadyTfBuilders.erase(lIt);
+  setEstimatedFreeMemory(*lTfBuilder, lTfBuilder->mEstimatedFreeMemory - lTfEstSize);
 
-  lTfBuilder->mEstimatedFreeMemory -= lTfEstSize;
-  mReadyTfBuilders.push_back(std::move(lTfBuilder));
+  // reposition the selected TfBuilder in the order index
+  mReadyByOrder.erase({ lTfBuilder->mOrderKey, lTfBuilder });
+  if (mSelectionPolicy == TfBuilderSelectionPolicy::eWeightedThroughput) {
+    // assume 1 GiB/s until the throughput is measured
+    const double lThroughput = (lTfBuilder->mThroughput > 0.0) ? lTfBuilder->mThroughput : double(1ULL << 30);
+    lTfBuilder->mOrderKey += double(pSize) / lThroughput;
+  } else {
+    lTfBuilder->mOrderKey = double(++mOrderSeq);
+  }
+  mReadyByOrder.emplace(lTfBuilder->mOrderKey, lTfBuilder);
 
   return true;
 }
@@ -177,7 +385,8 @@ void TfSchedulerTfBuilderInfo::HousekeepingThread()
     std::this_thread::sleep_for(2000ms);
 
     {
-      std::scoped_lock lLock(mGlobalInfoLock);
+      std::scoped_lock lLock(mGlobalInfoLock, mReadyInfoLock);
+      double lSizeErrorMean = 0.0;
 
       // reap stale TfBuilders
       assert (lIdsToErase.empty());
@@ -189,9 +398,16 @@ void TfSchedulerTfBuilderInfo::HousekeepingThread()
           lIdsToErase.push_back(lInfo->mTfBuilderUpdate.info().process_id());
         }
 
-        DDDLOG("TfBuilder information: tfb_id={:s} free_memory={:d} num_buffered_tfs={:d}",
-          lInfo->mTfBuilderUpdate.info().process_id(), lInfo->mTfBuilderUpdate.free_memory(),
-          lInfo->mTfBuilderUpdate.num_buffered_tfs());
+        DDDLOG("TfBuilder information: tfb_id={:s} free_memory={:d} num_buffered_tfs={:d} size_ratio={:.4} "
+          "size_ratio_dev={:.4}", lInfo->mTfBuilderUpdate.info().process_id(), lInfo->mTfBuilderUpdate.free_memory(),
+          lInfo->mTfBuilderUpdate.num_buffered_tfs(), lInfo->mSizeRatio, lInfo->mSizeRatioDev);
+
+        lSizeErrorMean += lInfo->mSizeRatioDev / mGlobalInfo.size();
+      }
+
+      if (!mGlobalInfo.empty()) {
+        IDDLOG_RL(10000, "TfBuilder TF size estimate. mean_ratio_error={:.4} num_tfbuilders={}",
+          lSizeErrorMean, mGlobalInfo.size());
       }
 
     } // mGlobalInfoLock unlock (to be able to sleep)
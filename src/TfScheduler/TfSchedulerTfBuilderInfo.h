@@ -28,6 +28,10 @@
 #include <vector>
 #include <map>
 #include <deque>
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <unordered_map>
 #include <thread>
 #include <chrono>
 
@@ -44,6 +48,30 @@ struct TfBuilderInfo {
   std::uint64_t mLastScheduledTf = 0;
   std::uint64_t mEstimatedFreeMemory;
 
+  // ready index state (see TfSchedulerTfBuilderInfo)
+  bool mReady = false;
+  double mOrderKey = 0.0;
+
+  // throughput estimate: TFs scheduled, but not yet reported as built <tf id, size>
+  std::deque<std::pair<std::uint64_t, std::uint64_t>> mScheduledTfs;
+  std::set<std::uint64_t> mAcceptedTfs; // scheduled TFs reported as accepted (reserved in the free memory)
+  double mThroughput = 0.0; // bytes / s
+  std::chrono::system_clock::time_point mThroughputTime;
+
+  // topology aware placement
+  std::string mNetworkSegment;
+
+  // TF size estimate: EWMA of the actual/announced size ratio and of its deviation
+  // starts with 10% overestimation until the TfBuilder reports built TF sizes
+  double mSizeRatio = 1.1;
+  double mSizeRatioDev = 0.0;
+  std::uint64_t mMemoryKey = 0; // key in the memory index
+
+  // overestimate of the announced TF size
+  double sizeFactor() const { return std::clamp(mSizeRatio + 2.0 * mSizeRatioDev, 1.0, 2.0); }
+  // largest announced TF size that fits the estimated free memory
+  std::uint64_t availableTfSize() const { return std::uint64_t(double(mEstimatedFreeMemory) / sizeFactor()); }
+
   TfBuilderInfo() = delete;
 
   TfBuilderInfo(std::chrono::system_clock::time_point pUpdateLocalTime, const TfBuilderUpdateMessage &pTfBuilderUpdate)
@@ -51,6 +79,14 @@ struct TfBuilderInfo {
     mTfBuilderUpdate(pTfBuilderUpdate)
   {
     mEstimatedFreeMemory = mTfBuilderUpdate.free_memory();
+
+    // network segment: the switch label, or the rack
+    const auto &lTopology = mTfBuilderUpdate.info().topology();
+    if (lTopology.count("switch") > 0) {
+      mNetworkSegment = lTopology.at("switch");
+    } else if (lTopology.count("rack") > 0) {
+      mNetworkSegment = lTopology.at("rack");
+    }
   }
 
   const std::string& id() const { return mTfBuilderUpdate.info().process_id(); }
@@ -58,6 +94,15 @@ struct TfBuilderInfo {
   std::uint64_t last_built_tf_id() const { return mTfBuilderUpdate.last_built_tf_id(); }
 };
 
+/// TfBuilder selection policy (DATADIST_TFSCHED_TFB_POLICY)
+enum class TfBuilderSelectionPolicy {
+  eRoundRobin,          // least recently scheduled TfBuilder with enough memory (default)
+  eBestFit,             // TfBuilder with the least free memory that fits the TF
+  eLeastLoaded,         // TfBuilder with the most free memory
+  eWeightedThroughput,  // round-robin weighted by the measured build throughput
+  eTopologyAware        // TfBuilder in the network segment with the least recent ingress
+};
+
 class TfSchedulerTfBuilderInfo
 {
  public:
@@ -72,6 +117,7 @@ class TfSchedulerTfBuilderInfo
 
   void start() {
     mGlobalInfo.clear();
+    mSelectionPolicy = selectionPolicyFromEnv();
 
     mRunning = true;
     // start gRPC client monitoring thread
@@ -93,6 +139,9 @@ class TfSchedulerTfBuilderInfo
     {
       std::scoped_lock lLock(mReadyInfoLock);
       mReadyTfBuilders.clear();
+      mReadyByMemory.clear();
+      mReadyByOrder.clear();
+      mSegmentIngress.clear();
     }
   }
 
@@ -100,40 +149,38 @@ class TfSchedulerTfBuilderInfo
 
   void updateTfBuilderInfo(const TfBuilderUpdateMessage &pTfBuilderUpdate);
 
-  void addReadyTfBuilder(std::shared_ptr<TfBuilderInfo> pInfo)
-  {
-    std::scoped_lock lLock(mReadyInfoLock);
-    mReadyTfBuilders.push_back(std::move(pInfo));
-  }
-
-  void removeReadyTfBuilder(const std::string &pId)
-  {
-    std::scoped_lock lLock(mReadyInfoLock);
-    for (auto it = mReadyTfBuilders.begin(); it != mReadyTfBuilders.end(); it++) {
-      if ((*it)->id() == pId) {
-        DDDLOG("Removed TfBuilder from the ready list. tfb_id={}", pId);
-        mReadyTfBuilders.erase(it);
-        break;
-      }
-    }
-  }
+  void addReadyTfBuilder(std::shared_ptr<TfBuilderInfo> pInfo);
+  void removeReadyTfBuilder(const std::string &pId);
 
   bool findTfBuilderForTf(const std::uint64_t pSize, std::string& pTfBuilderId /*out*/);
 
-  bool markTfBuilderWithTfId(const std::string& pTfBuilderId, const std::uint64_t pTfIf)
+  /// pSize: announced size of the TF, as passed to findTfBuilderForTf()
+  /// NOTE: with several scheduling threads, TFs of a TfBuilder can be marked out of order
+  bool markTfBuilderWithTfId(const std::string& pTfBuilderId, const std::uint64_t pTfIf, const std::uint64_t pSize)
   {
     std::scoped_lock lLock(mGlobalInfoLock, mReadyInfoLock);
     if (mGlobalInfo.count(pTfBuilderId) > 0) {
-      mGlobalInfo[pTfBuilderId]->mLastScheduledTf = pTfIf;
+      auto &lInfo = mGlobalInfo[pTfBuilderId];
+      lInfo->mLastScheduledTf = std::max(lInfo->mLastScheduledTf, pTfIf);
+      if (lInfo->mScheduledTfs.empty()) {
+        // do not count the idle time in the throughput
+        lInfo->mThroughputTime = std::chrono::system_clock::now();
+      }
+      // keep ordered by the tf id
+      auto lPos = lInfo->mScheduledTfs.end();
+      while (lPos != lInfo->mScheduledTfs.begin() && std::prev(lPos)->first > pTfIf) {
+        --lPos;
+      }
+      lInfo->mScheduledTfs.emplace(lPos, pTfIf, pSize);
       return true;
     }
     return false;
   }
 
-private:
-  /// Overestimation of actual size for TF building
-  static constexpr std::uint64_t sTfSizeOverestimatePercent = std::uint64_t(10);
+  /// Undo markTfBuilderWithTfId() and the memory reserved by findTfBuilderForTf(): the TF was not accepted
+  void unmarkTfBuilderWithTfId(const std::string& pTfBuilderId, const std::uint64_t pTfIf, const std::uint64_t pSize);
 
+private:
   /// Discard timeout for non-complete TFs
   static constexpr auto sTfBuilderDiscardTimeout = 5s;
 
@@ -148,9 +195,35 @@ private:
   mutable std::recursive_mutex mGlobalInfoLock;
     std::unordered_map<std::string, std::shared_ptr<TfBuilderInfo>> mGlobalInfo;
 
-  /// List of TfBuilders with available resources
+  /// TfBuilders with available resources, indexed by estimated free memory and by the policy order
+  /// (last scheduling for round-robin, virtual time for weighted)
   mutable std::recursive_mutex mReadyInfoLock;
-    std::deque<std::shared_ptr<TfBuilderInfo>> mReadyTfBuilders;
+    TfBuilderSelectionPolicy mSelectionPolicy = TfBuilderSelectionPolicy::eRoundRobin;
+    std::unordered_map<std::string, std::shared_ptr<TfBuilderInfo>> mReadyTfBuilders;
+    std::set<std::pair<std::uint64_t, TfBuilderInfo*>> mReadyByMemory;
+    std::set<std::pair<double, TfBuilderInfo*>> mReadyByOrder;
+    std::uint64_t mOrderSeq = 0;
+
+    /// Bytes scheduled to each network segment over the sliding window
+    static constexpr auto sSegmentIngressWindow = std::chrono::seconds(2);
+    struct SegmentIngress {
+      std::deque<std::pair<std::chrono::steady_clock::time_point, std::uint64_t>> mTfs;
+      std::uint64_t mBytes = 0;
+    };
+    std::unordered_map<std::string, SegmentIngress> mSegmentIngress;
+
+  // bytes scheduled to the segment within the window (mReadyInfoLock must be held)
+  std::uint64_t segmentIngress(const std::string &pSegment, const std::chrono::steady_clock::time_point pNow);
+
+  static TfBuilderSelectionPolicy selectionPolicyFromEnv();
+
+  // update the estimate and the memory index (mReadyInfoLock must be held)
+  void setEstimatedFreeMemory(TfBuilderInfo &pInfo, const std::uint64_t pFreeMemory);
+  // update the size estimate with the actual TF sizes (mReadyInfoLock must be held)
+  void updateSizeEstimate(TfBuilderInfo &pInfo, const TfBuilderUpdateMessage &pTfBuilderUpdate);
+  // update the throughput estimate with TFs built since the last update (mReadyInfoLock must be held)
+  void updateThroughput(TfBuilderInfo &pInfo, const std::uint64_t pLastBuiltTfId,
+    const std::chrono::system_clock::time_point pNow);
 };
 
 }
@@ -0,0 +1,146 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef DATADIST_BENCHMARK_H_
+#define DATADIST_BENCHMARK_H_
+
+#include <boost/program_options.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace o2::DataDistribution
+{
+
+/// Minimal benchmark harness
+///
+/// Every benchmark runs one untimed warm-up and --reps timed repetitions. One JSON object per line is
+/// written for every benchmark (stdout, or appended to --output), labeled with --tag, so that results
+/// of different builds can be compared. Per-operation times are taken from the median repetition.
+class DataDistBenchmark
+{
+ public:
+  /// Measures only the sections between start() and stop(), for benchmarks with per-repetition setup
+  class Timer {
+   public:
+    void start() { mStart = std::chrono::steady_clock::now(); }
+    void stop() { mElapsed += std::chrono::steady_clock::now() - mStart; }
+   private:
+    friend class DataDistBenchmark;
+    std::chrono::steady_clock::time_point mStart;
+    std::chrono::steady_clock::duration mElapsed{0};
+  };
+
+  DataDistBenchmark(const std::string &pSuite, int argc, char* argv[])
+    : mSuite(pSuite)
+  {
+    namespace bpo = boost::program_options;
+
+    bpo::options_description lOptions(pSuite + " options", 120);
+    lOptions.add_options()
+      ("help,h", "Print help")
+      ("reps", bpo::value<unsigned>(&mReps)->default_value(5), "Timed repetitions of every benchmark.")
+      ("filter", bpo::value<std::string>(&mFilter)->default_value(""), "Run benchmarks with names containing the string.")
+      ("tag", bpo::value<std::string>(&mTag)->default_value(""), "Label of the results (e.g. the release tag).")
+      ("output", bpo::value<std::string>(&mOutputFile)->default_value(""), "Append results to the file (JSON lines).");
+
+    bpo::variables_map lVm;
+    try {
+      bpo::store(bpo::parse_command_line(argc, argv, lOptions), lVm);
+      bpo::notify(lVm);
+    } catch (const std::exception &e) {
+      std::cerr << "Invalid options: " << e.what() << std::endl;
+      mValid = false;
+      return;
+    }
+
+    if (lVm.count("help")) {
+      std::cout << lOptions << std::endl;
+      mValid = false;
+      return;
+    }
+
+    mReps = std::max(mReps, 1u);
+    if (!mOutputFile.empty()) {
+      mOutput.open(mOutputFile, std::ios::app);
+      if (!mOutput) {
+        std::cerr << "Cannot open the output file: " << mOutputFile << std::endl;
+        mValid = false;
+      }
+    }
+  }
+
+  bool valid() const { return mValid; }
+
+  bool enabled(const std::string &pName) const
+  {
+    return mFilter.empty() || pName.find(mFilter) != std::string::npos;
+  }
+
+  /// pFn(Timer&) performs pOps operations, moving pBytes bytes (0: not applicable)
+  template <typename F>
+  void runTimed(const std::string &pName, const std::uint64_t pOps, const std::uint64_t pBytes, F &&pFn)
+  {
+    if (!enabled(pName)) {
+      return;
+    }
+
+    { Timer lWarmup; pFn(lWarmup); }
+
+    std::vector<double> lNs;
+    for (unsigned r = 0; r < mReps; r++) {
+      Timer lTimer;
+      pFn(lTimer);
+      lNs.push_back(double(std::chrono::duration_cast<std::chrono::nanoseconds>(lTimer.mElapsed).count()));
+    }
+    std::sort(lNs.begin(), lNs.end());
+
+    const double lOps = double(std::max(pOps, std::uint64_t(1)));
+    const double lMedian = lNs[lNs.size() / 2];
+
+    const auto lLine = fmt::format("{{\"suite\":\"{}\",\"benchmark\":\"{}\",\"tag\":\"{}\",\"reps\":{},\"ops\":{},"
+      "\"bytes\":{},\"ns_per_op\":{:.3f},\"ns_per_op_min\":{:.3f},\"ns_per_op_max\":{:.3f},\"ops_per_s\":{:.1f},"
+      "\"mb_per_s\":{:.1f}}}",
+      mSuite, pName, mTag, mReps, pOps, pBytes, lMedian / lOps, lNs.front() / lOps, lNs.back() / lOps,
+      lMedian > 0 ? (lOps * 1e9 / lMedian) : 0.0, lMedian > 0 ? (double(pBytes) * 1e3 / lMedian) : 0.0);
+
+    (mOutput.is_open() ? static_cast<std::ostream&>(mOutput) : std::cout) << lLine << std::endl;
+  }
+
+  /// pFn() is timed as a whole
+  template <typename F>
+  void run(const std::string &pName, const std::uint64_t pOps, const std::uint64_t pBytes, F &&pFn)
+  {
+    runTimed(pName, pOps, pBytes, [&](Timer &pTimer) { pTimer.start(); pFn(); pTimer.stop(); });
+  }
+
+ private:
+  std::string mSuite;
+  unsigned mReps = 5;
+  std::string mFilter;
+  std::string mTag;
+  std::string mOutputFile;
+  std::ofstream mOutput;
+  bool mValid = true;
+};
+
+} /* namespace o2::DataDistribution */
+
+#endif /* DATADIST_BENCHMARK_H_ */
@@ -0,0 +1,490 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/// End-to-end pipeline benchmark in one process, on the shared memory transport
+///
+/// FLP side (per FLP): readout data region -> SubTimeFrameReadoutBuilder -> CoalescedHdrDataSerializer
+/// EPN side (per EPN): receiver per FLP channel -> CoalescedHdrDataDeserializer -> TF merger
+///
+/// TFs are assigned to EPNs by a stub scheduler (round robin on the TF id). The stages are wired the same
+/// way as in StfBuilder, StfSender and TfBuilder, without the devices, RPC and the discovery service.
+/// Reports sustained TF/s and GB/s, CPU per stage and the occupancy of the memory regions.
+
+#include <MemoryUtils.h>
+#include <SubTimeFrameBuilder.h>
+#include <SubTimeFrameVisitors.h>
+#include <ReadoutDataModel.h>
+#include <ConcurrentQueue.h>
+
+#include <fairmq/FairMQTransportFactory.h>
+#include <fairmq/FairMQChannel.h>
+
+#include <Headers/RAWDataHeader.h>
+
+#include <boost/program_options.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+#include <unistd.h>
+
+using namespace o2::DataDistribution;
+using namespace std::chrono_literals;
+
+namespace
+{
+
+constexpr std::size_t cPageSize = 8192;
+
+struct EndToEndConfig {
+  unsigned mNumFlps = 2;
+  unsigned mNumEpns = 2;
+  unsigned mNumEquipments = 12;
+  unsigned mHbfsPerStf = 128;
+  unsigned mPagesPerHbf = 2;
+  unsigned mMaxInFlight = 8;
+  std::size_t mReadoutRegionMb = 1024;
+  std::size_t mTfHeaderRegionMb = 256;
+  bool mHeaderBlocks = false;
+  double mWarmup = 1.0;
+  double mDuration = 10.0;
+  std::string mTag;
+  std::string mOutputFile;
+
+  std::size_t hbfSize() const { return mPagesPerHbf * cPageSize + sizeof(o2::header::RAWDataHeaderV6); }
+};
+
+// CPU time of the calling thread
+std::uint64_t threadCpuNs()
+{
+  timespec lTs;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &lTs);
+  return std::uint64_t(lTs.tv_sec) * 1000000000ULL + std::uint64_t(lTs.tv_nsec);
+}
+
+enum Stage { eStfBuild, eStfSend, eTfReceive, eTfDeserialize, eTfMerge, eNumStages };
+const char* cStageNames[eNumStages] = { "stf_build", "stf_send", "tf_receive", "tf_deserialize", "tf_merge" };
+
+// stub scheduler: TFs are assigned to EPNs round robin
+inline unsigned scheduleTf(const std::uint64_t pTfId, const unsigned pNumEpns)
+{
+  return unsigned(pTfId % pNumEpns);
+}
+
+// RDHv6 HBFrame: data pages and a header-only stop page
+void writeHbFrame(char *pData, const unsigned pPages, const std::uint16_t pFeeId, const std::uint32_t pOrbit)
+{
+  using RDH = o2::header::RAWDataHeaderV6;
+
+  for (unsigned p = 0; p <= pPages; p++) {
+    const bool lStop = (p == pPages);
+    RDH lRdh;
+    lRdh.feeId = pFeeId;
+    lRdh.linkID = std::uint8_t(pFeeId);
+    lRdh.cruID = 0x20;
+    lRdh.orbit = pOrbit;
+    lRdh.memorySize = std::uint16_t(lStop ? sizeof(RDH) : cPageSize);
+    lRdh.offsetToNext = std::uint16_t(lStop ? sizeof(RDH) : cPageSize);
+    lRdh.pageCnt = std::uint16_t(p);
+    lRdh.stop = lStop;
+    std::memcpy(pData + p * cPageSize, &lRdh, sizeof(RDH));
+  }
+}
+
+struct RegionOccupancy {
+  double mSum = 0;
+  double mMax = 0;
+  std::uint64_t mSamples = 0;
+
+  void sample(const std::size_t pSize, const std::size_t pFree)
+  {
+    const double lOcc = pSize ? (100.0 * double(pSize - std::min(pSize, pFree)) / double(pSize)) : 0.0;
+    mSum += lOcc;
+    mMax = std::max(mMax, lOcc);
+    mSamples++;
+  }
+
+  double mean() const { return mSamples ? (mSum / double(mSamples)) : 0.0; }
+};
+
+bool parseOptions(int argc, char* argv[], EndToEndConfig &pCfg)
+{
+  namespace bpo = boost::program_options;
+
+  bpo::options_description lOptions("end_to_end options", 120);
+  lOptions.add_options()
+    ("help,h", "Print help")
+    ("flps", bpo::value<unsigned>(&pCfg.mNumFlps)->default_value(pCfg.mNumFlps), "Number of FLPs (StfBuilder and StfSender stages).")
+    ("epns", bpo::value<unsigned>(&pCfg.mNumEpns)->default_value(pCfg.mNumEpns), "Number of EPNs (TfBuilder stages).")
+    ("equipments", bpo::value<unsigned>(&pCfg.mNumEquipments)->default_value(pCfg.mNumEquipments), "Equipments (links) per FLP.")
+    ("hbfs-per-stf", bpo::value<unsigned>(&pCfg.mHbfsPerStf)->default_value(pCfg.mHbfsPerStf), "HBFrames per equipment in a STF.")
+    ("pages-per-hbf", bpo::value<unsigned>(&pCfg.mPagesPerHbf)->default_value(pCfg.mPagesPerHbf), "8 KiB RDH pages per HBFrame.")
+    ("max-inflight", bpo::value<unsigned>(&pCfg.mMaxInFlight)->default_value(pCfg.mMaxInFlight), "TFs built but not yet merged.")
+    ("readout-region-mb", bpo::value<std::size_t>(&pCfg.mReadoutRegionMb)->default_value(pCfg.mReadoutRegionMb), "Readout data region size per FLP (MiB).")
+    ("tf-header-region-mb", bpo::value<std::size_t>(&pCfg.mTfHeaderRegionMb)->default_value(pCfg.mTfHeaderRegionMb), "TfBuilder header region size per EPN (MiB).")
+    ("header-blocks", bpo::bool_switch(&pCfg.mHeaderBlocks), "Send STF headers as header blocks.")
+    ("warmup", bpo::value<double>(&pCfg.mWarmup)->default_value(pCfg.mWarmup), "Seconds before the measurement starts.")
+    ("duration", bpo::value<double>(&pCfg.mDuration)->default_value(pCfg.mDuration), "Seconds of measurement.")
+    ("tag", bpo::value<std::string>(&pCfg.mTag)->default_value(""), "Label of the results (e.g. the release tag).")
+    ("output", bpo::value<std::string>(&pCfg.mOutputFile)->default_value(""), "Append results to the file (JSON lines).");
+
+  bpo::variables_map lVm;
+  try {
+    bpo::store(bpo::parse_command_line(argc, argv, lOptions), lVm);
+    bpo::notify(lVm);
+  } catch (const std::exception &e) {
+    std::cerr << "Invalid options: " << e.what() << std::endl;
+    return false;
+  }
+
+  if (lVm.count("help")) {
+    std::cout << lOptions << std::endl;
+    return false;
+  }
+
+  if (pCfg.mNumFlps == 0 || pCfg.mNumEpns == 0 || pCfg.mNumEquipments == 0 || pCfg.mHbfsPerStf == 0 ||
+    pCfg.mPagesPerHbf == 0 || pCfg.mMaxInFlight == 0) {
+    std::cerr << "Invalid options: counts must be greater than zero" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} /* namespace */
+
+int main(int argc, char* argv[])
+{
+  EndToEndConfig lCfg;
+  if (!parseOptions(argc, argv, lCfg)) {
+    return -1;
+  }
+
+  std::ofstream lOutput;
+  if (!lCfg.mOutputFile.empty()) {
+    lOutput.open(lCfg.mOutputFile, std::ios::app);
+    if (!lOutput) {
+      std::cerr << "Cannot open the output file: " << lCfg.mOutputFile << std::endl;
+      return -1;
+    }
+  }
+
+  ReadoutDataUtils::sRdhVersion = ReadoutDataUtils::eRdhVer6;
+  RDHReader::Initialize(6);
+
+  const unsigned lNumFlps = lCfg.mNumFlps;
+  const unsigned lNumEpns = lCfg.mNumEpns;
+  const std::size_t lHbfSize = lCfg.hbfSize();
+  const std::uint64_t lStfSize = std::uint64_t(lCfg.mNumEquipments) * lCfg.mHbfsPerStf * lHbfSize;
+
+  auto lTransport = FairMQTransportFactory::CreateTransportFactory("shmem", "datadist-e2e-" + std::to_string(getpid()));
+
+  // FLP side: one data region per FLP, the header region is shared by all STF builders
+  MemoryResources lReadoutMemRes(lTransport);
+  ReadoutDataContext lReadoutCtx;
+
+  std::vector<std::unique_ptr<RegionAllocatorResource<>>> lReadoutRegions;
+  std::vector<std::unique_ptr<SubTimeFrameReadoutBuilder>> lStfBuilders;
+  for (unsigned f = 0; f < lNumFlps; f++) {
+    lReadoutRegions.push_back(std::make_unique<RegionAllocatorResource<>>(fmt::format("Readout_FLP{}", f),
+      *lTransport, lCfg.mReadoutRegionMb << 20, 0, lReadoutMemRes.mAllocStrategy));
+    lStfBuilders.push_back(std::make_unique<SubTimeFrameReadoutBuilder>(lReadoutMemRes, false, lReadoutCtx,
+      f == 0 /* create the header region */, true /* concurrent allocation */));
+  }
+
+  // EPN side
+  std::vector<std::unique_ptr<SyncMemoryResources>> lTfMemRes;
+  std::vector<std::unique_ptr<TimeFrameBuilder>> lTfBuilders;
+  for (unsigned e = 0; e < lNumEpns; e++) {
+    lTfMemRes.push_back(std::make_unique<SyncMemoryResources>(lTransport));
+    lTfBuilders.push_back(std::make_unique<TimeFrameBuilder>(*lTfMemRes.back(), false));
+    // payloads arrive in the readout regions, the data region is not used on the shm transport
+    lTfBuilders.back()->allocate_memory(std::size_t(64) << 20, lCfg.mTfHeaderRegionMb << 20);
+  }
+
+  // one pair channel for every (FLP, EPN)
+  std::vector<std::unique_ptr<FairMQChannel>> lOutChans;
+  std::vector<std::unique_ptr<FairMQChannel>> lInChans;
+  for (unsigned f = 0; f < lNumFlps; f++) {
+    for (unsigned e = 0; e < lNumEpns; e++) {
+      const auto lAddress = fmt::format("inproc://datadist-e2e-{}-{}-{}", getpid(), f, e);
+      lOutChans.push_back(std::make_unique<FairMQChannel>(fmt::format("flp{}-epn{}", f, e), "pair", lTransport));
+      lInChans.push_back(std::make_unique<FairMQChannel>(fmt::format("epn{}-flp{}", e, f), "pair", lTransport));
+      if (!lOutChans.back()->Bind(lAddress) || !lInChans.back()->Connect(lAddress)) {
+        std::cerr << "Cannot connect the benchmark channels: " << lAddress << std::endl;
+        return -1;
+      }
+    }
+  }
+  auto lChanIdx = [lNumEpns](const unsigned pFlp, const unsigned pEpn) { return pFlp * lNumEpns + pEpn; };
+
+  // queues between the stages
+  std::vector<ConcurrentFifo<std::unique_ptr<SubTimeFrame>>> lSendQueues(lNumFlps);
+  std::vector<ConcurrentFifo<std::unique_ptr<std::vector<FairMQMessagePtr>>>> lRecvQueues(lNumEpns);
+  std::vector<ConcurrentFifo<std::unique_ptr<SubTimeFrame>>> lMergeQueues(lNumEpns);
+
+  // counters
+  std::atomic_bool lBuilding = true;
+  std::atomic_bool lSendersDone = false;
+  std::vector<std::atomic_uint64_t> lSent(lNumFlps * lNumEpns);
+  std::vector<std::atomic_uint64_t> lReceived(lNumFlps * lNumEpns);
+  std::atomic_uint64_t lTfsCompleted = 0;
+  std::atomic_uint64_t lTfBytes = 0;
+  std::atomic_uint64_t lTfsIncomplete = 0;
+  std::atomic_uint64_t lErrors = 0;
+  std::atomic_uint64_t lStageCpuNs[eNumStages] = { };
+
+  std::vector<std::thread> lBuilderThreads, lSenderThreads, lReceiverThreads, lDeserializerThreads, lMergerThreads;
+
+  const auto lRunStart = std::chrono::steady_clock::now();
+
+  for (unsigned f = 0; f < lNumFlps; f++) {
+    // readout and STF building
+    lBuilderThreads.emplace_back([&, f]() {
+      auto &lBuilder = *lStfBuilders[f];
+      auto &lRegion = *lReadoutRegions[f];
+      std::vector<FairMQMessagePtr> lHbFrames;
+      lHbFrames.reserve(lCfg.mHbfsPerStf);
+
+      for (std::uint32_t lTfId = 1; lBuilding; lTfId++) {
+        // flow control: the STF sender would otherwise buffer without limit
+        while (lBuilding && (lTfId - 1) >= (lTfsCompleted + lCfg.mMaxInFlight)) {
+          std::this_thread::sleep_for(50us);
+        }
+
+        for (unsigned lEq = 0; lBuilding && lEq < lCfg.mNumEquipments; lEq++) {
+          const auto lSubSpec = f * lCfg.mNumEquipments + lEq;
+
+          lHbFrames.clear();
+          for (unsigned h = 0; h < lCfg.mHbfsPerStf; h++) {
+            auto lMsg = lRegion.NewFairMQMessage(lHbfSize);
+            if (!lMsg) {
+              break; // region stopped
+            }
+            writeHbFrame(reinterpret_cast<char*>(lMsg->GetData()), lCfg.mPagesPerHbf, std::uint16_t(lSubSpec),
+              lTfId * lCfg.mHbfsPerStf + h);
+            lHbFrames.push_back(std::move(lMsg));
+          }
+          if (lHbFrames.size() != lCfg.mHbfsPerStf) {
+            break;
+          }
+
+          ReadoutSubTimeframeHeader lHdr;
+          lHdr.mTimeFrameId = lTfId;
+          lHdr.mTimeframeOrbitFirst = lTfId * lCfg.mHbfsPerStf;
+          lHdr.mLinkId = std::uint8_t(lEq);
+          lBuilder.addHbFrames(o2::header::gDataOriginTPC, lSubSpec, lHdr, lHbFrames.begin(), lHbFrames.size());
+        }
+
+        auto lStf = lBuilder.getStf();
+        if (lStf && lBuilding) {
+          lSendQueues[f].push(std::move(*lStf));
+        }
+      }
+      lStageCpuNs[eStfBuild] += threadCpuNs();
+    });
+
+    // STF sending to the EPN chosen by the scheduler
+    lSenderThreads.emplace_back([&, f]() {
+      std::vector<std::unique_ptr<CoalescedHdrDataSerializer>> lSerializers;
+      for (unsigned e = 0; e < lNumEpns; e++) {
+        lSerializers.push_back(std::make_unique<CoalescedHdrDataSerializer>(*lOutChans[lChanIdx(f, e)], nullptr,
+          lCfg.mHeaderBlocks));
+      }
+
+      std::unique_ptr<SubTimeFrame> lStf;
+      while (lSendQueues[f].pop(lStf)) {
+        const auto lEpn = scheduleTf(lStf->header().mId, lNumEpns);
+        lSerializers[lEpn]->serialize(std::move(lStf));
+        lSent[lChanIdx(f, lEpn)]++;
+      }
+      lStageCpuNs[eStfSend] += threadCpuNs();
+    });
+  }
+
+  for (unsigned e = 0; e < lNumEpns; e++) {
+    // one receiver per FLP, as in TfBuilderInput
+    for (unsigned f = 0; f < lNumFlps; f++) {
+      lReceiverThreads.emplace_back([&, e, f]() {
+        auto &lChan = *lInChans[lChanIdx(f, e)];
+        auto &lCount = lReceived[lChanIdx(f, e)];
+
+        while (true) {
+          auto lMsgs = std::make_unique<std::vector<FairMQMessagePtr>>();
+          if (lChan.Receive(*lMsgs, 100 /* ms */) > 0) {
+            lRecvQueues[e].push(std::move(lMsgs));
+            lCount++;
+            continue;
+          }
+          if (lSendersDone && lCount >= lSent[lChanIdx(f, e)]) {
+            break;
+          }
+        }
+        lStageCpuNs[eTfReceive] += threadCpuNs();
+      });
+    }
+
+    lDeserializerThreads.emplace_back([&, e]() {
+      CoalescedHdrDataDeserializer lDeserializer(*lTfBuilders[e]);
+
+      std::unique_ptr<std::vector<FairMQMessagePtr>> lMsgs;
+      while (lRecvQueues[e].pop(lMsgs)) {
+        auto lStf = lDeserializer.deserialize(*lMsgs);
+        if (!lStf) {
+          lErrors++;
+          continue;
+        }
+        lMergeQueues[e].push(std::move(lStf));
+      }
+      lStageCpuNs[eTfDeserialize] += threadCpuNs();
+    });
+
+    // TFs are complete when STFs of all FLPs are received. Complete TFs are dropped (no consumer)
+    lMergerThreads.emplace_back([&, e]() {
+      std::map<std::uint64_t, std::vector<std::unique_ptr<SubTimeFrame>>> lStfs;
+
+      std::unique_ptr<SubTimeFrame> lStf;
+      while (lMergeQueues[e].pop(lStf)) {
+        auto &lTfStfs = lStfs[lStf->header().mId];
+        lTfStfs.push_back(std::move(lStf));
+        if (lTfStfs.size() < lNumFlps) {
+          continue;
+        }
+
+        auto lTf = std::move(lTfStfs.front());
+        for (std::size_t s = 1; s < lTfStfs.size(); s++) {
+          lTf->mergeStf(std::move(lTfStfs[s]));
+        }
+        lTfBytes += lTf->getDataSize();
+        lStfs.erase(lTf->header().mId);
+        lTf.reset();
+
+        lTfsCompleted++;
+      }
+      lTfsIncomplete += lStfs.size();
+      lStfs.clear();
+      lStageCpuNs[eTfMerge] += threadCpuNs();
+    });
+  }
+
+  // measurement: throughput between the end of the warm-up and the end of the run
+  RegionOccupancy lReadoutDataOcc, lReadoutHdrOcc, lTfHdrOcc;
+
+  auto lSampleUntil = [&](const std::chrono::steady_clock::time_point pUntil, const bool pSample) {
+    while (std::chrono::steady_clock::now() < pUntil) {
+      std::this_thread::sleep_for(10ms);
+      if (!pSample) {
+        continue;
+      }
+
+      std::size_t lSize = 0, lFree = 0;
+      for (const auto &lRegion : lReadoutRegions) {
+        const auto lStats = lRegion->stats();
+        lSize += lStats.mSize;
+        lFree += lStats.mFree;
+      }
+      lReadoutDataOcc.sample(lSize, lFree);
+
+      const auto lHdrStats = lReadoutMemRes.headerStats();
+      lReadoutHdrOcc.sample(lHdrStats.mSize, lHdrStats.mFree);
+
+      lSize = lFree = 0;
+      for (const auto &lMemRes : lTfMemRes) {
+        const auto lStats = lMemRes->headerStats();
+        lSize += lStats.mSize;
+        lFree += lStats.mFree;
+      }
+      lTfHdrOcc.sample(lSize, lFree);
+    }
+  };
+
+  const auto lMeasureStart = lRunStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(lCfg.mWarmup));
+  const auto lMeasureEnd = lMeasureStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(lCfg.mDuration));
+
+  lSampleUntil(lMeasureStart, false);
+  const auto lStartTime = std::chrono::steady_clock::now();
+  const std::uint64_t lStartTfs = lTfsCompleted;
+  const std::uint64_t lStartBytes = lTfBytes;
+
+  lSampleUntil(lMeasureEnd, true);
+  const auto lEndTime = std::chrono::steady_clock::now();
+  const std::uint64_t lEndTfs = lTfsCompleted;
+  const std::uint64_t lEndBytes = lTfBytes;
+
+  // shutdown: stop building, drain the stages in order
+  lBuilding = false;
+  for (auto &lRegion : lReadoutRegions) {
+    lRegion->stop(); // unblock allocations
+  }
+  for (auto &lThread : lBuilderThreads) { lThread.join(); }
+
+  for (auto &lQueue : lSendQueues) { lQueue.stop(); }
+  for (auto &lThread : lSenderThreads) { lThread.join(); }
+
+  lSendersDone = true;
+  for (auto &lThread : lReceiverThreads) { lThread.join(); }
+
+  for (auto &lQueue : lRecvQueues) { lQueue.stop(); }
+  for (auto &lThread : lDeserializerThreads) { lThread.join(); }
+
+  for (auto &lQueue : lMergeQueues) { lQueue.stop(); }
+  for (auto &lThread : lMergerThreads) { lThread.join(); }
+
+  const double lRunSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - lRunStart).count();
+  const double lSec = std::max(std::chrono::duration<double>(lEndTime - lStartTime).count(), 1e-9);
+  const double lTfs = double(lEndTfs - lStartTfs);
+  const double lTotalTfs = double(std::max(lTfsCompleted.load(), std::uint64_t(1)));
+
+  // CPU per stage: cores used over the whole run, and CPU time per TF
+  std::string lCpu;
+  for (unsigned s = 0; s < eNumStages; s++) {
+    const double lCpuSec = double(lStageCpuNs[s]) / 1e9;
+    lCpu += fmt::format(",\"cpu_cores_{}\":{:.3f},\"cpu_us_per_tf_{}\":{:.1f}", cStageNames[s], lCpuSec / lRunSec,
+      cStageNames[s], lCpuSec * 1e6 / lTotalTfs);
+  }
+
+  const auto lLine = fmt::format("{{\"suite\":\"end_to_end\",\"benchmark\":\"pipeline_{}flp_{}epn{}\",\"tag\":\"{}\","
+    "\"flps\":{},\"epns\":{},\"equipments\":{},\"hbfs_per_stf\":{},\"hbf_size\":{},\"tf_size\":{},\"seconds\":{:.3f},"
+    "\"tfs\":{},\"tf_per_s\":{:.2f},\"gb_per_s\":{:.3f}{},"
+    "\"readout_data_occupancy_mean\":{:.1f},\"readout_data_occupancy_max\":{:.1f},"
+    "\"readout_header_occupancy_mean\":{:.1f},\"readout_header_occupancy_max\":{:.1f},"
+    "\"tf_header_occupancy_mean\":{:.1f},\"tf_header_occupancy_max\":{:.1f},"
+    "\"incomplete_tfs\":{},\"errors\":{}}}",
+    lNumFlps, lNumEpns, lCfg.mHeaderBlocks ? "_hdr_blocks" : "", lCfg.mTag,
+    lNumFlps, lNumEpns, lCfg.mNumEquipments, lCfg.mHbfsPerStf, lHbfSize, lStfSize * lNumFlps, lSec,
+    lEndTfs - lStartTfs, lTfs / lSec, double(lEndBytes - lStartBytes) / lSec / 1e9, lCpu,
+    lReadoutDataOcc.mean(), lReadoutDataOcc.mMax, lReadoutHdrOcc.mean(), lReadoutHdrOcc.mMax,
+    lTfHdrOcc.mean(), lTfHdrOcc.mMax, lTfsIncomplete.load(), lErrors.load());
+
+  (lOutput.is_open() ? static_cast<std::ostream&>(lOutput) : std::cout) << lLine << std::endl;
+
+  for (auto &lBuilder : lStfBuilders) {
+    lBuilder->stop();
+  }
+  for (auto &lMemRes : lTfMemRes) {
+    lMemRes->stop();
+  }
+
+  return lErrors ? 1 : 0;
+}
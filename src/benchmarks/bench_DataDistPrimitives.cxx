@@ -0,0 +1,208 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/// Microbenchmarks of primitives that do not need a FairMQ transport:
+/// concurrent queues, RDH sanity checking and empty trigger block filtering
+
+#include "DataDistBenchmark.h"
+
+#include <ConcurrentQueue.h>
+#include <Crc32c.h>
+#include <ReadoutDataModel.h>
+
+#include <Headers/RAWDataHeader.h>
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace o2::DataDistribution;
+
+namespace
+{
+
+constexpr std::uint64_t cQueueOps = 1000000;
+
+// pProducers push cQueueOps elements in total, pConsumers pop all of them
+template <typename Queue>
+void queueBenchmark(Queue &pQueue, const unsigned pProducers, const unsigned pConsumers)
+{
+  std::atomic_uint64_t lPopped = 0;
+  std::vector<std::thread> lThreads;
+
+  for (unsigned p = 0; p < pProducers; p++) {
+    lThreads.emplace_back([&pQueue, pProducers]() {
+      for (std::uint64_t i = 0; i < cQueueOps / pProducers; i++) {
+        pQueue.push(i);
+      }
+    });
+  }
+
+  const std::uint64_t lTotal = (cQueueOps / pProducers) * pProducers;
+  for (unsigned c = 0; c < pConsumers; c++) {
+    lThreads.emplace_back([&pQueue, &lPopped, lTotal]() {
+      std::uint64_t lElem;
+      while (lPopped.load(std::memory_order_relaxed) < lTotal) {
+        if (pQueue.pop_wait_for(lElem, std::chrono::microseconds(1000))) {
+          lPopped.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    });
+  }
+
+  for (auto &lThread : lThreads) {
+    lThread.join();
+  }
+}
+
+// RDHv6 HBFrame: pPages data pages of 8 KiB and a stop page, or an empty trigger block (two RDHs)
+void makeHbFrame(std::vector<char> &pBuf, const std::uint32_t pOrbit, const unsigned pPages, const bool pEmpty)
+{
+  using RDH = o2::header::RAWDataHeaderV6;
+  constexpr std::size_t cPageSize = 8192;
+
+  auto lAddRdh = [&](const std::size_t pMemSize, const std::size_t pOffsetToNext, const unsigned pPageCnt,
+    const bool pStop) {
+    RDH lRdh;
+    lRdh.feeId = 0x10;
+    lRdh.linkID = 1;
+    lRdh.cruID = 0x20;
+    lRdh.orbit = pOrbit;
+    lRdh.memorySize = std::uint16_t(pMemSize);
+    lRdh.offsetToNext = std::uint16_t(pOffsetToNext);
+    lRdh.pageCnt = std::uint16_t(pPageCnt);
+    lRdh.stop = pStop;
+
+    const auto lPos = pBuf.size();
+    pBuf.resize(lPos + pOffsetToNext, 0);
+    std::memcpy(pBuf.data() + lPos, &lRdh, sizeof(RDH));
+  };
+
+  pBuf.clear();
+  if (pEmpty) {
+    lAddRdh(sizeof(RDH), sizeof(RDH), 0, false);
+    lAddRdh(sizeof(RDH), sizeof(RDH), 1, true);
+    return;
+  }
+
+  for (unsigned p = 0; p < pPages; p++) {
+    lAddRdh(cPageSize, cPageSize, p, false);
+  }
+  lAddRdh(sizeof(RDH), sizeof(RDH), pPages, true);
+}
+
+} /* namespace */
+
+int main(int argc, char* argv[])
+{
+  DataDistBenchmark lBench("primitives", argc, argv);
+  if (!lBench.valid()) {
+    return -1;
+  }
+
+  // queues
+  for (const auto &[lProd, lCons] : { std::pair{1u, 1u}, std::pair{4u, 4u} }) {
+    const auto lSuffix = fmt::format("_{}p{}c", lProd, lCons);
+
+    const unsigned lNumProd = lProd;
+    const unsigned lNumCons = lCons;
+
+    lBench.run("fifo_push_pop" + lSuffix, cQueueOps, 0, [&]() {
+      ConcurrentFifo<std::uint64_t> lQueue;
+      queueBenchmark(lQueue, lNumProd, lNumCons);
+    });
+
+    lBench.run("mpmc_ring_push_pop" + lSuffix, cQueueOps, 0, [&]() {
+      ConcurrentMpmcRing<std::uint64_t> lQueue(4096);
+      queueBenchmark(lQueue, lNumProd, lNumCons);
+    });
+  }
+
+  // RDH checks
+  ReadoutDataUtils::sRdhVersion = ReadoutDataUtils::eRdhVer6;
+  RDHReader::Initialize(6);
+
+  constexpr unsigned cNumHbf = 4096;
+  std::vector<std::vector<char>> lHbFrames(cNumHbf);
+  std::uint64_t lHbfBytes = 0;
+  for (unsigned i = 0; i < cNumHbf; i++) {
+    makeHbFrame(lHbFrames[i], 0x1000 + i, 1 + (i % 4), false);
+    lHbfBytes += lHbFrames[i].size();
+  }
+
+  for (const auto lImpl : { ReadoutDataUtils::eSanityCheckScalar, ReadoutDataUtils::eSanityCheckSimd }) {
+    const std::string lName = (lImpl == ReadoutDataUtils::eSanityCheckScalar) ? "scalar" : "simd";
+
+    lBench.run("rdh_sanity_check_" + lName, cNumHbf, lHbfBytes, [&]() {
+      ReadoutDataContext lCtx;
+      lCtx.mRdhSanityCheckMode = ReadoutDataUtils::eSanityCheckDrop;
+      lCtx.mRdhSanityCheckImpl = lImpl;
+
+      std::uint64_t lOk = 0;
+      for (const auto &lHbf : lHbFrames) {
+        lOk += ReadoutDataUtils::rdhSanityCheck(lCtx, lHbf.data(), lHbf.size());
+      }
+      if (lOk != cNumHbf) {
+        std::cerr << "rdh_sanity_check: synthetic HBFrames failed the check" << std::endl;
+      }
+    });
+  }
+
+  // 3 of 4 HBFrames are empty trigger blocks, as in triggered detectors
+  std::vector<std::vector<char>> lTrigHbFrames(cNumHbf);
+  std::uint64_t lTrigBytes = 0;
+  for (unsigned i = 0; i < cNumHbf; i++) {
+    makeHbFrame(lTrigHbFrames[i], 0x1000 + i, 1, (i % 4) != 0);
+    lTrigBytes += lTrigHbFrames[i].size();
+  }
+
+  lBench.run("filter_empty_trigger_blocks", cNumHbf, lTrigBytes, [&]() {
+    ReadoutDataContext lCtx;
+    lCtx.mEmptyTriggerHBFrameFilterring = true;
+
+    std::uint64_t lFiltered = 0;
+    for (const auto &lHbf : lTrigHbFrames) {
+      lFiltered += ReadoutDataUtils::filterEmptyTriggerBlocks(lCtx, lHbf.data(), lHbf.size());
+    }
+    if (lFiltered != (cNumHbf / 4) * 3) {
+      std::cerr << "filter_empty_trigger_blocks: unexpected number of filtered blocks " << lFiltered << std::endl;
+    }
+  });
+
+  // integrity checksums of file blocks and transport messages
+  constexpr unsigned cNumCrcBlocks = 64;
+  constexpr std::size_t cCrcBlockSize = 1 << 20;
+  std::vector<char> lCrcData(cNumCrcBlocks * cCrcBlockSize);
+  for (std::size_t i = 0; i < lCrcData.size(); i++) {
+    lCrcData[i] = char(i * 31 + 7);
+  }
+
+  for (const bool lHw : { false, true }) {
+    if (lHw && !Crc32c::hardware()) {
+      continue;
+    }
+    lBench.run(lHw ? "crc32c_hw" : "crc32c_sw", cNumCrcBlocks, lCrcData.size(), [&]() {
+      std::uint32_t lCrc = 0;
+      for (unsigned b = 0; b < cNumCrcBlocks; b++) {
+        const char *lBlock = lCrcData.data() + b * cCrcBlockSize;
+        lCrc ^= lHw ? Crc32c::compute(lBlock, cCrcBlockSize) : Crc32c::computeSoftware(lBlock, cCrcBlockSize);
+      }
+      if (lCrc == 0) {
+        std::cerr << "crc32c: unexpected checksum" << std::endl;
+      }
+    });
+  }
+
+  return 0;
+}
@@ -0,0 +1,293 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/// Microbenchmarks of the (Sub)TimeFrame path on the shared memory transport:
+/// region allocation, STF building and merging, serialization round trips, and file writing/reading
+
+#include "DataDistBenchmark.h"
+
+#include <MemoryUtils.h>
+#include <SubTimeFrameBuilder.h>
+#include <SubTimeFrameVisitors.h>
+#include <SubTimeFrameFileWriter.h>
+#include <SubTimeFrameFileReader.h>
+#include <ReadoutDataModel.h>
+
+#include <fairmq/FairMQTransportFactory.h>
+#include <fairmq/FairMQChannel.h>
+
+#include <Headers/RAWDataHeader.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace o2::DataDistribution;
+
+namespace
+{
+
+constexpr unsigned cNumEquipments = 12;
+constexpr unsigned cNumHbf = 128;
+constexpr std::size_t cHbfSize = 8192 * 2 + 64; // two data pages and the stop page
+
+// HBFrame messages of one equipment (RDHv6)
+std::vector<FairMQMessagePtr> makeHbFrames(FairMQTransportFactory &pTransport, const unsigned pEquipment,
+  const std::uint32_t pFirstOrbit)
+{
+  using RDH = o2::header::RAWDataHeaderV6;
+
+  std::vector<FairMQMessagePtr> lMsgs;
+  for (unsigned h = 0; h < cNumHbf; h++) {
+    auto lMsg = pTransport.CreateMessage(cHbfSize);
+    char *lData = reinterpret_cast<char*>(lMsg->GetData());
+    std::memset(lData, 0, cHbfSize);
+
+    for (unsigned p = 0; p < 3; p++) {
+      RDH lRdh;
+      lRdh.feeId = std::uint16_t(pEquipment);
+      lRdh.linkID = std::uint8_t(pEquipment);
+      lRdh.cruID = 0x20;
+      lRdh.orbit = pFirstOrbit + h;
+      lRdh.memorySize = (p < 2) ? 8192 : sizeof(RDH);
+      lRdh.offsetToNext = (p < 2) ? 8192 : sizeof(RDH);
+      lRdh.pageCnt = p;
+      lRdh.stop = (p == 2);
+      std::memcpy(lData + p * 8192, &lRdh, sizeof(RDH));
+    }
+    lMsgs.push_back(std::move(lMsg));
+  }
+  return lMsgs;
+}
+
+std::unique_ptr<SubTimeFrame> buildStf(SubTimeFrameReadoutBuilder &pBuilder, FairMQTransportFactory &pTransport,
+  const std::uint32_t pStfId, const unsigned pFirstEquipment, const unsigned pNumEquipments)
+{
+  for (unsigned e = pFirstEquipment; e < pFirstEquipment + pNumEquipments; e++) {
+    auto lHbFrames = makeHbFrames(pTransport, e, pStfId * 256);
+
+    ReadoutSubTimeframeHeader lHdr;
+    lHdr.mTimeFrameId = pStfId;
+    lHdr.mTimeframeOrbitFirst = pStfId * 256;
+    lHdr.mLinkId = std::uint8_t(e);
+
+    pBuilder.addHbFrames(o2::header::gDataOriginTPC, e, lHdr, lHbFrames.begin(), lHbFrames.size());
+  }
+  auto lStf = pBuilder.getStf();
+  return lStf ? std::move(*lStf) : nullptr;
+}
+
+} /* namespace */
+
+int main(int argc, char* argv[])
+{
+  DataDistBenchmark lBench("stf_pipeline", argc, argv);
+  if (!lBench.valid()) {
+    return -1;
+  }
+
+  ReadoutDataUtils::sRdhVersion = ReadoutDataUtils::eRdhVer6;
+  RDHReader::Initialize(6);
+
+  auto lTransport = FairMQTransportFactory::CreateTransportFactory("shmem", "datadist-bench-" + std::to_string(getpid()));
+
+  constexpr std::uint64_t cStfBytes = std::uint64_t(cNumEquipments) * cNumHbf * cHbfSize;
+  constexpr std::uint64_t cStfBlocks = std::uint64_t(cNumEquipments) * cNumHbf;
+
+  // region allocation and reclaim with mixed sizes and out-of-order release
+  for (const auto lStrategy : { RegionAllocStrategy::eIntervalMap, RegionAllocStrategy::eSizeClass }) {
+    const std::string lName = (lStrategy == RegionAllocStrategy::eIntervalMap) ? "interval" : "sizeclass";
+    RegionAllocatorResource<> lRegion("DataDistBench_" + lName, *lTransport, std::size_t(256) << 20, 0, lStrategy);
+
+    constexpr std::size_t cNumAllocs = 100000;
+    constexpr std::size_t cLiveWindow = 512;
+
+    std::mt19937_64 lGen(42);
+    std::vector<std::size_t> lSizes(cNumAllocs);
+    std::uint64_t lBytes = 0;
+    for (auto &lSize : lSizes) {
+      lSize = std::size_t(1) << (8 + (lGen() % 10)); // 256 B .. 128 KiB
+      lSize += lGen() % lSize;
+      lBytes += lSize;
+    }
+
+    lBench.run("region_alloc_fragmented_" + lName, cNumAllocs, lBytes, [&]() {
+      std::mt19937_64 lRelease(7);
+      std::vector<FairMQMessagePtr> lLive(cLiveWindow);
+      for (std::size_t i = 0; i < cNumAllocs; i++) {
+        // release a random live message, which fragments the free space
+        lLive[lRelease() % cLiveWindow] = lRegion.NewFairMQMessage(lSizes[i]);
+      }
+    });
+  }
+
+  // STF building, merging and header updates
+  MemoryResources lReadoutMemRes(lTransport);
+  ReadoutDataContext lReadoutCtx;
+  SubTimeFrameReadoutBuilder lStfBuilder(lReadoutMemRes, false, lReadoutCtx);
+
+  std::uint32_t lStfId = 1;
+
+  lBench.runTimed("stf_add_hbframes", cStfBlocks, cStfBytes, [&](DataDistBenchmark::Timer &pTimer) {
+    std::vector<std::vector<FairMQMessagePtr>> lHbFrames;
+    for (unsigned e = 0; e < cNumEquipments; e++) {
+      lHbFrames.push_back(makeHbFrames(*lTransport, e, lStfId * 256));
+    }
+
+    pTimer.start();
+    for (unsigned e = 0; e < cNumEquipments; e++) {
+      ReadoutSubTimeframeHeader lHdr;
+      lHdr.mTimeFrameId = lStfId;
+      lHdr.mTimeframeOrbitFirst = lStfId * 256;
+      lHdr.mLinkId = std::uint8_t(e);
+      lStfBuilder.addHbFrames(o2::header::gDataOriginTPC, e, lHdr, lHbFrames[e].begin(), lHbFrames[e].size());
+    }
+    auto lStf = lStfBuilder.getStf();
+    pTimer.stop();
+    lStfId++;
+  });
+
+  lBench.runTimed("stf_merge", cStfBlocks, cStfBytes, [&](DataDistBenchmark::Timer &pTimer) {
+    std::vector<std::unique_ptr<SubTimeFrame>> lStfs;
+    for (unsigned e = 0; e < cNumEquipments; e++) {
+      lStfs.push_back(buildStf(lStfBuilder, *lTransport, lStfId, e, 1));
+    }
+
+    pTimer.start();
+    auto lTf = std::move(lStfs[0]);
+    for (unsigned e = 1; e < cNumEquipments; e++) {
+      lTf->mergeStf(std::move(lStfs[e]));
+    }
+    pTimer.stop();
+    lStfId++;
+  });
+
+  {
+    auto lStf = buildStf(lStfBuilder, *lTransport, lStfId++, 0, cNumEquipments);
+    std::uint32_t lRunNumber = 1;
+
+    // every header is rewritten when the STF header changes
+    lBench.run("stf_update_headers", cStfBlocks, 0, [&]() {
+      lStf->updateRunNumber(lRunNumber++);
+      lStf->updateStf();
+    });
+
+    lBench.run("stf_equipment_ids", cStfBlocks, 0, [&]() {
+      const auto lIds = lStf->getEquipmentIdentifiers();
+      if (lIds.size() != cNumEquipments) {
+        std::cerr << "stf_equipment_ids: unexpected number of equipments " << lIds.size() << std::endl;
+      }
+    });
+  }
+
+  // serialization round trip over a pair channel
+  {
+    constexpr unsigned cStfsPerRep = 16;
+
+    SyncMemoryResources lTfMemRes(lTransport);
+    TimeFrameBuilder lTfBuilder(lTfMemRes, false);
+    lTfBuilder.allocate_memory(std::size_t(64) << 20, std::size_t(256) << 20);
+
+    const std::string lAddress = "inproc://datadist-bench-" + std::to_string(getpid());
+    FairMQChannel lOutChan("bench-out", "pair", lTransport);
+    FairMQChannel lInChan("bench-in", "pair", lTransport);
+    if (!lOutChan.Bind(lAddress) || !lInChan.Connect(lAddress)) {
+      std::cerr << "Cannot connect the benchmark channels: " << lAddress << std::endl;
+      return -1;
+    }
+
+    for (const bool lHeaderBlocks : { false, true }) {
+      const std::string lName = lHeaderBlocks ? "serializer_round_trip_hdr_blocks" : "serializer_round_trip";
+
+      lBench.runTimed(lName, cStfsPerRep, cStfsPerRep * cStfBytes, [&](DataDistBenchmark::Timer &pTimer) {
+        std::vector<std::unique_ptr<SubTimeFrame>> lStfs;
+        for (unsigned s = 0; s < cStfsPerRep; s++) {
+          lStfs.push_back(buildStf(lStfBuilder, *lTransport, lStfId++, 0, cNumEquipments));
+        }
+
+        CoalescedHdrDataSerializer lSerializer(lOutChan, nullptr, lHeaderBlocks);
+        CoalescedHdrDataDeserializer lDeserializer(lTfBuilder);
+
+        pTimer.start();
+        std::thread lReceiver([&]() {
+          for (unsigned s = 0; s < cStfsPerRep; s++) {
+            auto lStf = lDeserializer.deserialize(lInChan, true);
+            if (!lStf || lStf->getDataSize() != cStfBytes) {
+              std::cerr << lName << ": deserialization failed" << std::endl;
+            }
+          }
+        });
+        for (auto &lStf : lStfs) {
+          lSerializer.serialize(std::move(lStf));
+        }
+        lReceiver.join();
+        pTimer.stop();
+      });
+    }
+  }
+
+  // file writing and reading
+  {
+    constexpr unsigned cStfsPerFile = 16;
+    const auto lFileName = boost::filesystem::temp_directory_path() /
+      ("datadist-bench-" + std::to_string(getpid()) + ".tf");
+
+    for (const auto lEngine : { SubTimeFrameFileWriter::WriteEngine::Stream, SubTimeFrameFileWriter::WriteEngine::Direct }) {
+      const std::string lName = (lEngine == SubTimeFrameFileWriter::WriteEngine::Stream) ? "stream" : "direct";
+
+      lBench.runTimed("file_write_" + lName, cStfsPerFile, cStfsPerFile * cStfBytes, [&](DataDistBenchmark::Timer &pTimer) {
+        std::vector<std::unique_ptr<SubTimeFrame>> lStfs;
+        for (unsigned s = 0; s < cStfsPerFile; s++) {
+          lStfs.push_back(buildStf(lStfBuilder, *lTransport, lStfId++, 0, cNumEquipments));
+        }
+
+        pTimer.start();
+        {
+          SubTimeFrameFileWriter lWriter(lFileName, SubTimeFrameFileWriter::SidecarFormat::None, lEngine);
+          for (const auto &lStf : lStfs) {
+            lWriter.write(*lStf);
+          }
+        }
+        pTimer.stop();
+      });
+    }
+
+    // read the file of the last write benchmark
+    if (boost::filesystem::exists(lFileName)) {
+      SyncMemoryResources lFileMemRes(lTransport);
+      SubTimeFrameFileBuilder lFileBuilder(lFileMemRes, std::size_t(512) << 20, std::size_t(64) << 20);
+      auto lReadFileName = lFileName;
+
+      lBench.run("file_read", cStfsPerFile, cStfsPerFile * cStfBytes, [&]() {
+        SubTimeFrameFileReader lReader(lReadFileName);
+        for (unsigned s = 0; s < cStfsPerFile; s++) {
+          auto lStf = lReader.read(lFileBuilder);
+          if (!lStf) {
+            std::cerr << "file_read: unexpected end of file" << std::endl;
+            break;
+          }
+        }
+      });
+
+      boost::filesystem::remove(lFileName);
+    }
+  }
+
+  lStfBuilder.stop();
+  return 0;
+}
@@ -26,12 +26,25 @@
 #include <Headers/DataHeader.h>
 
 #include "DataDistLogger.h"
+#include "Utilities.h"
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/value_semantic.hpp>
 
 #include <vector>
+#include <array>
+#include <map>
+#include <algorithm>
+#include <atomic>
 #include <mutex>
+#include <condition_variable>
 #include <memory>
 #include <thread>
 #include <chrono>
+#include <istream>
+#include <ostream>
+#include <cctype>
+#include <cerrno>
 
 #include <sys/mman.h>
 #include <cstdlib>
@@ -39,6 +52,8 @@
 
 #if defined(__linux__)
 #include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/vfs.h>
 #endif
 
 namespace icl = boost::icl;
@@ -53,6 +68,371 @@ static constexpr const char *ENV_NOLOCK = "DATADIST_NO_MLOCK";
 static constexpr const char *ENV_SHM_PATH = "DATADIST_SHM_PATH";
 static constexpr const char *ENV_SHM_DELAY = "DATADIST_SHM_DELAY";
 
+/// NUMA helpers (raw syscalls, no libnuma dependency)
+namespace numa {
+
+static constexpr int cMpolDefault = 0;
+static constexpr int cMpolBind = 2;
+static constexpr unsigned cMpolMfMove = (1 << 1);
+
+inline
+int num_nodes()
+{
+  namespace bfs = boost::filesystem;
+  int lNodes = 0;
+  try {
+    const bfs::path lNodePath("/sys/devices/system/node");
+    if (bfs::is_directory(lNodePath)) {
+      for (const auto &lEntry : bfs::directory_iterator(lNodePath)) {
+        const auto lName = lEntry.path().filename().string();
+        if (lName.size() > 4 && lName.compare(0, 4, "node") == 0 && std::isdigit(lName[4])) {
+          lNodes++;
+        }
+      }
+    }
+  } catch (...) { }
+  return std::max(lNodes, 1);
+}
+
+inline
+int current_node()
+{
+#if defined(__linux__) && defined(SYS_getcpu)
+  unsigned lCpu = 0, lNode = 0;
+  if (0 == syscall(SYS_getcpu, &lCpu, &lNode, nullptr)) {
+    return int(lNode);
+  }
+#endif
+  return 0;
+}
+
+// node mask with the single bit of the node set (any number of nodes)
+inline
+std::vector<unsigned long> node_mask(const int pNode)
+{
+  static constexpr std::size_t cBitsPerWord = sizeof(unsigned long) * 8;
+  std::vector<unsigned long> lMask(std::size_t(pNode) / cBitsPerWord + 1, 0UL);
+  lMask[std::size_t(pNode) / cBitsPerWord] = 1UL << (std::size_t(pNode) % cBitsPerWord);
+  return lMask;
+}
+
+// maxnode argument for the mask: the kernel uses one bit less than given
+inline
+unsigned long node_mask_bits(const std::vector<unsigned long> &pMask)
+{
+  return pMask.size() * sizeof(unsigned long) * 8 + 1;
+}
+
+// bind allocations of the calling thread to the node (pNode < 0 resets the policy)
+inline
+bool set_thread_policy(const int pNode)
+{
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+  if (pNode < 0) {
+    return 0 == syscall(SYS_set_mempolicy, cMpolDefault, nullptr, 0);
+  }
+  const auto lMask = node_mask(pNode);
+  return 0 == syscall(SYS_set_mempolicy, cMpolBind, lMask.data(), node_mask_bits(lMask));
+#else
+  (void) pNode;
+  return false;
+#endif
+}
+
+// bind (and move) already mapped memory to the node
+inline
+bool bind(void *pAddr, const std::size_t pLen, const int pNode)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+  if (pNode < 0) {
+    return false;
+  }
+  const auto lMask = node_mask(pNode);
+  return 0 == syscall(SYS_mbind, pAddr, pLen, cMpolBind, lMask.data(), node_mask_bits(lMask), cMpolMfMove);
+#else
+  (void) pAddr; (void) pLen; (void) pNode;
+  return false;
+#endif
+}
+
+} /* namespace numa */
+
+/// Allocation engine used by the RegionAllocatorResource
+enum class RegionAllocStrategy {
+  eIntervalMap, // bump allocation with reclaim of merged free intervals (default)
+  eSizeClass    // segregated-fit size classes with lock-free free lists
+};
+
+inline
+std::istream& operator>>(std::istream& in, RegionAllocStrategy& pRetVal)
+{
+  std::string token;
+  in >> token;
+
+  if (token == "interval") {
+    pRetVal = RegionAllocStrategy::eIntervalMap;
+  } else if (token == "sizeclass") {
+    pRetVal = RegionAllocStrategy::eSizeClass;
+  } else {
+    in.setstate(std::ios_base::failbit);
+  }
+  return in;
+}
+
+inline
+std::string to_string(const RegionAllocStrategy pStrategy)
+{
+  switch (pStrategy) {
+    case RegionAllocStrategy::eIntervalMap:
+      return "interval";
+    case RegionAllocStrategy::eSizeClass:
+      return "sizeclass";
+    default:
+      return "invalid";
+  }
+}
+
+inline
+std::ostream& operator<<(std::ostream& out, const RegionAllocStrategy& pStrategy)
+{
+  out << to_string(pStrategy);
+  return out;
+}
+
+/// Point in time allocator statistics of a region
+struct RegionAllocatorStats {
+  std::size_t mSize = 0;
+  std::size_t mFree = 0;
+  std::size_t mLargestFreeBlock = 0; // contiguous, not including size class free lists
+  std::size_t mNumFreeRanges = 0;
+  std::uint64_t mTryAllocFailed = 0;
+  std::size_t mSizeClassBytes = 0; // carved for size classes, permanently (free or used)
+  std::uint64_t mMagazineRefills = 0; // thread magazines taken from the region
+
+  // allocation wait time in microseconds (allocations served by the general path)
+  std::uint64_t mAllocWaitP50Us = 0;
+  std::uint64_t mAllocWaitP90Us = 0;
+  std::uint64_t mAllocWaitP99Us = 0;
+  std::uint64_t mAllocWaitMaxUs = 0;
+
+  // number of blocks returned by a single region callback
+  std::array<std::uint64_t, Log2Histogram::cNumBuckets> mReclaimBatchHist = { };
+};
+
+/// Segregated-fit free lists for the region allocator
+///
+/// Sizes up to cMaxClassSize are rounded up to one of the size classes (4 classes per power
+/// of two, at most 25% internal waste). Freed blocks are pushed onto a per-class lock-free
+/// list by the region callback. The allocating thread takes the whole pending list with a single
+/// exchange when its private list runs empty, so neither side takes a lock and there is no ABA.
+/// The free list link is stored in the first word of a free block.
+/// NOTE: spans carved for a size class are never returned to the region, even when all their blocks are free.
+///       The footprint of a class is the high watermark of its use (see RegionAllocatorStats::mSizeClassBytes).
+template<std::size_t ALIGN>
+class RegionSizeClasses
+{
+  static constexpr unsigned ilog2(const std::size_t pVal) { return (pVal <= 1) ? 0 : 1 + ilog2(pVal >> 1); }
+
+public:
+  static constexpr std::size_t cMinClassSize = std::max(ALIGN * 4, std::size_t(64));
+  static constexpr std::size_t cMaxClassSize = std::size_t(1) << 20;
+  static constexpr unsigned cMinClassLog2 = ilog2(cMinClassSize);
+  static constexpr unsigned cMaxClassLog2 = ilog2(cMaxClassSize);
+  static constexpr std::size_t cNumClasses = 1 + (cMaxClassLog2 - cMinClassLog2) * 4;
+
+  static_assert((cMinClassSize & (cMinClassSize - 1)) == 0, "Minimum class size must be power of 2");
+  static_assert(cMinClassSize / 4 % ALIGN == 0, "Class sizes must respect the region alignment");
+
+  static inline
+  std::size_t class_index(const std::size_t pSize) {
+    if (pSize <= cMinClassSize) {
+      return 0;
+    }
+    const unsigned lLog2 = 63 - __builtin_clzll(pSize - 1);
+    const std::size_t lSub = ((pSize - 1) >> (lLog2 - 2)) & 3;
+    return 1 + (lLog2 - cMinClassLog2) * 4 + lSub;
+  }
+
+  static inline
+  std::size_t class_size(const std::size_t pIdx) {
+    if (pIdx == 0) {
+      return cMinClassSize;
+    }
+    const unsigned lLog2 = cMinClassLog2 + (pIdx - 1) / 4;
+    const std::size_t lSub = (pIdx - 1) % 4;
+    return (std::size_t(1) << lLog2) + (lSub + 1) * (std::size_t(1) << (lLog2 - 2));
+  }
+
+  /// Allocating thread only
+  inline
+  void* pop(const std::size_t pIdx) {
+    auto &lList = mLists[pIdx];
+
+    if (!lList.mLocal) {
+      lList.mLocal = lList.mPending.exchange(nullptr, std::memory_order_acquire);
+      if (!lList.mLocal) {
+        return nullptr;
+      }
+    }
+
+    void *lBlock = lList.mLocal;
+    lList.mLocal = *reinterpret_cast<void**>(lBlock);
+    *reinterpret_cast<void**>(lBlock) = nullptr; // blocks are handed out zeroed
+    return lBlock;
+  }
+
+  /// Allocating thread only: used when carving a new span
+  inline
+  void push_local(const std::size_t pIdx, void *pBlock) {
+    auto &lList = mLists[pIdx];
+    *reinterpret_cast<void**>(pBlock) = lList.mLocal;
+    lList.mLocal = pBlock;
+  }
+
+  /// Any thread: region callback
+  inline
+  void push(const std::size_t pIdx, void *pBlock) {
+    auto &lPending = mLists[pIdx].mPending;
+    void *lHead = lPending.load(std::memory_order_relaxed);
+    do {
+      *reinterpret_cast<void**>(pBlock) = lHead;
+    } while (!lPending.compare_exchange_weak(lHead, pBlock, std::memory_order_release, std::memory_order_relaxed));
+  }
+
+private:
+  struct alignas(128) FreeList {
+    std::atomic<void*> mPending = nullptr;
+    void *mLocal = nullptr;
+  };
+
+  std::array<FreeList, cNumClasses> mLists;
+};
+
+/// Fixed-size slot pool for the header region
+///
+/// Slots are carved lazily from a slab reserved at the start of the region. Each thread keeps
+/// a private cache of free slots, refilled in batches from the slab, or by taking the whole list
+/// of slots returned by the region callback. Returning a slot is a single lock-free push.
+class RegionSlotPool : public std::enable_shared_from_this<RegionSlotPool>
+{
+public:
+  static constexpr std::size_t cSlabBatch = 256;
+
+  RegionSlotPool() = delete;
+  RegionSlotPool(char *pSlabStart, const std::size_t pSlabSize, const std::size_t pSlotSize)
+  : mSlabStart(pSlabStart),
+    mSlotSize(pSlotSize),
+    mNumSlots(pSlabSize / pSlotSize),
+    mPoolId(sPoolIdCnt.fetch_add(1) + 1)
+  { }
+
+  std::size_t slot_size() const { return mSlotSize; }
+  std::size_t slab_size() const { return mNumSlots * mSlotSize; }
+
+  inline
+  bool owns(const void *pPtr) const {
+    return (pPtr >= mSlabStart) && (pPtr < mSlabStart + mNumSlots * mSlotSize);
+  }
+
+  inline
+  void* get() {
+    auto &lCache = thread_cache();
+
+    if (!lCache.mHead && !refill(lCache)) {
+      return nullptr;
+    }
+
+    void *lSlot = lCache.mHead;
+    lCache.mHead = *reinterpret_cast<void**>(lSlot);
+    *reinterpret_cast<void**>(lSlot) = nullptr; // slots are handed out zeroed
+    return lSlot;
+  }
+
+  // Any thread: region callback
+  inline
+  void put(void *pSlot) {
+    void *lHead = mReturned.load(std::memory_order_relaxed);
+    do {
+      *reinterpret_cast<void**>(pSlot) = lHead;
+    } while (!mReturned.compare_exchange_weak(lHead, pSlot, std::memory_order_release, std::memory_order_relaxed));
+  }
+
+private:
+  struct ThreadCache {
+    std::weak_ptr<RegionSlotPool> mPool;
+    std::uint64_t mPoolId = 0;
+    void *mHead = nullptr;
+
+    // return cached slots if the pool is still alive
+    void release() {
+      if (auto lPool = mPool.lock()) {
+        while (mHead) {
+          void *lNext = *reinterpret_cast<void**>(mHead);
+          lPool->put(mHead);
+          mHead = lNext;
+        }
+      }
+      mHead = nullptr;
+      mPool.reset();
+      mPoolId = 0;
+    }
+
+    ~ThreadCache() { release(); }
+  };
+
+  // one cache per pool and thread
+  ThreadCache& thread_cache() {
+    static thread_local std::vector<std::unique_ptr<ThreadCache>> tCaches;
+
+    for (auto &lCache : tCaches) {
+      if (lCache->mPoolId == mPoolId) {
+        return *lCache;
+      }
+    }
+
+    // drop the caches of destroyed pools
+    tCaches.erase(std::remove_if(tCaches.begin(), tCaches.end(),
+      [](const std::unique_ptr<ThreadCache> &pCache) { return pCache->mPool.expired(); }), tCaches.end());
+
+    tCaches.push_back(std::make_unique<ThreadCache>());
+    tCaches.back()->mPool = weak_from_this();
+    tCaches.back()->mPoolId = mPoolId;
+    return *tCaches.back();
+  }
+
+  bool refill(ThreadCache &pCache) {
+    // returned slots first, to keep the working set small
+    pCache.mHead = mReturned.exchange(nullptr, std::memory_order_acquire);
+    if (pCache.mHead) {
+      return true;
+    }
+
+    // take a new batch from the slab
+    const std::size_t lFirst = mSlabNext.fetch_add(cSlabBatch);
+    if (lFirst >= mNumSlots) {
+      return false;
+    }
+
+    const std::size_t lLast = std::min(lFirst + cSlabBatch, mNumSlots);
+    for (std::size_t lIdx = lLast; lIdx-- > lFirst; ) {
+      char *lSlot = mSlabStart + lIdx * mSlotSize;
+      *reinterpret_cast<void**>(lSlot) = pCache.mHead;
+      pCache.mHead = lSlot;
+    }
+    return true;
+  }
+
+  char *mSlabStart;
+  const std::size_t mSlotSize;
+  const std::size_t mNumSlots;
+  const std::uint64_t mPoolId;
+
+  alignas(128) std::atomic_size_t mSlabNext = 0;
+  alignas(128) std::atomic<void*> mReturned = nullptr;
+
+  static inline std::atomic_uint64_t sPoolIdCnt = 0;
+};
+
 template<size_t ALIGN = 64>
 class RegionAllocatorResource
 {
@@ -61,11 +441,17 @@ public:
   RegionAllocatorResource() = delete;
 
   RegionAllocatorResource(std::string pSegmentName, FairMQTransportFactory& pShmTrans,
-                          std::size_t pSize, std::uint64_t pRegionFlags = 0)
+                          std::size_t pSize, std::uint64_t pRegionFlags = 0,
+                          const RegionAllocStrategy pStrategy = RegionAllocStrategy::eIntervalMap,
+                          const int pNumaNode = -1, const unsigned pPrefaultThreads = 0)
   : mSegmentName(pSegmentName), mTransport(pShmTrans)
   {
     static_assert(ALIGN && !(ALIGN & (ALIGN - 1)), "Alignment must be power of 2");
-    fair::mq::RegionConfig lRegionCfg(true /*mlock*/, true /*bzero*/);
+
+    // with pre-faulting, the region is zeroed and locked in parallel after it is mapped (see prefault())
+    const bool lPrefault = (pPrefaultThreads > 0);
+    bool lLockMemory = true;
+    fair::mq::RegionConfig lRegionCfg(!lPrefault /*mlock*/, !lPrefault /*bzero*/);
 
     pSize = align_size_up(pSize);
 
@@ -84,9 +470,12 @@ public:
     getrlimit(RLIMIT_MEMLOCK, &lMyLimits);
 
     if (lMyLimits.rlim_cur >= pSize) {
-      lMapFlags |= MAP_LOCKED;
+      if (!lPrefault) {
+        lMapFlags |= MAP_LOCKED;
+      }
     } else {
       lRegionCfg.lock = false;
+      lLockMemory = false;
       if (std::getenv(ENV_NOLOCK)) {
         WDDLOG("MemoryResource: Memory locking disabled via {} env variable. Not suitable for production.",
           ENV_NOLOCK);
@@ -102,7 +491,9 @@ public:
 
     // populate the mapping
 #if defined(MAP_POPULATE)
-    lMapFlags |= MAP_POPULATE;
+    if (!lPrefault) {
+      lMapFlags |= MAP_POPULATE;
+    }
 #endif
 
     // try to use different file mapping (hugetlbfs)
@@ -130,8 +521,18 @@ public:
       } while (false);
     }
 
-    IDDLOG("Creating new UnmanagedRegion name={} path={} size={}",
-      mSegmentName, lSegmentRoot, pSize);
+    if (pStrategy == RegionAllocStrategy::eSizeClass) {
+      mSizeClasses = std::make_unique<RegionSizeClasses<ALIGN>>();
+    }
+
+    IDDLOG("Creating new UnmanagedRegion name={} path={} size={} allocator={} numa_node={}",
+      mSegmentName, lSegmentRoot, pSize, to_string(pStrategy), pNumaNode);
+
+    // first touch (populate, mlock) should place the pages on the requested node
+    if (pNumaNode >= 0 && !numa::set_thread_policy(pNumaNode)) {
+      WDDLOG("Memory segment '{}': cannot set the NUMA memory policy. numa_node={} errno={}",
+        mSegmentName, pNumaNode, errno);
+    }
 
     mRegion = pShmTrans.CreateUnmanagedRegion(
       pSize,
@@ -144,18 +545,41 @@ public:
         std::int64_t lReclaimed = 0;
 
         lIntMap.clear();
+        mReclaimBatchHist.record(pBlkVect.size());
 
         for (const auto &lInt : pBlkVect) {
           if (lInt.size == 0) {
             continue;
           }
 
+          // slots go back to the pool
+          if (mSlotPool && mSlotPool->owns(lInt.ptr)) {
+            memset(lInt.ptr, 0x00, lInt.size);
+            mSlotPool->put(lInt.ptr);
+            lReclaimed += mSlotPool->slot_size();
+            continue;
+          }
+
+          // size class blocks go directly to their free list, without merging or locking
+          if (mSizeClasses && lInt.size <= RegionSizeClasses<ALIGN>::cMaxClassSize) {
+            // header slots carved from the extents go back to the interval map
+            if (mNumExtentSlotRanges > 0 && release_extent_slot(static_cast<const char*>(lInt.ptr), lIntMap)) {
+              continue;
+            }
+
+            const auto lIdx = RegionSizeClasses<ALIGN>::class_index(align_size_up(lInt.size));
+            memset(lInt.ptr, 0x00, lInt.size);
+            mSizeClasses->push(lIdx, lInt.ptr);
+            lReclaimed += RegionSizeClasses<ALIGN>::class_size(lIdx);
+            continue;
+          }
+
           lIntMap += std::make_pair(
             icl::discrete_interval<std::size_t>::right_open(
               std::size_t(lInt.ptr) , std::size_t(lInt.ptr) + lInt.size), std::size_t(1));
         }
 
-        {
+        if (!lIntMap.empty()) {
           // callback to be called when message buffers no longer needed by transports
           std::scoped_lock lock(mReclaimLock);
 
@@ -180,6 +604,11 @@ public:
         }
 
         mFree += lReclaimed;
+        notify_waiters(lReclaimed);
+
+        if (lIntMap.empty()) {
+          return; // only size class blocks
+        }
 
         // weighted average merge ratio
         sMergeRatio = sMergeRatio * 0.75 + double(pBlkVect.size() - lIntMap.iterative_size()) /
@@ -197,10 +626,26 @@ public:
       throw std::bad_alloc();
     }
 
+    if (pNumaNode >= 0) {
+      numa::set_thread_policy(-1);
+
+      // bind the region, moving pages already faulted in (MAP_POPULATE) on another node
+      if (!numa::bind(mRegion->GetData(), mRegion->GetSize(), pNumaNode)) {
+        WDDLOG("Memory segment '{}': cannot bind the region to the NUMA node. numa_node={} errno={}",
+          mSegmentName, pNumaNode, errno);
+      }
+    }
+
+    if (lPrefault) {
+      prefault(pPrefaultThreads, lLockMemory, page_size(lSegmentRoot));
+    }
+
     mStart = static_cast<char*>(mRegion->GetData());
     mSegmentSize = mRegion->GetSize();
     mLength = mRegion->GetSize();
     mFree = mSegmentSize;
+    mMagazineSize = align_size_up(std::clamp(mSegmentSize / 256, std::size_t(1) << 20, std::size_t(64) << 20));
+    mMagazineOwner->mResource = this;
 
     // Insert delay for testing
     const auto lShmDelay = std::getenv(ENV_SHM_DELAY);
@@ -223,10 +668,84 @@ public:
   }
 
   ~RegionAllocatorResource() {
+    // magazines of running threads are no longer returned
+    {
+      std::scoped_lock lLock(mMagazineOwner->mLock);
+      mMagazineOwner->mResource = nullptr;
+    }
+
     // Ensure the region is destructed before anything else in this object
     mRegion.reset();
   }
 
+private:
+  // page size of the segment: hugetlbfs mounts report the huge page size
+  static std::size_t page_size(const std::string &pSegmentRoot)
+  {
+    std::size_t lPageSize = sysconf(_SC_PAGESIZE);
+#if defined(__linux__)
+    static constexpr long cHugetlbfsMagic = 0x958458f6;
+    struct statfs lFs;
+    if (!pSegmentRoot.empty() && (0 == statfs(pSegmentRoot.c_str(), &lFs)) && (long(lFs.f_type) == cHugetlbfsMagic)) {
+      lPageSize = std::max(lPageSize, std::size_t(lFs.f_bsize));
+    }
+#endif
+    return lPageSize;
+  }
+
+  // zero (fault in) and lock the region in page aligned chunks, one per thread
+  void prefault(const unsigned pThreads, const bool pLock, const std::size_t pPageSize)
+  {
+    const auto lStart = std::chrono::steady_clock::now();
+
+    char *lData = static_cast<char*>(mRegion->GetData());
+    const std::size_t lSize = mRegion->GetSize();
+    const std::size_t lNumPages = (lSize + pPageSize - 1) / pPageSize;
+    const std::size_t lNumThreads = std::clamp(std::size_t(pThreads), std::size_t(1), std::max(lNumPages, std::size_t(1)));
+
+    std::atomic_size_t lLockFailures = 0;
+    std::vector<std::thread> lThreads;
+    for (std::size_t t = 0; t < lNumThreads; t++) {
+      const std::size_t lBegin = std::min(lSize, (lNumPages * t / lNumThreads) * pPageSize);
+      const std::size_t lEnd = std::min(lSize, (lNumPages * (t + 1) / lNumThreads) * pPageSize);
+      lThreads.push_back(create_thread_member("shm_prefault", &RegionAllocatorResource::prefaultRange, this,
+        lData + lBegin, lEnd - lBegin, pLock, &lLockFailures));
+    }
+    for (auto &lThread : lThreads) {
+      lThread.join();
+    }
+
+    const double lElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+    IDDLOG("Memory segment '{}': pre-faulted region. size={} page_size={} threads={} locked={} elapsed_s={:.3} "
+      "rate_gib_s={:.3}", mSegmentName, lSize, pPageSize, lNumThreads, (pLock && lLockFailures == 0), lElapsed,
+      double(lSize) / double(1ULL << 30) / std::max(lElapsed, 1e-6));
+
+    if (lLockFailures > 0) {
+      if (std::getenv(ENV_NOLOCK)) {
+        WDDLOG("Memory segment '{}': failed to lock the memory region. errors={}", mSegmentName, lLockFailures);
+      } else {
+        EDDLOG("Memory segment '{}': failed to lock the memory region. Increase your memory lock limits "
+          "(ulimit -l), or define {} env variable (not suitable for production).", mSegmentName, ENV_NOLOCK);
+        throw std::bad_alloc();
+      }
+    }
+  }
+
+  void prefaultRange(char *pStart, const std::size_t pLen, const bool pLock, std::atomic_size_t *pLockFailures)
+  {
+    if (pLen == 0) {
+      return;
+    }
+    // writing faults the pages in, on the NUMA node the region is bound to
+    std::memset(pStart, 0x00, pLen);
+
+    if (pLock && (0 != mlock(pStart, pLen))) {
+      (*pLockFailures)++;
+    }
+  }
+
+public:
+
   inline
   std::unique_ptr<FairMQMessage> NewFairMQMessage(std::size_t pSize) {
     auto* lMem = do_allocate(pSize, ALIGN);
@@ -248,6 +767,82 @@ public:
     }
   }
 
+  // Non-blocking variant: returns nullptr if the region cannot serve the allocation immediately
+  inline
+  std::unique_ptr<FairMQMessage> TryNewFairMQMessage(std::size_t pSize) {
+    auto* lMem = do_allocate(pSize, ALIGN, false);
+    if (lMem) {
+      return mTransport.CreateMessage(mRegion, lMem, pSize);
+    } else {
+      return nullptr;
+    }
+  }
+
+  // Thread-safe variants: allocate from the per-thread magazine
+  inline
+  std::unique_ptr<FairMQMessage> NewFairMQMessageMT(std::size_t pSize) {
+    auto* lMem = do_allocate_mt(pSize);
+    if (lMem) {
+      return mTransport.CreateMessage(mRegion, lMem, pSize);
+    } else {
+      return nullptr;
+    }
+  }
+
+  inline
+  std::unique_ptr<FairMQMessage> NewFairMQMessageMT(const char *pData, const std::size_t pSize) {
+    auto* lMem = do_allocate_mt(pSize);
+    if (lMem) {
+      std::memcpy(lMem, pData, pSize);
+      return mTransport.CreateMessage(mRegion, lMem, pSize);
+    } else {
+      return nullptr;
+    }
+  }
+
+  inline
+  std::unique_ptr<FairMQMessage> TryNewFairMQMessageMT(std::size_t pSize) {
+    auto* lMem = do_allocate_mt(pSize, false);
+    if (lMem) {
+      return mTransport.CreateMessage(mRegion, lMem, pSize);
+    } else {
+      return nullptr;
+    }
+  }
+
+  // Slot distance for objects placed with allocate_slots(). The interval engine reclaims every slot
+  // as a separate block, the size class engine returns the whole block once all slots are released.
+  std::size_t slot_stride(const std::size_t pObjSize) const {
+    return align_size_up(pObjSize);
+  }
+
+  // Allocate one contiguous block for pCount objects of pObjSize bytes, placed slot_stride() apart.
+  // Messages for individual objects are created with NewFairMQMessageFromPtr(ptr, pObjSize), and
+  // each one returns its slot to the region independently.
+  // NOTE: all slots must be turned into messages, otherwise the memory is not reclaimed
+  char* allocate_slots(const std::size_t pObjSize, const std::size_t pCount) {
+    if (pObjSize == 0 || pCount == 0) {
+      return nullptr;
+    }
+    auto lSlots = static_cast<char*>(do_allocate(slot_stride(pObjSize) * pCount, ALIGN, true, true));
+    record_extent_slots(lSlots, slot_stride(pObjSize) * pCount, pCount);
+    return lSlots;
+  }
+
+  // Thread-safe variant of allocate_slots()
+  char* allocate_slots_mt(const std::size_t pObjSize, const std::size_t pCount) {
+    if (pObjSize == 0 || pCount == 0) {
+      return nullptr;
+    }
+    char *lSlots = nullptr;
+    {
+      std::scoped_lock lLock(mAllocLock);
+      lSlots = static_cast<char*>(do_allocate(slot_stride(pObjSize) * pCount, ALIGN, true, true));
+    }
+    record_extent_slots(lSlots, slot_stride(pObjSize) * pCount, pCount);
+    return lSlots;
+  }
+
   inline
   std::unique_ptr<FairMQMessage> NewFairMQMessageFromPtr(void *pPtr, const std::size_t pSize) {
     assert(pPtr >= static_cast<char*>(mRegion->GetData()));
@@ -256,12 +851,74 @@ public:
     return mTransport.CreateMessage(mRegion, pPtr, pSize);
   }
 
+  // Reserve the start of the region for fixed-size slots. Allocations not larger than the slot
+  // are served from the pool while slots are available.
+  // NOTE: must be called before any allocations are made from the region
+  void enableSlotPool(const std::size_t pSlotSize, const std::size_t pPoolSize) {
+    const std::size_t lSlotSize = align_size_up(std::max(pSlotSize, sizeof(void*)));
+    const std::size_t lPoolSize = std::min(pPoolSize, mLength.load()) / lSlotSize * lSlotSize;
+
+    if (mSlotPool || mStart != static_cast<char*>(mRegion->GetData()) || lPoolSize == 0) {
+      EDDLOG("Memory segment '{}': cannot create the slot pool. slot_size={} pool_size={}",
+        mSegmentName, lSlotSize, lPoolSize);
+      return;
+    }
+
+    mSlotPool = std::make_shared<RegionSlotPool>(mStart, lPoolSize, lSlotSize);
+    mStart += lPoolSize;
+    mLength -= lPoolSize;
+
+    IDDLOG("Memory segment '{}': slot pool created. slot_size={} num_slots={}",
+      mSegmentName, lSlotSize, lPoolSize / lSlotSize);
+  }
+
   void stop() {
-    std::scoped_lock lock(mReclaimLock);
-    mRunning = false;
+    {
+      std::scoped_lock lock(mReclaimLock);
+      mRunning = false;
+    }
+    // wake up all blocked allocations
+    std::scoped_lock lWaitLock(mWaitLock);
+    mWaitCond.notify_all();
   }
 
   std::size_t free() const { return mFree; }
+  std::size_t size() const { return mSegmentSize; }
+
+  std::uint64_t magazine_refills() const { return mMagazineRefills; }
+
+  std::uint64_t try_alloc_failed() const { return mTryAllocFailed; }
+
+  // Allocation wait and reclaim batch histograms cover the interval since the previous call
+  RegionAllocatorStats stats() {
+    RegionAllocatorStats lStats;
+
+    lStats.mSize = mSegmentSize;
+    lStats.mFree = std::max(std::int64_t(0), std::int64_t(mFree));
+    lStats.mTryAllocFailed = mTryAllocFailed;
+    lStats.mSizeClassBytes = mSizeClassBytes;
+    lStats.mMagazineRefills = mMagazineRefills;
+    lStats.mReclaimBatchHist = mReclaimBatchHist.snapshot_reset();
+
+    const auto lWaitHist = mAllocWaitHist.snapshot_reset();
+    lStats.mAllocWaitP50Us = Log2Histogram::percentile(lWaitHist, 50.0);
+    lStats.mAllocWaitP90Us = Log2Histogram::percentile(lWaitHist, 90.0);
+    lStats.mAllocWaitP99Us = Log2Histogram::percentile(lWaitHist, 99.0);
+    lStats.mAllocWaitMaxUs = Log2Histogram::percentile(lWaitHist, 100.0);
+
+    {
+      std::scoped_lock lock(mReclaimLock);
+      // NOTE: the allocating thread can shrink the current extent concurrently, good enough for stats
+      const std::size_t lLength = mLength.load(std::memory_order_relaxed);
+      lStats.mLargestFreeBlock = lLength;
+      lStats.mNumFreeRanges = mFreeRanges.iterative_size() + (lLength > 0 ? 1 : 0);
+      for (const auto &lRange : mFreeRanges) {
+        lStats.mLargestFreeBlock = std::max(lStats.mLargestFreeBlock, lRange.first.upper() - lRange.first.lower());
+      }
+    }
+
+    return lStats;
+  }
 
   bool running() const { return mRunning; }
 
@@ -273,7 +930,9 @@ protected:
     return (pSize + ALIGN - 1) / ALIGN * ALIGN;
   }
 
-  void* do_allocate(std::size_t pSize, std::size_t /* pAlign */)
+  // NOTE: pExtent skips the slot pool and size classes, the block is taken from the free extents
+  void* do_allocate(std::size_t pSize, std::size_t /* pAlign */, const bool pBlocking = true,
+    const bool pExtent = false)
   {
     if (!mRunning) {
       return nullptr;
@@ -287,22 +946,70 @@ protected:
     // align up
     pSize = align_size_up(pSize);
 
-    auto lRet = try_alloc(pSize);
-    // we cannot fail! report problem if failing to allocate block often
-    while (!lRet && mRunning) {
-      // try to reclaim if possible
-      if (try_reclaim(pSize)) {
-        // try again
-        lRet = try_alloc(pSize);
+    // fixed size headers are served from the slot pool, if enabled
+    if (!pExtent && mSlotPool && (pSize <= mSlotPool->slot_size())) {
+      auto lSlot = mSlotPool->get();
+      if (lSlot) {
+        mFree -= mSlotPool->slot_size();
+        return lSlot;
       }
+      // pool exhausted, use the general path
+    }
 
-      if (!lRet) {
-        using namespace std::chrono_literals;
-        WDDLOG_RL(1000, "RegionAllocatorResource: waiting to allocate a message. region={} alloc={} region_size={} free={}",
-          mSegmentName, pSize, mRegion->GetSize(), mFree);
-        WDDLOG_RL(1000, "Memory region '{}' is too small, or there is a large backpressure.", mSegmentName);
-        std::this_thread::sleep_for(5ms);
+    // small blocks are served from size classes, if enabled
+    const bool lSizeClass = !pExtent && mSizeClasses && (pSize <= RegionSizeClasses<ALIGN>::cMaxClassSize);
+    std::size_t lClassIdx = 0;
+    if (lSizeClass) {
+      lClassIdx = RegionSizeClasses<ALIGN>::class_index(pSize);
+      pSize = RegionSizeClasses<ALIGN>::class_size(lClassIdx);
+    }
+
+    const auto lRetry = [&]() -> void* {
+      if (lSizeClass) {
+        // blocks could have been freed in the meantime
+        return try_alloc_class(lClassIdx);
+      } else if (try_reclaim(pSize)) {
+        // try to reclaim if possible
+        return try_alloc(pSize);
       }
+      return nullptr;
+    };
+
+    // snapshot of returned bytes, taken before the attempt so that no release is missed
+    std::uint64_t lReclaimedSnap = mReclaimedTotal;
+
+    auto lRet = lSizeClass ? try_alloc_class(lClassIdx) : try_alloc(pSize);
+    if (!lRet) {
+      lRet = lRetry();
+    }
+
+    std::chrono::steady_clock::time_point lWaitStart;
+    if (!lRet && pBlocking) {
+      lWaitStart = std::chrono::steady_clock::now();
+    }
+
+    // we cannot fail! report problem if failing to allocate block often
+    while (!lRet && mRunning && pBlocking) {
+      WDDLOG_RL(1000, "RegionAllocatorResource: waiting to allocate a message. region={} alloc={} region_size={} free={}",
+        mSegmentName, pSize, mRegion->GetSize(), mFree);
+      WDDLOG_RL(1000, "Memory region '{}' is too small, or there is a large backpressure.", mSegmentName);
+
+      wait_for_release(pSize, lReclaimedSnap);
+
+      lReclaimedSnap = mReclaimedTotal;
+      lRet = lRetry();
+    }
+
+    if (!lRet && !pBlocking) {
+      mTryAllocFailed++;
+      return nullptr;
+    }
+
+    if (lWaitStart.time_since_epoch().count() != 0) {
+      mAllocWaitHist.record(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - lWaitStart).count());
+    } else {
+      mAllocWaitHist.record(0);
     }
 
     // check the running again
@@ -323,16 +1030,281 @@ protected:
     return lRet;
   }
 
+  // Thread-safe allocation. Each thread reserves a chunk of the region (magazine) and allocates
+  // from it without locking. With size classes, the magazine caches blocks taken from the class
+  // lists instead. Large blocks, and allocations while a magazine cannot be refilled, take the locked path.
+  void* do_allocate_mt(std::size_t pSize, const bool pBlocking = true)
+  {
+    if (!mRunning) {
+      return nullptr;
+    }
+
+    if (pSize == 0) {
+      // return last address of the segment
+      return reinterpret_cast<char*>(mRegion->GetData()) + mRegion->GetSize();
+    }
+
+    std::size_t lSize = align_size_up(pSize);
+
+    // slots are already cached per thread
+    if (mSlotPool && (lSize <= mSlotPool->slot_size())) {
+      auto lSlot = mSlotPool->get();
+      if (lSlot) {
+        mFree -= mSlotPool->slot_size();
+        return lSlot;
+      }
+    }
+
+    // keep the block size consistent with the free path
+    if (mSizeClasses && (lSize <= RegionSizeClasses<ALIGN>::cMaxClassSize)) {
+      lSize = RegionSizeClasses<ALIGN>::class_size(RegionSizeClasses<ALIGN>::class_index(lSize));
+    }
+
+    if (lSize <= mMagazineSize / 4) {
+      auto &lMag = thread_magazine();
+
+      // size class blocks are cached per class, and released to their class list
+      if (mSizeClasses && (lSize <= RegionSizeClasses<ALIGN>::cMaxClassSize)) {
+        const auto lIdx = RegionSizeClasses<ALIGN>::class_index(lSize);
+
+        if (!lMag.mClassHead[lIdx]) {
+          refill_class_magazine(lMag, lIdx);
+        }
+
+        if (lMag.mClassHead[lIdx]) {
+          void *lRet = lMag.mClassHead[lIdx];
+          lMag.mClassHead[lIdx] = *reinterpret_cast<void**>(lRet);
+          *reinterpret_cast<void**>(lRet) = nullptr; // blocks are handed out zeroed
+          return lRet;
+        }
+      } else {
+        if (lMag.mLength < lSize) {
+          refill_magazine(lMag);
+        }
+
+        if (lMag.mLength >= lSize) {
+          const auto lRet = lMag.mStart;
+          lMag.mStart += lSize;
+          lMag.mLength -= lSize;
+          return lRet;
+        }
+      }
+    }
+
+    std::scoped_lock lLock(mAllocLock);
+    return do_allocate(pSize, ALIGN, pBlocking);
+  }
+
 private:
+  // Block until at least pSize bytes were returned to the region after pSnap was taken. Returned
+  // bytes are not necessarily contiguous, the caller must retry and wait again if needed.
+  // The timeout only guards against a (fragmented) region that never returns enough at once.
+  void wait_for_release(const std::size_t pSize, const std::uint64_t pSnap) {
+    using namespace std::chrono_literals;
+    std::unique_lock lLock(mWaitLock);
+
+    mNumWaiters++;
+    mWaitCond.wait_for(lLock, 100ms, [&]() {
+      return !mRunning || (mReclaimedTotal - pSnap) >= pSize;
+    });
+    mNumWaiters--;
+  }
+
+  // called from the region callback, after the blocks are available for allocation
+  void notify_waiters(const std::uint64_t pReclaimed) {
+    mReclaimedTotal += pReclaimed;
+
+    if (mNumWaiters > 0) {
+      std::scoped_lock lLock(mWaitLock);
+      mWaitCond.notify_all();
+    }
+  }
+
+  // Slot blocks are taken from the extents. With size classes, the callback would push every slot
+  // to a class list, and the extents would drain. Keep the block until all slots are released.
+  void record_extent_slots(const char *pStart, const std::size_t pSize, const std::size_t pCount) {
+    if (!pStart || !mSizeClasses) {
+      return;
+    }
+    std::scoped_lock lLock(mExtentSlotsLock);
+    mExtentSlots[pStart] = ExtentSlots{ pSize, pCount };
+    mNumExtentSlotRanges++;
+  }
+
+  // called from the region callback: true if pPtr is an extent slot
+  bool release_extent_slot(const char *pPtr, icl::interval_map<std::size_t, std::size_t> &pIntMap) {
+    std::scoped_lock lLock(mExtentSlotsLock);
+
+    auto lIt = mExtentSlots.upper_bound(pPtr);
+    if (lIt == mExtentSlots.begin()) {
+      return false;
+    }
+    --lIt;
+
+    if (pPtr >= lIt->first + lIt->second.mSize) {
+      return false;
+    }
+
+    if (--lIt->second.mPending == 0) {
+      pIntMap += std::make_pair(
+        icl::discrete_interval<std::size_t>::right_open(
+          std::size_t(lIt->first), std::size_t(lIt->first) + lIt->second.mSize), std::size_t(1));
+      mExtentSlots.erase(lIt);
+      mNumExtentSlotRanges--;
+    }
+    return true;
+  }
+
+  // Magazines outlive the resource if the thread does. They only return their blocks
+  // while the resource is alive.
+  struct MagazineOwner {
+    std::mutex mLock;
+    RegionAllocatorResource *mResource = nullptr;
+  };
+
+  struct Magazine {
+    std::shared_ptr<MagazineOwner> mOwner;
+    std::uint64_t mResourceId = 0;
+    char *mStart = nullptr;
+    std::size_t mLength = 0;
+    std::uint64_t mRefills = 0;
+    // size class blocks, one list per class
+    std::array<void*, RegionSizeClasses<ALIGN>::cNumClasses> mClassHead = { };
+
+    bool alive() {
+      std::scoped_lock lLock(mOwner->mLock);
+      return mOwner->mResource != nullptr;
+    }
+
+    // thread exit: return the cached blocks
+    ~Magazine() {
+      std::scoped_lock lLock(mOwner->mLock);
+      if (mOwner->mResource) {
+        mOwner->mResource->return_magazine(*this);
+      }
+    }
+  };
+
+  // one magazine per resource and thread
+  Magazine& thread_magazine() {
+    static thread_local std::vector<std::unique_ptr<Magazine>> tMagazines;
+
+    for (auto &lMag : tMagazines) {
+      if (lMag->mResourceId == mResourceId) {
+        return *lMag;
+      }
+    }
+
+    // drop the magazines of destroyed resources
+    tMagazines.erase(std::remove_if(tMagazines.begin(), tMagazines.end(),
+      [](const std::unique_ptr<Magazine> &pMag) { return !pMag->alive(); }), tMagazines.end());
+
+    tMagazines.push_back(std::make_unique<Magazine>());
+    tMagazines.back()->mOwner = mMagazineOwner;
+    tMagazines.back()->mResourceId = mResourceId;
+    return *tMagazines.back();
+  }
+
+  void refill_magazine(Magazine &pMag) {
+    std::scoped_lock lLock(mAllocLock);
+
+    // return the leftover
+    if (pMag.mLength > 0) {
+      std::scoped_lock lReclaimLock(mReclaimLock);
+      reclaimSHMMessage(pMag.mStart, pMag.mLength);
+      mFree += pMag.mLength;
+    }
+    pMag.mStart = nullptr;
+    pMag.mLength = 0;
+
+    auto lChunk = static_cast<char*>(try_alloc(mMagazineSize));
+    if (!lChunk && try_reclaim(mMagazineSize)) {
+      lChunk = static_cast<char*>(try_alloc(mMagazineSize));
+    }
+
+    if (!lChunk) {
+      return; // use the locked path
+    }
+
+    // the magazine is accounted as used until the blocks are freed
+    mFree -= mMagazineSize;
+    pMag.mStart = lChunk;
+    pMag.mLength = mMagazineSize;
+    pMag.mRefills++;
+    mMagazineRefills++;
+
+    DDDLOG_RL(5000, "Memory segment '{}': thread magazine refilled. thread_refills={} total_refills={}",
+      mSegmentName, pMag.mRefills, mMagazineRefills);
+  }
+
+  // take a batch of blocks from the class list (or a new span) into the magazine
+  void refill_class_magazine(Magazine &pMag, const std::size_t pIdx) {
+    const std::size_t lClassSize = RegionSizeClasses<ALIGN>::class_size(pIdx);
+    const std::size_t lBatch = std::clamp(mMagazineSize / 4 / lClassSize, std::size_t(1), cMagazineClassBatch);
+
+    std::scoped_lock lLock(mAllocLock);
+
+    std::size_t lCount = 0;
+    for (; lCount < lBatch; lCount++) {
+      void *lBlock = try_alloc_class(pIdx);
+      if (!lBlock) {
+        break; // use the locked path
+      }
+      *reinterpret_cast<void**>(lBlock) = pMag.mClassHead[pIdx];
+      pMag.mClassHead[pIdx] = lBlock;
+    }
+
+    if (lCount == 0) {
+      return;
+    }
+
+    // the cached blocks are accounted as used until they are returned
+    mFree -= lCount * lClassSize;
+    pMag.mRefills++;
+    mMagazineRefills++;
+
+    DDDLOG_RL(5000, "Memory segment '{}': thread magazine refilled. class_size={} blocks={} "
+      "thread_refills={} total_refills={}", mSegmentName, lClassSize, lCount, pMag.mRefills, mMagazineRefills);
+  }
+
+  // return all blocks held by the magazine. Called on thread exit, with the owner locked.
+  void return_magazine(Magazine &pMag) {
+    std::int64_t lReturned = 0;
+
+    for (std::size_t lIdx = 0; lIdx < pMag.mClassHead.size(); lIdx++) {
+      while (pMag.mClassHead[lIdx]) {
+        void *lBlock = pMag.mClassHead[lIdx];
+        pMag.mClassHead[lIdx] = *reinterpret_cast<void**>(lBlock);
+        mSizeClasses->push(lIdx, lBlock);
+        lReturned += RegionSizeClasses<ALIGN>::class_size(lIdx);
+      }
+    }
+
+    if (pMag.mLength > 0) {
+      std::scoped_lock lReclaimLock(mReclaimLock);
+      reclaimSHMMessage(pMag.mStart, pMag.mLength);
+      lReturned += pMag.mLength;
+    }
+    pMag.mStart = nullptr;
+    pMag.mLength = 0;
+
+    if (lReturned > 0) {
+      mFree += lReturned;
+      notify_waiters(lReturned);
+    }
+  }
+
   inline
   void* try_alloc(const std::size_t pSize) {
-    if (mLength >= pSize) {
+    // only the allocating thread changes the extent, stats() reads the length
+    const std::size_t lLength = mLength.load(std::memory_order_relaxed);
+    if (lLength >= pSize) {
       const auto lObjectPtr = mStart;
 
       mStart += pSize;
-      mLength -= pSize;
+      mLength.store(lLength - pSize, std::memory_order_relaxed);
 
-      if (mLength == 0) {
+      if (lLength == pSize) {
         mStart = nullptr;
       }
 
@@ -342,6 +1314,45 @@ private:
     return nullptr;
   }
 
+  // Size class allocation: take a free block of the class, or carve a new span from the extent.
+  // Carved spans are not returned to the interval map. The blocks stay in their class (counted in mSizeClassBytes).
+  inline
+  void* try_alloc_class(const std::size_t pIdx) {
+    auto lRet = mSizeClasses->pop(pIdx);
+    if (lRet) {
+      return lRet;
+    }
+
+    const std::size_t lClassSize = RegionSizeClasses<ALIGN>::class_size(pIdx);
+    std::size_t lSpanSize = std::max(cSizeClassSpanSize / lClassSize, std::size_t(8)) * lClassSize;
+
+    char *lSpan = static_cast<char*>(try_alloc(lSpanSize));
+    if (!lSpan && try_reclaim(lSpanSize)) {
+      lSpan = static_cast<char*>(try_alloc(lSpanSize));
+    }
+
+    if (!lSpan) {
+      // the region is close to full, try with a single block
+      lSpanSize = lClassSize;
+      lSpan = static_cast<char*>(try_alloc(lSpanSize));
+      if (!lSpan && try_reclaim(lSpanSize)) {
+        lSpan = static_cast<char*>(try_alloc(lSpanSize));
+      }
+      if (lSpan) {
+        mSizeClassBytes += lSpanSize;
+      }
+      return lSpan;
+    }
+    mSizeClassBytes += lSpanSize;
+
+    // keep the first block, the rest go to the free list
+    for (std::size_t lOff = lSpanSize - lClassSize; lOff > 0; lOff -= lClassSize) {
+      mSizeClasses->push_local(pIdx, lSpan + lOff);
+    }
+
+    return lSpan;
+  }
+
   bool try_reclaim(const std::size_t pSize) {
     // First declare any leftover memory as free
     std::scoped_lock lock(mReclaimLock);
@@ -434,7 +1445,7 @@ private:
   std::unique_ptr<FairMQUnmanagedRegion> mRegion;
 
   char *mStart = nullptr;
-  std::size_t mLength = 0;
+  std::atomic_size_t mLength = 0;
 
   // free space accounting
   std::atomic_int64_t mFree = 0;
@@ -442,12 +1453,92 @@ private:
   // two step reclaim to avoid lock contention in the allocation path
   std::mutex mReclaimLock;
   icl::interval_map<std::size_t, std::size_t> mFreeRanges;
+
+  // size class engine (optional)
+  static constexpr std::size_t cSizeClassSpanSize = std::size_t(2) << 20;
+  std::unique_ptr<RegionSizeClasses<ALIGN>> mSizeClasses;
+  std::atomic_uint64_t mSizeClassBytes = 0;
+
+  // header slot pool (optional)
+  std::shared_ptr<RegionSlotPool> mSlotPool;
+
+  // header slot blocks taken from the extents, with the number of slots not yet released
+  struct ExtentSlots {
+    std::size_t mSize;
+    std::size_t mPending;
+  };
+  std::mutex mExtentSlotsLock;
+  std::map<const char*, ExtentSlots> mExtentSlots;
+  std::atomic_size_t mNumExtentSlotRanges = 0;
+
+  // per-thread magazines (thread-safe allocation)
+  static constexpr std::size_t cMagazineClassBatch = 32;
+  const std::uint64_t mResourceId = sResourceIdCnt.fetch_add(1) + 1;
+  std::shared_ptr<MagazineOwner> mMagazineOwner = std::make_shared<MagazineOwner>();
+  std::size_t mMagazineSize = 0;
+  std::mutex mAllocLock;
+  std::atomic_uint64_t mMagazineRefills = 0;
+
+  // blocking allocations wait on the region callback
+  std::mutex mWaitLock;
+  std::condition_variable mWaitCond;
+  std::atomic_uint64_t mNumWaiters = 0;
+  std::atomic_uint64_t mReclaimedTotal = 0;
+  std::atomic_uint64_t mTryAllocFailed = 0;
+
+  // statistics
+  Log2Histogram mAllocWaitHist;
+  Log2Histogram mReclaimBatchHist;
+
+  static inline std::atomic_uint64_t sResourceIdCnt = 0;
 };
 
 
 class MemoryResources {
 
 public:
+  static constexpr const char* OptionKeyShmAllocator = "shm-allocator";
+  static constexpr const char* OptionKeyShmHeaderSlotPool = "shm-header-slot-pool";
+  static constexpr const char* OptionKeyShmHeaderSlotPoolPercent = "shm-header-slot-pool-percent";
+  static constexpr const char* OptionKeyShmNumaNode = "shm-numa-node";
+  static constexpr const char* OptionKeyShmNumaRegions = "shm-numa-regions";
+  static constexpr const char* OptionKeyShmPrefaultThreads = "shm-prefault-threads";
+
+  static
+  boost::program_options::options_description getProgramOptions()
+  {
+    namespace bpo = boost::program_options;
+    bpo::options_description lMemoryOptions("Shared memory region options", 120);
+
+    lMemoryOptions.add_options()(
+      OptionKeyShmAllocator,
+      bpo::value<RegionAllocStrategy>()->default_value(RegionAllocStrategy::eIntervalMap, "interval"),
+      "Allocation engine for shared memory regions. Permitted values: interval (default), "
+      "sizeclass (segregated-fit with lock-free free lists; memory carved for a size class is not returned to the "
+      "region, the footprint stays at the peak use of each class).")(
+      OptionKeyShmHeaderSlotPool,
+      bpo::bool_switch()->default_value(false),
+      "Serve fixed-size O2 headers from a pool of slots with per-thread caches. "
+      "The start of the header region is reserved for the pool (see shm-header-slot-pool-percent).")(
+      OptionKeyShmHeaderSlotPoolPercent,
+      bpo::value<unsigned>()->default_value(50),
+      "Percentage of the header region reserved for the header slot pool (1-99). Default: 50.")(
+      OptionKeyShmNumaNode,
+      bpo::value<int>()->default_value(-1),
+      "Bind the shared memory regions to the NUMA node (e.g. local to the NIC). Default: no binding (-1).")(
+      OptionKeyShmNumaRegions,
+      bpo::bool_switch()->default_value(false),
+      "Create one data region per NUMA node and allocate from the region local to the calling thread. "
+      "The data region size is split equally between the nodes.")(
+      OptionKeyShmPrefaultThreads,
+      bpo::value<unsigned>()->default_value(0),
+      "Pre-fault and lock the shared memory regions with the given number of threads when they are created. "
+      "Huge pages of a hugetlbfs mount (DATADIST_SHM_PATH) are respected. "
+      "Default: 0 (populated and locked by the mapping, in one thread).");
+
+    return lMemoryOptions;
+  }
+
   MemoryResources() = delete;
   explicit MemoryResources(std::shared_ptr<FairMQTransportFactory> pShmTransport)
   : mShmTransport(pShmTransport) { }
@@ -455,6 +1546,8 @@ public:
   virtual ~MemoryResources() {
     // make sure to delete regions before dropping the transport
     mHeaderMemRes.reset();
+    mDataMemResByNode.clear();
+    mNumaDataMemRes.clear();
     mDataMemRes.reset();
     mShmTransport.reset();
   }
@@ -468,7 +1561,72 @@ public:
   inline
   FairMQMessagePtr newDataMessage(const std::size_t pSize) {
     assert(mDataMemRes);
-    return mDataMemRes->NewFairMQMessage(pSize);
+    return dataRegion().NewFairMQMessage(pSize);
+  }
+
+  // Batch header allocation: one block with pCount header slots. See RegionAllocatorResource::allocate_slots()
+  // pConcurrent: the header region is shared by multiple allocating threads
+  inline
+  char* newHeaderSlots(const std::size_t pHdrSize, const std::size_t pCount, std::size_t &pStride /*[out]*/,
+    const bool pConcurrent = false) {
+    assert(mHeaderMemRes);
+    pStride = mHeaderMemRes->slot_stride(pHdrSize);
+    return pConcurrent ? mHeaderMemRes->allocate_slots_mt(pHdrSize, pCount) :
+      mHeaderMemRes->allocate_slots(pHdrSize, pCount);
+  }
+
+  inline
+  FairMQMessagePtr newHeaderMessageFromSlot(char *pSlot, const std::size_t pHdrSize) {
+    assert(mHeaderMemRes);
+    return mHeaderMemRes->NewFairMQMessageFromPtr(pSlot, pHdrSize);
+  }
+
+  // Non-blocking: returns nullptr when the data region is full (early drop decisions)
+  inline
+  FairMQMessagePtr tryNewDataMessage(const std::size_t pSize) {
+    assert(mDataMemRes);
+    return dataRegion().TryNewFairMQMessage(pSize);
+  }
+
+  // Create the data region(s). With NUMA regions enabled, one region per node is created.
+  void createDataRegions(const std::string &pName, const std::size_t pSize, const std::uint64_t pRegionFlags)
+  {
+    const int lNumNodes = mNumaRegions ? numa::num_nodes() : 1;
+
+    if (lNumNodes <= 1) {
+      mDataMemRes = std::make_unique<RegionAllocatorResource<>>(pName, *mShmTransport, pSize, pRegionFlags,
+        mAllocStrategy, mNumaNode, mPrefaultThreads);
+      return;
+    }
+
+    for (int lNode = 0; lNode < lNumNodes; lNode++) {
+      auto lRegion = std::make_unique<RegionAllocatorResource<>>(pName + "_numa" + std::to_string(lNode),
+        *mShmTransport, pSize / lNumNodes, pRegionFlags, mAllocStrategy, lNode, mPrefaultThreads);
+
+      mDataMemResByNode.push_back(lRegion.get());
+      if (lNode == 0) {
+        mDataMemRes = std::move(lRegion);
+      } else {
+        mNumaDataMemRes.push_back(std::move(lRegion));
+      }
+    }
+  }
+
+  // data region local to the calling thread
+  inline
+  RegionAllocatorResource<>& dataRegion() {
+    if (mDataMemResByNode.empty()) {
+      return *mDataMemRes;
+    }
+
+    // refresh the node of the thread from time to time
+    static thread_local int tNode = numa::current_node();
+    static thread_local std::uint32_t tCnt = 0;
+    if (++tCnt % 1024 == 0) {
+      tNode = numa::current_node();
+    }
+
+    return *mDataMemResByNode[std::size_t(tNode) % mDataMemResByNode.size()];
   }
 
   inline
@@ -491,14 +1649,93 @@ public:
     if (mDataMemRes) {
       mDataMemRes->stop();
     }
+    for (auto &lRegion : mNumaDataMemRes) {
+      lRegion->stop();
+    }
+  }
+
+  // create the header slot pool, if configured
+  void initHeaderSlotPool(const std::size_t pSlotSize) {
+    if (mHeaderSlotPool && mHeaderMemRes) {
+      const auto lPercent = std::clamp(mHeaderSlotPoolPercent, 1U, 99U);
+      mHeaderMemRes->enableSlotPool(pSlotSize, mHeaderMemRes->free() / 100 * lPercent);
+    }
   }
 
   inline std::size_t freeHeader() const { return (running() && mHeaderMemRes) ? mHeaderMemRes->free() : std::size_t(0); }
-  inline std::size_t freeData() const { return (running() && mDataMemRes) ? mDataMemRes->free() : std::size_t(0);  }
+  inline std::size_t freeData() const {
+    if (!running() || !mDataMemRes) {
+      return std::size_t(0);
+    }
+    std::size_t lFree = mDataMemRes->free();
+    for (const auto &lRegion : mNumaDataMemRes) {
+      lFree += lRegion->free();
+    }
+    return lFree;
+  }
+
+  inline std::size_t sizeData() const {
+    if (!mDataMemRes) {
+      return std::size_t(0);
+    }
+    std::size_t lSize = mDataMemRes->size();
+    for (const auto &lRegion : mNumaDataMemRes) {
+      lSize += lRegion->size();
+    }
+    return lSize;
+  }
+
+  inline RegionAllocatorStats headerStats() const {
+    return mHeaderMemRes ? mHeaderMemRes->stats() : RegionAllocatorStats();
+  }
+
+  // NUMA data regions are reported together
+  inline RegionAllocatorStats dataStats() const {
+    if (!mDataMemRes) {
+      return RegionAllocatorStats();
+    }
+
+    auto lStats = mDataMemRes->stats();
+    for (const auto &lRegion : mNumaDataMemRes) {
+      const auto lNodeStats = lRegion->stats();
+      lStats.mSize += lNodeStats.mSize;
+      lStats.mFree += lNodeStats.mFree;
+      lStats.mLargestFreeBlock = std::max(lStats.mLargestFreeBlock, lNodeStats.mLargestFreeBlock);
+      lStats.mNumFreeRanges += lNodeStats.mNumFreeRanges;
+      lStats.mTryAllocFailed += lNodeStats.mTryAllocFailed;
+      lStats.mSizeClassBytes += lNodeStats.mSizeClassBytes;
+      lStats.mMagazineRefills += lNodeStats.mMagazineRefills;
+      lStats.mAllocWaitP50Us = std::max(lStats.mAllocWaitP50Us, lNodeStats.mAllocWaitP50Us);
+      lStats.mAllocWaitP90Us = std::max(lStats.mAllocWaitP90Us, lNodeStats.mAllocWaitP90Us);
+      lStats.mAllocWaitP99Us = std::max(lStats.mAllocWaitP99Us, lNodeStats.mAllocWaitP99Us);
+      lStats.mAllocWaitMaxUs = std::max(lStats.mAllocWaitMaxUs, lNodeStats.mAllocWaitMaxUs);
+      for (std::size_t i = 0; i < lStats.mReclaimBatchHist.size(); i++) {
+        lStats.mReclaimBatchHist[i] += lNodeStats.mReclaimBatchHist[i];
+      }
+    }
+    return lStats;
+  }
 
   std::unique_ptr<RegionAllocatorResource<alignof(o2::header::DataHeader)>> mHeaderMemRes;
   std::unique_ptr<RegionAllocatorResource<64>> mDataMemRes;
 
+  // allocation engine for new regions
+  RegionAllocStrategy mAllocStrategy = RegionAllocStrategy::eIntervalMap;
+  bool mHeaderSlotPool = false;
+  unsigned mHeaderSlotPoolPercent = 50;
+
+  // NUMA placement of new regions
+  int mNumaNode = -1;
+  bool mNumaRegions = false;
+  unsigned mPrefaultThreads = 0;
+
+private:
+  // additional data regions, one per NUMA node (node 0 is mDataMemRes)
+  std::vector<std::unique_ptr<RegionAllocatorResource<64>>> mNumaDataMemRes;
+  std::vector<RegionAllocatorResource<64>*> mDataMemResByNode;
+
+public:
+
   // shm transport
   std::shared_ptr<FairMQTransportFactory> mShmTransport;
 
@@ -515,23 +1752,27 @@ public:
 
   virtual ~SyncMemoryResources() {}
 
+  // NOTE: allocations are served from per-thread magazines, no global lock in the common path
   inline
   FairMQMessagePtr newHeaderMessage(const char *pData, const std::size_t pSize) {
     assert(mHeaderMemRes);
-    std::scoped_lock lock(mHdrLock);
-    return mHeaderMemRes->NewFairMQMessage(pData, pSize);
+    return mHeaderMemRes->NewFairMQMessageMT(pData, pSize);
   }
 
   inline
   FairMQMessagePtr newDataMessage(const std::size_t pSize) {
     assert(mDataMemRes);
-    std::scoped_lock lock(mDataLock);
-    return mDataMemRes->NewFairMQMessage(pSize);
+    return dataRegion().NewFairMQMessageMT(pSize);
   }
 
-private:
-  std::mutex mHdrLock;
-  std::mutex mDataLock;
+  inline
+  FairMQMessagePtr tryNewDataMessage(const std::size_t pSize) {
+    assert(mDataMemRes);
+    return dataRegion().TryNewFairMQMessageMT(pSize);
+  }
+
+  inline std::uint64_t headerRefills() const { return mHeaderMemRes ? mHeaderMemRes->magazine_refills() : 0; }
+  inline std::uint64_t dataRefills() const { return mDataMemRes ? mDataMemRes->magazine_refills() : 0; }
 };
 
 } /* o2::DataDistribution */
@@ -21,6 +21,12 @@
 #include <Headers/DAQID.h>
 
 #include <tuple>
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 namespace o2
 {
@@ -29,167 +35,403 @@ namespace DataDistribution
 
 o2::header::DataOrigin ReadoutDataUtils::sSpecifiedDataOrigin = o2::header::gDataOriginInvalid; // to be initialized if not RDH6
 ReadoutDataUtils::SubSpecMode ReadoutDataUtils::sRawDataSubspectype = eCruLinkId;
-ReadoutDataUtils::SanityCheckMode ReadoutDataUtils::sRdhSanityCheckMode = eNoSanityCheck;
 ReadoutDataUtils::RdhVersion ReadoutDataUtils::sRdhVersion = eRdhInvalid;
-bool ReadoutDataUtils::sEmptyTriggerHBFrameFilterring = false;
 
 std::unique_ptr<RDHReaderIf> RDHReader::sRDHReader = nullptr;
 
-/// static
-std::uint32_t ReadoutDataUtils::sFirstSeenHBOrbitCnt = 0;
-
-o2::header::DataOrigin
-ReadoutDataUtils::getDataOrigin(const RDHReader &R)
+bool ReadoutDataUtils::rdhSanityCheck(ReadoutDataContext &pCtx, const char* pData, const std::size_t pLen)
 {
-  if (sRdhVersion == eRdhVer6) {
-    const auto lOrig =  o2::header::DAQID::DAQtoO2(R.getSystemID());
-    if (lOrig != o2::header::DAQID::DAQtoO2(o2::header::DAQID::INVALID)) {
-      return lOrig;
-    } else {
-        EDDLOG_RL(1000, "Data origin in RDH is invalid: {}. Please configure the correct SYSTEM_ID in the hardware."
-          " Using the configuration value {}.", R.getSystemID(), std::string(sSpecifiedDataOrigin.str));
+  return withRdhReader([&](auto pReaderTag) {
+    using ReaderT = typename decltype(pReaderTag)::Reader;
+
+    const auto R = ReaderT(pData, pLen);
+
+    if (pLen < R.getRDHSize()) { // size of one RDH
+      EDDLOG("Data block is shorter than RDH: {}", pLen);
+      o2::header::hexDump("Short readout block", pData, pLen);
+      return false;
     }
-  }
 
-  return sSpecifiedDataOrigin;
-}
+    // set first hbframe orbit if not set for this stf
+    {
+      std::uint32_t lOrbit = R.getOrbit();
+      if (pCtx.mFirstSeenHBOrbitCnt == 0) {
+        pCtx.mFirstSeenHBOrbitCnt = lOrbit;
+      } else {
+        if (lOrbit < pCtx.mFirstSeenHBOrbitCnt) {
+          EDDLOG("Orbit counter of the current data packet (HBF) is smaller than first orbit of the STF."
+            " orbit={} first_orbit={} diff={}", lOrbit, pCtx.mFirstSeenHBOrbitCnt, (pCtx.mFirstSeenHBOrbitCnt - lOrbit));
+          return false;
+        }
+      }
+    }
 
-o2::header::DataHeader::SubSpecificationType
-ReadoutDataUtils::getSubSpecification(const RDHReader &R)
-{
-  static_assert( sizeof(o2::header::DataHeader::SubSpecificationType) == 4);
-  o2::header::DataHeader::SubSpecificationType lSubSpec = ~0;
-
-  if (ReadoutDataUtils::sRawDataSubspectype == eCruLinkId) {
-    /* add 1 to linkID because they start with 0 */
-    lSubSpec = (R.getCruID() << 16) | ((R.getLinkID() + 1) << (R.getEndPointID() == 0 ? 0 : 8));
-  } else if (ReadoutDataUtils::sRawDataSubspectype == eFeeId) {
-    lSubSpec = R.getFeeID();
-  } else {
-    EDDLOG("Invalid SubSpecification method={}", ReadoutDataUtils::sRawDataSubspectype);
-  }
+    // the fast checker only accepts. Failed blocks are checked again to report the reason
+    if ((pCtx.mRdhSanityCheckImpl == eSanityCheckSimd) && rdhSanityCheckSimd(pData, pLen)) {
+      return true;
+    }
 
-  return lSubSpec;
+    return rdhSanityCheckScalar(pData, pLen);
+  });
 }
 
-std::tuple<std::size_t, bool>
-ReadoutDataUtils::getHBFrameMemorySize(const FairMQMessagePtr &pMsg)
+bool ReadoutDataUtils::rdhSanityCheckScalar(const char* pData, const std::size_t pLen)
 {
-  std::size_t lMemRet = 0;
-  bool lStopRet = false;
+  return withRdhReader([&](auto pReaderTag) {
+    using ReaderT = typename decltype(pReaderTag)::Reader;
+
+    // sub spec of first RDH
+    const auto lSubSpec = getSubSpecification(ReaderT(pData, pLen));
+
+    std::int64_t lDataLen = pLen;
+    const char* lCurrData = pData;
+    std::uint32_t lPacketCnt = 1;
+
+    while(lDataLen > 0) {
+      const auto Rc = ReaderT(lCurrData, lDataLen);
 
-  try {
-    auto R = RDHReader(pMsg);
-    while (R != R.end()) {
-      lMemRet += R.getMemorySize();
-      lStopRet = R.getStopBit();
+      if (lDataLen > 0 && lDataLen < 64/*RDH*/ ) {
+        EDDLOG("BLOCK CHECK: Data is shorter than RDH. Block offset: {}", (lCurrData - pData));
+        o2::header::hexDump("Data at the end of the block", lCurrData, lDataLen);
+        return false;
+      }
+
+      // check if sub spec matches
+      if (lSubSpec != getSubSpecification(Rc)) {
+        EDDLOG("BLOCK CHECK: Data sub-specification of trailing RDHs does not match."
+          " RDH[0]::SubSpec: {:#06x}, RDH[{}]::SubSpec: {:#06x}",
+          lSubSpec, lPacketCnt, getSubSpecification(Rc));
+        return false;
+      }
+
+      const auto lMemSize = Rc.getMemorySize();
+      const auto lOffsetNext = Rc.getOffsetToNext();
+      const auto lStopBit = Rc.getStopBit();
+
+      // check if last package
+      if (lStopBit) {
+        if (lMemSize <= lDataLen) {
+          return true; // all memory is accounted for
+        } else {
+          EDDLOG("BLOCK CHECK: RDH has bit stop set, but memory size is different from remaining block size."
+            " memory_size={} remaining_buffer_size={}", lMemSize, lDataLen);
+          return false;
+        }
+      }
+
+      if (lOffsetNext == 0) {
+        EDDLOG("BLOCK CHECK: Next block offset is 0.");
+        return false;
+      }
+
+      if (lOffsetNext >= lDataLen) {
+        EDDLOG("BLOCK CHECK: Next offset points beyond end of data block (stop bit is not set).");
+        return false;
+      }
 
-      R = R.next();
+      if (lMemSize >= lDataLen) {
+        EDDLOG("BLOCK CHECK: Memory size is larger than remaining data block size for packet {}", lPacketCnt);
+        return false;
+      }
+
+      lDataLen -= lOffsetNext;
+      lCurrData += lOffsetNext;
+      lPacketCnt += 1;
     }
-  } catch (RDHReaderException &e) {
-    EDDLOG( e.what());
+
+    return true;
+  });
+}
+
+namespace {
+
+// Mask of RDH bits used for the O2 SubSpecification. RDHs with equal masked bits have the same SubSpecification.
+using RdhSubSpecMask = std::array<std::uint64_t, 8>;
+
+template <typename RDH>
+RdhSubSpecMask rdhSubSpecMask(const ReadoutDataUtils::SubSpecMode pMode)
+{
+  static_assert(sizeof(RDH) == sizeof(RdhSubSpecMask));
+
+  // the mask is the difference of RDHs with the used fields cleared and set (bitfields wrap around)
+  RDH lClear;
+  if (pMode == ReadoutDataUtils::eFeeId) {
+    lClear.feeId = 0;
+  } else {
+    lClear.cruID = 0;
+    lClear.linkID = 0;
+    lClear.endPointID = 0;
   }
 
-  if (lMemRet > pMsg->GetSize()) {
-    EDDLOG("BLOCK CHECK: StopBit lookup failed: advanced beyond end of the buffer.");
-    lStopRet = false;
+  RDH lSet = lClear;
+  if (pMode == ReadoutDataUtils::eFeeId) {
+    lSet.feeId -= 1;
+  } else {
+    lSet.cruID -= 1;
+    lSet.linkID -= 1;
+    lSet.endPointID -= 1;
   }
 
-  return {lMemRet, lStopRet};
+  RdhSubSpecMask lMask;
+  RdhSubSpecMask lSetWords;
+  std::memcpy(lMask.data(), &lClear, sizeof(RDH));
+  std::memcpy(lSetWords.data(), &lSet, sizeof(RDH));
+  for (std::size_t w = 0; w < lMask.size(); w++) {
+    lMask[w] ^= lSetWords[w];
+  }
+  return lMask;
 }
 
-bool ReadoutDataUtils::rdhSanityCheck(const char* pData, const std::size_t pLen)
+// compare masked RDHs to the first RDH of the block
+using RdhSubSpecCmpFn = bool (*)(const char *pFirst, const char* const* pRdhs, const std::size_t pCnt,
+  const RdhSubSpecMask &pMask);
+
+bool rdhSameSubSpecWords(const char *pFirst, const char* const* pRdhs, const std::size_t pCnt,
+  const RdhSubSpecMask &pMask)
 {
-  const auto R = RDHReader(pData, pLen);
+  RdhSubSpecMask lFirst;
+  std::memcpy(lFirst.data(), pFirst, sizeof(RdhSubSpecMask));
+
+  for (std::size_t i = 0; i < pCnt; i++) {
+    RdhSubSpecMask lRdh;
+    std::memcpy(lRdh.data(), pRdhs[i], sizeof(RdhSubSpecMask));
 
-  if (pLen < R.getRDHSize()) { // size of one RDH
-    EDDLOG("Data block is shorter than RDH: {}", pLen);
-    o2::header::hexDump("Short readout block", pData, pLen);
-    return false;
+    std::uint64_t lDiff = 0;
+    for (std::size_t w = 0; w < lRdh.size(); w++) {
+      lDiff |= (lRdh[w] ^ lFirst[w]) & pMask[w];
+    }
+    if (lDiff) {
+      return false;
+    }
   }
+  return true;
+}
 
-  // set first hbframe orbit if not set for this stf
-  {
-    std::uint32_t lOrbit = R.getOrbit();
-    if (sFirstSeenHBOrbitCnt == 0) {
-      sFirstSeenHBOrbitCnt = lOrbit;
-    } else {
-      if (lOrbit < sFirstSeenHBOrbitCnt) {
-        EDDLOG("Orbit counter of the current data packet (HBF) is smaller than first orbit of the STF."
-          " orbit={} first_orbit={} diff={}", lOrbit, sFirstSeenHBOrbitCnt, (sFirstSeenHBOrbitCnt - lOrbit));
-        return false;
-      }
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+bool rdhSameSubSpecAvx2(const char *pFirst, const char* const* pRdhs, const std::size_t pCnt,
+  const RdhSubSpecMask &pMask)
+{
+  const __m256i lMask0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pMask.data()));
+  const __m256i lMask1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pMask.data() + 4));
+  const __m256i lFirst0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pFirst));
+  const __m256i lFirst1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pFirst + 32));
+
+  for (std::size_t i = 0; i < pCnt; i++) {
+    const __m256i lRdh0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pRdhs[i]));
+    const __m256i lRdh1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pRdhs[i] + 32));
+
+    const __m256i lDiff = _mm256_or_si256(
+      _mm256_and_si256(_mm256_xor_si256(lRdh0, lFirst0), lMask0),
+      _mm256_and_si256(_mm256_xor_si256(lRdh1, lFirst1), lMask1)
+    );
+    if (!_mm256_testz_si256(lDiff, lDiff)) {
+      return false;
     }
   }
+  return true;
+}
+#endif
 
-  // sub spec of first RDH
-  const auto lSubSpec = getSubSpecification(R);
+// mask for the configured SubSpecification mode
+template <typename RDH>
+const RdhSubSpecMask& rdhConfiguredSubSpecMask()
+{
+  static const std::array<RdhSubSpecMask, 2> sMasks = {
+    rdhSubSpecMask<RDH>(ReadoutDataUtils::eCruLinkId),
+    rdhSubSpecMask<RDH>(ReadoutDataUtils::eFeeId)
+  };
+  return sMasks[ReadoutDataUtils::sRawDataSubspectype == ReadoutDataUtils::eFeeId ? 1 : 0];
+}
+
+// Walk the RDH chain checking the memory layout. SubSpecifications are compared in batches of RDHs.
+// Same criteria as rdhSanityCheckScalar(), without reporting.
+template <typename RDH>
+bool rdhChainCheck(const char* pData, const std::size_t pLen, const RdhSubSpecCmpFn pCmp)
+{
+  const auto &lMask = rdhConfiguredSubSpecMask<RDH>();
+
+  static constexpr std::size_t cBatch = 32;
+  std::array<const char*, cBatch> lRdhs;
+  std::size_t lCnt = 0;
 
   std::int64_t lDataLen = pLen;
   const char* lCurrData = pData;
-  std::uint32_t lPacketCnt = 1;
-
-  while(lDataLen > 0) {
-    const auto Rc = RDHReader(lCurrData, lDataLen);
 
-    if (lDataLen > 0 && lDataLen < 64/*RDH*/ ) {
-      EDDLOG("BLOCK CHECK: Data is shorter than RDH. Block offset: {}", (lCurrData - pData));
-      o2::header::hexDump("Data at the end of the block", lCurrData, lDataLen);
+  while (lDataLen > 0) {
+    if (lDataLen < std::int64_t(sizeof(RDH))) {
       return false;
     }
 
-    // check if sub spec matches
-    if (lSubSpec != getSubSpecification(Rc)) {
-      EDDLOG("BLOCK CHECK: Data sub-specification of trailing RDHs does not match."
-        " RDH[0]::SubSpec: {:#06x}, RDH[{}]::SubSpec: {:#06x}",
-        lSubSpec, lPacketCnt, getSubSpecification(Rc));
-      return false;
+    lRdhs[lCnt++] = lCurrData;
+    if (lCnt == cBatch) {
+      if (!pCmp(pData, lRdhs.data(), lCnt, lMask)) {
+        return false;
+      }
+      lCnt = 0;
     }
 
-    const auto lMemSize = Rc.getMemorySize();
-    const auto lOffsetNext = Rc.getOffsetToNext();
-    const auto lStopBit = Rc.getStopBit();
+    const RDH &lRdh = *reinterpret_cast<const RDH*>(lCurrData);
+    const std::int64_t lMemSize = lRdh.memorySize;
+    const std::int64_t lOffsetNext = lRdh.offsetToNext;
 
-    // check if last package
-    if (lStopBit) {
-      if (lMemSize <= lDataLen) {
-        return true; // all memory is accounted for
-      } else {
-        EDDLOG("BLOCK CHECK: RDH has bit stop set, but memory size is different from remaining block size."
-          " memory_size={} remaining_buffer_size={}", lMemSize, lDataLen);
+    if (lRdh.stop) {
+      if (lMemSize > lDataLen) {
         return false;
       }
+      break;
     }
 
-    if (lOffsetNext == 0) {
-      EDDLOG("BLOCK CHECK: Next block offset is 0.");
+    if ((lOffsetNext == 0) || (lOffsetNext >= lDataLen) || (lMemSize >= lDataLen)) {
       return false;
     }
 
-    if (lOffsetNext >= lDataLen) {
-      EDDLOG("BLOCK CHECK: Next offset points beyond end of data block (stop bit is not set).");
-      return false;
-    }
+    lDataLen -= lOffsetNext;
+    lCurrData += lOffsetNext;
+  }
 
-    if (lMemSize >= lDataLen) {
-      EDDLOG("BLOCK CHECK: Memory size is larger than remaining data block size for packet {}", lPacketCnt);
-      return false;
+  return pCmp(pData, lRdhs.data(), lCnt, lMask);
+}
+
+} /* namespace */
+
+bool ReadoutDataUtils::rdhSanityCheckSimd(const char* pData, const std::size_t pLen)
+{
+#if defined(__x86_64__)
+  static const RdhSubSpecCmpFn sCmp = __builtin_cpu_supports("avx2") ? rdhSameSubSpecAvx2 : rdhSameSubSpecWords;
+#else
+  static const RdhSubSpecCmpFn sCmp = rdhSameSubSpecWords;
+#endif
+
+  switch (sRdhVersion) {
+    case eRdhVer3:
+    case eRdhVer4:
+      return rdhChainCheck<o2::header::RAWDataHeaderV4>(pData, pLen, sCmp);
+    case eRdhVer5:
+      return rdhChainCheck<o2::header::RAWDataHeaderV5>(pData, pLen, sCmp);
+    case eRdhVer6:
+      return rdhChainCheck<o2::header::RAWDataHeaderV6>(pData, pLen, sCmp);
+    default:
+      return rdhSanityCheckScalar(pData, pLen);
+  }
+}
+
+namespace {
+
+void countFilteredBlocks(std::uint64_t &pCounter, const std::uint64_t pNum, const char *pBlockSize)
+{
+  static constexpr std::uint64_t cReportInterval = 250000;
+
+  if (pNum == 0) {
+    return;
+  }
+
+  const auto lPrev = pCounter;
+  pCounter += pNum;
+  if ((lPrev / cReportInterval) != ((lPrev + pNum) / cReportInterval)) {
+    IDDLOG("Filtered {} of {} blocks in trigger mode.", (lPrev + pNum), pBlockSize);
+  }
+}
+
+enum EmptyTriggerBlock {
+  eNotEmpty = 0,
+  eEmpty64,
+  eEmpty128,
+  eEmpty16k
+};
+
+// Same criteria as the RDHReader based filterEmptyTriggerBlocks(), with direct RDH access
+template <typename RDH>
+EmptyTriggerBlock classifyEmptyTriggerBlock(const char* pData, const std::size_t pLen)
+{
+  if (!pData || (pLen != 64 && pLen != 128 && pLen != 16384)) {
+    return eNotEmpty;
+  }
+
+  const RDH &R1 = *reinterpret_cast<const RDH*>(pData);
+  if (R1.stop) {
+    // check the 64B case
+    return (pLen == sizeof(RDH) && R1.memorySize == sizeof(RDH)) ? eEmpty64 : eNotEmpty;
+  }
+
+  const std::size_t lOffsetNext1 = R1.offsetToNext;
+  if (lOffsetNext1 < sizeof(RDH) || (lOffsetNext1 + sizeof(RDH)) > pLen) {
+    EDDLOG_RL(1000, "BLOCK CHECK: Invalid offset. offset={} block_size={}", lOffsetNext1, pLen);
+    return eNotEmpty;
+  }
+
+  const RDH &R2 = *reinterpret_cast<const RDH*>(pData + lOffsetNext1);
+
+  if ((R1.memorySize != R2.memorySize) || (R1.memorySize != sizeof(RDH)) || (R2.stop != 1)) {
+    return eNotEmpty;
+  }
+
+  // check the subspecification
+  const auto &lMask = rdhConfiguredSubSpecMask<RDH>();
+  const char *lRdh2 = pData + lOffsetNext1;
+  if (!rdhSameSubSpecWords(pData, &lRdh2, 1, lMask)) {
+    return eNotEmpty;
+  }
+
+  return (pLen == 128) ? eEmpty128 : eEmpty16k;
+}
+
+template <typename RDH>
+std::size_t filterEmptyTriggerBlocksImpl(ReadoutDataContext &pCtx, std::vector<FairMQMessagePtr>::iterator pBegin,
+  const std::size_t pLen, HBFrameBitmap &pRemove)
+{
+  std::array<std::uint64_t, 4> lCounts = { };
+
+  for (std::size_t i = 0; i < pLen; i++) {
+    if (pRemove.test(i)) {
+      continue; // already discarded
     }
 
-    lDataLen -= lOffsetNext;
-    lCurrData += lOffsetNext;
-    lPacketCnt += 1;
+    const auto lClass = classifyEmptyTriggerBlock<RDH>(
+      reinterpret_cast<const char*>(pBegin[i]->GetData()), pBegin[i]->GetSize());
+    if (lClass != eNotEmpty) {
+      pRemove.set(i);
+    }
+    lCounts[lClass] += 1;
   }
 
-  return true;
+  countFilteredBlocks(pCtx.mNumFiltered64Blocks, lCounts[eEmpty64], "64 B");
+  countFilteredBlocks(pCtx.mNumFiltered128Blocks, lCounts[eEmpty128], "128 B");
+  countFilteredBlocks(pCtx.mNumFiltered16kBlocks, lCounts[eEmpty16k], "16 kiB");
+
+  return lCounts[eEmpty64] + lCounts[eEmpty128] + lCounts[eEmpty16k];
 }
 
-bool ReadoutDataUtils::filterEmptyTriggerBlocks(const char* pData, const std::size_t pLen)
+} /* namespace */
+
+std::size_t ReadoutDataUtils::filterEmptyTriggerBlocks(ReadoutDataContext &pCtx,
+  std::vector<FairMQMessagePtr>::iterator pBegin, const std::size_t pLen, HBFrameBitmap &pRemove)
 {
-  static std::size_t sNumFiltered64Blocks = 0;
-  static std::size_t sNumFiltered128Blocks = 0;
-  static std::size_t sNumFiltered16kBlocks = 0;
+  switch (sRdhVersion) {
+    case eRdhVer3:
+    case eRdhVer4:
+      return filterEmptyTriggerBlocksImpl<o2::header::RAWDataHeaderV4>(pCtx, pBegin, pLen, pRemove);
+    case eRdhVer5:
+      return filterEmptyTriggerBlocksImpl<o2::header::RAWDataHeaderV5>(pCtx, pBegin, pLen, pRemove);
+    case eRdhVer6:
+      return filterEmptyTriggerBlocksImpl<o2::header::RAWDataHeaderV6>(pCtx, pBegin, pLen, pRemove);
+    default:
+      break;
+  }
+
+  std::size_t lNumFiltered = 0;
+  for (std::size_t i = 0; i < pLen; i++) {
+    if (!pRemove.test(i) &&
+      filterEmptyTriggerBlocks(pCtx, reinterpret_cast<const char*>(pBegin[i]->GetData()), pBegin[i]->GetSize())) {
+      pRemove.set(i);
+      lNumFiltered++;
+    }
+  }
+  return lNumFiltered;
+}
 
+bool ReadoutDataUtils::filterEmptyTriggerBlocks(ReadoutDataContext &pCtx, const char* pData, const std::size_t pLen)
+{
   std::uint32_t lMemSize1, lOffsetNext1, lStopBit1;
   std::uint32_t lMemSize2, lStopBit2;
 
@@ -200,10 +442,7 @@ bool ReadoutDataUtils::filterEmptyTriggerBlocks(const char* pData, const std::si
       lMemSize1 = R1.getMemorySize();
       // check the 64B case
       if (lStopBit1 && pLen == R1.getRDHSize() && lMemSize1 == R1.getRDHSize()) {
-        sNumFiltered64Blocks++;
-        if (sNumFiltered128Blocks % 250000 == 0) {
-          IDDLOG("Filtered {} of 64 B blocks in trigger mode.", sNumFiltered128Blocks);
-        }
+        countFilteredBlocks(pCtx.mNumFiltered64Blocks, 1, "64 B");
         return true;
       } else if (lStopBit1) {
         return false;
@@ -240,15 +479,9 @@ bool ReadoutDataUtils::filterEmptyTriggerBlocks(const char* pData, const std::si
       }
 
       if (pLen == 128) {
-        sNumFiltered128Blocks++;
-        if (sNumFiltered128Blocks % 250000 == 0) {
-          IDDLOG("Filtered {} of 128 B blocks in trigger mode.", sNumFiltered128Blocks);
-        }
+        countFilteredBlocks(pCtx.mNumFiltered128Blocks, 1, "128 B");
       } else if (pLen == 16384) {
-        sNumFiltered16kBlocks++;
-        if (sNumFiltered16kBlocks % 250000 == 0) {
-          IDDLOG("Filtered {} of 16 kiB blocks in trigger mode.", sNumFiltered16kBlocks);
-        }
+        countFilteredBlocks(pCtx.mNumFiltered16kBlocks, 1, "16 kiB");
       }
     } catch (RDHReaderException &e) {
       EDDLOG(e.what());
@@ -279,6 +512,21 @@ std::istream& operator>>(std::istream& in, ReadoutDataUtils::SanityCheckMode& pR
   return in;
 }
 
+std::istream& operator>>(std::istream& in, ReadoutDataUtils::SanityCheckImpl& pRetVal)
+{
+  std::string token;
+  in >> token;
+
+  if (token == "scalar") {
+    pRetVal = ReadoutDataUtils::eSanityCheckScalar;
+  } else if (token == "simd") {
+    pRetVal = ReadoutDataUtils::eSanityCheckSimd;
+  } else {
+    in.setstate(std::ios_base::failbit);
+  }
+  return in;
+}
+
 std::istream& operator>>(std::istream& in, ReadoutDataUtils::SubSpecMode& pRetVal)
 {
   std::string token;
@@ -334,5 +582,18 @@ std::string to_string(ReadoutDataUtils::SubSpecMode pSubSpec)
   }
 }
 
+std::string to_string(ReadoutDataUtils::SanityCheckImpl pImpl)
+{
+  switch (pImpl)
+  {
+    case ReadoutDataUtils::eSanityCheckScalar:
+      return "scalar";
+    case ReadoutDataUtils::eSanityCheckSimd:
+      return "simd";
+    default:
+      return "invalid";
+  }
+}
+
 }
 } /* o2::DataDistribution */
@@ -26,6 +26,7 @@
 #include <cstdint>
 #include <tuple>
 #include <variant>
+#include <vector>
 
 namespace o2
 {
@@ -331,6 +332,100 @@ public:
   std::uint32_t getTriggerType() const { return I().getTriggerType(mData); };
 };
 
+////////////////////////////////////////////////////////////////////////////////
+/// RDHReaderT: RDH reader for a version known at compile time
+/// Same interface as RDHReader, with non-virtual accessors. Use ReadoutDataUtils::withRdhReader() to
+/// select the reader type of the configured RDH version once, outside of per-HBFrame loops.
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename RDH>
+class RDHReaderT {
+  // final class: calls are resolved at compile time
+  inline static const RDHReaderImpl<RDH> sImpl;
+
+  const char *mData = nullptr;
+  std::size_t mSize = 0;
+
+  static FairMQMessage& checkedMsg(const FairMQMessagePtr &msg) {
+    if (!msg) {
+      throw std::runtime_error("RDHReader::msg is null");
+    }
+    return *msg;
+  }
+
+  struct Unchecked { };
+  RDHReaderT(const char* data, const std::size_t size, Unchecked)
+  : mData(data),
+    mSize(size) {}
+
+public:
+  RDHReaderT() = default;
+
+  RDHReaderT(const char* data, const std::size_t size)
+  : mData(data),
+    mSize(size)
+  {
+    sImpl.CheckRdhData(mData, mSize);
+  }
+
+  explicit RDHReaderT(const FairMQMessagePtr &msg)
+  : RDHReaderT(reinterpret_cast<const char*>(checkedMsg(msg).GetData()), msg->GetSize()) { }
+
+  inline
+  RDHReaderT next() const {
+    if (getStopBit()) {
+      return RDHReaderT();
+    }
+
+    const auto lOffNext = getOffsetToNext();
+    if (lOffNext < 64 || lOffNext > 8192) {
+      return RDHReaderT(); // error
+    }
+
+    const char *p = mData + lOffNext;
+
+    if (((mData + mSize) - sizeof(RDH)) < p) {
+      return RDHReaderT(); // the rest of original buffer is too short
+    }
+
+    return RDHReaderT(p, mData + mSize - p, Unchecked());
+  }
+
+  inline
+  RDHReaderT end() const { return RDHReaderT(); }
+
+  inline
+  bool operator==(const RDHReaderT& b) const { return (mData == b.mData && mSize == b.mSize); }
+
+  inline
+  bool operator!=(const RDHReaderT &b) const { return !(*this == b); }
+
+  static constexpr std::size_t getRDHSize() { return sizeof(RDH); }
+
+  // RDH equipment
+  inline std::uint8_t getSystemID() const { return sImpl.getSystemID(mData); }
+  inline std::uint64_t getFeeID() const { return sImpl.getFeeID(mData); }
+  inline std::uint16_t getLinkID() const { return sImpl.getLinkID(mData); }
+  inline std::uint8_t getEndPointID() const { return sImpl.getEndPointID(mData); }
+  inline std::uint16_t getCruID() const { return sImpl.getCruID(mData); }
+
+  // RDH memory layout
+  inline std::uint32_t getMemorySize() const { return sImpl.getMemorySize(mData); }
+  inline std::uint32_t getOffsetToNext() const { return sImpl.getOffsetToNext(mData); }
+  inline bool getStopBit() const { return sImpl.getStopBit(mData); }
+
+  // RDH trigger information
+  inline std::uint32_t getOrbit() const { return sImpl.getOrbit(mData); }
+  inline std::uint16_t getBC() const { return sImpl.getBC(mData); }
+  inline std::uint32_t getTriggerType() const { return sImpl.getTriggerType(mData); }
+};
+
+// reader type selection for ReadoutDataUtils::withRdhReader()
+template <typename ReaderT>
+struct RdhReaderTag {
+  using Reader = ReaderT;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /// ReadoutSubTimeframeHeader
 ////////////////////////////////////////////////////////////////////////////////
@@ -357,6 +452,39 @@ struct ReadoutSubTimeframeHeader {
   } mFlags;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+/// HBFrameBitmap: one bit per HBFrame of a readout multipart
+////////////////////////////////////////////////////////////////////////////////
+
+class HBFrameBitmap {
+  std::vector<std::uint64_t> mWords;
+  std::size_t mSize = 0;
+
+public:
+  // clear and resize to pSize bits
+  void reset(const std::size_t pSize) {
+    mSize = pSize;
+    mWords.assign((pSize + 63) / 64, 0);
+  }
+
+  std::size_t size() const { return mSize; }
+
+  bool test(const std::size_t pIdx) const { return mWords[pIdx / 64] & (std::uint64_t(1) << (pIdx % 64)); }
+  void set(const std::size_t pIdx) { mWords[pIdx / 64] |= (std::uint64_t(1) << (pIdx % 64)); }
+  void unset(const std::size_t pIdx) { mWords[pIdx / 64] &= ~(std::uint64_t(1) << (pIdx % 64)); }
+
+  // number of set bits
+  std::size_t count() const {
+    std::size_t lCnt = 0;
+    for (const auto lWord : mWords) {
+      lCnt += __builtin_popcountll(lWord);
+    }
+    return lCnt;
+  }
+};
+
+struct ReadoutDataContext;
+
 class ReadoutDataUtils {
 public:
   enum SubSpecMode {
@@ -370,7 +498,11 @@ public:
     eSanityCheckDrop,
     eSanityCheckPrint
   };
-  static SanityCheckMode sRdhSanityCheckMode;
+
+  enum SanityCheckImpl {
+    eSanityCheckScalar = 0, // RDHReader walk
+    eSanityCheckSimd        // per-version checker, AVX2 if supported by the cpu. Scalar check on failure, for reporting
+  };
 
   enum RdhVersion {
     eRdhInvalid = -1,
@@ -383,24 +515,138 @@ public:
   static o2::header::DataOrigin sSpecifiedDataOrigin; // to be initialized if not RDH6
   static RdhVersion sRdhVersion;
 
-  static bool sEmptyTriggerHBFrameFilterring;
+  // Call pFunc(RdhReaderTag<ReaderT>) with the reader type of the configured RDH version.
+  // The generic RDHReader is used if the version is not configured.
+  template <typename F>
+  static decltype(auto) withRdhReader(F &&pFunc) {
+    switch (sRdhVersion) {
+      case eRdhVer3:
+      case eRdhVer4:
+        return pFunc(RdhReaderTag<RDHReaderT<o2::header::RAWDataHeaderV4>>());
+      case eRdhVer5:
+        return pFunc(RdhReaderTag<RDHReaderT<o2::header::RAWDataHeaderV5>>());
+      case eRdhVer6:
+        return pFunc(RdhReaderTag<RDHReaderT<o2::header::RAWDataHeaderV6>>());
+      default:
+        return pFunc(RdhReaderTag<RDHReader>());
+    }
+  }
+
+  // readers: RDHReader or RDHReaderT
+  template <typename ReaderT>
+  static o2::header::DataOrigin getDataOrigin(const ReaderT &R)
+  {
+    if (sRdhVersion == eRdhVer6) {
+      const auto lOrig =  o2::header::DAQID::DAQtoO2(R.getSystemID());
+      if (lOrig != o2::header::DAQID::DAQtoO2(o2::header::DAQID::INVALID)) {
+        return lOrig;
+      } else {
+          EDDLOG_RL(1000, "Data origin in RDH is invalid: {}. Please configure the correct SYSTEM_ID in the hardware."
+            " Using the configuration value {}.", R.getSystemID(), std::string(sSpecifiedDataOrigin.str));
+      }
+    }
+
+    return sSpecifiedDataOrigin;
+  }
+
+  template <typename ReaderT>
+  static o2::header::DataHeader::SubSpecificationType getSubSpecification(const ReaderT &R)
+  {
+    static_assert( sizeof(o2::header::DataHeader::SubSpecificationType) == 4);
+    o2::header::DataHeader::SubSpecificationType lSubSpec = ~0;
+
+    if (sRawDataSubspectype == eCruLinkId) {
+      /* add 1 to linkID because they start with 0 */
+      lSubSpec = (R.getCruID() << 16) | ((R.getLinkID() + 1) << (R.getEndPointID() == 0 ? 0 : 8));
+    } else if (sRawDataSubspectype == eFeeId) {
+      lSubSpec = R.getFeeID();
+    } else {
+      EDDLOG("Invalid SubSpecification method={}", sRawDataSubspectype);
+    }
+
+    return lSubSpec;
+  }
+
+  template <typename ReaderT = RDHReader>
+  static std::tuple<std::size_t, bool> getHBFrameMemorySize(const FairMQMessagePtr &pMsg)
+  {
+    if (!pMsg) {
+      throw std::runtime_error("RDHReader::msg is null");
+    }
+    return getHBFrameMemorySize<ReaderT>(reinterpret_cast<const char*>(pMsg->GetData()), pMsg->GetSize());
+  }
+
+  template <typename ReaderT = RDHReader>
+  static std::tuple<std::size_t, bool> getHBFrameMemorySize(const char *pData, const std::size_t pSize)
+  {
+    std::size_t lMemRet = 0;
+    bool lStopRet = false;
+
+    try {
+      auto R = ReaderT(pData, pSize);
+      while (R != R.end()) {
+        lMemRet += R.getMemorySize();
+        lStopRet = R.getStopBit();
+
+        R = R.next();
+      }
+    } catch (RDHReaderException &e) {
+      EDDLOG( e.what());
+    }
+
+    if (lMemRet > pSize) {
+      EDDLOG("BLOCK CHECK: StopBit lookup failed: advanced beyond end of the buffer.");
+      lStopRet = false;
+    }
+
+    return {lMemRet, lStopRet};
+  }
+
+  static bool rdhSanityCheck(ReadoutDataContext &pCtx, const char* data, const std::size_t len);
+  // check of the RDH chain of one block (without the first orbit check) using a selected implementation
+  static bool rdhSanityCheckScalar(const char* data, const std::size_t len);
+  static bool rdhSanityCheckSimd(const char* data, const std::size_t len);
+  static bool filterEmptyTriggerBlocks(ReadoutDataContext &pCtx, const char* pData, const std::size_t pLen);
+  // classify all HBFrames of a multipart, setting the bit of empty trigger blocks. Returns the number of new bits set.
+  static std::size_t filterEmptyTriggerBlocks(ReadoutDataContext &pCtx,
+    std::vector<FairMQMessagePtr>::iterator pBegin, const std::size_t pLen, HBFrameBitmap &pRemove);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// ReadoutDataContext: RDH checking and filtering configuration and state of one STF builder
+////////////////////////////////////////////////////////////////////////////////
+
+struct ReadoutDataContext {
+  // configuration
+  ReadoutDataUtils::SanityCheckMode mRdhSanityCheckMode = ReadoutDataUtils::eNoSanityCheck;
+  ReadoutDataUtils::SanityCheckImpl mRdhSanityCheckImpl = ReadoutDataUtils::eSanityCheckSimd;
+  bool mEmptyTriggerHBFrameFilterring = false;
+  // coalescing of contiguous HBFrames into one payload (0: disabled)
+  std::size_t mHbfCoalesceMaxSize = 0;
+  std::size_t mHbfCoalesceRegionSize = 0;
 
-  static std::uint32_t sFirstSeenHBOrbitCnt;
+  // state of the STF in building
+  std::uint32_t mFirstSeenHBOrbitCnt = 0;
 
-  static o2::header::DataOrigin getDataOrigin(const RDHReader &R);
-  static o2::header::DataHeader::SubSpecificationType getSubSpecification(const RDHReader &R);
+  // filtered empty trigger blocks, per block size
+  std::uint64_t mNumFiltered64Blocks = 0;
+  std::uint64_t mNumFiltered128Blocks = 0;
+  std::uint64_t mNumFiltered16kBlocks = 0;
 
-  static std::tuple<std::size_t, bool> getHBFrameMemorySize(const FairMQMessagePtr &pMsg);
+  // coalesced HBFrames and the payloads they were merged into
+  std::uint64_t mNumCoalescedHbfs = 0;
+  std::uint64_t mNumCoalescedPayloads = 0;
 
-  static bool rdhSanityCheck(const char* data, const std::size_t len);
-  static bool filterEmptyTriggerBlocks(const char* pData, const std::size_t pLen);
+  void newStf() { mFirstSeenHBOrbitCnt = 0; }
 };
 
 std::istream& operator>>(std::istream& in, ReadoutDataUtils::SanityCheckMode& pRetVal);
+std::istream& operator>>(std::istream& in, ReadoutDataUtils::SanityCheckImpl& pRetVal);
 std::istream& operator>>(std::istream& in, ReadoutDataUtils::SubSpecMode& pRetVal);
 std::istream& operator>>(std::istream& in, ReadoutDataUtils::RdhVersion& pRetVal);
 
 std::string to_string (ReadoutDataUtils::SubSpecMode c);
+std::string to_string (ReadoutDataUtils::SanityCheckImpl c);
 
 }
 } /* o2::DataDistribution */
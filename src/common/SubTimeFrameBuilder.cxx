@@ -12,6 +12,7 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "SubTimeFrameBuilder.h"
+#include "SubTimeFrameDPL.h"
 #include "ReadoutDataModel.h"
 #include "MemoryUtils.h"
 #include "DataDistLogger.h"
@@ -23,6 +24,10 @@
 #include <fairmq/FairMQDevice.h>
 #include <fairmq/FairMQUnmanagedRegion.h>
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
 namespace o2::DataDistribution
 {
 
@@ -32,28 +37,74 @@ using namespace o2::header;
 /// SubTimeFrameReadoutBuilder
 ////////////////////////////////////////////////////////////////////////////////
 
-SubTimeFrameReadoutBuilder::SubTimeFrameReadoutBuilder(MemoryResources &pMemRes, bool pDplEnabled)
-  : mStf(nullptr), mDplEnabled(pDplEnabled),mMemRes(pMemRes)
+SubTimeFrameReadoutBuilder::SubTimeFrameReadoutBuilder(MemoryResources &pMemRes, bool pDplEnabled,
+  const ReadoutDataContext &pReadoutCfg, const bool pCreateRegion, const bool pConcurrentAlloc)
+  : mStf(nullptr), mReadoutCtx(pReadoutCfg), mDplEnabled(pDplEnabled), mConcurrentAlloc(pConcurrentAlloc),
+    mMemRes(pMemRes)
 {
+  if (!pCreateRegion) {
+    assert (mMemRes.mHeaderMemRes);
+    return;
+  }
+
   mMemRes.mHeaderMemRes = std::make_unique<RegionAllocatorResource<alignof(o2::header::DataHeader)>>(
     "O2HeadersRegion",
     *mMemRes.mShmTransport,
     std::size_t(512) << 20, /* good for 5s 3CRU @ 50Gbps, TODO: make configurable */
     mDplEnabled ?
       sizeof(DataHeader) + sizeof(o2::framework::DataProcessingHeader) :
-      sizeof(DataHeader)
+      sizeof(DataHeader),
+    mMemRes.mAllocStrategy,
+    mMemRes.mNumaNode,
+    mMemRes.mPrefaultThreads
   );
 
+  // NOTE: no header slot pool here, HBFrame headers are allocated in blocks (see addHbFrames)
+
+  // data region for coalesced HBFrames, shared by all builders
+  if (mReadoutCtx.mHbfCoalesceMaxSize > 0 && !mMemRes.mDataMemRes) {
+    mMemRes.createDataRegions("O2HbfCoalesceRegion", mReadoutCtx.mHbfCoalesceRegionSize, 0);
+  }
+
   mMemRes.start();
 }
 
+FairMQMessagePtr SubTimeFrameReadoutBuilder::coalesceHbFrames(std::vector<FairMQMessagePtr>::iterator pHbFramesBegin,
+  const std::size_t pLen, const std::size_t pSize)
+{
+  if (!mMemRes.mDataMemRes) {
+    return nullptr;
+  }
+
+  // do not block the input when the region is full, the HBFrames are kept as they are
+  auto lMsg = mConcurrentAlloc ? mMemRes.dataRegion().TryNewFairMQMessageMT(pSize) :
+    mMemRes.tryNewDataMessage(pSize);
+  if (!lMsg) {
+    WDDLOG_RL(10000, "HBFrame coalescing: data region is full, not coalescing. size={}", pSize);
+    return nullptr;
+  }
+
+  // the run is contiguous, copy it at once and return the readout pages
+  std::memcpy(lMsg->GetData(), pHbFramesBegin[0]->GetData(), pSize);
+  for (std::size_t i = 0; i < pLen; i++) {
+    pHbFramesBegin[i].reset();
+  }
+
+  mReadoutCtx.mNumCoalescedHbfs += pLen;
+  mReadoutCtx.mNumCoalescedPayloads += 1;
+  DDDLOG_RL(10000, "HBFrame coalescing: hbframes={} payloads={}",
+    mReadoutCtx.mNumCoalescedHbfs, mReadoutCtx.mNumCoalescedPayloads);
+
+  return lMsg;
+}
+
 void SubTimeFrameReadoutBuilder::addHbFrames(
   const o2::header::DataOrigin &pDataOrig,
   const o2::header::DataHeader::SubSpecificationType pSubSpecification,
   const ReadoutSubTimeframeHeader& pHdr,
   std::vector<FairMQMessagePtr>::iterator pHbFramesBegin, const std::size_t pHBFrameLen)
 {
-  static thread_local std::vector<bool> lRemoveBlocks;
+  static thread_local HBFrameBitmap lRemoveBlocks;
 
   if (!mRunning) {
     WDDLOG("Adding HBFrames while STFBuilder is not running!");
@@ -61,7 +112,7 @@ void SubTimeFrameReadoutBuilder::addHbFrames(
   }
 
   if (!mStf) {
-    mStf = std::make_unique<SubTimeFrame>(pHdr.mTimeFrameId);
+    mStf = SubTimeFramePool::get(pHdr.mTimeFrameId);
     mFirstFiltered.clear();
   }
 
@@ -81,59 +132,47 @@ void SubTimeFrameReadoutBuilder::addHbFrames(
   mStf->updateRunNumber(pHdr.mRunNumber);
 
   // filter empty trigger
-  lRemoveBlocks.clear();
-  lRemoveBlocks.resize(pHBFrameLen);
+  lRemoveBlocks.reset(pHBFrameLen);
   {
-    if (ReadoutDataUtils::sEmptyTriggerHBFrameFilterring) {
-      // filter empty trigger start stop pages
-      for (std::size_t i = 0; i < pHBFrameLen; i++) {
-        if (lRemoveBlocks[i]) {
-          continue; // already discarded
-        }
-
-        if (i == 0) {
-          // NOTE: this can be implemented by checking trigger flags in the RDH for the TF bit
-          //       Perhaps switch to that method later, when the RHD is more stable
-          //       Fow now, we simply keep the first HBFrame of each equipment in the STF
-          const auto R = RDHReader(pHbFramesBegin[0]);
-          const auto lSubSpec = ReadoutDataUtils::getSubSpecification(R);
-          if (!mFirstFiltered[lSubSpec]) {
-            mFirstFiltered[lSubSpec] = true;
-            continue; // we keep the first HBFrame for each subspec (equipment)
-          }
-        }
-
-        if (!ReadoutDataUtils::filterEmptyTriggerBlocks(
-              reinterpret_cast<const char*>(pHbFramesBegin[i]->GetData()),
-              pHbFramesBegin[i]->GetSize()) ) {
-          lRemoveBlocks[i] = false;
-        } else {
-          lRemoveBlocks[i] = true;
-        }
+    if (mReadoutCtx.mEmptyTriggerHBFrameFilterring && (pHBFrameLen > 0)) {
+      // NOTE: this can be implemented by checking trigger flags in the RDH for the TF bit
+      //       Perhaps switch to that method later, when the RHD is more stable
+      //       Fow now, we simply keep the first HBFrame of each equipment in the STF
+      const auto R = RDHReader(pHbFramesBegin[0]);
+      const auto lSubSpec = ReadoutDataUtils::getSubSpecification(R);
+      const bool lKeepFirst = !mFirstFiltered[lSubSpec];
+      mFirstFiltered[lSubSpec] = true;
+
+      if (lKeepFirst) {
+        lRemoveBlocks.set(0); // we keep the first HBFrame for each subspec (equipment)
+        ReadoutDataUtils::filterEmptyTriggerBlocks(mReadoutCtx, pHbFramesBegin, pHBFrameLen, lRemoveBlocks);
+        lRemoveBlocks.unset(0);
+      } else {
+        ReadoutDataUtils::filterEmptyTriggerBlocks(mReadoutCtx, pHbFramesBegin, pHBFrameLen, lRemoveBlocks);
       }
     }
   }
 
   // sanity check
   {
-    if (ReadoutDataUtils::sRdhSanityCheckMode != ReadoutDataUtils::eNoSanityCheck) {
+    if (mReadoutCtx.mRdhSanityCheckMode != ReadoutDataUtils::eNoSanityCheck) {
       // check blocks individually
       for (std::size_t i = 0; i < pHBFrameLen; i++) {
 
-        if (lRemoveBlocks[i]) {
+        if (lRemoveBlocks.test(i)) {
           continue; // already filtered out
         }
 
-        const auto lOk = ReadoutDataUtils::rdhSanityCheck(
+        const auto lOk = ReadoutDataUtils::rdhSanityCheck(mReadoutCtx,
           reinterpret_cast<const char*>(pHbFramesBegin[i]->GetData()),
           pHbFramesBegin[i]->GetSize());
 
-        if (!lOk && (ReadoutDataUtils::sRdhSanityCheckMode == ReadoutDataUtils::eSanityCheckDrop)) {
+        if (!lOk && (mReadoutCtx.mRdhSanityCheckMode == ReadoutDataUtils::eSanityCheckDrop)) {
           WDDLOG("RDH SANITY CHECK: Removing data block");
 
-          lRemoveBlocks[i] = true;
+          lRemoveBlocks.set(i);
 
-        } else if (!lOk && (ReadoutDataUtils::sRdhSanityCheckMode == ReadoutDataUtils::eSanityCheckPrint)) {
+        } else if (!lOk && (mReadoutCtx.mRdhSanityCheckMode == ReadoutDataUtils::eSanityCheckPrint)) {
 
           IDDLOG("Printing data blocks of update with TF ID={} Lik ID={}",
             pHdr.mTimeFrameId, unsigned(pHdr.mLinkId));
@@ -183,36 +222,94 @@ void SubTimeFrameReadoutBuilder::addHbFrames(
   );
   lDataHdr.payloadSerializationMethod = gSerializationMethodNone;
 
-  for (size_t i = 0; i < pHBFrameLen; i++) {
+  const std::size_t lNumHbFrames = pHBFrameLen - lRemoveBlocks.count();
+  if (lNumHbFrames == 0) {
+    return;
+  }
 
-    if (lRemoveBlocks[i]) {
-      continue; // already filtered out
+  // O2 payloads of the update: [begin, end) HBFrame ranges, more than one HBFrame if coalesced
+  struct HbfPayload {
+    std::size_t mBegin;
+    std::size_t mEnd;
+    FairMQMessagePtr mCoalesced;
+  };
+  static thread_local std::vector<HbfPayload> lPayloads;
+  lPayloads.clear();
+
+  std::size_t lRunBegin = 0;
+  std::size_t lRunEnd = 0;
+  std::size_t lRunSize = 0;
+
+  const auto lCloseRun = [&]() {
+    if (lRunEnd - lRunBegin > 1) {
+      auto lMsg = coalesceHbFrames(pHbFramesBegin + lRunBegin, lRunEnd - lRunBegin, lRunSize);
+      if (lMsg) {
+        lPayloads.push_back(HbfPayload{ lRunBegin, lRunEnd, std::move(lMsg) });
+        return;
+      }
+    }
+    for (std::size_t i = lRunBegin; i < lRunEnd; i++) {
+      lPayloads.push_back(HbfPayload{ i, i + 1, nullptr });
     }
+  };
 
-    std::unique_ptr<FairMQMessage> lHdrMsg;
+  for (std::size_t i = 0; i < pHBFrameLen; i++) {
 
-    lDataHdr.payloadSize = pHbFramesBegin[i]->GetSize();
+    if (lRemoveBlocks.test(i)) {
+      continue; // already filtered out
+    }
 
-    if (mDplEnabled) {
-      auto lStack = Stack(
-        lDataHdr,
-        o2::framework::DataProcessingHeader{mStf->header().mId}
-      );
+    const std::size_t lSize = pHbFramesBegin[i]->GetSize();
 
-      lHdrMsg = mMemRes.newHeaderMessage(reinterpret_cast<char*>(lStack.data()), lStack.size());
-    } else {
-      lHdrMsg = mMemRes.newHeaderMessage(reinterpret_cast<char*>(&lDataHdr), sizeof(lDataHdr));
-    }
+    // extend the run with the next HBFrame if it directly follows in the same superpage
+    const bool lExtendRun = (mReadoutCtx.mHbfCoalesceMaxSize > 0) && (lRunEnd == i) && (i > 0) &&
+      (lRunSize + lSize <= mReadoutCtx.mHbfCoalesceMaxSize) &&
+      (reinterpret_cast<const char*>(pHbFramesBegin[i-1]->GetData()) + pHbFramesBegin[i-1]->GetSize() ==
+        reinterpret_cast<const char*>(pHbFramesBegin[i]->GetData()));
 
-    if (!lHdrMsg) {
-      EDDLOG("Allocation error: HbFrame::DataHeader={}", sizeof(DataHeader));
-      throw std::bad_alloc();
+    if (lExtendRun) {
+      lRunEnd = i + 1;
+      lRunSize += lSize;
+      continue;
     }
 
+    lCloseRun();
+    lRunBegin = i;
+    lRunEnd = i + 1;
+    lRunSize = lSize;
+  }
+  lCloseRun();
+
+  // prepare the header template, the payload size is updated in place for each payload
+  // NOTE: the DataProcessingHeader is only added at the DPL output (StfToDplAdapter::materializeDplHeaders)
+  const auto lHdrStack = Stack(lDataHdr);
+  const std::size_t lHdrSize = lHdrStack.size();
+
+  // allocate headers of all payloads in one block
+  std::size_t lHdrStride = 0;
+  char *lHdrSlot = mMemRes.newHeaderSlots(lHdrSize, lPayloads.size(), lHdrStride, mConcurrentAlloc);
+  if (!lHdrSlot) {
+    EDDLOG("Allocation error: HbFrame::DataHeader={} count={}", lHdrSize, lPayloads.size());
+    lPayloads.clear();
+    throw std::bad_alloc();
+  }
+
+  for (auto &lPayload : lPayloads) {
+
+    auto lDataMsg = lPayload.mCoalesced ? std::move(lPayload.mCoalesced) : std::move(pHbFramesBegin[lPayload.mBegin]);
+    lDataHdr.payloadSize = lDataMsg->GetSize();
+
+    std::memcpy(lHdrSlot, lHdrStack.data(), lHdrSize);
+    reinterpret_cast<DataHeader*>(lHdrSlot)->payloadSize = lDataHdr.payloadSize;
+
+    auto lHdrMsg = mMemRes.newHeaderMessageFromSlot(lHdrSlot, lHdrSize);
+    lHdrSlot += lHdrStride;
+
     mStf->addStfData(lDataHdr,
-      SubTimeFrame::StfData{ std::move(lHdrMsg), std::move(pHbFramesBegin[i]) }
+      SubTimeFrame::StfData{ std::move(lHdrMsg), std::move(lDataMsg) }
     );
   }
+  lPayloads.clear();
 }
 
 
@@ -221,23 +318,27 @@ void SubTimeFrameReadoutBuilder::addHbFrames(
 ////////////////////////////////////////////////////////////////////////////////
 
 SubTimeFrameFileBuilder::SubTimeFrameFileBuilder(MemoryResources &pMemRes,
-  const std::size_t pDataSegSize, const std::size_t pHdrSegSize, bool pDplEnabled)
-  : mMemRes(pMemRes), mDplEnabled(pDplEnabled)
+  const std::size_t pDataSegSize, const std::size_t pHdrSegSize)
+  : mMemRes(pMemRes)
 {
   mMemRes.mHeaderMemRes = std::make_unique<RegionAllocatorResource<alignof(o2::header::DataHeader)>>(
     "O2HeadersRegion_FileSource",
     *mMemRes.mShmTransport,
     pHdrSegSize,
-    0
+    0,
+    mMemRes.mAllocStrategy,
+    mMemRes.mNumaNode,
+    mMemRes.mPrefaultThreads
   );
 
-  mMemRes.mDataMemRes = std::make_unique<RegionAllocatorResource<>>(
+  mMemRes.createDataRegions(
     "O2DataRegion_FileSource",
-    *mMemRes.mShmTransport,
     pDataSegSize,
     0 // TODO: GPU flags
   );
 
+  mMemRes.initHeaderSlotPool(sizeof(DataHeader) + sizeof(o2::framework::DataProcessingHeader));
+
   mMemRes.start();
 }
 
@@ -247,50 +348,27 @@ void SubTimeFrameFileBuilder::adaptHeaders(SubTimeFrame *pStf)
     return;
   }
 
-  for (auto& lDataIdentMapIter : pStf->mData) {
-    for (auto& lSubSpecMapIter : lDataIdentMapIter.second) {
-      for (auto& lStfDataIter : lSubSpecMapIter.second) {
+  pStf->mData.for_each([&](const EquipmentIdentifier &, auto lStfDataRange) {
+    for (auto& lStfDataIter : lStfDataRange) {
 
-        // make sure there is a DataProcessing header in the stack
-        const auto &lHeader = lStfDataIter.mHeader;
+      // update the DataProcessingHeader if the stack has one
+      const auto &lHeader = lStfDataIter.mHeader;
 
-        if (!lHeader || lHeader->GetSize() < sizeof(DataHeader)) {
-          EDDLOG("File data invalid. Missing DataHeader.");
-          return;
-        }
-
-        auto lDplHdrConst = o2::header::get<o2::framework::DataProcessingHeader*>(lHeader->GetData(), lHeader->GetSize());
-
-        if (lDplHdrConst != nullptr) {
-          if (lDplHdrConst->startTime != pStf->header().mId) {
-
-            auto lDplHdr = const_cast<o2::framework::DataProcessingHeader*>(lDplHdrConst);
-            lDplHdr->startTime = pStf->header().mId;
-          }
-        } else {
-          // make the stack with an DPL header
-          // get the DataHeader
-          auto lDHdr = o2::header::get<o2::header::DataHeader*>(lHeader->GetData(), lHeader->GetSize());
-          if (lDHdr == nullptr) {
-            EDDLOG("File data invalid. DataHeader not found in the header stack.");
-            return;
-          }
+      if (!lHeader || lHeader->GetSize() < sizeof(DataHeader)) {
+        EDDLOG("File data invalid. Missing DataHeader.");
+        return false;
+      }
 
-          if (mDplEnabled) {
-            auto lStack = Stack(
-              *lDHdr, /* TODO: add complete existing header lStfDataIter.mHeader */
-              o2::framework::DataProcessingHeader{pStf->header().mId}
-            );
+      auto lDplHdrConst = o2::header::get<o2::framework::DataProcessingHeader*>(lHeader->GetData(), lHeader->GetSize());
 
-            lStfDataIter.mHeader = mMemRes.newHeaderMessage(reinterpret_cast<char*>(lStack.data()), lStack.size());
-            if (!lStfDataIter.mHeader) {
-              return;
-            }
-          }
-        }
+      // stacks without the DataProcessingHeader are completed at the DPL output
+      if (lDplHdrConst != nullptr && lDplHdrConst->startTime != pStf->header().mId) {
+        auto lDplHdr = const_cast<o2::framework::DataProcessingHeader*>(lDplHdrConst);
+        lDplHdr->startTime = pStf->header().mId;
       }
     }
-  }
+    return true;
+  });
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -308,117 +386,126 @@ void TimeFrameBuilder::allocate_memory(const std::size_t pDataSegSize, const std
     "O2HeadersRegion",
     *mMemRes.mShmTransport,
     pHdrSegSize,
-    0 /* dont need registration flags for headers */
+    0, /* dont need registration flags for headers */
+    mMemRes.mAllocStrategy,
+    mMemRes.mNumaNode,
+    mMemRes.mPrefaultThreads
   );
 
-  mMemRes.mDataMemRes = std::make_unique<RegionAllocatorResource<>>(
+  mMemRes.createDataRegions(
     "O2DataRegion_TimeFrame",
-    *mMemRes.mShmTransport,
     pDataSegSize,
     0 // TODO: GPU flags
   );
 
+  mMemRes.initHeaderSlotPool(sizeof(DataHeader) + sizeof(o2::framework::DataProcessingHeader));
+
   mMemRes.start();
 }
 
-void TimeFrameBuilder::adaptHeaders(SubTimeFrame *pStf)
+bool TimeFrameBuilder::placeDataInRegion(FairMQMessagePtr &pData)
+{
+  if (!pData || !mMemRes.mDataMemRes || pData->GetType() == fair::mq::Transport::SHM) {
+    return true;
+  }
+
+  auto lNewDataMsg = newDataMessage(pData->GetSize());
+  if (!lNewDataMsg) {
+    return false;
+  }
+  std::memcpy(lNewDataMsg->GetData(), pData->GetData(), pData->GetSize());
+  pData.swap(lNewDataMsg);
+  return true;
+}
+
+bool TimeFrameBuilder::adaptHeaders(SubTimeFrame *pStf)
 {
   if (!pStf || !mMemRes.mHeaderMemRes || !mMemRes.mDataMemRes) {
-    return;
+    return true;
   }
 
-  const auto lOutChannelType = fair::mq::Transport::SHM;
+  const auto lTfId = pStf->header().mId;
+  const auto lRunNumber = pStf->header().mRunNumber;
+  const auto lFirstOrbit = pStf->header().mFirstOrbit;
 
-  // adapt headers for DPL
-  for (auto& lDataIdentMapIter : pStf->mData) {
-    for (auto& lSubSpecMapIter : lDataIdentMapIter.second) {
-      for (auto& lStfDataIter : lSubSpecMapIter.second) {
+  // One pass over all headers (DPL output is a shmem channel):
+  //  - headers in the region with a DataProcessingHeader are patched in place
+  //  - headers without the DataProcessingHeader get a new DPL stack in the region, allocated in one block after
+  //    the pass (see StfToDplAdapter::materializeDplHeaders)
+  //  - other headers and payloads are copied to the region only if they are not already there
+  bool lOk = true;
+  pStf->mData.for_each([&](const EquipmentIdentifier &, auto lStfDataRange) {
+    for (auto& lStfDataIter : lStfDataRange) {
 
-        // make sure there is a DataProcessing header in the stack
-        const auto &lHeader = lStfDataIter.mHeader;
+      auto &lHeader = lStfDataIter.mHeader;
 
-        if (!lHeader || lHeader->GetSize() < sizeof(DataHeader)) {
-          EDDLOG("Adapting TF headers: Missing DataHeader.");
-          continue;
+      if (!lHeader || lHeader->GetSize() < sizeof(DataHeader)) {
+        EDDLOG("Adapting TF headers: Missing DataHeader.");
+        continue;
+      }
+
+      auto lDplHdrConst = o2::header::get<o2::framework::DataProcessingHeader*>(
+        lHeader->GetData(),
+        lHeader->GetSize()
+      );
+
+      if (lDplHdrConst != nullptr) {
+        if (lHeader->GetType() != fair::mq::Transport::SHM) {
+          auto lNewHdr = newHeaderMessage(reinterpret_cast<char*>(lHeader->GetData()), lHeader->GetSize());
+          if (!lNewHdr) {
+            lOk = false;
+            return false;
+          }
+          lHeader.swap(lNewHdr);
+          lDplHdrConst = o2::header::get<o2::framework::DataProcessingHeader*>(lHeader->GetData(), lHeader->GetSize());
         }
 
-        auto lDplHdrConst = o2::header::get<o2::framework::DataProcessingHeader*>(
+        // patch the received stack in place
+        auto lDplHdr = const_cast<o2::framework::DataProcessingHeader*>(lDplHdrConst);
+        lDplHdr->startTime = lTfId;
+
+        // DataHeader must be first in the stack
+        DataHeader *lDataHdr = reinterpret_cast<DataHeader*>(lHeader->GetData());
+        lDataHdr->tfCounter = lTfId;
+        lDataHdr->runNumber = lRunNumber;
+        if (lFirstOrbit != std::numeric_limits<std::uint32_t>::max()) {
+          lDataHdr->firstTForbit = lFirstOrbit;
+        }
+      } else {
+        // the DPL stack is made after the pass
+        auto lDHdr = o2::header::get<o2::header::DataHeader*>(
           lHeader->GetData(),
           lHeader->GetSize()
         );
 
-        if (lDplHdrConst != nullptr) {
-          if (lDplHdrConst->startTime != pStf->header().mId) {
-
-            auto lDplHdr = const_cast<o2::framework::DataProcessingHeader*>(lDplHdrConst);
-            lDplHdr->startTime = pStf->header().mId;
-          }
-        } else {
-          // make the stack with an DPL header
-          // get the DataHeader
-          auto lDHdr = o2::header::get<o2::header::DataHeader*>(
-            lHeader->GetData(),
-            lHeader->GetSize()
-          );
-
-          if (lDHdr == nullptr) {
-            EDDLOG("TimeFrame invalid. DataHeader not found in the header stack.");
-            continue;
-          }
-
-          if (mDplEnabled) {
-            auto lStack = Stack(
-              reinterpret_cast<o2::byte*>(lHeader->GetData()),
-              o2::framework::DataProcessingHeader{pStf->header().mId}
-            );
+        if (lDHdr == nullptr) {
+          EDDLOG("TimeFrame invalid. DataHeader not found in the header stack.");
+          continue;
+        }
 
-            lStfDataIter.mHeader = newHeaderMessage(reinterpret_cast<char*>(lStack.data()), lStack.size());
-            if (!lStfDataIter.mHeader) {
-              return;
-            }
+        if (!mDplEnabled && lHeader->GetType() != fair::mq::Transport::SHM) {
+          auto lNewHdr = newHeaderMessage(reinterpret_cast<char*>(lHeader->GetData()), lHeader->GetSize());
+          if (!lNewHdr) {
+            lOk = false;
+            return false;
           }
+          lHeader.swap(lNewHdr);
         }
       }
-    }
-  }
 
-  // make sure the data is in shmem messages if we are sending data to shmem channel
-  if (lOutChannelType == fair::mq::Transport::SHM) {
-
-    // adapt the payload for shmem if needed
-    for (auto& lDataIdentMapIter : pStf->mData) {
-      for (auto& lSubSpecMapIter : lDataIdentMapIter.second) {
-        for (auto& lStfDataIter : lSubSpecMapIter.second) {
-
-          // header
-          {
-            const auto &lHeaderMsg = lStfDataIter.mHeader;
-            if (lHeaderMsg->GetType() != fair::mq::Transport::SHM) {
-              auto lNewHdr = newHeaderMessage(reinterpret_cast<char*>(lHeaderMsg->GetData()), lHeaderMsg->GetSize());
-              if (!lNewHdr) {
-                return;
-              }
-              lStfDataIter.mHeader.swap(lNewHdr);
-            }
-          }
-
-          // data
-          {
-            const auto &lDataMsg = lStfDataIter.mData;
-            if (lDataMsg->GetType() != fair::mq::Transport::SHM) {
-              auto lNewDataMsg = newDataMessage(lDataMsg->GetSize());
-              if (lNewDataMsg) {
-                std::memcpy(lNewDataMsg->GetData(), lDataMsg->GetData(), lDataMsg->GetSize());
-              } else {
-                return;
-              }
-              lStfDataIter.mData.swap(lNewDataMsg);
-            }
-          }
-        }
+      // normally placed in the region on receive
+      if (!placeDataInRegion(lStfDataIter.mData)) {
+        lOk = false;
+        return false;
       }
     }
+    return true;
+  });
+
+  if (lOk && mDplEnabled) {
+    lOk = StfToDplAdapter::materializeDplHeaders(*pStf, mMemRes, true);
   }
+  return lOk;
 }
 
 } /* o2::DataDistribution */
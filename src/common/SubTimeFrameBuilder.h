@@ -39,7 +39,11 @@ class SubTimeFrameReadoutBuilder
 {
  public:
   SubTimeFrameReadoutBuilder() = delete;
-  SubTimeFrameReadoutBuilder(MemoryResources &pMemRes, bool pDplEnabled);
+  // pReadoutCfg: RDH checking and filtering configuration, each builder keeps its own state
+  // pCreateRegion: create the header region (only one builder creates it when several share the resources)
+  // pConcurrentAlloc: the header region is used by multiple builders concurrently
+  SubTimeFrameReadoutBuilder(MemoryResources &pMemRes, bool pDplEnabled, const ReadoutDataContext &pReadoutCfg,
+    const bool pCreateRegion = true, const bool pConcurrentAlloc = false);
 
   void addHbFrames(const o2::header::DataOrigin &pDataOrig,
     const o2::header::DataHeader::SubSpecificationType pSubSpecification,
@@ -51,6 +55,7 @@ class SubTimeFrameReadoutBuilder
   }
 
   std::optional<std::unique_ptr<SubTimeFrame>> getStf() {
+    mReadoutCtx.newStf();
     mFirstFiltered.clear();
     std::unique_ptr<SubTimeFrame> lStf = std::move(mStf);
     mStf = nullptr;
@@ -65,6 +70,10 @@ class SubTimeFrameReadoutBuilder
   }
 
  private:
+  // copy a run of HBFrames, contiguous in the readout superpage, into one data message
+  FairMQMessagePtr coalesceHbFrames(std::vector<FairMQMessagePtr>::iterator pHbFramesBegin, const std::size_t pLen,
+    const std::size_t pSize);
+
   bool mRunning = true;
 
   std::unique_ptr<SubTimeFrame> mStf;
@@ -72,7 +81,11 @@ class SubTimeFrameReadoutBuilder
   // filtering: keep info if the first HBFrame is already kept back
   std::unordered_map<o2::header::DataHeader::SubSpecificationType, bool> mFirstFiltered;
 
+  // RDH checking and filtering
+  ReadoutDataContext mReadoutCtx;
+
   bool mDplEnabled;
+  bool mConcurrentAlloc;
 
   MemoryResources &mMemRes;
 };
@@ -87,33 +100,14 @@ class SubTimeFrameFileBuilder
  public:
   SubTimeFrameFileBuilder() = delete;
   SubTimeFrameFileBuilder(MemoryResources &pMemRes, const std::size_t pDataSegSize,
-    const std::size_t pHdrSegSize, bool pDplEnabled);
+    const std::size_t pHdrSegSize);
 
   void adaptHeaders(SubTimeFrame *pStf);
 
-  // allocate appropriate message for the header
+  // allocate the message for the header. The DataProcessingHeader is added at the DPL output
   inline
-  FairMQMessagePtr newHeaderMessage(const o2::header::Stack &pIncomingStack, const std::uint64_t pTfId) {
-    std::unique_ptr<FairMQMessage> lMsg;
-
-    if (mDplEnabled) {
-      auto lStack = o2::header::Stack(
-        pIncomingStack,
-        o2::framework::DataProcessingHeader{pTfId}
-      );
-
-      lMsg = mMemRes.newHeaderMessage(reinterpret_cast<char*>(lStack.data()), lStack.size());
-      if (!lMsg) {
-        return nullptr;
-      }
-    } else {
-      lMsg = mMemRes.newHeaderMessage(reinterpret_cast<char*>(pIncomingStack.data()), pIncomingStack.size());
-      if (!lMsg) {
-        return nullptr;
-      }
-    }
-
-    return lMsg;
+  FairMQMessagePtr newHeaderMessage(const o2::header::Stack &pIncomingStack) {
+    return mMemRes.newHeaderMessage(reinterpret_cast<char*>(pIncomingStack.data()), pIncomingStack.size());
   }
 
   // allocate appropriate message for the data blocks
@@ -128,8 +122,6 @@ class SubTimeFrameFileBuilder
 
  private:
   MemoryResources &mMemRes;
-
-  bool mDplEnabled;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -145,7 +137,12 @@ class TimeFrameBuilder
   // make allocate the memory here
   void allocate_memory(const std::size_t pDataSegSize, const std::size_t pHdrSegSize);
 
-  void adaptHeaders(SubTimeFrame *pStf);
+  // Returns false if the headers or data could not be placed in the region (the TF must be dropped)
+  bool adaptHeaders(SubTimeFrame *pStf);
+
+  // place the received payload in the TimeFrame data region (no-op if already there)
+  // Returns false if the region allocation failed
+  bool placeDataInRegion(FairMQMessagePtr &pData);
 
   inline
   FairMQMessagePtr newHeaderMessage(const char *pData, const std::size_t pSize) {
@@ -157,6 +154,17 @@ class TimeFrameBuilder
     return mMemRes.newDataMessage(pSize);
   }
 
+  // allocate pCount headers in one block. See MemoryResources::newHeaderSlots()
+  inline
+  char* newHeaderSlots(const std::size_t pHdrSize, const std::size_t pCount, std::size_t &pStride /*[out]*/) {
+    return mMemRes.newHeaderSlots(pHdrSize, pCount, pStride, true);
+  }
+
+  inline
+  FairMQMessagePtr newHeaderMessageFromSlot(char *pSlot, const std::size_t pHdrSize) {
+    return mMemRes.newHeaderMessageFromSlot(pSlot, pHdrSize);
+  }
+
   inline void stop() {
     mMemRes.stop();
   }
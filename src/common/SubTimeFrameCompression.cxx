@@ -0,0 +1,224 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "SubTimeFrameCompression.h"
+#include "SubTimeFrameBuilder.h"
+
+#include <DataDistLogger.h>
+
+#include <fairmq/FairMQChannel.h>
+
+#if defined(DATADIST_WITH_LZ4)
+#include <lz4.h>
+#endif
+
+#include <cstring>
+#include <limits>
+
+namespace o2::DataDistribution
+{
+
+using namespace o2::header;
+
+bool StfPayloadCompressor::available()
+{
+#if defined(DATADIST_WITH_LZ4)
+  return true;
+#else
+  return false;
+#endif
+}
+
+StfPayloadCompressor::StfPayloadCompressor(const std::vector<DataOrigin> &pOrigins, const unsigned pNumThreads)
+  : mOrigins(pOrigins)
+{
+  // the calling thread takes part in every job
+  for (unsigned i = 1; i < std::max(pNumThreads, 1u); i++) {
+    mWorkers.push_back(create_thread_member("stf_compress", &StfPayloadCompressor::WorkerThread, this));
+  }
+}
+
+StfPayloadCompressor::~StfPayloadCompressor()
+{
+  {
+    std::scoped_lock lLock(mPoolLock);
+    mRunning = false;
+  }
+  mPoolCond.notify_all();
+
+  for (auto &lWorker : mWorkers) {
+    if (lWorker.joinable()) {
+      lWorker.join();
+    }
+  }
+}
+
+void StfPayloadCompressor::WorkerThread()
+{
+  std::uint64_t lLastGen = 0;
+
+  while (true) {
+    const std::function<void(const std::size_t)> *lJob = nullptr;
+    std::size_t lJobCount = 0;
+    {
+      std::unique_lock lLock(mPoolLock);
+      mPoolCond.wait(lLock, [&]() { return !mRunning || (mJob && mJobGen != lLastGen); });
+      if (!mRunning) {
+        return;
+      }
+      lLastGen = mJobGen;
+      lJob = mJob;
+      lJobCount = mJobCount;
+      mWorkersBusy++;
+    }
+
+    for (std::size_t lIdx = mJobNext++; lIdx < lJobCount; lIdx = mJobNext++) {
+      (*lJob)(lIdx);
+    }
+
+    {
+      std::scoped_lock lLock(mPoolLock);
+      mWorkersBusy--;
+    }
+    mDoneCond.notify_one();
+  }
+}
+
+void StfPayloadCompressor::parallel_for(const std::size_t pCount, const std::function<void(const std::size_t)> &pFn)
+{
+  std::scoped_lock lJobLock(mJobLock);
+
+  if (mWorkers.empty() || pCount <= 1) {
+    for (std::size_t lIdx = 0; lIdx < pCount; lIdx++) {
+      pFn(lIdx);
+    }
+    return;
+  }
+
+  {
+    std::scoped_lock lLock(mPoolLock);
+    mJobNext = 0;
+    mJob = &pFn;
+    mJobCount = pCount;
+    mJobGen++;
+  }
+  mPoolCond.notify_all();
+
+  for (std::size_t lIdx = mJobNext++; lIdx < pCount; lIdx = mJobNext++) {
+    pFn(lIdx);
+  }
+
+  // wait for the workers to finish their last item
+  std::unique_lock lLock(mPoolLock);
+  mJob = nullptr;
+  mDoneCond.wait(lLock, [&]() { return mWorkersBusy == 0; });
+}
+
+void StfPayloadCompressor::compress(std::vector<FairMQMessagePtr> &pHdrs, std::vector<FairMQMessagePtr> &pData,
+  FairMQChannel &pChan)
+{
+#if defined(DATADIST_WITH_LZ4)
+  assert (pHdrs.size() == pData.size());
+
+  parallel_for(pData.size(), [&](const std::size_t pIdx) {
+    DataHeader *lDataHdr = reinterpret_cast<DataHeader*>(pHdrs[pIdx]->GetData());
+    auto &lData = pData[pIdx];
+
+    if (!compressOrigin(lDataHdr->dataOrigin) || lDataHdr->payloadSerializationMethod != gSerializationMethodNone) {
+      return;
+    }
+
+    const std::size_t lSize = lData->GetSize();
+    if (lSize < 1024 || lSize > LZ4_MAX_INPUT_SIZE) {
+      return;
+    }
+
+    const std::size_t lMaxSize = sizeof(std::uint64_t) + LZ4_compressBound(int(lSize));
+    auto lCompMsg = pChan.NewMessage(lMaxSize);
+    if (!lCompMsg) {
+      return;
+    }
+
+    char *lCompData = reinterpret_cast<char*>(lCompMsg->GetData());
+    const int lCompSize = LZ4_compress_default(reinterpret_cast<const char*>(lData->GetData()),
+      lCompData + sizeof(std::uint64_t), int(lSize), int(lMaxSize - sizeof(std::uint64_t)));
+
+    mUncompressedSize += lSize;
+
+    // send as is if there is no gain
+    if (lCompSize <= 0 || (sizeof(std::uint64_t) + lCompSize) >= (lSize - lSize / 8)) {
+      mCompressedSize += lSize;
+      return;
+    }
+
+    const std::uint64_t lUncompressedSize = lSize;
+    std::memcpy(lCompData, &lUncompressedSize, sizeof(std::uint64_t));
+    lCompMsg->SetUsedSize(sizeof(std::uint64_t) + lCompSize);
+    mCompressedSize += sizeof(std::uint64_t) + lCompSize;
+
+    lDataHdr->payloadSerializationMethod = gSerializationMethodLZ4;
+    lData = std::move(lCompMsg);
+  });
+#else
+  (void) pHdrs; (void) pData; (void) pChan;
+#endif
+}
+
+void StfPayloadCompressor::decompress(FairMQMessage &pHdr, FairMQMessagePtr &pData, TimeFrameBuilder &pTfBld)
+{
+  DataHeader *lDataHdr = reinterpret_cast<DataHeader*>(pHdr.GetData());
+  if (lDataHdr->payloadSerializationMethod != gSerializationMethodLZ4) {
+    return;
+  }
+
+#if defined(DATADIST_WITH_LZ4)
+  std::uint64_t lUncompressedSize = 0;
+  if (pData->GetSize() < sizeof(std::uint64_t)) {
+    EDDLOG_RL(1000, "StfPayloadCompressor: compressed payload is too small. size={}", pData->GetSize());
+    throw std::runtime_error("StfPayloadCompressor::Compressed payload too small");
+  }
+  std::memcpy(&lUncompressedSize, pData->GetData(), sizeof(std::uint64_t));
+
+  // the DataHeader keeps the uncompressed size
+  if (lUncompressedSize != lDataHdr->payloadSize || lUncompressedSize > LZ4_MAX_INPUT_SIZE) {
+    EDDLOG_RL(1000, "StfPayloadCompressor: invalid uncompressed size. size={} payload_size={}",
+      lUncompressedSize, lDataHdr->payloadSize);
+    throw std::runtime_error("StfPayloadCompressor::Invalid uncompressed size");
+  }
+
+  auto lDataMsg = pTfBld.newDataMessage(lUncompressedSize);
+  if (!lDataMsg) {
+    EDDLOG_RL(1000, "StfPayloadCompressor: allocation of the uncompressed payload failed. size={}",
+      lUncompressedSize);
+    throw std::bad_alloc();
+  }
+
+  const int lSize = LZ4_decompress_safe(reinterpret_cast<const char*>(pData->GetData()) + sizeof(std::uint64_t),
+    reinterpret_cast<char*>(lDataMsg->GetData()), int(pData->GetSize() - sizeof(std::uint64_t)),
+    int(lUncompressedSize));
+
+  if (lSize < 0 || std::uint64_t(lSize) != lDataHdr->payloadSize) {
+    EDDLOG_RL(1000, "StfPayloadCompressor: decompression failed. ret={} payload_size={}", lSize, lDataHdr->payloadSize);
+    throw std::runtime_error("StfPayloadCompressor::Decompression failed");
+  }
+
+  lDataHdr->payloadSerializationMethod = gSerializationMethodNone;
+  pData = std::move(lDataMsg);
+#else
+  (void) pData; (void) pTfBld;
+  EDDLOG_RL(1000, "StfPayloadCompressor: received a compressed payload, but built without LZ4 support.");
+  throw std::runtime_error("StfPayloadCompressor::LZ4 not supported");
+#endif
+}
+
+} /* o2::DataDistribution */
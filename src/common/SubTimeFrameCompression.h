@@ -0,0 +1,96 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef ALICEO2_SUBTIMEFRAME_COMPRESSION_H_
+#define ALICEO2_SUBTIMEFRAME_COMPRESSION_H_
+
+#include "SubTimeFrameDataModel.h"
+
+#include <Headers/DataHeader.h>
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+
+class FairMQChannel;
+
+namespace o2::DataDistribution
+{
+
+class TimeFrameBuilder;
+
+////////////////////////////////////////////////////////////////////////////////
+/// StfPayloadCompressor
+////////////////////////////////////////////////////////////////////////////////
+
+/// LZ4 compression of STF payloads for the StfSender -> TfBuilder transport
+///
+/// Compressed payloads are marked in the DataHeader::payloadSerializationMethod, the payloadSize
+/// stays the uncompressed size. The compressed message is prefixed with the uncompressed size.
+/// Payloads that do not compress are sent as they are.
+class StfPayloadCompressor
+{
+ public:
+  static constexpr o2::header::SerializationMethod gSerializationMethodLZ4{"DDLZ4"};
+
+  /// false if built without LZ4
+  static bool available();
+
+  StfPayloadCompressor() = delete;
+  StfPayloadCompressor(const std::vector<o2::header::DataOrigin> &pOrigins, const unsigned pNumThreads);
+  ~StfPayloadCompressor();
+
+  /// Compress payloads of the configured data origins. pHdrs[i] is the header of pData[i]
+  void compress(std::vector<FairMQMessagePtr> &pHdrs, std::vector<FairMQMessagePtr> &pData, FairMQChannel &pChan);
+
+  /// Decompress the payload if it was compressed. The header is restored to the uncompressed state
+  static void decompress(FairMQMessage &pHdr, FairMQMessagePtr &pData, TimeFrameBuilder &pTfBld);
+
+  std::uint64_t uncompressedSize() const { return mUncompressedSize; }
+  std::uint64_t compressedSize() const { return mCompressedSize; }
+
+ private:
+  bool compressOrigin(const o2::header::DataOrigin &pOrigin) const {
+    return std::find(mOrigins.cbegin(), mOrigins.cend(), pOrigin) != mOrigins.cend();
+  }
+
+  // run pFn(0 .. pCount-1) on the workers and the calling thread
+  void parallel_for(const std::size_t pCount, const std::function<void(const std::size_t)> &pFn);
+  void WorkerThread();
+
+  std::vector<o2::header::DataOrigin> mOrigins;
+
+  // thread pool: one job at the time
+  std::mutex mJobLock;
+  std::mutex mPoolLock;
+  std::condition_variable mPoolCond;
+  std::condition_variable mDoneCond;
+  const std::function<void(const std::size_t)> *mJob = nullptr;
+  std::size_t mJobCount = 0;
+  std::uint64_t mJobGen = 0;
+  std::size_t mWorkersBusy = 0;
+  bool mRunning = true;
+  std::atomic_size_t mJobNext = 0;
+  std::vector<std::thread> mWorkers;
+
+  std::atomic_uint64_t mUncompressedSize = 0;
+  std::atomic_uint64_t mCompressedSize = 0;
+};
+
+} /* o2::DataDistribution */
+
+#endif /* ALICEO2_SUBTIMEFRAME_COMPRESSION_H_ */
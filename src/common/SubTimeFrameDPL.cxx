@@ -13,6 +13,7 @@
 
 #include "SubTimeFrameDPL.h"
 
+#include "MemoryUtils.h"
 #include "DataDistLogger.h"
 
 #include <Framework/DataProcessingHeader.h>
@@ -27,8 +28,73 @@ using namespace o2::header;
 /// StfDplAdapter
 ////////////////////////////////////////////////////////////////////////////////
 
+bool StfToDplAdapter::materializeDplHeaders(SubTimeFrame &pStf, MemoryResources &pMemRes, const bool pConcurrent)
+{
+  using o2::framework::DataProcessingHeader;
+
+  const auto lMissingDplHeader = [](const SubTimeFrame::StfData &pStfData) {
+    return pStfData.mHeader && pStfData.mHeader->GetSize() >= sizeof(DataHeader) &&
+      !o2::header::get<DataProcessingHeader*>(pStfData.mHeader->GetData(), pStfData.mHeader->GetSize());
+  };
+
+  // count the stacks to complete
+  std::size_t lNumMissing = 0;
+  std::size_t lMaxStackSize = 0;
+  pStf.mData.for_each([&](const EquipmentIdentifier &, const auto &pRange) {
+    for (const auto &lStfData : pRange) {
+      if (lMissingDplHeader(lStfData)) {
+        lNumMissing++;
+        lMaxStackSize = std::max(lMaxStackSize, lStfData.mHeader->GetSize());
+      }
+    }
+  });
+
+  if (lNumMissing == 0) {
+    return true;
+  }
+
+  std::size_t lStride = 0;
+  char *lHdrSlot = pMemRes.newHeaderSlots(lMaxStackSize + sizeof(DataProcessingHeader), lNumMissing, lStride,
+    pConcurrent);
+  if (!lHdrSlot) {
+    EDDLOG("Allocation error: DPL header stacks. size={} count={}", lMaxStackSize + sizeof(DataProcessingHeader),
+      lNumMissing);
+    return false;
+  }
+
+  const DataProcessingHeader lDplHeader{pStf.header().mId};
+
+  pStf.mData.for_each([&](const EquipmentIdentifier &, const auto &pRange) {
+    for (auto &lStfData : pRange) {
+      if (!lMissingDplHeader(lStfData)) {
+        continue;
+      }
+
+      // append the DataProcessingHeader to the existing stack
+      const std::size_t lStackSize = lStfData.mHeader->GetSize();
+      std::memcpy(lHdrSlot, lStfData.mHeader->GetData(), lStackSize);
+      std::memcpy(lHdrSlot + lStackSize, &lDplHeader, sizeof(DataProcessingHeader));
+
+      auto lLastHdr = reinterpret_cast<o2::header::BaseHeader*>(lHdrSlot);
+      while (lLastHdr->next() != nullptr) {
+        lLastHdr = const_cast<o2::header::BaseHeader*>(lLastHdr->next());
+      }
+      lLastHdr->flagsNextHeader = 1;
+
+      lStfData.mHeader = pMemRes.newHeaderMessageFromSlot(lHdrSlot, lStackSize + sizeof(DataProcessingHeader));
+      lHdrSlot += lStride;
+    }
+  });
+
+  return true;
+}
+
 void StfToDplAdapter::visit(SubTimeFrame& pStf)
 {
+  if (mHdrMemRes && !materializeDplHeaders(pStf, *mHdrMemRes, true)) {
+    throw std::bad_alloc();
+  }
+
   // Pack the Stf header
   o2::header::DataHeader lStfDistDataHeader(
     gDataDescSubTimeFrame,
@@ -65,13 +131,37 @@ void StfToDplAdapter::visit(SubTimeFrame& pStf)
   }
 
   // Send data in lexicographical order of DataIdentifier + subSpecification
-  // for easier binary comparison
-  std::vector<EquipmentIdentifier> lEquipIds = pStf.getEquipmentIdentifiers();
-  std::sort(std::begin(lEquipIds), std::end(lEquipIds));
+  // for easier binary comparison. The order is only recomputed when the set of equipments changes.
+  std::size_t lNumEquip = 0;
+  std::size_t lNumBlocks = 0;
+  pStf.mData.for_each([&](const EquipmentIdentifier &, const auto &pRange) {
+    lNumEquip++;
+    lNumBlocks += pRange.size();
+  });
+
+  bool lOrderValid = (lNumEquip == mEquipOrder.size());
+  mEquipRanges.clear();
+  for (std::size_t lIdx = 0; lOrderValid && lIdx < mEquipOrder.size(); lIdx++) {
+    mEquipRanges.push_back(pStf.mData.find(mEquipOrder[lIdx]));
+    lOrderValid = !mEquipRanges.back().empty();
+  }
+
+  if (!lOrderValid) {
+    mEquipOrder = pStf.getEquipmentIdentifiers();
+    std::sort(std::begin(mEquipOrder), std::end(mEquipOrder));
+    mEquipOrderUpdates++;
+
+    mEquipRanges.clear();
+    for (const auto &lEquip : mEquipOrder) {
+      mEquipRanges.push_back(pStf.mData.find(lEquip));
+    }
+    DDDLOG_RL(5000, "StfToDplAdapter: equipment order updated. num_equipment={} updates={}",
+      mEquipOrder.size(), mEquipOrderUpdates);
+  }
 
-  for (const auto& lEquip : lEquipIds) {
+  mMessages.reserve(mMessages.size() + 2 * lNumBlocks);
 
-    auto& lHBFrameVector = pStf.mData.at(lEquip).at(lEquip.mSubSpecification);
+  for (const auto& lHBFrameVector : mEquipRanges) {
 
     for (std::size_t i = 0; i < lHBFrameVector.size(); i++) {
 
@@ -86,8 +176,10 @@ void StfToDplAdapter::visit(SubTimeFrame& pStf)
       mMessages.push_back(std::move(lHBFrameVector[i].mHeader));
       mMessages.push_back(std::move(lHBFrameVector[i].mData));
     }
-    lHBFrameVector.clear();
   }
+  mEquipRanges.clear();
+
+  pStf.clear();
 }
 
 void StfToDplAdapter::inspect() const
@@ -218,7 +310,7 @@ void StfToDplAdapter::sendToDpl(std::unique_ptr<SubTimeFrame>&& pStf)
 
   // make sure headers and chunk pointers don't linger
   mMessages.clear();
-  pStf.reset();
+  SubTimeFramePool::put(std::move(pStf));
 }
 
 
@@ -291,7 +383,7 @@ void DplToStfAdapter::visit(SubTimeFrame& pStf)
 std::unique_ptr<SubTimeFrame> DplToStfAdapter::deserialize_impl()
 {
   // NOTE: StfID will be updated from the stf header
-  std::unique_ptr<SubTimeFrame> lStf = std::make_unique<SubTimeFrame>(0);
+  std::unique_ptr<SubTimeFrame> lStf = SubTimeFramePool::get(0);
 
   try {
     lStf->accept(*this);
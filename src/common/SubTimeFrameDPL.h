@@ -22,6 +22,8 @@
 namespace o2::DataDistribution
 {
 
+class MemoryResources;
+
 ////////////////////////////////////////////////////////////////////////////////
 /// StfDplAdapter
 ////////////////////////////////////////////////////////////////////////////////
@@ -30,8 +32,9 @@ class StfToDplAdapter : public ISubTimeFrameVisitor
 {
  public:
   StfToDplAdapter() = delete;
-  StfToDplAdapter(FairMQChannel& pDplBridgeChan)
-    : mChan(pDplBridgeChan)
+  /// pHdrMemRes: header stacks without the DataProcessingHeader are completed at output (see materializeDplHeaders)
+  StfToDplAdapter(FairMQChannel& pDplBridgeChan, MemoryResources *pHdrMemRes = nullptr)
+    : mChan(pDplBridgeChan), mHdrMemRes(pHdrMemRes)
   {
     mMessages.reserve(1024);
     if (getenv("DATADIST_DEBUG_DPL_CHAN")) {
@@ -45,6 +48,11 @@ class StfToDplAdapter : public ISubTimeFrameVisitor
 
   inline void stop() { mRunning = false; }
 
+  /// Add the DataProcessingHeader to all header stacks without one. The new stacks are allocated in one block
+  /// of the header region. Headers are carried without the DPL header through the pipeline, and completed here
+  /// only once, before the DPL output. Returns false if the allocation failed.
+  static bool materializeDplHeaders(SubTimeFrame &pStf, MemoryResources &pMemRes, const bool pConcurrent);
+
  protected:
   void visit(SubTimeFrame& pStf) override;
 
@@ -56,6 +64,12 @@ class StfToDplAdapter : public ISubTimeFrameVisitor
 
   std::vector<FairMQMessagePtr> mMessages;
   FairMQChannel& mChan;
+  MemoryResources *mHdrMemRes;
+
+  // sorted equipment order of the last TF, reused while the set of equipments does not change
+  std::vector<EquipmentIdentifier> mEquipOrder;
+  std::vector<SubTimeFrame::StfDataIndex::Range> mEquipRanges;
+  std::uint64_t mEquipOrderUpdates = 0;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
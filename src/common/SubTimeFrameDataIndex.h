@@ -0,0 +1,562 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef ALICEO2_SUBTIMEFRAME_DATAINDEX_H_
+#define ALICEO2_SUBTIMEFRAME_DATAINDEX_H_
+
+#include <Headers/DataHeader.h>
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <numeric>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+namespace o2::DataDistribution
+{
+
+namespace impl
+{
+
+////////////////////////////////////////////////////////////////////////////////
+/// Data blocks of one equipment (contiguous in memory for both index layouts)
+////////////////////////////////////////////////////////////////////////////////
+template <class StfDataT>
+class StfDataRange
+{
+ public:
+  StfDataRange() = default;
+  StfDataRange(StfDataT *pBegin, StfDataT *pEnd) : mBegin(pBegin), mEnd(pEnd) { }
+
+  StfDataT* begin() const { return mBegin; }
+  StfDataT* end() const { return mEnd; }
+  std::size_t size() const { return std::size_t(mEnd - mBegin); }
+  bool empty() const { return mBegin == mEnd; }
+
+  StfDataT& operator[](const std::size_t pIdx) const { return mBegin[pIdx]; }
+  StfDataT& front() const { return *mBegin; }
+  StfDataT& back() const { return *(mEnd - 1); }
+
+ private:
+  StfDataT *mBegin = nullptr;
+  StfDataT *mEnd = nullptr;
+};
+
+// visitor functions can return false to stop the iteration
+template <class F, class... Args>
+static inline bool invoke_visitor(F &&f, Args&&... args)
+{
+  if constexpr (std::is_same_v<std::invoke_result_t<F, Args...>, bool>) {
+    return f(std::forward<Args>(args)...);
+  } else {
+    f(std::forward<Args>(args)...);
+    return true;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Map layout: DataIdentifier -> SubSpecification -> vector of data blocks
+/// Vectors of new equipments are reserved with CapacityPolicyT::capacity(EquipmentIdentifier)
+////////////////////////////////////////////////////////////////////////////////
+template <class EquipmentIdentifierT, class StfDataT, class StfDataVectorT, class CapacityPolicyT>
+class StfDataMapIndex
+{
+  struct EquipmentData {
+    StfDataVectorT mVec;
+    std::size_t mCleanSize = cModified; // number of blocks when for_each_modified() visited the equipment
+  };
+
+  using StfSubSpecMap = std::unordered_map<o2::header::DataHeader::SubSpecificationType, EquipmentData>;
+  using StfDataIdentMap = std::unordered_map<o2::header::DataIdentifier, StfSubSpecMap>;
+
+ public:
+  using Range = StfDataRange<StfDataT>;
+  using ConstRange = StfDataRange<const StfDataT>;
+
+  static constexpr std::size_t cModified = std::size_t(-1);
+
+  void add(const EquipmentIdentifierT &pEqId, StfDataT &&pStfData)
+  {
+    auto lDataIdIt = mData.find(pEqId);
+    if (lDataIdIt == mData.end()) {
+      if (!mSpareIdentNodes.empty()) {
+        auto lNode = std::move(mSpareIdentNodes.back());
+        mSpareIdentNodes.pop_back();
+        lNode.key() = pEqId;
+        lDataIdIt = mData.insert(std::move(lNode)).position;
+      } else {
+        lDataIdIt = mData.emplace(pEqId, StfSubSpecMap()).first;
+      }
+    }
+
+    auto &lSubSpecMap = lDataIdIt->second;
+    auto lIt = lSubSpecMap.find(pEqId.mSubSpecification);
+    if (lIt == lSubSpecMap.end()) {
+      if (!mSpareSubSpecNodes.empty()) {
+        auto lNode = std::move(mSpareSubSpecNodes.back());
+        mSpareSubSpecNodes.pop_back();
+        lNode.key() = pEqId.mSubSpecification;
+        lIt = lSubSpecMap.insert(std::move(lNode)).position;
+      } else {
+        lIt = lSubSpecMap.emplace(pEqId.mSubSpecification, EquipmentData()).first;
+      }
+      lIt->second.mVec.reserve(CapacityPolicyT::capacity(pEqId));
+    }
+    lIt->second.mVec.push_back(std::move(pStfData));
+  }
+
+  void clear() { mData.clear(); }
+
+  // clear, keeping the map nodes and the data block vectors (with their capacity) for reuse by add()
+  void recycle()
+  {
+    for (auto lDataIdentIt = mData.begin(); lDataIdentIt != mData.end(); ) {
+      auto &lSubSpecMap = lDataIdentIt->second;
+      for (auto lSubSpecIt = lSubSpecMap.begin(); lSubSpecIt != lSubSpecMap.end(); ) {
+        auto lNode = lSubSpecMap.extract(lSubSpecIt++);
+        lNode.mapped().mVec.clear();
+        lNode.mapped().mCleanSize = cModified;
+        mSpareSubSpecNodes.push_back(std::move(lNode));
+      }
+      mSpareIdentNodes.push_back(mData.extract(lDataIdentIt++));
+    }
+  }
+  bool empty() const { return mData.empty(); }
+
+  // vectors are reserved per equipment (see add())
+  void reserve(const std::size_t) { }
+
+  // nothing to do for this layout
+  void finalize() const { }
+
+  // number of allocated, but unused data block entries
+  std::size_t unused_capacity() const
+  {
+    std::size_t lUnused = 0;
+    for (const auto &lDataIdentMapIter : mData) {
+      for (const auto &lSubSpecMapIter : lDataIdentMapIter.second) {
+        lUnused += lSubSpecMapIter.second.mVec.capacity() - lSubSpecMapIter.second.mVec.size();
+      }
+    }
+    return lUnused;
+  }
+
+  template <class F>
+  void for_each(F &&f)
+  {
+    for (auto &lDataIdentMapIter : mData) {
+      for (auto &lSubSpecMapIter : lDataIdentMapIter.second) {
+        auto &lVec = lSubSpecMapIter.second.mVec;
+        if (!invoke_visitor(f, EquipmentIdentifierT(lDataIdentMapIter.first, lSubSpecMapIter.first),
+          Range(lVec.data(), lVec.data() + lVec.size()))) {
+          return;
+        }
+      }
+    }
+  }
+
+  template <class F>
+  void for_each(F &&f) const
+  {
+    for (const auto &lDataIdentMapIter : mData) {
+      for (const auto &lSubSpecMapIter : lDataIdentMapIter.second) {
+        const auto &lVec = lSubSpecMapIter.second.mVec;
+        if (!invoke_visitor(f, EquipmentIdentifierT(lDataIdentMapIter.first, lSubSpecMapIter.first),
+          ConstRange(lVec.data(), lVec.data() + lVec.size()))) {
+          return;
+        }
+      }
+    }
+  }
+
+  // visit equipments with blocks added since the last call (or all with pAll)
+  template <class F>
+  void for_each_modified(F &&f, const bool pAll = false)
+  {
+    for (auto &lDataIdentMapIter : mData) {
+      for (auto &lSubSpecMapIter : lDataIdentMapIter.second) {
+        auto &lEqData = lSubSpecMapIter.second;
+        if (!pAll && (lEqData.mCleanSize == lEqData.mVec.size())) {
+          continue;
+        }
+        f(EquipmentIdentifierT(lDataIdentMapIter.first, lSubSpecMapIter.first),
+          Range(lEqData.mVec.data(), lEqData.mVec.data() + lEqData.mVec.size()));
+        lEqData.mCleanSize = lEqData.mVec.size();
+      }
+    }
+  }
+
+  // empty range if the equipment is not present
+  Range find(const EquipmentIdentifierT &pEqId)
+  {
+    const auto lDataIdIt = mData.find(pEqId);
+    if (lDataIdIt == mData.end()) {
+      return Range();
+    }
+    const auto lSubSpecIt = lDataIdIt->second.find(pEqId.mSubSpecification);
+    if (lSubSpecIt == lDataIdIt->second.end()) {
+      return Range();
+    }
+    auto &lVec = lSubSpecIt->second.mVec;
+    return Range(lVec.data(), lVec.data() + lVec.size());
+  }
+
+  std::vector<EquipmentIdentifierT> equipment_ids() const
+  {
+    std::vector<EquipmentIdentifierT> lKeys;
+    for (const auto &lDataIdentMapIter : mData) {
+      for (const auto &lSubSpecMapIter : lDataIdentMapIter.second) {
+        lKeys.emplace_back(lDataIdentMapIter.first, lSubSpecMapIter.first);
+      }
+    }
+    return lKeys;
+  }
+
+  // adopt all data blocks of pOther. Adopted equipments are marked as modified.
+  // Equipments not present in this index are spliced as map nodes, without moving data blocks or allocating.
+  // pOnOverlap(EquipmentIdentifierT) is called for equipments present in both (data blocks are appended).
+  template <class F>
+  void merge(StfDataMapIndex &&pOther, F &&pOnOverlap)
+  {
+    if (mData.empty()) {
+      mData.swap(pOther.mData);
+      mark_modified();
+      return;
+    }
+
+    for (auto lDataIdentIt = pOther.mData.begin(); lDataIdentIt != pOther.mData.end(); ) {
+      auto lDstIt = mData.find(lDataIdentIt->first);
+      if (lDstIt == mData.end()) {
+        auto lNode = pOther.mData.extract(lDataIdentIt++);
+        for (auto &lSubSpecMapIter : lNode.mapped()) {
+          lSubSpecMapIter.second.mCleanSize = cModified;
+        }
+        mData.insert(std::move(lNode));
+        continue;
+      }
+
+      auto &lSrcSubSpecMap = lDataIdentIt->second;
+      for (auto lSubSpecIt = lSrcSubSpecMap.begin(); lSubSpecIt != lSrcSubSpecMap.end(); ) {
+        auto lNode = lSrcSubSpecMap.extract(lSubSpecIt++);
+        lNode.mapped().mCleanSize = cModified;
+
+        auto lInsert = lDstIt->second.insert(std::move(lNode));
+        if (!lInsert.inserted) {
+          pOnOverlap(EquipmentIdentifierT(lDataIdentIt->first, lInsert.position->first));
+
+          auto &lSrcVec = lInsert.node.mapped().mVec;
+          auto &lDstData = lInsert.position->second;
+          std::move(lSrcVec.begin(), lSrcVec.end(), std::back_inserter(lDstData.mVec));
+          lDstData.mCleanSize = cModified;
+        }
+      }
+      ++lDataIdentIt;
+    }
+    pOther.mData.clear();
+  }
+
+  void merge(StfDataMapIndex &&pOther) { merge(std::move(pOther), [](const EquipmentIdentifierT &) { }); }
+
+  // move all data blocks with a matching DataIdentifier to pDst
+  template <class Pred>
+  void extract(Pred &&pPred, StfDataMapIndex &pDst)
+  {
+    // equipments already in pDst are merged per subspecification
+    StfDataMapIndex lExtracted;
+    for (auto lIt = mData.begin(); lIt != mData.end(); ) {
+      if (pPred(lIt->first)) {
+        lExtracted.mData.insert(mData.extract(lIt++));
+      } else {
+        ++lIt;
+      }
+    }
+
+    if (!lExtracted.mData.empty()) {
+      pDst.merge(std::move(lExtracted));
+    }
+  }
+
+ private:
+  void mark_modified()
+  {
+    for (auto &lDataIdentMapIter : mData) {
+      for (auto &lSubSpecMapIter : lDataIdentMapIter.second) {
+        lSubSpecMapIter.second.mCleanSize = cModified;
+      }
+    }
+  }
+
+  StfDataIdentMap mData;
+
+  // nodes released by recycle()
+  std::vector<typename StfDataIdentMap::node_type> mSpareIdentNodes;
+  std::vector<typename StfSubSpecMap::node_type> mSpareSubSpecNodes;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Flat layout: all data blocks are stored in one vector, grouped by equipment.
+/// A sorted vector of (EquipmentIdentifier, range) is used for lookup and iteration.
+/// Blocks are appended in arrival order. Grouping and the index are (re)built lazily,
+/// on the first access after a modification (stable, the order of blocks within an
+/// equipment is kept).
+////////////////////////////////////////////////////////////////////////////////
+template <class EquipmentIdentifierT, class StfDataT>
+class StfDataFlatIndex
+{
+  struct IndexEntry {
+    EquipmentIdentifierT mEqId;
+    std::size_t mBegin;
+    std::size_t mEnd;
+    std::size_t mCleanSize; // number of blocks when for_each_modified() visited the equipment
+  };
+
+ public:
+  using Range = StfDataRange<StfDataT>;
+  using ConstRange = StfDataRange<const StfDataT>;
+
+  static constexpr std::size_t cModified = std::size_t(-1);
+
+  void add(const EquipmentIdentifierT &pEqId, StfDataT &&pStfData)
+  {
+    if (!mKeys.empty() && (pEqId < mKeys.back())) {
+      mGrouped = false;
+    }
+    mKeys.push_back(pEqId);
+    mData.push_back(std::move(pStfData));
+    mIndexValid = false;
+  }
+
+  void clear()
+  {
+    mKeys.clear();
+    mData.clear();
+    mIndex.clear();
+    mGrouped = true;
+    mIndexValid = true;
+  }
+
+  bool empty() const { return mData.empty(); }
+
+  // the vectors keep their capacity
+  void recycle() { clear(); }
+
+  void reserve(const std::size_t pNumBlocks)
+  {
+    mKeys.reserve(pNumBlocks);
+    mData.reserve(pNumBlocks);
+  }
+
+  // number of allocated, but unused data block entries
+  std::size_t unused_capacity() const { return mData.capacity() - mData.size(); }
+
+  // group data blocks by equipment and build the index
+  void finalize() const
+  {
+    if (mIndexValid) {
+      return;
+    }
+
+    if (!mGrouped) {
+      std::vector<std::size_t> lOrder(mKeys.size());
+      std::iota(lOrder.begin(), lOrder.end(), std::size_t(0));
+      std::stable_sort(lOrder.begin(), lOrder.end(), [this](const std::size_t a, const std::size_t b) {
+        return mKeys[a] < mKeys[b];
+      });
+
+      std::vector<EquipmentIdentifierT> lKeys;
+      std::vector<StfDataT> lData;
+      lKeys.reserve(mKeys.size());
+      lData.reserve(mData.size());
+      for (const auto lIdx : lOrder) {
+        lKeys.push_back(mKeys[lIdx]);
+        lData.push_back(std::move(mData[lIdx]));
+      }
+      mKeys.swap(lKeys);
+      mData.swap(lData);
+      mGrouped = true;
+    }
+
+    // blocks are only appended: an equipment with an unchanged block count is not modified
+    std::vector<IndexEntry> lOldIndex;
+    lOldIndex.swap(mIndex);
+    auto lOldIt = lOldIndex.cbegin();
+
+    for (std::size_t lIdx = 0; lIdx < mKeys.size(); lIdx++) {
+      if (mIndex.empty() || mIndex.back().mEqId != mKeys[lIdx]) {
+        mIndex.push_back(IndexEntry{ mKeys[lIdx], lIdx, lIdx, cModified });
+      }
+      mIndex.back().mEnd = lIdx + 1;
+    }
+
+    for (auto &lEntry : mIndex) {
+      while (lOldIt != lOldIndex.cend() && lOldIt->mEqId < lEntry.mEqId) {
+        ++lOldIt;
+      }
+      if (lOldIt != lOldIndex.cend() && lOldIt->mEqId == lEntry.mEqId) {
+        lEntry.mCleanSize = lOldIt->mCleanSize;
+      }
+    }
+    mIndexValid = true;
+  }
+
+  template <class F>
+  void for_each(F &&f)
+  {
+    finalize();
+    for (const auto &lEntry : mIndex) {
+      if (!invoke_visitor(f, lEntry.mEqId, Range(mData.data() + lEntry.mBegin, mData.data() + lEntry.mEnd))) {
+        return;
+      }
+    }
+  }
+
+  template <class F>
+  void for_each(F &&f) const
+  {
+    finalize();
+    for (const auto &lEntry : mIndex) {
+      if (!invoke_visitor(f, lEntry.mEqId, ConstRange(mData.data() + lEntry.mBegin, mData.data() + lEntry.mEnd))) {
+        return;
+      }
+    }
+  }
+
+  // visit equipments with blocks added since the last call (or all with pAll)
+  template <class F>
+  void for_each_modified(F &&f, const bool pAll = false)
+  {
+    finalize();
+    for (auto &lEntry : mIndex) {
+      const std::size_t lSize = lEntry.mEnd - lEntry.mBegin;
+      if (!pAll && (lEntry.mCleanSize == lSize)) {
+        continue;
+      }
+      f(lEntry.mEqId, Range(mData.data() + lEntry.mBegin, mData.data() + lEntry.mEnd));
+      lEntry.mCleanSize = lSize;
+    }
+  }
+
+  // empty range if the equipment is not present
+  Range find(const EquipmentIdentifierT &pEqId)
+  {
+    finalize();
+    const auto lIt = std::lower_bound(mIndex.cbegin(), mIndex.cend(), pEqId,
+      [](const IndexEntry &pEntry, const EquipmentIdentifierT &pId) { return pEntry.mEqId < pId; });
+
+    if (lIt == mIndex.cend() || lIt->mEqId != pEqId) {
+      return Range();
+    }
+    return Range(mData.data() + lIt->mBegin, mData.data() + lIt->mEnd);
+  }
+
+  std::vector<EquipmentIdentifierT> equipment_ids() const
+  {
+    finalize();
+    std::vector<EquipmentIdentifierT> lKeys;
+    lKeys.reserve(mIndex.size());
+    for (const auto &lEntry : mIndex) {
+      lKeys.push_back(lEntry.mEqId);
+    }
+    return lKeys;
+  }
+
+  // adopt all data blocks of pOther. Adopted equipments are marked as modified.
+  // When all equipments of pOther sort after the equipments of this index, data blocks and index entries are
+  // appended as ranges and the index stays valid. Otherwise the index is rebuilt on the next access.
+  // pOnOverlap(EquipmentIdentifierT) is called for equipments present in both.
+  template <class F>
+  void merge(StfDataFlatIndex &&pOther, F &&pOnOverlap)
+  {
+    if (mData.empty()) {
+      *this = std::move(pOther);
+      pOther.clear();
+      for (auto &lEntry : mIndex) {
+        lEntry.mCleanSize = cModified;
+      }
+      return;
+    }
+
+    finalize();
+    pOther.finalize();
+
+    // report overlapping equipments (both indexes are sorted)
+    auto lOtherIt = pOther.mIndex.cbegin();
+    for (const auto &lEntry : mIndex) {
+      while (lOtherIt != pOther.mIndex.cend() && lOtherIt->mEqId < lEntry.mEqId) {
+        ++lOtherIt;
+      }
+      if (lOtherIt != pOther.mIndex.cend() && lOtherIt->mEqId == lEntry.mEqId) {
+        pOnOverlap(lEntry.mEqId);
+      }
+    }
+
+    const bool lSplice = !pOther.mKeys.empty() && (mKeys.back() < pOther.mKeys.front());
+    const std::size_t lOffset = mData.size();
+
+    mKeys.insert(mKeys.end(), pOther.mKeys.cbegin(), pOther.mKeys.cend());
+    mData.insert(mData.end(), std::make_move_iterator(pOther.mData.begin()),
+      std::make_move_iterator(pOther.mData.end()));
+
+    if (lSplice) {
+      for (const auto &lEntry : pOther.mIndex) {
+        mIndex.push_back(IndexEntry{ lEntry.mEqId, lEntry.mBegin + lOffset, lEntry.mEnd + lOffset, cModified });
+      }
+    } else if (!pOther.mKeys.empty()) {
+      mGrouped = false;
+      mIndexValid = false;
+    }
+    pOther.clear();
+  }
+
+  void merge(StfDataFlatIndex &&pOther) { merge(std::move(pOther), [](const EquipmentIdentifierT &) { }); }
+
+  // move all data blocks with a matching DataIdentifier to pDst
+  template <class Pred>
+  void extract(Pred &&pPred, StfDataFlatIndex &pDst)
+  {
+    std::size_t lKept = 0;
+    for (std::size_t lIdx = 0; lIdx < mKeys.size(); lIdx++) {
+      if (pPred(o2::header::DataIdentifier(mKeys[lIdx]))) {
+        pDst.add(mKeys[lIdx], std::move(mData[lIdx]));
+      } else {
+        if (lKept != lIdx) {
+          mKeys[lKept] = mKeys[lIdx];
+          mData[lKept] = std::move(mData[lIdx]);
+        }
+        lKept++;
+      }
+    }
+
+    if (lKept != mKeys.size()) {
+      mKeys.erase(mKeys.begin() + lKept, mKeys.end());
+      mData.erase(mData.begin() + lKept, mData.end());
+      mIndexValid = false;
+    }
+  }
+
+ private:
+  // NOTE: grouping and indexing do not change the content, allowed on const objects
+  mutable std::vector<EquipmentIdentifierT> mKeys;
+  mutable std::vector<StfDataT> mData;
+  mutable std::vector<IndexEntry> mIndex;
+  mutable bool mGrouped = true;
+  mutable bool mIndexValid = true;
+};
+
+} /* namespace impl */
+
+} /* namespace o2::DataDistribution */
+
+#endif /* ALICEO2_SUBTIMEFRAME_DATAINDEX_H_ */
@@ -16,6 +16,10 @@
 
 #include "DataDistLogger.h"
 
+#include <fairmq/FairMQTransportFactory.h>
+
+#include <cstring>
+#include <cstdlib>
 #include <map>
 #include <iterator>
 #include <algorithm>
@@ -25,6 +29,8 @@ namespace o2::DataDistribution
 
 using namespace o2::header;
 
+std::array<std::atomic_uint32_t, StfDataCapacityHints::cNumSlots> StfDataCapacityHints::sHints{};
+
 ////////////////////////////////////////////////////////////////////////////////
 /// SubTimeFrame
 ////////////////////////////////////////////////////////////////////////////////
@@ -39,95 +45,199 @@ void SubTimeFrame::updateStf() const
     return;
   }
 
-  // recalculate data size
-  mDataSize = 0;
+  if (mData.empty()) {
+    mDataUpdated = true;
+    return;
+  }
 
-  // Update data block indexes
-  for (auto &lIdentSubSpecVect : mData) {
-    StfSubSpecMap &lSubSpecMap = lIdentSubSpecVect.second;
+  // Update data block indexes of modified equipments (or all if the STF header changed)
+  mData.for_each_modified([this](const EquipmentIdentifier &pEqId, StfDataIndex::Range lDataVector) {
 
-    for (auto &lSubSpecDataVector : lSubSpecMap) {
-      StfDataVector &lDataVector = lSubSpecDataVector.second;
+    const auto lTotalCount = lDataVector.size();
+    StfDataCapacityHints::record(pEqId, lTotalCount);
+    for (std::size_t i = 0; i < lTotalCount; i++) {
 
-      const auto lTotalCount = lDataVector.size();
-      for (StfDataVector::size_type i = 0; i < lTotalCount; i++) {
+      lDataVector[i].setPayloadIndex_TfCounter_RunNumber(i, lTotalCount, mHeader.mId, mHeader.mRunNumber);
 
-        lDataVector[i].setPayloadIndex_TfCounter_RunNumber(i, lTotalCount, mHeader.mId, mHeader.mRunNumber);
+      // update first orbit if not present in the data (old tf files)
+      // update tfCounter
+      if (mHeader.mFirstOrbit != std::numeric_limits<std::uint32_t>::max()) {
+        lDataVector[i].setFirstOrbit(mHeader.mFirstOrbit);
+      }
+    }
 
-        // update first orbit if not present in the data (old tf files)
-        // update tfCounter
-        if (mHeader.mFirstOrbit != std::numeric_limits<std::uint32_t>::max()) {
-          lDataVector[i].setFirstOrbit(mHeader.mFirstOrbit);
-        }
+    assert(lDataVector.empty() ? true :
+      lDataVector.front().getDataHeader().splitPayloadIndex == 0
+    );
+    assert(lDataVector.empty() ? true :
+      lDataVector.back().getDataHeader().splitPayloadIndex == (lTotalCount - 1)
+    );
+    assert(lDataVector.empty() ? true :
+      lDataVector.front().getDataHeader().splitPayloadParts == lTotalCount
+    );
+    assert(lDataVector.empty() ? true :
+      lDataVector.front().getDataHeader().splitPayloadParts ==
+      lDataVector.back().getDataHeader().splitPayloadParts
+    );
+  }, mStfHeaderChanged);
+
+  mStfHeaderChanged = false;
+  mDataUpdated = true;
+}
 
-        // sum up only data size
-        mDataSize += lDataVector[i].mData->GetSize();
-      }
+std::uint64_t SubTimeFrame::calculateDataSize() const
+{
+  std::uint64_t lDataSize = 0;
 
-      assert(lDataVector.empty() ? true :
-        lDataVector.front().getDataHeader().splitPayloadIndex == 0
-      );
-      assert(lDataVector.empty() ? true :
-        lDataVector.back().getDataHeader().splitPayloadIndex == (lTotalCount - 1)
-      );
-      assert(lDataVector.empty() ? true :
-        lDataVector.front().getDataHeader().splitPayloadParts == lTotalCount
-      );
-      assert(lDataVector.empty() ? true :
-        lDataVector.front().getDataHeader().splitPayloadParts ==
-        lDataVector.back().getDataHeader().splitPayloadParts
-      );
+  mData.for_each([&lDataSize](const EquipmentIdentifier &, auto lDataVector) {
+    for (const auto &lStfData : lDataVector) {
+      lDataSize += lStfData.mData->GetSize();
     }
-  }
-  mDataUpdated = true;
+  });
+
+  return lDataSize;
 }
 
 std::vector<EquipmentIdentifier> SubTimeFrame::getEquipmentIdentifiers() const
 {
-  std::vector<EquipmentIdentifier> lKeys;
+  return mData.equipment_ids();
+}
+
+void SubTimeFrame::extractMessages(std::vector<FairMQMessagePtr> &pMsgs)
+{
+  mData.for_each([&](const EquipmentIdentifier &, const StfDataIndex::Range &pRange) {
+    for (auto &lStfData : pRange) {
+      pMsgs.push_back(std::move(lStfData.mHeader));
+      pMsgs.push_back(std::move(lStfData.mData));
+    }
+  });
+  clear();
+}
+
+std::unique_ptr<SubTimeFrame> SubTimeFrame::referenceCopy() const
+{
+  updateStf();
+
+  auto lCopy = SubTimeFramePool::get(mHeader.mId);
+  lCopy->mHeader = mHeader;
+  lCopy->mNumMissingStfs = mNumMissingStfs;
+
+  mData.for_each([&](const EquipmentIdentifier &, const StfDataIndex::Range &pRange) {
+    for (const auto &lStfData : pRange) {
+      // headers can be adapted in place by the receiver of the original
+      auto lHdr = lStfData.mHeader->GetTransport()->CreateMessage(lStfData.mHeader->GetSize());
+      std::memcpy(lHdr->GetData(), lStfData.mHeader->GetData(), lStfData.mHeader->GetSize());
+
+      auto lData = lStfData.mData->GetTransport()->CreateMessage();
+      lData->Copy(*lStfData.mData);
+
+      lCopy->addStfData(StfData(std::move(lHdr), std::move(lData)));
+    }
+  });
+
+  // headers are already up to date
+  lCopy->mDataUpdated = true;
+  lCopy->mStfHeaderChanged = false;
+  return lCopy;
+}
 
-  for (const auto& lDataIdentMapIter : mData) {
-    for (const auto& lSubSpecMapIter : lDataIdentMapIter.second) {
-      lKeys.emplace_back(lDataIdentMapIter.first, lSubSpecMapIter.first);
+std::string SubTimeFrame::traceRecord() const
+{
+  static constexpr std::array<const char*, Header::Trace::eNumPoints> cPointNames = {
+    "stf_built", "stfb_sent", "stfs_recv", "stfs_req", "stfs_sent", "tfb_recv", "tf_built"
+  };
+
+  const auto &lTs = mHeader.mTrace.mTs;
+  std::uint64_t lStart = std::numeric_limits<std::uint64_t>::max();
+  for (const auto lT : lTs) {
+    if (lT != 0) {
+      lStart = std::min(lStart, lT);
     }
   }
+  if (lStart == std::numeric_limits<std::uint64_t>::max()) {
+    lStart = 0;
+  }
 
-  return lKeys;
+  std::string lRec = fmt::format("tf_id={} start_ns={}", id(), lStart);
+  for (std::size_t i = 0; i < lTs.size(); i++) {
+    if (lTs[i] == 0) {
+      lRec += fmt::format(" {}=-1", cPointNames[i]);
+    } else {
+      lRec += fmt::format(" {}={}", cPointNames[i], (lTs[i] - lStart) / 1000);
+    }
+  }
+  return lRec;
 }
 
 void SubTimeFrame::mergeStf(std::unique_ptr<SubTimeFrame> pStf)
 {
-  // make sure data equipment does not repeat
-  std::set<EquipmentIdentifier> lUnionSet;
-  for (const auto& lId : getEquipmentIdentifiers())
-    lUnionSet.emplace(lId);
-
-  for (const auto& lId : pStf->getEquipmentIdentifiers()) {
-    if (lUnionSet.emplace(lId).second == false /* not inserted */) {
-      EDDLOG_RL(1000, "Merging STFs error: Equipment already present: fee={}", lId.info());
+  // merge the Stfs. Data equipment should not repeat
+  mDataSize += pStf->mDataSize;
+  mData.merge(std::move(pStf->mData), [](const EquipmentIdentifier &pEqId) {
+    EDDLOG_RL(1000, "Merging STFs error: Equipment already present: fee={}", pEqId.info());
+  });
+  mDataUpdated = false;
+
+  SubTimeFramePool::put(std::move(pStf));
+}
+
+void SubTimeFrame::recycle(const TimeFrameIdType pStfId)
+{
+  mData.recycle();
+  mHeader = Header(pStfId);
+  mDataSize = 0;
+  mNumMissingStfs = 0;
+  mDataUpdated = false;
+  mStfHeaderChanged = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// SubTimeFramePool
+////////////////////////////////////////////////////////////////////////////////
+std::mutex SubTimeFramePool::sLock;
+std::vector<std::unique_ptr<SubTimeFrame>> SubTimeFramePool::sPool;
+
+std::size_t SubTimeFramePool::maxSize()
+{
+  static const std::size_t sMaxSize = []() {
+    const auto lPoolSizeVar = std::getenv("DATADIST_STF_POOL_SIZE");
+    return lPoolSizeVar ? std::size_t(std::strtoull(lPoolSizeVar, nullptr, 10)) : std::size_t(64);
+  }();
+  return sMaxSize;
+}
+
+std::unique_ptr<SubTimeFrame> SubTimeFramePool::get(const TimeFrameIdType pStfId)
+{
+  std::unique_ptr<SubTimeFrame> lStf;
+  {
+    std::scoped_lock lLock(sLock);
+    if (!sPool.empty()) {
+      lStf = std::move(sPool.back());
+      sPool.pop_back();
     }
   }
 
-  // merge the Stfs
-  for (auto& lDataIdentMapIter : pStf->mData) {
-    for (auto& lSubSpecMapIter : lDataIdentMapIter.second) {
-      // source
-      const DataIdentifier& lDataId = lDataIdentMapIter.first;
-      const DataHeader::SubSpecificationType& lSubSpec = lSubSpecMapIter.first;
-      StfDataVector& lStfDataVec = lSubSpecMapIter.second;
-
-      // destination
-      StfDataVector& lDstStfDataVec = mData[lDataId][lSubSpec];
-
-      std::move(
-        lStfDataVec.begin(),
-        lStfDataVec.end(),
-        std::back_inserter(lDstStfDataVec));
-    }
+  if (!lStf) {
+    return std::make_unique<SubTimeFrame>(pStfId);
   }
 
-  // delete pStf
-  pStf.reset();
+  lStf->mHeader.mId = pStfId;
+  return lStf;
+}
+
+void SubTimeFramePool::put(std::unique_ptr<SubTimeFrame> pStf)
+{
+  if (!pStf) {
+    return;
+  }
+
+  // release the data outside of the lock
+  pStf->recycle(sInvalidTimeFrameId);
+
+  std::scoped_lock lLock(sLock);
+  if (sPool.size() < maxSize()) {
+    sPool.push_back(std::move(pStf));
+  }
 }
 
 } /* o2::DataDistribution */
@@ -17,10 +17,17 @@
 #include "Utilities.h"
 #include "DataModelUtils.h"
 #include "ReadoutDataModel.h"
+#include "SubTimeFrameDataIndex.h"
 
 #include <Headers/DataHeader.h>
 
 #include <vector>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <map>
 #include <unordered_set>
 #include <stdexcept>
@@ -200,6 +207,53 @@ struct HBFrameHeader : public o2hdr::BaseHeader {
   }
 };
 
+////////////////////////////////////////////////////////////////////////////////
+/// Initial capacity of per-equipment data vectors
+/// Learned from the number of data blocks of the equipment in previous (Sub)TimeFrames. Equipments
+/// are hashed into a fixed table without collision handling, which is fine for a hint. Without
+/// a hint, the capacity is selected on the data type (raw data contains many HBFrames).
+////////////////////////////////////////////////////////////////////////////////
+class StfDataCapacityHints
+{
+ public:
+  static constexpr std::size_t cNumSlots = 4096;
+  static constexpr std::uint32_t cMaxCapacity = 1U << 14;
+  static constexpr std::uint32_t cRawDataCapacity = 64;
+  static constexpr std::uint32_t cDefaultCapacity = 4;
+
+  static std::size_t capacity(const EquipmentIdentifier &pEqId)
+  {
+    const std::uint32_t lHint = sHints[slot(pEqId)].load(std::memory_order_relaxed);
+    if (lHint > 0) {
+      return lHint;
+    }
+    return (pEqId.mDataDescription == o2hdr::gDataDescriptionRawData) ? cRawDataCapacity : cDefaultCapacity;
+  }
+
+  // follow increases immediately (with 1/8 headroom), decrease slowly
+  static void record(const EquipmentIdentifier &pEqId, const std::size_t pCount)
+  {
+    auto &lHint = sHints[slot(pEqId)];
+    const std::uint32_t lNew = std::uint32_t(std::min(pCount + pCount / 8 + 1, std::size_t(cMaxCapacity)));
+    const std::uint32_t lOld = lHint.load(std::memory_order_relaxed);
+    const std::uint32_t lVal = (lNew >= lOld) ? lNew : (lOld - (lOld - lNew) / 4);
+    if (lVal != lOld) {
+      lHint.store(lVal, std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  static std::size_t slot(const EquipmentIdentifier &pEqId)
+  {
+    std::uint64_t lHash = pEqId.mDataDescription.itg[0] ^ (pEqId.mDataDescription.itg[1] * 0x9E3779B97F4A7C15ULL);
+    lHash ^= (std::uint64_t(pEqId.mDataOrigin.itg[0]) << 32) | pEqId.mSubSpecification;
+    lHash *= 0xFF51AFD7ED558CCDULL;
+    return std::size_t(lHash >> 32) % cNumSlots;
+  }
+
+  static std::array<std::atomic_uint32_t, cNumSlots> sHints;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /// Visitor friends
 ////////////////////////////////////////////////////////////////////////////////
@@ -273,10 +327,9 @@ class SubTimeFrame : public IDataModelObject
     }
   };
 
-  // we SHOULD be able to get away with this
-  // make sure the vector has sufficient initial capacity
+  // initial capacity is reserved by the index (see StfDataCapacityHints)
   struct StfDataVectorT : public std::vector<StfData> {
-    StfDataVectorT() : std::vector<StfData>() { reserve(512); }
+    StfDataVectorT() : std::vector<StfData>() { }
 
     StfDataVectorT(const StfDataVectorT&) = delete;
     StfDataVectorT(StfDataVectorT&&) = default;
@@ -297,10 +350,13 @@ class SubTimeFrame : public IDataModelObject
   void mergeStf(std::unique_ptr<SubTimeFrame> pStf);
 
   // get data size (not including o2 headers)
-  std::uint64_t getDataSize() const { updateStf(); return mDataSize; }
+  std::uint64_t getDataSize() const { return mDataSize; }
 
   std::vector<EquipmentIdentifier> getEquipmentIdentifiers() const;
 
+  // memory reserved for data block entries but not used (bytes)
+  std::uint64_t getUnusedCapacity() const { return mData.unused_capacity() * sizeof(StfData); }
+
   struct Header {
     TimeFrameIdType mId = sInvalidTimeFrameId;
     std::uint32_t mFirstOrbit = std::numeric_limits<std::uint32_t>::max();
@@ -312,6 +368,24 @@ class SubTimeFrame : public IDataModelObject
       eNull
     } mOrigin = eNull;
 
+    /// Hand-off timestamps of sampled TFs (system clock, ns since epoch; 0 if not reached)
+    /// The clock is used because the points are compared between nodes.
+    struct Trace {
+      enum Point {
+        eStfBuilt = 0,        // StfBuilder: STF complete
+        eStfBuilderSent,      // StfBuilder: sent to StfSender
+        eStfSenderReceived,
+        eStfSenderRequested,  // StfSender: TfBuilder assigned by the scheduler
+        eStfSenderSent,
+        eTfBuilderReceived,
+        eTfBuilt,             // TfBuilder: all STFs merged
+        eNumPoints
+      };
+
+      std::uint64_t mSampled = 0;
+      std::array<std::uint64_t, eNumPoints> mTs = { };
+    } mTrace;
+
     Header() = default;
     explicit Header(TimeFrameIdType pId)
     : mId(pId) { }
@@ -322,9 +396,28 @@ class SubTimeFrame : public IDataModelObject
   Header::Origin origin() const { return mHeader.mOrigin; }
   void setOrigin(const Header::Origin pOrig) { mHeader.mOrigin = pOrig; }
 
-  void clear() { mData.clear(); mDataUpdated = false; }
+  // tracing: 1 in pEveryN TFs by the TF id, so that all FLPs trace the same TFs (0: disabled)
+  void setTraceSampling(const std::uint64_t pEveryN) {
+    mHeader.mTrace.mSampled = (pEveryN > 0) && ((id() % pEveryN) == 0);
+  }
+  bool traced() const { return mHeader.mTrace.mSampled != 0; }
+  void trace(const Header::Trace::Point pPoint,
+    const std::chrono::system_clock::time_point pTime = std::chrono::system_clock::now()) {
+    if (traced()) {
+      mHeader.mTrace.mTs[pPoint] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        pTime.time_since_epoch()).count();
+    }
+  }
+  // compact trace record: start time and offsets of all points (us, -1 if not reached)
+  std::string traceRecord() const;
+
+  void clear() { mData.clear(); mDataSize = 0; mDataUpdated = false; }
+  // move all header and data messages to pMsgs (bulk release). The STF is empty afterwards
+  void extractMessages(std::vector<FairMQMessagePtr> &pMsgs);
   // NOTE: method declared const to work with const visitors, manipulated fields are mutable
   void updateStf() const;
+  // copy sharing the data messages (reference counted), header messages are duplicated
+  std::unique_ptr<SubTimeFrame> referenceCopy() const;
 
  protected:
   void accept(ISubTimeFrameVisitor& v) override { updateStf(); v.visit(*this); }
@@ -332,48 +425,70 @@ class SubTimeFrame : public IDataModelObject
 
  private:
 
-  using StfDataVector = StfDataVectorT; // vector with more capacity on creation
-  using StfSubSpecMap = std::unordered_map<o2hdr::DataHeader::SubSpecificationType, StfDataVector>;
-  using StfDataIdentMap = std::unordered_map<o2hdr::DataIdentifier, StfSubSpecMap>;
+  // Layout of the data blocks is selected at build time (DATADIST_STF_FLAT_INDEX)
+  //  - map:  DataIdentifier -> SubSpecification -> vector of data blocks
+  //  - flat: one vector of data blocks with a sorted (EquipmentIdentifier, range) index
+  // Both are accessed using for_each(), find(), and equipment_ids(). Data blocks of one equipment are
+  // contiguous in both.
+#if defined(DATADIST_STF_FLAT_INDEX)
+  using StfDataIndex = impl::StfDataFlatIndex<EquipmentIdentifier, StfData>;
+#else
+  using StfDataIndex = impl::StfDataMapIndex<EquipmentIdentifier, StfData, StfDataVectorT, StfDataCapacityHints>;
+#endif
 
   ///
   /// Fields
   ///
   Header mHeader;
-  mutable StfDataIdentMap mData;
-  mutable std::uint64_t mDataSize = 0;
+  mutable StfDataIndex mData;
+  std::uint64_t mDataSize = 0; // kept up to date on every data change
+  std::uint32_t mNumMissingStfs = 0;
 
   ///
-  /// internal: do lazy accounting. Must be invalidated every time StubTimeFrame is changed
+  /// internal: do lazy header update. Must be invalidated every time StubTimeFrame is changed
+  /// Only headers of modified equipments are rewritten, unless the STF header changed
   ///
   mutable bool mDataUpdated = false;
+  mutable bool mStfHeaderChanged = true;
+
+  // sum up the data size (not including o2 headers)
+  std::uint64_t calculateDataSize() const;
 
 public:
   void updateFirstOrbit(const std::uint32_t pOrbit) {
     if (pOrbit < mHeader.mFirstOrbit) {
       mHeader.mFirstOrbit = pOrbit;
-     mDataUpdated = false;
+      mStfHeaderChanged = true;
+      mDataUpdated = false;
     }
   }
 
+  // number of STFs missing from a partial TF (assembly timeout). Not serialized
+  std::uint32_t numMissingStfs() const { return mNumMissingStfs; }
+  void setNumMissingStfs(const std::uint32_t pNumMissing) { mNumMissingStfs = pNumMissing; }
+
   void updateRunNumber(const std::uint32_t pRunNum) {
     if (mHeader.mRunNumber != pRunNum) {
       mHeader.mRunNumber = pRunNum;
-     mDataUpdated = false;
+      mStfHeaderChanged = true;
+      mDataUpdated = false;
     }
   }
 
 private:
+  friend class SubTimeFramePool;
+
+  // release all data and reset the header. Containers are kept for reuse (see SubTimeFramePool)
+  void recycle(const TimeFrameIdType pStfId);
+
   ///
   /// helper methods
   ///
   inline void addStfData(const o2hdr::DataHeader& pDataHeader, StfData&& pStfData)
   {
-    const o2hdr::DataIdentifier lDataId = impl::getDataIdentifier(pDataHeader);
-    auto& lDataVector = mData[lDataId][pDataHeader.subSpecification];
-
-    lDataVector.push_back(std::move(pStfData));
-   mDataUpdated = false;
+    mDataSize += pStfData.mData->GetSize();
+    mData.add(EquipmentIdentifier(pDataHeader), std::move(pStfData));
+    mDataUpdated = false;
   }
 
   inline void addStfData(StfData&& pStfData)
@@ -383,6 +498,30 @@ private:
   }
 
 };
+
+////////////////////////////////////////////////////////////////////////////////
+/// SubTimeFramePool
+/// Released (Sub)TimeFrames are emptied and kept with the nodes and data block vectors of their index, so that
+/// building new ones does not allocate. The number of kept objects is limited by DATADIST_STF_POOL_SIZE
+/// (default 64, 0 disables the pool).
+////////////////////////////////////////////////////////////////////////////////
+class SubTimeFramePool
+{
+ public:
+  SubTimeFramePool() = delete;
+
+  static std::unique_ptr<SubTimeFrame> get(const TimeFrameIdType pStfId);
+
+  // the data messages are released immediately
+  static void put(std::unique_ptr<SubTimeFrame> pStf);
+
+ private:
+  static std::size_t maxSize();
+
+  static std::mutex sLock;
+  static std::vector<std::unique_ptr<SubTimeFrame>> sPool;
+};
+
 }
 } /* o2::DataDistribution */
 
@@ -13,6 +13,8 @@
 
 #include "SubTimeFrameFile.h"
 
+#include <cstring>
+
 namespace o2
 {
 namespace DataDistribution
@@ -55,8 +57,71 @@ std::ostream& operator<<(std::ostream& pStream, const SubTimeFrameFileDataIndex&
   pStream.write(reinterpret_cast<const char*>(&lDataHeader), sizeof(o2::header::DataHeader));
 
   // write the index
-  return pStream.write(reinterpret_cast<const char*>(pIndex.mDataIndex.data()),
-                       pIndex.mDataIndex.size() * sizeof(SubTimeFrameFileDataIndex::DataIndexElem));
+  pStream.write(reinterpret_cast<const char*>(pIndex.mDataIndex.data()),
+                pIndex.mDataIndex.size() * sizeof(SubTimeFrameFileDataIndex::DataIndexElem));
+
+  if (!pIndex.mHasChecksums) {
+    return pStream;
+  }
+
+  // write the checksum table
+  pStream.write(reinterpret_cast<const char*>(pIndex.mChecksums.data()),
+                pIndex.mChecksums.size() * sizeof(std::uint32_t));
+
+  SubTimeFrameFileDataIndex::ChecksumTrailer lTrailer;
+  lTrailer.mNumChecksums = pIndex.mChecksums.size();
+  return pStream.write(reinterpret_cast<const char*>(&lTrailer), sizeof(SubTimeFrameFileDataIndex::ChecksumTrailer));
+}
+
+bool SubTimeFrameFileDataIndex::getChecksumTable(const char *pPayload, const std::uint64_t pPayloadSize,
+  std::uint64_t &pIndexSize, const char* &pChecksums, std::uint32_t &pNumChecksums)
+{
+  if (pPayloadSize < sizeof(ChecksumTrailer)) {
+    return false;
+  }
+
+  // the payload is not aligned in the file
+  ChecksumTrailer lTrailer;
+  std::memcpy(&lTrailer, pPayload + pPayloadSize - sizeof(ChecksumTrailer), sizeof(ChecksumTrailer));
+
+  const std::uint64_t lTableSize = std::uint64_t(lTrailer.mNumChecksums) * sizeof(std::uint32_t);
+  if (lTrailer.mMagic != sChecksumMagic || (lTableSize + sizeof(ChecksumTrailer)) > pPayloadSize) {
+    return false;
+  }
+
+  pIndexSize = pPayloadSize - sizeof(ChecksumTrailer) - lTableSize;
+  if ((pIndexSize % sizeof(DataIndexElem)) != 0) {
+    return false;
+  }
+
+  pChecksums = pPayload + pIndexSize;
+  pNumChecksums = lTrailer.mNumChecksums;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// SubTimeFrameFileTfIndex
+////////////////////////////////////////////////////////////////////////////////
+
+const o2::header::DataDescription SubTimeFrameFileTfIndex::sDataDescFileTfIndex{ "FILE_TF_INDEX" };
+
+std::ostream& operator<<(std::ostream& pStream, const SubTimeFrameFileTfIndex& pIndex)
+{
+  static_assert(std::is_standard_layout<SubTimeFrameFileTfIndex::TfIndexElem>::value,
+                "SubTimeFrameFileTfIndex::TfIndexElem must be a std layout type.");
+
+  // write DataHeader
+  const o2::header::DataHeader lDataHeader = pIndex.getDataHeader();
+  pStream.write(reinterpret_cast<const char*>(&lDataHeader), sizeof(o2::header::DataHeader));
+
+  // write the index
+  pStream.write(reinterpret_cast<const char*>(pIndex.mTfIndex.data()),
+                pIndex.mTfIndex.size() * sizeof(SubTimeFrameFileTfIndex::TfIndexElem));
+
+  // write the trailer
+  SubTimeFrameFileTfIndex::Trailer lTrailer;
+  lTrailer.mFooterSize = pIndex.getSizeInFile();
+  return pStream.write(reinterpret_cast<const char*>(&lTrailer), sizeof(SubTimeFrameFileTfIndex::Trailer));
 }
 }
 } /* o2::DataDistribution */
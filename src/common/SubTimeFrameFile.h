@@ -54,9 +54,14 @@ struct SubTimeFrameFileMeta {
   }
 
   ///
-  /// Version of STF file format
+  /// Version of STF file format (2: the index has a checksum table)
   ///
-  const std::uint64_t mStfFileVersion = 1;
+  static constexpr std::uint64_t sVersionChecksums = 2;
+  static constexpr std::uint64_t sVersionLatest = sVersionChecksums;
+  std::uint64_t mStfFileVersion = 1;
+
+  // readers must reject versions they do not know about
+  bool isVersionSupported() const { return (mStfFileVersion >= 1) && (mStfFileVersion <= sVersionLatest); }
 
   ///
   /// Size of the Stf in file, including this header.
@@ -139,11 +144,30 @@ struct SubTimeFrameFileDataIndex {
     }
   };
 
+  /// Optional CRC32C table after the index elements: the checksum of each data block payload, in file order,
+  /// followed by the ChecksumTrailer. Readers without checksum support cannot use such index for selective reads.
+  static constexpr std::uint32_t sChecksumMagic = 0x43524344; // "DCRC"
+
+  struct ChecksumTrailer {
+    std::uint32_t mNumChecksums = 0;
+    std::uint32_t mMagic = sChecksumMagic;
+  };
+
+  static_assert(sizeof(ChecksumTrailer) == 8, "ChecksumTrailer changed -> Binary compatibility is lost!");
+
   SubTimeFrameFileDataIndex() = default;
 
-  void clear() noexcept { mDataIndex.clear(); }
+  void clear() noexcept { mDataIndex.clear(); mChecksums.clear(); }
   bool empty() const noexcept { return mDataIndex.empty(); }
 
+  void setChecksums(const bool pChecksums) { mHasChecksums = pChecksums; }
+  bool hasChecksums() const { return mHasChecksums; }
+  void AddChecksum(const std::uint32_t pCrc) { mChecksums.push_back(pCrc); }
+
+  /// find the checksum table of an index payload (file version 2). pIndexSize: size of the index elements
+  static bool getChecksumTable(const char *pPayload, const std::uint64_t pPayloadSize, std::uint64_t &pIndexSize,
+    const char* &pChecksums, std::uint32_t &pNumChecksums);
+
   void AddStfElement(const EquipmentIdentifier& pEqDataId,
                      const std::uint32_t pCnt,
                      const std::uint64_t pOffset,
@@ -154,19 +178,25 @@ struct SubTimeFrameFileDataIndex {
 
   std::uint64_t getSizeInFile() const
   {
-    return sizeof(o2::header::DataHeader) + (sizeof(DataIndexElem) * mDataIndex.size());
+    return sizeof(o2::header::DataHeader) + getPayloadSize();
   }
 
   friend std::ostream& operator<<(std::ostream& pStream, const SubTimeFrameFileDataIndex& pIndex);
 
  private:
+  std::uint64_t getPayloadSize() const
+  {
+    return (sizeof(DataIndexElem) * mDataIndex.size()) +
+      (mHasChecksums ? (sizeof(std::uint32_t) * mChecksums.size() + sizeof(ChecksumTrailer)) : 0);
+  }
+
   const o2::header::DataHeader getDataHeader() const
   {
     auto lHdr = o2::header::DataHeader(
       sDataDescFileStfDataIndex,
       o2::header::gDataOriginAny,
       0, // TODO: subspecification? FLP ID? EPN ID?
-      mDataIndex.size() * sizeof(DataIndexElem));
+      getPayloadSize());
 
     lHdr.payloadSerializationMethod = o2::header::gSerializationMethodNone;
 
@@ -174,9 +204,111 @@ struct SubTimeFrameFileDataIndex {
   }
 
   std::vector<DataIndexElem> mDataIndex;
+
+  bool mHasChecksums = false;
+  std::vector<std::uint32_t> mChecksums;
 };
 
 std::ostream& operator<<(std::ostream& pStream, const SubTimeFrameFileDataIndex& pIndex);
+
+////////////////////////////////////////////////////////////////////////////////
+/// SubTimeFrameFileTfIndex
+////////////////////////////////////////////////////////////////////////////////
+
+/// Optional footer of a TF file: DataHeader, one TfIndexElem per (Sub)TimeFrame, and a Trailer at the
+/// end of the file. The Trailer is used to locate the footer.
+struct SubTimeFrameFileTfIndex {
+  static const o2::header::DataDescription sDataDescFileTfIndex;
+  static constexpr std::uint64_t sTrailerMagic = 0x3158444946544444ULL; // "DDTFIDX1"
+
+  struct TfIndexElem {
+    std::uint64_t mTfId = 0;
+    /// Offset of the SubTimeFrameFileMeta header in the file
+    std::uint64_t mOffset = 0;
+    /// Size of the (Sub)TimeFrame in file
+    std::uint64_t mSize = 0;
+    std::uint32_t mFirstOrbit = 0;
+    std::uint32_t mReserved = 0;
+  };
+
+  struct Trailer {
+    /// Size of the footer, including the DataHeader and this trailer
+    std::uint64_t mFooterSize = 0;
+    std::uint64_t mMagic = sTrailerMagic;
+  };
+
+  static_assert(sizeof(TfIndexElem) == 32, "TfIndexElem changed -> Binary compatibility is lost!");
+  static_assert(sizeof(Trailer) == 16, "TfIndex Trailer changed -> Binary compatibility is lost!");
+
+  void clear() noexcept { mTfIndex.clear(); }
+  bool empty() const noexcept { return mTfIndex.empty(); }
+
+  void AddTfElement(const std::uint64_t pTfId, const std::uint64_t pOffset, const std::uint64_t pSize,
+                    const std::uint32_t pFirstOrbit)
+  {
+    mTfIndex.push_back(TfIndexElem{ pTfId, pOffset, pSize, pFirstOrbit, 0 });
+  }
+
+  std::uint64_t getSizeInFile() const
+  {
+    return sizeof(o2::header::DataHeader) + (sizeof(TfIndexElem) * mTfIndex.size()) + sizeof(Trailer);
+  }
+
+  friend std::ostream& operator<<(std::ostream& pStream, const SubTimeFrameFileTfIndex& pIndex);
+
+ private:
+  const o2::header::DataHeader getDataHeader() const
+  {
+    auto lHdr = o2::header::DataHeader(
+      sDataDescFileTfIndex,
+      o2::header::gDataOriginAny,
+      0,
+      mTfIndex.size() * sizeof(TfIndexElem) + sizeof(Trailer));
+
+    lHdr.payloadSerializationMethod = o2::header::gSerializationMethodNone;
+
+    return lHdr;
+  }
+
+  std::vector<TfIndexElem> mTfIndex;
+};
+
+std::ostream& operator<<(std::ostream& pStream, const SubTimeFrameFileTfIndex& pIndex);
+
+////////////////////////////////////////////////////////////////////////////////
+/// SubTimeFrameFileSidecar
+////////////////////////////////////////////////////////////////////////////////
+
+/// Binary sidecar file (<data file>.info.bin): FileHeader followed by one Record per data block.
+/// RDH fields are not stored, they are read from the data file when converting to the text format.
+struct SubTimeFrameFileSidecar {
+  static constexpr std::uint64_t sMagic = 0x5241434544495344ULL; // "DSIDECAR"
+  static constexpr std::uint32_t sVersion = 1;
+
+  struct FileHeader {
+    std::uint64_t mMagic = sMagic;
+    std::uint32_t mVersion = sVersion;
+    std::uint32_t mRecordSize = 0;
+  };
+
+  struct Record {
+    std::uint64_t mTfId;
+    std::uint64_t mTfOffset;
+    std::uint64_t mTfSize;
+    std::uint64_t mHdrOffset;
+    std::uint64_t mDataOffset;
+    std::uint64_t mDataSize;
+    o2::header::DataDescription mDataDescription;
+    o2::header::DataOrigin mDataOrigin;
+    o2::header::DataHeader::SubSpecificationType mSubSpecification;
+    std::uint32_t mDataIndex;
+    std::uint32_t mHdrSize;
+  };
+
+  static_assert(sizeof(FileHeader) == 16, "Sidecar FileHeader changed -> Binary compatibility is lost!");
+  static_assert(sizeof(Record) == 80, "Sidecar Record changed -> Binary compatibility is lost!");
+};
+
 }
 } /* o2::DataDistribution */
 
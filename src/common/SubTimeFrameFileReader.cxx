@@ -16,6 +16,17 @@
 #include "SubTimeFrameBuilder.h"
 
 #include "DataDistLogger.h"
+#include "Crc32c.h"
+
+#include "MemoryUtils.h"
+
+#include <cstring>
+#include <tuple>
+#include <chrono>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #if __linux__
 #include <sys/mman.h>
@@ -28,11 +39,125 @@ namespace DataDistribution
 
 using namespace o2::header;
 
+////////////////////////////////////////////////////////////////////////////////
+/// StfFileRegion
+////////////////////////////////////////////////////////////////////////////////
+
+std::mutex StfFileRegion::sRetiredLock;
+std::vector<StfFileRegion*> StfFileRegion::sRetired;
+
+std::shared_ptr<StfFileRegion> StfFileRegion::make(FairMQTransportFactory &pShmTrans, const std::string &pFileName)
+{
+  // messages can outlive the last reference: destroy in collect()
+  return std::shared_ptr<StfFileRegion>(new StfFileRegion(pShmTrans, pFileName), [](StfFileRegion *pRegion) {
+    std::scoped_lock lLock(sRetiredLock);
+    sRetired.push_back(pRegion);
+  });
+}
+
+void StfFileRegion::collect(const bool pWait)
+{
+  using namespace std::chrono_literals;
+  const auto lStart = std::chrono::steady_clock::now();
+
+  while (true) {
+    {
+      std::scoped_lock lLock(sRetiredLock);
+      auto lIdleIt = std::partition(sRetired.begin(), sRetired.end(),
+        [](const StfFileRegion *pRegion) { return pRegion->mInFlight > 0; });
+      std::for_each(lIdleIt, sRetired.end(), [](StfFileRegion *pRegion) { delete pRegion; });
+      sRetired.erase(lIdleIt, sRetired.end());
+
+      if (sRetired.empty() || !pWait) {
+        return;
+      }
+      if (std::chrono::steady_clock::now() - lStart > 5s) {
+        WDDLOG("StfFileRegion: file regions still in use, not destroyed. count={}", sRetired.size());
+        return;
+      }
+    }
+    std::this_thread::sleep_for(10ms);
+  }
+}
+
+StfFileRegion::StfFileRegion(FairMQTransportFactory &pShmTrans, const std::string &pFileName)
+  : mTransport(pShmTrans)
+{
+  mSize = boost::filesystem::file_size(pFileName);
+
+  const int lFd = ::open(pFileName.c_str(), O_RDONLY | O_CLOEXEC);
+  if (lFd < 0) {
+    EDDLOG("StfFileRegion: cannot open the file. file={} error={}", pFileName, std::strerror(errno));
+    throw std::runtime_error("StfFileRegion: open failed");
+  }
+
+  // place the region on hugetlbfs if configured
+  std::string lSegmentRoot;
+  const auto lHugetlbfsPath = std::getenv(ENV_SHM_PATH);
+  if (lHugetlbfsPath && boost::filesystem::is_directory(lHugetlbfsPath)) {
+    lSegmentRoot = lHugetlbfsPath;
+    lSegmentRoot += boost::filesystem::path::preferred_separator;
+  }
+
+  mRegion = pShmTrans.CreateUnmanagedRegion(
+    std::max(mSize, std::size_t(1)),
+    0,
+    [this](const std::vector<FairMQRegionBlock>& pBlkVect) {
+      mInFlight -= pBlkVect.size();
+    },
+    lSegmentRoot.c_str(),
+    0,
+    fair::mq::RegionConfig(false /*mlock*/, false /*bzero*/)
+  );
+
+  if (!mRegion) {
+    ::close(lFd);
+    EDDLOG("StfFileRegion: creation of the file region failed. file={} size={}", pFileName, mSize);
+    throw std::bad_alloc();
+  }
+
+  // the only copy: the file is loaded into the region once
+  char *lData = static_cast<char*>(mRegion->GetData());
+  std::size_t lRead = 0;
+  while (lRead < mSize) {
+    const ssize_t lRet = ::pread(lFd, lData + lRead, mSize - lRead, lRead);
+    if (lRet < 0 && errno == EINTR) {
+      continue;
+    }
+    if (lRet <= 0) {
+      ::close(lFd);
+      EDDLOG("StfFileRegion: reading the file failed. file={} error={}", pFileName, std::strerror(errno));
+      throw std::runtime_error("StfFileRegion: read failed");
+    }
+    lRead += std::size_t(lRet);
+  }
+  ::close(lFd);
+
+  DDDLOG("StfFileRegion: file loaded into region. file={} size={} path={}", pFileName, mSize, lSegmentRoot);
+}
+
+StfFileRegion::~StfFileRegion()
+{
+  assert (mInFlight == 0);
+  mRegion.reset();
+}
+
+FairMQMessagePtr StfFileRegion::newMessage(const std::uint64_t pOffset, const std::size_t pSize)
+{
+  assert (pOffset + pSize <= mSize);
+
+  mInFlight++;
+  return mTransport.CreateMessage(mRegion, static_cast<char*>(mRegion->GetData()) + pOffset, pSize);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /// SubTimeFrameFileReader
 ////////////////////////////////////////////////////////////////////////////////
 
-SubTimeFrameFileReader::SubTimeFrameFileReader(boost::filesystem::path& pFileName)
+SubTimeFrameFileReader::SubTimeFrameFileReader(boost::filesystem::path& pFileName, const StfFileReadFilter &pFilter,
+  std::shared_ptr<StfFileRegion> pRegion)
+  : mFilter(pFilter),
+    mRegion(std::move(pRegion))
 {
   mFileName = pFileName.string();
   mFileMap.open(mFileName);
@@ -43,10 +168,15 @@ SubTimeFrameFileReader::SubTimeFrameFileReader(boost::filesystem::path& pFileNam
 
   mFileSize = mFileMap.size();
   mFileMapOffset = 0;
+  mDataEnd = mFileSize;
 
 #if __linux__
-  madvise((void*)mFileMap.data(), mFileMap.size(), MADV_HUGEPAGE | MADV_SEQUENTIAL | MADV_DONTDUMP);
+  // selective reads: do not read ahead the data that is skipped
+  madvise((void*)mFileMap.data(), mFileMap.size(),
+    (mFilter.empty() ? (MADV_HUGEPAGE | MADV_SEQUENTIAL) : MADV_RANDOM) | MADV_DONTDUMP);
 #endif
+
+  readTfIndexFooter();
 }
 
 SubTimeFrameFileReader::~SubTimeFrameFileReader()
@@ -59,6 +189,120 @@ SubTimeFrameFileReader::~SubTimeFrameFileReader()
   }
 }
 
+bool SubTimeFrameFileReader::readTfIndexFooter()
+{
+  using TfIndexElem = SubTimeFrameFileTfIndex::TfIndexElem;
+  using Trailer = SubTimeFrameFileTfIndex::Trailer;
+
+  if (mFileSize < (sizeof(DataHeader) + sizeof(Trailer))) {
+    return false;
+  }
+
+  Trailer lTrailer;
+  std::memcpy(&lTrailer, mFileMap.data() + mFileSize - sizeof(Trailer), sizeof(Trailer));
+  if (lTrailer.mMagic != SubTimeFrameFileTfIndex::sTrailerMagic) {
+    return false; // files without the footer
+  }
+
+  if (lTrailer.mFooterSize < (sizeof(DataHeader) + sizeof(Trailer)) || lTrailer.mFooterSize > mFileSize) {
+    WDDLOG("FileReader: invalid TF-ID index footer. footer_size={} file={}", lTrailer.mFooterSize, mFileName);
+    return false;
+  }
+
+  const std::uint64_t lFooterPos = mFileSize - lTrailer.mFooterSize;
+  DataHeader lHdr;
+  std::memcpy(&lHdr, mFileMap.data() + lFooterPos, sizeof(DataHeader));
+
+  const std::uint64_t lIndexSize = lTrailer.mFooterSize - sizeof(DataHeader) - sizeof(Trailer);
+  if (!(lHdr.dataDescription == SubTimeFrameFileTfIndex::sDataDescFileTfIndex) ||
+    (lHdr.payloadSize != (lIndexSize + sizeof(Trailer))) || (lIndexSize % sizeof(TfIndexElem)) != 0) {
+    WDDLOG("FileReader: invalid TF-ID index footer header. file={}", mFileName);
+    return false;
+  }
+
+  mTfIndex.resize(lIndexSize / sizeof(TfIndexElem));
+  std::memcpy(mTfIndex.data(), mFileMap.data() + lFooterPos + sizeof(DataHeader), lIndexSize);
+
+  mDataEnd = lFooterPos;
+  mTfIndexFooter = true;
+  mTfIndexValid = true;
+  return true;
+}
+
+void SubTimeFrameFileReader::scanTfIndex()
+{
+  // files without the footer: read only the headers of every TF
+  const auto lPosition = position();
+  mTfIndex.clear();
+
+  std::uint64_t lTfPos = 0;
+  while (mFileMap.is_open() && (lTfPos < mDataEnd)) {
+    set_position(lTfPos);
+
+    std::size_t lMetaHdrStackSize = 0;
+    SubTimeFrameFileMeta lStfFileMeta;
+    auto lMetaHdrStack = getHeaderStack(lMetaHdrStackSize);
+    const DataHeader *lMetaHdr = (lMetaHdrStackSize > 0) ? DataHeader::Get(lMetaHdrStack.first()) : nullptr;
+
+    if (!lMetaHdr || !(lMetaHdr->dataDescription == SubTimeFrameFileMeta::sDataDescFileSubTimeFrame) ||
+      !read_advance(&lStfFileMeta, sizeof(SubTimeFrameFileMeta)) || !lStfFileMeta.isVersionSupported() ||
+      (lStfFileMeta.mStfSizeInFile == 0) || ((lTfPos + lStfFileMeta.mStfSizeInFile) > mDataEnd)) {
+      WDDLOG("FileReader: TF-ID index scan stopped. pos={} file={}", lTfPos, mFileName);
+      break;
+    }
+
+    SubTimeFrameFileTfIndex::TfIndexElem lElem;
+    lElem.mOffset = lTfPos;
+    lElem.mSize = lStfFileMeta.mStfSizeInFile;
+
+    // TF id and first orbit from the first data header (after the STF data index), as in the footer
+    std::size_t lIndexHdrStackSize = 0;
+    auto lIndexHdrStack = getHeaderStack(lIndexHdrStackSize);
+    const DataHeader *lIndexHdr = (lIndexHdrStackSize > 0) ? DataHeader::Get(lIndexHdrStack.first()) : nullptr;
+
+    if (lIndexHdr && ignore_nbytes(lIndexHdr->payloadSize) && (position() < (lTfPos + lElem.mSize))) {
+      std::size_t lDataHdrStackSize = 0;
+      auto lDataHdrStack = getHeaderStack(lDataHdrStackSize);
+      const DataHeader *lDataHdr = (lDataHdrStackSize > 0) ? DataHeader::Get(lDataHdrStack.first()) : nullptr;
+      if (lDataHdr) {
+        lElem.mTfId = lDataHdr->tfCounter;
+        lElem.mFirstOrbit = lDataHdr->firstTForbit;
+      }
+    }
+
+    mTfIndex.push_back(lElem);
+    lTfPos += lElem.mSize;
+  }
+
+  mTfIndexValid = true;
+  if (mFileMap.is_open()) {
+    set_position(std::min(lPosition, mDataEnd));
+  }
+}
+
+const std::vector<SubTimeFrameFileTfIndex::TfIndexElem>& SubTimeFrameFileReader::tfIndex()
+{
+  if (!mTfIndexValid && mFileMap.is_open()) {
+    scanTfIndex();
+  }
+  return mTfIndex;
+}
+
+bool SubTimeFrameFileReader::seek(const std::uint64_t pTfId)
+{
+  const auto &lIndex = tfIndex();
+
+  const auto lIt = std::find_if(lIndex.cbegin(), lIndex.cend(),
+    [pTfId](const SubTimeFrameFileTfIndex::TfIndexElem &pElem) { return pElem.mTfId == pTfId; });
+
+  if (lIt == lIndex.cend() || !mFileMap.is_open()) {
+    return false;
+  }
+
+  set_position(lIt->mOffset);
+  return true;
+}
+
 void SubTimeFrameFileReader::visit(SubTimeFrame& pStf)
 {
   for (auto& lStfDataPair : mStfData) {
@@ -167,17 +411,179 @@ Stack SubTimeFrameFileReader::getHeaderStack(std::size_t &pOrigsize)
   return Stack(lStackMem);
 }
 
-std::uint64_t SubTimeFrameFileReader::sStfId = 0; // TODO: add id to files metadata
+bool SubTimeFrameFileReader::readDataBlock(SubTimeFrameFileBuilder &pFileBuilder, SubTimeFrame &pStf,
+  const std::uint32_t pBlockIdx, std::uint64_t &pBlockSize)
+{
+  // allocate and read the Headers
+  std::size_t lDataHeaderStackSize = 0;
+  Stack lDataHeaderStack = getHeaderStack(lDataHeaderStackSize);
+  if (lDataHeaderStackSize == 0) {
+    mFileMap.close();
+    return false;
+  }
+  const DataHeader *lDataHeader = o2::header::DataHeader::Get(lDataHeaderStack.first());
+  if (!lDataHeader) {
+    EDDLOG("Failed to read the TF HBF DataHeader structure. The file might be corrupted.");
+    mFileMap.close();
+    return false;
+  }
+
+  const std::uint64_t lDataSize = lDataHeader->payloadSize;
+  pBlockSize = lDataHeaderStackSize + lDataSize;
+
+  if (!mFilter.select(lDataHeader->dataOrigin, lDataHeader->subSpecification)) {
+    return ignore_nbytes(lDataSize);
+  }
+
+  auto lHdrStackMsg = pFileBuilder.newHeaderMessage(lDataHeaderStack);
+  if (!lHdrStackMsg) {
+    DDDLOG_RL(1000, "Header memory resource stopped. Exiting.");
+    mFileMap.close();
+    return false;
+  }
+
+  // read the data
+  FairMQMessagePtr lDataMsg;
+  const auto lDataPos = position();
+  if (mRegion && (mRegion->size() == mFileSize)) {
+    // zero-copy: reference the payload in the file region
+    if (!ignore_nbytes(lDataSize)) {
+      return false;
+    }
+    lDataMsg = mRegion->newMessage(lDataPos, lDataSize);
+  } else {
+    lDataMsg = pFileBuilder.newDataMessage(lDataSize);
+    if (!lDataMsg) {
+      IDDLOG("Data memory resource stopped. Exiting.");
+      mFileMap.close();
+      return false;
+    }
+    if (!read_advance(lDataMsg->GetData(), lDataSize) ) {
+      return false;
+    }
+  }
+
+  // verify the data in the file mapping
+  if (mVerifyChecksums && mChecksums) {
+    std::uint32_t lCrc = 0;
+    if (pBlockIdx >= mNumChecksums) {
+      EDDLOG_RL(1000, "FileReader: checksum table does not match the data. file={}", mFileName);
+      mChecksumError = true;
+      return false;
+    }
+    std::memcpy(&lCrc, mChecksums + std::size_t(pBlockIdx) * sizeof(std::uint32_t), sizeof(std::uint32_t));
+
+    if (lCrc != Crc32c::compute(mFileMap.data() + lDataPos, lDataSize)) {
+      EDDLOG_RL(1000, "FileReader: data block checksum error. Skipping the TF. file={} offset={} origin={} "
+        "subspec={:#06x}", mFileName, lDataPos, lDataHeader->dataOrigin.str, lDataHeader->subSpecification);
+      mChecksumError = true;
+      return false;
+    }
+  }
+
+  // Try to figure out the first orbit
+  try {
+    const auto lHdr = reinterpret_cast<DataHeader*>(lDataHeaderStack.data());
+
+    if (lHdr && lHdr->firstTForbit != 0) {
+      pStf.updateFirstOrbit(lHdr->firstTForbit);
+    } else if (lHdr && lHdr->dataDescription == o2::header::gDataDescriptionRawData) {
+      const auto R = RDHReader(lDataMsg);
+      pStf.updateFirstOrbit(R.getOrbit());
+    }
+  } catch (...) {
+    EDDLOG("Error getting RDHReader instace. Not setting firstOrbit for file data");
+  }
+
+  mStfData.emplace_back(std::move(lHdrStackMsg), std::move(lDataMsg));
+  return true;
+}
+
+bool SubTimeFrameFileReader::readIndexedBlocks(SubTimeFrameFileBuilder &pFileBuilder, SubTimeFrame &pStf,
+  const std::uint64_t pIndexPos, const std::uint64_t pIndexSize, const std::uint64_t pDataPos,
+  const std::uint64_t pDataSize, bool &pError)
+{
+  using DataIndexElem = SubTimeFrameFileDataIndex::DataIndexElem;
+  pError = false;
+
+  if (pIndexSize == 0 || (pIndexSize % sizeof(DataIndexElem)) != 0) {
+    return false;
+  }
+
+  // <offset, block count, size, index of the first block> of the selected equipment
+  std::vector<std::tuple<std::uint64_t, std::uint32_t, std::uint64_t, std::uint32_t>> lSelected;
+  std::uint32_t lNumBlocks = 0;
+
+  const char *lIndexMem = mFileMap.data() + pIndexPos;
+  for (std::uint64_t lOff = 0; lOff < pIndexSize; lOff += sizeof(DataIndexElem)) {
+    // the index is not aligned in the file
+    alignas(DataIndexElem) char lElemMem[sizeof(DataIndexElem)];
+    std::memcpy(lElemMem, lIndexMem + lOff, sizeof(DataIndexElem));
+    const auto &lElem = *reinterpret_cast<const DataIndexElem*>(lElemMem);
+
+    if ((lElem.mOffset + lElem.mSize) > pDataSize) {
+      return false;
+    }
+    if (mFilter.select(lElem.mDataOrigin, lElem.mSubSpecification)) {
+      lSelected.emplace_back(lElem.mOffset, lElem.mDataBlockCnt, lElem.mSize, lNumBlocks);
+    }
+    lNumBlocks += lElem.mDataBlockCnt;
+  }
+
+  for (const auto &[lOffset, lCnt, lSize, lFirstBlock] : lSelected) {
+    set_position(pDataPos + lOffset);
+
+    std::uint64_t lReadSize = 0;
+    for (std::uint32_t i = 0; i < lCnt; i++) {
+      std::uint64_t lBlockSize = 0;
+      if (!readDataBlock(pFileBuilder, pStf, lFirstBlock + i, lBlockSize)) {
+        pError = true;
+        return false;
+      }
+      lReadSize += lBlockSize;
+    }
+
+    if (lReadSize != lSize) {
+      EDDLOG("FileReader: TF index does not match the data. The file might be corrupted. file={}", mFileName);
+      pError = true;
+      return false;
+    }
+  }
+
+  // skip the rest of the TF
+  set_position(pDataPos + pDataSize);
+  return true;
+}
+
+std::atomic_uint64_t SubTimeFrameFileReader::sStfId = 0; // TODO: add id to files metadata
 
 std::unique_ptr<SubTimeFrame> SubTimeFrameFileReader::read(SubTimeFrameFileBuilder &pFileBuilder)
+{
+  while (true) {
+    mChecksumError = false;
+    auto lStf = readStf(pFileBuilder);
+    if (lStf || !mChecksumError || !mFileMap.is_open()) {
+      return lStf;
+    }
+
+    // skip the corrupted TF
+    mChecksumErrors++;
+    mStfData.clear();
+    set_position(mTfEnd);
+  }
+}
+
+std::unique_ptr<SubTimeFrame> SubTimeFrameFileReader::readStf(SubTimeFrameFileBuilder &pFileBuilder)
 {
   // make sure headers and chunk pointers don't linger
   mStfData.clear();
+  mChecksums = nullptr;
+  mNumChecksums = 0;
 
   // record current position
   const auto lTfStartPosition = position();
 
-  if (lTfStartPosition == size()) {
+  if (lTfStartPosition >= mDataEnd) {
     return nullptr;
   }
 
@@ -187,7 +593,7 @@ std::unique_ptr<SubTimeFrame> SubTimeFrameFileReader::read(SubTimeFrameFileBuild
   }
 
   // NOTE: StfID will be updated from the stf header
-  std::unique_ptr<SubTimeFrame> lStf = std::make_unique<SubTimeFrame>(sStfId++);
+  std::unique_ptr<SubTimeFrame> lStf = SubTimeFramePool::get(sStfId++);
 
   std::size_t lMetaHdrStackSize = 0;
   const DataHeader *lStfMetaDataHdr = nullptr;
@@ -207,6 +613,12 @@ std::unique_ptr<SubTimeFrame> SubTimeFrameFileReader::read(SubTimeFrameFileBuild
     return nullptr;
   }
 
+  // TF-ID index footer: no more TFs
+  if (lStfMetaDataHdr->dataDescription == SubTimeFrameFileTfIndex::sDataDescFileTfIndex) {
+    set_position(size());
+    return nullptr;
+  }
+
   // verify we're actually reading the correct data in
   if (!(SubTimeFrameFileMeta::getDataHeader().dataDescription == lStfMetaDataHdr->dataDescription)) {
     WDDLOG("Reading bad data: SubTimeFrame META header");
@@ -214,6 +626,13 @@ std::unique_ptr<SubTimeFrame> SubTimeFrameFileReader::read(SubTimeFrameFileBuild
     return nullptr;
   }
 
+  if (!lStfFileMeta.isVersionSupported()) {
+    EDDLOG("Unsupported TF file version. version={} latest_supported={} file={}", lStfFileMeta.mStfFileVersion,
+      SubTimeFrameFileMeta::sVersionLatest, mFileName);
+    mFileMap.close();
+    return nullptr;
+  }
+
   // prepare to read the TF data
   const auto lStfSizeInFile = lStfFileMeta.mStfSizeInFile;
   if (lStfSizeInFile == (sizeof(DataHeader) + sizeof(SubTimeFrameFileMeta))) {
@@ -223,15 +642,16 @@ std::unique_ptr<SubTimeFrame> SubTimeFrameFileReader::read(SubTimeFrameFileBuild
   }
 
   // check there's enough data in the file
-  if ((lTfStartPosition + lStfSizeInFile) > this->size()) {
+  if ((lTfStartPosition + lStfSizeInFile) > mDataEnd) {
     WDDLOG_RL(200, "Not enough data in file for this TF. Required: {}, available: {}",
-      lStfSizeInFile, (this->size() - lTfStartPosition));
+      lStfSizeInFile, (mDataEnd - lTfStartPosition));
     mFileMap.close();
     return nullptr;
   }
+  mTfEnd = lTfStartPosition + lStfSizeInFile;
 
   // Index
-  // TODO: skip the index for now, check in future all data is there
+  // Index: only used for selective reads (see StfFileReadFilter)
   std::size_t lStfIndexHdrStackSize = 0;
   const DataHeader *lStfIndexHdr = nullptr;
 
@@ -247,10 +667,22 @@ std::unique_ptr<SubTimeFrame> SubTimeFrameFileReader::read(SubTimeFrameFileBuild
     return nullptr;
   }
 
+  const auto lStfIndexPosition = position();
   if (!ignore_nbytes(lStfIndexHdr->payloadSize)) {
     return nullptr;
   }
 
+  // the index elements are followed by the checksum table (version 2)
+  std::uint64_t lStfIndexSize = lStfIndexHdr->payloadSize;
+  if (lStfFileMeta.mStfFileVersion >= SubTimeFrameFileMeta::sVersionChecksums) {
+    if (!SubTimeFrameFileDataIndex::getChecksumTable(mFileMap.data() + lStfIndexPosition, lStfIndexHdr->payloadSize,
+      lStfIndexSize, mChecksums, mNumChecksums)) {
+      EDDLOG("Failed to read the TF checksum table. The file might be corrupted. file={}", mFileName);
+      mFileMap.close();
+      return nullptr;
+    }
+  }
+
   // Remaining data size of the TF:
   // total size in file - meta (hdr+struct) - index (hdr + payload)
   const auto lStfDataSize = lStfSizeInFile - (lMetaHdrStackSize + sizeof(SubTimeFrameFileMeta))
@@ -259,61 +691,33 @@ std::unique_ptr<SubTimeFrame> SubTimeFrameFileReader::read(SubTimeFrameFileBuild
   // read all data blocks and headers
   assert(mStfData.empty());
 
-  std::int64_t lLeftToRead = lStfDataSize;
-
-  // read <hdrStack + data> pairs
-  while (lLeftToRead > 0) {
-
-    // allocate and read the Headers
-    std::size_t lDataHeaderStackSize = 0;
-    Stack lDataHeaderStack = getHeaderStack(lDataHeaderStackSize);
-    if (lDataHeaderStackSize == 0) {
-      mFileMap.close();
-      return nullptr;
-    }
-    const DataHeader *lDataHeader = o2::header::DataHeader::Get(lDataHeaderStack.first());
-    if (!lDataHeader) {
-      EDDLOG("Failed to read the TF HBF DataHeader structure. The file might be corrupted.");
-      mFileMap.close();
-      return nullptr;
+  // selected data only: use the index to skip everything else
+  if (!mFilter.empty()) {
+    bool lError = false;
+    if (readIndexedBlocks(pFileBuilder, *lStf, lStfIndexPosition, lStfIndexSize, position(),
+      lStfDataSize, lError)) {
+      lStf->accept(*this);
+      return lStf;
     }
-
-    auto lHdrStackMsg = pFileBuilder.newHeaderMessage(lDataHeaderStack, lStf->id());
-    if (!lHdrStackMsg) {
-      DDDLOG_RL(1000, "Header memory resource stopped. Exiting.");
-      mFileMap.close();
+    if (lError) {
       return nullptr;
     }
+    WDDLOG_RL(1000, "FileReader: TF index cannot be used, reading all data headers. file={}", mFileName);
+    mStfData.clear();
+  }
 
-    // read the data
-    const std::uint64_t lDataSize = lDataHeader->payloadSize;
+  std::int64_t lLeftToRead = lStfDataSize;
+  std::uint32_t lBlockIdx = 0;
 
-    auto lDataMsg = pFileBuilder.newDataMessage(lDataSize);
-    if (!lDataMsg) {
-      IDDLOG("Data memory resource stopped. Exiting.");
-      mFileMap.close();
-      return nullptr;
-    }
-    if (!read_advance(lDataMsg->GetData(), lDataSize) ) {
+  // read <hdrStack + data> pairs
+  while (lLeftToRead > 0) {
+    std::uint64_t lBlockSize = 0;
+    if (!readDataBlock(pFileBuilder, *lStf, lBlockIdx++, lBlockSize)) {
       return nullptr;
     }
 
-    // Try to figure out the first orbit
-    try {
-      const auto lHdr = reinterpret_cast<DataHeader*>(lDataHeaderStack.data());
-
-      if (lHdr && lHdr->firstTForbit == 0 && lHdr->dataDescription == o2::header::gDataDescriptionRawData) {
-        const auto R = RDHReader(lDataMsg);
-        lStf->updateFirstOrbit(R.getOrbit());
-      }
-    } catch (...) {
-      EDDLOG("Error getting RDHReader instace. Not setting firstOrbit for file data");
-    }
-
-    mStfData.emplace_back(std::move(lHdrStackMsg), std::move(lDataMsg));
-
     // update the counter
-    lLeftToRead -= (lDataHeaderStackSize + lDataSize);
+    lLeftToRead -= lBlockSize;
   }
 
   if (lLeftToRead < 0) {
@@ -15,13 +15,22 @@
 #define ALICEO2_SUBTIMEFRAME_FILE_READER_H_
 
 #include "SubTimeFrameDataModel.h"
+#include "SubTimeFrameFile.h"
 #include <Headers/DataHeader.h>
 #include <Headers/Stack.h>
 
 #include <boost/filesystem.hpp>
 #include <boost/iostreams/device/mapped_file.hpp>
+
+#include <fairmq/FairMQTransportFactory.h>
+#include <fairmq/FairMQUnmanagedRegion.h>
+
 #include <fstream>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 namespace o2
 {
@@ -30,6 +39,58 @@ namespace DataDistribution
 
 class SubTimeFrameFileBuilder;
 
+////////////////////////////////////////////////////////////////////////////////
+/// StfFileReadFilter
+////////////////////////////////////////////////////////////////////////////////
+
+/// Selection of data blocks to read, by data origin and subspecification (empty list: any)
+struct StfFileReadFilter {
+  std::vector<o2::header::DataOrigin> mOrigins;
+  std::vector<o2::header::DataHeader::SubSpecificationType> mSubSpecs;
+
+  bool empty() const { return mOrigins.empty() && mSubSpecs.empty(); }
+
+  bool select(const o2::header::DataOrigin &pOrigin, const o2::header::DataHeader::SubSpecificationType pSubSpec) const
+  {
+    return (mOrigins.empty() || std::find(mOrigins.cbegin(), mOrigins.cend(), pOrigin) != mOrigins.cend()) &&
+      (mSubSpecs.empty() || std::find(mSubSpecs.cbegin(), mSubSpecs.cend(), pSubSpec) != mSubSpecs.cend());
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// StfFileRegion
+////////////////////////////////////////////////////////////////////////////////
+
+/// Content of a TF file in a FairMQ unmanaged region (on hugetlbfs with DATADIST_SHM_PATH)
+///
+/// Payload messages reference the region directly, without copies. The region is destroyed only after
+/// the last reference is dropped and all messages are released by the transport (see collect()).
+class StfFileRegion
+{
+ public:
+  static std::shared_ptr<StfFileRegion> make(FairMQTransportFactory &pShmTrans, const std::string &pFileName);
+
+  /// destroy released regions which have no messages in use. pWait: wait for the messages (bounded)
+  static void collect(const bool pWait = false);
+
+  std::size_t size() const { return mSize; }
+
+  /// message referencing the file content at [pOffset, pOffset + pSize)
+  FairMQMessagePtr newMessage(const std::uint64_t pOffset, const std::size_t pSize);
+
+ private:
+  StfFileRegion(FairMQTransportFactory &pShmTrans, const std::string &pFileName);
+  ~StfFileRegion();
+
+  FairMQTransportFactory &mTransport;
+  FairMQUnmanagedRegionPtr mRegion;
+  std::size_t mSize = 0;
+  std::atomic_int64_t mInFlight = 0;
+
+  static std::mutex sRetiredLock;
+  static std::vector<StfFileRegion*> sRetired;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /// SubTimeFrameFileReader
 ////////////////////////////////////////////////////////////////////////////////
@@ -38,14 +99,32 @@ class SubTimeFrameFileReader : public ISubTimeFrameVisitor
 {
  public:
   SubTimeFrameFileReader() = delete;
-  SubTimeFrameFileReader(boost::filesystem::path& pFileName);
+  SubTimeFrameFileReader(boost::filesystem::path& pFileName, const StfFileReadFilter &pFilter = StfFileReadFilter(),
+    std::shared_ptr<StfFileRegion> pRegion = nullptr);
   ~SubTimeFrameFileReader();
 
   ///
-  /// Read a single TF from the file
+  /// Read a single TF from the file. TFs with checksum errors are skipped (see setVerifyChecksums())
   ///
   std::unique_ptr<SubTimeFrame> read(SubTimeFrameFileBuilder &pFileBuilder);
 
+  ///
+  /// Verify the CRC32C of the read data blocks (files with checksums)
+  ///
+  void setVerifyChecksums(const bool pVerify) { mVerifyChecksums = pVerify; }
+  std::uint64_t checksumErrors() const { return mChecksumErrors; }
+
+  ///
+  /// TF-ID seek index: from the file footer, or built by scanning the TF headers if the file has no footer
+  ///
+  const std::vector<SubTimeFrameFileTfIndex::TfIndexElem>& tfIndex();
+  bool hasTfIndexFooter() const { return mTfIndexFooter; }
+
+  ///
+  /// Position the file at the (Sub)TimeFrame with pTfId. Returns false if it is not in the file
+  ///
+  bool seek(const std::uint64_t pTfId);
+
   ///
   /// Tell the current position of the file
   ///
@@ -65,10 +144,10 @@ class SubTimeFrameFileReader : public ISubTimeFrameVisitor
   }
 
   ///
-  /// Is the stream position at EOF
+  /// Is the stream position at EOF (at the TF-ID index footer, if present)
   ///
   inline
-  bool eof() const { return mFileMapOffset == mFileSize; }
+  bool eof() const { return mFileMapOffset >= mDataEnd; }
 
   ///
   /// Tell the size of the file
@@ -80,9 +159,27 @@ class SubTimeFrameFileReader : public ISubTimeFrameVisitor
   void visit(SubTimeFrame& pStf) override;
 
   std::string mFileName;
+  StfFileReadFilter mFilter;
+  std::shared_ptr<StfFileRegion> mRegion; // zero-copy payloads
   boost::iostreams::mapped_file_source mFileMap;
   std::uint64_t mFileMapOffset = 0;
   std::uint64_t mFileSize = 0;
+  std::uint64_t mDataEnd = 0; // end of (Sub)TimeFrame data
+
+  // CRC32C table of the current TF
+  bool mVerifyChecksums = false;
+  bool mChecksumError = false;
+  std::uint64_t mChecksumErrors = 0;
+  const char *mChecksums = nullptr;
+  std::uint32_t mNumChecksums = 0;
+  std::uint64_t mTfEnd = 0;
+
+  // TF-ID seek index
+  bool mTfIndexFooter = false;
+  bool mTfIndexValid = false;
+  std::vector<SubTimeFrameFileTfIndex::TfIndexElem> mTfIndex;
+  bool readTfIndexFooter();
+  void scanTfIndex();
 
   // helper to make sure written chunks are buffered, only allow pointers
   template <typename pointer,
@@ -100,7 +197,7 @@ class SubTimeFrameFileReader : public ISubTimeFrameVisitor
       EDDLOG("FileReader: request to read beyond the file end. pos={} size={} len={}",
         mFileMapOffset, mFileSize, pLen);
       EDDLOG("Closing the file {}. The read data is invalid.", mFileName);
-      mFileMap.close(); mFileMapOffset = 0; mFileSize = 0;
+      mFileMap.close(); mFileMapOffset = 0; mFileSize = 0; mDataEnd = 0;
       return false;
     }
 
@@ -123,7 +220,7 @@ class SubTimeFrameFileReader : public ISubTimeFrameVisitor
       EDDLOG("FileReader: request to ignore bytes beyond the file end. pos={} size={} len={}",
         mFileMapOffset, mFileSize, pLen);
       EDDLOG("Closing the file {}. The read data is invalid.", mFileName);
-      mFileMap.close(); mFileMapOffset = 0; mFileSize = 0;
+      mFileMap.close(); mFileMapOffset = 0; mFileSize = 0; mDataEnd = 0;
       return false;
     }
 
@@ -135,11 +232,20 @@ class SubTimeFrameFileReader : public ISubTimeFrameVisitor
   std::size_t getHeaderStackSize();
   o2::header::Stack getHeaderStack(std::size_t &pOrigsize);
 
+  std::unique_ptr<SubTimeFrame> readStf(SubTimeFrameFileBuilder &pFileBuilder);
+
+  /// read one <header stack, data> block, or skip it if not selected by the filter. pBlockIdx: in file order
+  bool readDataBlock(SubTimeFrameFileBuilder &pFileBuilder, SubTimeFrame &pStf, const std::uint32_t pBlockIdx,
+    std::uint64_t &pBlockSize);
+  /// read only the selected equipment using the STF index. False if the index cannot be used
+  bool readIndexedBlocks(SubTimeFrameFileBuilder &pFileBuilder, SubTimeFrame &pStf, const std::uint64_t pIndexPos,
+    const std::uint64_t pIndexSize, const std::uint64_t pDataPos, const std::uint64_t pDataSize, bool &pError);
+
   // vector of <hdr, fmqMsg> elements of a tf read from the file
   std::vector<SubTimeFrame::StfData> mStfData;
 
   // flags for upgrading DataHeader versions
-  static std::uint64_t sStfId; // TODO: add id to files metadata
+  static std::atomic_uint64_t sStfId; // TODO: add id to files metadata
 
 };
 }
@@ -22,7 +22,9 @@
 #include <boost/program_options/options_description.hpp>
 #include <boost/filesystem.hpp>
 
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
 #include <ctime>
 #include <iostream>
 #include <iomanip>
@@ -40,17 +42,56 @@ void SubTimeFrameFileSink::start()
 {
   if (enabled()) {
     mRunning = true;
-    mSinkThread = create_thread_member("stf_sink", &SubTimeFrameFileSink::DataHandlerThread, this, 0);
+    mNextWriter = 0;
+    mNextSeqOut = 0;
+    mOrderedStfs.clear();
+    mWriteBehindSize = 0;
+    mWriteBehindCapHits = 0;
+    mWriteBehindSkipped = 0;
+
+    mWriters.clear();
+    for (unsigned lIdx = 0; lIdx < mNumWriters; lIdx++) {
+      mWriters.push_back(std::make_unique<StfSinkWriter>());
+    }
+
+    if (!useDispatcher()) {
+      mWriters[0]->mThread = create_thread_member("stf_sink", &SubTimeFrameFileSink::DataHandlerThread, this, 0);
+    } else {
+      for (unsigned lIdx = 0; lIdx < mNumWriters; lIdx++) {
+        char lThreadName[128];
+        std::snprintf(lThreadName, 127, "stf_sink_%u", lIdx);
+        lThreadName[127] = '\0'; // safety
+        mWriters[lIdx]->mStfQueue.start();
+        mWriters[lIdx]->mThread = create_thread_member(lThreadName, &SubTimeFrameFileSink::DataHandlerThread, this, lIdx);
+      }
+      mDispatchThread = create_thread_member("stf_sink_disp", &SubTimeFrameFileSink::StfDispatchThread, this);
+    }
   }
   DDDLOG("SubTimeFrameFileSink started");
 }
 
 void SubTimeFrameFileSink::stop()
 {
-  mRunning = false;
+  {
+    std::scoped_lock lLock(mWriteBehindLock, mWriterQueueLock);
+    mRunning = false;
+  }
+  mWriteBehindCond.notify_all();
+  mWriterQueueCond.notify_all();
 
-  if (mSinkThread.joinable()) {
-    mSinkThread.join();
+  if (mDispatchThread.joinable()) {
+    mDispatchThread.join();
+  }
+
+  for (auto &lWriter : mWriters) {
+    lWriter->mStfQueue.stop();
+    if (lWriter->mThread.joinable()) {
+      lWriter->mThread.join();
+    }
+  }
+
+  if (mWriteBehindSkipped > 0) {
+    WDDLOG("(Sub)TimeFrame file sink: write-behind memory limit reached. skipped_stfs={}", mWriteBehindSkipped);
   }
 }
 
@@ -68,7 +109,8 @@ bpo::options_description SubTimeFrameFileSink::getProgramOptions()
     "Note: A new directory will be created here for all output files.")(
     OptionKeyStfSinkFileName,
     bpo::value<std::string>()->default_value("run%r_tf%i.tf"),
-    "Specifies file name pattern: %n - file index, %r - run number, %i - starting (S)TF id, %D - date, %T - time.")(
+    "Specifies file name pattern: %n - file index, %w - writer index, %r - run number, %i - starting (S)TF id, "
+    "%D - date, %T - time.")(
     OptionKeyStfSinkStfsPerFile,
     bpo::value<std::uint64_t>()->default_value(1),
     "Specifies number of (Sub)TimeFrames per file. Default: 1")(
@@ -80,7 +122,43 @@ bpo::options_description SubTimeFrameFileSink::getProgramOptions()
     "Write a sidecar file for each (Sub)TimeFrame file containing information about data blocks "
     "written in the data file. "
     "Note: Useful for debugging. "
-    "Warning: sidecar file format is not stable.");
+    "Warning: sidecar file format is not stable.")(
+    OptionKeyStfSinkSidecarFormat,
+    bpo::value<std::string>()->default_value("text"),
+    "Specifies the sidecar file format: 'text' (formatted rows, written inline) or 'binary' (compact records "
+    "written by a separate thread; convert to text with StfSidecarConvert).")(
+    OptionKeyStfSinkWriteEngine,
+    bpo::value<std::string>()->default_value("stream"),
+    "Specifies the file write engine: 'stream' (buffered) or 'direct' (O_DIRECT with aligned staging buffers, "
+    "asynchronous writes with io_uring if available). The file format is the same.")(
+    OptionKeyStfSinkTfIndex,
+    bpo::bool_switch()->default_value(false),
+    "Append a footer with the TF-ID seek index (TF id, offset, size, first orbit) to each (Sub)TimeFrame file. "
+    "Note: readers without the footer support report bad data at the end of the file.")(
+    OptionKeyStfSinkChecksums,
+    bpo::bool_switch()->default_value(false),
+    "Store the CRC32C checksum of each data block in the (Sub)TimeFrame index (file version 2). "
+    "Note: readers without the checksum support cannot use the index for selective reads.")(
+    OptionKeyStfSinkWriters,
+    bpo::value<unsigned>()->default_value(1),
+    "Specifies number of parallel file writers. Each writer writes its own series of files. "
+    "Note: the writer index is added to the file name if the pattern does not contain %w.")(
+    OptionKeyStfSinkRelaxedOrder,
+    bpo::bool_switch()->default_value(false),
+    "Forward (Sub)TimeFrames as soon as they are written, instead of in the input order (multiple writers).")(
+    OptionKeyStfSinkWriteBehind,
+    bpo::bool_switch()->default_value(false),
+    "Forward (Sub)TimeFrames before they are written. Data is held (by reference) until the write completes.")(
+    OptionKeyStfSinkWriteBehindMemory,
+    bpo::value<std::uint64_t>()->default_value(std::uint64_t(4) << 10), /* 4GiB */
+    "Specifies the maximum size of (Sub)TimeFrame data held for writing in MiB (write-behind).")(
+    OptionKeyStfSinkWriteBehindPolicy,
+    bpo::value<std::string>()->default_value("block"),
+    "Specifies what to do when the write-behind memory limit is reached: 'block' (wait for writes to complete), "
+    "'skip' (do not write the (Sub)TimeFrame), or 'sample' (wait for every N-th (Sub)TimeFrame, skip the rest).")(
+    OptionKeyStfSinkWriteBehindSample,
+    bpo::value<std::uint64_t>()->default_value(10),
+    "Specifies N for the 'sample' write-behind policy.");
 
   return lSinkDesc;
 }
@@ -108,7 +186,51 @@ bool SubTimeFrameFileSink::loadVerifyConfig(const FairMQProgOptions& pFMQProgOpt
   mStfsPerFile = pFMQProgOpt.GetValue<std::uint64_t>(OptionKeyStfSinkStfsPerFile);
   mFileSize = std::max(std::uint64_t(1), pFMQProgOpt.GetValue<std::uint64_t>(OptionKeyStfSinkFileSize));
   mFileSize <<= 20; /* in MiB */
-  mSidecar = pFMQProgOpt.GetValue<bool>(OptionKeyStfSinkSidecar);
+  const auto lSidecarFormat = pFMQProgOpt.GetValue<std::string>(OptionKeyStfSinkSidecarFormat);
+  if (!pFMQProgOpt.GetValue<bool>(OptionKeyStfSinkSidecar)) {
+    mSidecar = SubTimeFrameFileWriter::SidecarFormat::None;
+  } else if (lSidecarFormat == "text") {
+    mSidecar = SubTimeFrameFileWriter::SidecarFormat::Text;
+  } else if (lSidecarFormat == "binary") {
+    mSidecar = SubTimeFrameFileWriter::SidecarFormat::Binary;
+  } else {
+    EDDLOG("(Sub)TimeFrame file sink: unknown sidecar format. {}={}", OptionKeyStfSinkSidecarFormat, lSidecarFormat);
+    return false;
+  }
+
+  mNumWriters = std::clamp(pFMQProgOpt.GetValue<unsigned>(OptionKeyStfSinkWriters), 1u, 64u);
+  mRelaxedOrder = pFMQProgOpt.GetValue<bool>(OptionKeyStfSinkRelaxedOrder);
+
+  mWriteBehind = pFMQProgOpt.GetValue<bool>(OptionKeyStfSinkWriteBehind);
+  mWriteBehindMax = std::max(std::uint64_t(1), pFMQProgOpt.GetValue<std::uint64_t>(OptionKeyStfSinkWriteBehindMemory));
+  mWriteBehindMax <<= 20; /* in MiB */
+  mWriteBehindSample = std::max(std::uint64_t(1), pFMQProgOpt.GetValue<std::uint64_t>(OptionKeyStfSinkWriteBehindSample));
+
+  const auto lWriteBehindPolicy = pFMQProgOpt.GetValue<std::string>(OptionKeyStfSinkWriteBehindPolicy);
+  if (lWriteBehindPolicy == "block") {
+    mWriteBehindPolicy = eBlock;
+  } else if (lWriteBehindPolicy == "skip") {
+    mWriteBehindPolicy = eSkip;
+  } else if (lWriteBehindPolicy == "sample") {
+    mWriteBehindPolicy = eSample;
+  } else {
+    EDDLOG("(Sub)TimeFrame file sink: unknown write-behind policy. {}={}", OptionKeyStfSinkWriteBehindPolicy,
+      lWriteBehindPolicy);
+    return false;
+  }
+
+  mTfIndex = pFMQProgOpt.GetValue<bool>(OptionKeyStfSinkTfIndex);
+  mChecksums = pFMQProgOpt.GetValue<bool>(OptionKeyStfSinkChecksums);
+
+  const auto lWriteEngine = pFMQProgOpt.GetValue<std::string>(OptionKeyStfSinkWriteEngine);
+  if (lWriteEngine == "stream") {
+    mWriteEngine = SubTimeFrameFileWriter::WriteEngine::Stream;
+  } else if (lWriteEngine == "direct") {
+    mWriteEngine = SubTimeFrameFileWriter::WriteEngine::Direct;
+  } else {
+    EDDLOG("(Sub)TimeFrame file sink: unknown write engine. {}={}", OptionKeyStfSinkWriteEngine, lWriteEngine);
+    return false;
+  }
 
   // make sure directory exists and it is writable
   namespace bfs = boost::filesystem;
@@ -126,7 +248,15 @@ bool SubTimeFrameFileSink::loadVerifyConfig(const FairMQProgOptions& pFMQProgOpt
   IDDLOG("(Sub)TimeFrame Sink :: file pattern  = {:s}", mFileNamePattern);
   IDDLOG("(Sub)TimeFrame Sink :: stfs per file = {:s}", (mStfsPerFile > 0 ? std::to_string(mStfsPerFile) : "unlimited" ));
   IDDLOG("(Sub)TimeFrame Sink :: max file size = {:d}", mFileSize);
-  IDDLOG("(Sub)TimeFrame Sink :: sidecar files = {:s}", (mSidecar ? "yes" : "no"));
+  IDDLOG("(Sub)TimeFrame Sink :: sidecar files = {:s}",
+    (mSidecar != SubTimeFrameFileWriter::SidecarFormat::None ? ("yes (" + lSidecarFormat + ")") : std::string("no")));
+  IDDLOG("(Sub)TimeFrame Sink :: write engine  = {:s}", lWriteEngine);
+  IDDLOG("(Sub)TimeFrame Sink :: tf-id index   = {:s}", (mTfIndex ? "yes" : "no"));
+  IDDLOG("(Sub)TimeFrame Sink :: checksums     = {:s}", (mChecksums ? "yes" : "no"));
+  IDDLOG("(Sub)TimeFrame Sink :: writers       = {:d}", mNumWriters);
+  IDDLOG("(Sub)TimeFrame Sink :: output order  = {:s}", (mRelaxedOrder ? "relaxed" : "input"));
+  IDDLOG("(Sub)TimeFrame Sink :: write-behind  = {:s}", (mWriteBehind ?
+    fmt::format("yes (max={} MiB, policy={})", mWriteBehindMax >> 20, lWriteBehindPolicy) : std::string("no")));
   return mEnabled;
 }
 
@@ -154,7 +284,8 @@ bool SubTimeFrameFileSink::makeDirectory()
   return true;
 }
 
-std::string SubTimeFrameFileSink::newStfFileName(const std::uint64_t pStfId) const
+std::string SubTimeFrameFileSink::newStfFileName(const std::uint64_t pStfId, const unsigned pWriterIdx,
+  const unsigned pFileIdx) const
 {
   time_t lNow;
   time(&lNow);
@@ -162,9 +293,19 @@ std::string SubTimeFrameFileSink::newStfFileName(const std::uint64_t pStfId) con
 
   std::string lFileName = mFileNamePattern;
 
+  // writer index: keep the file series of parallel writers apart
+  if (mNumWriters > 1 && lFileName.find("%w") == std::string::npos) {
+    namespace bfs = boost::filesystem;
+    const bfs::path lPath(lFileName);
+    lFileName = lPath.stem().string() + "_w%w" + lPath.extension().string();
+  }
+  std::stringstream lWriterIdxString;
+  lWriterIdxString << std::dec << std::setw(2) << std::setfill('0') << pWriterIdx;
+  boost::replace_all(lFileName, "%w", lWriterIdxString.str());
+
   // file index
   std::stringstream lIdxString;
-  lIdxString << std::dec << std::setw(8) << std::setfill('0') << mCurrentFileIdx;
+  lIdxString << std::dec << std::setw(8) << std::setfill('0') << pFileIdx;
   boost::replace_all(lFileName, "%n", lIdxString.str());
 
   // run id
@@ -189,72 +330,226 @@ std::string SubTimeFrameFileSink::newStfFileName(const std::uint64_t pStfId) con
   return lFileName;
 }
 
-/// File writing thread
-void SubTimeFrameFileSink::DataHandlerThread(const unsigned pIdx)
+bool SubTimeFrameFileSink::writeStf(const unsigned pWriterIdx, SubTimeFrame &pStf)
+{
+  auto &lWriter = *mWriters[pWriterIdx];
+
+  // make sure Stf is updated before writing
+  pStf.updateStf();
+
+  // check if we need a writer
+  if (!lWriter.mStfWriter) {
+    lWriter.mCurrentFileName = newStfFileName(pStf.id(), pWriterIdx, mCurrentFileIdx++);
+    namespace bfs = boost::filesystem;
+
+    try {
+      lWriter.mStfWriter = std::make_unique<SubTimeFrameFileWriter>(
+        bfs::path(mCurrentDir) / bfs::path(lWriter.mCurrentFileName), mSidecar, mWriteEngine, mTfIndex, mChecksums);
+    } catch (...) {
+      return false;
+    }
+  }
+
+  // write
+  if (lWriter.mStfWriter->write(pStf)) {
+    lWriter.mCurrentFileStfs++;
+    lWriter.mCurrentFileSize = lWriter.mStfWriter->size();
+  } else {
+    lWriter.mStfWriter.reset();
+    return false;
+  }
+
+  // check if we should rotate the file
+  if (((mStfsPerFile > 0) && (lWriter.mCurrentFileStfs >= mStfsPerFile)) || (lWriter.mCurrentFileSize >= mFileSize)) {
+    lWriter.mCurrentFileStfs = 0;
+    lWriter.mCurrentFileSize = 0;
+    lWriter.mStfWriter.reset();
+  }
+  return true;
+}
+
+bool SubTimeFrameFileSink::reserveWriteBehind(const std::uint64_t pSize)
+{
+  std::unique_lock lLock(mWriteBehindLock);
+
+  // always allow one STF, even if larger than the limit
+  const auto lFits = [&]() { return (mWriteBehindSize == 0) || (mWriteBehindSize + pSize <= mWriteBehindMax); };
+
+  if (!lFits()) {
+    mWriteBehindCapHits++;
+    const bool lWait = (mWriteBehindPolicy == eBlock) ||
+      ((mWriteBehindPolicy == eSample) && (mWriteBehindCapHits % mWriteBehindSample == 0));
+    if (!lWait) {
+      mWriteBehindSkipped++;
+      WDDLOG_RL(5000, "(Sub)TimeFrame file sink: write-behind memory limit reached, not writing. skipped_stfs={}",
+        mWriteBehindSkipped);
+      return false;
+    }
+
+    mWriteBehindCond.wait(lLock, [&]() { return !mRunning || lFits(); });
+    if (!mRunning) {
+      return false;
+    }
+  }
+
+  mWriteBehindSize += pSize;
+  return true;
+}
+
+void SubTimeFrameFileSink::releaseWriteBehind(const std::uint64_t pSize)
 {
-  std::uint64_t lCurrentFileSize = 0;
-  std::uint64_t lCurrentFileStfs = 0;
+  {
+    std::scoped_lock lLock(mWriteBehindLock);
+    mWriteBehindSize -= pSize;
+  }
+  mWriteBehindCond.notify_all();
+}
 
-  std::string lCurrentFileName;
+bool SubTimeFrameFileSink::queueOut(std::unique_ptr<SubTimeFrame> &&pStf)
+{
+  if (mPipelineI.queue(mPipelineStageOut, std::move(pStf))) {
+    return true;
+  }
+  // as a leaf stage, the sink drops STFs on purpose
+  return mPipelineI.isLastStage(mPipelineStageOut);
+}
+
+bool SubTimeFrameFileSink::forwardStf(const std::uint64_t pSeq, std::unique_ptr<SubTimeFrame> &&pStf)
+{
+  if (mNumWriters == 1 || mRelaxedOrder || mWriteBehind) {
+    return queueOut(std::move(pStf));
+  }
+
+  // keep the input order: forward all consecutive STFs
+  std::scoped_lock lLock(mOrderLock);
+  mOrderedStfs.emplace(pSeq, std::move(pStf));
+
+  while (!mOrderedStfs.empty() && (mOrderedStfs.begin()->first == mNextSeqOut)) {
+    auto lNode = mOrderedStfs.extract(mOrderedStfs.begin());
+    mNextSeqOut++;
+    if (!queueOut(std::move(lNode.mapped()))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Distribute STFs to the writers: least queued data, round-robin among equals
+/// With write-behind, STFs are forwarded here and the writers get reference copies
+void SubTimeFrameFileSink::StfDispatchThread()
+{
+  std::uint64_t lSeq = 0;
 
   while (mRunning) {
-    // Get the next STF
     std::unique_ptr<SubTimeFrame> lStf = mPipelineI.dequeue(mPipelineStageIn);
     if (!lStf) {
       // input queue is stopped, bail out
       break;
     }
 
-    if (mEnabled) {
-      do {
-        // make sure Stf is updated before writing
-        lStf->updateStf();
-
-        // check if we need a writer
-        if (!mStfWriter) {
-          const auto lStfId = lStf->id();
-          lCurrentFileName = newStfFileName(lStfId);
-          namespace bfs = boost::filesystem;
-
-          try {
-            mStfWriter = std::make_unique<SubTimeFrameFileWriter>(
-              bfs::path(mCurrentDir) / bfs::path(lCurrentFileName), mSidecar);
-          } catch (...) {
-            mEnabled = false;
-            break;
-          }
-            mCurrentFileIdx++;
-        }
+    if (!mEnabled) {
+      if (!forwardStf(lSeq++, std::move(lStf))) {
+        break;
+      }
+      continue;
+    }
 
-        // write
-        if (mStfWriter->write(*lStf)) {
-          lCurrentFileStfs++;
-          lCurrentFileSize = mStfWriter->size();
-        } else {
-          mStfWriter.reset();
-          mEnabled = false;
-          break;
-        }
+    lStf->updateStf();
+    const std::uint64_t lSize = lStf->getDataSize();
 
-        // check if we should rotate the file
-        if (((mStfsPerFile > 0) && (lCurrentFileStfs >= mStfsPerFile)) || (lCurrentFileSize >= mFileSize)) {
-          lCurrentFileStfs = 0;
-          lCurrentFileSize = 0;
-          mStfWriter.reset();
+    if (mWriteBehind) {
+      // the copy must be made before the STF is passed on
+      std::unique_ptr<SubTimeFrame> lCopy = reserveWriteBehind(lSize) ? lStf->referenceCopy() : nullptr;
+      if (!queueOut(std::move(lStf))) {
+        if (lCopy) {
+          releaseWriteBehind(lSize);
         }
-      } while(0);
+        break;
+      }
+      if (!lCopy) {
+        continue;
+      }
+      lStf = std::move(lCopy);
+    }
 
-      if (!mEnabled) {
-        EDDLOG("(Sub)TimeFrame file sink: error while writing to file {}", lCurrentFileName);
-        EDDLOG("(Sub)TimeFrame file sink: disabling file sink");
+    const std::size_t lFirst = mNextWriter;
+    std::size_t lBest = lFirst;
+    for (std::size_t i = 1; i < mWriters.size(); i++) {
+      const std::size_t lIdx = (lFirst + i) % mWriters.size();
+      if (mWriters[lIdx]->mQueuedBytes < mWriters[lBest]->mQueuedBytes) {
+        lBest = lIdx;
       }
     }
+    mNextWriter = (lFirst + 1) % mWriters.size();
+
+    // backpressure: do not queue more than the writers can take (write-behind is limited by memory)
+    if (!mWriteBehind) {
+      std::unique_lock lLock(mWriterQueueLock);
+      mWriterQueueCond.wait(lLock, [&]() {
+        return !mRunning || (mWriters[lBest]->mStfQueue.size() < cWriterQueueDepth);
+      });
+    }
+
+    mWriters[lBest]->mQueuedBytes += lSize;
+    mWriters[lBest]->mStfQueue.push(lSeq++, lSize, std::move(lStf));
+  }
+
+  for (auto &lWriter : mWriters) {
+    lWriter->mStfQueue.stop();
+  }
+  DDDLOG("Exiting file sink dispatch thread");
+}
+
+/// File writing thread
+void SubTimeFrameFileSink::DataHandlerThread(const unsigned pIdx)
+{
+  auto &lWriter = *mWriters[pIdx];
+
+  while (mRunning) {
+    // Get the next STF: from the pipeline, or from the dispatcher
+    std::uint64_t lSeq = 0;
+    std::uint64_t lSize = 0;
+    std::unique_ptr<SubTimeFrame> lStf;
+
+    if (!useDispatcher()) {
+      lStf = mPipelineI.dequeue(mPipelineStageIn);
+    } else if (auto lItem = lWriter.mStfQueue.pop(); lItem) {
+      auto &[lItemSeq, lItemSize, lItemStf] = *lItem;
+      lWriter.mQueuedBytes -= lItemSize;
+      lSeq = lItemSeq;
+      lSize = lItemSize;
+      lStf = std::move(lItemStf);
+
+      // wake up the dispatcher waiting for queue space
+      { std::scoped_lock lLock(mWriterQueueLock); }
+      mWriterQueueCond.notify_one();
+    }
+
+    if (!lStf) {
+      // input queue is stopped, bail out
+      break;
+    }
+
+    if (mEnabled && !writeStf(pIdx, *lStf)) {
+      mEnabled = false;
+      EDDLOG("(Sub)TimeFrame file sink: error while writing to file {}", lWriter.mCurrentFileName);
+      EDDLOG("(Sub)TimeFrame file sink: disabling file sink");
+    }
 
-    if (! mPipelineI.queue(mPipelineStageOut, std::move(lStf)) ) {
+    if (mWriteBehind) {
+      // already forwarded: release the data references
+      lStf.reset();
+      releaseWriteBehind(lSize);
+      continue;
+    }
+
+    if (!forwardStf(lSeq, std::move(lStf))) {
       // the pipeline is stopped: exiting
       break;
     }
   }
+
+  lWriter.mStfWriter.reset();
   DDDLOG("Exiting file sink thread [{}]", pIdx);
 }
 
@@ -27,6 +27,11 @@
 #include <boost/filesystem.hpp>
 #include <fstream>
 #include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
 
 namespace o2
 {
@@ -52,6 +57,16 @@ class SubTimeFrameFileSink
   static constexpr const char* OptionKeyStfSinkStfsPerFile = "data-sink-max-stfs-per-file";
   static constexpr const char* OptionKeyStfSinkFileSize = "data-sink-max-file-size";
   static constexpr const char* OptionKeyStfSinkSidecar = "data-sink-sidecar";
+  static constexpr const char* OptionKeyStfSinkSidecarFormat = "data-sink-sidecar-format";
+  static constexpr const char* OptionKeyStfSinkWriteEngine = "data-sink-write-engine";
+  static constexpr const char* OptionKeyStfSinkTfIndex = "data-sink-tf-index";
+  static constexpr const char* OptionKeyStfSinkChecksums = "data-sink-checksums";
+  static constexpr const char* OptionKeyStfSinkWriters = "data-sink-writers";
+  static constexpr const char* OptionKeyStfSinkRelaxedOrder = "data-sink-relaxed-order";
+  static constexpr const char* OptionKeyStfSinkWriteBehind = "data-sink-write-behind";
+  static constexpr const char* OptionKeyStfSinkWriteBehindMemory = "data-sink-write-behind-memory";
+  static constexpr const char* OptionKeyStfSinkWriteBehindPolicy = "data-sink-write-behind-policy";
+  static constexpr const char* OptionKeyStfSinkWriteBehindSample = "data-sink-write-behind-sample";
 
   static bpo::options_description getProgramOptions();
 
@@ -68,9 +83,7 @@ class SubTimeFrameFileSink
 
   ~SubTimeFrameFileSink()
   {
-    if (mSinkThread.joinable()) {
-      mSinkThread.join();
-    }
+    stop();
     DDDLOG("(Sub)TimeFrame Sink terminated.");
   }
 
@@ -83,32 +96,82 @@ class SubTimeFrameFileSink
   void stop();
 
   void DataHandlerThread(const unsigned pIdx);
+  void StfDispatchThread();
 
-  std::string newStfFileName(const std::uint64_t pStfId) const;
+  std::string newStfFileName(const std::uint64_t pStfId, const unsigned pWriterIdx, const unsigned pFileIdx) const;
 
  private:
   const DataDistDevice& mDeviceI;
   stf_pipeline& mPipelineI;
 
-  std::unique_ptr<SubTimeFrameFileWriter> mStfWriter = nullptr;
+  /// File writer threads: each one writes its own series of files
+  struct StfSinkWriter {
+    std::unique_ptr<SubTimeFrameFileWriter> mStfWriter = nullptr;
+    std::uint64_t mCurrentFileSize = 0;
+    std::uint64_t mCurrentFileStfs = 0;
+    std::string mCurrentFileName;
+
+    // <sequence number, data size, stf> (only with more than one writer)
+    ConcurrentFifo<std::tuple<std::uint64_t, std::uint64_t, std::unique_ptr<SubTimeFrame>>> mStfQueue;
+    std::atomic_uint64_t mQueuedBytes = 0;
+    std::thread mThread;
+  };
+  std::vector<std::unique_ptr<StfSinkWriter>> mWriters;
+
+  bool writeStf(const unsigned pWriterIdx, SubTimeFrame &pStf);
+  // false if the pipeline is stopped
+  bool queueOut(std::unique_ptr<SubTimeFrame> &&pStf);
+  bool forwardStf(const std::uint64_t pSeq, std::unique_ptr<SubTimeFrame> &&pStf);
+
+  /// Dispatch thread (more than one writer, or write-behind)
+  static constexpr std::size_t cWriterQueueDepth = 4;
+  bool useDispatcher() const { return (mNumWriters > 1) || mWriteBehind; }
+  std::thread mDispatchThread;
+  std::size_t mNextWriter = 0;
+  // signalled by the writers when they take an STF from their queue
+  std::mutex mWriterQueueLock;
+  std::condition_variable mWriterQueueCond;
+
+  /// Forwarding in input order: <sequence number, stf>
+  std::mutex mOrderLock;
+  std::uint64_t mNextSeqOut = 0;
+  std::map<std::uint64_t, std::unique_ptr<SubTimeFrame>> mOrderedStfs;
+
+  /// Write-behind: STFs are forwarded immediately, writers hold reference copies of the data
+  enum WriteBehindPolicy { eBlock, eSkip, eSample };
+  bool reserveWriteBehind(const std::uint64_t pSize);
+  void releaseWriteBehind(const std::uint64_t pSize);
+
+  std::mutex mWriteBehindLock;
+  std::condition_variable mWriteBehindCond;
+  std::uint64_t mWriteBehindSize = 0;
+  std::uint64_t mWriteBehindCapHits = 0;
+  std::uint64_t mWriteBehindSkipped = 0;
 
   /// Configuration
-  bool mEnabled = false;
+  std::atomic_bool mEnabled = false;
   bool mRunning = false;
   std::string mRootDir;
   std::string mCurrentDir;
   std::string mFileNamePattern;
   std::uint64_t mStfsPerFile;
   std::uint64_t mFileSize;
-  bool mSidecar = false;
+  SubTimeFrameFileWriter::SidecarFormat mSidecar = SubTimeFrameFileWriter::SidecarFormat::None;
+  unsigned mNumWriters = 1;
+  bool mRelaxedOrder = false;
+  bool mWriteBehind = false;
+  std::uint64_t mWriteBehindMax = 0;
+  WriteBehindPolicy mWriteBehindPolicy = eBlock;
+  std::uint64_t mWriteBehindSample = 10;
+  SubTimeFrameFileWriter::WriteEngine mWriteEngine = SubTimeFrameFileWriter::WriteEngine::Stream;
+  bool mTfIndex = false;
+  bool mChecksums = false;
 
-  /// Thread for file writing
-  std::thread mSinkThread;
   unsigned mPipelineStageIn;
   unsigned mPipelineStageOut;
 
   /// variables
-  unsigned mCurrentFileIdx = 0;
+  std::atomic_uint mCurrentFileIdx = 0;
 };
 }
 } /* o2::DataDistribution */
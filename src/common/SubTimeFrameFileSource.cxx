@@ -15,7 +15,9 @@
 #include "SubTimeFrameFileReader.h"
 #include "FilePathUtils.h"
 #include "DataDistLogger.h"
+#include "Utilities.h"
 
+#include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/trim.hpp>
@@ -23,8 +25,11 @@
 #include <boost/filesystem.hpp>
 #include <boost/process.hpp>
 
+#include <algorithm>
+#include <cctype>
 #include <chrono>
 #include <ctime>
+#include <deque>
 #include <iostream>
 #include <iomanip>
 
@@ -51,14 +56,17 @@ void SubTimeFrameFileSource::start(MemoryResources &pMemRes, const bool pDplEnab
 {
   if (enabled()) {
     mDplEnabled = pDplEnabled;
+    mShmTransport = pMemRes.mShmTransport;
 
+    // zero-copy: the data region is only used when a file cannot be loaded into its own region
     mFileBuilder = std::make_unique<SubTimeFrameFileBuilder>(
       pMemRes,
-      mRegionSizeMB << 20,
-      mHdrRegionSizeMB << 20,
-      mDplEnabled
+      (mZeroCopy ? std::min(mRegionSizeMB, std::size_t(256)) : mRegionSizeMB) << 20,
+      mHdrRegionSizeMB << 20
     );
 
+    mReadStfQueue = std::make_unique<ConcurrentMpmcRing<std::unique_ptr<SubTimeFrame>>>(mPreReadStfs);
+
     mRunning = true;
 
     mFetchThread = create_thread_member("stf_file_fetch", &SubTimeFrameFileSource::DataFetcherThread, this);
@@ -67,6 +75,21 @@ void SubTimeFrameFileSource::start(MemoryResources &pMemRes, const bool pDplEnab
   }
 }
 
+void SubTimeFrameFileSource::pause()
+{
+  std::scoped_lock lLock(mPauseLock);
+  mPaused = true;
+}
+
+void SubTimeFrameFileSource::resume()
+{
+  {
+    std::scoped_lock lLock(mPauseLock);
+    mPaused = false;
+  }
+  mPauseCond.notify_all();
+}
+
 void SubTimeFrameFileSource::stop()
 {
   mRunning = false;
@@ -77,8 +100,14 @@ void SubTimeFrameFileSource::stop()
 
   mInputFileQueue.stop();
 
-  mReadStfQueue.stop();
-  mReadStfQueue.flush();
+  if (mReadStfQueue) {
+    mReadStfQueue->stop();
+    mReadStfQueue->flush();
+  }
+  {
+    std::scoped_lock lLock(mPauseLock);
+  }
+  mPauseCond.notify_all();
 
   if (mFetchThread.joinable()) {
     mFetchThread.join();
@@ -92,6 +121,13 @@ void SubTimeFrameFileSource::stop()
     mInjectThread.join();
   }
 
+  mReadStfQueue.reset();
+
+  // release the file regions after the in-flight messages
+  mFileRegions.clear();
+  mFileRegionsSize = 0;
+  StfFileRegion::collect(true);
+
   // make sure we delete the cache
   if (!mLocalFiles && boost::contains(mCopyDstPath.native(), "dd-tmp-tfs")) {
     try {
@@ -119,7 +155,18 @@ bpo::options_description SubTimeFrameFileSource::getProgramOptions()
     "Rate of injecting new (Sub)TimeFrames (approximate). -1 to inject as fast as possible.")(
     OptionKeyStfLoadPreRead,
     bpo::value<std::uint32_t>()->default_value(1),
-    "Number of pre-read (Sub)TimeFrames prepared for sending. Must be greater or equal to 1.")(
+    "Number of pre-read (Sub)TimeFrames prepared for sending. Must be greater or equal to 1. "
+    "Rounded up to a power of 2.")(
+    OptionKeyStfLoadBurst,
+    bpo::value<std::uint32_t>()->default_value(1),
+    "Number of (Sub)TimeFrames injected back-to-back at the configured rate (1: steady rate).")(
+    OptionKeyStfLoadTimed,
+    bpo::bool_switch()->default_value(false),
+    "Inject each (Sub)TimeFrame at the time of its first orbit relative to the first injected one, reproducing "
+    "the timing of the recorded data. The rate and burst options are not used.")(
+    OptionKeyStfLoadSpeedup,
+    bpo::value<double>()->default_value(1.0),
+    "Speed-up factor of the timed injection (2.0: twice as fast as recorded).")(
     OptionKeyStfSourceRepeat,
     bpo::bool_switch()->default_value(false),
     "If enabled, repeatedly inject (Sub)TimeFrames into the chain.")(
@@ -139,7 +186,34 @@ bpo::options_description SubTimeFrameFileSource::getProgramOptions()
     bpo::value<std::string>()->default_value(""),
     "Copy command to be used to fetch remote files. NOTE: Placeholders for source and destination file name "
     "(?src and ?dst) must be specified. E.g. \"scp user@my-server:?src ?dst\". Source placeholder will be "
-    "substituted with files provided in the file-list option.");
+    "substituted with files provided in the file-list option.")(
+    OptionKeyStfSourceOrigins,
+    bpo::value<std::string>()->default_value(""),
+    "Only read data of the listed data origins, e.g. \"TPC,ITS\". The TF index is used to skip all other data.")(
+    OptionKeyStfSourceSubSpecs,
+    bpo::value<std::string>()->default_value(""),
+    "Only read data of the listed subspecifications (decimal or hex), e.g. \"0x10,0x11\".")(
+    OptionKeyStfSourceZeroCopy,
+    bpo::bool_switch()->default_value(false),
+    "Load each file into its own shared memory region and send the payloads without copies. Files are kept "
+    "loaded for repeated reads up to the data region size. Use DATADIST_SHM_PATH to place the regions on hugetlbfs.")(
+    OptionKeyStfSourceVerifyChecksums,
+    bpo::bool_switch()->default_value(false),
+    "Verify the CRC32C checksums of the data blocks (files written with data-sink-checksums). (Sub)TimeFrames "
+    "with checksum errors are skipped.")(
+    OptionKeyStfSourceFetchParallel,
+    bpo::value<std::uint32_t>()->default_value(1),
+    "Number of concurrent copy commands for remote files.")(
+    OptionKeyStfSourceFetchLookahead,
+    bpo::value<std::uint32_t>()->default_value(4),
+    "Maximum number of remote files fetched ahead of reading (in progress and fetched).")(
+    OptionKeyStfSourceCacheDir,
+    bpo::value<std::string>()->default_value(""),
+    "Directory for a persistent cache of remote files. Cached files are kept between runs and are not fetched "
+    "again. Default: files are fetched to a temporary directory and deleted after use.")(
+    OptionKeyStfSourceCacheSize,
+    bpo::value<std::uint64_t>()->default_value(std::uint64_t(64) << 10), /* 64GiB */
+    "Size limit of the persistent file cache in MiB. Least recently used files are removed.");
 
   return lSinkDesc;
 }
@@ -188,12 +262,62 @@ bool SubTimeFrameFileSource::loadVerifyConfig(const FairMQProgOptions& pFMQProgO
   mRepeat = pFMQProgOpt.GetValue<bool>(OptionKeyStfSourceRepeat);
   mLoadRate = pFMQProgOpt.GetValue<double>(OptionKeyStfLoadRate);
   mPreReadStfs = pFMQProgOpt.GetValue<std::uint32_t>(OptionKeyStfLoadPreRead);
+  mLoadBurst = std::max(std::uint32_t(1), pFMQProgOpt.GetValue<std::uint32_t>(OptionKeyStfLoadBurst));
+  mLoadTimed = pFMQProgOpt.GetValue<bool>(OptionKeyStfLoadTimed);
+  mLoadSpeedup = pFMQProgOpt.GetValue<double>(OptionKeyStfLoadSpeedup);
+  if (mLoadTimed && !(mLoadSpeedup > 0.)) {
+    EDDLOG("(Sub)TimeFrame file source: speed-up factor must be positive. {}={}", OptionKeyStfLoadSpeedup,
+      mLoadSpeedup);
+    return false;
+  }
   mRegionSizeMB = pFMQProgOpt.GetValue<std::uint64_t>(OptionKeyStfSourceRegionSize);
   mHdrRegionSizeMB = pFMQProgOpt.GetValue<std::uint64_t>(OptionKeyStfHeadersRegionSize);
+  mZeroCopy = pFMQProgOpt.GetValue<bool>(OptionKeyStfSourceZeroCopy);
+  mVerifyChecksums = pFMQProgOpt.GetValue<bool>(OptionKeyStfSourceVerifyChecksums);
+  mFetchParallel = std::max(std::uint32_t(1), pFMQProgOpt.GetValue<std::uint32_t>(OptionKeyStfSourceFetchParallel));
+  mFetchLookahead = std::max(mFetchParallel, pFMQProgOpt.GetValue<std::uint32_t>(OptionKeyStfSourceFetchLookahead));
 
   mCopyFileList = pFMQProgOpt.GetValue<std::string>(OptionKeyStfFileList);
   mCopyCmd = pFMQProgOpt.GetValue<std::string>(OptionKeyStfCopyCmd);
 
+  // selective reading
+  {
+    mReadFilter = StfFileReadFilter();
+
+    const auto lOriginsOpt = pFMQProgOpt.GetValue<std::string>(OptionKeyStfSourceOrigins);
+    std::vector<std::string> lOriginStrs;
+    boost::split(lOriginStrs, lOriginsOpt, boost::is_any_of(","), boost::token_compress_on);
+    for (auto &lOriginStr : lOriginStrs) {
+      boost::algorithm::trim(lOriginStr);
+      if (lOriginStr.empty()) {
+        continue;
+      }
+      if (lOriginStr.size() > o2::header::DataOrigin::size) {
+        EDDLOG("(Sub)TimeFrame file source: invalid data origin. {}={}", OptionKeyStfSourceOrigins, lOriginStr);
+        return false;
+      }
+      o2::header::DataOrigin lOrigin;
+      lOrigin.runtimeInit(lOriginStr.c_str());
+      mReadFilter.mOrigins.push_back(lOrigin);
+    }
+
+    const auto lSubSpecsOpt = pFMQProgOpt.GetValue<std::string>(OptionKeyStfSourceSubSpecs);
+    std::vector<std::string> lSubSpecStrs;
+    boost::split(lSubSpecStrs, lSubSpecsOpt, boost::is_any_of(","), boost::token_compress_on);
+    for (auto &lSubSpecStr : lSubSpecStrs) {
+      boost::algorithm::trim(lSubSpecStr);
+      if (lSubSpecStr.empty()) {
+        continue;
+      }
+      try {
+        mReadFilter.mSubSpecs.push_back(std::stoull(lSubSpecStr, nullptr, 0));
+      } catch (std::logic_error &) {
+        EDDLOG("(Sub)TimeFrame file source: invalid subspecification. {}={}", OptionKeyStfSourceSubSpecs, lSubSpecStr);
+        return false;
+      }
+    }
+  }
+
   // initialize file fetcher
   if (!mCopyFileList.empty() && !mCopyCmd.empty()) {
 
@@ -240,9 +364,22 @@ bool SubTimeFrameFileSource::loadVerifyConfig(const FairMQProgOptions& pFMQProgO
         return false;
       }
 
-      const auto lCopyDstPath = bfs::temp_directory_path() / "dd-tmp-tfs" / bfs::unique_path("%%%%");
+      mCacheDir = pFMQProgOpt.GetValue<std::string>(OptionKeyStfSourceCacheDir);
+      mCacheSize = pFMQProgOpt.GetValue<std::uint64_t>(OptionKeyStfSourceCacheSize) << 20; /* in MiB */
+
+      const auto lCopyDstPath = mCacheDir.empty() ?
+        (bfs::temp_directory_path() / "dd-tmp-tfs" / bfs::unique_path("%%%%")) : bfs::path(mCacheDir);
       bfs::create_directories(lCopyDstPath);
       mCopyDstPath = lCopyDstPath.native();
+
+      // remove incomplete fetches of a previous run
+      if (!mCacheDir.empty()) {
+        for (const auto &lEntry : bfs::directory_iterator(lCopyDstPath)) {
+          if (bfs::is_regular_file(lEntry) && boost::ends_with(lEntry.path().filename().native(), ".part")) {
+            bfs::remove(lEntry.path());
+          }
+        }
+      }
       // location of log file
       mCopyCmdLogFile = (lCopyDstPath / "copy-cmd.log").native();
 
@@ -303,84 +440,290 @@ bool SubTimeFrameFileSource::loadVerifyConfig(const FairMQProgOptions& pFMQProgO
   } else {
     IDDLOG("(Sub)TimeFrame source :: file list               = {}", mCopyFileList);
     IDDLOG("(Sub)TimeFrame source :: copy command            = {}", mCopyCmd);
+    IDDLOG("(Sub)TimeFrame source :: parallel fetches        = {}", mFetchParallel);
+    IDDLOG("(Sub)TimeFrame source :: fetch look-ahead        = {}", mFetchLookahead);
+    if (!mCacheDir.empty()) {
+      IDDLOG("(Sub)TimeFrame source :: cache directory         = {}", mCacheDir);
+      IDDLOG("(Sub)TimeFrame source :: cache size (MiB)        = {}", mCacheSize >> 20);
+    }
   }
   IDDLOG("(Sub)TimeFrame source :: (s)tf load rate         = {}", mLoadRate);
+  IDDLOG("(Sub)TimeFrame source :: (s)tf load burst        = {}", mLoadBurst);
+  IDDLOG("(Sub)TimeFrame source :: timed injection         = {}", (mLoadTimed ? "yes" : "no"));
+  if (mLoadTimed) {
+    IDDLOG("(Sub)TimeFrame source :: timed speed-up          = {}", mLoadSpeedup);
+  }
   IDDLOG("(Sub)TimeFrame source :: (s)tf pre reads         = {}", mPreReadStfs);
   IDDLOG("(Sub)TimeFrame source :: repeat data             = {}", mRepeat);
   IDDLOG("(Sub)TimeFrame source :: num files in dataset    = {}", mFilesVector.size());
   IDDLOG("(Sub)TimeFrame source :: data region size(MiB)   = {}", mRegionSizeMB);
   IDDLOG("(Sub)TimeFrame source :: header region size(MiB) = {}", mHdrRegionSizeMB);
+  IDDLOG("(Sub)TimeFrame source :: zero-copy payloads      = {}", (mZeroCopy ? "yes" : "no"));
+  IDDLOG("(Sub)TimeFrame source :: verify checksums        = {}", (mVerifyChecksums ? "yes" : "no"));
+  if (!mReadFilter.empty()) {
+    IDDLOG("(Sub)TimeFrame source :: selected origins        = {}", pFMQProgOpt.GetValue<std::string>(OptionKeyStfSourceOrigins));
+    IDDLOG("(Sub)TimeFrame source :: selected subspecs       = {}", pFMQProgOpt.GetValue<std::string>(OptionKeyStfSourceSubSpecs));
+  }
 
   return true;
 }
 
+// Cache file of a remote file: keyed by the source path, and the size and modification time if the source
+// can be accessed locally (e.g. a network file system)
+std::string SubTimeFrameFileSource::cacheFileName(const std::size_t pFileIdx) const
+{
+  const auto &lSrcPath = mFilesVector[pFileIdx];
+  std::string lKey = lSrcPath;
+
+  boost::system::error_code lErr;
+  const auto lSrcSize = bfs::file_size(lSrcPath, lErr);
+  if (!lErr) {
+    const auto lSrcTime = bfs::last_write_time(lSrcPath, lErr);
+    lKey += fmt::format("|{}|{}", lSrcSize, (lErr ? 0 : lSrcTime));
+  }
+
+  // FNV-1a: stable between runs
+  std::uint64_t lHash = 0xcbf29ce484222325ULL;
+  for (const auto lChar : lKey) {
+    lHash = (lHash ^ std::uint8_t(lChar)) * 0x100000001b3ULL;
+  }
+
+  return (mCopyDstPath / fmt::format("{:016x}-{}", lHash, bfs::path(lSrcPath).filename().native())).native();
+}
+
+// Complete cache files only: "<16 hex digits of the hash>-<source file name>", without the ".part" suffix
+bool SubTimeFrameFileSource::isCacheFileName(const std::string &pFileName)
+{
+  static constexpr std::size_t cHashLen = 16;
+
+  if (pFileName.size() <= cHashLen + 1 || pFileName[cHashLen] != '-') {
+    return false;
+  }
+  if (!std::all_of(pFileName.begin(), pFileName.begin() + cHashLen, [](const char c) { return std::isxdigit(static_cast<unsigned char>(c)); })) {
+    return false;
+  }
+  // being fetched
+  return !boost::ends_with(pFileName, ".part");
+}
+
+// Remove least recently used files to make room for pReserve bytes. Files in use are kept
+void SubTimeFrameFileSource::evictCache(const std::uint64_t pReserve)
+{
+  std::vector<std::tuple<std::time_t, std::uint64_t, bfs::path>> lFiles;
+  std::uint64_t lCacheUsed = 0;
+
+  try {
+    for (const auto &lEntry : bfs::directory_iterator(mCopyDstPath)) {
+      const auto &lPath = lEntry.path();
+      if (!bfs::is_regular_file(lPath) || !isCacheFileName(lPath.filename().native())) {
+        continue;
+      }
+      const auto lSize = bfs::file_size(lPath);
+      lCacheUsed += lSize;
+      lFiles.emplace_back(bfs::last_write_time(lPath), lSize, lPath);
+    }
+
+    std::sort(lFiles.begin(), lFiles.end());
+
+    for (const auto &[lTime, lSize, lPath] : lFiles) {
+      if (lCacheUsed + pReserve <= mCacheSize) {
+        break;
+      }
+      if (StfFileMeta::isLive(lPath.native())) {
+        continue;
+      }
+      DDDLOG("(Sub)TimeFrame source: removing file from the cache. file={} size={}", lPath.native(), lSize);
+      bfs::remove(lPath);
+      lCacheUsed -= lSize;
+    }
+  } catch (std::exception &e) {
+    WDDLOG_RL(10000, "(Sub)TimeFrame source: file cache cleanup failed. error={}", e.what());
+  }
+
+  if (lCacheUsed + pReserve > mCacheSize) {
+    WDDLOG_RL(10000, "(Sub)TimeFrame source: file cache is over the size limit. used={} limit={}",
+      lCacheUsed + pReserve, mCacheSize);
+  }
+}
+
 // Fetch copy files if needed
+// Remote files are fetched by up to mFetchParallel copy commands, at most mFetchLookahead files ahead of the reader.
+// Fetched files are queued in the file list order.
 void SubTimeFrameFileSource::DataFetcherThread()
 {
+  struct PendingFetch {
+    std::size_t mFileIdx;
+    bfs::path mDstFileName;
+    std::string mCmd;
+    std::unique_ptr<bp::child> mChild; // nullptr: the file is already in the cache
+    std::shared_ptr<StfFileMeta> mExisting;
+    std::chrono::steady_clock::time_point mStart;
+    std::chrono::steady_clock::time_point mLastLog;
+  };
+  std::deque<PendingFetch> lPending;
+
   std::size_t lFileIndex = std::size_t(-1);
   std::uint64_t lFileErrors = 0;
   std::uint64_t lTotalFiles = 0;
   std::uint64_t lTotalSuccessfulFiles = 0;
 
-  while (mRunning && lFileErrors < 10) {
-    if (mInputFileQueue.size() > 4) {
-      std::this_thread::sleep_for(5ms);
-      continue;
-    }
+  // fetch metrics
+  std::uint64_t lFetchedFiles = 0;
+  std::uint64_t lFetchedBytes = 0;
+  double lFetchTimeSum = 0.;
 
-    // get the next list
+  const auto lMoreFiles = [&]() {
     if (lTotalFiles >= mFilesVector.size() && !mRepeat) {
-      IDDLOG("(Sub)TimeFrame source: finished loading all files. Waiting for injecting to complete.");
-      break;
+      return false;
     }
+    // DATADIST_FILE_READ_COUNT
+    if (mNumFiles > 0 && (lTotalSuccessfulFiles + lPending.size()) >= mNumFiles) {
+      return false;
+    }
+    return true;
+  };
 
-    // make sure we progress on errors
-    lFileIndex = (lFileIndex + 1) % mFilesVector.size();
-    lTotalFiles++;
+  while (mRunning && lFileErrors < 10) {
 
     if (mLocalFiles) {
+      if (mInputFileQueue.size() > 4) {
+        std::this_thread::sleep_for(5ms);
+        continue;
+      }
+      if (!lMoreFiles()) {
+        IDDLOG("(Sub)TimeFrame source: finished loading all files. Waiting for injecting to complete.");
+        break;
+      }
+
       // simply forward
+      lFileIndex = (lFileIndex + 1) % mFilesVector.size();
+      lTotalFiles++;
       mInputFileQueue.push(std::make_shared<StfFileMeta>(lFileIndex, mFilesVector[lFileIndex]));
-    } else {
+      lTotalSuccessfulFiles++;
+      continue;
+    }
+
+    // start new fetches
+    while (mRunning && lMoreFiles() && (lPending.size() < mFetchParallel) &&
+      ((mInputFileQueue.size() + lPending.size()) < mFetchLookahead)) {
+
+      const std::size_t lNextIndex = (lFileIndex + 1) % mFilesVector.size();
+      // the same file is still being fetched (short file list)
+      if (std::any_of(lPending.cbegin(), lPending.cend(),
+        [&](const PendingFetch &pFetch) { return pFetch.mFileIdx == lNextIndex; })) {
+        break;
+      }
+
+      // make sure we progress on errors
+      lFileIndex = lNextIndex;
+      lTotalFiles++;
+
+      PendingFetch lFetch;
+      lFetch.mFileIdx = lFileIndex;
+      lFetch.mStart = lFetch.mLastLog = std::chrono::steady_clock::now();
+
       // check if the file already exists in the cache
       auto lExisting = StfFileMeta::getExistingInstance(lFileIndex);
+      const auto lCacheFile = mCacheDir.empty() ? std::string() : cacheFileName(lFileIndex);
+
       if (lExisting) {
-        mInputFileQueue.push(lExisting.value());
+        lFetch.mExisting = lExisting.value();
+      } else if (!lCacheFile.empty() && bfs::is_regular_file(lCacheFile) && !bfs::is_empty(lCacheFile)) {
+        // persistent cache hit: mark as recently used
+        bfs::last_write_time(lCacheFile, std::time(nullptr));
+        lFetch.mExisting = std::make_shared<StfFileMeta>(lFileIndex, lCacheFile, false /* keep in cache */);
+        StfFileMeta::insertExistingInstance(lFileIndex, lFetch.mExisting);
       } else {
-        // run the copy command
-        const auto lDstFileName = mCopyDstPath /
-          ("cache-" + std::to_string(lFileIndex) + "-" + bfs::path(mFilesVector[lFileIndex]).filename().native());
+        // run the copy command (to a temporary name when caching)
+        lFetch.mDstFileName = lCacheFile.empty() ? (mCopyDstPath /
+          ("cache-" + std::to_string(lFileIndex) + "-" + bfs::path(mFilesVector[lFileIndex]).filename().native())) :
+          bfs::path(lCacheFile + ".part");
 
-        auto lRealCmd = boost::replace_all_copy(mCopyCmd, "?src", mFilesVector[lFileIndex]);
-        boost::replace_all(lRealCmd, "?dst", lDstFileName.native());
+        lFetch.mCmd = boost::replace_all_copy(mCopyCmd, "?src", mFilesVector[lFileIndex]);
+        boost::replace_all(lFetch.mCmd, "?dst", lFetch.mDstFileName.native());
 
-        std::vector<std::string> lCopyParams { "-c", lRealCmd };
-        bp::child lCopyChild(bp::search_path("sh"), lCopyParams, bp::std_err > mCopyCmdLogFile,
-          bp::std_out > mCopyCmdLogFile);
+        std::vector<std::string> lCopyParams { "-c", lFetch.mCmd };
+        lFetch.mChild = std::make_unique<bp::child>(bp::search_path("sh"), lCopyParams,
+          bp::std_err > mCopyCmdLogFile, bp::std_out > mCopyCmdLogFile);
+      }
+      lPending.push_back(std::move(lFetch));
+    }
 
-        while (!lCopyChild.wait_for(5s)) {
-          IDDLOG("(Sub)TimeFrame source: waiting for copy command. cmd='{}'", lRealCmd);
-        }
+    if (lPending.empty()) {
+      if (!lMoreFiles()) {
+        IDDLOG("(Sub)TimeFrame source: finished loading all files. Waiting for injecting to complete.");
+        break;
+      }
+      // look-ahead is full
+      std::this_thread::sleep_for(5ms);
+      continue;
+    }
 
-        const auto lSysRet = lCopyChild.exit_code();
-        if (lSysRet != 0) {
-          WDDLOG_RL(1000, "(Sub)TimeFrame source: copy command returned non-zero exit code. cmd='{}' exit_code={}",
-            lRealCmd, lSysRet);
+    // complete the oldest fetch first to keep the order
+    auto &lFetch = lPending.front();
+    if (lFetch.mChild) {
+      if (!lFetch.mChild->wait_for(100ms)) {
+        const auto lNow = std::chrono::steady_clock::now();
+        if (lNow - lFetch.mLastLog > 5s) {
+          lFetch.mLastLog = lNow;
+          IDDLOG("(Sub)TimeFrame source: waiting for copy command. cmd='{}' in_progress={}", lFetch.mCmd,
+            lPending.size());
         }
+        continue;
+      }
 
-        if (!bfs::is_regular_file(lDstFileName) || bfs::is_empty(lDstFileName)) {
-          EDDLOG("(Sub)TimeFrame source: copy command failed to fetch the file. stc_file={} dst_file={}.",
-            mFilesVector[lFileIndex], lDstFileName.native());
+      const auto lSysRet = lFetch.mChild->exit_code();
+      if (lSysRet != 0) {
+        WDDLOG_RL(1000, "(Sub)TimeFrame source: copy command returned non-zero exit code. cmd='{}' exit_code={}",
+          lFetch.mCmd, lSysRet);
+      }
+
+      if (!bfs::is_regular_file(lFetch.mDstFileName) || bfs::is_empty(lFetch.mDstFileName)) {
+        EDDLOG("(Sub)TimeFrame source: copy command failed to fetch the file. stc_file={} dst_file={}.",
+          mFilesVector[lFetch.mFileIdx], lFetch.mDstFileName.native());
+        lFileErrors++;
+        lPending.pop_front();
+        continue;
+      }
+
+      // metrics
+      const double lFetchTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - lFetch.mStart).count();
+      const auto lFileSize = bfs::file_size(lFetch.mDstFileName);
+      lFetchedFiles++;
+      lFetchedBytes += lFileSize;
+      lFetchTimeSum += lFetchTime;
+      DDDLOG("(Sub)TimeFrame source: fetched file={} size={} time={:.3f}s throughput={:.1f}MiB/s",
+        mFilesVector[lFetch.mFileIdx], lFileSize, lFetchTime, double(lFileSize) / (1 << 20) / std::max(lFetchTime, 1e-6));
+      IDDLOG_RL(10000, "(Sub)TimeFrame source: fetch stats files={} mean_time={:.3f}s mean_throughput={:.1f}MiB/s "
+        "parallel={}", lFetchedFiles, lFetchTimeSum / lFetchedFiles,
+        double(lFetchedBytes) / (1 << 20) / std::max(lFetchTimeSum, 1e-6), lPending.size());
+
+      std::shared_ptr<StfFileMeta> lNewFile;
+      if (mCacheDir.empty()) {
+        lNewFile = std::make_shared<StfFileMeta>(lFetch.mFileIdx, lFetch.mDstFileName.native(),
+          true /* delete after done */);
+      } else {
+        // complete files only: move into the cache
+        const auto lCacheFile = lFetch.mDstFileName.parent_path() / lFetch.mDstFileName.stem();
+        evictCache(lFileSize);
+        boost::system::error_code lErr;
+        bfs::rename(lFetch.mDstFileName, lCacheFile, lErr);
+        if (lErr) {
+          EDDLOG("(Sub)TimeFrame source: cannot move the fetched file into the cache. file={} error={}",
+            lCacheFile.native(), lErr.message());
           lFileErrors++;
+          lPending.pop_front();
           continue;
         }
-
-        auto lNewFile = std::make_shared<StfFileMeta>(lFileIndex, lDstFileName.native(), true /* delete after done */);
-        StfFileMeta::insertExistingInstance(lFileIndex, lNewFile);
-        mInputFileQueue.push(lNewFile);
+        lNewFile = std::make_shared<StfFileMeta>(lFetch.mFileIdx, lCacheFile.native(), false /* keep in cache */);
       }
+      StfFileMeta::insertExistingInstance(lFetch.mFileIdx, lNewFile);
+      mInputFileQueue.push(lNewFile);
+    } else {
+      mInputFileQueue.push(lFetch.mExisting);
     }
 
+    lPending.pop_front();
     lTotalSuccessfulFiles++;
 
     // check if we are done because of DATADIST_FILE_READ_COUNT
@@ -390,17 +733,56 @@ void SubTimeFrameFileSource::DataFetcherThread()
     }
   }
 
+  // stop the copy commands still running
+  for (auto &lFetch : lPending) {
+    if (lFetch.mChild && lFetch.mChild->running()) {
+      std::error_code lErr;
+      lFetch.mChild->terminate(lErr);
+    }
+  }
+
+  if (lFetchedFiles > 0) {
+    IDDLOG("(Sub)TimeFrame source: fetched files={} size={} mean_time={:.3f}s mean_throughput={:.1f}MiB/s",
+      lFetchedFiles, lFetchedBytes, lFetchTimeSum / lFetchedFiles,
+      double(lFetchedBytes) / (1 << 20) / std::max(lFetchTimeSum, 1e-6));
+  }
+
   // close the file queue to signal the next thread to exit
   mInputFileQueue.stop();
   DDDLOG("Exiting file provider thread...");
 }
 
+std::shared_ptr<StfFileRegion> SubTimeFrameFileSource::getFileRegion(StfFileMeta &pFile)
+{
+  if (pFile.mRegion) {
+    return pFile.mRegion;
+  }
+
+  const auto lCached = mFileRegions.find(pFile.mIdx);
+  if (lCached != mFileRegions.end()) {
+    pFile.mRegion = lCached->second;
+    return pFile.mRegion;
+  }
+
+  try {
+    pFile.mRegion = StfFileRegion::make(*mShmTransport, pFile.mFilePath);
+  } catch (...) {
+    WDDLOG_RL(1000, "(Sub)TimeFrame Source: cannot load the file into a region, copying the data. file={}",
+      pFile.mFilePath);
+    return nullptr;
+  }
+
+  // keep for repeated reads
+  if (mRepeat && (mFileRegionsSize + pFile.mRegion->size()) <= (std::uint64_t(mRegionSizeMB) << 20)) {
+    mFileRegionsSize += pFile.mRegion->size();
+    mFileRegions[pFile.mIdx] = pFile.mRegion;
+  }
+  return pFile.mRegion;
+}
+
 /// File reading thread
 void SubTimeFrameFileSource::DataHandlerThread()
 {
-  // inject rate
-  const std::chrono::microseconds lIntervalUs(mLoadRate > 0. ? unsigned(1000000. / mLoadRate) : 0);
-
   while (mRunning) {
 
     std::shared_ptr<StfFileMeta> lMyFile;
@@ -412,7 +794,8 @@ void SubTimeFrameFileSource::DataHandlerThread()
 
     DDDLOG_RL(5000, "(Sub)TimeFrame Source: reading new file={}", lMyFile->mFilePath);
     auto lFileNameAbs = bfs::path(lMyFile->mFilePath);
-    SubTimeFrameFileReader lStfReader(lFileNameAbs);
+    SubTimeFrameFileReader lStfReader(lFileNameAbs, mReadFilter, (mZeroCopy ? getFileRegion(*lMyFile) : nullptr));
+    lStfReader.setVerifyChecksums(mVerifyChecksums);
 
     try {
       // load multiple TF per file
@@ -423,7 +806,8 @@ void SubTimeFrameFileSource::DataHandlerThread()
         if (mRunning && lStfPtr) {
           // adapt Stf headers for different output channels, native or DPL
           mFileBuilder->adaptHeaders(lStfPtr.get());
-          if (!mReadStfQueue.push(std::move(lStfPtr))) {
+          // blocks while the read-ahead queue is full
+          if (!mReadStfQueue->push(std::move(lStfPtr))) {
             break;
           }
 
@@ -431,44 +815,223 @@ void SubTimeFrameFileSource::DataHandlerThread()
           // bad file?
           break; // EOF or !running
         }
-
-        // Limit read-ahead
-        while (mRunning && (mReadStfQueue.size() >= mPreReadStfs)) {
-          std::this_thread::sleep_for(mPaused ? lIntervalUs : (lIntervalUs / 10));
-        }
       }
     } catch (...) {
       EDDLOG("(Sub)TimeFrame Source: error while reading (S)TFs from file. file={} file_idx={}",
         lMyFile->mFilePath, lMyFile->mIdx);
     }
 
+    if (lStfReader.checksumErrors() > 0) {
+      EDDLOG("(Sub)TimeFrame Source: skipped (S)TFs with checksum errors. file={} num_skipped={}",
+        lMyFile->mFilePath, lStfReader.checksumErrors());
+    }
+
     // make sure we release the file first befor put call
     const auto lIdx = lMyFile->mIdx;
     lMyFile.reset();
     StfFileMeta::putExistingInstance(lIdx);
+
+    // destroy file regions no longer in use
+    StfFileRegion::collect();
   }
 
   // notify the injection thread to stop
-  mReadStfQueue.stop();
+  mReadStfQueue->stop();
 
   DDDLOG("Exiting file source data load thread...");
 }
 
 
+namespace {
+
+/// Token bucket pacer: one token every 1/rate seconds, at most pBurst tokens are accumulated.
+/// The bucket starts full. Tokens are counted from the (re)start time to avoid skewing the rate over time.
+class StfInjectPacer
+{
+ public:
+  StfInjectPacer(const double pRate, const std::uint32_t pBurst)
+  : mInterval(pRate > 0. ? (1. / pRate) : 0.), mBurst(pBurst) { reset(); }
+
+  void reset()
+  {
+    mStart = std::chrono::steady_clock::now();
+    mTaken = 0;
+    mTokens = mBurst;
+    mNumSent = 0;
+  }
+
+  /// Wait for the next token. Returns false if pRunning was cleared while waiting
+  template <typename Pred>
+  bool acquire(const Pred &pRunning)
+  {
+    if (mInterval <= 0.) {
+      mNumSent++;
+      return true;
+    }
+
+    if (mTokens == 0) {
+      // wait for a full burst of tokens
+      const auto lDeadline = mStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>((mTaken + mBurst) * mInterval));
+
+      while (std::chrono::steady_clock::now() < lDeadline) {
+        if (!pRunning()) {
+          return false;
+        }
+        // limit sleep time to 0.5s in order to be able to check for exit signal
+        std::this_thread::sleep_until(std::min(lDeadline, std::chrono::steady_clock::now() + 500ms));
+      }
+
+      // tokens not used while the consumer was late are dropped (at most one burst is accumulated)
+      const auto lElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+      const auto lAvailable = std::uint64_t(lElapsed / mInterval);
+      mTokens = mBurst;
+      mTaken = std::max(mTaken + mBurst, lAvailable);
+    }
+
+    mTokens--;
+    mNumSent++;
+    return true;
+  }
+
+  double rate() const
+  {
+    return mNumSent / std::max(1e-6, std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count());
+  }
+
+ private:
+  const double mInterval;
+  const std::uint64_t mBurst;
+  std::chrono::steady_clock::time_point mStart;
+  std::uint64_t mTaken = 0;
+  std::uint64_t mTokens = 0;
+  std::uint64_t mNumSent = 0;
+};
+
+/// Orbit pacer: each STF is due at the time of its first orbit relative to the anchor STF, divided by the
+/// speed-up factor. The pacer re-anchors when the orbit goes backwards (repeated data, new run) or when the
+/// gap to the previous STF is larger than cMaxGap, e.g. between files of different runs.
+/// Sleeps until shortly before the deadline and spins for the rest, recording the injection error.
+class StfOrbitPacer
+{
+ public:
+  static constexpr double cLhcOrbitNs = 3564 * 24.9507; // 3564 bunch slots of 24.95 ns
+  static constexpr auto cSpinTime = 200us;
+  static constexpr auto cMaxGap = 10s;
+
+  StfOrbitPacer(const double pSpeedup)
+  : mOrbitNs(cLhcOrbitNs / pSpeedup) { reset(); }
+
+  void reset() { mAnchored = false; }
+
+  /// Wait for the time of pOrbit. Returns false if pRunning was cleared while waiting
+  template <typename Pred>
+  bool acquire(const std::uint32_t pOrbit, const Pred &pRunning)
+  {
+    const auto lNow = std::chrono::steady_clock::now();
+
+    // STFs without the orbit are injected at once
+    if (pOrbit == std::numeric_limits<std::uint32_t>::max()) {
+      mNumNoOrbit++;
+      return true;
+    }
+
+    if (!mAnchored || pOrbit < mLastOrbit || orbitsTime(pOrbit - mLastOrbit) > cMaxGap) {
+      if (mAnchored) {
+        mNumReanchors++;
+      }
+      mAnchored = true;
+      mAnchorTime = lNow;
+      mAnchorOrbit = pOrbit;
+      mLastOrbit = pOrbit;
+      mErrorUs.record(0);
+      return true;
+    }
+    mLastOrbit = pOrbit;
+
+    const auto lDeadline = mAnchorTime + orbitsTime(pOrbit - mAnchorOrbit);
+    if (lNow > lDeadline) {
+      // the STF was not ready in time
+      mNumLate++;
+    } else {
+      while (std::chrono::steady_clock::now() < (lDeadline - cSpinTime)) {
+        if (!pRunning()) {
+          return false;
+        }
+        // limit sleep time to 0.5s in order to be able to check for exit signal
+        std::this_thread::sleep_until(std::min(lDeadline - cSpinTime, std::chrono::steady_clock::now() + 500ms));
+      }
+      while (std::chrono::steady_clock::now() < lDeadline) {
+        cpu_relax();
+      }
+    }
+
+    mErrorUs.record(std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - lDeadline).count());
+    return true;
+  }
+
+  void logStats()
+  {
+    const auto lSnap = mErrorUs.snapshot_reset();
+    if (lSnap.mCount == 0) {
+      return;
+    }
+    IDDLOG("(Sub)TimeFrame Source: timed injection. p50_err_us={} p99_err_us={} max_err_us={} count={} late={} "
+      "reanchors={} no_orbit={}", LogLinearHistogram::percentile(lSnap, 50.0),
+      LogLinearHistogram::percentile(lSnap, 99.0), lSnap.mMax, lSnap.mCount, mNumLate, mNumReanchors, mNumNoOrbit);
+    mNumLate = mNumReanchors = mNumNoOrbit = 0;
+  }
+
+ private:
+  std::chrono::steady_clock::duration orbitsTime(const std::uint64_t pOrbits) const
+  {
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double, std::nano>(double(pOrbits) * mOrbitNs));
+  }
+
+  static inline void cpu_relax()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+  }
+
+  const double mOrbitNs;
+  bool mAnchored = false;
+  std::chrono::steady_clock::time_point mAnchorTime;
+  std::uint32_t mAnchorOrbit = 0;
+  std::uint32_t mLastOrbit = 0;
+
+  LogLinearHistogram mErrorUs; // injection time - deadline
+  std::uint64_t mNumLate = 0;
+  std::uint64_t mNumReanchors = 0;
+  std::uint64_t mNumNoOrbit = 0;
+};
+
+}
+
 /// STF injecting thread
 void SubTimeFrameFileSource::DataInjectThread()
 {
-  const std::chrono::microseconds lIntervalUs(mLoadRate > 0. ? unsigned(1000000. / mLoadRate) : 0);
+  StfInjectPacer lPacer(mLoadRate, mLoadBurst);
+  StfOrbitPacer lOrbitPacer(mLoadSpeedup);
+  auto lStatsTime = std::chrono::steady_clock::now();
 
-  IDDLOG("(Sub)TimeFrame Source: Injecting new STF every {} us", lIntervalUs.count());
-
-  static double sNumSentStfs = 1;
+  if (mLoadTimed) {
+    IDDLOG("(Sub)TimeFrame Source: Injecting STFs at the time of their first orbit, speedup={}", mLoadSpeedup);
+  } else {
+    IDDLOG("(Sub)TimeFrame Source: Injecting new STF every {:.1f} us, burst={}",
+      (mLoadRate > 0. ? (1000000. / mLoadRate) : 0.), mLoadBurst);
+  }
 
   while (mRunning) {
 
     // Get the next STF
     std::unique_ptr<SubTimeFrame> lStf;
-    if (!mReadStfQueue.pop(lStf)) {
+    if (!mReadStfQueue->pop(lStf)) {
       break;
     }
 
@@ -476,41 +1039,39 @@ void SubTimeFrameFileSource::DataInjectThread()
     if (lStf) {
       lStf->setOrigin(SubTimeFrame::Header::Origin::eFile);
     }
+    const auto lOrbit = lStf ? lStf->header().mFirstOrbit : std::numeric_limits<std::uint32_t>::max();
+
+    // wait for the next token, or for resume if paused while waiting
+    while (mRunning) {
+      if (mPaused) {
+        std::unique_lock lLock(mPauseLock);
+        mPauseCond.wait(lLock, [&]() { return !mRunning || !mPaused; });
+        // reset the rate stats
+        lPacer.reset();
+        lOrbitPacer.reset();
+      }
 
-    static auto sRateStartTime = std::chrono::high_resolution_clock::now();
+      const auto lRunning = [&]() { return mRunning && !mPaused; };
+      if (mLoadTimed ? lOrbitPacer.acquire(lOrbit, lRunning) : lPacer.acquire(lRunning)) {
+        break;
+      }
+    }
 
-    while (mRunning && mPaused) {
-      std::this_thread::sleep_for(200ms);
-      // reset the rate stats
-      sRateStartTime = std::chrono::high_resolution_clock::now();
-      sNumSentStfs = 1;
+    if (!mRunning) {
+      break;
     }
 
     mPipelineI.queue(mPipelineStageOut, std::move(lStf));
-    sNumSentStfs++;
-
-    auto getElapsedTime = []() {
-      return std::max(1e-6, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() -
-        sRateStartTime).count());
-    };
-
-    // rate limiting
-    // calculate absolute times from the start to avoid skewing the rate over time
-    while(mRunning) {
-      const double lSecSinceStart = getElapsedTime();
-      const double lSecNext = sNumSentStfs / mLoadRate;
 
-      // check if we're done waiting
-      if ((lSecNext - lSecSinceStart) < 0.001) {
-        break;
+    if (mLoadTimed) {
+      if (std::chrono::steady_clock::now() - lStatsTime > 10s) {
+        lStatsTime = std::chrono::steady_clock::now();
+        lOrbitPacer.logStats();
       }
-
-      // limit sleep time to 0.5s in order to be able to check for exit signal
-      auto lWaitTime = std::clamp((lSecNext - lSecSinceStart) * 3. / 5., 0.001, 0.5);
-      std::this_thread::sleep_for(std::chrono::duration<double>(lWaitTime));
+    } else {
+      DDDLOG_RL(2000, "SubTimeFrameFileSource prepared_tfs={} inject_rate={:.4f}",
+        mReadStfQueue->size(), lPacer.rate());
     }
-    DDDLOG_RL(2000, "SubTimeFrameFileSource prepared_tfs={} inject_rate={:.4f}",
-      mReadStfQueue.size(), sNumSentStfs / getElapsedTime());
   }
 
   mPipelineI.close(mPipelineStageOut);
@@ -16,6 +16,7 @@
 
 #include "ConcurrentQueue.h"
 #include "SubTimeFrameBuilder.h"
+#include "SubTimeFrameFileReader.h"
 
 #include "DataDistLogger.h"
 
@@ -24,6 +25,8 @@
 
 #include <fstream>
 #include <vector>
+#include <mutex>
+#include <condition_variable>
 
 namespace o2
 {
@@ -61,6 +64,12 @@ class SubTimeFrameFileSource
       mLiveFiles[pIdx] = pFile;
     }
 
+    static bool isLive(const std::string &pPath) {
+      std::scoped_lock lLock(sLiveFilesLock);
+      return std::any_of(mLiveFiles.cbegin(), mLiveFiles.cend(),
+        [&](const auto &pFile) { return pFile.second->mFilePath == pPath; });
+    }
+
     static void putExistingInstance(const std::size_t pIdx) {
       std::scoped_lock lLock(sLiveFilesLock);
 
@@ -81,6 +90,7 @@ class SubTimeFrameFileSource
     StfFileMeta(const StfFileMeta &) = delete;
 
     ~StfFileMeta() {
+      mRegion.reset();
       if (mDeleteMe) {
         try {
           boost::filesystem::remove(mFilePath);
@@ -91,6 +101,8 @@ class SubTimeFrameFileSource
     std::string mFilePath;
     std::size_t mIdx;
     bool mDeleteMe;
+    // zero-copy: file content referenced by the STF payloads
+    std::shared_ptr<StfFileRegion> mRegion;
   };
 
  public:
@@ -98,12 +110,23 @@ class SubTimeFrameFileSource
   static constexpr const char* OptionKeyStfSourceDir = "data-source-dir";
   static constexpr const char* OptionKeyStfLoadRate = "data-source-rate";
   static constexpr const char* OptionKeyStfLoadPreRead = "data-source-preread";
+  static constexpr const char* OptionKeyStfLoadBurst = "data-source-burst";
+  static constexpr const char* OptionKeyStfLoadTimed = "data-source-timed";
+  static constexpr const char* OptionKeyStfLoadSpeedup = "data-source-speedup";
   static constexpr const char* OptionKeyStfSourceRepeat = "data-source-repeat";
   static constexpr const char* OptionKeyStfSourceRegionSize = "data-source-regionsize";
   static constexpr const char* OptionKeyStfHeadersRegionSize = "data-source-headersize";
 
   static constexpr const char* OptionKeyStfFileList = "data-source-file-list";
   static constexpr const char* OptionKeyStfCopyCmd = "data-source-copy-cmd";
+  static constexpr const char* OptionKeyStfSourceOrigins = "data-source-origins";
+  static constexpr const char* OptionKeyStfSourceSubSpecs = "data-source-subspecs";
+  static constexpr const char* OptionKeyStfSourceZeroCopy = "data-source-zero-copy";
+  static constexpr const char* OptionKeyStfSourceVerifyChecksums = "data-source-verify-checksums";
+  static constexpr const char* OptionKeyStfSourceFetchParallel = "data-source-fetch-parallel";
+  static constexpr const char* OptionKeyStfSourceFetchLookahead = "data-source-fetch-lookahead";
+  static constexpr const char* OptionKeyStfSourceCacheDir = "data-source-cache-dir";
+  static constexpr const char* OptionKeyStfSourceCacheSize = "data-source-cache-size";
 
 
   static bpo::options_description getProgramOptions();
@@ -129,8 +152,8 @@ class SubTimeFrameFileSource
   bool enabled() const { return mEnabled; }
 
   void start(MemoryResources &pMemRes, const bool pDplEnabled);
-  void pause() { mPaused = true; }
-  void resume() { mPaused = false; }
+  void pause();
+  void resume();
   void stop();
 
   void DataFetcherThread();
@@ -159,16 +182,42 @@ class SubTimeFrameFileSource
   std::string mCopyCmd;
   std::string mCopyCmdLogFile;
   boost::filesystem::path mCopyDstPath;
+  std::uint32_t mFetchParallel = 1;
+  std::uint32_t mFetchLookahead = 4;
+
+  /// Persistent cache of remote files: LRU by file modification time (updated on every use)
+  std::string mCacheDir;
+  std::uint64_t mCacheSize = 0;
+  std::string cacheFileName(const std::size_t pFileIdx) const;
+  static bool isCacheFileName(const std::string &pFileName);
+  void evictCache(const std::uint64_t pReserve);
 
   double mLoadRate = 1.f;
   std::uint32_t mPreReadStfs = 1;
+  std::uint32_t mLoadBurst = 1;
+  /// Timed replay: STFs are injected at the time of their first orbit, scaled by mLoadSpeedup
+  bool mLoadTimed = false;
+  double mLoadSpeedup = 1.0;
   std::size_t mRegionSizeMB = 1024; /* 1GB in MiB */
   std::size_t mHdrRegionSizeMB = 256;
+  StfFileReadFilter mReadFilter;
+  bool mVerifyChecksums = false;
+
+  /// Zero-copy: files are loaded into their own regions, kept for repeated reads up to the data region size
+  bool mZeroCopy = false;
+  std::shared_ptr<FairMQTransportFactory> mShmTransport;
+  std::map<std::size_t, std::shared_ptr<StfFileRegion>> mFileRegions;
+  std::uint64_t mFileRegionsSize = 0;
+  std::shared_ptr<StfFileRegion> getFileRegion(StfFileMeta &pFile);
 
   /// Thread for file writing
   std::atomic_bool mRunning = false;
   std::atomic_bool mPaused = false;
-  ConcurrentFifo<std::unique_ptr<SubTimeFrame>> mReadStfQueue;
+  std::mutex mPauseLock;
+  std::condition_variable mPauseCond;
+
+  /// Read-ahead queue: the reader blocks when mPreReadStfs STFs are prepared
+  std::unique_ptr<ConcurrentMpmcRing<std::unique_ptr<SubTimeFrame>>> mReadStfQueue;
 
   std::thread mFetchThread;
   std::thread mSourceThread;
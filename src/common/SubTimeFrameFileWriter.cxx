@@ -15,8 +15,15 @@
 #include "SubTimeFrameFileWriter.h"
 
 #include "DataDistLogger.h"
+#include "Crc32c.h"
 
 #include <iomanip>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace o2
 {
@@ -88,25 +95,303 @@ namespace impl {
   }
 
   template<class T>
-  static void sInfoVal(fmt::memory_buffer &pBuf, const SidecarInfoDataType pType, const T& pVal) {
+  static void sInfoVal(std::string &pBuf, const SidecarInfoDataType pType, const T& pVal) {
     const auto lHdrCnt = sizeof(sInfoData) / sizeof(SidecarInfoData);
     fmt::format_to(std::back_inserter(pBuf), sInfoData[pType].mValFmt, pVal);
     fmt::format_to(std::back_inserter(pBuf), "{}", (pType < lHdrCnt - 1) ? " " : "");
   }
 }
 
-SubTimeFrameFileWriter::SubTimeFrameFileWriter(const boost::filesystem::path& pFileName, bool pWriteInfo)
-  : mWriteInfo(pWriteInfo)
+////////////////////////////////////////////////////////////////////////////////
+/// DirectWriteStreamBuf
+////////////////////////////////////////////////////////////////////////////////
+
+DirectWriteStreamBuf::DirectWriteStreamBuf(const std::string &pFileName)
+{
+  mFd = ::open(pFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+  if (mFd < 0 && errno == EINVAL) {
+    // the file system does not support direct I/O (e.g. tmpfs)
+    WDDLOG("O_DIRECT is not supported for the TF file, using the page cache. file={}", pFileName);
+    mFd = ::open(pFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  }
+  if (mFd < 0) {
+    throw std::ios_base::failure(fmt::format("Cannot open {}: {}", pFileName, std::strerror(errno)));
+  }
+
+  for (auto &lBuf : mStaging) {
+    lBuf.mData = static_cast<char*>(std::aligned_alloc(sBlockSize, sStagingSize));
+    if (!lBuf.mData) {
+      ::close(mFd);
+      mFd = -1;
+      throw std::bad_alloc();
+    }
+  }
+
+#if defined(DATADIST_WITH_URING)
+  const int lRet = io_uring_queue_init(sNumStaging, &mRing, 0);
+  mUseRing = (lRet == 0);
+  if (!mUseRing) {
+    WDDLOG("io_uring is not available, direct TF file writes are synchronous. error={}", std::strerror(-lRet));
+  }
+#endif
+
+  setp(mStaging[mCurrIdx].mData, mStaging[mCurrIdx].mData + sStagingSize);
+}
+
+DirectWriteStreamBuf::~DirectWriteStreamBuf()
+{
+  close();
+
+#if defined(DATADIST_WITH_URING)
+  if (mUseRing) {
+    io_uring_queue_exit(&mRing);
+  }
+#endif
+
+  for (auto &lBuf : mStaging) {
+    std::free(lBuf.mData);
+  }
+}
+
+bool DirectWriteStreamBuf::writeBuffer(const unsigned pIdx, const std::size_t pLen, const std::uint64_t pOffset)
+{
+  auto &lBuf = mStaging[pIdx];
+  assert (!lBuf.mInFlight && (pLen % sBlockSize == 0));
+  lBuf.mLen = pLen;
+
+#if defined(DATADIST_WITH_URING)
+  if (mUseRing) {
+    // at most sNumStaging writes are in flight, the submission queue cannot be full
+    struct io_uring_sqe *lSqe = io_uring_get_sqe(&mRing);
+    if (lSqe) {
+      io_uring_prep_write(lSqe, mFd, lBuf.mData, unsigned(pLen), pOffset);
+      io_uring_sqe_set_data(lSqe, &lBuf);
+      const int lRet = io_uring_submit(&mRing);
+      if (lRet == 1) {
+        lBuf.mInFlight = true;
+        return true;
+      }
+      EDDLOG_RL(1000, "io_uring submission of a TF file write failed. error={}", std::strerror(-lRet));
+    }
+    mError = true;
+    return false;
+  }
+#endif
+
+  std::size_t lWritten = 0;
+  while (lWritten < pLen) {
+    const ssize_t lRet = ::pwrite(mFd, lBuf.mData + lWritten, pLen - lWritten, pOffset + lWritten);
+    if (lRet < 0 && errno == EINTR) {
+      continue;
+    }
+    if (lRet <= 0) {
+      EDDLOG_RL(1000, "Writing to TF file failed. error={}", std::strerror(errno));
+      mError = true;
+      return false;
+    }
+    lWritten += std::size_t(lRet);
+  }
+  return true;
+}
+
+bool DirectWriteStreamBuf::waitBuffer(const unsigned pIdx)
+{
+#if defined(DATADIST_WITH_URING)
+  while (mStaging[pIdx].mInFlight) {
+    struct io_uring_cqe *lCqe = nullptr;
+    const int lRet = io_uring_wait_cqe(&mRing, &lCqe);
+    if (lRet == -EINTR) {
+      continue;
+    }
+    if (lRet < 0) {
+      EDDLOG_RL(1000, "io_uring completion of a TF file write failed. error={}", std::strerror(-lRet));
+      mError = true;
+      return false;
+    }
+
+    auto *lBuf = static_cast<StagingBuffer*>(io_uring_cqe_get_data(lCqe));
+    if (lCqe->res < 0 || std::size_t(lCqe->res) != lBuf->mLen) {
+      // short writes are not retried: the file is already inconsistent
+      EDDLOG_RL(1000, "Writing to TF file failed. ret={} size={}", lCqe->res, lBuf->mLen);
+      mError = true;
+    }
+    lBuf->mInFlight = false;
+    io_uring_cqe_seen(&mRing, lCqe);
+  }
+#else
+  (void) pIdx;
+#endif
+  return !mError;
+}
+
+bool DirectWriteStreamBuf::submitBlocks()
+{
+  if (mError) {
+    return false;
+  }
+
+  const std::size_t lLen = pptr() - pbase();
+  const std::size_t lAligned = lLen & ~(sBlockSize - 1);
+  if (lAligned == 0) {
+    return true;
+  }
+
+  const unsigned lNextIdx = (mCurrIdx + 1) % sNumStaging;
+  if (!writeBuffer(mCurrIdx, lAligned, mBufOffset) || !waitBuffer(lNextIdx)) {
+    return false;
+  }
+
+  // the buffer in flight is only read, the tail can be copied out
+  const std::size_t lTail = lLen - lAligned;
+  std::memcpy(mStaging[lNextIdx].mData, mStaging[mCurrIdx].mData + lAligned, lTail);
+
+  mBufOffset += lAligned;
+  mCurrIdx = lNextIdx;
+  setp(mStaging[mCurrIdx].mData, mStaging[mCurrIdx].mData + sStagingSize);
+  pbump(int(lTail));
+  return true;
+}
+
+DirectWriteStreamBuf::int_type DirectWriteStreamBuf::overflow(int_type pCh)
+{
+  if (!submitBlocks()) {
+    return traits_type::eof();
+  }
+  if (!traits_type::eq_int_type(pCh, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(pCh);
+    pbump(1);
+    return pCh;
+  }
+  return traits_type::not_eof(pCh);
+}
+
+std::streamsize DirectWriteStreamBuf::xsputn(const char_type *pData, std::streamsize pCount)
+{
+  std::streamsize lWritten = 0;
+  while (lWritten < pCount) {
+    if (pptr() == epptr() && !submitBlocks()) {
+      break;
+    }
+    const auto lToCopy = std::min(pCount - lWritten, std::streamsize(epptr() - pptr()));
+    std::memcpy(pptr(), pData + lWritten, lToCopy);
+    pbump(int(lToCopy));
+    lWritten += lToCopy;
+  }
+  return lWritten;
+}
+
+int DirectWriteStreamBuf::sync()
+{
+  // only complete blocks are written, the tail stays staged until close()
+  return submitBlocks() ? 0 : -1;
+}
+
+DirectWriteStreamBuf::pos_type DirectWriteStreamBuf::seekoff(off_type pOff, std::ios_base::seekdir pDir,
+  std::ios_base::openmode pMode)
+{
+  // only tellp() is supported
+  if (pOff != 0 || pDir != std::ios_base::cur || !(pMode & std::ios_base::out)) {
+    return pos_type(off_type(-1));
+  }
+  return pos_type(off_type(mBufOffset + (pptr() - pbase())));
+}
+
+bool DirectWriteStreamBuf::close()
+{
+  if (mFd < 0) {
+    return !mError;
+  }
+
+  submitBlocks();
+  for (unsigned i = 0; i < sNumStaging; i++) {
+    waitBuffer(i);
+  }
+
+  // pad the last block and truncate the file to the written size
+  const std::size_t lTail = pptr() - pbase();
+  const std::uint64_t lFileSize = mBufOffset + lTail;
+  if (!mError && lTail > 0) {
+    const std::size_t lPadded = (lTail + sBlockSize - 1) & ~(sBlockSize - 1);
+    std::memset(pptr(), 0, lPadded - lTail);
+#if defined(DATADIST_WITH_URING)
+    // the last write is synchronous
+    mUseRing = false;
+    io_uring_queue_exit(&mRing);
+#endif
+    writeBuffer(mCurrIdx, lPadded, mBufOffset);
+  }
+  if (!mError && ::ftruncate(mFd, off_t(lFileSize)) != 0) {
+    EDDLOG("Truncating TF file failed. error={}", std::strerror(errno));
+    mError = true;
+  }
+
+  ::close(mFd);
+  mFd = -1;
+  setp(nullptr, nullptr);
+  return !mError;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// SubTimeFrameFileWriter
+////////////////////////////////////////////////////////////////////////////////
+
+std::string SubTimeFrameFileWriter::sidecarTextHeader()
+{
+  return impl::sInfoToHdrString();
+}
+
+void SubTimeFrameFileWriter::sidecarTextRow(std::string &pRow, const SubTimeFrameFileSidecar::Record &pRec,
+  const char *pData)
+{
+  impl::sInfoVal(pRow, impl::TF_ID, pRec.mTfId);
+  impl::sInfoVal(pRow, impl::TF_OFFSET, pRec.mTfOffset);
+  impl::sInfoVal(pRow, impl::TF_SIZE, pRec.mTfSize);
+  impl::sInfoVal(pRow, impl::ORIGIN, pRec.mDataOrigin.str);
+  impl::sInfoVal(pRow, impl::DESC, pRec.mDataDescription.str);
+  impl::sInfoVal(pRow, impl::SUBSPEC, pRec.mSubSpecification);
+  impl::sInfoVal(pRow, impl::DATA_IDX, pRec.mDataIndex);
+  impl::sInfoVal(pRow, impl::HDR_OFF, pRec.mHdrOffset);
+  impl::sInfoVal(pRow, impl::HDR_SIZE, pRec.mHdrSize);
+  impl::sInfoVal(pRow, impl::DATA_OFF, pRec.mDataOffset);
+  impl::sInfoVal(pRow, impl::DATA_SIZE, pRec.mDataSize);
+
+  // only if the O2 header is RAWDATA
+  if (pData && pRec.mDataDescription == gDataDescriptionRawData) {
+    try {
+      ReadoutDataUtils::withRdhReader([&](auto pReaderTag) {
+        using ReaderT = typename decltype(pReaderTag)::Reader;
+
+        const auto R = ReaderT(pData, pRec.mDataSize);
+        const auto [l12MemSize, l13StopBit] = ReadoutDataUtils::getHBFrameMemorySize<ReaderT>(pData, pRec.mDataSize);
+
+        impl::sInfoVal(pRow, impl::RDH_MEM_SIZE, l12MemSize);
+        impl::sInfoVal(pRow, impl::RDH_STOP_BIT, l13StopBit ? 1 : 0);
+        impl::sInfoVal(pRow, impl::RDH_FEE_ID, R.getFeeID());
+        impl::sInfoVal(pRow, impl::RDH_ORBIT, R.getOrbit());
+        impl::sInfoVal(pRow, impl::RDH_BC, R.getBC());
+        impl::sInfoVal(pRow, impl::RDH_TRG, R.getTriggerType());
+      });
+    } catch (RDHReaderException &e) {
+      EDDLOG( e.what());
+    }
+  }
+}
+
+SubTimeFrameFileWriter::SubTimeFrameFileWriter(const boost::filesystem::path& pFileName, SidecarFormat pSidecar,
+  WriteEngine pEngine, bool pTfIndex, bool pChecksums)
+  : mWriteTfIndex(pTfIndex),
+    mChecksums(pChecksums),
+    mSidecar(pSidecar)
 {
   using ios = std::ios_base;
 
   // allocate and set the larger stream buffer
-  mFileBuf = std::make_unique<char[]>(sBuffSize);
-  mFile.rdbuf()->pubsetbuf(mFileBuf.get(), sBuffSize);
-  mFile.clear();
-  mFile.exceptions(std::fstream::failbit | std::fstream::badbit);
+  if (pEngine == WriteEngine::Stream) {
+    mFileBuf = std::make_unique<char[]>(sBuffSize);
+    mFileStreamBuf.pubsetbuf(mFileBuf.get(), sBuffSize);
+  }
   // allocate and set the larger stream buffer (info file)
-  if (mWriteInfo) {
+  if (mSidecar != SidecarFormat::None) {
     mInfoFileBuf = std::make_unique<char[]>(sBuffSize);
     mInfoFile.rdbuf()->pubsetbuf(mInfoFileBuf.get(), sBuffSize);
     mInfoFile.clear();
@@ -114,14 +399,34 @@ SubTimeFrameFileWriter::SubTimeFrameFileWriter(const boost::filesystem::path& pF
   }
 
   try {
-    mFile.open(pFileName.string(), ios::binary | ios::trunc | ios::out | ios::ate);
+    if (pEngine == WriteEngine::Direct) {
+      mFileDirectBuf = std::make_unique<DirectWriteStreamBuf>(pFileName.string());
+      mFile.rdbuf(mFileDirectBuf.get());
+    } else {
+      if (!mFileStreamBuf.open(pFileName.string(), ios::binary | ios::trunc | ios::out | ios::ate)) {
+        throw std::ios_base::failure("Cannot open " + pFileName.string());
+      }
+      mFile.rdbuf(&mFileStreamBuf);
+    }
+    mFile.exceptions(std::fstream::failbit | std::fstream::badbit);
 
-    if (mWriteInfo) {
+    if (mSidecar == SidecarFormat::Text) {
       auto lInfoFileName = pFileName.string();
       lInfoFileName += ".info";
 
       mInfoFile.open(lInfoFileName, ios::trunc | ios::out);
       mInfoFile << impl::sInfoToHdrString() << '\n';
+    } else if (mSidecar == SidecarFormat::Binary) {
+      auto lInfoFileName = pFileName.string();
+      lInfoFileName += ".info.bin";
+
+      mInfoFile.open(lInfoFileName, ios::binary | ios::trunc | ios::out);
+
+      SubTimeFrameFileSidecar::FileHeader lHdr;
+      lHdr.mRecordSize = sizeof(SubTimeFrameFileSidecar::Record);
+      mInfoFile.write(reinterpret_cast<const char*>(&lHdr), sizeof(lHdr));
+
+      mSidecarThread = create_thread_member("stf_sidecar", &SubTimeFrameFileWriter::SidecarThread, this);
     }
   } catch (std::ifstream::failure& eOpenErr) {
     EDDLOG("Failed to open/create TF file for writing. error={}", eOpenErr.what());
@@ -131,9 +436,24 @@ SubTimeFrameFileWriter::SubTimeFrameFileWriter(const boost::filesystem::path& pF
 
 SubTimeFrameFileWriter::~SubTimeFrameFileWriter()
 {
+  // write the queued sidecar records
+  mSidecarQueue.stop();
+  if (mSidecarThread.joinable()) {
+    mSidecarThread.join();
+  }
+
   try {
-    mFile.close();
-    if (mWriteInfo) {
+    // TF-ID seek footer
+    if (mWriteTfIndex && !mTfIndex.empty() && mFile.good()) {
+      mFile << mTfIndex;
+      mFile.flush();
+    }
+
+    const bool lClosed = mFileDirectBuf ? mFileDirectBuf->close() : (mFileStreamBuf.close() != nullptr);
+    if (!lClosed) {
+      EDDLOG("Closing TF file failed.");
+    }
+    if (mInfoFile.is_open()) {
       mInfoFile.close();
     }
   } catch (std::ifstream::failure& eCloseErr) {
@@ -143,10 +463,36 @@ SubTimeFrameFileWriter::~SubTimeFrameFileWriter()
   }
 }
 
+void SubTimeFrameFileWriter::SidecarThread()
+{
+  bool lFailed = false;
+
+  while (true) {
+    auto lRecordsOpt = mSidecarQueue.pop();
+    if (!lRecordsOpt) {
+      break;
+    }
+
+    if (lFailed) {
+      continue;
+    }
+
+    const auto &lRecords = lRecordsOpt.value();
+    try {
+      mInfoFile.write(reinterpret_cast<const char*>(lRecords.data()),
+        lRecords.size() * sizeof(SubTimeFrameFileSidecar::Record));
+    } catch (const std::ios_base::failure& eFailExc) {
+      EDDLOG("Writing the sidecar file failed. error={}", eFailExc.what());
+      lFailed = true;
+    }
+  }
+}
+
 void SubTimeFrameFileWriter::visit(const SubTimeFrame& pStf)
 {
   assert(mStfData.empty() && mStfSize == 0);
   assert(mStfDataIndex.empty());
+  mStfDataIndex.setChecksums(mChecksums);
 
   // Write data in lexicographical order of DataIdentifier + subSpecification
   // for easier binary comparison
@@ -158,7 +504,7 @@ void SubTimeFrameFileWriter::visit(const SubTimeFrame& pStf)
 
   for (const auto& lEquip : lEquipIds) {
 
-    const auto& lEquipDataVec = pStf.mData.at(lEquip).at(lEquip.mSubSpecification);
+    const auto lEquipDataVec = pStf.mData.find(lEquip);
 
     for (const auto& lData : lEquipDataVec) {
       // NOTE: get only pointers to <hdr, data> struct
@@ -174,6 +520,10 @@ void SubTimeFrameFileWriter::visit(const SubTimeFrame& pStf)
       auto & [ lSize, lCnt ] = lDataIdSizeCnt[lEquip];
       lSize += lHdrDataSize;
       lCnt++;
+
+      if (mChecksums) {
+        mStfDataIndex.AddChecksum(Crc32c::compute(lData.mData->GetData(), lData.mData->GetSize()));
+      }
     }
   }
 
@@ -223,6 +573,9 @@ std::uint64_t SubTimeFrameFileWriter::_write(const SubTimeFrame& pStf)
   std::uint64_t lDataOffset = 0;
 
   SubTimeFrameFileMeta lStfFileMeta(lStfSizeInFile);
+  if (mChecksums) {
+    lStfFileMeta.mStfFileVersion = SubTimeFrameFileMeta::sVersionChecksums;
+  }
 
   try {
     // Write DataHeader + SubTimeFrameFileMeta
@@ -251,71 +604,60 @@ std::uint64_t SubTimeFrameFileWriter::_write(const SubTimeFrame& pStf)
 
   assert((size() - lPrevSize == lStfSizeInFile) && "Calculated and written sizes differ");
 
+  // the TF id and first orbit of the first data header: the same as found by readers scanning the file
+  if (mWriteTfIndex) {
+    if (!mStfData.empty()) {
+      const DataHeader &lFirstDh = mStfData.front()->getDataHeader();
+      mTfIndex.AddTfElement(lFirstDh.tfCounter, lPrevSize, lStfSizeInFile, lFirstDh.firstTForbit);
+    } else {
+      mTfIndex.AddTfElement(pStf.header().mId, lPrevSize, lStfSizeInFile, pStf.header().mFirstOrbit);
+    }
+  }
+
   // sidecar
-  if (mWriteInfo) {
+  if (mSidecar != SidecarFormat::None) {
 
-    try {
+    std::vector<SubTimeFrameFileSidecar::Record> lRecords;
+    lRecords.reserve(mStfData.size());
 
-      const auto l1StfId = pStf.header().mId;
-      const auto l2StfFileOff = lPrevSize;
-      const auto l3StfFileSize = lStfSizeInFile;
-
-      for (const auto& lStfData : mStfData) {
-        fmt::memory_buffer lValRow;
-
-        const DataHeader &lDH = lStfData->getDataHeader();
-
-        const auto& l4DataOrigin = lDH.dataOrigin;
-        const auto& l5DataDescription = lDH.dataDescription;
-        const auto l6SubSpec = lDH.subSpecification;
-        const auto l7DataIndex = lDH.splitPayloadIndex;
-
-        const auto l8HdrOff = lDataOffset;
-        lDataOffset += lStfData->mHeader->GetSize();
-        const auto l9HdrSize = lStfData->mHeader->GetSize();
-        const auto l10DataOff = lDataOffset;
-        lDataOffset += lStfData->mData->GetSize();
-        const auto l11DataSize = lStfData->mData->GetSize();
-
-        impl::sInfoVal(lValRow, impl::TF_ID, l1StfId);
-        impl::sInfoVal(lValRow, impl::TF_OFFSET, l2StfFileOff);
-        impl::sInfoVal(lValRow, impl::TF_SIZE, l3StfFileSize);
-        impl::sInfoVal(lValRow, impl::ORIGIN, l4DataOrigin.str);
-        impl::sInfoVal(lValRow, impl::DESC, l5DataDescription.str);
-        impl::sInfoVal(lValRow, impl::SUBSPEC, l6SubSpec);
-        impl::sInfoVal(lValRow, impl::DATA_IDX, l7DataIndex);
-        impl::sInfoVal(lValRow, impl::HDR_OFF, l8HdrOff);
-        impl::sInfoVal(lValRow, impl::HDR_SIZE, l9HdrSize);
-        impl::sInfoVal(lValRow, impl::DATA_OFF, l10DataOff);
-        impl::sInfoVal(lValRow, impl::DATA_SIZE, l11DataSize);
-
-        // only if the O2 header is RAWDATA
-        if (lDH.dataDescription == gDataDescriptionRawData) {
-          try {
-            const auto R = RDHReader(lStfData->mData);
-            const auto [l12MemSize, l13StopBit] = ReadoutDataUtils::getHBFrameMemorySize(lStfData->mData);
-            const auto l14FeeId = R.getFeeID();
-            const auto l15Orbit = R.getOrbit();
-            const auto l16Bc = R.getBC();
-            const auto l17Trig = R.getTriggerType();
-
-            impl::sInfoVal(lValRow, impl::RDH_MEM_SIZE, l12MemSize);
-            impl::sInfoVal(lValRow, impl::RDH_STOP_BIT, l13StopBit ? 1 : 0);
-            impl::sInfoVal(lValRow, impl::RDH_FEE_ID, l14FeeId);
-            impl::sInfoVal(lValRow, impl::RDH_ORBIT, l15Orbit);
-            impl::sInfoVal(lValRow, impl::RDH_BC, l16Bc);
-            impl::sInfoVal(lValRow, impl::RDH_TRG, l17Trig);
-          } catch (RDHReaderException &e) {
-            EDDLOG( e.what());
-          }
-        }
+    for (const auto& lStfData : mStfData) {
+      const DataHeader &lDH = lStfData->getDataHeader();
+
+      SubTimeFrameFileSidecar::Record lRec;
+      lRec.mTfId = pStf.header().mId;
+      lRec.mTfOffset = lPrevSize;
+      lRec.mTfSize = lStfSizeInFile;
+      lRec.mDataOrigin = lDH.dataOrigin;
+      lRec.mDataDescription = lDH.dataDescription;
+      lRec.mSubSpecification = lDH.subSpecification;
+      lRec.mDataIndex = lDH.splitPayloadIndex;
+
+      // only the DataHeader is written for each block
+      lRec.mHdrOffset = lDataOffset;
+      lRec.mHdrSize = sizeof(DataHeader);
+      lDataOffset += sizeof(DataHeader);
+      lRec.mDataOffset = lDataOffset;
+      lRec.mDataSize = lStfData->mData->GetSize();
+      lDataOffset += lStfData->mData->GetSize();
+
+      lRecords.push_back(lRec);
+    }
 
-        mInfoFile << std::string_view(lValRow.begin(), lValRow.size()) << '\n';
+    if (mSidecar == SidecarFormat::Binary) {
+      mSidecarQueue.push(std::move(lRecords));
+    } else {
+      try {
+        std::string lValRow;
+        for (std::size_t i = 0; i < lRecords.size(); i++) {
+          lValRow.clear();
+          sidecarTextRow(lValRow, lRecords[i], reinterpret_cast<const char*>(mStfData[i]->mData->GetData()));
+          mInfoFile << lValRow << '\n';
+        }
+        mInfoFile.flush();
+      } catch (const std::ios_base::failure& eFailExc) {
+        EDDLOG("Writing to file failed. error={}", eFailExc.what());
+        return std::uint64_t(0);
       }
-      mInfoFile.flush();
-    } catch (const std::ios_base::failure& eFailExc) {
-      EDDLOG("Writing to file failed. error={}", eFailExc.what());
-      return std::uint64_t(0);
     }
   }
 
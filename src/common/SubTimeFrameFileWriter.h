@@ -16,18 +16,80 @@
 
 #include "SubTimeFrameDataModel.h"
 #include "SubTimeFrameFile.h"
+#include "ConcurrentQueue.h"
 #include <Headers/DataHeader.h>
 
 #include <type_traits>
 #include <boost/filesystem.hpp>
 #include <fstream>
+#include <streambuf>
+#include <array>
 #include <vector>
+#include <string>
+#include <thread>
+
+#if defined(DATADIST_WITH_URING)
+#include <liburing.h>
+#endif
 
 namespace o2
 {
 namespace DataDistribution
 {
 
+////////////////////////////////////////////////////////////////////////////////
+/// DirectWriteStreamBuf
+////////////////////////////////////////////////////////////////////////////////
+
+/// Output stream buffer for O_DIRECT files
+///
+/// Data is collected in aligned staging buffers and written in multiples of the block size. Full
+/// buffers are submitted asynchronously with io_uring (if available) while the next buffer is filled.
+/// The unaligned tail is padded on close() and the file is truncated to the written size.
+class DirectWriteStreamBuf : public std::streambuf
+{
+ public:
+  static constexpr std::size_t sBlockSize = 4096;
+  static constexpr std::size_t sStagingSize = 8ul << 20; // 8 MiB
+  static constexpr unsigned sNumStaging = 4;
+
+  DirectWriteStreamBuf() = delete;
+  explicit DirectWriteStreamBuf(const std::string &pFileName);
+  ~DirectWriteStreamBuf() override;
+
+  /// Write all data and close the file. Returns false on write errors
+  bool close();
+
+ protected:
+  int_type overflow(int_type pCh) override;
+  std::streamsize xsputn(const char_type *pData, std::streamsize pCount) override;
+  int sync() override;
+  pos_type seekoff(off_type pOff, std::ios_base::seekdir pDir, std::ios_base::openmode pMode) override;
+
+ private:
+  /// submit all complete blocks of the current staging buffer and move the tail to the next one
+  bool submitBlocks();
+  bool writeBuffer(const unsigned pIdx, const std::size_t pLen, const std::uint64_t pOffset);
+  bool waitBuffer(const unsigned pIdx);
+
+  struct StagingBuffer {
+    char *mData = nullptr;
+    std::size_t mLen = 0;
+    bool mInFlight = false;
+  };
+
+  int mFd = -1;
+  bool mError = false;
+  std::uint64_t mBufOffset = 0; // file offset of the current staging buffer
+  unsigned mCurrIdx = 0;
+  std::array<StagingBuffer, sNumStaging> mStaging;
+
+#if defined(DATADIST_WITH_URING)
+  bool mUseRing = false;
+  struct io_uring mRing;
+#endif
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /// SubTimeFrameFileWriter
 ////////////////////////////////////////////////////////////////////////////////
@@ -38,10 +100,24 @@ class SubTimeFrameFileWriter : public ISubTimeFrameConstVisitor
   static const constexpr char* sSidecarRecordSep = "\n";
 
  public:
+  /// Stream: buffered std::filebuf, Direct: O_DIRECT with aligned staging buffers (same file format)
+  enum class WriteEngine { Stream, Direct };
+
+  /// Text: formatted rows (".info"), Binary: SubTimeFrameFileSidecar records (".info.bin") written by a
+  /// separate thread. Binary sidecars are converted to the text format offline (StfSidecarConvert).
+  enum class SidecarFormat { None, Text, Binary };
+
   SubTimeFrameFileWriter() = delete;
-  SubTimeFrameFileWriter(const boost::filesystem::path& pFileName, bool pWriteInfo = false);
+  /// pTfIndex: append the TF-ID seek footer (SubTimeFrameFileTfIndex) when the file is closed
+  /// pChecksums: store the CRC32C of each data block in the STF index (file version 2)
+  SubTimeFrameFileWriter(const boost::filesystem::path& pFileName, SidecarFormat pSidecar = SidecarFormat::None,
+    WriteEngine pEngine = WriteEngine::Stream, bool pTfIndex = false, bool pChecksums = false);
   virtual ~SubTimeFrameFileWriter();
 
+  /// Text sidecar format: header line, and the row of a data block (RDH fields only if pData is not null)
+  static std::string sidecarTextHeader();
+  static void sidecarTextRow(std::string &pRow, const SubTimeFrameFileSidecar::Record &pRec, const char *pData);
+
   ///
   /// Writes a (Sub)TimeFrame
   ///
@@ -65,11 +141,23 @@ class SubTimeFrameFileWriter : public ISubTimeFrameConstVisitor
   //
   static constexpr std::streamsize sBuffSize = 1ul << 20; // 1 MiB
   static constexpr std::streamsize sChunkSize = 512;
-  std::ofstream mFile;
+  std::filebuf mFileStreamBuf;
+  std::unique_ptr<DirectWriteStreamBuf> mFileDirectBuf;
+  std::ostream mFile{nullptr};
+
+  bool mWriteTfIndex;
+  SubTimeFrameFileTfIndex mTfIndex;
 
-  bool mWriteInfo;
+  bool mChecksums;
+
+  SidecarFormat mSidecar;
   std::ofstream mInfoFile;
 
+  /// binary sidecar: records of one (Sub)TimeFrame are written by the sidecar thread
+  ConcurrentFifo<std::vector<SubTimeFrameFileSidecar::Record>> mSidecarQueue;
+  std::thread mSidecarThread;
+  void SidecarThread();
+
   std::unique_ptr<char[]> mFileBuf;
   std::unique_ptr<char[]> mInfoFileBuf;
 
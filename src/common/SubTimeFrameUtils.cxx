@@ -16,6 +16,9 @@
 #include "SubTimeFrameDataModel.h"
 #include "DataModelUtils.h"
 
+#include <boost/algorithm/string.hpp>
+
+#include <cstring>
 #include <stdexcept>
 
 #include <vector>
@@ -30,40 +33,50 @@ namespace DataDistribution
 /// DataOriginSplitter
 ////////////////////////////////////////////////////////////////////////////////
 
+namespace {
+
+inline bool selected(const DataIdentifierSplitter::Selection& pSelection, const EquipmentIdentifier& pEqId)
+{
+  for (const auto& lIden : pSelection) {
+    if ((lIden.dataOrigin == gDataOriginAny || lIden.dataOrigin == pEqId.mDataOrigin) &&
+        (lIden.dataDescription == gDataDescriptionAny || lIden.dataDescription == pEqId.mDataDescription)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} /* namespace */
+
 void DataIdentifierSplitter::visit(SubTimeFrame& pStf)
 {
-  std::vector<DataIdentifier> lToErase;
+  if (mRoutes) {
+    route(pStf);
+    return;
+  }
 
   if (mDataIdentifier.dataOrigin == gDataOriginAny) {
     mSubTimeFrame = std::make_unique<SubTimeFrame>(std::move(pStf));
+    pStf.clear();
+    return;
   } else if (mDataIdentifier.dataDescription == gDataDescriptionAny) {
     // filter any source with requested origin
-    mSubTimeFrame = std::make_unique<SubTimeFrame>(pStf.header().mId);
-    for (auto& lKeyData : pStf.mData) {
-      const DataIdentifier& lIden = lKeyData.first;
-      if (lIden.dataOrigin == mDataIdentifier.dataOrigin) {
-        // use the equipment identifier of the object
-        mSubTimeFrame->mData[lIden] = std::move(lKeyData.second);
-        lToErase.push_back(lIden);
-      }
-    }
+    mSubTimeFrame = SubTimeFramePool::get(pStf.header().mId);
+    pStf.mData.extract([this](const DataIdentifier& lIden) {
+      return lIden.dataOrigin == mDataIdentifier.dataOrigin;
+    }, mSubTimeFrame->mData);
   } else {
     /* find the exact match */
-    mSubTimeFrame = std::make_unique<SubTimeFrame>(pStf.header().mId);
-
-    for (auto& lKeyData : pStf.mData) {
-      const DataIdentifier& lIden = lKeyData.first;
-      if (lIden == mDataIdentifier) {
-        // use the equipment identifier of the object
-        mSubTimeFrame->mData[lIden] = std::move(lKeyData.second);
-        lToErase.push_back(lIden);
-      }
-    }
+    mSubTimeFrame = SubTimeFramePool::get(pStf.header().mId);
+    pStf.mData.extract([this](const DataIdentifier& lIden) {
+      return lIden == mDataIdentifier;
+    }, mSubTimeFrame->mData);
   }
 
-  // erase forked elements
-  for (auto& lIden : lToErase)
-    pStf.mData.erase(lIden);
+  // forked elements are removed: only the extracted part is accounted again
+  mSubTimeFrame->mDataSize = mSubTimeFrame->calculateDataSize();
+  pStf.mDataSize -= mSubTimeFrame->mDataSize;
+  pStf.mDataUpdated = false;
 }
 
 std::unique_ptr<SubTimeFrame> DataIdentifierSplitter::split(SubTimeFrame& pStf, const DataIdentifier& pDataIdent)
@@ -74,5 +87,105 @@ std::unique_ptr<SubTimeFrame> DataIdentifierSplitter::split(SubTimeFrame& pStf,
 
   return std::move(mSubTimeFrame);
 }
+
+void DataIdentifierSplitter::route(SubTimeFrame& pStf)
+{
+  const auto& lRoutes = *mRoutes;
+
+  mRoutedStfs.clear();
+  for (std::size_t i = 0; i < lRoutes.size(); i++) {
+    auto lStf = SubTimeFramePool::get(pStf.header().mId);
+    lStf->mHeader = pStf.mHeader;
+    lStf->mNumMissingStfs = pStf.mNumMissingStfs;
+    mRoutedStfs.push_back(std::move(lStf));
+  }
+
+  std::vector<std::size_t> lDests;
+  lDests.reserve(lRoutes.size());
+
+  pStf.mData.for_each([&](const EquipmentIdentifier& pEqId, const SubTimeFrame::StfDataIndex::Range& pRange) {
+    lDests.clear();
+    for (std::size_t i = 0; i < lRoutes.size(); i++) {
+      if (selected(lRoutes[i], pEqId)) {
+        lDests.push_back(i);
+      }
+    }
+
+    if (lDests.empty()) {
+      return; // released with the source STF
+    }
+
+    for (auto& lStfData : pRange) {
+      for (std::size_t d = 0; d < lDests.size() - 1; d++) {
+        // headers can be adapted in place by each destination
+        auto lHdr = lStfData.mHeader->GetTransport()->CreateMessage(lStfData.mHeader->GetSize());
+        std::memcpy(lHdr->GetData(), lStfData.mHeader->GetData(), lStfData.mHeader->GetSize());
+
+        auto lData = lStfData.mData->GetTransport()->CreateMessage();
+        lData->Copy(*lStfData.mData);
+
+        mRoutedStfs[lDests[d]]->addStfData(SubTimeFrame::StfData(std::move(lHdr), std::move(lData)));
+      }
+
+      // the last destination takes the original messages
+      mRoutedStfs[lDests.back()]->addStfData(
+        SubTimeFrame::StfData(std::move(lStfData.mHeader), std::move(lStfData.mData)));
+    }
+  });
+
+  pStf.clear();
+
+  // headers were updated before the split
+  for (auto& lStf : mRoutedStfs) {
+    lStf->mDataUpdated = true;
+    lStf->mStfHeaderChanged = false;
+  }
+}
+
+std::vector<std::unique_ptr<SubTimeFrame>> DataIdentifierSplitter::split(SubTimeFrame& pStf, const RoutingTable& pRoutes)
+{
+  mRoutes = &pRoutes;
+
+  pStf.accept(*this);
+
+  mRoutes = nullptr;
+  return std::move(mRoutedStfs);
+}
+
+bool DataIdentifierSplitter::parseSelection(const std::string& pStr, Selection& pSelection)
+{
+  std::vector<std::string> lIdenStrs;
+  boost::split(lIdenStrs, pStr, boost::is_any_of(","), boost::token_compress_on);
+
+  pSelection.clear();
+  for (auto& lIdenStr : lIdenStrs) {
+    boost::algorithm::trim(lIdenStr);
+    if (lIdenStr.empty()) {
+      continue;
+    }
+
+    DataIdentifier lIden;
+    lIden.dataOrigin = gDataOriginAny;
+    lIden.dataDescription = gDataDescriptionAny;
+
+    const auto lSep = lIdenStr.find('/');
+    const auto lOriginStr = boost::to_upper_copy(lIdenStr.substr(0, lSep));
+    const auto lDescStr = (lSep == std::string::npos) ? std::string() : boost::to_upper_copy(lIdenStr.substr(lSep + 1));
+
+    if (lOriginStr.empty() || lOriginStr.size() > DataOrigin::size || lDescStr.size() > DataDescription::size) {
+      return false;
+    }
+
+    if (lOriginStr != "*") {
+      lIden.dataOrigin.runtimeInit(lOriginStr.c_str());
+    }
+    if (!lDescStr.empty() && lDescStr != "*") {
+      lIden.dataDescription.runtimeInit(lDescStr.c_str());
+    }
+    pSelection.push_back(lIden);
+  }
+
+  return !pSelection.empty();
+}
 }
 } /* o2::DataDistribution */
@@ -18,6 +18,9 @@
 
 #include <Headers/DataHeader.h>
 
+#include <string>
+#include <vector>
+
 namespace o2
 {
 namespace DataDistribution
@@ -32,14 +35,30 @@ using namespace o2::header;
 class DataIdentifierSplitter : public ISubTimeFrameVisitor
 {
  public:
+  // data identifiers selected by each destination (origin or description can be 'Any')
+  using Selection = std::vector<DataIdentifier>;
+  using RoutingTable = std::vector<Selection>;
+
   DataIdentifierSplitter() = default;
   std::unique_ptr<SubTimeFrame> split(SubTimeFrame& pStf, const DataIdentifier& pDataIdent);
 
+  /// Split the STF into one STF per destination in one pass. Data selected by several destinations is shared:
+  /// payload messages are reference counted, only headers are copied. Data not selected by any destination is
+  /// released. pStf is empty afterwards.
+  std::vector<std::unique_ptr<SubTimeFrame>> split(SubTimeFrame& pStf, const RoutingTable& pRoutes);
+
+  /// "ORIG[/DESC],..." or "*" for all data
+  static bool parseSelection(const std::string& pStr, Selection& pSelection /*out*/);
+
  private:
   void visit(SubTimeFrame& pStf) override;
+  void route(SubTimeFrame& pStf);
 
   DataIdentifier mDataIdentifier;
   std::unique_ptr<SubTimeFrame> mSubTimeFrame;
+
+  const RoutingTable* mRoutes = nullptr;
+  std::vector<std::unique_ptr<SubTimeFrame>> mRoutedStfs;
 };
 }
 } /* o2::DataDistribution */
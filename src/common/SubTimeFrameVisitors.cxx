@@ -13,6 +13,7 @@
 
 #include "SubTimeFrameVisitors.h"
 #include "SubTimeFrameDataModel.h"
+#include "SubTimeFrameCompression.h"
 #include "DataModelUtils.h"
 
 #include "DataDistLogger.h"
@@ -63,21 +64,19 @@ void InterleavedHdrDataSerializer::visit(SubTimeFrame& pStf)
   mMessages.push_back(std::move(lDataHeaderMsg));
   mMessages.push_back(std::move(lDataMsg));
 
-  for (auto& lDataIdentMapIter : pStf.mData) {
-    for (auto& lSubSpecMapIter : lDataIdentMapIter.second) {
-      for (auto& lStfDataIter : lSubSpecMapIter.second) {
-        mMessages.push_back(std::move(lStfDataIter.mHeader));
+  pStf.mData.for_each([this](const EquipmentIdentifier &, auto lStfDataRange) {
+    for (auto& lStfDataIter : lStfDataRange) {
+      mMessages.push_back(std::move(lStfDataIter.mHeader));
 
-        if (lStfDataIter.mData->GetSize() == 0) {
-          EDDLOG("Sending STF data payload with zero size");
-        }
-
-        mMessages.push_back(std::move(lStfDataIter.mData));
+      if (lStfDataIter.mData->GetSize() == 0) {
+        EDDLOG("Sending STF data payload with zero size");
       }
+
+      mMessages.push_back(std::move(lStfDataIter.mData));
     }
-  }
+  });
 
-  pStf.mData.clear();
+  pStf.clear();
   pStf.mHeader = SubTimeFrame::Header();
 }
 
@@ -90,6 +89,7 @@ void InterleavedHdrDataSerializer::serialize(std::unique_ptr<SubTimeFrame>&& pSt
 
   // make sure headers and chunk pointers don't linger
   mMessages.clear();
+  SubTimeFramePool::put(std::move(pStf));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -108,6 +108,12 @@ void InterleavedHdrDataDeserializer::visit(SubTimeFrame& pStf)
    WDDLOG("Receiving bad SubTimeFrame::Header::DataHeader message");
     throw std::runtime_error("SubTimeFrame::Header::DataHeader");
   }
+  // the Stf::Header is sent as is: a different size means a different layout
+  if (mMessages[1]->GetSize() != sizeof(SubTimeFrame::Header)) {
+    EDDLOG_RL(1000, "Receiving SubTimeFrame::Header of unsupported size. size={} expected={}",
+      mMessages[1]->GetSize(), sizeof(SubTimeFrame::Header));
+    throw std::runtime_error("SubTimeFrame::Header size");
+  }
   // copy the header
   std::memcpy(&pStf.mHeader, mMessages[1]->GetData(), sizeof(SubTimeFrame::Header));
 
@@ -173,7 +179,7 @@ std::unique_ptr<SubTimeFrame> InterleavedHdrDataDeserializer::deserialize(FairMQ
 std::unique_ptr<SubTimeFrame> InterleavedHdrDataDeserializer::deserialize_impl()
 {
   // NOTE: StfID will be updated from the stf header
-  std::unique_ptr<SubTimeFrame> lStf = std::make_unique<SubTimeFrame>(0);
+  std::unique_ptr<SubTimeFrame> lStf = SubTimeFramePool::get(0);
   try {
     lStf->accept(*this);
   } catch (std::runtime_error& e) {
@@ -194,11 +200,96 @@ std::unique_ptr<SubTimeFrame> InterleavedHdrDataDeserializer::deserialize_impl()
 
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// CoalescedHdrBufferPool
+////////////////////////////////////////////////////////////////////////////////
+
+CoalescedHdrBufferPool::CoalescedHdrBufferPool(FairMQTransportFactory &pTransport, const std::size_t pPoolSize,
+  const std::size_t pBufferSize)
+  : mTransport(pTransport),
+    mBufferSize(std::max(pBufferSize, std::size_t(4096)))
+{
+  const std::size_t lNumBuffers = std::max(pPoolSize / mBufferSize, std::size_t(1));
+
+  mRegion = mTransport.CreateUnmanagedRegion(
+    lNumBuffers * mBufferSize,
+    0,
+    [this](const std::vector<FairMQRegionBlock>& pBlkVect) {
+      std::scoped_lock lLock(mFreeLock);
+      for (const auto &lBlk : pBlkVect) {
+        mFreeBuffers.push_back(reinterpret_cast<char*>(lBlk.ptr));
+      }
+    }
+  );
+
+  if (!mRegion) {
+    EDDLOG("Creation of the coalesced header region failed. size={}", lNumBuffers * mBufferSize);
+    throw std::bad_alloc();
+  }
+
+  char *lStart = reinterpret_cast<char*>(mRegion->GetData());
+  mFreeBuffers.reserve(lNumBuffers);
+  for (std::size_t lIdx = 0; lIdx < lNumBuffers; lIdx++) {
+    mFreeBuffers.push_back(lStart + lIdx * mBufferSize);
+  }
+
+  IDDLOG("CoalescedHdrBufferPool: created. num_buffers={} buffer_size={}", lNumBuffers, mBufferSize);
+}
+
+FairMQMessagePtr CoalescedHdrBufferPool::get(const std::size_t pSize)
+{
+  if (pSize > mBufferSize) {
+    WDDLOG_RL(10000, "CoalescedHdrBufferPool: header set larger than the pool buffers. size={} buffer_size={}",
+      pSize, mBufferSize);
+    return nullptr;
+  }
+
+  char *lBuffer = nullptr;
+  {
+    std::scoped_lock lLock(mFreeLock);
+    if (mFreeBuffers.empty()) {
+      return nullptr;
+    }
+    lBuffer = mFreeBuffers.back();
+    mFreeBuffers.pop_back();
+  }
+
+  return mTransport.CreateMessage(mRegion, lBuffer, pSize);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /// CoalescedHdrDataSerializer
 ////////////////////////////////////////////////////////////////////////////////
 
 void CoalescedHdrDataSerializer::visit(SubTimeFrame& pStf)
+{
+  mStfHeader = pStf.header();
+
+  // chunks end on equipment boundaries
+  std::size_t lChunkSize = 0;
+
+  pStf.mData.for_each([this, &lChunkSize](const EquipmentIdentifier &, auto lStfDataRange) {
+    for (auto& lStfDataIter : lStfDataRange) {
+      lChunkSize += lStfDataIter.mData->GetSize();
+      mStfHdrs.push_back(std::move(lStfDataIter.mHeader));
+      mStfData.push_back(std::move(lStfDataIter.mData));
+    }
+
+    if (mChunkSize > 0 && lChunkSize >= mChunkSize) {
+      mChunkEnds.push_back(mStfData.size());
+      lChunkSize = 0;
+    }
+  });
+
+  if (mChunkEnds.empty() || mChunkEnds.back() != mStfData.size()) {
+    mChunkEnds.push_back(mStfData.size());
+  }
+
+  pStf.clear();
+  pStf.mHeader = SubTimeFrame::Header();
+}
+
+void CoalescedHdrDataSerializer::addStfHeaders(const chunk_info *pChunk, const std::vector<std::uint32_t> *pChecksums)
 {
   // Pack the Stf header
   auto lDataHeaderMsg = mChan.NewMessage(sizeof(DataHeader));
@@ -209,40 +300,42 @@ void CoalescedHdrDataSerializer::visit(SubTimeFrame& pStf)
 
   DataHeader *lHdrPtr = reinterpret_cast<DataHeader*>(lDataHeaderMsg->GetData());
   std::memcpy(lHdrPtr, &gStfDistDataHeader, sizeof(DataHeader));
-  lHdrPtr->firstTForbit = pStf.header().mFirstOrbit;
-  lHdrPtr->runNumber = pStf.header().mRunNumber;
+  lHdrPtr->firstTForbit = mStfHeader.mFirstOrbit;
+  lHdrPtr->runNumber = mStfHeader.mRunNumber;
   lHdrPtr->payloadSerializationMethod = gSerializationMethodNone;
 
-  auto lDataMsg = mChan.NewMessage(sizeof(SubTimeFrame::Header));
+  // chunk info and protocol version are appended to the Stf::Header
+  static constexpr chunk_info cSingleChunk = { 0, 1 };
+  static constexpr protocol_info cProtocolInfo = { cProtocolMagic, cProtocolVersion };
+
+  const std::size_t lChecksumSize = pChecksums ?
+    (sizeof(checksum_info) + pChecksums->size() * sizeof(std::uint32_t)) : 0;
+  const std::size_t lStfHdrSize = sizeof(SubTimeFrame::Header) + sizeof(chunk_info) + sizeof(protocol_info) +
+    lChecksumSize;
+  auto lDataMsg = mChan.NewMessage(lStfHdrSize);
   if (!lDataMsg) {
-    EDDLOG("Allocation error: Stf::Header. size={}", sizeof(SubTimeFrame::Header));
+    EDDLOG("Allocation error: Stf::Header. size={}", lStfHdrSize);
     throw std::bad_alloc();
   }
-  std::memcpy(lDataMsg->GetData(), &pStf.header(), sizeof(SubTimeFrame::Header));
+  char *lStfHdrPtr = reinterpret_cast<char*>(lDataMsg->GetData());
+  std::memcpy(lStfHdrPtr, &mStfHeader, sizeof(SubTimeFrame::Header));
+  std::memcpy(lStfHdrPtr + sizeof(SubTimeFrame::Header), pChunk ? pChunk : &cSingleChunk, sizeof(chunk_info));
+  std::memcpy(lStfHdrPtr + sizeof(SubTimeFrame::Header) + sizeof(chunk_info), &cProtocolInfo,
+    sizeof(protocol_info));
+
+  if (pChecksums) {
+    char *lChecksumPtr = lStfHdrPtr + sizeof(SubTimeFrame::Header) + sizeof(chunk_info) + sizeof(protocol_info);
+    const checksum_info lChecksumInfo = { cChecksumMagic, std::uint32_t(pChecksums->size()) };
+    std::memcpy(lChecksumPtr, &lChecksumInfo, sizeof(checksum_info));
+    std::memcpy(lChecksumPtr + sizeof(checksum_info), pChecksums->data(), pChecksums->size() * sizeof(std::uint32_t));
+  }
 
   mHdrs.push_back(std::move(lDataHeaderMsg));
   mHdrs.push_back(std::move(lDataMsg));
-
-  for (auto& lDataIdentMapIter : pStf.mData) {
-    for (auto& lSubSpecMapIter : lDataIdentMapIter.second) {
-      for (auto& lStfDataIter : lSubSpecMapIter.second) {
-        mHdrs.push_back(std::move(lStfDataIter.mHeader));
-        mData.push_back(std::move(lStfDataIter.mData));
-      }
-    }
-  }
-
-  pStf.mData.clear();
-  pStf.mHeader = SubTimeFrame::Header();
 }
 
-void CoalescedHdrDataSerializer::serialize(std::unique_ptr<SubTimeFrame>&& pStf)
+void CoalescedHdrDataSerializer::addCoalescedHeaders()
 {
-  mHdrs.clear();
-  mData.clear();
-
-  pStf->accept(*this);
-
   // coalesce the headers
   const std::size_t lHdrSize = std::accumulate(mHdrs.begin(), mHdrs.end(), std::size_t(0),
     [](const std::size_t v, const FairMQMessagePtr&h) { return v + h->GetSize(); }
@@ -253,42 +346,177 @@ void CoalescedHdrDataSerializer::serialize(std::unique_ptr<SubTimeFrame>&& pStf)
   DDLOGF_GRL(5000, DataDistSeverity::debug, "CoalescedHdrDataSerializer: headers={} coalesced_size={}",
     mHdrs.size(), lTotalHdrSize);
 
-  auto lFullHdrMsg = mChan.NewMessage(lTotalHdrSize);
+  // try the pooled header buffers first
+  FairMQMessagePtr lFullHdrMsg = mHdrPool ? mHdrPool->get(lTotalHdrSize) : nullptr;
+  if (!lFullHdrMsg) {
+    lFullHdrMsg = mChan.NewMessage(lTotalHdrSize);
+  }
   if (!lFullHdrMsg) {
-    EDDLOG("Allocation error: Stf::CoalescedHeader. size={}", sizeof(lTotalHdrSize));
+    EDDLOG("Allocation error: Stf::CoalescedHeader. size={}", lTotalHdrSize);
     throw std::bad_alloc();
   }
 
-  std::size_t lInfoOff = 0;
-  std::size_t lHdrOff = mHdrs.size() * sizeof(header_info);
   char* lFullHdrMsgAddr = reinterpret_cast<char*>(lFullHdrMsg->GetData());
+  header_info *lHdrInfos = reinterpret_cast<header_info*>(lFullHdrMsgAddr);
+  std::size_t lHdrOff = mHdrs.size() * sizeof(header_info);
 
-  // coalesce all headers into a single message
-  for (const auto &lHdr : mHdrs) {
+  // headers allocated in batches are adjacent: copy contiguous runs at once
+  const char *lRunStart = nullptr;
+  std::size_t lRunLen = 0;
+  std::size_t lRunOff = lHdrOff;
 
-    const header_info lHdrInfo = { lHdrOff, lHdr->GetSize() };
+  // coalesce all headers into a single message
+  for (std::size_t lIdx = 0; lIdx < mHdrs.size(); lIdx++) {
+    const char *lHdrData = reinterpret_cast<const char*>(mHdrs[lIdx]->GetData());
+    const std::size_t lHdrLen = mHdrs[lIdx]->GetSize();
 
-    std::memcpy(lFullHdrMsgAddr + lInfoOff, &lHdrInfo, sizeof(header_info));
-    std::memcpy(lFullHdrMsgAddr + lHdrOff, reinterpret_cast<const char*>(lHdr->GetData()), lHdrInfo.len);
+    lHdrInfos[lIdx] = { lHdrOff, lHdrLen };
 
-    lInfoOff += sizeof(header_info);
-    lHdrOff += lHdrInfo.len;
+    if (lRunStart && (lHdrData == lRunStart + lRunLen)) {
+      lRunLen += lHdrLen;
+    } else {
+      if (lRunLen > 0) {
+        std::memcpy(lFullHdrMsgAddr + lRunOff, lRunStart, lRunLen);
+      }
+      lRunStart = lHdrData;
+      lRunLen = lHdrLen;
+      lRunOff = lHdrOff;
+    }
 
-    assert (lInfoOff <= mHdrs.size() * sizeof(header_info));
+    lHdrOff += lHdrLen;
     assert (lHdrOff <= lTotalHdrSize);
   }
-  assert (lInfoOff == mHdrs.size() * sizeof(header_info));
+  if (lRunLen > 0) {
+    std::memcpy(lFullHdrMsgAddr + lRunOff, lRunStart, lRunLen);
+  }
   assert (lHdrOff == lTotalHdrSize);
 
   // add it to data messages for sending
   mData.push_back(std::move(lFullHdrMsg));
   mHdrs.clear();
+}
 
-  // send the data + coslesced headers
-  mChan.Send(mData);
+void CoalescedHdrDataSerializer::addHeaderBlocks()
+{
+  // only adjacent headers are coalesced: the alignment padding of the header region is the only gap sent,
+  // it is part of the allocation of the previous header. Gaps of other sizes can be memory no message owns.
+  static constexpr std::uintptr_t cHdrAlign = alignof(DataHeader);
+  auto lAlignedEnd = [](const char *pEnd) {
+    return reinterpret_cast<const char*>((reinterpret_cast<std::uintptr_t>(pEnd) + cHdrAlign - 1) & ~(cHdrAlign - 1));
+  };
+
+  const std::size_t lTableSize = sizeof(header_block_table) + mHdrs.size() * sizeof(header_block_info);
+  auto lTableMsg = mChan.NewMessage(lTableSize);
+  if (!lTableMsg) {
+    EDDLOG("Allocation error: Stf::HeaderBlockTable. size={}", lTableSize);
+    throw std::bad_alloc();
+  }
 
-  // make sure headers and chunk pointers don't linger
-  mData.clear();
+  auto *lTable = reinterpret_cast<header_block_table*>(lTableMsg->GetData());
+  auto *lInfos = reinterpret_cast<header_block_info*>(lTable + 1);
+
+  // header messages of a block are kept alive until the transport is done with the block
+  std::vector<FairMQMessagePtr> *lBlockHdrs = nullptr;
+  const char *lBlockStart = nullptr;
+  const char *lBlockEnd = nullptr;
+  std::uint64_t lNumBlocks = 0;
+
+  auto lFinishBlock = [&]() {
+    if (!lBlockHdrs) {
+      return;
+    }
+    auto lBlockMsg = mChan.NewMessage(const_cast<char*>(lBlockStart), std::size_t(lBlockEnd - lBlockStart),
+      [](void*, void *pHint) { delete static_cast<std::vector<FairMQMessagePtr>*>(pHint); }, lBlockHdrs);
+    if (!lBlockMsg) {
+      delete lBlockHdrs;
+      EDDLOG("Allocation error: Stf::HeaderBlock. size={}", (lBlockEnd - lBlockStart));
+      throw std::bad_alloc();
+    }
+    mData.push_back(std::move(lBlockMsg));
+    lBlockHdrs = nullptr;
+  };
+
+  for (std::size_t lIdx = 0; lIdx < mHdrs.size(); lIdx++) {
+    const char *lHdrData = reinterpret_cast<const char*>(mHdrs[lIdx]->GetData());
+    const std::size_t lHdrLen = mHdrs[lIdx]->GetSize();
+
+    if (!lBlockHdrs || (lHdrData != lAlignedEnd(lBlockEnd))) {
+      lFinishBlock();
+      lBlockHdrs = new std::vector<FairMQMessagePtr>();
+      lBlockStart = lHdrData;
+      lNumBlocks += 1;
+    }
+
+    lInfos[lIdx] = { lNumBlocks - 1, std::uint64_t(lHdrData - lBlockStart), lHdrLen };
+    lBlockEnd = lHdrData + lHdrLen;
+    lBlockHdrs->push_back(std::move(mHdrs[lIdx]));
+  }
+  lFinishBlock();
+
+  lTable->mMagic = cHeaderBlockMagic;
+  lTable->mNumBlocks = lNumBlocks;
+
+  DDLOGF_GRL(5000, DataDistSeverity::debug, "CoalescedHdrDataSerializer: headers={} header_blocks={}",
+    mHdrs.size(), lNumBlocks);
+
+  // the block table is the last message
+  mData.push_back(std::move(lTableMsg));
+  mHdrs.clear();
+}
+
+void CoalescedHdrDataSerializer::serialize(std::unique_ptr<SubTimeFrame>&& pStf)
+{
+  mStfHdrs.clear();
+  mStfData.clear();
+  mChunkEnds.clear();
+
+  pStf->accept(*this);
+
+  if (mCompressor) {
+    mCompressor->compress(mStfHdrs, mStfData, mChan);
+  }
+
+  // without chunking, the STF is sent as a single multipart without the chunk info
+  const bool lChunked = (mChunkSize > 0);
+
+  std::size_t lChunkStart = 0;
+  for (std::size_t lChunkIdx = 0; lChunkIdx < mChunkEnds.size(); lChunkIdx++) {
+    const std::size_t lChunkEnd = mChunkEnds[lChunkIdx];
+    const chunk_info lChunkInfo = { std::uint32_t(lChunkIdx), (lChunkIdx + 1) == mChunkEnds.size() };
+
+    mHdrs.clear();
+    mData.clear();
+
+    // checksums of the payloads as sent
+    if (mChecksums) {
+      mChecksumTable.clear();
+      for (std::size_t i = lChunkStart; i < lChunkEnd; i++) {
+        mChecksumTable.push_back(Crc32c::compute(mStfData[i]->GetData(), mStfData[i]->GetSize()));
+      }
+    }
+
+    addStfHeaders(lChunked ? &lChunkInfo : nullptr, mChecksums ? &mChecksumTable : nullptr);
+    std::move(mStfHdrs.begin() + lChunkStart, mStfHdrs.begin() + lChunkEnd, std::back_inserter(mHdrs));
+    std::move(mStfData.begin() + lChunkStart, mStfData.begin() + lChunkEnd, std::back_inserter(mData));
+
+    if (mHeaderBlocks) {
+      addHeaderBlocks();
+    } else {
+      addCoalescedHeaders();
+    }
+
+    // send the data + coslesced headers
+    mChan.Send(mData);
+
+    // make sure headers and chunk pointers don't linger
+    mData.clear();
+
+    lChunkStart = lChunkEnd;
+  }
+
+  mStfHdrs.clear();
+  mStfData.clear();
+  SubTimeFramePool::put(std::move(pStf));
 }
 
 
@@ -308,9 +536,33 @@ void CoalescedHdrDataDeserializer::visit(SubTimeFrame& pStf)
     WDDLOG("Receiving bad SubTimeFrame::Header::DataHeader message");
     throw std::runtime_error("SubTimeFrame::Header::DataHeader");
   }
+  // the Stf::Header layout is only known for the current protocol version
+  using protocol_info = CoalescedHdrDataSerializer::protocol_info;
+  const std::size_t lProtoOff = sizeof(SubTimeFrame::Header) + sizeof(CoalescedHdrDataSerializer::chunk_info);
+  protocol_info lProtoInfo = { 0, 0 };
+  if (mHdrs[1]->GetSize() >= lProtoOff + sizeof(protocol_info)) {
+    std::memcpy(&lProtoInfo, reinterpret_cast<const char*>(mHdrs[1]->GetData()) + lProtoOff, sizeof(protocol_info));
+  }
+  if ((lProtoInfo.mMagic != CoalescedHdrDataSerializer::cProtocolMagic) ||
+    (lProtoInfo.mVersion != CoalescedHdrDataSerializer::cProtocolVersion)) {
+    EDDLOG_RL(1000, "Receiving SubTimeFrame of unsupported protocol version. version={} expected={} hdr_size={}",
+      lProtoInfo.mVersion, CoalescedHdrDataSerializer::cProtocolVersion, mHdrs[1]->GetSize());
+    throw std::runtime_error("SubTimeFrame::Header protocol version");
+  }
   // copy the header
   std::memcpy(&pStf.mHeader, mHdrs[1]->GetData(), sizeof(SubTimeFrame::Header));
 
+  // chunked STF
+  mChunkInfo = { 0, 1 };
+  if (mHdrs[1]->GetSize() >= sizeof(SubTimeFrame::Header) + sizeof(CoalescedHdrDataSerializer::chunk_info)) {
+    std::memcpy(&mChunkInfo, reinterpret_cast<const char*>(mHdrs[1]->GetData()) + sizeof(SubTimeFrame::Header),
+      sizeof(CoalescedHdrDataSerializer::chunk_info));
+  }
+
+  if (mVerifyChecksums) {
+    verifyChecksums(reinterpret_cast<const char*>(mHdrs[1]->GetData()), mHdrs[1]->GetSize());
+  }
+
   // iterate over all incoming HBFrame data sources
   for (size_t i = 0; i < mData.size(); i += 1) {
 
@@ -321,6 +573,15 @@ void CoalescedHdrDataDeserializer::visit(SubTimeFrame& pStf)
       EDDLOG("Received STF data payload with zero size");
     }
 
+    // payloads can be compressed for the transport
+    StfPayloadCompressor::decompress(*lHdrMsg, lDataMsg, mTfBld);
+
+    // receive into the TimeFrame region: accounted from arrival, and no copy when forwarding
+    if (!mTfBld.placeDataInRegion(lDataMsg)) {
+      EDDLOG_RL(1000, "Allocation error: STF data payload. size={}", lDataMsg->GetSize());
+      throw std::bad_alloc();
+    }
+
     pStf.addStfData({ std::move(lHdrMsg), std::move(lDataMsg) });
   }
 }
@@ -376,58 +637,277 @@ std::unique_ptr<SubTimeFrame> CoalescedHdrDataDeserializer::deserialize(std::vec
   return deserialize_impl();
 }
 
-std::unique_ptr<SubTimeFrame> CoalescedHdrDataDeserializer::deserialize_impl()
+void CoalescedHdrDataDeserializer::unpackCoalescedHeaders(FairMQMessage &pCoalescedHdr)
 {
-  // NOTE: StfID will be updated from the stf header
-  std::unique_ptr<SubTimeFrame> lStf = std::make_unique<SubTimeFrame>(0);
-  try {
-    // recreate header messages
-    mHdrs.clear();
+  // we pack 2 transient stf header messages into Hdrs
+  const auto lExpectedMsgs = mData.size() + 2;
 
-    const auto lCoalescedHdr = std::move(*mData.rbegin());
-    mData.pop_back();
+  DDLOGF_GRL(5000, DataDistSeverity::debug, "CoalescedHdrDataDeserializer: headers={} coalesced_size={}",
+    lExpectedMsgs, pCoalescedHdr.GetSize());
 
-    // we pack 2 transient stf header messages into Hdrs
-    const auto lExpectedMsgs = mData.size() + 2;
+  std::size_t lInfoOff = 0;
+  std::size_t lHdrOff = lExpectedMsgs * sizeof(CoalescedHdrDataSerializer::header_info);
+  char* lFullHdrMsgAddr = reinterpret_cast<char*>(pCoalescedHdr.GetData());
+
+  // sanity checking
+  if (pCoalescedHdr.GetSize() < lExpectedMsgs * sizeof(CoalescedHdrDataSerializer::header_info)) {
+    EDDLOG("CoalescedHdrDataDeserializer: packed header message too small. size={} min_expected_size={}",
+      pCoalescedHdr.GetSize(), (lExpectedMsgs * sizeof(CoalescedHdrDataSerializer::header_info)));
+    throw std::runtime_error("CoalescedHdrDataDeserializer::HeaderSize too small");
+  }
 
-    DDLOGF_GRL(5000, DataDistSeverity::debug, "CoalescedHdrDataDeserializer: headers={} coalesced_size={}",
-      lExpectedMsgs, lCoalescedHdr->GetSize());
+  // unpack coalesced headers
+  for (unsigned m = 0; m < lExpectedMsgs; m++) {
+    CoalescedHdrDataSerializer::header_info lHdrInfo;
+    std::memcpy(&lHdrInfo, lFullHdrMsgAddr + lInfoOff, sizeof(CoalescedHdrDataSerializer::header_info));
 
-    std::size_t lInfoOff = 0;
-    std::size_t lHdrOff = lExpectedMsgs * sizeof(CoalescedHdrDataSerializer::header_info);
-    char* lFullHdrMsgAddr = reinterpret_cast<char*>(lCoalescedHdr->GetData());
+    if (lHdrInfo.len > (100 << 10)) {
+      WDDLOG("CoalescedHdrDataDeserializer: unpacked header size is too large. size={}", lHdrInfo.len);
+    }
 
-    // sanity checking
-    if (lCoalescedHdr->GetSize() < lExpectedMsgs * sizeof(CoalescedHdrDataSerializer::header_info)) {
-      EDDLOG("CoalescedHdrDataDeserializer: packed header message too small. size={} min_expected_size={}",
-        lCoalescedHdr->GetSize(), (lExpectedMsgs * sizeof(CoalescedHdrDataSerializer::header_info)));
-      throw std::runtime_error("CoalescedHdrDataDeserializer::HeaderSize too small");
+    if (lHdrInfo.start != (lHdrOff)) {
+      EDDLOG("CoalescedHdrDataDeserializer: header unpacking failed. msg_idx={} offset_meta={} offset_unpacking={}",
+        m, lHdrInfo.start, lHdrOff);
+      throw std::runtime_error("CoalescedHdrDataDeserializer::Deserializing failed");
     }
 
-    // unpack coalesced headers
-    for (unsigned m = 0; m < lExpectedMsgs; m++) {
-      CoalescedHdrDataSerializer::header_info lHdrInfo;
-      std::memcpy(&lHdrInfo, lFullHdrMsgAddr + lInfoOff, sizeof(CoalescedHdrDataSerializer::header_info));
+    auto lNewHdr = mTfBld.newHeaderMessage(lFullHdrMsgAddr + lHdrOff, lHdrInfo.len);
 
-      if (lHdrInfo.len > (100 << 10)) {
-        WDDLOG("CoalescedHdrDataDeserializer: unpacked header size is too large. size={}", lHdrInfo.len);
-      }
+    lInfoOff += sizeof(CoalescedHdrDataSerializer::header_info);
+    lHdrOff += lHdrInfo.len;
 
-      if (lHdrInfo.start != (lHdrOff)) {
-        EDDLOG("CoalescedHdrDataDeserializer: header unpacking failed. msg_idx={} offset_meta={} offset_unpacking={}",
-          m, lHdrInfo.start, lHdrOff);
-        throw std::runtime_error("CoalescedHdrDataDeserializer::Deserializing failed");
-      }
+    mHdrs.push_back(std::move(lNewHdr));
+  }
+}
+
+void CoalescedHdrDataDeserializer::unpackHeaderBlocks(FairMQMessage &pBlockTable)
+{
+  using header_block_table = CoalescedHdrDataSerializer::header_block_table;
+  using header_block_info = CoalescedHdrDataSerializer::header_block_info;
+
+  const auto *lTable = reinterpret_cast<const header_block_table*>(pBlockTable.GetData());
+  const auto *lInfos = reinterpret_cast<const header_block_info*>(lTable + 1);
+  const std::size_t lNumInfos = (pBlockTable.GetSize() - sizeof(header_block_table)) / sizeof(header_block_info);
+
+  // header blocks are sent after the data messages
+  if (lTable->mNumBlocks > mData.size()) {
+    EDDLOG("CoalescedHdrDataDeserializer: missing header blocks. num_blocks={} num_msgs={}",
+      lTable->mNumBlocks, mData.size());
+    throw std::runtime_error("CoalescedHdrDataDeserializer::Missing header blocks");
+  }
+  const std::size_t lFirstBlock = mData.size() - lTable->mNumBlocks;
+
+  // we pack 2 transient stf header messages into Hdrs
+  const auto lExpectedMsgs = lFirstBlock + 2;
+
+  DDLOGF_GRL(5000, DataDistSeverity::debug, "CoalescedHdrDataDeserializer: headers={} header_blocks={}",
+    lExpectedMsgs, lTable->mNumBlocks);
 
-      auto lNewHdr = mTfBld.newHeaderMessage(lFullHdrMsgAddr + lHdrOff, lHdrInfo.len);
+  if (lNumInfos != lExpectedMsgs) {
+    EDDLOG("CoalescedHdrDataDeserializer: header block table size mismatch. num_headers={} expected_headers={}",
+      lNumInfos, lExpectedMsgs);
+    throw std::runtime_error("CoalescedHdrDataDeserializer::Header block table size mismatch");
+  }
 
-      lInfoOff += sizeof(CoalescedHdrDataSerializer::header_info);
-      lHdrOff += lHdrInfo.len;
+  for (std::size_t m = 0; m < lExpectedMsgs; m++) {
+    const auto &lHdrInfo = lInfos[m];
 
-      mHdrs.push_back(std::move(lNewHdr));
+    if ((lHdrInfo.block >= lTable->mNumBlocks) ||
+      (lHdrInfo.start + lHdrInfo.len > mData[lFirstBlock + lHdrInfo.block]->GetSize())) {
+      EDDLOG("CoalescedHdrDataDeserializer: header block unpacking failed. msg_idx={} block={} start={} len={}",
+        m, lHdrInfo.block, lHdrInfo.start, lHdrInfo.len);
+      throw std::runtime_error("CoalescedHdrDataDeserializer::Deserializing failed");
     }
 
-    lStf->accept(*this);
+    const char *lBlockAddr = reinterpret_cast<const char*>(mData[lFirstBlock + lHdrInfo.block]->GetData());
+    mHdrs.push_back(mTfBld.newHeaderMessage(lBlockAddr + lHdrInfo.start, lHdrInfo.len));
+  }
+
+  // headers are copied, release the blocks
+  mData.resize(lFirstBlock);
+}
+
+bool CoalescedHdrDataDeserializer::fastPathSupported(const FairMQMessage &pCoalescedHdr) const
+{
+  using header_info = CoalescedHdrDataSerializer::header_info;
+  using protocol_info = CoalescedHdrDataSerializer::protocol_info;
+
+  if (mFullValidation) {
+    return false;
+  }
+
+  const auto lExpectedMsgs = mData.size() + 2;
+  if (pCoalescedHdr.GetSize() < lExpectedMsgs * sizeof(header_info)) {
+    return false;
+  }
+
+  // the second header is the Stf::Header, followed by the chunk and the protocol info
+  header_info lStfHdrInfo;
+  std::memcpy(&lStfHdrInfo, reinterpret_cast<const char*>(pCoalescedHdr.GetData()) + sizeof(header_info),
+    sizeof(header_info));
+
+  const std::size_t lProtoOff = sizeof(SubTimeFrame::Header) + sizeof(CoalescedHdrDataSerializer::chunk_info);
+  if ((lStfHdrInfo.len < lProtoOff + sizeof(protocol_info)) || (lStfHdrInfo.start > pCoalescedHdr.GetSize()) ||
+    (lStfHdrInfo.len > pCoalescedHdr.GetSize() - lStfHdrInfo.start)) {
+    return false;
+  }
+
+  protocol_info lProtoInfo;
+  std::memcpy(&lProtoInfo, reinterpret_cast<const char*>(pCoalescedHdr.GetData()) + lStfHdrInfo.start + lProtoOff,
+    sizeof(protocol_info));
+
+  return (lProtoInfo.mMagic == CoalescedHdrDataSerializer::cProtocolMagic) &&
+    (lProtoInfo.mVersion == CoalescedHdrDataSerializer::cProtocolVersion);
+}
+
+void CoalescedHdrDataDeserializer::deserializeFast(FairMQMessage &pCoalescedHdr, SubTimeFrame &pStf)
+{
+  using header_info = CoalescedHdrDataSerializer::header_info;
+
+  const auto lNumData = mData.size();
+  const auto lExpectedMsgs = lNumData + 2;
+  const std::size_t lMsgSize = pCoalescedHdr.GetSize();
+  const char *lBase = reinterpret_cast<const char*>(pCoalescedHdr.GetData());
+  const header_info *lInfos = reinterpret_cast<const header_info*>(lBase);
+
+  // check the offset table in one pass (size of the table is checked in fastPathSupported())
+  // the second entry is the Stf::Header with the chunk and protocol info, all others are DataHeader stacks
+  constexpr std::size_t cMinStfHdrLen = sizeof(SubTimeFrame::Header) +
+    sizeof(CoalescedHdrDataSerializer::chunk_info) + sizeof(CoalescedHdrDataSerializer::protocol_info);
+  std::size_t lHdrOff = lExpectedMsgs * sizeof(header_info);
+  bool lValid = true;
+  bool lSameLen = true;
+  for (std::size_t m = 0; m < lExpectedMsgs; m++) {
+    const std::size_t lMinLen = (m == 1) ? cMinStfHdrLen : sizeof(DataHeader);
+    lValid &= (lInfos[m].start == lHdrOff) & (lInfos[m].len >= lMinLen) & (lInfos[m].len <= lMsgSize);
+    lSameLen &= (m < 2) || (lInfos[m].len == lInfos[2].len);
+    lHdrOff += lInfos[m].len;
+  }
+
+  if (!lValid || (lHdrOff > lMsgSize)) {
+    EDDLOG("CoalescedHdrDataDeserializer: invalid header offset table. headers={} coalesced_size={}",
+      lExpectedMsgs, lMsgSize);
+    throw std::runtime_error("CoalescedHdrDataDeserializer::Deserializing failed");
+  }
+
+  // stf headers are read in place
+  DataHeader lStfDataHdr;
+  std::memcpy(&lStfDataHdr, lBase + lInfos[0].start, sizeof(DataHeader));
+  if (!(gStfDistDataHeader == lStfDataHdr)) {
+    WDDLOG("Receiving bad SubTimeFrame::Header::DataHeader message");
+    throw std::runtime_error("SubTimeFrame::Header::DataHeader");
+  }
+  std::memcpy(&pStf.mHeader, lBase + lInfos[1].start, sizeof(SubTimeFrame::Header));
+  std::memcpy(&mChunkInfo, lBase + lInfos[1].start + sizeof(SubTimeFrame::Header),
+    sizeof(CoalescedHdrDataSerializer::chunk_info));
+
+  if (mVerifyChecksums) {
+    verifyChecksums(lBase + lInfos[1].start, lInfos[1].len);
+  }
+
+  if (lNumData == 0) {
+    return;
+  }
+
+  // headers of the same size are allocated in one block
+  std::size_t lStride = 0;
+  char *lSlot = lSameLen ? mTfBld.newHeaderSlots(lInfos[2].len, lNumData, lStride) : nullptr;
+
+  // create all header messages first: every slot must be turned into a message
+  mHdrs.clear();
+  for (std::size_t i = 0; i < lNumData; i++) {
+    const auto &lHdrInfo = lInfos[i + 2];
+
+    if (lSlot) {
+      std::memcpy(lSlot, lBase + lHdrInfo.start, lHdrInfo.len);
+      mHdrs.push_back(mTfBld.newHeaderMessageFromSlot(lSlot, lHdrInfo.len));
+      lSlot += lStride;
+    } else {
+      mHdrs.push_back(mTfBld.newHeaderMessage(lBase + lHdrInfo.start, lHdrInfo.len));
+    }
+  }
+
+  pStf.mData.reserve(lNumData);
+
+  for (std::size_t i = 0; i < lNumData; i++) {
+    auto &lHdrMsg = mHdrs[i];
+    auto &lDataMsg = mData[i];
+
+    if (!lHdrMsg) {
+      EDDLOG("Allocation error: STF data header. size={}", lInfos[i + 2].len);
+      throw std::bad_alloc();
+    }
+
+    // payloads can be compressed for the transport
+    StfPayloadCompressor::decompress(*lHdrMsg, lDataMsg, mTfBld);
+
+    // receive into the TimeFrame region: accounted from arrival, and no copy when forwarding
+    if (!mTfBld.placeDataInRegion(lDataMsg)) {
+      EDDLOG_RL(1000, "Allocation error: STF data payload. size={}", lDataMsg->GetSize());
+      throw std::bad_alloc();
+    }
+
+    const DataHeader &lDataHdr = *reinterpret_cast<const DataHeader*>(lHdrMsg->GetData());
+    pStf.addStfData(lDataHdr, { std::move(lHdrMsg), std::move(lDataMsg) });
+  }
+}
+
+void CoalescedHdrDataDeserializer::verifyChecksums(const char *pStfHdr, const std::size_t pStfHdrSize) const
+{
+  using checksum_info = CoalescedHdrDataSerializer::checksum_info;
+
+  const std::size_t lChecksumOff = sizeof(SubTimeFrame::Header) + sizeof(CoalescedHdrDataSerializer::chunk_info) +
+    sizeof(CoalescedHdrDataSerializer::protocol_info);
+
+  checksum_info lChecksumInfo = { 0, 0 };
+  if (pStfHdrSize >= lChecksumOff + sizeof(checksum_info)) {
+    std::memcpy(&lChecksumInfo, pStfHdr + lChecksumOff, sizeof(checksum_info));
+  }
+
+  // the StfSender does not send checksums
+  if (lChecksumInfo.mMagic != CoalescedHdrDataSerializer::cChecksumMagic) {
+    return;
+  }
+
+  if ((lChecksumInfo.mNumChecksums != mData.size()) ||
+    (pStfHdrSize < lChecksumOff + sizeof(checksum_info) + mData.size() * sizeof(std::uint32_t))) {
+    EDDLOG("CoalescedHdrDataDeserializer: checksum table size mismatch. num_checksums={} num_msgs={}",
+      lChecksumInfo.mNumChecksums, mData.size());
+    throw std::runtime_error("CoalescedHdrDataDeserializer::Checksum table size mismatch");
+  }
+
+  const char *lTable = pStfHdr + lChecksumOff + sizeof(checksum_info);
+  for (std::size_t i = 0; i < mData.size(); i++) {
+    std::uint32_t lCrc;
+    std::memcpy(&lCrc, lTable + i * sizeof(std::uint32_t), sizeof(std::uint32_t));
+
+    if (lCrc != Crc32c::compute(mData[i]->GetData(), mData[i]->GetSize())) {
+      EDDLOG_RL(1000, "CoalescedHdrDataDeserializer: data checksum error. msg_idx={} size={}", i, mData[i]->GetSize());
+      throw std::runtime_error("CoalescedHdrDataDeserializer::Data checksum error");
+    }
+  }
+}
+
+std::unique_ptr<SubTimeFrame> CoalescedHdrDataDeserializer::deserialize_impl()
+{
+  // NOTE: StfID will be updated from the stf header
+  std::unique_ptr<SubTimeFrame> lStf = SubTimeFramePool::get(0);
+  try {
+    // recreate header messages
+    mHdrs.clear();
+
+    const auto lCoalescedHdr = std::move(*mData.rbegin());
+    mData.pop_back();
+
+    if (CoalescedHdrDataSerializer::isHeaderBlockTable(*lCoalescedHdr)) {
+      unpackHeaderBlocks(*lCoalescedHdr);
+      lStf->accept(*this);
+    } else if (fastPathSupported(*lCoalescedHdr)) {
+      deserializeFast(*lCoalescedHdr, *lStf);
+    } else {
+      unpackCoalescedHeaders(*lCoalescedHdr);
+      lStf->accept(*this);
+    }
 
   } catch (std::runtime_error& e) {
     EDDLOG("SubTimeFrame deserialization failed. reason={}", e.what());
@@ -20,6 +20,8 @@
 #include <Headers/DataHeader.h>
 
 #include <vector>
+#include <mutex>
+#include <memory>
 
 class FairMQChannel;
 
@@ -28,6 +30,8 @@ namespace o2
 namespace DataDistribution
 {
 
+class StfPayloadCompressor;
+
 ////////////////////////////////////////////////////////////////////////////////
 /// InterleavedHdrDataSerializer
 ////////////////////////////////////////////////////////////////////////////////
@@ -76,6 +80,39 @@ class InterleavedHdrDataDeserializer : public ISubTimeFrameVisitor
 };
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// CoalescedHdrBufferPool
+////////////////////////////////////////////////////////////////////////////////
+
+/// Fixed-size buffers for coalesced headers, in a region registered with the transport.
+/// Buffers are returned to the pool by the region callback once the message is sent.
+/// Can be shared by serializers of all channels using the same transport.
+class CoalescedHdrBufferPool
+{
+ public:
+  static constexpr std::size_t cDefaultBufferSize = std::size_t(1) << 20;
+
+  CoalescedHdrBufferPool() = delete;
+  /// pBufferSize: size of one buffer, i.e. the largest coalesced header set taken from the pool
+  CoalescedHdrBufferPool(FairMQTransportFactory &pTransport, const std::size_t pPoolSize,
+    const std::size_t pBufferSize = cDefaultBufferSize);
+  ~CoalescedHdrBufferPool() {
+    // make sure no callbacks are issued after the pool is gone
+    mRegion.reset();
+  }
+
+  /// Returns nullptr if the size exceeds the buffer size or if no buffer is free
+  FairMQMessagePtr get(const std::size_t pSize);
+
+ private:
+  FairMQTransportFactory &mTransport;
+  std::unique_ptr<FairMQUnmanagedRegion> mRegion;
+  std::size_t mBufferSize;
+
+  std::mutex mFreeLock;
+  std::vector<char*> mFreeBuffers;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /// CoalescedHdrDataSerializer
 ////////////////////////////////////////////////////////////////////////////////
@@ -89,13 +126,74 @@ class CoalescedHdrDataSerializer : public ISubTimeFrameVisitor
     std::size_t len;
   };
 
+  /// Header block mode: runs of adjacent headers are sent as they are, as extra messages after the data.
+  /// The last message is the block table with one header_block_info per header.
+  static constexpr std::uint64_t cHeaderBlockMagic = 0x4b4c4248444446ULL;
+
+  struct header_block_table {
+    std::uint64_t mMagic;
+    std::uint64_t mNumBlocks;
+  };
+
+  struct header_block_info {
+    std::uint64_t block;
+    std::uint64_t start;
+    std::uint64_t len;
+  };
+
+  /// Chunked transfer: an STF is sent as several multiparts, split on equipment boundaries.
+  /// Every chunk is a complete serialized STF. The chunk info is appended to the Stf::Header.
+  struct chunk_info {
+    std::uint32_t mChunkIdx;
+    std::uint32_t mLastChunk;
+  };
+
+  /// Protocol version, appended to the Stf::Header after the chunk info. STFs of other versions are rejected.
+  /// Bump on any change of the Stf::Header layout (v2: Trace block).
+  static constexpr std::uint32_t cProtocolMagic = 0x54534444; // "DDST"
+  static constexpr std::uint32_t cProtocolVersion = 2;
+
+  struct protocol_info {
+    std::uint32_t mMagic;
+    std::uint32_t mVersion;
+  };
+
+  /// Optional CRC32C of the data messages of the chunk (as sent, after compression), appended to the
+  /// Stf::Header after the protocol info: checksum_info followed by one checksum per data message.
+  static constexpr std::uint32_t cChecksumMagic = 0x43524344; // "DCRC"
+
+  struct checksum_info {
+    std::uint32_t mMagic;
+    std::uint32_t mNumChecksums;
+  };
+
+  static bool isHeaderBlockTable(const FairMQMessage &pMsg) {
+    return (pMsg.GetSize() >= sizeof(header_block_table)) &&
+      (reinterpret_cast<const header_block_table*>(pMsg.GetData())->mMagic == cHeaderBlockMagic);
+  }
+
   CoalescedHdrDataSerializer() = delete;
-  CoalescedHdrDataSerializer(FairMQChannel& pChan)
-    : mChan(pChan)
+  CoalescedHdrDataSerializer(FairMQChannel& pChan, std::shared_ptr<CoalescedHdrBufferPool> pHdrPool = nullptr,
+    const bool pHeaderBlocks = false)
+    : mChan(pChan),
+      mHdrPool(pHdrPool),
+      mHeaderBlocks(pHeaderBlocks)
   {
+    mHdrs.reserve(25600);
     mData.reserve(25600);
+    mStfHdrs.reserve(25600);
+    mStfData.reserve(25600);
   }
 
+  /// Chunk size in bytes (0: chunking disabled)
+  void setChunkSize(const std::size_t pChunkSize) { mChunkSize = pChunkSize; }
+
+  /// Compress payloads before sending (nullptr: disabled)
+  void setCompressor(std::shared_ptr<StfPayloadCompressor> pCompressor) { mCompressor = pCompressor; }
+
+  /// Send the CRC32C of the data messages in the Stf::Header
+  void setChecksums(const bool pChecksums) { mChecksums = pChecksums; }
+
   virtual ~CoalescedHdrDataSerializer() = default;
 
   void serialize(std::unique_ptr<SubTimeFrame>&& pStf);
@@ -104,10 +202,27 @@ class CoalescedHdrDataSerializer : public ISubTimeFrameVisitor
   void visit(SubTimeFrame& pStf) override;
 
  private:
+  void addStfHeaders(const chunk_info *pChunk, const std::vector<std::uint32_t> *pChecksums);
+  void addCoalescedHeaders();
+  void addHeaderBlocks();
+
+  // STF being serialized
+  SubTimeFrame::Header mStfHeader;
+  std::vector<FairMQMessagePtr> mStfHdrs;
+  std::vector<FairMQMessagePtr> mStfData;
+  std::vector<std::size_t> mChunkEnds;
+  std::size_t mChunkSize = 0;
+
+  // chunk being sent
   std::vector<FairMQMessagePtr> mHdrs;
   std::vector<FairMQMessagePtr> mData;
 
   FairMQChannel& mChan;
+  std::shared_ptr<CoalescedHdrBufferPool> mHdrPool;
+  bool mHeaderBlocks = false;
+  std::shared_ptr<StfPayloadCompressor> mCompressor;
+  bool mChecksums = false;
+  std::vector<std::uint32_t> mChecksumTable;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -125,13 +240,32 @@ class CoalescedHdrDataDeserializer : public ISubTimeFrameVisitor
   std::unique_ptr<SubTimeFrame> deserialize(FairMQChannel& pChan, bool pLogError = false);
   std::unique_ptr<SubTimeFrame> deserialize(std::vector<FairMQMessagePtr>& pMsgs);
 
+  /// Chunk info of the last deserialized STF (single chunk if the STF was not chunked)
+  const CoalescedHdrDataSerializer::chunk_info& chunkInfo() const { return mChunkInfo; }
+
+  /// Full validation of every header (debugging). Otherwise STFs of the same protocol version are
+  /// deserialized on the fast path: the offset table is checked in one pass and headers are allocated in bulk.
+  void setFullValidation(const bool pFullValidation) { mFullValidation = pFullValidation; }
+
+  /// Verify the CRC32C of the data messages (if sent by the StfSender). STFs with errors are rejected
+  void setVerifyChecksums(const bool pVerify) { mVerifyChecksums = pVerify; }
+
  protected:
   std::unique_ptr<SubTimeFrame> deserialize_impl();
   void visit(SubTimeFrame& pStf) override;
 
  private:
+  void unpackCoalescedHeaders(FairMQMessage &pCoalescedHdr);
+  void unpackHeaderBlocks(FairMQMessage &pBlockTable);
+  bool fastPathSupported(const FairMQMessage &pCoalescedHdr) const;
+  void deserializeFast(FairMQMessage &pCoalescedHdr, SubTimeFrame &pStf);
+  void verifyChecksums(const char *pStfHdr, const std::size_t pStfHdrSize) const;
+
   std::vector<FairMQMessagePtr> mHdrs;
   std::vector<FairMQMessagePtr> mData;
+  CoalescedHdrDataSerializer::chunk_info mChunkInfo = { 0, 1 };
+  bool mFullValidation = false;
+  bool mVerifyChecksums = false;
 
   TimeFrameBuilder &mTfBld;
 };
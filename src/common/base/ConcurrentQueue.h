@@ -22,6 +22,10 @@
 #include <condition_variable>
 #include <iterator>
 #include <chrono>
+#include <optional>
+#include <thread>
+#include <limits>
+#include <algorithm>
 
 #include <Utilities.h>
 
@@ -133,6 +137,35 @@ class ConcurrentContainerImpl
     return true;
   }
 
+  // push a range of elements with a single lock acquisition. Use std::make_move_iterator() to move.
+  // return false (fail) if not running
+  template <class InputIt>
+  bool push_range(InputIt pBegin, InputIt pEnd)
+  {
+    std::unique_lock<std::mutex> lLock(mImpl->mLock);
+    if (!mImpl->mRunning) {
+      mImpl->mCond.notify_all(); // just in case someone is waiting
+      return false;
+    }
+
+    std::size_t lCnt = 0;
+    for (; pBegin != pEnd; ++pBegin, ++lCnt) {
+      if constexpr (type == eFIFO) {
+        mImpl->mContainer.emplace_back(*pBegin);
+      } else if constexpr (type == eLIFO) {
+        mImpl->mContainer.emplace_front(*pBegin);
+      }
+    }
+
+    lLock.unlock(); // reduce contention
+    if (lCnt > 1) {
+      mImpl->mCond.notify_all();
+    } else if (lCnt == 1) {
+      mImpl->mCond.notify_one();
+    }
+    return true;
+  }
+
   // pop an element from the queue. Caller will block while the queue is running
   // returns true on success
   bool pop(T& d)
@@ -231,6 +264,31 @@ class ConcurrentContainerImpl
     return ret;
   }
 
+  // pop up to pCnt elements, waiting at most for the timeout for the first one
+  // returns number of elements taken, 0 on timeout or if not running
+  template <class OutputIt>
+  std::size_t pop_n(const unsigned long pCnt, const std::chrono::microseconds &us, OutputIt pDstIter)
+  {
+    const auto lWaitUntil = std::chrono::system_clock::now() + us;
+
+    std::unique_lock<std::mutex> lLock(mImpl->mLock);
+    mImpl->mCond.wait_until(lLock, lWaitUntil, [this]() {
+      return !mImpl->mContainer.empty() || !mImpl->mRunning;
+    });
+
+    const std::size_t ret = std::min(mImpl->mContainer.size(), pCnt);
+    std::copy_n(std::make_move_iterator(mImpl->mContainer.begin()), ret, pDstIter);
+    mImpl->mContainer.erase(std::begin(mImpl->mContainer), std::begin(mImpl->mContainer) + ret);
+    return ret;
+  }
+
+  // pop all queued elements. Caller will block while the queue is running and empty
+  template <class OutputIt>
+  std::size_t pop_all(OutputIt pDstIter)
+  {
+    return pop_n(std::numeric_limits<unsigned long>::max(), pDstIter);
+  }
+
   bool try_pop(T& d)
   {
     std::unique_lock<std::mutex> lLock(mImpl->mLock);
@@ -278,6 +336,399 @@ class ConcurrentContainerImpl
   std::unique_ptr<QueueInternals> mImpl;
 };
 
+/// Bounded lock-free ring buffer with the ConcurrentFifo interface
+enum RingType {
+  eSPSC, // single producer, single consumer (callers may change if serialized externally)
+  eMPMC  // multiple producers, multiple consumers
+};
+
+/// Cells carry a sequence number (Vyukov bounded queue), which makes the same layout usable for both
+/// modes: the SPSC variant owns the positions, the MPMC variant claims them with a CAS.
+/// Producers and consumers spin briefly before parking on a condition variable. The lock is only
+/// taken when a counterpart is parked, so the handoff does not involve a syscall in the common case.
+/// NOTE: push() waits for free space when the ring is full (backpressure)
+template <typename T, RingType type>
+class ConcurrentRingImpl
+{
+ public:
+  typedef T value_type;
+
+  static constexpr std::size_t cDefaultCapacity = 1024;
+  static constexpr unsigned cSpinCount = 512;
+
+  explicit ConcurrentRingImpl(const std::size_t pCapacity = cDefaultCapacity)
+  : mImpl(std::make_unique<RingInternals>(pCapacity)) { }
+
+  ConcurrentRingImpl(ConcurrentRingImpl &&) = default;
+
+  ~ConcurrentRingImpl() { if (mImpl) { stop(); } }
+
+  void stop()
+  {
+    mImpl->mRunning = false;
+    std::unique_lock<std::mutex> lLock(mImpl->mParkLock);
+    mImpl->mNotEmpty.notify_all();
+    mImpl->mNotFull.notify_all();
+  }
+
+  // NOTE: must not race with producers or consumers
+  void start()
+  {
+    T d;
+    while (try_pop(d)) { }
+    mImpl->mRunning = true;
+  }
+
+  // NOTE: consumer side operation
+  std::size_t flush()
+  {
+    std::size_t lCount = 0;
+    T d;
+    while (try_pop(d)) {
+      lCount++;
+    }
+    return lCount;
+  }
+
+  // push a new element to the ring, while in the running state
+  // return false (fail) if not running
+  template <typename... Args>
+  bool push(Args&&... args)
+  {
+    auto &I = *mImpl;
+
+    for (unsigned i = 0; i < cSpinCount; i++) {
+      if (!I.mRunning) {
+        notify(I.mNumWaitingConsumers, I.mNotEmpty); // just in case someone is waiting
+        return false;
+      }
+      if (I.try_push(std::forward<Args>(args)...)) {
+        notify(I.mNumWaitingConsumers, I.mNotEmpty);
+        return true;
+      }
+      cpu_relax();
+    }
+
+    // park until there is free space
+    std::unique_lock<std::mutex> lLock(I.mParkLock);
+    I.mNumWaitingProducers++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    bool lRet = false;
+    I.mNotFull.wait(lLock, [&]() {
+      if (!I.mRunning) {
+        return true;
+      }
+      lRet = I.try_push(std::forward<Args>(args)...);
+      return lRet;
+    });
+
+    I.mNumWaitingProducers--;
+    lLock.unlock();
+
+    notify(I.mNumWaitingConsumers, I.mNotEmpty);
+    return lRet;
+  }
+
+  // push without waiting: return false if the ring is full or not running
+  template <typename... Args>
+  bool try_push(Args&&... args)
+  {
+    auto &I = *mImpl;
+    if (!I.mRunning || !I.try_push(std::forward<Args>(args)...)) {
+      return false;
+    }
+    notify(I.mNumWaitingConsumers, I.mNotEmpty);
+    return true;
+  }
+
+  // push a range of elements. Use std::make_move_iterator() to move
+  template <class InputIt>
+  bool push_range(InputIt pBegin, InputIt pEnd)
+  {
+    for (; pBegin != pEnd; ++pBegin) {
+      if (!push(*pBegin)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // pop an element from the ring. Caller will block while the ring is running
+  // returns true on success
+  bool pop(T& d)
+  {
+    return pop_until(d, std::nullopt);
+  }
+
+  std::optional<T> pop()
+  {
+    T d;
+    if (pop_until(d, std::nullopt)) {
+      return std::make_optional<T>(std::move(d));
+    }
+    return std::nullopt;
+  }
+
+  bool pop_wait_for(T& d, const std::chrono::microseconds &us)
+  {
+    return pop_until(d, std::chrono::steady_clock::now() + us);
+  }
+
+  std::optional<T> pop_wait_for(const std::chrono::microseconds &us)
+  {
+    T d;
+    if (pop_until(d, std::chrono::steady_clock::now() + us)) {
+      return std::make_optional<T>(std::move(d));
+    }
+    return std::nullopt;
+  }
+
+  template <class OutputIt>
+  std::size_t pop_n(const unsigned long pCnt, OutputIt pDstIter)
+  {
+    if (pCnt == 0) {
+      return 0;
+    }
+
+    T d;
+    if (!pop(d)) {
+      return 0; // should stop
+    }
+    *pDstIter++ = std::move(d);
+
+    return 1 + try_pop_n(pCnt - 1, pDstIter);
+  }
+
+  template <class OutputIt>
+  std::size_t pop_n(const unsigned long pCnt, const std::chrono::microseconds &us, OutputIt pDstIter)
+  {
+    if (pCnt == 0) {
+      return 0;
+    }
+
+    T d;
+    if (!pop_wait_for(d, us)) {
+      return 0;
+    }
+    *pDstIter++ = std::move(d);
+
+    return 1 + try_pop_n(pCnt - 1, pDstIter);
+  }
+
+  template <class OutputIt>
+  std::size_t pop_all(OutputIt pDstIter)
+  {
+    return pop_n(capacity(), pDstIter);
+  }
+
+  bool try_pop(T& d)
+  {
+    auto &I = *mImpl;
+    if (I.try_pop(d)) {
+      notify(I.mNumWaitingProducers, I.mNotFull);
+      return true;
+    }
+    return false;
+  }
+
+  template <class OutputIt>
+  std::size_t try_pop_n(const std::size_t pCnt, OutputIt pDstIter)
+  {
+    auto &I = *mImpl;
+    std::size_t lRet = 0;
+    T d;
+    while (lRet < pCnt && I.try_pop(d)) {
+      *pDstIter++ = std::move(d);
+      lRet++;
+    }
+
+    if (lRet > 0) {
+      notify(I.mNumWaitingProducers, I.mNotFull);
+    }
+    return lRet;
+  }
+
+  // approximate when used concurrently
+  std::size_t size() const
+  {
+    const std::size_t lTail = mImpl->mTail.load(std::memory_order_acquire);
+    const std::size_t lHead = mImpl->mHead.load(std::memory_order_acquire);
+    return (lTail > lHead) ? (lTail - lHead) : 0;
+  }
+
+  bool empty() const { return size() == 0; }
+
+  bool is_running() const { return mImpl->mRunning; }
+
+  std::size_t capacity() const { return mImpl->mMask + 1; }
+
+ private:
+  static inline void cpu_relax()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+  }
+
+  // wake the parked counterpart. The fence orders the preceding ring update with the check
+  // of waiters (the parking side increments the waiters before checking the ring).
+  inline void notify(const std::atomic_uint &pNumWaiting, std::condition_variable &pCond)
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (pNumWaiting.load(std::memory_order_relaxed) > 0) {
+      std::unique_lock<std::mutex> lLock(mImpl->mParkLock);
+      pCond.notify_all();
+    }
+  }
+
+  bool pop_until(T& d, const std::optional<std::chrono::steady_clock::time_point> &pUntil)
+  {
+    auto &I = *mImpl;
+
+    for (unsigned i = 0; i < cSpinCount; i++) {
+      if (try_pop(d)) {
+        return true;
+      }
+      if (!I.mRunning) {
+        return try_pop(d);
+      }
+      cpu_relax();
+    }
+
+    // park until data is available, the ring is stopped, or timeout
+    std::unique_lock<std::mutex> lLock(I.mParkLock);
+    I.mNumWaitingConsumers++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    bool lRet = false;
+    const auto lPred = [&]() {
+      lRet = I.try_pop(d);
+      return lRet || !I.mRunning;
+    };
+
+    if (pUntil) {
+      I.mNotEmpty.wait_until(lLock, *pUntil, lPred);
+    } else {
+      I.mNotEmpty.wait(lLock, lPred);
+    }
+
+    I.mNumWaitingConsumers--;
+    lLock.unlock();
+
+    if (lRet) {
+      notify(I.mNumWaitingProducers, I.mNotFull);
+    }
+    return lRet;
+  }
+
+  struct RingInternals {
+    struct Cell {
+      std::atomic_size_t mSeq;
+      std::optional<T> mValue;
+    };
+
+    explicit RingInternals(const std::size_t pCapacity)
+    {
+      std::size_t lCap = 2;
+      while (lCap < pCapacity) {
+        lCap <<= 1;
+      }
+      mMask = lCap - 1;
+      mCells = std::make_unique<Cell[]>(lCap);
+      for (std::size_t i = 0; i < lCap; i++) {
+        mCells[i].mSeq.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    template <typename... Args>
+    bool try_push(Args&&... args)
+    {
+      Cell *lCell;
+      std::size_t lPos = mTail.load(std::memory_order_relaxed);
+
+      if constexpr (type == eSPSC) {
+        lCell = &mCells[lPos & mMask];
+        if (lCell->mSeq.load(std::memory_order_acquire) != lPos) {
+          return false; // full
+        }
+        mTail.store(lPos + 1, std::memory_order_relaxed);
+      } else {
+        for (;;) {
+          lCell = &mCells[lPos & mMask];
+          const std::size_t lSeq = lCell->mSeq.load(std::memory_order_acquire);
+          const auto lDiff = std::intptr_t(lSeq) - std::intptr_t(lPos);
+          if (lDiff == 0) {
+            if (mTail.compare_exchange_weak(lPos, lPos + 1, std::memory_order_relaxed)) {
+              break;
+            }
+          } else if (lDiff < 0) {
+            return false; // full
+          } else {
+            lPos = mTail.load(std::memory_order_relaxed);
+          }
+        }
+      }
+
+      lCell->mValue.emplace(std::forward<Args>(args)...);
+      lCell->mSeq.store(lPos + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool try_pop(T &d)
+    {
+      Cell *lCell;
+      std::size_t lPos = mHead.load(std::memory_order_relaxed);
+
+      if constexpr (type == eSPSC) {
+        lCell = &mCells[lPos & mMask];
+        if (lCell->mSeq.load(std::memory_order_acquire) != lPos + 1) {
+          return false; // empty
+        }
+        mHead.store(lPos + 1, std::memory_order_relaxed);
+      } else {
+        for (;;) {
+          lCell = &mCells[lPos & mMask];
+          const std::size_t lSeq = lCell->mSeq.load(std::memory_order_acquire);
+          const auto lDiff = std::intptr_t(lSeq) - std::intptr_t(lPos + 1);
+          if (lDiff == 0) {
+            if (mHead.compare_exchange_weak(lPos, lPos + 1, std::memory_order_relaxed)) {
+              break;
+            }
+          } else if (lDiff < 0) {
+            return false; // empty
+          } else {
+            lPos = mHead.load(std::memory_order_relaxed);
+          }
+        }
+      }
+
+      d = std::move(*lCell->mValue);
+      lCell->mValue.reset();
+      lCell->mSeq.store(lPos + mMask + 1, std::memory_order_release);
+      return true;
+    }
+
+    std::unique_ptr<Cell[]> mCells;
+    std::size_t mMask = 0;
+
+    alignas(128) std::atomic_size_t mTail = 0;
+    alignas(128) std::atomic_size_t mHead = 0;
+
+    alignas(128) std::atomic_bool mRunning = true;
+    std::atomic_uint mNumWaitingProducers = 0;
+    std::atomic_uint mNumWaitingConsumers = 0;
+
+    std::mutex mParkLock;
+    std::condition_variable mNotEmpty;
+    std::condition_variable mNotFull;
+  };
+
+  std::unique_ptr<RingInternals> mImpl;
+};
+
 } /* namespace impl*/
 
 ///
@@ -298,6 +749,28 @@ using ConcurrentLifo = impl::ConcurrentContainerImpl<T, impl::eLIFO>;
 template <class T>
 using ConcurrentStack = ConcurrentLifo<T>;
 
+// bounded lock-free rings (FIFO)
+template <class T>
+using ConcurrentSpscRing = impl::ConcurrentRingImpl<T, impl::eSPSC>;
+
+template <class T>
+using ConcurrentMpmcRing = impl::ConcurrentRingImpl<T, impl::eMPMC>;
+
+///
+///  Pipeline stage statistics, for the interval since the previous snapshot
+///
+struct PipelineStageStats {
+  std::int64_t  mDepth = 0;
+  std::int64_t  mHighWatermark = 0;
+  std::uint64_t mNumDequeued = 0;
+
+  // dwell time of dequeued elements in microseconds
+  std::uint64_t mDwellP50Us = 0;
+  std::uint64_t mDwellP90Us = 0;
+  std::uint64_t mDwellP99Us = 0;
+  std::uint64_t mDwellMaxUs = 0;
+};
+
 ///
 ///  Pipeline handler with input and output ConcurrentContainer queue/stack
 ///
@@ -306,11 +779,25 @@ template <
   typename = std::enable_if_t<std::is_move_assignable<T>::value>>
 class IFifoPipeline
 {
+  using clock = std::chrono::steady_clock;
+
+  struct StageElem {
+    T mElem;
+    clock::time_point mQueued;
+  };
+
+  struct alignas(128) StageCounters {
+    std::atomic_int64_t mDepth = 0;
+    std::atomic_int64_t mHighWatermark = 0;
+    Log2Histogram mDwellUs;
+  };
+
  public:
   IFifoPipeline() = delete;
 
   IFifoPipeline(unsigned pNoStages)
-    : mPipelineQueues(pNoStages)
+    : mPipelineQueues(pNoStages),
+      mStageCounters(std::make_unique<StageCounters[]>(pNoStages))
   {
   }
 
@@ -325,8 +812,8 @@ class IFifoPipeline
 
   void clearPipeline()
   {
-    for (auto& lQueue : mPipelineQueues) {
-      lQueue.flush();
+    for (std::size_t i = 0; i < mPipelineQueues.size(); i++) {
+      mStageCounters[i].mDepth -= mPipelineQueues[i].flush();
     }
   }
 
@@ -339,11 +826,28 @@ class IFifoPipeline
 
     // NOTE: (lNextStage == mPipelineQueues.size()) is the drop queue
     if (lNextStage < mPipelineQueues.size()) {
-      return mPipelineQueues[lNextStage].push(std::forward<Args>(args)...);
+      auto &lCounters = mStageCounters[lNextStage];
+
+      // count before the push, the consumer can take the element immediately
+      const auto lDepth = ++lCounters.mDepth;
+      auto lHwm = lCounters.mHighWatermark.load(std::memory_order_relaxed);
+      while (lDepth > lHwm && !lCounters.mHighWatermark.compare_exchange_weak(lHwm, lDepth)) { }
+
+      if (mPipelineQueues[lNextStage].push(StageElem{ T(std::forward<Args>(args)...), clock::now() })) {
+        return true;
+      }
+      lCounters.mDepth--;
     }
     return false;
   }
 
+  // true if elements queued from pStage go to the drop queue (see queue())
+  bool isLastStage(unsigned pStage)
+  {
+    assert(pStage < mPipelineQueues.size());
+    return getNextPipelineStage(pStage) == mPipelineQueues.size();
+  }
+
   // notify the receiver the queue is closed
   void close(unsigned pStage)
   {
@@ -366,31 +870,111 @@ class IFifoPipeline
     std::size_t lCount = 0;
     if (lNextStage < mPipelineQueues.size()) {
       lCount = mPipelineQueues[lNextStage].flush();
+      mStageCounters[lNextStage].mDepth -= lCount;
     }
     return lCount;
   }
 
   T dequeue(unsigned pStage)
   {
-    T t;
-    mPipelineQueues[pStage].pop(t);
-    mPipelinedSize--;
-    return t;
+    StageElem lElem;
+    if (mPipelineQueues[pStage].pop(lElem)) {
+      record_dequeue(pStage, lElem, clock::now());
+    }
+    return std::move(lElem.mElem);
+  }
+
+  // dequeue up to pMax elements with a single wakeup
+  template <class OutputIt>
+  std::size_t dequeue_batch(unsigned pStage, const std::size_t pMax, OutputIt pDstIter)
+  {
+    static thread_local std::vector<StageElem> tBatch;
+    tBatch.clear();
+
+    mPipelineQueues[pStage].pop_n(pMax, std::back_inserter(tBatch));
+    return output_batch(pStage, tBatch, pDstIter);
+  }
+
+  template <class OutputIt>
+  std::size_t dequeue_batch(unsigned pStage, const std::size_t pMax, const std::chrono::microseconds &us,
+    OutputIt pDstIter)
+  {
+    static thread_local std::vector<StageElem> tBatch;
+    tBatch.clear();
+
+    mPipelineQueues[pStage].pop_n(pMax, us, std::back_inserter(tBatch));
+    return output_batch(pStage, tBatch, pDstIter);
   }
 
   bool try_pop(unsigned pStage)
   {
-    T t;
-    return mPipelineQueues[pStage].try_pop(t);
+    StageElem lElem;
+    if (mPipelineQueues[pStage].try_pop(lElem)) {
+      record_dequeue(pStage, lElem, clock::now());
+      return true;
+    }
+    return false;
+  }
+
+  long getPipelineSize() const noexcept
+  {
+    long lSize = 0;
+    for (std::size_t i = 0; i < mPipelineQueues.size(); i++) {
+      lSize += mStageCounters[i].mDepth.load(std::memory_order_relaxed);
+    }
+    return lSize;
   }
 
-  long getPipelineSize() const noexcept { return mPipelinedSize; }
+  unsigned getPipelineNumStages() const noexcept { return mPipelineQueues.size(); }
+
+  // Statistics of the stage input queue since the previous call. Resets the high watermark and dwell times.
+  PipelineStageStats getStageStats(unsigned pStage)
+  {
+    assert(pStage < mPipelineQueues.size());
+    auto &lCounters = mStageCounters[pStage];
+    PipelineStageStats lStats;
+
+    lStats.mDepth = std::max(std::int64_t(0), lCounters.mDepth.load());
+    lStats.mHighWatermark = std::max(lStats.mDepth, lCounters.mHighWatermark.exchange(lStats.mDepth));
+
+    const auto lDwell = lCounters.mDwellUs.snapshot_reset();
+    for (const auto lCnt : lDwell) {
+      lStats.mNumDequeued += lCnt;
+    }
+    lStats.mDwellP50Us = Log2Histogram::percentile(lDwell, 50.0);
+    lStats.mDwellP90Us = Log2Histogram::percentile(lDwell, 90.0);
+    lStats.mDwellP99Us = Log2Histogram::percentile(lDwell, 99.0);
+    lStats.mDwellMaxUs = Log2Histogram::percentile(lDwell, 100.0);
+
+    return lStats;
+  }
 
  protected:
   virtual unsigned getNextPipelineStage(unsigned pStage) = 0;
 
-  std::atomic_long mPipelinedSize = 0;
-  std::vector<o2::DataDistribution::ConcurrentFifo<T>> mPipelineQueues;
+ private:
+  inline void record_dequeue(unsigned pStage, const StageElem &pElem, const clock::time_point &pNow)
+  {
+    auto &lCounters = mStageCounters[pStage];
+    lCounters.mDepth.fetch_sub(1, std::memory_order_relaxed);
+    lCounters.mDwellUs.record(std::chrono::duration_cast<std::chrono::microseconds>(pNow - pElem.mQueued).count());
+  }
+
+  template <class OutputIt>
+  std::size_t output_batch(unsigned pStage, std::vector<StageElem> &pBatch, OutputIt pDstIter)
+  {
+    const auto lNow = clock::now();
+    for (auto &lElem : pBatch) {
+      record_dequeue(pStage, lElem, lNow);
+      *pDstIter++ = std::move(lElem.mElem);
+    }
+    const auto lCnt = pBatch.size();
+    pBatch.clear();
+    return lCnt;
+  }
+
+  std::vector<o2::DataDistribution::ConcurrentFifo<StageElem>> mPipelineQueues;
+  std::unique_ptr<StageCounters[]> mStageCounters;
 };
 
 } /* namespace o2::DataDistribution */
@@ -0,0 +1,158 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Crc32c.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace o2
+{
+namespace DataDistribution
+{
+
+namespace {
+
+constexpr std::uint32_t cPoly = 0x82f63b78; // reflected Castagnoli polynomial
+
+// slicing-by-8 tables
+struct Crc32cTables {
+  std::array<std::array<std::uint32_t, 256>, 8> mTable;
+
+  Crc32cTables() {
+    for (std::uint32_t i = 0; i < 256; i++) {
+      std::uint32_t lCrc = i;
+      for (int b = 0; b < 8; b++) {
+        lCrc = (lCrc >> 1) ^ ((lCrc & 1) ? cPoly : 0);
+      }
+      mTable[0][i] = lCrc;
+    }
+    for (std::uint32_t i = 0; i < 256; i++) {
+      for (std::size_t t = 1; t < 8; t++) {
+        mTable[t][i] = (mTable[t - 1][i] >> 8) ^ mTable[0][mTable[t - 1][i] & 0xff];
+      }
+    }
+  }
+};
+
+std::uint32_t crc32cSoftware(const unsigned char *pData, std::size_t pLen, std::uint32_t pCrc)
+{
+  static const Crc32cTables sTables;
+  const auto &T = sTables.mTable;
+
+  while (pLen >= 8) {
+    std::uint64_t lWord;
+    std::memcpy(&lWord, pData, 8);
+    lWord ^= pCrc;
+    pCrc = T[7][lWord & 0xff] ^ T[6][(lWord >> 8) & 0xff] ^ T[5][(lWord >> 16) & 0xff] ^
+      T[4][(lWord >> 24) & 0xff] ^ T[3][(lWord >> 32) & 0xff] ^ T[2][(lWord >> 40) & 0xff] ^
+      T[1][(lWord >> 48) & 0xff] ^ T[0][lWord >> 56];
+    pData += 8;
+    pLen -= 8;
+  }
+  while (pLen--) {
+    pCrc = (pCrc >> 8) ^ T[0][(pCrc ^ *pData++) & 0xff];
+  }
+  return pCrc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+std::uint32_t crc32cHardware(const unsigned char *pData, std::size_t pLen, std::uint32_t pCrc)
+{
+  std::uint64_t lCrc = pCrc;
+  while (pLen >= 32) {
+    std::uint64_t lWords[4];
+    std::memcpy(lWords, pData, 32);
+    lCrc = _mm_crc32_u64(lCrc, lWords[0]);
+    lCrc = _mm_crc32_u64(lCrc, lWords[1]);
+    lCrc = _mm_crc32_u64(lCrc, lWords[2]);
+    lCrc = _mm_crc32_u64(lCrc, lWords[3]);
+    pData += 32;
+    pLen -= 32;
+  }
+  while (pLen >= 8) {
+    std::uint64_t lWord;
+    std::memcpy(&lWord, pData, 8);
+    lCrc = _mm_crc32_u64(lCrc, lWord);
+    pData += 8;
+    pLen -= 8;
+  }
+  std::uint32_t lCrc32 = std::uint32_t(lCrc);
+  while (pLen--) {
+    lCrc32 = _mm_crc32_u8(lCrc32, *pData++);
+  }
+  return lCrc32;
+}
+
+bool crc32cHardwareSupported() { return __builtin_cpu_supports("sse4.2"); }
+
+#elif defined(__aarch64__)
+__attribute__((target("+crc")))
+std::uint32_t crc32cHardware(const unsigned char *pData, std::size_t pLen, std::uint32_t pCrc)
+{
+  while (pLen >= 8) {
+    std::uint64_t lWord;
+    std::memcpy(&lWord, pData, 8);
+    pCrc = __crc32cd(pCrc, lWord);
+    pData += 8;
+    pLen -= 8;
+  }
+  while (pLen--) {
+    pCrc = __crc32cb(pCrc, *pData++);
+  }
+  return pCrc;
+}
+
+bool crc32cHardwareSupported() { return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0; }
+
+#else
+std::uint32_t crc32cHardware(const unsigned char *pData, std::size_t pLen, std::uint32_t pCrc)
+{
+  return crc32cSoftware(pData, pLen, pCrc);
+}
+
+bool crc32cHardwareSupported() { return false; }
+#endif
+
+using Crc32cFn = std::uint32_t (*)(const unsigned char *, std::size_t, std::uint32_t);
+
+} /* namespace */
+
+bool Crc32c::hardware()
+{
+  static const bool sHardware = crc32cHardwareSupported();
+  return sHardware;
+}
+
+std::uint32_t Crc32c::compute(const void *pData, const std::size_t pLen, const std::uint32_t pCrc)
+{
+  static const Crc32cFn sImpl = hardware() ? crc32cHardware : crc32cSoftware;
+  return ~sImpl(static_cast<const unsigned char*>(pData), pLen, ~pCrc);
+}
+
+std::uint32_t Crc32c::computeSoftware(const void *pData, const std::size_t pLen, const std::uint32_t pCrc)
+{
+  return ~crc32cSoftware(static_cast<const unsigned char*>(pData), pLen, ~pCrc);
+}
+
+}
+} /* o2::DataDistribution */
@@ -0,0 +1,49 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef DATADIST_CRC32C_H_
+#define DATADIST_CRC32C_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace o2
+{
+namespace DataDistribution
+{
+
+////////////////////////////////////////////////////////////////////////////////
+/// Crc32c class
+////////////////////////////////////////////////////////////////////////////////
+
+/// CRC32C (Castagnoli) checksums of data blocks. Uses the SSE4.2 or ARMv8 CRC instructions if supported
+/// by the cpu, a table based implementation otherwise.
+class Crc32c
+{
+ public:
+  Crc32c() = delete;
+
+  /// checksum of [pData, pData + pLen). pCrc: checksum of the preceding data, to checksum data in parts
+  static std::uint32_t compute(const void *pData, const std::size_t pLen, const std::uint32_t pCrc = 0);
+
+  /// the cpu instructions are used
+  static bool hardware();
+
+  /// implementation without the cpu instructions (testing)
+  static std::uint32_t computeSoftware(const void *pData, const std::size_t pLen, const std::uint32_t pCrc = 0);
+};
+
+}
+} /* o2::DataDistribution */
+
+#endif /* DATADIST_CRC32C_H_ */
@@ -25,12 +25,18 @@ thread_local char* DataDistLogger::sThisThreadName = nullptr;
 // InfoLoggerFacility
 std::string DataDistLogger::sInfoLoggerFacility;
 
-std::chrono::steady_clock::time_point
-DataDistLogger::sRateLimitLast = std::chrono::steady_clock::now();
+std::atomic_uint64_t DataDistLogger::sRateLimitTickMs = DataDistLogger::cRateLimitTickStart;
 
 volatile bool impl::DataDistLoggerCtx::sRunning = false;
 std::thread impl::DataDistLoggerCtx::sRateUpdateThread;
 std::thread impl::DataDistLoggerCtx::mInfoLoggerThread;
+std::thread impl::DataDistLoggerCtx::sAsyncLogThread;
+
+// asynchronous mode
+std::atomic_bool DataDistLogger::sAsyncEnabled = false;
+std::atomic_uint64_t DataDistLogger::sAsyncDropped = 0;
+std::unique_ptr<ConcurrentMpmcRing<std::tuple<DataDistSeverity, std::string>>> DataDistLogger::sAsyncQueue = nullptr;
+std::mutex DataDistLogger::sWriteLock;
 
 
 std::unique_ptr<ConcurrentFifo<std::tuple<AliceO2::InfoLogger::InfoLogger::Severity, std::string>>>
@@ -17,6 +17,9 @@
 #include <type_traits> // enable_if, conjuction
 #include "ConcurrentQueue.h"
 
+#include <string>
+#include <cstdlib>
+
 #include <fmt/format.h>
 #include <fmt/core.h>
 
@@ -41,8 +44,10 @@ class DataDistLogger {
   static constexpr std::size_t cInfoLoggerQueueSize = 1024;
 
 public:
-  // rate logging updater
-  static std::chrono::steady_clock::time_point sRateLimitLast;
+  // rate logging: coarse global tick (ms), updated by the logger context every 100 ms
+  // The tick starts at cRateLimitTickStart, so the first message of every call site is logged.
+  static constexpr std::uint64_t cRateLimitTickStart = std::uint64_t(1) << 32;
+  static std::atomic_uint64_t sRateLimitTickMs;
 
   static DataDistSeverity sConfigSeverity;
   static DataDistSeverity sInfologgerSeverity;
@@ -133,107 +138,150 @@ public:
 
   ~DataDistLogger() {
     try {
-      switch(mSeverity) {
-        case DataDistSeverity::fatal:
-          if (StdoutEnabled(mSeverity)) {
-            I().critical(std::string_view(mLogMessage.begin(), mLogMessage.size()));
-          }
+      const std::string_view lMsg(mLogMessage.begin(), mLogMessage.size());
+
+      if (sAsyncEnabled.load(std::memory_order_relaxed)) {
+        if (mSeverity == DataDistSeverity::fatal) {
+          // write everything queued before the fatal record, and flush
+          std::scoped_lock lLock(sWriteLock);
+          drain_async();
+          write(mSeverity, lMsg);
+          I().flush();
+          return;
+        }
 
-          if (InfoLogEnabled(mSeverity)) {
-            sInfoLogQueue->push_capacity(cInfoLoggerQueueSize,
-              std::make_tuple(AliceO2::InfoLogger::InfoLogger::Severity::Fatal,
-              std::string(std::string_view(mLogMessage.begin(), mLogMessage.size()))
-            ));
-          }
-          break;
-        case DataDistSeverity::error:
-          if (StdoutEnabled(mSeverity)) {
-            I().error(std::string_view(mLogMessage.begin(), mLogMessage.size()));
-          }
+        if (sAsyncQueue->try_push(mSeverity, std::string(lMsg))) {
+          return;
+        }
+        if (sAsyncQueue->is_running()) {
+          sAsyncDropped.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        // stopped: write synchronously
+      }
 
-          if (InfoLogEnabled(mSeverity)) {
-            sInfoLogQueue->push_capacity(cInfoLoggerQueueSize,
-              std::make_tuple(AliceO2::InfoLogger::InfoLogger::Severity::Error,
-              std::string(std::string_view(mLogMessage.begin(), mLogMessage.size()))
-            ));
-          }
+      write(mSeverity, lMsg);
+    } catch (const std::exception &e) { std::cerr << "Logging exception what=" << e.what() << std::endl; }
+  }
 
-          break;
-        case DataDistSeverity::warn:
-          if (StdoutEnabled(mSeverity)) {
-            I().warn(std::string_view(mLogMessage.begin(), mLogMessage.size()));
-          }
+  // write the record to stdout and queue it for InfoLogger
+  static void write(const DataDistSeverity pSeverity, const std::string_view pMsg) {
+    switch(pSeverity) {
+      case DataDistSeverity::fatal:
+        if (StdoutEnabled(pSeverity)) {
+          I().critical(pMsg);
+        }
 
-          if (InfoLogEnabled(mSeverity)) {
-            sInfoLogQueue->push_capacity(cInfoLoggerQueueSize,
-              std::make_tuple(AliceO2::InfoLogger::InfoLogger::Severity::Warning,
-              std::string(std::string_view(mLogMessage.begin(), mLogMessage.size()))
-            ));
-          }
+        if (InfoLogEnabled(pSeverity)) {
+          sInfoLogQueue->push_capacity(cInfoLoggerQueueSize,
+            std::make_tuple(AliceO2::InfoLogger::InfoLogger::Severity::Fatal,
+            std::string(pMsg)
+          ));
+        }
+        break;
+      case DataDistSeverity::error:
+        if (StdoutEnabled(pSeverity)) {
+          I().error(pMsg);
+        }
 
-          break;
-        case DataDistSeverity::state:
-          if (StdoutEnabled(mSeverity)) {
-            I().info("[STATE]" + std::string(mLogMessage.begin(), mLogMessage.end()));
-          }
+        if (InfoLogEnabled(pSeverity)) {
+          sInfoLogQueue->push_capacity(cInfoLoggerQueueSize,
+            std::make_tuple(AliceO2::InfoLogger::InfoLogger::Severity::Error,
+            std::string(pMsg)
+          ));
+        }
 
-          if (InfoLogEnabled(mSeverity)) {
-            sInfoLogQueue->push_capacity(cInfoLoggerQueueSize,
-              std::make_tuple(AliceO2::InfoLogger::InfoLogger::Severity::Info,
-              std::string(std::string_view(mLogMessage.begin(), mLogMessage.size()))
-            ));
-          }
+        break;
+      case DataDistSeverity::warn:
+        if (StdoutEnabled(pSeverity)) {
+          I().warn(pMsg);
+        }
 
-          break;
-        case DataDistSeverity::info:
-          if (StdoutEnabled(mSeverity)) {
-            I().info(std::string_view(mLogMessage.begin(), mLogMessage.size()));
-          }
+        if (InfoLogEnabled(pSeverity)) {
+          sInfoLogQueue->push_capacity(cInfoLoggerQueueSize,
+            std::make_tuple(AliceO2::InfoLogger::InfoLogger::Severity::Warning,
+            std::string(pMsg)
+          ));
+        }
 
-          if (InfoLogEnabled(mSeverity)) {
-            sInfoLogQueue->push_capacity(cInfoLoggerQueueSize,
-              std::make_tuple(AliceO2::InfoLogger::InfoLogger::Severity::Info,
-              std::string(std::string_view(mLogMessage.begin(), mLogMessage.size()))
-            ));
-          }
+        break;
+      case DataDistSeverity::state:
+        if (StdoutEnabled(pSeverity)) {
+          I().info("[STATE]" + std::string(pMsg));
+        }
 
-          break;
-        case DataDistSeverity::debug:
-          if (StdoutEnabled(mSeverity)) {
-            I().debug(std::string_view(mLogMessage.begin(), mLogMessage.size()));
-          }
+        if (InfoLogEnabled(pSeverity)) {
+          sInfoLogQueue->push_capacity(cInfoLoggerQueueSize,
+            std::make_tuple(AliceO2::InfoLogger::InfoLogger::Severity::Info,
+            std::string(pMsg)
+          ));
+        }
 
-          if (InfoLogEnabled(mSeverity)) {
-            sInfoLogQueue->push_capacity(cInfoLoggerQueueSize,
-              std::make_tuple(AliceO2::InfoLogger::InfoLogger::Severity::Debug,
-              std::string(std::string_view(mLogMessage.begin(), mLogMessage.size()))
-            ));
-          }
+        break;
+      case DataDistSeverity::info:
+        if (StdoutEnabled(pSeverity)) {
+          I().info(pMsg);
+        }
 
-          break;
-        case DataDistSeverity::trace:
-          if (StdoutEnabled(mSeverity)) {
-            I().trace(std::string_view(mLogMessage.begin(), mLogMessage.size()));
-          }
+        if (InfoLogEnabled(pSeverity)) {
+          sInfoLogQueue->push_capacity(cInfoLoggerQueueSize,
+            std::make_tuple(AliceO2::InfoLogger::InfoLogger::Severity::Info,
+            std::string(pMsg)
+          ));
+        }
 
-          if (InfoLogEnabled(mSeverity)) {
-            sInfoLogQueue->push_capacity(cInfoLoggerQueueSize,
-              std::make_tuple(AliceO2::InfoLogger::InfoLogger::Severity::Debug,
-              std::string(std::string_view(mLogMessage.begin(), mLogMessage.size()))
-            ));
-          }
+        break;
+      case DataDistSeverity::debug:
+        if (StdoutEnabled(pSeverity)) {
+          I().debug(pMsg);
+        }
 
-          break;
+        if (InfoLogEnabled(pSeverity)) {
+          sInfoLogQueue->push_capacity(cInfoLoggerQueueSize,
+            std::make_tuple(AliceO2::InfoLogger::InfoLogger::Severity::Debug,
+            std::string(pMsg)
+          ));
+        }
 
-        default:
-          if (StdoutEnabled(mSeverity)) {
-            I().info("[???] " + std::string(mLogMessage.begin(), mLogMessage.end()));
-          }
-          break;
-      }
-    } catch (const std::exception &e) { std::cerr << "Logging exception what=" << e.what() << std::endl; }
+        break;
+      case DataDistSeverity::trace:
+        if (StdoutEnabled(pSeverity)) {
+          I().trace(pMsg);
+        }
+
+        if (InfoLogEnabled(pSeverity)) {
+          sInfoLogQueue->push_capacity(cInfoLoggerQueueSize,
+            std::make_tuple(AliceO2::InfoLogger::InfoLogger::Severity::Debug,
+            std::string(pMsg)
+          ));
+        }
+
+        break;
+
+      default:
+        if (StdoutEnabled(pSeverity)) {
+          I().info("[???] " + std::string(pMsg));
+        }
+        break;
+    }
+  }
+
+  // asynchronous mode (DATADIST_LOG_ASYNC): records are written by the logger thread
+  // NOTE: caller must hold sWriteLock
+  static void drain_async() {
+    std::tuple<DataDistSeverity, std::string> lRec;
+    while (sAsyncQueue->try_pop(lRec)) {
+      write(std::get<0>(lRec), std::get<1>(lRec));
+    }
   }
 
+  static std::uint64_t AsyncDropped() { return sAsyncDropped.load(std::memory_order_relaxed); }
+
+  static std::atomic_bool sAsyncEnabled;
+  static std::atomic_uint64_t sAsyncDropped;
+  static std::unique_ptr<ConcurrentMpmcRing<std::tuple<DataDistSeverity, std::string>>> sAsyncQueue;
+  static std::mutex sWriteLock; // logger thread and fatal records
+
   template<typename T>
   DataDistLogger& operator<<(const T& pTObj) {
     fmt::format_to(mLogMessage, "{}", pTObj);
@@ -282,53 +330,81 @@ private:
   if(DataDistLogger::LogEnabled(severity)) DataDistLogger(severity)
 
 
-#define DDDLOG(...) DDLOGF(DataDistSeverity::debug, __VA_ARGS__)
-#define IDDLOG(...) DDLOGF(DataDistSeverity::info, __VA_ARGS__)
-#define WDDLOG(...) DDLOGF(DataDistSeverity::warn, __VA_ARGS__)
-#define EDDLOG(...) DDLOGF(DataDistSeverity::error, __VA_ARGS__)
+// Compile-time minimum severity (DATADIST_LOG_MIN_LEVEL, set by the DATADIST_LOG_MIN_SEVERITY build option)
+//  0: all, 1: no debug, 2: no debug and info, 3: errors only
+// Statements below the minimum are discarded at compile time, but their arguments are still checked.
+#if !defined(DATADIST_LOG_MIN_LEVEL)
+#define DATADIST_LOG_MIN_LEVEL 0
+#endif
+
+#define DDLOG_COMPILED_OUT(...) do { if constexpr (false) { __VA_ARGS__; } } while(0)
 
 // Log with fmt using ratelimiting (per thread)
 #define DDLOGF_RL(intervalMs, severity, ...)                                                                           \
 do {                                                                                                                   \
-  static thread_local auto sRateLimit__NoShadow = std::chrono::steady_clock::time_point::min();                        \
+  static thread_local std::uint64_t sRateLimit__NoShadow = 0;                                                          \
   static thread_local unsigned sRateLimitCnt__NoShadow = 0;                                                            \
-  if (DataDistLogger::LogEnabled(severity) &&                                                                          \
-    (sRateLimit__NoShadow + std::chrono::milliseconds(intervalMs)) < DataDistLogger::sRateLimitLast) {                 \
+  const std::uint64_t lRateLimitTick__NoShadow = DataDistLogger::sRateLimitTickMs.load(std::memory_order_relaxed);    \
+  if ((lRateLimitTick__NoShadow - sRateLimit__NoShadow) > std::uint64_t(intervalMs) &&                                 \
+    DataDistLogger::LogEnabled(severity)) {                                                                            \
     o2::DataDistribution::DataDistLogger(severity, o2::DataDistribution::DataDistLogger::log_fmt{}, __VA_ARGS__) <<    \
       ((sRateLimitCnt__NoShadow > 0) ? fmt::format(" <msgs_suppressed={}>", sRateLimitCnt__NoShadow) : "");            \
-    sRateLimit__NoShadow = DataDistLogger::sRateLimitLast;                                                             \
+    sRateLimit__NoShadow = lRateLimitTick__NoShadow;                                                                   \
     sRateLimitCnt__NoShadow = 0;                                                                                       \
   } else {                                                                                                             \
     sRateLimitCnt__NoShadow++;                                                                                         \
   }                                                                                                                    \
 } while(0)
 
-
-#define DDDLOG_RL(intervalMs, ...) DDLOGF_RL(intervalMs, DataDistSeverity::debug, __VA_ARGS__)
-#define IDDLOG_RL(intervalMs, ...) DDLOGF_RL(intervalMs, DataDistSeverity::info, __VA_ARGS__)
-#define WDDLOG_RL(intervalMs, ...) DDLOGF_RL(intervalMs, DataDistSeverity::warn, __VA_ARGS__)
-#define EDDLOG_RL(intervalMs, ...) DDLOGF_RL(intervalMs, DataDistSeverity::error, __VA_ARGS__)
-
 // Log with fmt using ratelimiting (global)
 #define DDLOGF_GRL(intervalMs, severity, ...)                                                                          \
 do {                                                                                                                   \
-  static auto sRateLimit__NoShadow = std::chrono::steady_clock::time_point::min();                                     \
+  static std::uint64_t sRateLimit__NoShadow = 0;                                                                       \
   static unsigned sRateLimitCnt__NoShadow = 0;                                                                         \
-  if (DataDistLogger::LogEnabled(severity) &&                                                                          \
-    (sRateLimit__NoShadow + std::chrono::milliseconds(intervalMs)) < DataDistLogger::sRateLimitLast) {                 \
+  const std::uint64_t lRateLimitTick__NoShadow = DataDistLogger::sRateLimitTickMs.load(std::memory_order_relaxed);    \
+  if ((lRateLimitTick__NoShadow - sRateLimit__NoShadow) > std::uint64_t(intervalMs) &&                                 \
+    DataDistLogger::LogEnabled(severity)) {                                                                            \
     o2::DataDistribution::DataDistLogger(severity, o2::DataDistribution::DataDistLogger::log_fmt{}, __VA_ARGS__) <<    \
       ((sRateLimitCnt__NoShadow > 0) ? fmt::format(" <msgs_suppressed={}>", sRateLimitCnt__NoShadow) : "");            \
-    sRateLimit__NoShadow = DataDistLogger::sRateLimitLast;                                                             \
+    sRateLimit__NoShadow = lRateLimitTick__NoShadow;                                                                   \
     sRateLimitCnt__NoShadow = 0;                                                                                       \
   } else {                                                                                                             \
     sRateLimitCnt__NoShadow++;                                                                                         \
   }                                                                                                                    \
 } while(0)
 
-
+#if DATADIST_LOG_MIN_LEVEL > 0
+#define DDDLOG(...) DDLOG_COMPILED_OUT(DDLOGF(DataDistSeverity::debug, __VA_ARGS__))
+#define DDDLOG_RL(intervalMs, ...) DDLOG_COMPILED_OUT(DDLOGF(DataDistSeverity::debug, __VA_ARGS__))
+#define DDDLOG_GRL(intervalMs, ...) DDLOG_COMPILED_OUT(DDLOGF(DataDistSeverity::debug, __VA_ARGS__))
+#else
+#define DDDLOG(...) DDLOGF(DataDistSeverity::debug, __VA_ARGS__)
+#define DDDLOG_RL(intervalMs, ...) DDLOGF_RL(intervalMs, DataDistSeverity::debug, __VA_ARGS__)
 #define DDDLOG_GRL(intervalMs, ...) DDLOGF_GRL(intervalMs, DataDistSeverity::debug, __VA_ARGS__)
+#endif
+
+#if DATADIST_LOG_MIN_LEVEL > 1
+#define IDDLOG(...) DDLOG_COMPILED_OUT(DDLOGF(DataDistSeverity::info, __VA_ARGS__))
+#define IDDLOG_RL(intervalMs, ...) DDLOG_COMPILED_OUT(DDLOGF(DataDistSeverity::info, __VA_ARGS__))
+#define IDDLOG_GRL(intervalMs, ...) DDLOG_COMPILED_OUT(DDLOGF(DataDistSeverity::info, __VA_ARGS__))
+#else
+#define IDDLOG(...) DDLOGF(DataDistSeverity::info, __VA_ARGS__)
+#define IDDLOG_RL(intervalMs, ...) DDLOGF_RL(intervalMs, DataDistSeverity::info, __VA_ARGS__)
 #define IDDLOG_GRL(intervalMs, ...) DDLOGF_GRL(intervalMs, DataDistSeverity::info, __VA_ARGS__)
+#endif
+
+#if DATADIST_LOG_MIN_LEVEL > 2
+#define WDDLOG(...) DDLOG_COMPILED_OUT(DDLOGF(DataDistSeverity::warn, __VA_ARGS__))
+#define WDDLOG_RL(intervalMs, ...) DDLOG_COMPILED_OUT(DDLOGF(DataDistSeverity::warn, __VA_ARGS__))
+#define WDDLOG_GRL(intervalMs, ...) DDLOG_COMPILED_OUT(DDLOGF(DataDistSeverity::warn, __VA_ARGS__))
+#else
+#define WDDLOG(...) DDLOGF(DataDistSeverity::warn, __VA_ARGS__)
+#define WDDLOG_RL(intervalMs, ...) DDLOGF_RL(intervalMs, DataDistSeverity::warn, __VA_ARGS__)
 #define WDDLOG_GRL(intervalMs, ...) DDLOGF_GRL(intervalMs, DataDistSeverity::warn, __VA_ARGS__)
+#endif
+
+#define EDDLOG(...) DDLOGF(DataDistSeverity::error, __VA_ARGS__)
+#define EDDLOG_RL(intervalMs, ...) DDLOGF_RL(intervalMs, DataDistSeverity::error, __VA_ARGS__)
 #define EDDLOG_GRL(intervalMs, ...) DDLOGF_GRL(intervalMs, DataDistSeverity::error, __VA_ARGS__)
 
 namespace impl {
@@ -337,6 +413,7 @@ struct DataDistLoggerCtx {
   static volatile bool sRunning;
   static std::thread sRateUpdateThread;
   static std::thread mInfoLoggerThread;
+  static std::thread sAsyncLogThread;
 
   DataDistLoggerCtx() {
     if (sRunning) {
@@ -356,15 +433,53 @@ struct DataDistLoggerCtx {
       DDLOGF_FMQ(meta.severity, content);
     });
 
-    sRateUpdateThread = std::thread([&]() {
+    const auto lStart = std::chrono::steady_clock::now();
+    sRateUpdateThread = std::thread([lStart]() {
       while (sRunning) {
-        DataDistLogger::sRateLimitLast = std::chrono::steady_clock::now();
+        DataDistLogger::sRateLimitTickMs = DataDistLogger::cRateLimitTickStart +
+          std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lStart).count();
 
         using namespace std::chrono_literals;
         std::this_thread::sleep_for(100ms);
       }
     });
 
+    // asynchronous mode: DATADIST_LOG_ASYNC=<number of queued records>
+    const char *lAsyncVar = getenv("DATADIST_LOG_ASYNC");
+    if (lAsyncVar) {
+      const auto lCapacity = std::max(std::strtoull(lAsyncVar, nullptr, 10), 1024ull);
+      DataDistLogger::sAsyncQueue =
+        std::make_unique<ConcurrentMpmcRing<std::tuple<DataDistSeverity, std::string>>>(lCapacity);
+
+      sAsyncLogThread = std::thread([&]() {
+        std::vector<std::tuple<DataDistSeverity, std::string>> lRecs;
+        std::uint64_t lReportedDrops = 0;
+
+        while (true) {
+          lRecs.clear();
+          const auto lNumRecs = DataDistLogger::sAsyncQueue->pop_n(256, std::chrono::milliseconds(500),
+            std::back_inserter(lRecs));
+          if (lNumRecs == 0 && !DataDistLogger::sAsyncQueue->is_running()) {
+            break;
+          }
+
+          std::scoped_lock lLock(DataDistLogger::sWriteLock);
+          for (const auto &lRec : lRecs) {
+            DataDistLogger::write(std::get<0>(lRec), std::get<1>(lRec));
+          }
+
+          const auto lDropped = DataDistLogger::AsyncDropped();
+          if (lDropped != lReportedDrops) {
+            DataDistLogger::write(DataDistSeverity::warn, fmt::format("DataDistLogger: log queue is full, "
+              "records were dropped. dropped={} total_dropped={}", lDropped - lReportedDrops, lDropped));
+            lReportedDrops = lDropped;
+          }
+        }
+      });
+
+      DataDistLogger::sAsyncEnabled = true;
+    }
+
     mInfoLoggerThread = std::thread([&]() {
       std::tuple<AliceO2::InfoLogger::InfoLogger::Severity, std::string> lLogVal;
 
@@ -377,6 +492,18 @@ struct DataDistLoggerCtx {
   }
 
   ~DataDistLoggerCtx() {
+    // write the queued records, later records are written synchronously
+    if (DataDistLogger::sAsyncEnabled) {
+      DataDistLogger::sAsyncEnabled = false;
+      DataDistLogger::sAsyncQueue->stop();
+      if (sAsyncLogThread.joinable()) {
+        sAsyncLogThread.join();
+      }
+      std::scoped_lock lLock(DataDistLogger::sWriteLock);
+      DataDistLogger::drain_async();
+      DataDistLogger::I().flush();
+    }
+
     DataDistLogger::sInfoLogQueue->stop();
     sRunning = false;
     // check if the FairLogger is still alive and remove spdlog's sink
@@ -0,0 +1,226 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "ThreadPlacement.h"
+#include "DataDistLogger.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cerrno>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace o2::DataDistribution
+{
+
+static std::string cpuListToString(const std::vector<int> &pCpus)
+{
+  std::string lRet;
+  for (const auto lCpu : pCpus) {
+    lRet += (lRet.empty() ? "" : ",") + std::to_string(lCpu);
+  }
+  return lRet;
+}
+
+bool ThreadPlacement::parseCpuList(const std::string &pList, std::vector<int> &pCpus)
+{
+  std::stringstream lListStream(pList);
+  std::string lRange;
+
+  while (std::getline(lListStream, lRange, ',')) {
+    if (lRange.empty()) {
+      continue;
+    }
+    try {
+      const auto lDash = lRange.find('-');
+      const int lFirst = std::stoi(lRange.substr(0, lDash));
+      const int lLast = (lDash == std::string::npos) ? lFirst : std::stoi(lRange.substr(lDash + 1));
+      if (lFirst < 0 || lLast < lFirst) {
+        return false;
+      }
+      for (int lCpu = lFirst; lCpu <= lLast; lCpu++) {
+        pCpus.push_back(lCpu);
+      }
+    } catch (...) {
+      return false;
+    }
+  }
+
+  std::sort(pCpus.begin(), pCpus.end());
+  pCpus.erase(std::unique(pCpus.begin(), pCpus.end()), pCpus.end());
+  return !pCpus.empty();
+}
+
+bool ThreadPlacement::parseConfig(const std::string &pConfig, std::vector<Entry> &pEntries)
+{
+  std::stringstream lCfgStream(pConfig);
+  std::string lItem;
+
+  while (std::getline(lCfgStream, lItem, ';')) {
+    if (lItem.empty()) {
+      continue;
+    }
+
+    const auto lEq = lItem.find('=');
+    if (lEq == std::string::npos || lEq == 0) {
+      EDDLOG("Thread placement: invalid entry, expected <name>=<fields>. entry={}", lItem);
+      return false;
+    }
+
+    Entry lEntry;
+    lEntry.mPrefix = lItem.substr(0, lEq);
+
+    std::stringstream lFieldStream(lItem.substr(lEq + 1));
+    std::string lField;
+    while (std::getline(lFieldStream, lField, '|')) {
+      const auto lColon = lField.find(':');
+      const auto lKey = lField.substr(0, lColon);
+      const auto lVal = (lColon == std::string::npos) ? std::string() : lField.substr(lColon + 1);
+
+      try {
+        if (lKey == "cpu") {
+          if (!parseCpuList(lVal, lEntry.mCpus)) {
+            EDDLOG("Thread placement: invalid cpu list. entry={} cpu={}", lItem, lVal);
+            return false;
+          }
+        } else if (lKey == "numa") {
+          lEntry.mNumaNode = std::stoi(lVal);
+        } else if (lKey == "fifo") {
+          lEntry.mFifoPriority = std::clamp(std::stoi(lVal), 1, 99);
+        } else {
+          EDDLOG("Thread placement: unknown field. entry={} field={}", lItem, lField);
+          return false;
+        }
+      } catch (...) {
+        EDDLOG("Thread placement: invalid value. entry={} field={}", lItem, lField);
+        return false;
+      }
+    }
+
+    pEntries.push_back(std::move(lEntry));
+  }
+  return true;
+}
+
+const std::vector<ThreadPlacement::Entry>& ThreadPlacement::config()
+{
+  static const std::vector<Entry> sEntries = []() {
+    std::vector<Entry> lEntries;
+
+    const auto lCfg = std::getenv(ENV_THREAD_PLACEMENT);
+    if (lCfg && !parseConfig(lCfg, lEntries)) {
+      EDDLOG("Thread placement: ignoring invalid {}={}", ENV_THREAD_PLACEMENT, lCfg);
+      lEntries.clear();
+    }
+
+    // resolve NUMA nodes into CPU sets
+    for (auto &lEntry : lEntries) {
+      if (lEntry.mNumaNode < 0) {
+        continue;
+      }
+
+      std::ifstream lCpuListFile("/sys/devices/system/node/node" + std::to_string(lEntry.mNumaNode) + "/cpulist");
+      std::string lCpuList;
+      std::vector<int> lNodeCpus;
+      if (!std::getline(lCpuListFile, lCpuList) || !parseCpuList(lCpuList, lNodeCpus)) {
+        WDDLOG("Thread placement: cannot read CPUs of the NUMA node. prefix={} numa={}",
+          lEntry.mPrefix, lEntry.mNumaNode);
+        continue;
+      }
+
+      if (lEntry.mCpus.empty()) {
+        lEntry.mCpus = std::move(lNodeCpus);
+      } else {
+        std::vector<int> lCpus;
+        std::set_intersection(lEntry.mCpus.begin(), lEntry.mCpus.end(), lNodeCpus.begin(), lNodeCpus.end(),
+          std::back_inserter(lCpus));
+        if (lCpus.empty()) {
+          WDDLOG("Thread placement: none of the CPUs are on the NUMA node, using the CPU list. prefix={} numa={}",
+            lEntry.mPrefix, lEntry.mNumaNode);
+        } else {
+          lEntry.mCpus = std::move(lCpus);
+        }
+      }
+    }
+
+    // report the configuration on first use, i.e. when the first thread is started
+    for (const auto &lEntry : lEntries) {
+      IDDLOG("Thread placement: prefix={} cpus=[{}] numa={} fifo_priority={}",
+        lEntry.mPrefix, cpuListToString(lEntry.mCpus), lEntry.mNumaNode, lEntry.mFifoPriority);
+    }
+
+    return lEntries;
+  }();
+
+  return sEntries;
+}
+
+void ThreadPlacement::apply(const char *pThreadName)
+{
+  const auto &lEntries = config();
+  if (lEntries.empty() || !pThreadName) {
+    return;
+  }
+
+  const std::string_view lName(pThreadName);
+  const Entry *lMatch = nullptr;
+  for (const auto &lEntry : lEntries) {
+    if (lName.substr(0, lEntry.mPrefix.size()) == lEntry.mPrefix) {
+      if (!lMatch || lEntry.mPrefix.size() > lMatch->mPrefix.size()) {
+        lMatch = &lEntry;
+      }
+    }
+  }
+
+  if (!lMatch) {
+    return;
+  }
+
+#if defined(__linux__)
+  if (!lMatch->mCpus.empty()) {
+    cpu_set_t lCpuSet;
+    CPU_ZERO(&lCpuSet);
+    for (const auto lCpu : lMatch->mCpus) {
+      if (lCpu < CPU_SETSIZE) {
+        CPU_SET(lCpu, &lCpuSet);
+      }
+    }
+
+    const auto lRet = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &lCpuSet);
+    if (lRet != 0) {
+      WDDLOG("Thread placement: cannot set CPU affinity. thread={} error={}", lName, lRet);
+    }
+  }
+
+  if (lMatch->mFifoPriority > 0) {
+    sched_param lParam = { };
+    lParam.sched_priority = lMatch->mFifoPriority;
+
+    const auto lRet = pthread_setschedparam(pthread_self(), SCHED_FIFO, &lParam);
+    if (lRet != 0) {
+      WDDLOG("Thread placement: cannot set SCHED_FIFO. thread={} priority={} error={}",
+        lName, lMatch->mFifoPriority, lRet);
+    }
+  }
+
+  IDDLOG("Thread placement: thread={} prefix={} cpus=[{}] fifo_priority={}",
+    lName, lMatch->mPrefix, cpuListToString(lMatch->mCpus), lMatch->mFifoPriority);
+#endif
+}
+
+} /* o2::DataDistribution */
@@ -0,0 +1,64 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef ALICEO2_DATADIST_THREAD_PLACEMENT_H_
+#define ALICEO2_DATADIST_THREAD_PLACEMENT_H_
+
+#include <string>
+#include <vector>
+
+namespace o2::DataDistribution
+{
+
+////////////////////////////////////////////////////////////////////////////////
+/// ThreadPlacement
+///
+/// Maps thread names (or name prefixes) to a CPU set, NUMA node and SCHED_FIFO
+/// priority. The configuration is read from the DATADIST_THREAD_PLACEMENT
+/// environment variable, a ';' separated list of <name-prefix>=<fields>, where
+/// fields are '|' separated:
+///   cpu:<list>    CPU list, e.g. cpu:2-5,8
+///   numa:<node>   run on CPUs of the NUMA node (combined with cpu: if both given)
+///   fifo:<prio>   SCHED_FIFO with the given priority (1-99)
+/// Example: DATADIST_THREAD_PLACEMENT="stfb_builder=cpu:2|fifo:10;tfb_in=numa:1"
+/// The longest matching prefix is used. The configuration is logged when the first thread is started.
+////////////////////////////////////////////////////////////////////////////////
+
+static constexpr const char *ENV_THREAD_PLACEMENT = "DATADIST_THREAD_PLACEMENT";
+
+class ThreadPlacement
+{
+ public:
+  struct Entry {
+    std::string mPrefix;
+    std::vector<int> mCpus;
+    int mNumaNode = -1;
+    int mFifoPriority = 0;
+  };
+
+  ThreadPlacement() = delete;
+
+  // apply the configured placement to the calling thread
+  static void apply(const char *pThreadName);
+
+  // parsing helpers
+  static bool parseCpuList(const std::string &pList, std::vector<int> &pCpus /*[out]*/);
+  static bool parseConfig(const std::string &pConfig, std::vector<Entry> &pEntries /*[out]*/);
+
+ private:
+  static const std::vector<Entry>& config();
+};
+
+} /* o2::DataDistribution */
+
+#endif /* ALICEO2_DATADIST_THREAD_PLACEMENT_H_ */
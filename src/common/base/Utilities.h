@@ -21,9 +21,15 @@
 
 #include <array>
 #include <numeric>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
 
 #include <boost/dynamic_bitset.hpp>
 
+#include "ThreadPlacement.h"
+
 namespace o2::DataDistribution
 {
 
@@ -34,6 +40,9 @@ std::thread create_thread_member(const char* name, F&& f, Args&&... args) {
 #if defined(__linux__)
     pthread_setname_np(pthread_self(), lName);
 #endif
+    // cpu affinity and scheduling policy, if configured
+    ThreadPlacement::apply(lName);
+
     // run the function
     auto fun = std::mem_fn(f);
     fun(args...);
@@ -139,6 +148,139 @@ private:
 };
 
 
+/// Power of two histogram with lock-free recording
+///
+/// Bucket 0 counts zero values, bucket i counts values in [2^(i-1), 2^i).
+class Log2Histogram
+{
+public:
+  static constexpr std::size_t cNumBuckets = 32;
+
+  void record(const std::uint64_t pVal) {
+    const std::size_t lIdx = (pVal == 0) ? 0 : std::min<std::size_t>(64 - __builtin_clzll(pVal), cNumBuckets - 1);
+    mBuckets[lIdx].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::array<std::uint64_t, cNumBuckets> snapshot() const {
+    std::array<std::uint64_t, cNumBuckets> lRet;
+    for (std::size_t i = 0; i < cNumBuckets; i++) {
+      lRet[i] = mBuckets[i].load(std::memory_order_relaxed);
+    }
+    return lRet;
+  }
+
+  // take the recorded values and start a new interval
+  std::array<std::uint64_t, cNumBuckets> snapshot_reset() {
+    std::array<std::uint64_t, cNumBuckets> lRet;
+    for (std::size_t i = 0; i < cNumBuckets; i++) {
+      lRet[i] = mBuckets[i].exchange(0, std::memory_order_relaxed);
+    }
+    return lRet;
+  }
+
+  // upper bound of the bucket containing the requested percentile
+  static std::uint64_t percentile(const std::array<std::uint64_t, cNumBuckets> &pHist, const double pPerc) {
+    std::uint64_t lTotal = 0;
+    for (const auto lCnt : pHist) {
+      lTotal += lCnt;
+    }
+    if (lTotal == 0) {
+      return 0;
+    }
+
+    const std::uint64_t lTarget = std::uint64_t(std::max(1.0, pPerc / 100.0 * double(lTotal)));
+    std::uint64_t lSum = 0;
+    for (std::size_t i = 0; i < cNumBuckets; i++) {
+      lSum += pHist[i];
+      if (lSum >= lTarget) {
+        return (i == 0) ? 0 : (std::uint64_t(1) << i);
+      }
+    }
+    return std::uint64_t(1) << (cNumBuckets - 1);
+  }
+
+private:
+  std::array<std::atomic_uint64_t, cNumBuckets> mBuckets = { };
+};
+
+/// Log-linear histogram with lock-free recording
+///
+/// Values below cSubBuckets are counted exactly. Every higher power of two is split into
+/// cSubBuckets linear buckets, which bounds the relative error of percentiles to 1/cSubBuckets.
+class LogLinearHistogram
+{
+public:
+  static constexpr std::size_t cSubBits = 3;
+  static constexpr std::size_t cSubBuckets = std::size_t(1) << cSubBits;
+  static constexpr std::size_t cNumBuckets = cSubBuckets + (64 - cSubBits) * cSubBuckets;
+
+  struct Snapshot {
+    std::array<std::uint64_t, cNumBuckets> mBuckets;
+    std::uint64_t mCount = 0;
+    std::uint64_t mMax = 0;
+  };
+
+  static std::size_t bucket_index(const std::uint64_t pVal) {
+    if (pVal < cSubBuckets) {
+      return std::size_t(pVal);
+    }
+    const std::size_t lExp = 63 - __builtin_clzll(pVal);
+    const std::size_t lSub = std::size_t(pVal >> (lExp - cSubBits)) & (cSubBuckets - 1);
+    return cSubBuckets + (lExp - cSubBits) * cSubBuckets + lSub;
+  }
+
+  // largest value counted in the bucket
+  static std::uint64_t bucket_upper(const std::size_t pIdx) {
+    if (pIdx < cSubBuckets) {
+      return pIdx;
+    }
+    const std::size_t lExp = (pIdx - cSubBuckets) / cSubBuckets + cSubBits;
+    const std::uint64_t lSub = (pIdx - cSubBuckets) % cSubBuckets;
+    const std::uint64_t lLower = (cSubBuckets + lSub) << (lExp - cSubBits);
+    return lLower + ((std::uint64_t(1) << (lExp - cSubBits)) - 1);
+  }
+
+  void record(const std::uint64_t pVal) {
+    mBuckets[bucket_index(pVal)].fetch_add(1, std::memory_order_relaxed);
+
+    std::uint64_t lMax = mMax.load(std::memory_order_relaxed);
+    while (pVal > lMax && !mMax.compare_exchange_weak(lMax, pVal, std::memory_order_relaxed)) { }
+  }
+
+  // take the recorded values and start a new interval
+  Snapshot snapshot_reset() {
+    Snapshot lRet;
+    for (std::size_t i = 0; i < cNumBuckets; i++) {
+      lRet.mBuckets[i] = mBuckets[i].exchange(0, std::memory_order_relaxed);
+      lRet.mCount += lRet.mBuckets[i];
+    }
+    lRet.mMax = mMax.exchange(0, std::memory_order_relaxed);
+    return lRet;
+  }
+
+  // upper bound of the bucket containing the requested percentile, not larger than the maximum
+  static std::uint64_t percentile(const Snapshot &pSnap, const double pPerc) {
+    if (pSnap.mCount == 0) {
+      return 0;
+    }
+
+    const std::uint64_t lTarget = std::uint64_t(std::max(1.0, std::ceil(pPerc / 100.0 * double(pSnap.mCount))));
+    std::uint64_t lSum = 0;
+    for (std::size_t i = 0; i < cNumBuckets; i++) {
+      lSum += pSnap.mBuckets[i];
+      if (lSum >= lTarget) {
+        return std::min(bucket_upper(i), pSnap.mMax);
+      }
+    }
+    return pSnap.mMax;
+  }
+
+private:
+  std::array<std::atomic_uint64_t, cNumBuckets> mBuckets = { };
+  std::atomic_uint64_t mMax = 0;
+};
+
+
 class EventRecorder {
 public:
   EventRecorder() = delete;
@@ -23,6 +23,8 @@
 
 #include <string>
 #include <map>
+#include <vector>
+#include <optional>
 #include <cassert>
 #include <future>
 
@@ -31,6 +33,7 @@
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/asio/ip/host_name.hpp>
+#include <boost/algorithm/string.hpp>
 
 namespace o2::DataDistribution
 {
@@ -104,6 +107,8 @@ public:
 
   static constexpr const char* OptionKeyDiscoveryPartition = "discovery-partition";
 
+  static constexpr const char* OptionKeyDiscoveryTopology = "discovery-topology";
+
   static
   boost::program_options::options_description getProgramOptions(const ProcessType pProcType)
   {
@@ -129,6 +134,11 @@ public:
         OptionKeyDiscoveryPartition,
         boost::program_options::value<std::string>()->default_value(""),
         "Specifies partition ID for the DataDistribution discovery.");
+
+      lDataDistDiscovery.add_options()(
+        OptionKeyDiscoveryTopology,
+        boost::program_options::value<std::string>()->default_value(""),
+        "Specifies network topology labels of the process, e.g. 'rack=r12,switch=leaf3'.");
     }
 
     return lDataDistDiscovery;
@@ -205,6 +215,27 @@ public:
     }
   }
 
+  static
+  std::map<std::string, std::string> getTopologyOption(const FairMQProgOptions& pFMQProgOpt)
+  {
+    std::map<std::string, std::string> lLabels;
+    const std::string lTopology = pFMQProgOpt.GetValue<std::string>(OptionKeyDiscoveryTopology);
+
+    std::vector<std::string> lKeyValues;
+    boost::split(lKeyValues, lTopology, boost::is_any_of(","), boost::token_compress_on);
+    for (auto &lKeyValue : lKeyValues) {
+      const auto lPos = lKeyValue.find('=');
+      if (lPos == std::string::npos || lPos == 0) {
+        if (!lKeyValue.empty()) {
+          WDDLOG("Ignoring topology label without a value. {}={}", OptionKeyDiscoveryTopology, lTopology);
+        }
+        continue;
+      }
+      lLabels[boost::trim_copy(lKeyValue.substr(0, lPos))] = boost::trim_copy(lKeyValue.substr(lPos + 1));
+    }
+    return lLabels;
+  }
+
   static
   std::optional<std::string> getPartitionOption(const FairMQProgOptions& pFMQProgOpt)
   {
@@ -16,6 +16,7 @@
 
 #include "Config.h"
 #include "ConfigParameters.h"
+#include "ConsulWatch.h"
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
@@ -27,7 +28,10 @@
 #include <boost/algorithm/string/trim.hpp>
 
 #include <ppconsul/kv.h>
+#include <chrono>
+#include <cstdlib>
 #include <string>
+#include <thread>
 #include <variant>
 #include <mutex>
 
@@ -74,7 +78,7 @@ public:
   { }
   ConsulConfig(ConsulConfig &&) = default;
 
-  virtual ~ConsulConfig() { cleanup(); }
+  virtual ~ConsulConfig() { mWatch.reset(); cleanup(); }
 
   bool write(bool pIinitial = false)
   {
@@ -126,8 +130,82 @@ public:
 
   T& status() { return mStatus; }
 
+  /// Keep the partition keys under pSubPrefix (e.g. "TfSchedulerInstance", or all when empty) in an
+  /// in-process cache updated with blocking queries. The readers use the cache once it is synchronized.
+  bool startWatch(const std::string &pSubPrefix = "")
+  {
+    using namespace std::string_literals;
+
+    const auto &lPartId = mStatus.partition().partition_id();
+    if (lPartId.empty() || mWatch) {
+      return false;
+    }
+
+    std::chrono::seconds lWait = std::chrono::seconds(10);
+    const auto lWaitVar = getenv("DATADIST_CONSUL_WATCH_S");
+    if (lWaitVar) {
+      try {
+        lWait = std::chrono::seconds(std::stoul(lWaitVar));
+      } catch (...) {
+        EDDLOG("Consul watch wait time is not valid. DATADIST_CONSUL_WATCH_S={}", lWaitVar);
+      }
+    }
+    if (lWait.count() == 0) {
+      IDDLOG("Consul watch is disabled, discovery data will be queried directly.");
+      return false;
+    }
+
+    const std::string lPrefix = "epn/data-dist/partition/"s + lPartId + "/"s + pSubPrefix;
+    mWatch = std::make_unique<ConsulKvWatch>(mEndpoint, lPrefix, lWait);
+    mWatch->start();
+
+    IDDLOG("Watching Consul discovery keys. prefix={} wait_s={}", lPrefix, lWait.count());
+    return true;
+  }
+
+  ConsulKvWatch* watch() { return mWatch.get(); }
+
+  /// wait for a change of the watched keys, or sleep for pTimeout without a watch. pIndex is updated.
+  bool waitForUpdate(std::uint64_t &pIndex, const std::chrono::milliseconds pTimeout)
+  {
+    if (mWatch) {
+      return mWatch->waitForChange(pIndex, pTimeout);
+    }
+    std::this_thread::sleep_for(pTimeout);
+    return false;
+  }
+
 private:
 
+  // read through the watch cache if it covers the key
+  bool readItem(const std::string &pKey, std::string &pValue /*out*/)
+  {
+    if (mWatch && mWatch->synced() && mWatch->covers(pKey)) {
+      return mWatch->get(pKey, pValue);
+    }
+
+    std::scoped_lock lLock(mConsulLock);
+    Kv kv(*mConsul);
+
+    const auto lItem = kv.item(pKey);
+    if (!lItem.valid()) {
+      return false;
+    }
+    pValue = lItem.value;
+    return true;
+  }
+
+  std::vector<KeyValue> readItems(const std::string &pPrefix)
+  {
+    if (mWatch && mWatch->synced() && mWatch->covers(pPrefix)) {
+      return mWatch->items(pPrefix);
+    }
+
+    std::scoped_lock lLock(mConsulLock);
+    Kv kv(*mConsul);
+    return kv.items(pPrefix);
+  }
+
   bool createKeyPrefix();
 
   bool write_string(const std::string &lData, const bool pInitial = false)
@@ -168,6 +246,8 @@ private:
   std::unique_ptr<ppconsul::Consul> mConsul;
   std::string mConsulKey;
 
+  std::unique_ptr<ConsulKvWatch> mWatch;
+
   T mStatus;
 
 private:
@@ -311,23 +391,18 @@ public:
     const std::string lConsulKey = sKeyPrefix + pPartId + "/StfSender/" + pStfSenderId;
 
     try {
-      std::scoped_lock lLock(mConsulLock);
-
-      Kv kv(*mConsul);
-
-      const auto lReqItem = kv.item(lConsulKey);
-
-      if (!lReqItem.valid()) {
+      std::string lValue;
+      if (!readItem(lConsulKey, lValue)) {
         // does not exist!
         return false;
       }
 
-      if (lReqItem.value.empty()) {
+      if (lValue.empty()) {
         EDDLOG("Consul: no data returned for key: {}", lConsulKey);
         return false;
       }
 
-      if (!pStfSenderStat.ParseFromString(lReqItem.value)) {
+      if (!pStfSenderStat.ParseFromString(lValue)) {
         EDDLOG("Cannot parse protobuf message from consul! (type StfSenderConfigStatus)");
       }
 
@@ -346,23 +421,18 @@ public:
     const std::string lConsulKey = sKeyPrefix + pPartId + "/TfBuilder/" + pTfBuilderId;
 
     try {
-      std::scoped_lock lLock(mConsulLock);
-
-      Kv kv(*mConsul);
-
-      const auto lReqItem = kv.item(lConsulKey);
-
-      if (!lReqItem.valid()) {
+      std::string lValue;
+      if (!readItem(lConsulKey, lValue)) {
         EDDLOG("Consul: key does not exist: {}", lConsulKey);
         return false;
       }
 
-      if (lReqItem.value.empty()) {
+      if (lValue.empty()) {
         EDDLOG("Consul: no data returned for key: {}", lConsulKey);
         return false;
       }
 
-      if (!pTfBuilderStat.ParseFromString(lReqItem.value)) {
+      if (!pTfBuilderStat.ParseFromString(lValue)) {
         EDDLOG("Cannot parse protobuf message from consul! (type StfSenderConfigStatus)");
       }
 
@@ -383,12 +453,8 @@ public:
 
     // get the scheduler instance with the "smallest" ID
     try {
-      std::scoped_lock lLock(mConsulLock);
-
-      Kv kv(*mConsul);
-
       // get all schedulers in the partition
-      auto lReqItems = kv.items(lConsulKey);
+      auto lReqItems = readItems(lConsulKey);
       if (lReqItems.empty()) {
         return false;
       }
@@ -0,0 +1,174 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "ConsulWatch.h"
+
+#include <DataDistLogger.h>
+#include <Utilities.h>
+
+#include <algorithm>
+#include <optional>
+
+namespace o2::DataDistribution
+{
+
+using namespace std::chrono_literals;
+
+void ConsulKvWatch::start()
+{
+  mRunning = true;
+  mWatchThread = create_thread_member("consul_watch", &ConsulKvWatch::WatchThread, this);
+}
+
+void ConsulKvWatch::stop()
+{
+  {
+    std::scoped_lock lLock(mCacheLock);
+    mRunning = false;
+  }
+  mCacheCV.notify_all();
+
+  if (mWatchThread.joinable()) {
+    mWatchThread.join();
+  }
+}
+
+bool ConsulKvWatch::get(const std::string &pKey, std::string &pValue) const
+{
+  std::scoped_lock lLock(mCacheLock);
+  const auto lIt = mCache.find(pKey);
+  if (lIt == mCache.end()) {
+    return false;
+  }
+  pValue = lIt->second.value;
+  return true;
+}
+
+std::vector<ppconsul::kv::KeyValue> ConsulKvWatch::items(const std::string &pPrefix) const
+{
+  std::vector<ppconsul::kv::KeyValue> lItems;
+
+  std::scoped_lock lLock(mCacheLock);
+  for (auto lIt = mCache.lower_bound(pPrefix); lIt != mCache.end(); ++lIt) {
+    if (lIt->first.compare(0, pPrefix.size(), pPrefix) != 0) {
+      break;
+    }
+    lItems.push_back(lIt->second);
+  }
+  return lItems;
+}
+
+bool ConsulKvWatch::waitForChange(std::uint64_t &pIndex, const std::chrono::milliseconds pTimeout)
+{
+  std::unique_lock lLock(mCacheLock);
+  mCacheCV.wait_for(lLock, pTimeout, [&]() { return !mRunning || (mSynced && mIndex != pIndex); });
+
+  const bool lChanged = mSynced && (mIndex != pIndex);
+  pIndex = mIndex;
+  return lChanged;
+}
+
+void ConsulKvWatch::addCallback(ChangeCallback pCallback)
+{
+  std::scoped_lock lLock(mCallbacksLock);
+  mCallbacks.push_back(std::move(pCallback));
+}
+
+void ConsulKvWatch::update(std::vector<ppconsul::kv::KeyValue> &&pItems, const std::uint64_t pIndex)
+{
+  std::map<std::string, ppconsul::kv::KeyValue> lNewCache;
+  for (auto &lItem : pItems) {
+    std::string lKey = lItem.key;
+    lNewCache.emplace(std::move(lKey), std::move(lItem));
+  }
+
+  std::vector<std::pair<std::string, std::optional<std::string>>> lChanges;
+  {
+    std::scoped_lock lLock(mCacheLock);
+
+    for (const auto &[lKey, lItem] : lNewCache) {
+      const auto lOld = mCache.find(lKey);
+      if (lOld == mCache.end() || lOld->second.modifyIndex != lItem.modifyIndex) {
+        lChanges.emplace_back(lKey, lItem.value);
+      }
+    }
+    for (const auto &[lKey, lItem] : mCache) {
+      if (lNewCache.count(lKey) == 0) {
+        lChanges.emplace_back(lKey, std::nullopt);
+      }
+    }
+
+    mCache.swap(lNewCache);
+    mIndex = pIndex;
+    mSynced = true;
+  }
+  mCacheCV.notify_all();
+
+  if (lChanges.empty()) {
+    return;
+  }
+
+  DDDLOG("Consul watch: keys changed. prefix={} changed={} index={}", mPrefix, lChanges.size(), pIndex);
+
+  std::scoped_lock lLock(mCallbacksLock);
+  for (const auto &[lKey, lValue] : lChanges) {
+    for (const auto &lCallback : mCallbacks) {
+      lCallback(lKey, lValue ? &lValue.value() : nullptr);
+    }
+  }
+}
+
+void ConsulKvWatch::WatchThread()
+{
+  DDDLOG("Starting Consul watch thread. prefix={} wait_s={}", mPrefix, mWait.count());
+
+  std::unique_ptr<ppconsul::Consul> lConsul;
+  std::uint64_t lIndex = 0;
+  std::chrono::milliseconds lBackoff = 0ms;
+
+  while (mRunning) {
+    if (lBackoff > 0ms) {
+      std::this_thread::sleep_for(lBackoff);
+    }
+
+    try {
+      // blocking queries hold the connection, do not share the client of ConsulConfig
+      if (!lConsul) {
+        lConsul = std::make_unique<ppconsul::Consul>(mEndpoint);
+      }
+      ppconsul::kv::Kv lKv(*lConsul);
+
+      auto lResp = lKv.items(ppconsul::withHeaders, mPrefix,
+        ppconsul::kv::kw::block_for = { std::chrono::duration_cast<std::chrono::milliseconds>(mWait), lIndex });
+
+      const std::uint64_t lNewIndex = lResp.headers().index();
+      if (lNewIndex == lIndex && mSynced) {
+        continue; // wait time expired without changes
+      }
+
+      update(std::move(lResp.data()), lNewIndex);
+
+      // the index must grow, start over if Consul was restarted
+      lIndex = (lNewIndex < lIndex) ? 0 : std::max(lNewIndex, std::uint64_t(1));
+      lBackoff = 0ms;
+    } catch (std::exception &e) {
+      WDDLOG_RL(10000, "Consul watch query failed. prefix={} what={}", mPrefix, e.what());
+      lConsul.reset();
+      lBackoff = std::min(lBackoff + 500ms, std::chrono::milliseconds(5000));
+    }
+  }
+
+  DDDLOG("Exiting Consul watch thread. prefix={}", mPrefix);
+}
+
+} /* namespace o2::DataDistribution */
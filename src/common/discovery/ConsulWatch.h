@@ -0,0 +1,88 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef ALICEO2_DATADIST_CONSULWATCH_H_
+#define ALICEO2_DATADIST_CONSULWATCH_H_
+
+#include <ppconsul/kv.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace o2::DataDistribution
+{
+
+/// In-process cache of a Consul key prefix, kept up to date with blocking queries
+///
+/// Readers get the discovery data from memory instead of querying Consul. Change callbacks are
+/// called from the watch thread for every added or modified key (pValue set) and erased key (nullptr).
+class ConsulKvWatch {
+public:
+  using ChangeCallback = std::function<void(const std::string &pKey, const std::string *pValue)>;
+
+  ConsulKvWatch(const std::string &pEndpoint, const std::string &pPrefix, const std::chrono::seconds pWait)
+  : mEndpoint(pEndpoint), mPrefix(pPrefix), mWait(pWait)
+  { }
+
+  ~ConsulKvWatch() { stop(); }
+
+  void start();
+  /// can take up to the blocking query wait time
+  void stop();
+
+  const std::string& prefix() const { return mPrefix; }
+  bool covers(const std::string &pKey) const { return pKey.compare(0, mPrefix.size(), mPrefix) == 0; }
+
+  /// the initial query returned, the cache reflects the prefix
+  bool synced() const { return mSynced; }
+
+  bool get(const std::string &pKey, std::string &pValue /*out*/) const;
+  /// all cached keys starting with pPrefix, in key order
+  std::vector<ppconsul::kv::KeyValue> items(const std::string &pPrefix) const;
+
+  /// wait until the cache changed since pIndex (0: not synced yet). pIndex is updated.
+  bool waitForChange(std::uint64_t &pIndex, const std::chrono::milliseconds pTimeout);
+
+  void addCallback(ChangeCallback pCallback);
+
+private:
+  void WatchThread();
+  void update(std::vector<ppconsul::kv::KeyValue> &&pItems, const std::uint64_t pIndex);
+
+  std::string mEndpoint;
+  std::string mPrefix;
+  std::chrono::seconds mWait;
+
+  std::atomic_bool mRunning = false;
+  std::atomic_bool mSynced = false;
+  std::thread mWatchThread;
+
+  mutable std::mutex mCacheLock;
+  std::condition_variable mCacheCV;
+  std::map<std::string, ppconsul::kv::KeyValue> mCache;
+  std::uint64_t mIndex = 0;
+
+  std::mutex mCallbacksLock;
+  std::vector<ChangeCallback> mCallbacks;
+};
+
+} /* namespace o2::DataDistribution */
+
+#endif /* ALICEO2_DATADIST_CONSULWATCH_H_ */
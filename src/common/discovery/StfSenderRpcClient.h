@@ -25,6 +25,8 @@
 
 #include <vector>
 #include <map>
+#include <memory>
+#include <chrono>
 #include <thread>
 
 namespace o2::DataDistribution
@@ -37,6 +39,23 @@ using grpc::ClientContext;
 using grpc::Status;
 
 
+/// State of an asynchronous StfSender request, used as the completion queue tag
+template <typename Response>
+struct StfSenderAsyncCall {
+  ClientContext mContext;
+  Response mResponse;
+  Status mStatus;
+  std::unique_ptr<grpc::ClientAsyncResponseReader<Response>> mReader;
+
+  std::string mStfSenderId;
+  std::uint32_t mEndpointIdx = 0;
+};
+
+using ConnectTfBuilderAsyncCall = StfSenderAsyncCall<ConnectTfBuilderResponse>;
+using DisconnectTfBuilderAsyncCall = StfSenderAsyncCall<StatusResponse>;
+using HealthProbeAsyncCall = StfSenderAsyncCall<StatusResponse>;
+
+
 class StfSenderRpcClient {
 public:
   StfSenderRpcClient() = delete;
@@ -54,6 +73,36 @@ public:
     return mStub->DisconnectTfBuilderRequest(&lContext, pParam, &pRet);
   }
 
+  // rpc ConnectTfBuilderRequest: the completed pCall is returned by pCq as the tag
+  void ConnectTfBuilderRequestAsync(const TfBuilderEndpoint &pParam, ConnectTfBuilderAsyncCall *pCall,
+    grpc::CompletionQueue *pCq, const std::chrono::milliseconds pDeadline)
+  {
+    pCall->mContext.set_deadline(std::chrono::system_clock::now() + pDeadline);
+    pCall->mReader = mStub->PrepareAsyncConnectTfBuilderRequest(&pCall->mContext, pParam, pCq);
+    pCall->mReader->StartCall();
+    pCall->mReader->Finish(&pCall->mResponse, &pCall->mStatus, pCall);
+  }
+
+  // rpc DisconnectTfBuilderRequest: the completed pCall is returned by pCq as the tag
+  void DisconnectTfBuilderRequestAsync(const TfBuilderEndpoint &pParam, DisconnectTfBuilderAsyncCall *pCall,
+    grpc::CompletionQueue *pCq, const std::chrono::milliseconds pDeadline)
+  {
+    pCall->mContext.set_deadline(std::chrono::system_clock::now() + pDeadline);
+    pCall->mReader = mStub->PrepareAsyncDisconnectTfBuilderRequest(&pCall->mContext, pParam, pCq);
+    pCall->mReader->StartCall();
+    pCall->mReader->Finish(&pCall->mResponse, &pCall->mStatus, pCall);
+  }
+
+  // rpc HealthProbe: the completed pCall is returned by pCq as the tag
+  void HealthProbeAsync(HealthProbeAsyncCall *pCall, grpc::CompletionQueue *pCq,
+    const std::chrono::milliseconds pDeadline)
+  {
+    pCall->mContext.set_deadline(std::chrono::system_clock::now() + pDeadline);
+    pCall->mReader = mStub->PrepareAsyncHealthProbe(&pCall->mContext, ::google::protobuf::Empty(), pCq);
+    pCall->mReader->StartCall();
+    pCall->mReader->Finish(&pCall->mResponse, &pCall->mStatus, pCall);
+  }
+
   // rpc StfDataRequest(StfDataRequestMessage) returns (StfDataResponse) { }
   grpc::Status StfDataRequest(const StfDataRequestMessage &pParam, StfDataResponse &pRet /*out*/) {
     ClientContext lContext;
@@ -145,14 +194,17 @@ public:
       // create the RPC client
       mClients.try_emplace(
         lStfSenderId,
-        std::make_unique<StfSenderRpcClient>(lStfSenderStatus.rpc_endpoint())
+        std::make_shared<StfSenderRpcClient>(lStfSenderStatus.rpc_endpoint())
       );
     }
 
     IDDLOG_RL(1000, "gRPC: Connected to {} out of {} StfSender{}",
       mClients.size(), lNumStfSenders, lNumStfSenders > 1 ? "s" : "");
 
-    if (mClients.size() != lNumStfSenders) {
+    // when StfSender keys are watched the caller waits for the StfSenders to register
+    const auto lWatch = mDiscoveryConfig->watch();
+    const bool lWatched = lWatch && lWatch->covers("epn/data-dist/partition/" + lPartId + "/StfSender/");
+    if (mClients.size() != lNumStfSenders && !lWatched) {
       static int sBackoff = 0;
       sBackoff = std::min(sBackoff + 1, 10);
       // back off until gRPC servers on all StfSeners become ready
@@ -212,6 +264,20 @@ public:
     return false;
   }
 
+  /// clients in StfSender id order. Clients stay valid when removed from the collection (requests in flight)
+  std::vector<std::pair<std::string, std::shared_ptr<StfSenderRpcClient>>> snapshot()
+  {
+    std::scoped_lock lLock(mClientsGlobalLock);
+    return { mClients.begin(), mClients.end() };
+  }
+
+  std::shared_ptr<StfSenderRpcClient> get(const std::string &pId)
+  {
+    std::scoped_lock lLock(mClientsGlobalLock);
+    const auto lIt = mClients.find(pId);
+    return (lIt != mClients.end()) ? lIt->second : nullptr;
+  }
+
   std::size_t size() const { return mClients.size(); }
   std::size_t count(const std::string &pId) const { return mClients.count(pId); }
   auto& operator[](const std::string &pId) const { return mClients.at(pId); }
@@ -226,7 +292,7 @@ private:
 
   bool mClientsCreated = false;
   std::recursive_mutex mClientsGlobalLock;
-  std::map<std::string, std::unique_ptr<StfSenderRpcClient>> mClients;
+  std::map<std::string, std::shared_ptr<StfSenderRpcClient>> mClients;
 };
 
 } /* namespace o2::DataDistribution */
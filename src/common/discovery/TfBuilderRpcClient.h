@@ -20,8 +20,11 @@
 #include <discovery.grpc.pb.h>
 #include <grpcpp/grpcpp.h>
 
+#include <atomic>
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <thread>
 
 namespace o2::DataDistribution
@@ -34,6 +37,18 @@ using grpc::ClientContext;
 using grpc::Status;
 
 
+/// State of an asynchronous BuildTfRequest, used as the completion queue tag
+struct BuildTfAsyncCall {
+  ClientContext mContext;
+  BuildTfResponse mResponse;
+  Status mStatus;
+  std::unique_ptr<grpc::ClientAsyncResponseReader<BuildTfResponse>> mReader;
+
+  std::string mTfBuilderId;
+  std::uint64_t mTfId = 0;
+  std::uint64_t mTfSize = 0; // announced size
+};
+
 class TfBuilderRpcClientCtx {
 public:
   TfBuilderRpcClientCtx() { }
@@ -99,6 +114,23 @@ public:
     return false;
   }
 
+  // rpc BuildTfRequest: the completed pCall is returned by pCq as the tag
+  bool BuildTfRequestAsync(const TfBuildingInformation &pTfInfo, BuildTfAsyncCall *pCall, grpc::CompletionQueue *pCq)
+  {
+    using namespace std::chrono_literals;
+
+    if (!mStub) {
+      return false;
+    }
+
+    pCall->mContext.set_deadline(std::chrono::system_clock::now() + 5s);
+    pCall->mResponse.Clear();
+    pCall->mReader = mStub->PrepareAsyncBuildTfRequest(&pCall->mContext, pTfInfo, pCq);
+    pCall->mReader->StartCall();
+    pCall->mReader->Finish(&pCall->mResponse, &pCall->mStatus, pCall);
+    return true;
+  }
+
   //  rpc TerminatePartition(PartitionInfo) returns (PartitionResponse) { }
   bool TerminatePartition() {
     ClientContext lContext;
@@ -138,139 +170,94 @@ private:
 };
 
 
+/// Reference to a client of the collection, valid after the client is removed from the collection
 class TfBuilderRpcClient {
 public:
-  TfBuilderRpcClient(TfBuilderRpcClientCtx *pCtx, std::recursive_mutex *pMtx)
-  : mCliCtx(pCtx),
-    mMtx(pMtx)
-  {
-    if (mMtx) {
-      mMtx->lock();
-    }
-  }
-
-  ~TfBuilderRpcClient() { put(); }
+  TfBuilderRpcClient(std::shared_ptr<TfBuilderRpcClientCtx> pCtx)
+  : mCliCtx(std::move(pCtx))
+  { }
 
   TfBuilderRpcClientCtx& get() { return *mCliCtx; }
-  void put()
-  {
-    if (mMtx) {
-      mMtx->unlock();
-      mCliCtx = nullptr;
-      mMtx = nullptr;
-    }
-  }
+  void put() { mCliCtx.reset(); }
 
   operator bool() const { return mCliCtx != nullptr; }
 
 private:
-  TfBuilderRpcClientCtx *mCliCtx;
-  std::recursive_mutex *mMtx;
+  std::shared_ptr<TfBuilderRpcClientCtx> mCliCtx;
 };
 
 
+/// TfBuilder clients in an immutable map. Updates copy the map and publish it with an atomic
+/// pointer swap, lookups do not take locks. Removed clients are stopped when the last reference is released.
 template <class T>
 class TfBuilderRpcClientCollection {
 public:
+  using ClientMap = std::map<std::string, std::shared_ptr<TfBuilderRpcClientCtx>>;
+
   TfBuilderRpcClientCollection(std::shared_ptr<T> pDiscoveryConfig)
   : mDiscoveryConfig(pDiscoveryConfig)
   { }
 
-  struct RpcClient {
-    std::unique_ptr<std::recursive_mutex>  mClientLock;
-    std::unique_ptr<TfBuilderRpcClientCtx> mClient;
-  };
-
-
   bool remove(const std::string pId)
   {
-    std::scoped_lock lLock(mClientsGlobalLock);
+    std::scoped_lock lLock(mClientsUpdateLock);
 
-    if (mClients.count(pId) > 0) {
-
-      RpcClient lCliStruct = std::move(mClients.at(pId));
-      {
-        // we have to wait for RpcClient lock before erasing
-        std::scoped_lock lCliLock(mClientsGlobalLock, *(lCliStruct.mClientLock));
-
-        lCliStruct.mClient->stop();
-
-        mClients.erase(pId);
-      } // need to unlock lCliStruct.mClientLock here before destroying the object
-
-      return true;
+    const auto lClients = snapshot();
+    if (lClients->count(pId) == 0) {
+      return false;
     }
 
-    return false;
+    auto lNewClients = std::make_shared<ClientMap>(*lClients);
+    lNewClients->erase(pId);
+    publish(std::move(lNewClients));
+    return true;
   }
 
-
   bool add(const std::string &pId)
   {
-    std::scoped_lock lLock(mClientsGlobalLock);
-
-    remove(pId);
-
-    mClients.emplace(
-      pId,
-      RpcClient()
-    );
+    // connect without blocking the updates
+    auto lClient = std::make_shared<TfBuilderRpcClientCtx>();
+    const auto lRet = lClient->start(mDiscoveryConfig, pId);
 
-    RpcClient &lCli = mClients[pId];
-    lCli.mClientLock = std::make_unique<std::recursive_mutex>();
-    lCli.mClient = std::make_unique<TfBuilderRpcClientCtx>();
+    std::scoped_lock lLock(mClientsUpdateLock);
 
-    auto lRet = lCli.mClient->start(mDiscoveryConfig, pId);
-    if (!lRet) {
-      mClients.erase(pId);
+    auto lNewClients = std::make_shared<ClientMap>(*snapshot());
+    lNewClients->erase(pId);
+    if (lRet) {
+      lNewClients->emplace(pId, std::move(lClient));
     }
+    publish(std::move(lNewClients));
 
     return lRet;
   }
 
-  TfBuilderRpcClient get(const std::string &pId)
+  TfBuilderRpcClient get(const std::string &pId) const
   {
-    std::scoped_lock lLock(mClientsGlobalLock);
-
-    if (mClients.count(pId) > 0) {
-
-      RpcClient &lCli = mClients[pId];
-
-      return TfBuilderRpcClient(lCli.mClient.get(), lCli.mClientLock.get());
-    }
-
-    return TfBuilderRpcClient(nullptr, nullptr);
+    const auto lClients = snapshot();
+    const auto lIt = lClients->find(pId);
+    return TfBuilderRpcClient((lIt != lClients->end()) ? lIt->second : nullptr);
   }
 
-  std::size_t size() const { return mClients.size(); }
-  std::size_t count(const std::string &pId) const { return mClients.count(pId); }
-  // auto& operator[] const (const std::string &pId) const { return mClients.at(pId); }
+  std::shared_ptr<const ClientMap> snapshot() const { return std::atomic_load(&mClients); }
 
-  auto begin() const { return mClients.begin(); }
-  auto end() const { return mClients.end(); }
+  std::size_t size() const { return snapshot()->size(); }
+  std::size_t count(const std::string &pId) const { return snapshot()->count(pId); }
 
   void clear() {
-    // remove each of the clients while holding their locks
-    std::scoped_lock lLock(mClientsGlobalLock);
-
-    for (auto &[lId, lCli] : mClients) {
-      (void)lCli;
-      RpcClient lCliStruct = std::move(mClients.at(lId));
-
-      // we have to wait for RpcClient lock before erasing
-      std::scoped_lock lCliLock(mClientsGlobalLock, *(lCliStruct.mClientLock));
-      lCliStruct.mClient->stop();
-    }
-
-    mClients.clear();
+    std::scoped_lock lLock(mClientsUpdateLock);
+    publish(std::make_shared<ClientMap>());
   }
 
 private:
+  void publish(std::shared_ptr<ClientMap> &&pClients)
+  {
+    std::atomic_store(&mClients, std::shared_ptr<const ClientMap>(std::move(pClients)));
+  }
 
   std::shared_ptr<T> mDiscoveryConfig;
 
-  std::recursive_mutex mClientsGlobalLock;
-  std::map<std::string, RpcClient> mClients;
+  std::mutex mClientsUpdateLock;
+  std::shared_ptr<const ClientMap> mClients = std::make_shared<const ClientMap>();
 };
 
 
@@ -97,6 +97,45 @@ bool TfSchedulerRpcClient::NumStfSendersInPartitionRequest(std::uint32_t &pNumSt
 }
 
 
+// rpc PartitionReadyStream(PartitionInfo) returns (stream PartitionReadyNotification) { }
+bool TfSchedulerRpcClient::PartitionReadyWait(const std::chrono::milliseconds pTimeout,
+  TfBuilderConnectionStatus &pStatus /*out*/)
+{
+  if (!mStub || !is_alive()) {
+    EDDLOG_GRL(1000, "PartitionReadyWait: no gRPC connection to scheduler");
+    return false;
+  }
+
+  ClientContext lContext;
+  lContext.set_deadline(std::chrono::system_clock::now() + pTimeout);
+
+  PartitionInfo lPartInfo; // TODO: specify and check partition ID
+  PartitionReadyNotification lNotification;
+  bool lFinal = false;
+
+  auto lReader = mStub->PartitionReadyStream(&lContext, lPartInfo);
+  while (lReader->Read(&lNotification)) {
+    if (lNotification.status() == TfBuilderConnectionStatus::ERROR_STF_SENDERS_NOT_READY) {
+      IDDLOG_RL(2000, "Waiting for StfSenders. ready={} total={}", lNotification.num_stf_senders_ready(),
+        lNotification.num_stf_senders());
+      continue;
+    }
+    pStatus = lNotification.status();
+    lFinal = true;
+    break;
+  }
+
+  if (lFinal) {
+    lContext.TryCancel(); // do not wait for the end of the stream
+  }
+  const auto lStatus = lReader->Finish();
+  if (!lFinal) {
+    DDDLOG("PartitionReadyWait: stream ended without the partition status. code={} error={}",
+      lStatus.error_code(), lStatus.error_message());
+  }
+  return lFinal;
+}
+
 // rpc TfBuilderConnectionRequest(TfBuilderConfigStatus) returns (TfBuilderConnectionResponse) { }
 bool TfSchedulerRpcClient::TfBuilderConnectionRequest(TfBuilderConfigStatus &pParam, TfBuilderConnectionResponse &pRet /*out*/) {
   if (!mStub || !is_alive()) {
@@ -205,9 +244,13 @@ bool TfSchedulerRpcClient::TfBuilderUpdate(TfBuilderUpdateMessage &pMsg) {
 
 
 // rpc StfSenderStfUpdate(StfSenderStfInfo) returns (SchedulerStfInfoResponse) { }
-bool TfSchedulerRpcClient::StfSenderStfUpdate(StfSenderStfInfo &pMsg, SchedulerStfInfoResponse &pRet) {
+bool TfSchedulerRpcClient::StfSenderStfUpdate(StfSenderStfInfo &pMsg, SchedulerStfInfoResponse &pRet,
+  grpc::StatusCode *pCode) {
   if (!mStub || !is_alive()) {
-    EDDLOG_GRL(2000, "NumStfSendersInPartitionRequest: no gRPC connection to scheduler");
+    EDDLOG_GRL(2000, "StfSenderStfUpdate: no gRPC connection to scheduler");
+    if (pCode) {
+      *pCode = grpc::StatusCode::UNAVAILABLE;
+    }
     return false;
   }
 
@@ -217,6 +260,9 @@ bool TfSchedulerRpcClient::StfSenderStfUpdate(StfSenderStfInfo &pMsg, SchedulerS
   updateTimeInformation(*pMsg.mutable_info());
 
   auto lStatus = mStub->StfSenderStfUpdate(&lContext, pMsg, &pRet);
+  if (pCode) {
+    *pCode = lStatus.error_code();
+  }
   if (lStatus.ok()) {
     return true;
   }
@@ -225,6 +271,40 @@ bool TfSchedulerRpcClient::StfSenderStfUpdate(StfSenderStfInfo &pMsg, SchedulerS
   return false;
 }
 
+// rpc StfSenderStfUpdateBatch(StfSenderStfInfoBatch) returns (SchedulerStfInfoBatchResponse) { }
+bool TfSchedulerRpcClient::StfSenderStfUpdateBatch(StfSenderStfInfoBatch &pMsg, SchedulerStfInfoBatchResponse &pRet,
+  grpc::StatusCode *pCode) {
+  if (!mStub || !is_alive()) {
+    EDDLOG_GRL(2000, "StfSenderStfUpdateBatch: no gRPC connection to scheduler");
+    if (pCode) {
+      *pCode = grpc::StatusCode::UNAVAILABLE;
+    }
+    return false;
+  }
+
+  ClientContext lContext;
+
+  // update timestamp
+  updateTimeInformation(*pMsg.mutable_info());
+
+  auto lStatus = mStub->StfSenderStfUpdateBatch(&lContext, pMsg, &pRet);
+  if (pCode) {
+    *pCode = lStatus.error_code();
+  }
+  if (lStatus.ok()) {
+    return true;
+  }
+
+  // older TfSchedulers: the caller falls back to StfSenderStfUpdate
+  if (lStatus.error_code() == grpc::StatusCode::UNIMPLEMENTED) {
+    return false;
+  }
+
+  EDDLOG_GRL(2000, "gRPC: StfSenderStfUpdateBatch error. code={} message={}", lStatus.error_code(),
+    lStatus.error_message());
+  return false;
+}
+
 
 }
 }
@@ -22,6 +22,7 @@
 
 #include <vector>
 #include <map>
+#include <chrono>
 #include <thread>
 
 namespace o2::DataDistribution
@@ -79,14 +80,25 @@ public:
   // rpc TfBuilderConnectionRequest(TfBuilderConfigStatus) returns (TfBuilderConnectionResponse) { }
   bool TfBuilderConnectionRequest(TfBuilderConfigStatus &pParam, TfBuilderConnectionResponse &pRet /*out*/);
 
+  // rpc PartitionReadyStream(PartitionInfo) returns (stream PartitionReadyNotification) { }
+  // Waits until the scheduler reports a final status (OK or ERROR_PARTITION_TERMINATING). Returns false if the
+  // stream is not available or failed (e.g. older scheduler, timeout); callers then fall back to polling.
+  bool PartitionReadyWait(const std::chrono::milliseconds pTimeout, TfBuilderConnectionStatus &pStatus /*out*/);
+
   // rpc TfBuilderDisconnectionRequest(TfBuilderConfigStatus) returns (StatusResponse) { }
   bool TfBuilderDisconnectionRequest(TfBuilderConfigStatus &pParam, StatusResponse &pRet /*out*/);
 
   // rpc TfBuilderUpdate(TfBuilderUpdateMessage) returns (google.protobuf.Empty) { }
   bool TfBuilderUpdate(TfBuilderUpdateMessage &pMsg);
 
+  // pCode: gRPC status code of the call (UNAVAILABLE without connection)
+
   // rpc StfSenderStfUpdate(StfSenderStfInfo) returns (SchedulerStfInfoResponse) { }
-  bool StfSenderStfUpdate(StfSenderStfInfo &pMsg, SchedulerStfInfoResponse &pRet);
+  bool StfSenderStfUpdate(StfSenderStfInfo &pMsg, SchedulerStfInfoResponse &pRet, grpc::StatusCode *pCode = nullptr);
+
+  // rpc StfSenderStfUpdateBatch(StfSenderStfInfoBatch) returns (SchedulerStfInfoBatchResponse) { }
+  bool StfSenderStfUpdateBatch(StfSenderStfInfoBatch &pMsg, SchedulerStfInfoBatchResponse &pRet,
+    grpc::StatusCode *pCode = nullptr);
 
   std::string getEndpoint() { return mTfSchedulerConf.rpc_endpoint(); }
 
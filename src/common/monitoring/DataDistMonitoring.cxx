@@ -23,6 +23,124 @@
 namespace o2::DataDistribution
 {
 
+////////////////////////////////////////////////////////////////////////////////
+/// DataDistMetricSlots
+////////////////////////////////////////////////////////////////////////////////
+
+std::size_t DataDistMetricSlots::register_metric(const char *pName, const char *pKey)
+{
+  std::scoped_lock lLock(sLock);
+
+  for (std::size_t i = 0; i < sMetrics.size(); i++) {
+    if (sMetrics[i].first == pName && sMetrics[i].second == pKey) {
+      return i;
+    }
+  }
+
+  if (sMetrics.size() >= cMaxMetrics) {
+    EDDLOG("Too many pre-registered metrics. Metric is not recorded. name={} key={} max={}", pName, pKey, cMaxMetrics);
+    return cMaxMetrics;
+  }
+
+  sMetrics.emplace_back(pName, pKey);
+  return sMetrics.size() - 1;
+}
+
+DataDistMetricSlots::ThreadBlock* DataDistMetricSlots::acquire_block()
+{
+  // release the block when the thread exits
+  struct BlockRef {
+    ThreadBlock *mBlock = nullptr;
+    ~BlockRef() {
+      if (mBlock) {
+        sThreadBlock = nullptr;
+        mBlock->mInUse = false;
+      }
+    }
+  };
+  static thread_local BlockRef tBlockRef;
+
+  std::scoped_lock lLock(sLock);
+
+  for (auto &lBlock : sBlocks) {
+    if (!lBlock->mInUse) {
+      lBlock->mInUse = true;
+      sThreadBlock = lBlock.get();
+      break;
+    }
+  }
+
+  if (!sThreadBlock) {
+    sBlocks.push_back(std::make_unique<ThreadBlock>());
+    sThreadBlock = sBlocks.back().get();
+  }
+
+  tBlockRef.mBlock = sThreadBlock;
+  return sThreadBlock;
+}
+
+void DataDistMetricSlots::collect(std::vector<std::tuple<std::string, std::string, Aggregate>> &pOut)
+{
+  const std::uint64_t lEpoch = sEpoch.fetch_add(1, std::memory_order_acq_rel);
+
+  std::scoped_lock lLock(sLock);
+
+  for (std::size_t lIdx = 0; lIdx < sMetrics.size(); lIdx++) {
+    Aggregate lAggr;
+
+    for (const auto &lBlock : sBlocks) {
+      const Slot &lSlot = lBlock->mSlots[lIdx][lEpoch & 1];
+      if (lSlot.mEpoch.load(std::memory_order_acquire) != lEpoch) {
+        continue;
+      }
+
+      const auto lCount = lSlot.mCount.load(std::memory_order_relaxed);
+      const auto lMin = lSlot.mMin.load(std::memory_order_relaxed);
+      const auto lMax = lSlot.mMax.load(std::memory_order_relaxed);
+
+      lAggr.mMin = (lAggr.mCount == 0) ? lMin : std::min(lAggr.mMin, lMin);
+      lAggr.mMax = (lAggr.mCount == 0) ? lMax : std::max(lAggr.mMax, lMax);
+      lAggr.mCount += lCount;
+      lAggr.mSum += lSlot.mSum.load(std::memory_order_relaxed);
+    }
+
+    if (lAggr.mCount > 0) {
+      pOut.emplace_back(sMetrics[lIdx].first, sMetrics[lIdx].second, lAggr);
+    }
+  }
+}
+
+LogLinearHistogram* DataDistMetricSlots::register_histogram(const char *pName, const char *pKey)
+{
+  std::scoped_lock lLock(sLock);
+
+  for (const auto &[lName, lKey, lHist] : sHistograms) {
+    if (lName == pName && lKey == pKey) {
+      return lHist.get();
+    }
+  }
+
+  sHistograms.emplace_back(pName, pKey, std::make_unique<LogLinearHistogram>());
+  return std::get<2>(sHistograms.back()).get();
+}
+
+void DataDistMetricSlots::collect_histograms(
+  std::vector<std::tuple<std::string, std::string, LogLinearHistogram::Snapshot>> &pOut)
+{
+  std::scoped_lock lLock(sLock);
+
+  for (auto &[lName, lKey, lHist] : sHistograms) {
+    auto lSnap = lHist->snapshot_reset();
+    if (lSnap.mCount > 0) {
+      pOut.emplace_back(lName, lKey, std::move(lSnap));
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// DataDistMonitoring
+////////////////////////////////////////////////////////////////////////////////
+
 DataDistMonitoring::DataDistMonitoring(const ProcessType pProc, const std::string &pUriList)
 {
   using namespace o2::monitoring;
@@ -86,25 +204,30 @@ void DataDistMonitoring::MetricCollectionThread()
 
   DDDLOG("Starting monitoring collection thread for {}...", mUriList);
 
+  std::vector<std::tuple<std::string, std::string, double>> lMetrics;
+
   while (mRunning) {
-    auto lMetric = mMetricsQueue.pop_wait_for(std::chrono::milliseconds(250));
-    if (!mActive || !lMetric) {
+    lMetrics.clear();
+    mMetricsQueue.pop_n(1024, std::chrono::milliseconds(250), std::back_inserter(lMetrics));
+    if (!mActive || lMetrics.empty()) {
       std::scoped_lock lLock(mMetricLock);
       mMetricMap.clear();
       continue;
     }
 
-    const std::string &lMetricName = std::get<0>(lMetric.value());
-    const std::string &lKey = std::get<1>(lMetric.value());
-    const double lValue = std::get<2>(lMetric.value());
-
     std::scoped_lock lLock(mMetricLock);
 
-    auto &lMetricObj = mMetricMap[lMetricName];
-    lMetricObj.mMetricName = lMetricName;
-    // make sure not to overflow if the backend is not working
-    if (lMetricObj.mKeyValueVectors[lKey].size() < (size_t(1) << 20)) {
-      lMetricObj.mKeyValueVectors[lKey].push_back(lValue);
+    for (const auto &lMetric : lMetrics) {
+      const std::string &lMetricName = std::get<0>(lMetric);
+      const std::string &lKey = std::get<1>(lMetric);
+      const double lValue = std::get<2>(lMetric);
+
+      auto &lMetricObj = mMetricMap[lMetricName];
+      lMetricObj.mMetricName = lMetricName;
+      // make sure not to overflow if the backend is not working
+      if (lMetricObj.mKeyValueVectors[lKey].size() < (size_t(1) << 20)) {
+        lMetricObj.mKeyValueVectors[lKey].push_back(lValue);
+      }
     }
   }
 
@@ -117,8 +240,20 @@ void DataDistMonitoring::MonitorThread()
 
   DDDLOG("Starting monitoring sender thread for {}...", mUriList);
 
+  std::vector<std::tuple<std::string, std::string, DataDistMetricSlots::Aggregate>> lSlotMetrics;
+  std::vector<std::tuple<std::string, std::string, LogLinearHistogram::Snapshot>> lHistMetrics;
+
   while (mRunning) {
     std::this_thread::sleep_for(std::chrono::milliseconds(mMonitoringIntervalMs));
+
+    // start a new interval of the pre-registered metrics
+    lSlotMetrics.clear();
+    lHistMetrics.clear();
+    if (mCollectSlots) {
+      DataDistMetricSlots::collect(lSlotMetrics);
+      DataDistMetricSlots::collect_histograms(lHistMetrics);
+    }
+
     if (!mActive) {
       std::scoped_lock lLock(mMetricLock);
       mMetricMap.clear();
@@ -128,10 +263,12 @@ void DataDistMonitoring::MonitorThread()
     {
       std::scoped_lock lLock(mMetricLock);
 
-      if (mMetricMap.empty()) {
+      if (mMetricMap.empty() && lSlotMetrics.empty() && lHistMetrics.empty()) {
         continue;
       }
 
+      std::map<std::string, o2::monitoring::Metric> lMetrics;
+
       for (const auto &lMetricIter : mMetricMap) {
         const DataDistMetric &lMetricObj = lMetricIter.second;
 
@@ -139,7 +276,8 @@ void DataDistMonitoring::MonitorThread()
         const auto &lKeyValMaps = lMetricObj.mKeyValueVectors;
         const auto &lTimeStamp = lMetricObj.mTimestamp;
 
-        o2::monitoring::Metric lMetric(lMetricName, Metric::DefaultVerbosity, lTimeStamp);
+        auto &lMetric = lMetrics.try_emplace(lMetricName, lMetricName, Metric::DefaultVerbosity,
+          lTimeStamp).first->second;
 
         for (const auto &lKeyValsIter : lKeyValMaps) {
 
@@ -157,6 +295,31 @@ void DataDistMonitoring::MonitorThread()
           lMetric.addValue(*lMinMax.first, lKey + "_min");
           lMetric.addValue(*lMinMax.second, lKey + "_max");
         }
+      }
+
+      // pre-registered metrics are already aggregated
+      for (const auto &[lMetricName, lKey, lAggr] : lSlotMetrics) {
+        auto &lMetric = lMetrics.try_emplace(lMetricName, lMetricName, Metric::DefaultVerbosity,
+          std::chrono::system_clock::now()).first->second;
+
+        lMetric.addValue(lAggr.mSum / lAggr.mCount, lKey);
+        lMetric.addValue(lAggr.mMin, lKey + "_min");
+        lMetric.addValue(lAggr.mMax, lKey + "_max");
+      }
+
+      for (const auto &[lMetricName, lKey, lSnap] : lHistMetrics) {
+        auto &lMetric = lMetrics.try_emplace(lMetricName, lMetricName, Metric::DefaultVerbosity,
+          std::chrono::system_clock::now()).first->second;
+
+        lMetric.addValue(double(LogLinearHistogram::percentile(lSnap, 50.0)), lKey + ".p50");
+        lMetric.addValue(double(LogLinearHistogram::percentile(lSnap, 90.0)), lKey + ".p90");
+        lMetric.addValue(double(LogLinearHistogram::percentile(lSnap, 99.0)), lKey + ".p99");
+        lMetric.addValue(double(LogLinearHistogram::percentile(lSnap, 99.9)), lKey + ".p999");
+        lMetric.addValue(double(lSnap.mMax), lKey + ".max");
+      }
+
+      for (auto &lMetricIter : lMetrics) {
+        auto &lMetric = lMetricIter.second;
 
         // log
         if (mLogMetric) {
@@ -203,6 +366,7 @@ std::unique_ptr<DataDistMonitoring> DataDistMonitor::mSchedMon = nullptr;
 void DataDistMonitor::start_datadist(const ProcessType pProc, const std::string &pDatadistUris)
 {
   mDataDistMon = std::make_unique<DataDistMonitoring>(pProc, pDatadistUris);
+  mDataDistMon->set_collect_slots(true);
 }
 void DataDistMonitor::stop_datadist()
 {
@@ -21,10 +21,16 @@
 #include <Monitoring/DerivedMetrics.h>
 
 #include "ConcurrentQueue.h"
+#include "Utilities.h"
 
 #include <memory>
 #include <string>
 #include <tuple>
+#include <array>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <limits>
 
 namespace o2::DataDistribution
 {
@@ -37,6 +43,118 @@ struct DataDistMetric {
 };
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// DataDistMetricSlots
+////////////////////////////////////////////////////////////////////////////////
+
+/// Pre-registered metrics, aggregated per thread (count, sum, min, max) without locks or allocations
+///
+/// Every thread records into its own block of slots. Each slot has two buckets selected by the epoch.
+/// At every monitoring interval the collector advances the epoch and reads the previous buckets. A value
+/// recorded concurrently with the epoch change can be missed.
+class DataDistMetricSlots {
+public:
+  static constexpr std::size_t cMaxMetrics = 256;
+
+  struct Aggregate {
+    std::uint64_t mCount = 0;
+    double mSum = 0.0;
+    double mMin = 0.0;
+    double mMax = 0.0;
+  };
+
+  /// returns the metric index, or cMaxMetrics if there are too many metrics
+  static std::size_t register_metric(const char *pName, const char *pKey);
+
+  static inline void record(const std::size_t pIdx, const double pVal)
+  {
+    ThreadBlock *lBlock = sThreadBlock ? sThreadBlock : acquire_block();
+    const std::uint64_t lEpoch = sEpoch.load(std::memory_order_acquire);
+    Slot &lSlot = lBlock->mSlots[pIdx][lEpoch & 1];
+
+    // only the owning thread writes to the slot
+    if (lSlot.mEpoch.load(std::memory_order_relaxed) != lEpoch) {
+      lSlot.mCount.store(1, std::memory_order_relaxed);
+      lSlot.mSum.store(pVal, std::memory_order_relaxed);
+      lSlot.mMin.store(pVal, std::memory_order_relaxed);
+      lSlot.mMax.store(pVal, std::memory_order_relaxed);
+      lSlot.mEpoch.store(lEpoch, std::memory_order_release);
+      return;
+    }
+
+    lSlot.mCount.store(lSlot.mCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    lSlot.mSum.store(lSlot.mSum.load(std::memory_order_relaxed) + pVal, std::memory_order_relaxed);
+    if (pVal < lSlot.mMin.load(std::memory_order_relaxed)) {
+      lSlot.mMin.store(pVal, std::memory_order_relaxed);
+    }
+    if (pVal > lSlot.mMax.load(std::memory_order_relaxed)) {
+      lSlot.mMax.store(pVal, std::memory_order_relaxed);
+    }
+  }
+
+  /// start a new interval and aggregate the values of the previous one: <name, key, aggregate>
+  static void collect(std::vector<std::tuple<std::string, std::string, Aggregate>> &pOut);
+
+  /// shared latency histogram of the metric, published as percentiles (see DDMON_HIST)
+  static LogLinearHistogram* register_histogram(const char *pName, const char *pKey);
+
+  /// take the histograms of the previous interval: <name, key, snapshot>
+  static void collect_histograms(std::vector<std::tuple<std::string, std::string, LogLinearHistogram::Snapshot>> &pOut);
+
+private:
+  struct Slot {
+    std::atomic_uint64_t mEpoch = std::numeric_limits<std::uint64_t>::max();
+    std::atomic_uint64_t mCount = 0;
+    std::atomic<double> mSum = 0.0;
+    std::atomic<double> mMin = 0.0;
+    std::atomic<double> mMax = 0.0;
+  };
+
+  struct alignas(64) ThreadBlock {
+    std::array<std::array<Slot, 2>, cMaxMetrics> mSlots;
+    std::atomic_bool mInUse = true;
+  };
+
+  static ThreadBlock* acquire_block();
+
+  inline static thread_local ThreadBlock *sThreadBlock = nullptr;
+  inline static std::atomic_uint64_t sEpoch = 0;
+
+  // blocks of exited threads are reused
+  inline static std::mutex sLock;
+  inline static std::vector<std::unique_ptr<ThreadBlock>> sBlocks;
+  inline static std::vector<std::pair<std::string, std::string>> sMetrics;
+  inline static std::vector<std::tuple<std::string, std::string, std::unique_ptr<LogLinearHistogram>>> sHistograms;
+};
+
+/// Handle of a pre-registered metric (see DDMON_STATIC)
+class DataDistMetricHandle {
+public:
+  DataDistMetricHandle(const char *pName, const char *pKey)
+  : mIdx(DataDistMetricSlots::register_metric(pName, pKey)) { }
+
+  inline void record(const double pVal) const {
+    if (mIdx < DataDistMetricSlots::cMaxMetrics) {
+      DataDistMetricSlots::record(mIdx, pVal);
+    }
+  }
+
+private:
+  const std::size_t mIdx;
+};
+
+/// Handle of a pre-registered histogram (see DDMON_HIST)
+class DataDistHistogramHandle {
+public:
+  DataDistHistogramHandle(const char *pName, const char *pKey)
+  : mHist(DataDistMetricSlots::register_histogram(pName, pKey)) { }
+
+  inline void record(const std::uint64_t pVal) const { mHist->record(pVal); }
+
+private:
+  LogLinearHistogram *const mHist;
+};
+
 class DataDistMonitoring {
 public:
   DataDistMonitoring() = delete;
@@ -62,6 +180,7 @@ public:
   void set_active(bool pActive) { mActive = pActive; }
   void set_interval(const unsigned pIntMs) { mMonitoringIntervalMs = pIntMs; }
   void set_log(bool pLog) { mLogMetric = pLog; }
+  void set_collect_slots(bool pCollect) { mCollectSlots = pCollect; }
 
 private:
 
@@ -76,6 +195,7 @@ private:
 
   bool mRunning;
   bool mActive = false;
+  bool mCollectSlots = false; // pre-registered metrics (DDMON_STATIC, DDMON_HIST)
 
   o2::monitoring::tags::Value mSubSystem;
 
@@ -97,6 +217,22 @@ private:
   }                                                                   \
 } while (0)
 
+// name and key must be constant: the metric is registered once per call site
+#define DDMON_STATIC(name, key, val) do {                             \
+  static const DataDistMetricHandle lDDMonHandle(name, key);          \
+  if (DataDistMonitor::mDataDistMon) {                                \
+    lDDMonHandle.record(val);                                         \
+  }                                                                   \
+} while (0)
+
+// integer values (e.g. latency in us), published as key.p50, key.p90, key.p99, key.p999 and key.max
+#define DDMON_HIST(name, key, val) do {                               \
+  static const DataDistHistogramHandle lDDMonHist(name, key);         \
+  if (DataDistMonitor::mDataDistMon) {                                \
+    lDDMonHist.record(val);                                           \
+  }                                                                   \
+} while (0)
+
 
 class DataDistMonitor {
 public:
@@ -138,6 +274,24 @@ public:
     }
   }
 
+  // Publish queue depth, high watermark and dwell times of all pipeline stages
+  template <class Pipeline>
+  static void publish_pipeline(const std::string_view &pName, Pipeline &pPipeline)
+  {
+    for (unsigned lStage = 0; lStage < pPipeline.getPipelineNumStages(); lStage++) {
+      const auto lStats = pPipeline.getStageStats(lStage);
+      const auto lPrefix = fmt::format("pipeline.stage{}.", lStage);
+
+      DDMON(pName, lPrefix + "depth", lStats.mDepth);
+      DDMON(pName, lPrefix + "high_watermark", lStats.mHighWatermark);
+      DDMON(pName, lPrefix + "dequeued", lStats.mNumDequeued);
+      DDMON(pName, lPrefix + "dwell_us.p50", lStats.mDwellP50Us);
+      DDMON(pName, lPrefix + "dwell_us.p90", lStats.mDwellP90Us);
+      DDMON(pName, lPrefix + "dwell_us.p99", lStats.mDwellP99Us);
+      DDMON(pName, lPrefix + "dwell_us.max", lStats.mDwellMaxUs);
+    }
+  }
+
   static std::unique_ptr<DataDistMonitoring> mDataDistMon;
   static std::unique_ptr<DataDistMonitoring> mSchedMon;
 
@@ -0,0 +1,114 @@
+// Copyright CERN and copyright holders of ALICE O2. This software is
+// distributed under the terms of the GNU General Public License v3 (GPL
+// Version 3), copied verbatim in the file "COPYING".
+//
+// See http://alice-o2.web.cern.ch/license for full licensing information.
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#ifndef ALICEO2_DATADIST_TEST_STF_UTILS_H_
+#define ALICEO2_DATADIST_TEST_STF_UTILS_H_
+
+#include <boost/test/unit_test.hpp>
+
+#include <MemoryUtils.h>
+#include <SubTimeFrameBuilder.h>
+#include <ReadoutDataModel.h>
+
+#include <fairmq/FairMQTransportFactory.h>
+
+#include <Headers/RAWDataHeader.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace o2::DataDistribution::test
+{
+
+constexpr std::size_t cHbfSize = 8192 + 64; // one data page and the stop page
+
+// HBFrames of one equipment, with RDH V6 pages
+inline
+std::vector<FairMQMessagePtr> makeHbFrames(FairMQTransportFactory &pTransport, const unsigned pEquipment,
+  const std::uint32_t pFirstOrbit, const unsigned pNumHbf)
+{
+  using RDH = o2::header::RAWDataHeaderV6;
+
+  std::vector<FairMQMessagePtr> lMsgs;
+  for (unsigned h = 0; h < pNumHbf; h++) {
+    auto lMsg = pTransport.CreateMessage(cHbfSize);
+    char *lData = reinterpret_cast<char*>(lMsg->GetData());
+    std::memset(lData, 0, cHbfSize);
+
+    for (unsigned p = 0; p < 2; p++) {
+      RDH lRdh;
+      lRdh.feeId = std::uint16_t(pEquipment);
+      lRdh.linkID = std::uint8_t(pEquipment);
+      lRdh.cruID = 0x20;
+      lRdh.orbit = pFirstOrbit + h;
+      lRdh.memorySize = (p < 1) ? 8192 : sizeof(RDH);
+      lRdh.offsetToNext = (p < 1) ? 8192 : sizeof(RDH);
+      lRdh.pageCnt = p;
+      lRdh.stop = (p == 1);
+      std::memcpy(lData + p * 8192, &lRdh, sizeof(RDH));
+    }
+    lMsgs.push_back(std::move(lMsg));
+  }
+  return lMsgs;
+}
+
+// shmem transport and a readout STF builder, for tests working with whole STFs
+struct StfBuilderFixture {
+  StfBuilderFixture(const unsigned pNumEquipments, const unsigned pNumHbf)
+  : mNumEquipments(pNumEquipments),
+    mNumHbf(pNumHbf)
+  {
+    ReadoutDataUtils::sRdhVersion = ReadoutDataUtils::eRdhVer6;
+    RDHReader::Initialize(6);
+
+    mTransport = FairMQTransportFactory::CreateTransportFactory("shmem", "datadist-test-" + std::to_string(getpid()));
+    mReadoutMemRes = std::make_unique<MemoryResources>(mTransport);
+    mStfBuilder = std::make_unique<SubTimeFrameReadoutBuilder>(*mReadoutMemRes, false, mReadoutCtx);
+  }
+
+  ~StfBuilderFixture()
+  {
+    mStfBuilder->stop();
+  }
+
+  // one STF with mNumHbf HBFrames of each of the mNumEquipments TPC equipments
+  std::unique_ptr<SubTimeFrame> buildStf(const std::uint32_t pStfId)
+  {
+    for (unsigned e = 0; e < mNumEquipments; e++) {
+      auto lHbFrames = makeHbFrames(*mTransport, e, pStfId * 256, mNumHbf);
+
+      ReadoutSubTimeframeHeader lHdr;
+      lHdr.mTimeFrameId = pStfId;
+      lHdr.mTimeframeOrbitFirst = pStfId * 256;
+      lHdr.mLinkId = std::uint8_t(e);
+
+      mStfBuilder->addHbFrames(o2::header::gDataOriginTPC, e, lHdr, lHbFrames.begin(), lHbFrames.size());
+    }
+    auto lStf = mStfBuilder->getStf();
+    BOOST_REQUIRE(lStf && *lStf);
+    return std::move(*lStf);
+  }
+
+  const unsigned mNumEquipments;
+  const unsigned mNumHbf;
+
+  std::shared_ptr<FairMQTransportFactory> mTransport;
+  ReadoutDataContext mReadoutCtx;
+  std::unique_ptr<MemoryResources> mReadoutMemRes;
+  std::unique_ptr<SubTimeFrameReadoutBuilder> mStfBuilder;
+};
+
+} /* namespace o2::DataDistribution::test */
+
+#endif /* ALICEO2_DATADIST_TEST_STF_UTILS_H_ */
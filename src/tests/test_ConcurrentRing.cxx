@@ -0,0 +1,99 @@
+// Copyright CERN and copyright holders of ALICE O2. This software is
+// distributed under the terms of the GNU General Public License v3 (GPL
+// Version 3), copied verbatim in the file "COPYING".
+//
+// See http://alice-o2.web.cern.ch/license for full licensing information.
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE "ConcurrentRing"
+
+#include <boost/test/unit_test.hpp>
+
+#include <ConcurrentQueue.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace o2::DataDistribution;
+using namespace std::chrono_literals;
+
+BOOST_AUTO_TEST_CASE(SpscRingOrderTest)
+{
+  ConcurrentSpscRing<std::unique_ptr<std::uint64_t>> lRing(16);
+  constexpr std::uint64_t cNumElems = 100000;
+
+  std::thread lProducer([&]() {
+    for (std::uint64_t i = 0; i < cNumElems; i++) {
+      lRing.push(std::make_unique<std::uint64_t>(i));
+    }
+  });
+
+  std::uint64_t lExpected = 0;
+  std::unique_ptr<std::uint64_t> lElem;
+  while (lExpected < cNumElems && lRing.pop(lElem)) {
+    BOOST_REQUIRE(*lElem == lExpected);
+    lExpected++;
+  }
+  lProducer.join();
+
+  BOOST_CHECK(lExpected == cNumElems);
+  BOOST_CHECK(lRing.empty());
+}
+
+BOOST_AUTO_TEST_CASE(MpmcRingCountTest)
+{
+  ConcurrentMpmcRing<std::uint64_t> lRing(64);
+  constexpr std::uint64_t cNumElems = 50000;
+  constexpr unsigned cNumThreads = 4;
+
+  std::atomic_uint64_t lSum = 0;
+  std::vector<std::thread> lProducers, lConsumers;
+
+  for (unsigned t = 0; t < cNumThreads; t++) {
+    lProducers.emplace_back([&]() {
+      for (std::uint64_t i = 1; i <= cNumElems; i++) {
+        lRing.push(i);
+      }
+    });
+    lConsumers.emplace_back([&]() {
+      std::uint64_t lElem;
+      while (lRing.pop(lElem)) {
+        lSum += lElem;
+      }
+    });
+  }
+
+  for (auto &lThread : lProducers) {
+    lThread.join();
+  }
+  while (!lRing.empty()) {
+    std::this_thread::yield();
+  }
+  lRing.stop();
+  for (auto &lThread : lConsumers) {
+    lThread.join();
+  }
+
+  BOOST_CHECK(lSum == cNumThreads * cNumElems * (cNumElems + 1) / 2);
+}
+
+BOOST_AUTO_TEST_CASE(RingStopTest)
+{
+  ConcurrentMpmcRing<int> lRing(4);
+  int lElem;
+
+  // timeout on empty ring
+  BOOST_CHECK(!lRing.pop_wait_for(lElem, 10ms));
+
+  // elements are still returned after stop
+  BOOST_CHECK(lRing.push(1));
+  lRing.stop();
+  BOOST_CHECK(!lRing.push(2));
+  BOOST_CHECK(lRing.pop(lElem) && lElem == 1);
+  BOOST_CHECK(!lRing.pop(lElem));
+}
@@ -0,0 +1,66 @@
+// Copyright CERN and copyright holders of ALICE O2. This software is
+// distributed under the terms of the GNU General Public License v3 (GPL
+// Version 3), copied verbatim in the file "COPYING".
+//
+// See http://alice-o2.web.cern.ch/license for full licensing information.
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE "Crc32c"
+
+#include <boost/test/unit_test.hpp>
+
+#include <Crc32c.h>
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace o2::DataDistribution;
+
+BOOST_AUTO_TEST_CASE(Crc32cCheckValueTest)
+{
+  const char *lCheck = "123456789";
+
+  BOOST_CHECK(Crc32c::compute(lCheck, std::strlen(lCheck)) == 0xE3069283);
+  BOOST_CHECK(Crc32c::computeSoftware(lCheck, std::strlen(lCheck)) == 0xE3069283);
+  BOOST_CHECK(Crc32c::compute(lCheck, 0) == 0);
+
+  // 32 bytes of zeros (RFC 3720)
+  const std::vector<unsigned char> lZeros(32, 0);
+  BOOST_CHECK(Crc32c::compute(lZeros.data(), lZeros.size()) == 0x8A9136AA);
+}
+
+BOOST_AUTO_TEST_CASE(Crc32cImplementationsTest)
+{
+  std::mt19937_64 lGen(42);
+  std::vector<unsigned char> lData(1 << 16);
+  for (auto &lByte : lData) {
+    lByte = lGen();
+  }
+
+  for (std::size_t lLen : { 1, 7, 8, 31, 32, 33, 1000, 4096, 65535 }) {
+    // unaligned start
+    const auto *lStart = lData.data() + (lLen % 7);
+    lLen = std::min(lLen, lData.size() - (lLen % 7));
+
+    const auto lCrc = Crc32c::compute(lStart, lLen);
+    BOOST_CHECK(lCrc == Crc32c::computeSoftware(lStart, lLen));
+
+    // checksum in parts
+    const auto lSplit = lLen / 3;
+    BOOST_CHECK(lCrc == Crc32c::compute(lStart + lSplit, lLen - lSplit, Crc32c::compute(lStart, lSplit)));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(Crc32cCorruptionTest)
+{
+  std::vector<unsigned char> lData(8192, 0x5a);
+  const auto lCrc = Crc32c::compute(lData.data(), lData.size());
+
+  lData[4321] ^= 0x10;
+  BOOST_CHECK(lCrc != Crc32c::compute(lData.data(), lData.size()));
+}
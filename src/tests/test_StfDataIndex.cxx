@@ -0,0 +1,208 @@
+// Copyright CERN and copyright holders of ALICE O2. This software is
+// distributed under the terms of the GNU General Public License v3 (GPL
+// Version 3), copied verbatim in the file "COPYING".
+//
+// See http://alice-o2.web.cern.ch/license for full licensing information.
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE "StfDataIndex"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/mpl/list.hpp>
+
+#include <SubTimeFrameDataModel.h>
+#include <SubTimeFrameDataIndex.h>
+
+#include <map>
+#include <set>
+#include <vector>
+
+using namespace o2::DataDistribution;
+
+namespace
+{
+
+// stand-in for StfData: records the order blocks were added in
+struct TestBlock {
+  std::uint32_t mSeq;
+};
+
+struct TestBlockVector : public std::vector<TestBlock> { };
+
+struct TestCapacity {
+  static std::size_t capacity(const EquipmentIdentifier &) { return 4; }
+};
+
+// both layouts are tested regardless of DATADIST_STF_FLAT_INDEX
+using MapIndex = impl::StfDataMapIndex<EquipmentIdentifier, TestBlock, TestBlockVector, TestCapacity>;
+using FlatIndex = impl::StfDataFlatIndex<EquipmentIdentifier, TestBlock>;
+using IndexTypes = boost::mpl::list<MapIndex, FlatIndex>;
+
+using Content = std::map<EquipmentIdentifier, std::vector<std::uint32_t>>;
+
+const EquipmentIdentifier cTpc0(o2::header::gDataDescriptionRawData, o2::header::gDataOriginTPC, 0);
+const EquipmentIdentifier cTpc1(o2::header::gDataDescriptionRawData, o2::header::gDataOriginTPC, 1);
+const EquipmentIdentifier cIts0(o2::header::gDataDescriptionRawData, o2::header::gDataOriginITS, 0);
+const EquipmentIdentifier cTof7(o2::header::gDataDescriptionRawData, o2::header::gDataOriginTOF, 7);
+
+// equipments must be visited once each, with blocks in arrival order
+template <class IndexT>
+Content content(IndexT &pIndex)
+{
+  Content lContent;
+  pIndex.for_each([&](const EquipmentIdentifier &pEqId, const typename IndexT::Range &pRange) {
+    BOOST_CHECK(lContent.count(pEqId) == 0);
+    auto &lSeqs = lContent[pEqId];
+    for (const auto &lBlock : pRange) {
+      lSeqs.push_back(lBlock.mSeq);
+    }
+  });
+  return lContent;
+}
+
+template <class IndexT>
+std::set<EquipmentIdentifier> modified(IndexT &pIndex, const bool pAll = false)
+{
+  std::set<EquipmentIdentifier> lModified;
+  pIndex.for_each_modified([&](const EquipmentIdentifier &pEqId, const typename IndexT::Range &) {
+    lModified.insert(pEqId);
+  }, pAll);
+  return lModified;
+}
+
+} /* namespace */
+
+BOOST_AUTO_TEST_SUITE(StfDataIndexLayouts)
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(AddFinalizeFind, IndexT, IndexTypes)
+{
+  IndexT lIndex;
+  BOOST_CHECK(lIndex.empty());
+
+  // interleaved, and not in equipment order
+  lIndex.add(cTpc1, TestBlock{0});
+  lIndex.add(cTpc0, TestBlock{1});
+  lIndex.add(cTpc1, TestBlock{2});
+  lIndex.add(cIts0, TestBlock{3});
+  lIndex.add(cTpc0, TestBlock{4});
+  lIndex.finalize();
+
+  BOOST_CHECK(!lIndex.empty());
+  BOOST_CHECK(content(lIndex) == (Content{ {cTpc0, {1, 4}}, {cTpc1, {0, 2}}, {cIts0, {3}} }));
+  BOOST_CHECK_EQUAL(lIndex.equipment_ids().size(), 3U);
+
+  const auto lRange = lIndex.find(cTpc1);
+  BOOST_REQUIRE_EQUAL(lRange.size(), 2U);
+  BOOST_CHECK_EQUAL(lRange.front().mSeq, 0U);
+  BOOST_CHECK_EQUAL(lRange.back().mSeq, 2U);
+  BOOST_CHECK(lIndex.find(cTof7).empty());
+
+  // adding after finalize() regroups on the next access
+  lIndex.add(cTpc1, TestBlock{5});
+  BOOST_CHECK_EQUAL(lIndex.find(cTpc1).size(), 3U);
+  BOOST_CHECK_EQUAL(lIndex.find(cTpc1).back().mSeq, 5U);
+
+  lIndex.recycle();
+  BOOST_CHECK(lIndex.empty());
+  lIndex.add(cTof7, TestBlock{6});
+  BOOST_CHECK(content(lIndex) == (Content{ {cTof7, {6}} }));
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(ForEachModified, IndexT, IndexTypes)
+{
+  IndexT lIndex;
+  lIndex.add(cTpc0, TestBlock{0});
+  lIndex.add(cIts0, TestBlock{1});
+
+  BOOST_CHECK(modified(lIndex) == (std::set<EquipmentIdentifier>{ cTpc0, cIts0 }));
+  BOOST_CHECK(modified(lIndex).empty());
+
+  lIndex.add(cIts0, TestBlock{2});
+  lIndex.add(cTpc1, TestBlock{3});
+  BOOST_CHECK(modified(lIndex) == (std::set<EquipmentIdentifier>{ cIts0, cTpc1 }));
+  BOOST_CHECK(modified(lIndex).empty());
+
+  BOOST_CHECK(modified(lIndex, true) == (std::set<EquipmentIdentifier>{ cTpc0, cTpc1, cIts0 }));
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(Merge, IndexT, IndexTypes)
+{
+  // into an empty index
+  {
+    IndexT lIndex, lOther;
+    lOther.add(cTpc0, TestBlock{0});
+    lIndex.merge(std::move(lOther));
+    BOOST_CHECK(lOther.empty());
+    BOOST_CHECK(content(lIndex) == (Content{ {cTpc0, {0}} }));
+    BOOST_CHECK(modified(lIndex) == (std::set<EquipmentIdentifier>{ cTpc0 }));
+  }
+
+  // disjoint, and overlapping equipments
+  for (const bool lOverlap : { false, true }) {
+    IndexT lIndex, lOther;
+    lIndex.add(cTpc0, TestBlock{0});
+    lIndex.add(cIts0, TestBlock{1});
+    BOOST_CHECK_EQUAL(modified(lIndex).size(), 2U);
+
+    lOther.add(cTpc1, TestBlock{2});
+    if (lOverlap) {
+      lOther.add(cTpc0, TestBlock{3});
+    }
+
+    std::vector<EquipmentIdentifier> lOverlapping;
+    lIndex.merge(std::move(lOther), [&](const EquipmentIdentifier &pEqId) { lOverlapping.push_back(pEqId); });
+    BOOST_CHECK(lOther.empty());
+
+    if (lOverlap) {
+      BOOST_CHECK(lOverlapping == std::vector<EquipmentIdentifier>{ cTpc0 });
+      BOOST_CHECK(content(lIndex) == (Content{ {cTpc0, {0, 3}}, {cTpc1, {2}}, {cIts0, {1}} }));
+      BOOST_CHECK(modified(lIndex) == (std::set<EquipmentIdentifier>{ cTpc0, cTpc1 }));
+    } else {
+      BOOST_CHECK(lOverlapping.empty());
+      BOOST_CHECK(content(lIndex) == (Content{ {cTpc0, {0}}, {cTpc1, {2}}, {cIts0, {1}} }));
+      BOOST_CHECK(modified(lIndex) == (std::set<EquipmentIdentifier>{ cTpc1 }));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(Extract, IndexT, IndexTypes)
+{
+  IndexT lIndex, lDst;
+  lIndex.add(cTpc0, TestBlock{0});
+  lIndex.add(cIts0, TestBlock{1});
+  lIndex.add(cTpc1, TestBlock{2});
+  lIndex.add(cTpc0, TestBlock{3});
+  BOOST_CHECK_EQUAL(modified(lIndex).size(), 3U);
+
+  lIndex.extract([](const o2::header::DataIdentifier &pDataId) {
+    return pDataId.dataOrigin == o2::header::gDataOriginTPC;
+  }, lDst);
+
+  BOOST_CHECK(content(lIndex) == (Content{ {cIts0, {1}} }));
+  BOOST_CHECK(content(lDst) == (Content{ {cTpc0, {0, 3}}, {cTpc1, {2}} }));
+  BOOST_CHECK(modified(lDst) == (std::set<EquipmentIdentifier>{ cTpc0, cTpc1 }));
+
+  // nothing matches
+  lIndex.extract([](const o2::header::DataIdentifier &) { return false; }, lDst);
+  BOOST_CHECK(content(lIndex) == (Content{ {cIts0, {1}} }));
+  BOOST_CHECK_EQUAL(lDst.equipment_ids().size(), 2U);
+
+  // equipments already in the destination are appended to
+  lIndex.add(cTpc0, TestBlock{4});
+  lIndex.add(cTof7, TestBlock{5});
+  BOOST_CHECK_EQUAL(modified(lDst).size(), 0U);
+
+  lIndex.extract([](const o2::header::DataIdentifier &pDataId) {
+    return pDataId.dataOrigin != o2::header::gDataOriginITS;
+  }, lDst);
+
+  BOOST_CHECK(content(lIndex) == (Content{ {cIts0, {1}} }));
+  BOOST_CHECK(content(lDst) == (Content{ {cTpc0, {0, 3, 4}}, {cTpc1, {2}}, {cTof7, {5}} }));
+  BOOST_CHECK(modified(lDst) == (std::set<EquipmentIdentifier>{ cTpc0, cTof7 }));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,120 @@
+// Copyright CERN and copyright holders of ALICE O2. This software is
+// distributed under the terms of the GNU General Public License v3 (GPL
+// Version 3), copied verbatim in the file "COPYING".
+//
+// See http://alice-o2.web.cern.ch/license for full licensing information.
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE "StfFileIndex"
+
+#include <boost/test/unit_test.hpp>
+
+#include "StfTestUtils.h"
+
+#include <SubTimeFrameFileWriter.h>
+#include <SubTimeFrameFileReader.h>
+
+#include <boost/filesystem.hpp>
+
+using namespace o2::DataDistribution;
+using namespace o2::DataDistribution::test;
+
+namespace
+{
+
+constexpr unsigned cNumEquipments = 3;
+constexpr unsigned cNumHbf = 8;
+constexpr unsigned cNumStfs = 6;
+constexpr std::uint32_t cFirstStfId = 100;
+
+struct FileIndexFixture : public StfBuilderFixture {
+  FileIndexFixture()
+  : StfBuilderFixture(cNumEquipments, cNumHbf)
+  {
+    mFileMemRes = std::make_unique<SyncMemoryResources>(mTransport);
+    mFileBuilder = std::make_unique<SubTimeFrameFileBuilder>(*mFileMemRes, std::size_t(64) << 20,
+      std::size_t(16) << 20);
+
+    mFileName = boost::filesystem::temp_directory_path() / ("datadist-test-" + std::to_string(getpid()));
+  }
+
+  ~FileIndexFixture()
+  {
+    boost::filesystem::remove(mFileName.string() + ".footer.tf");
+    boost::filesystem::remove(mFileName.string() + ".scan.tf");
+  }
+
+  boost::filesystem::path writeFile(const std::string &pSuffix, const bool pTfIndex)
+  {
+    auto lFileName = mFileName;
+    lFileName += pSuffix;
+
+    SubTimeFrameFileWriter lWriter(lFileName, SubTimeFrameFileWriter::SidecarFormat::None,
+      SubTimeFrameFileWriter::WriteEngine::Stream, pTfIndex);
+    for (unsigned s = 0; s < cNumStfs; s++) {
+      const auto lStf = buildStf(cFirstStfId + s);
+      lStf->updateStf();
+      BOOST_REQUIRE(lWriter.write(*lStf) > 0);
+    }
+    return lFileName;
+  }
+
+  std::unique_ptr<SyncMemoryResources> mFileMemRes;
+  std::unique_ptr<SubTimeFrameFileBuilder> mFileBuilder;
+  boost::filesystem::path mFileName;
+};
+
+} /* namespace */
+
+BOOST_FIXTURE_TEST_SUITE(TfIndex, FileIndexFixture)
+
+// the footer written by the file writer and the index built by scanning a file without it must agree
+BOOST_AUTO_TEST_CASE(FooterMatchesScan)
+{
+  auto lFooterFile = writeFile(".footer.tf", true);
+  auto lScanFile = writeFile(".scan.tf", false);
+
+  SubTimeFrameFileReader lFooterReader(lFooterFile);
+  SubTimeFrameFileReader lScanReader(lScanFile);
+  BOOST_CHECK(lFooterReader.hasTfIndexFooter());
+  BOOST_CHECK(!lScanReader.hasTfIndexFooter());
+
+  const auto &lFooterIndex = lFooterReader.tfIndex();
+  const auto &lScanIndex = lScanReader.tfIndex();
+  BOOST_REQUIRE_EQUAL(lFooterIndex.size(), cNumStfs);
+  BOOST_REQUIRE_EQUAL(lScanIndex.size(), cNumStfs);
+
+  for (unsigned s = 0; s < cNumStfs; s++) {
+    BOOST_CHECK_EQUAL(lFooterIndex[s].mTfId, cFirstStfId + s);
+    BOOST_CHECK_EQUAL(lFooterIndex[s].mTfId, lScanIndex[s].mTfId);
+    BOOST_CHECK_EQUAL(lFooterIndex[s].mFirstOrbit, lScanIndex[s].mFirstOrbit);
+    BOOST_CHECK_EQUAL(lFooterIndex[s].mOffset, lScanIndex[s].mOffset);
+    BOOST_CHECK_EQUAL(lFooterIndex[s].mSize, lScanIndex[s].mSize);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(SeekAndRead)
+{
+  for (const bool lTfIndex : { true, false }) {
+    auto lFile = writeFile(lTfIndex ? ".footer.tf" : ".scan.tf", lTfIndex);
+    SubTimeFrameFileReader lReader(lFile);
+
+    BOOST_CHECK(!lReader.seek(cFirstStfId + cNumStfs));
+    BOOST_REQUIRE(lReader.seek(cFirstStfId + 3));
+
+    // the remaining TFs are read in file order, and the footer ends the file
+    for (unsigned s = 3; s < cNumStfs; s++) {
+      auto lStf = lReader.read(*mFileBuilder);
+      BOOST_REQUIRE(lStf);
+      BOOST_CHECK_EQUAL(lStf->getDataSize(), std::uint64_t(cNumEquipments) * cNumHbf * cHbfSize);
+      BOOST_CHECK_EQUAL(lStf->getEquipmentIdentifiers().size(), cNumEquipments);
+    }
+    BOOST_CHECK(!lReader.read(*mFileBuilder));
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
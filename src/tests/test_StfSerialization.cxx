@@ -0,0 +1,101 @@
+// Copyright CERN and copyright holders of ALICE O2. This software is
+// distributed under the terms of the GNU General Public License v3 (GPL
+// Version 3), copied verbatim in the file "COPYING".
+//
+// See http://alice-o2.web.cern.ch/license for full licensing information.
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE "StfSerialization"
+
+#include <boost/test/unit_test.hpp>
+
+#include "StfTestUtils.h"
+
+#include <SubTimeFrameVisitors.h>
+
+#include <fairmq/FairMQChannel.h>
+
+#include <thread>
+
+using namespace o2::DataDistribution;
+using namespace o2::DataDistribution::test;
+
+namespace
+{
+
+constexpr unsigned cNumEquipments = 4;
+constexpr unsigned cNumHbf = 16;
+
+struct SerializationFixture : public StfBuilderFixture {
+  SerializationFixture()
+  : StfBuilderFixture(cNumEquipments, cNumHbf)
+  {
+    mTfMemRes = std::make_unique<SyncMemoryResources>(mTransport);
+    mTfBuilder = std::make_unique<TimeFrameBuilder>(*mTfMemRes, false);
+    mTfBuilder->allocate_memory(std::size_t(16) << 20, std::size_t(64) << 20);
+
+    const std::string lAddress = "inproc://datadist-test-" + std::to_string(getpid());
+    mOutChan = std::make_unique<FairMQChannel>("test-out", "pair", mTransport);
+    mInChan = std::make_unique<FairMQChannel>("test-in", "pair", mTransport);
+    BOOST_REQUIRE(mOutChan->Bind(lAddress));
+    BOOST_REQUIRE(mInChan->Connect(lAddress));
+  }
+
+  // serialize and receive one STF
+  std::unique_ptr<SubTimeFrame> roundTrip(std::unique_ptr<SubTimeFrame> &&pStf, const bool pHeaderBlocks,
+    const bool pFullValidation)
+  {
+    CoalescedHdrDataSerializer lSerializer(*mOutChan, nullptr, pHeaderBlocks);
+    CoalescedHdrDataDeserializer lDeserializer(*mTfBuilder);
+    lDeserializer.setFullValidation(pFullValidation);
+
+    std::unique_ptr<SubTimeFrame> lRecv;
+    std::thread lReceiver([&]() {
+      for (unsigned i = 0; i < 10 && !lRecv; i++) {
+        lRecv = lDeserializer.deserialize(*mInChan, true);
+      }
+    });
+    lSerializer.serialize(std::move(pStf));
+    lReceiver.join();
+    return lRecv;
+  }
+
+  std::unique_ptr<SyncMemoryResources> mTfMemRes;
+  std::unique_ptr<TimeFrameBuilder> mTfBuilder;
+  std::unique_ptr<FairMQChannel> mOutChan;
+  std::unique_ptr<FairMQChannel> mInChan;
+};
+
+} /* namespace */
+
+BOOST_FIXTURE_TEST_SUITE(CoalescedHdrSerialization, SerializationFixture)
+
+BOOST_AUTO_TEST_CASE(FastPathRoundTrip)
+{
+  std::uint32_t lStfId = 1;
+
+  for (const bool lHeaderBlocks : { false, true }) {
+    for (const bool lFullValidation : { false, true }) {
+      auto lStf = buildStf(lStfId);
+      BOOST_REQUIRE(lStf);
+
+      const auto lDataSize = lStf->getDataSize();
+      const auto lEquipments = lStf->getEquipmentIdentifiers();
+
+      auto lRecv = roundTrip(std::move(lStf), lHeaderBlocks, lFullValidation);
+      BOOST_REQUIRE(lRecv);
+      BOOST_CHECK_EQUAL(lRecv->id(), lStfId);
+      BOOST_CHECK_EQUAL(lRecv->getDataSize(), lDataSize);
+      BOOST_CHECK_EQUAL(lRecv->getDataSize(), std::uint64_t(cNumEquipments) * cNumHbf * cHbfSize);
+      BOOST_CHECK(lRecv->getEquipmentIdentifiers() == lEquipments);
+
+      lStfId++;
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,146 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/// Conversion of binary sidecar files (<data file>.info.bin) to the text sidecar format
+///
+/// RDH fields of RAWDATA blocks are read from the data file. They are left out if the data file
+/// is not available.
+
+#include <SubTimeFrameFile.h>
+#include <SubTimeFrameFileWriter.h>
+#include <ReadoutDataModel.h>
+
+#include <DataDistLogger.h>
+
+#include <boost/program_options.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <string>
+
+using namespace o2::DataDistribution;
+namespace bpo = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  std::string lInputFile;
+  std::string lDataFile;
+  std::string lOutputFile;
+  unsigned lRdhVersion = 0;
+
+  bpo::options_description lOptions("Sidecar conversion options", 120);
+  lOptions.add_options()
+    ("help,h", "Print help")
+    ("input", bpo::value<std::string>(&lInputFile)->default_value(""), "Binary sidecar file (.info.bin).")
+    ("data-file", bpo::value<std::string>(&lDataFile)->default_value(""),
+      "(Sub)TimeFrame data file. Default: the input file name without the '.info.bin' suffix.")
+    ("output", bpo::value<std::string>(&lOutputFile)->default_value(""),
+      "Text sidecar file. Default: standard output.")
+    ("rdh-version", bpo::value<unsigned>(&lRdhVersion)->default_value(0),
+      "RDH version of RAWDATA blocks. Default (0): from the first RDH.");
+
+  bpo::variables_map lVm;
+  try {
+    bpo::store(bpo::parse_command_line(argc, argv, lOptions), lVm);
+    bpo::notify(lVm);
+  } catch (const std::exception &e) {
+    EDDLOG("Invalid options. what={}", e.what());
+    return -1;
+  }
+
+  if (lVm.count("help") || lInputFile.empty()) {
+    std::cout << lOptions << std::endl;
+    return lInputFile.empty() ? -1 : 0;
+  }
+
+  if (lDataFile.empty() && boost::algorithm::ends_with(lInputFile, ".info.bin")) {
+    lDataFile = lInputFile.substr(0, lInputFile.size() - std::string(".info.bin").size());
+  }
+
+  if (lRdhVersion != 0) {
+    ReadoutDataUtils::sRdhVersion = ReadoutDataUtils::RdhVersion(lRdhVersion);
+    RDHReader::Initialize(lRdhVersion);
+  }
+
+  std::ifstream lInput(lInputFile, std::ios::binary);
+  if (!lInput) {
+    EDDLOG("Cannot open the sidecar file. file={}", lInputFile);
+    return -1;
+  }
+
+  SubTimeFrameFileSidecar::FileHeader lHdr;
+  lInput.read(reinterpret_cast<char*>(&lHdr), sizeof(lHdr));
+  if (!lInput || lHdr.mMagic != SubTimeFrameFileSidecar::sMagic) {
+    EDDLOG("Not a binary sidecar file. file={}", lInputFile);
+    return -1;
+  }
+  if (lHdr.mVersion != SubTimeFrameFileSidecar::sVersion || lHdr.mRecordSize != sizeof(SubTimeFrameFileSidecar::Record)) {
+    EDDLOG("Unsupported sidecar file version. version={} record_size={}", lHdr.mVersion, lHdr.mRecordSize);
+    return -1;
+  }
+
+  std::ifstream lData;
+  if (!lDataFile.empty()) {
+    lData.open(lDataFile, std::ios::binary);
+  }
+  if (!lData.is_open()) {
+    WDDLOG("Data file is not available, RDH fields are not converted. file={}", lDataFile);
+  }
+
+  std::ofstream lOutputStream;
+  if (!lOutputFile.empty()) {
+    lOutputStream.open(lOutputFile, std::ios::trunc | std::ios::out);
+    if (!lOutputStream) {
+      EDDLOG("Cannot create the output file. file={}", lOutputFile);
+      return -1;
+    }
+  }
+  std::ostream &lOutput = lOutputFile.empty() ? std::cout : lOutputStream;
+
+  lOutput << SubTimeFrameFileWriter::sidecarTextHeader() << '\n';
+
+  SubTimeFrameFileSidecar::Record lRec;
+  std::vector<char> lBlock;
+  std::string lRow;
+  std::uint64_t lNumRecords = 0;
+
+  while (lInput.read(reinterpret_cast<char*>(&lRec), sizeof(lRec))) {
+    const char *lBlockData = nullptr;
+
+    if (lData.is_open() && lRec.mDataDescription == o2::header::gDataDescriptionRawData) {
+      lBlock.resize(lRec.mDataSize);
+      lData.seekg(lRec.mDataOffset);
+      if (lData.read(lBlock.data(), lRec.mDataSize)) {
+        lBlockData = lBlock.data();
+      } else {
+        EDDLOG_RL(1000, "Cannot read the data block. offset={} size={}", lRec.mDataOffset, lRec.mDataSize);
+        lData.clear();
+      }
+    }
+
+    lRow.clear();
+    SubTimeFrameFileWriter::sidecarTextRow(lRow, lRec, lBlockData);
+    lOutput << lRow << '\n';
+    lNumRecords++;
+  }
+
+  if (lInput.gcount() != 0) {
+    WDDLOG("Sidecar file is truncated. file={}", lInputFile);
+  }
+
+  lOutput.flush();
+  IDDLOG("Converted sidecar records. count={}", lNumRecords);
+  return 0;
+}